@@ -177,7 +177,7 @@ def build_launchers(env):
 
     dll = j(env.lib_dir, 'libcalibre-launcher.so')
     cmd = ['gcc', '-O2', '-Wl,--rpath=$ORIGIN/../lib', '-fPIC', '-o', dll, '-shared'] + objects + \
-        ['-L%s/lib' % PREFIX, '-lpython' + py_ver]
+        ['-L%s/lib' % PREFIX, '-lpython' + py_ver, '-lpthread']
     run(*cmd)
 
     src = j(base, 'main.c')
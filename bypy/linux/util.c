@@ -4,6 +4,11 @@
 #include <strings.h>
 #include <stdio.h>
 #include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static bool GUI_APP = False;
 
@@ -138,6 +143,68 @@ static void get_paths()
 }
 
 
+/* Background library preload {{{
+ *
+ * The frozen build ships a few hundred bundled .so files that get
+ * dlopened piecemeal as calibre imports its modules; on NFS homed
+ * deployments the cold reads for them dominate startup. Reading the
+ * files from a worker thread warms the page cache while the interpreter
+ * initializes on the main thread, so the dynamic loader later maps
+ * already cached pages. Set CALIBRE_NO_PRELOAD to disable.
+ */
+
+static int is_shared_library(const char *name) {
+    const char *p = strstr(name, ".so");
+    return p != NULL && (p[3] == 0 || p[3] == '.');
+}
+
+static void preload_file(const char *path) {
+    char buf[128*1024];
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    while (read(fd, buf, sizeof(buf)) > 0);
+    close(fd);
+}
+
+static void preload_tree(const char *path, int depth) {
+    DIR *d;
+    struct dirent *e;
+    struct stat st;
+    char child[2*PATH_MAX];
+
+    if (depth > 5) return;
+    d = opendir(path);
+    if (d == NULL) return;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(child, sizeof(child), "%s/%s", path, e->d_name);
+        /* lstat so symlinks are skipped, avoiding loops */
+        if (lstat(child, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) preload_tree(child, depth + 1);
+        else if (S_ISREG(st.st_mode) && is_shared_library(e->d_name)) preload_file(child);
+    }
+    closedir(d);
+}
+
+static void* preload_worker(void *arg) {
+    (void)arg;
+    preload_tree(lib_dir, 0);
+    return NULL;
+}
+
+static void start_library_preload() {
+    pthread_t worker;
+    pthread_attr_t attr;
+
+    if (getenv("CALIBRE_NO_PRELOAD") != NULL) return;
+    if (pthread_attr_init(&attr) != 0) return;
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&worker, &attr, preload_worker, NULL);
+    pthread_attr_destroy(&attr);
+}
+/* }}} */
+
 void setup_stream(const char *name, const char *errors) {
     PyObject *stream;
     char buf[100];
@@ -170,6 +237,7 @@ void initialize_interpreter(int argc, char **argv, char *outr, char *errr,
     char *encoding, *p;
 
     get_paths();
+    start_library_preload();
     char path[3*PATH_MAX];
 
     snprintf(path, sizeof(path),
@@ -1,6 +1,11 @@
 #include "util.h"
 #include <stdlib.h>
 #include <strings.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <mach-o/dyld.h>
 #include <Python.h>
@@ -25,6 +30,136 @@ report_code(const char *preamble, const char* msg, int code) {
 
 #define EXE "@executable_path/.."
 
+// Library readahead {{{
+// A cold launch spends most of its time waiting for the bundled frameworks
+// and extension modules to be paged in one at a time as they are loaded. Ask
+// the kernel (F_RDADVISE) to read them all in from a background thread, so
+// the page-in overlaps interpreter bootstrap. The list of libraries is
+// generated by walking the bundle on first run and persisted, so later
+// launches skip the walk and advise in the recorded order immediately.
+
+typedef struct {
+    char contents_dir[PATH_MAX+1];
+    char manifest_path[PATH_MAX+1];
+    char pyver[16];
+} ReadaheadInfo;
+
+static int
+is_shared_library(const char *path) {
+    const char *base, *ext;
+    base = strrchr(path, '/');
+    base = (base == NULL) ? path : base + 1;
+    ext = strrchr(base, '.');
+    if (ext != NULL) return (strcmp(ext, ".dylib") == 0 || strcmp(ext, ".so") == 0);
+    // The binaries inside frameworks have no extension
+    return strstr(path, ".framework/") != NULL;
+}
+
+static void
+readahead_path(const char *path) {
+    struct stat st;
+    struct radvisory ra;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        ra.ra_offset = 0;
+        ra.ra_count = (st.st_size > INT_MAX) ? INT_MAX : (int)st.st_size;
+        fcntl(fd, F_RDADVISE, &ra);  // advisory, failure is harmless
+    }
+    close(fd);
+}
+
+static void
+scan_and_advise(const char *dir, int depth, FILE *manifest, const char *contents_dir) {
+    DIR *d;
+    struct dirent *e;
+    char path[PATH_MAX+1];
+
+    if (depth > 10) return;
+    d = opendir(dir);
+    if (d == NULL) return;
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, PATH_MAX+1, "%s/%s", dir, e->d_name);
+        if (e->d_type == DT_DIR) scan_and_advise(path, depth+1, manifest, contents_dir);
+        else if (e->d_type == DT_REG && is_shared_library(path)) {
+            readahead_path(path);
+            if (manifest != NULL && strstr(path, contents_dir) == path)
+                fprintf(manifest, "%s\n", path + strlen(contents_dir));
+        }
+    }
+    closedir(d);
+}
+
+static void*
+readahead_worker(void *arg) {
+    ReadaheadInfo *info = (ReadaheadInfo *)arg;
+    FILE *manifest = NULL;
+    struct stat bundle_st, manifest_st;
+    char path[PATH_MAX+1], tmp_path[PATH_MAX+1], line[PATH_MAX+1];
+    size_t n;
+
+    // Regenerate the manifest if the bundle has been replaced since it was
+    // written, as happens on upgrades
+    if (stat(info->manifest_path, &manifest_st) == 0 &&
+            (stat(info->contents_dir, &bundle_st) != 0 || manifest_st.st_mtime >= bundle_st.st_mtime))
+        manifest = fopen(info->manifest_path, "r");
+
+    if (manifest != NULL) {
+        while (fgets(line, sizeof(line), manifest) != NULL) {
+            n = strlen(line);
+            while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r')) line[--n] = '\0';
+            if (n == 0 || strstr(line, "..") != NULL) continue;
+            snprintf(path, PATH_MAX+1, "%s%s", info->contents_dir, line);
+            readahead_path(path);
+        }
+        fclose(manifest);
+    } else {
+        // First run: walk the bundle, advising as we go, and persist the
+        // manifest. Failing to write it only means the walk is repeated.
+        snprintf(tmp_path, PATH_MAX+1, "%s.tmp", info->manifest_path);
+        manifest = fopen(tmp_path, "w");
+        snprintf(path, PATH_MAX+1, "%s/Frameworks", info->contents_dir);
+        scan_and_advise(path, 0, manifest, info->contents_dir);
+        snprintf(path, PATH_MAX+1, "%s/Resources/Python/lib/python%s", info->contents_dir, info->pyver);
+        scan_and_advise(path, 0, manifest, info->contents_dir);
+        snprintf(path, PATH_MAX+1, "%s/Resources/Python/site-packages", info->contents_dir);
+        scan_and_advise(path, 0, manifest, info->contents_dir);
+        if (manifest != NULL) {
+            if (fclose(manifest) == 0) rename(tmp_path, info->manifest_path);
+            else remove(tmp_path);
+        }
+    }
+    free(info);
+    return NULL;
+}
+
+static void
+start_library_readahead(const char *contents_dir, const char *pyver) {
+    ReadaheadInfo *info;
+    pthread_t worker;
+    pthread_attr_t attr;
+    const char *home;
+    char cache_dir[PATH_MAX+1];
+
+    home = getenv("HOME");
+    if (home == NULL) return;
+    info = calloc(1, sizeof(ReadaheadInfo));
+    if (info == NULL) return;
+    snprintf(cache_dir, PATH_MAX+1, "%s/Library/Caches/calibre", home);
+    mkdir(cache_dir, 0700);  // it most likely exists already
+    snprintf(info->manifest_path, PATH_MAX+1, "%s/launcher-readahead.txt", cache_dir);
+    snprintf(info->contents_dir, PATH_MAX+1, "%s", contents_dir);
+    snprintf(info->pyver, sizeof(info->pyver), "%s", pyver);
+    if (pthread_attr_init(&attr) != 0) { free(info); return; }
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&worker, &attr, readahead_worker, info) != 0) free(info);
+    pthread_attr_destroy(&attr);
+}
+// }}}
+
 static void
 set_env_vars(const char **ENV_VARS, const char **ENV_VAR_VALS, const char* exe_path) {
     int i = 0;
@@ -195,6 +330,8 @@ run(const char **ENV_VARS, const char **ENV_VAR_VALS, char *PROGRAM,
     char rpath[PATH_MAX+1], exe_path[PATH_MAX+1];
     snprintf(exe_path, PATH_MAX+1, "%s/Contents", pathPtr);
     snprintf(rpath, PATH_MAX+1, "%s/Resources", exe_path);
+    // Start paging in the bundled libraries while the interpreter boots
+    start_library_readahead(exe_path, PYVER);
     initialize_interpreter(ENV_VARS, ENV_VAR_VALS, PROGRAM, MODULE, FUNCTION, PYVER, IS_GUI,
             exe_path, rpath, argc, argv);
 
@@ -2725,6 +2725,8 @@ typedef struct
   HANDLE h; bool herr; unsigned long initial_offset;
   // for memory:
   void *buf; unsigned int len,pos; // if it's a memory block
+  // for memory that is a mapped view of a file (h and hmap then need closing):
+  bool is_map; HANDLE hmap;
 } LUFILE;
 
 
@@ -2766,22 +2768,42 @@ LUFILE *lufopen(void *z,unsigned int len,DWORD flags,ZRESULT *err)
 		canseek = (type==FILE_TYPE_DISK);
 	}
 	LUFILE *lf = new LUFILE;
+	lf->is_map=false; lf->hmap=0;
 	if (flags==ZIP_HANDLE||flags==ZIP_FILENAME)
-	{ 
+	{
 		lf->is_handle=true;
 		lf->canseek=canseek;
 		lf->h=h; lf->herr=false;
 		lf->initial_offset=0;
-		if (canseek) 
+		if (canseek)
 			lf->initial_offset = SetFilePointer(h,0,NULL,FILE_CURRENT);
+		// Map seekable files into memory, so the central directory is
+		// parsed from memory in one pass and member data feeds the
+		// inflater directly from the view, with no seek/read traffic.
+		// Failure just leaves the handle-backed mode in place.
+		if (canseek)
+		{ DWORD sizehigh=0; DWORD size=GetFileSize(h,&sizehigh);
+		  if (size!=INVALID_FILE_SIZE && sizehigh==0 && size>0)
+		  { HANDLE hmap = CreateFileMapping(h,NULL,PAGE_READONLY,0,0,NULL);
+		    if (hmap!=NULL)
+		    { void *view = MapViewOfFile(hmap,FILE_MAP_READ,0,0,0);
+		      if (view!=NULL)
+		      { lf->is_handle=false; lf->is_map=true; lf->hmap=hmap;
+		        lf->buf=view; lf->len=size; lf->pos=0;
+		        lf->initial_offset=0; // absolute positions; any sfx prefix is handled as byte_before_the_zipfile
+		      }
+		      else CloseHandle(hmap);
+		    }
+		  }
+		}
 	}
 	else
-	{ 
+	{
 		lf->is_handle=false;
 		lf->canseek=true;
-		lf->buf=z; 
-		lf->len=len; 
-		lf->pos=0; 
+		lf->buf=z;
+		lf->len=len;
+		lf->pos=0;
 		lf->initial_offset=0;
 	}
 	*err=ZR_OK;
@@ -2791,7 +2813,8 @@ LUFILE *lufopen(void *z,unsigned int len,DWORD flags,ZRESULT *err)
 
 int lufclose(LUFILE *stream)
 { if (stream==NULL) return EOF;
-  if (stream->is_handle) CloseHandle(stream->h);
+  if (stream->is_map) {UnmapViewOfFile(stream->buf); CloseHandle(stream->hmap); CloseHandle(stream->h);}
+  else if (stream->is_handle) CloseHandle(stream->h);
   delete stream;
   return 0;
 }
@@ -2882,6 +2905,7 @@ typedef struct
 	unz_file_info cur_file_info; // public info about the current file in zip
 	unz_file_info_internal cur_file_info_internal; // private info about it
     file_in_zip_read_info_s* pfile_in_zip_read; // structure about the current file if we are decompressing it
+    uLong *entry_offsets;       // central dir position of every entry, built in one pass for memory backed archives (NULL otherwise)
 } unz_s, *unzFile;
 
 
@@ -3101,6 +3125,28 @@ unzFile unzOpenInternal(LUFILE *fin)
 
   unz_s *s = (unz_s*)zmalloc(sizeof(unz_s));
   *s=us;
+  s->entry_offsets = NULL;
+  // For memory backed archives walk the central directory once, up front,
+  // into a contiguous array of entry positions so that any entry can be
+  // reached directly instead of re-walking from the first entry.
+  if (!fin->is_handle && s->gi.number_entry>0)
+  { uLong *offs = (uLong*)zmalloc(s->gi.number_entry*sizeof(uLong));
+    if (offs!=NULL)
+    { unsigned char *base = (unsigned char*)fin->buf;
+      uLong pos = s->offset_central_dir;
+      uLong i; bool ok=true;
+      for (i=0; i<s->gi.number_entry; i++)
+      { uLong abspos = pos + s->byte_before_the_zipfile;
+        if (abspos+SIZECENTRALDIRITEM > fin->len) {ok=false; break;}
+        unsigned char *p = base+abspos;
+        if (p[0]!=0x50 || p[1]!=0x4b || p[2]!=0x01 || p[3]!=0x02) {ok=false; break;}
+        offs[i] = pos;
+        pos += SIZECENTRALDIRITEM + (p[28]|(p[29]<<8)) + (p[30]|(p[31]<<8)) + (p[32]|(p[33]<<8));
+      }
+      if (ok) s->entry_offsets = offs;
+      else zfree(offs);
+    }
+  }
   unzGoToFirstFile((unzFile)s);
   return (unzFile)s;
 }
@@ -3122,6 +3168,7 @@ int unzClose (unzFile file)
         unzCloseCurrentFile(file);
 
 	lufclose(s->file);
+	if (s->entry_offsets) zfree(s->entry_offsets);
 	if (s) zfree(s); // unused s=0;
 	return UNZ_OK;
 }
@@ -3629,15 +3676,30 @@ int unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
   while (pfile_in_zip_read_info->stream.avail_out>0)
   { if ((pfile_in_zip_read_info->stream.avail_in==0) && (pfile_in_zip_read_info->rest_read_compressed>0))
-    { uInt uReadThis = UNZ_BUFSIZE;
-      if (pfile_in_zip_read_info->rest_read_compressed<uReadThis) uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
-      if (uReadThis == 0) return UNZ_EOF;
-      if (lufseek(pfile_in_zip_read_info->file, pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile,SEEK_SET)!=0) return UNZ_ERRNO;
-      if (lufread(pfile_in_zip_read_info->read_buffer,uReadThis,1,pfile_in_zip_read_info->file)!=1) return UNZ_ERRNO;
-      pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
-      pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
-      pfile_in_zip_read_info->stream.next_in = (Byte*)pfile_in_zip_read_info->read_buffer;
-      pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
+    { LUFILE *f = pfile_in_zip_read_info->file;
+      uLong abspos = pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile;
+      if (!f->is_handle)
+      { // memory backed: hand the inflater the whole remaining compressed
+        // span directly out of the archive, no intermediate buffer
+        uLong uReadThis = pfile_in_zip_read_info->rest_read_compressed;
+        if (uReadThis == 0) return UNZ_EOF;
+        if (abspos+uReadThis > f->len) return UNZ_ERRNO;
+        pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
+        pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
+        pfile_in_zip_read_info->stream.next_in = (Byte*)f->buf + abspos;
+        pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
+      }
+      else
+      { uInt uReadThis = UNZ_BUFSIZE;
+        if (pfile_in_zip_read_info->rest_read_compressed<uReadThis) uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+        if (uReadThis == 0) return UNZ_EOF;
+        if (lufseek(f,abspos,SEEK_SET)!=0) return UNZ_ERRNO;
+        if (lufread(pfile_in_zip_read_info->read_buffer,uReadThis,1,f)!=1) return UNZ_ERRNO;
+        pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
+        pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
+        pfile_in_zip_read_info->stream.next_in = (Byte*)pfile_in_zip_read_info->read_buffer;
+        pfile_in_zip_read_info->stream.avail_in = (uInt)uReadThis;
+      }
     }
 
     if (pfile_in_zip_read_info->compression_method==0)
@@ -3912,8 +3974,20 @@ ZRESULT TUnzip::Get(int index,ZIPENTRY *ze)
     ze->unc_size=0;
     return ZR_OK;
   }
-  if (index<(int)uf->num_file) unzGoToFirstFile(uf);
-  while ((int)uf->num_file<index) unzGoToNextFile(uf);
+  if (uf->entry_offsets!=NULL)
+  { // jump straight to the entry via the table built at open time
+    if ((int)uf->num_file!=index || !uf->current_file_ok)
+    { uf->pos_in_central_dir = uf->entry_offsets[index];
+      uf->num_file = (uLong)index;
+      int gres = unzlocal_GetCurrentFileInfoInternal(uf,&uf->cur_file_info,&uf->cur_file_info_internal,NULL,0,NULL,0,NULL,0);
+      uf->current_file_ok = (gres==UNZ_OK);
+      if (gres!=UNZ_OK) return ZR_CORRUPT;
+    }
+  }
+  else
+  { if (index<(int)uf->num_file) unzGoToFirstFile(uf);
+    while ((int)uf->num_file<index) unzGoToNextFile(uf);
+  }
   unz_file_info ufi; 
   char fn[MAX_PATH];
   unzGetCurrentFileInfo(uf,&ufi,fn,MAX_PATH,NULL,0,NULL,0);
@@ -4131,31 +4205,42 @@ ZRESULT TUnzip::Unzip(int index,void *dst,unsigned int len,DWORD flags)
 				ze.attr, NULL);
 	}
 
-	if (h == INVALID_HANDLE_VALUE)  
+	if (h == INVALID_HANDLE_VALUE)
 		return ZR_NOFILE;
-	
+
+	// Preallocate the output so the filesystem can place it contiguously
+	// and the writes below never have to extend the file
+	if (flags!=ZIP_HANDLE && ze.unc_size>0)
+	{ if (SetFilePointer(h,(LONG)ze.unc_size,NULL,FILE_BEGIN)!=INVALID_SET_FILE_POINTER)
+	  { SetEndOfFile(h);
+	    SetFilePointer(h,0,NULL,FILE_BEGIN);
+	  }
+	}
+
 	unzOpenCurrentFile(uf);
-	BYTE buf[16384];  
+	const unsigned int bufsize = 256*1024; // large sequential writes
+	BYTE *buf = new BYTE[bufsize];
 	bool haderr=false;
-	
+
 	for (;;)
-	{ 
-		int res = unzReadCurrentFile(uf,buf,16384);
-		if (res<0) 
+	{
+		int res = unzReadCurrentFile(uf,buf,bufsize);
+		if (res<0)
 		{
-			haderr=true; 
+			haderr=true;
 			break;
 		}
-		if (res==0) 
+		if (res==0)
 			break;
-		DWORD writ; 
+		DWORD writ;
 		BOOL bres = WriteFile(h,buf,res,&writ,NULL);
-		if (!bres) 
+		if (!bres)
 		{
-			haderr=true; 
+			haderr=true;
 			break;
 		}
 	}
+	delete[] buf;
 	bool settime=false;
 	DWORD type = GetFileType(h); 
 	if (type==FILE_TYPE_DISK && !haderr) 
@@ -531,7 +531,11 @@ def build_launchers(env, debug=False):
             '/LIBPATH:%s/libs' % env.python_base,
             'delayimp.lib', 'user32.lib', 'shell32.lib',
             'python%s.lib' % env.py_ver.replace('.', ''),
-            '/delayload:python%s.dll' % env.py_ver.replace('.', '')]
+            '/delayload:python%s.dll' % env.py_ver.replace('.', ''),
+            # user32 and shell32 are only needed for error dialogs and
+            # command line parsing, no need to load them before the
+            # readahead of the python dll has been started
+            '/delayload:user32.dll', '/delayload:shell32.dll']
     printf('Linking calibre-launcher.dll')
     run(*cmd)
 
@@ -110,23 +110,93 @@ static BOOL load_data(LPVOID *data, DWORD *sz) {
     return true;
 }
 
-static BOOL unzip(HZIP zipf, int nitems, IProgressDialog *pd) {
-    int i = 0;
-    ZRESULT res;
+// Members of the archive are independent, so extraction is pipelined
+// across worker threads: each worker opens the archive through its own
+// file handle (no shared read state), claims the next member index off a
+// shared counter, and inflates+writes it. The main thread only drives
+// the progress dialog, which is apartment threaded COM and must not be
+// touched from the workers.
+
+#define MAX_EXTRACT_WORKERS 8
+
+struct ExtractState {
+    LPCWSTR zipfile;
+    int nitems;
+    volatile LONG next_item;
+    volatile LONG items_done;
+    volatile LONG failed;
+    ZRESULT zerr;
+    WCHAR failed_name[MAX_PATH];
+};
+
+static DWORD WINAPI extract_worker(LPVOID arg) {
+    struct ExtractState *es = (struct ExtractState *)arg;
+    HANDLE h;
+    HZIP zipf;
     ZIPENTRYW ze;
+    ZRESULT res;
+    LONG i;
 
-    for (i = 0; i < nitems; i++) {
-        res = GetZipItem(zipf, i, &ze);
-        if (res != ZR_OK) { show_zip_error(L"Failed to get zip item", L"", res); return false;}
-        
-        res = UnzipItem(zipf, i, ze.name, 0, ZIP_FILENAME);
-        if (res != ZR_OK) { CloseZip(zipf); show_zip_error(L"Failed to extract zip item (is your disk full?):", ze.name, res); return false;}
+    h = CreateFile(es->zipfile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) { InterlockedExchange(&es->failed, 1); return 1; }
+    zipf = OpenZip(h, 0, ZIP_HANDLE);
+    if (zipf == 0) { CloseHandle(h); InterlockedExchange(&es->failed, 1); return 1; }
 
-        pd->SetLine(2, ze.name, true, NULL);
-        pd->SetProgress(i, nitems);
+    while (!es->failed) {
+        i = InterlockedIncrement(&es->next_item) - 1;
+        if (i >= es->nitems) break;
+        ze.name[0] = 0;
+        res = GetZipItem(zipf, i, &ze);
+        if (res == ZR_OK) res = UnzipItem(zipf, i, ze.name, 0, ZIP_FILENAME);
+        if (res != ZR_OK) {
+            // record only the first failure, the rest just stop
+            if (InterlockedExchange(&es->failed, 1) == 0) {
+                es->zerr = res;
+                lstrcpynW(es->failed_name, ze.name, MAX_PATH);
+            }
+            break;
+        }
+        InterlockedIncrement(&es->items_done);
     }
 
     CloseZip(zipf);
+    CloseHandle(h);
+    return 0;
+}
+
+static BOOL unzip(LPCWSTR zipfile, int nitems, IProgressDialog *pd) {
+    struct ExtractState es = {0};
+    SYSTEM_INFO si;
+    HANDLE threads[MAX_EXTRACT_WORKERS];
+    DWORD nthreads, i;
+
+    es.zipfile = zipfile;
+    es.nitems = nitems;
+
+    GetSystemInfo(&si);
+    nthreads = si.dwNumberOfProcessors;
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > MAX_EXTRACT_WORKERS) nthreads = MAX_EXTRACT_WORKERS;
+
+    for (i = 0; i < nthreads; i++) {
+        threads[i] = CreateThread(NULL, 0, extract_worker, &es, 0, NULL);
+        if (threads[i] == NULL) { nthreads = i; break; }
+    }
+    if (nthreads == 0) { show_last_error(L"Failed to create extraction threads"); return false; }
+
+    while (!es.failed && es.items_done < nitems) {
+        pd->SetProgress(es.items_done, nitems);
+        Sleep(100);
+    }
+    WaitForMultipleObjects(nthreads, threads, TRUE, INFINITE);
+    for (i = 0; i < nthreads; i++) CloseHandle(threads[i]);
+    pd->SetProgress(es.items_done, nitems);
+
+    if (es.failed) {
+        if (es.zerr != ZR_OK) show_zip_error(L"Failed to extract zip item (is your disk full?):", es.failed_name, es.zerr);
+        else show_last_error(L"Failed to extract portable data");
+        return false;
+    }
 
     return true;
 }
@@ -139,7 +209,9 @@ static HANDLE temp_file(LPWSTR name) {
 
     if (res == 0) { show_last_error(L"Failed to create temporary file to decompress portable data"); return INVALID_HANDLE_VALUE; }
 
-    h = CreateFile(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    // Shared for reading so that the extraction workers can open the file
+    // through their own handles
+    h = CreateFile(name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (h == INVALID_HANDLE_VALUE) { show_last_error(L"Failed to open temp file to decompress portable data"); }
     return h;
 
@@ -250,11 +322,12 @@ static BOOL extract(LPVOID cdata, DWORD csz) {
     if (zipf == 0) { show_last_error(L"Failed to open zipped portable data"); ret = false; goto end; }
 
     res = GetZipItem(zipf, -1, &ze);
-    if (res != ZR_OK) { show_zip_error(L"Failed to get count of items in portable data", L"", res); ret = false; goto end;}
+    if (res != ZR_OK) { CloseZip(zipf); show_zip_error(L"Failed to get count of items in portable data", L"", res); ret = false; goto end;}
     nitems = ze.index;
+    CloseZip(zipf);  // the extraction workers open their own handles
 
     pd->SetLine(1, L"Copying files...", true, NULL);
-    if (!unzip(zipf, nitems, pd)) { ret = false; goto end; }
+    if (!unzip(tempnam, nitems, pd)) { ret = false; goto end; }
 end:
     pd->StopProgressDialog();
     pd->Release();
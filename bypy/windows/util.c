@@ -120,6 +120,62 @@ wchar_t* get_app_dirw() {
 }
 
 
+// Startup readahead {{{
+// When the install is on a network share or cold spinning media, startup is
+// dominated by the loader faulting in python dll pages and the zipimporter
+// reading pylib.zip piecemeal. Read both files sequentially into the system
+// cache from a background thread started before the python dll is loaded, so
+// that the expensive I/O overlaps import resolution and interpreter startup.
+// Purely an optimization, all failures are ignored.
+
+static DWORD WINAPI
+readahead_worker(LPVOID arg) {
+    char **paths = (char**)arg;
+    char *buf;
+    HANDLE f;
+    DWORD nread;
+    int i;
+
+    buf = (char*)malloc(1024*1024);
+    if (buf != NULL) {
+        for (i = 0; paths[i] != NULL; i++) {
+            f = CreateFileA(paths[i], GENERIC_READ,
+                    FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL,
+                    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (f == INVALID_HANDLE_VALUE) continue;
+            while (ReadFile(f, buf, 1024*1024, &nread, NULL) && nread > 0);
+            CloseHandle(f);
+        }
+    }
+    free(buf);
+    for (i = 0; paths[i] != NULL; i++) free(paths[i]);
+    free(paths);
+    return 0;
+}
+
+static void
+start_readahead(void) {
+    char *app_dir, **paths;
+    HANDLE thread;
+    size_t l;
+
+    app_dir = get_app_dir();
+    paths = (char**)calloc(3, sizeof(char*));
+    if (!paths) { free(app_dir); return; }
+    l = strlen(app_dir) + 40;
+    paths[0] = (char*)calloc(l, sizeof(char));
+    paths[1] = (char*)calloc(l, sizeof(char));
+    if (paths[0] && paths[1]) {
+        _snprintf_s(paths[0], l, _TRUNCATE, "%s\\app\\DLLs\\%s", app_dir, python_dll);
+        _snprintf_s(paths[1], l, _TRUNCATE, "%s\\app\\pylib.zip", app_dir);
+        thread = CreateThread(NULL, 0, readahead_worker, paths, 0, NULL);
+        if (thread != NULL) { CloseHandle(thread); paths = NULL; }  // the worker frees paths
+    }
+    if (paths != NULL) { free(paths[0]); free(paths[1]); free(paths); }
+    free(app_dir);
+}
+// }}}
+
 void load_python_dll() {
     char *app_dir, *dll_dir, *qt_plugin_dir;
     size_t l;
@@ -381,6 +437,9 @@ execute_python_entrypoint(const char *basename, const char *module, const char *
     // Prevent Windows' idiotic error dialog popups when various win32 api functions fail
     SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOALIGNMENTFAULTEXCEPT | SEM_NOGPFAULTERRORBOX | SEM_NOOPENFILEERRORBOX);
 
+    // Start paging in the python dll and stdlib zip while we set up
+    start_readahead();
+
     if (is_gui_app) {
         // Redirect stdout and stderr to NUL so that python does not fail writing to them
         redirect_out_stream(stdout);
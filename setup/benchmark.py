@@ -0,0 +1,30 @@
+#!/usr/bin/env python2
+# vim:fileencoding=utf-8
+# License: GPLv3 Copyright: 2026, Kovid Goyal <kovid at kovidgoyal.net>
+
+from __future__ import absolute_import, division, print_function, unicode_literals
+
+from setup import Command
+
+
+class Benchmark(Command):
+
+    description = 'Run microbenchmarks for the native extensions, emitting JSON timings'
+
+    sub_commands = ['build']
+
+    def add_options(self, parser):
+        parser.add_option('--benchmark-module', default=[], action='append',
+                          help='The benchmark to run (can be specified more than once for multiple benchmarks).'
+                          ' By default all benchmarks are run.')
+        parser.add_option('--benchmark-repeats', type=int, default=5,
+                          help='Number of timed repetitions per benchmark (default: %default)')
+        parser.add_option('--benchmark-output', default=None,
+                          help='Write the JSON timing report to this file instead of stdout')
+
+    def run(self, opts):
+        from calibre.utils.benchmarks import run_benchmarks
+        run_benchmarks(
+            names=frozenset(opts.benchmark_module) or None,
+            repeats=opts.benchmark_repeats, outfile=opts.benchmark_output
+        )
@@ -106,6 +106,18 @@ def is_ext_allowed(ext):
     return True
 
 
+# The hot, pure native extensions that benefit from profile guided
+# optimization, mapped to the benchmarks from calibre.utils.benchmarks
+# used as their training run
+PGO_TRAINING = {
+    'matcher': ('matcher',),
+    'imageops': ('imageops',),
+    'tokenizer': ('tokenize_flat',),
+    'lzx': ('lzx',),
+    'lzma_binding': ('lzma_xz',),
+}
+
+
 def parse_extension(ext):
     ext = ext.copy()
     ext.pop('only', None)
@@ -257,13 +269,17 @@ class Build(Command):
             help='Path to directory in which to place object files during the build process, defaults to "build"')
         parser.add_option('--output-dir', default=None,
             help='Path to directory in which to place the built extensions. Defaults to src/calibre/plugins')
+        parser.add_option('--pgo', default=False, action='store_true',
+            help='Rebuild the hot extension modules (%s) with profile guided optimization and link time'
+            ' optimization, using the microbenchmarks from setup.py benchmark as the training run.'
+            ' Unix only.' % ', '.join(sorted(PGO_TRAINING)))
 
     def run(self, opts):
         if opts.no_compile:
             self.info('--no-compile specified, skipping compilation')
             return
         self.env = init_env()
-        extensions = map(parse_extension, filter(is_ext_allowed, read_extensions()))
+        extensions = list(map(parse_extension, filter(is_ext_allowed, read_extensions())))
         self.build_dir = os.path.abspath(opts.build_dir or self.DEFAULT_BUILDDIR)
         self.output_dir = os.path.abspath(opts.output_dir or self.DEFAULT_OUTPUTDIR)
         self.obj_dir = os.path.join(self.build_dir, 'objects')
@@ -288,6 +304,8 @@ class Build(Command):
             self.build(ext, dest)
         if opts.only in {'all', 'headless'}:
             self.build_headless()
+        if opts.pgo:
+            self.build_pgo(extensions, opts.only)
 
     def dest(self, ext):
         ex = '.pyd' if iswindows else '.so'
@@ -355,6 +373,66 @@ class Build(Command):
                     if os.path.exists(x):
                         os.remove(x)
 
+    def build_pgo(self, extensions, only):
+        # Rebuild the hot extensions twice: once instrumented for
+        # profiling, with the relevant microbenchmarks as the training
+        # run, then again using the collected profiles, with LTO (thin
+        # LTO when compiling with clang, since gcc LTO is always "fat")
+        if iswindows:
+            self.warn('PGO builds are not supported on windows (MSVC uses /GENPROFILE + /LTCG, which needs a'
+                      ' different pipeline), skipping')
+            return
+        hot = [ext for ext in extensions if ext.name in PGO_TRAINING and not ext.error and
+               not (ext.needs_py2 and ispy3) and (only in ('all', 'headless') or only == ext.name)]
+        if not hot:
+            return
+        profile_dir = self.j(self.build_dir, 'pgo')
+        if os.path.exists(profile_dir):
+            shutil.rmtree(profile_dir)
+        os.makedirs(profile_dir)
+        is_clang = 'clang' in self.b(self.env.cc)
+        lto = '-flto=thin' if is_clang else '-flto'
+
+        def rebuild(extra_flags):
+            for ext in hot:
+                # Discard objects from previous phases so the extension
+                # is actually recompiled with the new flags
+                obj_dir = self.j(self.obj_dir, ext.name)
+                if os.path.exists(obj_dir):
+                    shutil.rmtree(obj_dir)
+                dest = self.dest(ext)
+                if os.path.exists(dest):
+                    os.remove(dest)
+                saved = ext.cflags, ext.ldflags
+                ext.cflags = ext.cflags + extra_flags
+                ext.ldflags = ext.ldflags + extra_flags
+                try:
+                    self.info('\n####### Building extension', ext.name, '(PGO)', '#'*7)
+                    self.build(ext, dest)
+                finally:
+                    ext.cflags, ext.ldflags = saved
+
+        rebuild(['-fprofile-generate=' + profile_dir, lto])
+
+        self.info('\n####### Running PGO training benchmarks', '#'*7)
+        bench_names = sorted({b for ext in hot for b in PGO_TRAINING[ext.name]})
+        env = os.environ.copy()
+        env['PYTHONPATH'] = SRC + os.pathsep + env.get('PYTHONPATH', '')
+        if is_clang:
+            env['LLVM_PROFILE_FILE'] = self.j(profile_dir, 'default-%p.profraw')
+        self.check_call([sys.executable, self.j(SRC, 'calibre', 'utils', 'benchmarks.py')] + bench_names, env=env)
+
+        if is_clang:
+            profdata = self.j(profile_dir, 'default.profdata')
+            self.check_call(['llvm-profdata', 'merge', '-output', profdata] +
+                            glob.glob(self.j(profile_dir, '*.profraw')))
+            use_flags = ['-fprofile-use=' + profdata, lto]
+        else:
+            # -fprofile-correction tolerates the slightly inconsistent
+            # counters the multi-threaded training run produces
+            use_flags = ['-fprofile-use=' + profile_dir, '-fprofile-correction', lto]
+        rebuild(use_flags)
+
     def check_call(self, *args, **kwargs):
         """print cmdline if an error occured
 
@@ -13,7 +13,7 @@ __all__ = [
         'git_version',
         'develop', 'install',
         'kakasi', 'coffee', 'rapydscript', 'cacerts', 'recent_uas', 'resources',
-        'check', 'to3', 'unicode_check', 'iterators_check', 'test',
+        'check', 'to3', 'unicode_check', 'iterators_check', 'test', 'benchmark',
         'sdist', 'bootstrap',
         'manual', 'tag_release',
         'upload_to_server',
@@ -63,6 +63,9 @@ iterators_check = IteratorsCheck()
 from setup.test import Test
 test = Test()
 
+from setup.benchmark import Benchmark
+benchmark = Benchmark()
+
 from setup.resources import Resources, Kakasi, Coffee, CACerts, RapydScript, RecentUAs
 resources = Resources()
 kakasi = Kakasi()
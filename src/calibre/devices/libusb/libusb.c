@@ -17,6 +17,30 @@
 static PyObject *Error = NULL;
 static PyObject *cache = NULL;
 
+// Hotplug-driven caching of the device list. The device scanner polls
+// get_devices() every couple of seconds forever; without hotplug support
+// every poll re-enumerates the bus and re-reads descriptors, which wakes
+// devices and burns CPU. With hotplug support we only re-enumerate after
+// the kernel has told us something changed.
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000102)
+#define HAVE_LIBUSB_HOTPLUG 1
+#endif
+
+static PyObject *device_list = NULL;
+#ifdef HAVE_LIBUSB_HOTPLUG
+static volatile int devices_changed = 1;
+static int hotplug_registered = 0;
+static libusb_hotplug_callback_handle hotplug_handle;
+
+// Called from within libusb_handle_events*(), in the polling thread. Must
+// not touch Python state, the GIL is not held.
+static int LIBUSB_CALL on_hotplug(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data) {
+    (void)ctx; (void)dev; (void)event; (void)user_data;
+    devices_changed = 1;
+    return 0;
+}
+#endif
+
 static PyObject* format_err(int err) {
     PyErr_SetString(Error, libusb_error_name(err));
     return NULL;
@@ -70,6 +94,22 @@ static PyObject* get_devices(PyObject *self, PyObject *args) {
     libusb_device **devs = NULL, *dev = NULL;
     ssize_t count;
 
+#ifdef HAVE_LIBUSB_HOTPLUG
+    if (hotplug_registered) {
+        struct timeval tv = {0, 0};
+        // Drain any pending hotplug events; the callback marks the list dirty
+        Py_BEGIN_ALLOW_THREADS;
+        libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+        Py_END_ALLOW_THREADS;
+        if (!devices_changed && device_list != NULL)
+            // Return a shallow copy so callers cannot mutate the cache
+            return PyList_GetSlice(device_list, 0, PyList_GET_SIZE(device_list));
+        // Clear before enumerating, so a change arriving while we enumerate
+        // dirties the new list
+        devices_changed = 0;
+    }
+#endif
+
     ans = PyList_New(0);
     if (ans == NULL) return PyErr_NoMemory();
 
@@ -112,6 +152,14 @@ static PyObject* get_devices(PyObject *self, PyObject *args) {
 
     if (devs != NULL) libusb_free_device_list(devs, 1);
 
+#ifdef HAVE_LIBUSB_HOTPLUG
+    if (ans != NULL) {
+        Py_XDECREF(device_list);
+        Py_INCREF(ans);
+        device_list = ans;
+    } else devices_changed = 1; // retry the enumeration on the next poll
+#endif
+
     return ans;
 }
 
@@ -155,6 +203,19 @@ CALIBRE_MODINIT_FUNC initlibusb(void) {
         INITERROR;
     }
 
+#ifdef HAVE_LIBUSB_HOTPLUG
+    // If hotplug is unavailable (e.g. on older kernels) get_devices() simply
+    // keeps re-enumerating the bus on every call.
+    if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+        if (libusb_hotplug_register_callback(NULL,
+                    LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                    0, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+                    LIBUSB_HOTPLUG_MATCH_ANY, on_hotplug, NULL,
+                    &hotplug_handle) == LIBUSB_SUCCESS)
+            hotplug_registered = 1;
+    }
+#endif
+
     Error = PyErr_NewException("libusb.Error", NULL, NULL);
     if (Error == NULL) {
         INITERROR;
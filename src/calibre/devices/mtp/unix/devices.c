@@ -18,3 +18,58 @@ const calibre_device_entry_t calibre_mtp_device_table[] = {
     , { NULL, 0xffff, NULL, 0xffff, DEVICE_FLAG_NONE }
 };
 
+/* Hash index over the device table, so that classifying a device on a USB
+ * attach event is O(1) instead of a scan over the several thousand row
+ * table. The table only changes when this file is recompiled, so the index
+ * is built once, on first lookup. Slot count is a power of two comfortably
+ * above the table size; 0 marks an empty slot (index+1 is stored). */
+#define DEVICE_HASH_SIZE 8192
+#define DEVICE_HASH_MASK (DEVICE_HASH_SIZE - 1)
+
+static uint16_t device_hash_index[DEVICE_HASH_SIZE];
+static size_t device_table_len = 0;
+static int device_hash_built = 0;
+
+static size_t device_hash(uint16_t vendor_id, uint16_t product_id) {
+    uint32_t key = ((uint32_t)vendor_id << 16) | product_id;
+    /* Fibonacci hashing, spreads the mostly-sequential product ids well */
+    return (size_t)((key * 2654435761u) >> 19) & DEVICE_HASH_MASK;
+}
+
+static void build_device_hash(void) {
+    size_t i, slot;
+
+    for (i = 0; ; i++) {
+        const calibre_device_entry_t *e = &calibre_mtp_device_table[i];
+        if (e->vendor == NULL && e->product == NULL && e->vendor_id == 0xffff) break;
+        slot = device_hash(e->vendor_id, e->product_id);
+        /* Linear probing; duplicates keep the first (upstream) entry */
+        while (device_hash_index[slot] != 0) {
+            const calibre_device_entry_t *o = &calibre_mtp_device_table[device_hash_index[slot] - 1];
+            if (o->vendor_id == e->vendor_id && o->product_id == e->product_id) break;
+            slot = (slot + 1) & DEVICE_HASH_MASK;
+        }
+        if (device_hash_index[slot] == 0) device_hash_index[slot] = (uint16_t)(i + 1);
+    }
+    device_table_len = i;
+    device_hash_built = 1;
+}
+
+size_t calibre_mtp_device_table_len(void) {
+    if (!device_hash_built) build_device_hash();
+    return device_table_len;
+}
+
+const calibre_device_entry_t* calibre_mtp_device_lookup(uint16_t vendor_id, uint16_t product_id) {
+    size_t slot;
+
+    if (!device_hash_built) build_device_hash();
+    slot = device_hash(vendor_id, product_id);
+    while (device_hash_index[slot] != 0) {
+        const calibre_device_entry_t *e = &calibre_mtp_device_table[device_hash_index[slot] - 1];
+        if (e->vendor_id == vendor_id && e->product_id == product_id) return e;
+        slot = (slot + 1) & DEVICE_HASH_MASK;
+    }
+    return NULL;
+}
+
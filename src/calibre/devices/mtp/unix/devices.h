@@ -20,3 +20,10 @@ typedef struct calibre_device_entry_struct calibre_device_entry_t;
 
 extern const calibre_device_entry_t calibre_mtp_device_table[];
 
+/* Number of entries in calibre_mtp_device_table, excluding the sentinel */
+size_t calibre_mtp_device_table_len(void);
+
+/* O(1) lookup of a device table entry by USB ids. Returns NULL if the
+ * device is not in the table. */
+const calibre_device_entry_t* calibre_mtp_device_lookup(uint16_t vendor_id, uint16_t product_id);
+
@@ -12,6 +12,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <libmtp.h>
 
 #include "devices.h"
@@ -44,18 +47,39 @@ static PyObject *MTPError = NULL;
 #define AC_ReadOnly_with_Object_Deletion    0x0002
 
 
+// Size of the staging buffer used for file transfers. libmtp hands us data
+// in small chunks, and taking the GIL to call into Python for every chunk
+// leaves the USB bus idle, so reads and writes are staged through a buffer
+// this large.
+#define TRANSFER_BUFSIZE (4*1024*1024)
+
 typedef struct {
     PyObject *obj;
     PyObject *extra;
     PyThreadState *state;
+    unsigned char *buf;
+    uint32_t buf_pos, buf_len;
+    struct timespec last_progress;
 } ProgressCallback;
 
+static int progress_due(ProgressCallback *cb, uint64_t sent, uint64_t total) {
+    struct timespec now;
+    long ms;
+
+    if (sent >= total) return 1; /* always report completion */
+    if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) return 1;
+    ms = (long)(now.tv_sec - cb->last_progress.tv_sec) * 1000 + (long)(now.tv_nsec - cb->last_progress.tv_nsec) / 1000000;
+    if (ms >= 0 && ms < 100) return 0; /* coalesce progress reports to ~10Hz */
+    cb->last_progress = now;
+    return 1;
+}
+
 static int report_progress(uint64_t const sent, uint64_t const total, void const *const data) {
     PyObject *res;
     ProgressCallback *cb;
 
     cb = (ProgressCallback *)data;
-    if (cb->obj != NULL) {
+    if (cb->obj != NULL && progress_due(cb, sent, total)) {
         PyEval_RestoreThread(cb->state);
         res = PyObject_CallFunction(cb->obj, "KK", (unsigned long long)sent, (unsigned long long)total);
         Py_XDECREF(res);
@@ -78,25 +102,52 @@ static void dump_errorstack(LIBMTP_mtpdevice_t *dev, PyObject *list) {
     LIBMTP_Clear_Errorstack(dev);
 }
 
-static uint16_t data_to_python(void *params, void *priv, uint32_t sendlen, unsigned char *data, uint32_t *putlen) {
+// Write len bytes to the Python stream. The GIL must be held by the caller.
+static uint16_t write_to_python(ProgressCallback *cb, const unsigned char *data, uint32_t len) {
     PyObject *res;
+
+#if PY_MAJOR_VERSION >= 3
+    res = PyObject_CallMethod(cb->extra, "write", "y#", data, (Py_ssize_t)len);
+#else
+    res = PyObject_CallMethod(cb->extra, "write", "s#", data, (Py_ssize_t)len);
+#endif
+    if (res == NULL) { PyErr_Print(); return LIBMTP_HANDLER_RETURN_ERROR; }
+    Py_DECREF(res);
+    return LIBMTP_HANDLER_RETURN_OK;
+}
+
+static uint16_t data_to_python(void *params, void *priv, uint32_t sendlen, unsigned char *data, uint32_t *putlen) {
     ProgressCallback *cb;
     uint16_t ret = LIBMTP_HANDLER_RETURN_OK;
 
     cb = (ProgressCallback *)priv;
     *putlen = sendlen;
-    PyEval_RestoreThread(cb->state);
-#if PY_MAJOR_VERSION >= 3
-    res = PyObject_CallMethod(cb->extra, "write", "y#", data, (Py_ssize_t)sendlen);
-#else
-    res = PyObject_CallMethod(cb->extra, "write", "s#", data, (Py_ssize_t)sendlen);
-#endif
-    if (res == NULL) {
-        ret = LIBMTP_HANDLER_RETURN_ERROR;
-        *putlen = 0;
-        PyErr_Print();
-    } else Py_DECREF(res);
 
+    if (cb->buf != NULL) {
+        // Stage the chunk in the transfer buffer, only calling into Python
+        // when it fills up, so most chunks never touch the GIL
+        if (cb->buf_len + sendlen <= TRANSFER_BUFSIZE) {
+            memcpy(cb->buf + cb->buf_len, data, sendlen);
+            cb->buf_len += sendlen;
+            return ret;
+        }
+        PyEval_RestoreThread(cb->state);
+        if (cb->buf_len > 0) {
+            ret = write_to_python(cb, cb->buf, cb->buf_len);
+            cb->buf_len = 0;
+        }
+        if (ret == LIBMTP_HANDLER_RETURN_OK) {
+            if (sendlen >= TRANSFER_BUFSIZE) ret = write_to_python(cb, data, sendlen);
+            else { memcpy(cb->buf, data, sendlen); cb->buf_len = sendlen; }
+        }
+        if (ret != LIBMTP_HANDLER_RETURN_OK) *putlen = 0;
+        cb->state = PyEval_SaveThread();
+        return ret;
+    }
+
+    PyEval_RestoreThread(cb->state);
+    ret = write_to_python(cb, data, sendlen);
+    if (ret != LIBMTP_HANDLER_RETURN_OK) *putlen = 0;
     cb->state = PyEval_SaveThread();
     return ret;
 }
@@ -106,11 +157,44 @@ static uint16_t data_from_python(void *params, void *priv, uint32_t wantlen, uns
     ProgressCallback *cb;
     char *buf = NULL;
     Py_ssize_t len = 0;
+    uint32_t copied = 0, avail, n;
     uint16_t ret = LIBMTP_HANDLER_RETURN_ERROR;
 
     *gotlen = 0;
 
     cb = (ProgressCallback *)priv;
+
+    if (cb->buf != NULL) {
+        // Serve from the read-ahead buffer, refilling it with large reads,
+        // so that the Python stream is called far less often than libmtp
+        // asks us for data
+        while (copied < wantlen) {
+            avail = cb->buf_len - cb->buf_pos;
+            if (avail == 0) {
+                PyEval_RestoreThread(cb->state);
+                res = PyObject_CallMethod(cb->extra, "read", "k", (unsigned long)TRANSFER_BUFSIZE);
+                if (res == NULL || PyBytes_AsStringAndSize(res, &buf, &len) == -1 || len > TRANSFER_BUFSIZE) {
+                    PyErr_Print();
+                    Py_XDECREF(res);
+                    cb->state = PyEval_SaveThread();
+                    return LIBMTP_HANDLER_RETURN_ERROR;
+                }
+                memcpy(cb->buf, buf, len);
+                cb->buf_len = (uint32_t)len; cb->buf_pos = 0;
+                Py_DECREF(res);
+                cb->state = PyEval_SaveThread();
+                if (len == 0) break; /* EOF */
+                continue;
+            }
+            n = (avail < wantlen - copied) ? avail : wantlen - copied;
+            memcpy(data + copied, cb->buf + cb->buf_pos, n);
+            cb->buf_pos += n;
+            copied += n;
+        }
+        *gotlen = copied;
+        return LIBMTP_HANDLER_RETURN_OK;
+    }
+
     PyEval_RestoreThread(cb->state);
     res = PyObject_CallMethod(cb->extra, "read", "k", (unsigned long)wantlen);
     if (res != NULL && PyBytes_AsStringAndSize(res, &buf, &len) != -1 && len <= wantlen) {
@@ -367,49 +451,108 @@ Device_storage_info(Device *self, void *closure) {
 
 // Device.get_filesystem {{{
 
-static int recursive_get_files(LIBMTP_mtpdevice_t *dev, uint32_t storage_id, uint32_t parent_id, PyObject *ans, PyObject *errs, PyObject *callback, unsigned int level) {
-    LIBMTP_file_t *f, *files;
-    PyObject *entry, *r;
-    int ok = 1, recurse;
+// Listing a folder is a USB round trip that can take hundreds of
+// milliseconds, while building the Python metadata for its entries needs the
+// GIL. MTP devices only support a single session and a libmtp handle must not
+// be used from two threads at once, so the fetches themselves have to stay
+// serial; instead a worker thread runs the libmtp calls while this thread
+// converts the previous listing to Python objects, overlapping the USB wait
+// for the next folder with the object construction for the current one.
+
+struct folder_listing {
+    LIBMTP_file_t *files;
+    uint32_t storage_id, parent_id;
+    unsigned int level;
+    struct folder_listing *next;
+};
 
-    Py_BEGIN_ALLOW_THREADS;
-    files = LIBMTP_Get_Files_And_Folders(dev, storage_id, parent_id);
-    Py_END_ALLOW_THREADS;
+typedef struct {
+    LIBMTP_mtpdevice_t *dev;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct folder_listing *pending_head, *pending_tail;  // folders waiting to be fetched
+    struct folder_listing *done_head, *done_tail;  // fetched listings not yet consumed
+    int in_flight;  // enqueued folders whose listings have not been consumed yet
+    int shutdown;
+} FolderFetcher;
+
+static void* folder_fetch_worker(void *data) {
+    FolderFetcher *f = (FolderFetcher *)data;
+    struct folder_listing *r;
+
+    pthread_mutex_lock(&f->mutex);
+    while (1) {
+        while (f->pending_head == NULL && !f->shutdown) pthread_cond_wait(&f->cond, &f->mutex);
+        if (f->shutdown) break;
+        r = f->pending_head;
+        f->pending_head = r->next;
+        if (f->pending_head == NULL) f->pending_tail = NULL;
+        pthread_mutex_unlock(&f->mutex);
+
+        r->next = NULL;
+        r->files = LIBMTP_Get_Files_And_Folders(f->dev, r->storage_id, r->parent_id);
+
+        pthread_mutex_lock(&f->mutex);
+        if (f->done_tail == NULL) f->done_head = r;
+        else f->done_tail->next = r;
+        f->done_tail = r;
+        pthread_cond_broadcast(&f->cond);
+    }
+    pthread_mutex_unlock(&f->mutex);
+    return NULL;
+}
 
-    if (files == NULL) return ok;
-
-    for (f = files; ok && f != NULL; f = f->next) {
-        entry = build_file_metadata(f, storage_id);
-        if (entry == NULL) { ok = 0; }
-        else {
-            r = PyObject_CallFunction(callback, "OI", entry, level);
-            recurse = (r != NULL && PyObject_IsTrue(r)) ? 1 : 0;
-            Py_XDECREF(r);
-            if (PyList_Append(ans, entry) != 0) { ok = 0; }
-            Py_DECREF(entry);
-        }
+static int fetcher_enqueue(FolderFetcher *f, uint32_t storage_id, uint32_t parent_id, unsigned int level) {
+    struct folder_listing *r;
+
+    r = (struct folder_listing *)calloc(1, sizeof(struct folder_listing));
+    if (r == NULL) return 0;
+    r->storage_id = storage_id; r->parent_id = parent_id; r->level = level;
+    pthread_mutex_lock(&f->mutex);
+    if (f->pending_tail == NULL) f->pending_head = r;
+    else f->pending_tail->next = r;
+    f->pending_tail = r;
+    f->in_flight += 1;
+    pthread_cond_broadcast(&f->cond);
+    pthread_mutex_unlock(&f->mutex);
+    return 1;
+}
 
-        if (ok && recurse && f->filetype == LIBMTP_FILETYPE_FOLDER) {
-            if (!recursive_get_files(dev, storage_id, f->item_id, ans, errs, callback, level+1)) {
-                ok = 0;
-            }
-        }
-    }
+// Wait for the next fetched listing, with the GIL released. If no worker
+// thread could be started the fetch is simply done inline.
+static struct folder_listing* fetcher_next(FolderFetcher *f, int threaded) {
+    struct folder_listing *r = NULL;
 
-    // Release memory
-    f = files;
-    while (f != NULL) {
-        files = f; f = f->next; LIBMTP_destroy_file_t(files);
+    Py_BEGIN_ALLOW_THREADS;
+    pthread_mutex_lock(&f->mutex);
+    if (threaded) {
+        while (f->done_head == NULL) pthread_cond_wait(&f->cond, &f->mutex);
+        r = f->done_head;
+        f->done_head = r->next;
+        if (f->done_head == NULL) f->done_tail = NULL;
+    } else if (f->pending_head != NULL) {
+        r = f->pending_head;
+        f->pending_head = r->next;
+        if (f->pending_head == NULL) f->pending_tail = NULL;
     }
-
-    return ok;
+    pthread_mutex_unlock(&f->mutex);
+    if (r != NULL && !threaded) {
+        r->next = NULL;
+        r->files = LIBMTP_Get_Files_And_Folders(f->dev, r->storage_id, r->parent_id);
+    }
+    Py_END_ALLOW_THREADS;
+    return r;
 }
 
 static PyObject *
 Device_get_filesystem(Device *self, PyObject *args) {
-    PyObject *ans, *errs, *callback;
+    PyObject *ans, *errs, *callback, *entry, *r;
     unsigned long storage_id;
-    int ok = 0;
+    int ok = 1, threaded, recurse;
+    FolderFetcher fetcher;
+    pthread_t worker;
+    struct folder_listing *res, *next;
+    LIBMTP_file_t *f, *files;
 
     ENSURE_DEV(NULL); ENSURE_STORAGE(NULL);
 
@@ -420,7 +563,70 @@ Device_get_filesystem(Device *self, PyObject *args) {
     if (errs == NULL || ans == NULL) { PyErr_NoMemory(); return NULL; }
 
     LIBMTP_Clear_Errorstack(self->device);
-    ok = recursive_get_files(self->device, (uint32_t)storage_id, 0xFFFFFFFF, ans, errs, callback, 0);
+
+    memset(&fetcher, 0, sizeof(fetcher));
+    fetcher.dev = self->device;
+    pthread_mutex_init(&fetcher.mutex, NULL);
+    pthread_cond_init(&fetcher.cond, NULL);
+    // If the worker cannot be started the listings are fetched inline, which
+    // is merely slower
+    threaded = (pthread_create(&worker, NULL, folder_fetch_worker, &fetcher) == 0) ? 1 : 0;
+
+    if (!fetcher_enqueue(&fetcher, (uint32_t)storage_id, 0xFFFFFFFF, 0)) { ok = 0; PyErr_NoMemory(); }
+
+    // in_flight is only changed by this thread, so reading it without the
+    // mutex is safe
+    while (ok && fetcher.in_flight > 0) {
+        res = fetcher_next(&fetcher, threaded);
+        if (res == NULL) break;
+        files = res->files;
+        for (f = files; ok && f != NULL; f = f->next) {
+            entry = build_file_metadata(f, res->storage_id);
+            if (entry == NULL) { ok = 0; }
+            else {
+                r = PyObject_CallFunction(callback, "OI", entry, res->level);
+                recurse = (r != NULL && PyObject_IsTrue(r)) ? 1 : 0;
+                Py_XDECREF(r);
+                if (PyList_Append(ans, entry) != 0) { ok = 0; }
+                Py_DECREF(entry);
+                if (ok && recurse && f->filetype == LIBMTP_FILETYPE_FOLDER) {
+                    // Queue the subfolder so the worker can start fetching it
+                    // while the entries above are converted to Python objects
+                    if (!fetcher_enqueue(&fetcher, res->storage_id, f->item_id, res->level + 1)) { ok = 0; PyErr_NoMemory(); }
+                }
+            }
+        }
+
+        // Release memory
+        while (files != NULL) {
+            f = files; files = files->next; LIBMTP_destroy_file_t(f);
+        }
+        free(res);
+        pthread_mutex_lock(&fetcher.mutex);
+        fetcher.in_flight -= 1;
+        pthread_mutex_unlock(&fetcher.mutex);
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    pthread_mutex_lock(&fetcher.mutex);
+    fetcher.shutdown = 1;
+    pthread_cond_broadcast(&fetcher.cond);
+    pthread_mutex_unlock(&fetcher.mutex);
+    if (threaded) pthread_join(worker, NULL);
+    Py_END_ALLOW_THREADS;
+
+    // Free anything abandoned because of an error
+    for (res = fetcher.pending_head; res != NULL; res = next) { next = res->next; free(res); }
+    for (res = fetcher.done_head; res != NULL; res = next) {
+        next = res->next;
+        while (res->files != NULL) {
+            f = res->files; res->files = f->next; LIBMTP_destroy_file_t(f);
+        }
+        free(res);
+    }
+    pthread_mutex_destroy(&fetcher.mutex);
+    pthread_cond_destroy(&fetcher.cond);
+
     dump_errorstack(self->device, errs);
     if (!ok) {
         Py_DECREF(ans);
@@ -449,10 +655,19 @@ Device_get_file(Device *self, PyObject *args) {
     if (callback == NULL || !PyCallable_Check(callback)) callback = NULL;
 
     cb.obj = callback; cb.extra = stream;
+    // A failed allocation simply falls back to unbuffered transfers
+    cb.buf = (unsigned char *)malloc(TRANSFER_BUFSIZE);
+    cb.buf_pos = 0; cb.buf_len = 0;
+    memset(&cb.last_progress, 0, sizeof(cb.last_progress));
     Py_XINCREF(callback); Py_INCREF(stream);
     cb.state = PyEval_SaveThread();
     ret = LIBMTP_Get_File_To_Handler(self->device, (uint32_t)fileid, data_to_python, &cb, report_progress, &cb);
     PyEval_RestoreThread(cb.state);
+    if (ret == 0 && cb.buf != NULL && cb.buf_len > 0) {
+        // Write out whatever is still staged in the transfer buffer
+        if (write_to_python(&cb, cb.buf, cb.buf_len) != LIBMTP_HANDLER_RETURN_OK) ret = 1;
+    }
+    free(cb.buf); cb.buf = NULL;
     Py_XDECREF(callback); Py_DECREF(stream);
 
     if (ret != 0) {
@@ -482,11 +697,16 @@ Device_put_file(Device *self, PyObject *args) {
     if (callback == NULL || !PyCallable_Check(callback)) callback = NULL;
 
     cb.obj = callback; cb.extra = stream;
+    // A failed allocation simply falls back to unbuffered transfers
+    cb.buf = (unsigned char *)malloc(TRANSFER_BUFSIZE);
+    cb.buf_pos = 0; cb.buf_len = 0;
+    memset(&cb.last_progress, 0, sizeof(cb.last_progress));
     f.parent_id = (uint32_t)parent_id; f.storage_id = (uint32_t)storage_id; f.item_id = 0; f.filename = name; f.filetype = LIBMTP_FILETYPE_UNKNOWN; f.filesize = (uint64_t)filesize;
     Py_XINCREF(callback); Py_INCREF(stream);
     cb.state = PyEval_SaveThread();
     ret = LIBMTP_Send_File_From_Handler(self->device, data_from_python, &cb, &f, report_progress, &cb);
     PyEval_RestoreThread(cb.state);
+    free(cb.buf); cb.buf = NULL;
     Py_XDECREF(callback); Py_DECREF(stream);
 
     if (ret != 0) dump_errorstack(self->device, errs);
@@ -698,6 +918,17 @@ known_devices(PyObject *self, PyObject *args) {
     return ans;
 }
 
+static PyObject*
+device_flags(PyObject *self, PyObject *args) {
+    unsigned short vendor_id, product_id;
+    const calibre_device_entry_t *e;
+
+    if (!PyArg_ParseTuple(args, "HH", &vendor_id, &product_id)) return NULL;
+    e = calibre_mtp_device_lookup((uint16_t)vendor_id, (uint16_t)product_id);
+    if (e == NULL) Py_RETURN_NONE;
+    return Py_BuildValue("k", (unsigned long)e->device_flags);
+}
+
 static char libmtp_doc[] = "Interface to libmtp.";
 
 static PyMethodDef libmtp_methods[] = {
@@ -713,6 +944,10 @@ static PyMethodDef libmtp_methods[] = {
         "known_devices() -> Return the list of known (vendor_id, product_id) combinations."
     },
 
+    {"device_flags", device_flags, METH_VARARGS,
+        "device_flags(vendor_id, product_id) -> Return the device flags for the device from the device database, or None if the device is not in the database. This is an O(1) hash lookup, safe to call for every USB attach event."
+    },
+
     {NULL, NULL, 0, NULL}
 };
 
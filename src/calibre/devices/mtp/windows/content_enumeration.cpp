@@ -11,6 +11,19 @@
 
 #define ADDPROP(x) hr = properties->Add(x); if (FAILED(hr)) { hresult_set_exc("Failed to add property to filesystem properties collection", hr); properties->Release(); return NULL; }
 
+// Minimum buffer size for file transfers. Devices usually report a much
+// smaller optimal transfer size, and doing a Python call per such chunk
+// leaves the USB bus idle.
+#define TRANSFER_CHUNK (4*1024*1024)
+
+// Report progress at most every 100ms (and always at completion)
+static inline bool report_progress(ULONGLONG *last_report, ULONGLONG done, ULONGLONG total) {
+    ULONGLONG now = GetTickCount64();
+    if (done < total && now - *last_report < 100) return false;
+    *last_report = now;
+    return true;
+}
+
 namespace wpd {
 
 static IPortableDeviceKeyCollection* create_filesystem_properties_collection() { // {{{
@@ -430,11 +443,12 @@ end:
     return values;
 } // }}}
 
-static bool get_files_and_folders(unsigned int level, IPortableDevice *device, IPortableDeviceContent *content, IPortableDevicePropertiesBulk *bulk_properties, const wchar_t *parent_id, PyObject *callback, PyObject *ans) { // {{{
+static bool get_files_and_folders(unsigned int level, IPortableDevice *device, IPortableDeviceContent *content, IPortableDevicePropertiesBulk *bulk_properties, PyObject *parent_ids, PyObject *callback, PyObject *ans) { // {{{
     bool ok = true;
     IPortableDevicePropVariantCollection *object_ids = NULL;
     PyObject *subfolders = NULL;
     HRESULT hr;
+    DWORD num = 0;
 
     subfolders = PyList_New(0);
     if (subfolders == NULL) { ok = false; goto end; }
@@ -445,19 +459,27 @@ static bool get_files_and_folders(unsigned int level, IPortableDevice *device, I
     Py_END_ALLOW_THREADS;
     if (FAILED(hr)) { hresult_set_exc("Failed to create propvariantcollection", hr); ok = false; goto end; }
 
-    ok = find_objects_in(content, object_ids, parent_id);
-    if (!ok) goto end;
+    // Gather the children of every folder at this level into a single
+    // collection, so that their properties are fetched with one bulk request
+    // for the whole level, instead of one request per folder, which on large
+    // trees means thousands of USB round trips.
+    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(parent_ids); i++) {
+        const wchar_t *parent_id = unicode_to_wchar(PyList_GET_ITEM(parent_ids, i));
+        if (parent_id == NULL) { ok = false; goto end; }
+        ok = find_objects_in(content, object_ids, parent_id);
+        if (!ok) goto end;
+    }
+
+    hr = object_ids->GetCount(&num);
+    if (FAILED(hr)) { hresult_set_exc("Failed to get object id count", hr); ok = false; goto end; }
+    if (num == 0) goto end;
 
     if (bulk_properties != NULL) ok = bulk_get_filesystem(level, device, bulk_properties, object_ids, callback, ans, subfolders);
     else ok = single_get_filesystem(level, content, object_ids, callback, ans, subfolders);
     if (!ok) goto end;
 
-    for (Py_ssize_t i = 0; i < PyList_GET_SIZE(subfolders); i++) {
-        const wchar_t *child_id = unicode_to_wchar(PyList_GET_ITEM(subfolders, i));
-        if (child_id == NULL) { ok = false; break; }
-        ok = get_files_and_folders(level+1, device, content, bulk_properties, child_id, callback, ans);
-        if (!ok) break;
-    }
+    if (PyList_GET_SIZE(subfolders) > 0)
+        ok = get_files_and_folders(level+1, device, content, bulk_properties, subfolders, callback, ans);
 end:
     if (object_ids != NULL) object_ids->Release();
     Py_XDECREF(subfolders);
@@ -465,24 +487,28 @@ end:
 } // }}}
 
 PyObject* wpd::get_filesystem(IPortableDevice *device, const wchar_t *storage_id, IPortableDevicePropertiesBulk *bulk_properties, PyObject *callback) { // {{{
-    PyObject *ans = NULL;
+    PyObject *ans = NULL, *parent_ids = NULL;
     IPortableDeviceContent *content = NULL;
     HRESULT hr;
 
     ans = PyDict_New();
     if (ans == NULL) return PyErr_NoMemory();
 
+    parent_ids = Py_BuildValue("[N]", wchar_to_unicode(storage_id));
+    if (parent_ids == NULL) { Py_DECREF(ans); return NULL; }
+
     Py_BEGIN_ALLOW_THREADS;
     hr = device->Content(&content);
     Py_END_ALLOW_THREADS;
     if (FAILED(hr)) { hresult_set_exc("Failed to create content interface", hr); goto end; }
 
-    if (!get_files_and_folders(0, device, content, bulk_properties, storage_id, callback, ans)) {
+    if (!get_files_and_folders(0, device, content, bulk_properties, parent_ids, callback, ans)) {
         Py_DECREF(ans); ans = NULL;
     }
 
 end:
     if (content != NULL) content->Release();
+    Py_XDECREF(parent_ids);
     return ans;
 } // }}}
 
@@ -499,7 +525,7 @@ PyObject* wpd::get_file(IPortableDevice *device, const wchar_t *object_id, PyObj
     ULONG bytes_read = 0, total_read = 0;
     BOOL ok = FALSE;
     PyObject *res = NULL;
-    ULONGLONG filesize = 0;
+    ULONGLONG filesize = 0, last_report = 0;
 
     Py_BEGIN_ALLOW_THREADS;
     hr = device->Content(&content);
@@ -541,6 +567,11 @@ PyObject* wpd::get_file(IPortableDevice *device, const wchar_t *object_id, PyObj
         goto end;
     }
 
+    // Read in chunks much larger than the optimal transfer size the device
+    // reports, so far fewer Python write calls are needed; the stream
+    // breaks the reads up internally.
+    if (bufsize < TRANSFER_CHUNK) bufsize = TRANSFER_CHUNK;
+
     buf = (char *)calloc(bufsize+10, 1);
     if (buf == NULL) { PyErr_NoMemory(); goto end; }
 
@@ -561,7 +592,7 @@ PyObject* wpd::get_file(IPortableDevice *device, const wchar_t *object_id, PyObj
 #endif
                 if (res == NULL) break;
                 Py_DECREF(res); res = NULL;
-                if (callback != NULL) Py_XDECREF(PyObject_CallFunction(callback, "kK", total_read, filesize));
+                if (callback != NULL && report_progress(&last_report, total_read, filesize)) Py_XDECREF(PyObject_CallFunction(callback, "kK", total_read, filesize));
             }
         } else { hresult_set_exc("Failed to read file from device", hr); break; }
 
@@ -589,6 +620,146 @@ end:
     Py_RETURN_NONE;
 } // }}}
 
+PyObject* wpd::get_file_partial(IPortableDevice *device, const wchar_t *object_id, PyObject *dest, unsigned PY_LONG_LONG offset, unsigned PY_LONG_LONG count, PyObject *callback) { // {{{
+    IPortableDeviceContent *content = NULL;
+    IPortableDeviceResources *resources = NULL;
+    IPortableDeviceProperties *devprops = NULL;
+    IPortableDeviceValues *values = NULL;
+    IPortableDeviceKeyCollection *properties = NULL;
+    IStream *stream = NULL;
+    HRESULT hr;
+    DWORD bufsize = 4096;
+    char *buf = NULL;
+    ULONG bytes_read = 0;
+    ULONGLONG total_read = 0, to_skip = 0, chunk = 0;
+    BOOL ok = FALSE;
+    PyObject *res = NULL;
+    ULONGLONG filesize = 0, last_report = 0;
+    LARGE_INTEGER seek_pos;
+    ULARGE_INTEGER new_pos;
+
+    Py_BEGIN_ALLOW_THREADS;
+    hr = device->Content(&content);
+    Py_END_ALLOW_THREADS;
+    if (FAILED(hr)) { hresult_set_exc("Failed to create content interface", hr); goto end; }
+
+    Py_BEGIN_ALLOW_THREADS;
+    hr = content->Properties(&devprops);
+    Py_END_ALLOW_THREADS;
+    if (FAILED(hr)) { hresult_set_exc("Failed to get IPortableDeviceProperties interface", hr); goto end; }
+
+    Py_BEGIN_ALLOW_THREADS;
+    hr = CoCreateInstance(CLSID_PortableDeviceKeyCollection, NULL,
+            CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&properties));
+    Py_END_ALLOW_THREADS;
+    if (FAILED(hr)) { hresult_set_exc("Failed to create filesystem properties collection", hr); goto end; }
+    hr = properties->Add(WPD_OBJECT_SIZE);
+    if (FAILED(hr)) { hresult_set_exc("Failed to add filesize property to properties collection", hr); goto end; }
+
+    Py_BEGIN_ALLOW_THREADS;
+    hr = devprops->GetValues(object_id, properties, &values);
+    Py_END_ALLOW_THREADS;
+    if (FAILED(hr)) { hresult_set_exc("Failed to get filesize for object", hr); goto end; }
+    hr = values->GetUnsignedLargeIntegerValue(WPD_OBJECT_SIZE, &filesize);
+    if (FAILED(hr)) { hresult_set_exc("Failed to get filesize from values collection", hr); goto end; }
+
+    // Clamp the requested range to the actual object size
+    if (offset >= filesize) { offset = filesize; count = 0; }
+    else if (count > filesize - offset) count = filesize - offset;
+
+    Py_BEGIN_ALLOW_THREADS;
+    hr = content->Transfer(&resources);
+    Py_END_ALLOW_THREADS;
+    if (FAILED(hr)) { hresult_set_exc("Failed to create resources interface", hr); goto end; }
+
+    Py_BEGIN_ALLOW_THREADS;
+    hr = resources->GetStream(object_id, WPD_RESOURCE_DEFAULT, STGM_READ, &bufsize, &stream);
+    Py_END_ALLOW_THREADS;
+    if (FAILED(hr)) {
+        if (HRESULT_FROM_WIN32(ERROR_BUSY) == hr) {
+            PyErr_SetString(WPDFileBusy, "Object is in use");
+        } else hresult_set_exc("Failed to create stream interface to read from object", hr);
+        goto end;
+    }
+
+    if (bufsize < TRANSFER_CHUNK) bufsize = TRANSFER_CHUNK;
+
+    buf = (char *)calloc(bufsize+10, 1);
+    if (buf == NULL) { PyErr_NoMemory(); goto end; }
+
+    if (offset > 0) {
+        // Try to seek directly to the start of the range. Many MTP streams
+        // do not implement Seek(), so on failure fall back to reading and
+        // discarding the preamble, which is still much cheaper than sending
+        // it to the Python stream.
+        seek_pos.QuadPart = (LONGLONG)offset;
+        Py_BEGIN_ALLOW_THREADS;
+        hr = stream->Seek(seek_pos, STREAM_SEEK_SET, &new_pos);
+        Py_END_ALLOW_THREADS;
+        if (FAILED(hr) || new_pos.QuadPart != offset) {
+            to_skip = offset;
+            while (to_skip > 0) {
+                chunk = (to_skip < bufsize) ? to_skip : bufsize;
+                bytes_read = 0;
+                Py_BEGIN_ALLOW_THREADS;
+                hr = stream->Read(buf, (ULONG)chunk, &bytes_read);
+                Py_END_ALLOW_THREADS;
+                if (hr == STG_E_ACCESSDENIED) {
+                    PyErr_SetString(PyExc_IOError, "Read access is denied to this object"); goto end;
+                } else if (FAILED(hr)) {
+                    hresult_set_exc("Failed to read file from device", hr); goto end;
+                }
+                if (bytes_read == 0) { PyErr_SetString(WPDError, "File ended before the requested offset"); goto end; }
+                to_skip -= bytes_read;
+            }
+        }
+    }
+
+    while (total_read < count) {
+        chunk = count - total_read;
+        if (chunk > bufsize) chunk = bufsize;
+        bytes_read = 0;
+        Py_BEGIN_ALLOW_THREADS;
+        hr = stream->Read(buf, (ULONG)chunk, &bytes_read);
+        Py_END_ALLOW_THREADS;
+        total_read = total_read + bytes_read;
+        if (hr == STG_E_ACCESSDENIED) {
+            PyErr_SetString(PyExc_IOError, "Read access is denied to this object"); break;
+        } else if (SUCCEEDED(hr)) {
+            if (bytes_read > 0) {
+#if PY_MAJOR_VERSION >= 3
+                res = PyObject_CallMethod(dest, "write", "y#", buf, bytes_read);
+#else
+                res = PyObject_CallMethod(dest, "write", "s#", buf, bytes_read);
+#endif
+                if (res == NULL) break;
+                Py_DECREF(res); res = NULL;
+                if (callback != NULL && report_progress(&last_report, total_read, count)) Py_XDECREF(PyObject_CallFunction(callback, "KK", total_read, count));
+            }
+        } else { hresult_set_exc("Failed to read file from device", hr); break; }
+
+        if (bytes_read == 0) break;
+    }
+
+    if (!PyErr_Occurred()) {
+        if (total_read == count) {
+            ok = TRUE;
+            Py_XDECREF(PyObject_CallMethod(dest, "flush", NULL));
+        } else PyErr_SetString(WPDError, "Failed to read all data in the requested range from file");
+    }
+
+end:
+    if (content != NULL) content->Release();
+    if (devprops != NULL) devprops->Release();
+    if (resources != NULL) resources->Release();
+    if (stream != NULL) stream->Release();
+    if (values != NULL) values->Release();
+    if (properties != NULL) properties->Release();
+    if (buf != NULL) free(buf);
+    if (!ok) return NULL;
+    Py_RETURN_NONE;
+} // }}}
+
 PyObject* wpd::create_folder(IPortableDevice *device, const wchar_t *parent_id, const wchar_t *name) { // {{{
     IPortableDeviceContent *content = NULL;
     IPortableDeviceValues *values = NULL;
@@ -683,6 +854,7 @@ PyObject* wpd::put_file(IPortableDevice *device, const wchar_t *parent_id, const
     BOOL ok = FALSE;
     Py_ssize_t bytes_read = 0;
     ULONG bytes_written = 0, total_written = 0;
+    ULONGLONG last_report = 0;
 
     values = create_object_properties(parent_id, name, WPD_CONTENT_TYPE_GENERIC_FILE, size);
     if (values == NULL) goto end;
@@ -711,6 +883,10 @@ PyObject* wpd::put_file(IPortableDevice *device, const wchar_t *parent_id, const
     hr = temp->QueryInterface(IID_PPV_ARGS(&dest));
     if (FAILED(hr)) { hresult_set_exc("Failed to create IPortableDeviceStream", hr); goto end; }
 
+    // Read from Python in chunks much larger than the optimal transfer
+    // size the device reports; the stream breaks the writes up internally.
+    if (bufsize < TRANSFER_CHUNK) bufsize = TRANSFER_CHUNK;
+
     while(TRUE) {
         raw = PyObject_CallMethod(src, "read", "k", bufsize);
         if (raw == NULL) break;
@@ -726,7 +902,7 @@ PyObject* wpd::put_file(IPortableDevice *device, const wchar_t *parent_id, const
             if (FAILED(hr)) { hresult_set_exc("Cannot write to file", hr); break; }
             if (bytes_written != bytes_read) { PyErr_SetString(WPDError, "Writing to file failed, not all bytes were written"); break; }
             total_written += bytes_written;
-            if (callback != NULL) Py_XDECREF(PyObject_CallFunction(callback, "kK", total_written, size));
+            if (callback != NULL && report_progress(&last_report, total_written, size)) Py_XDECREF(PyObject_CallFunction(callback, "kK", total_written, size));
         } else Py_DECREF(raw);
         if (bytes_read == 0) { ok = TRUE; break; }
     }
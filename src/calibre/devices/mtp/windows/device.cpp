@@ -108,6 +108,24 @@ py_get_file(Device *self, PyObject *args) {
     return ret;
 } // }}}
 
+// get_file_partial() {{{
+static PyObject*
+py_get_file_partial(Device *self, PyObject *args) {
+    PyObject *object_id, *stream, *callback = NULL, *ret;
+    wchar_t *object;
+    unsigned long long offset, count;
+
+    if (!PyArg_ParseTuple(args, "OOKK|O", &object_id, &stream, &offset, &count, &callback)) return NULL;
+    object = unicode_to_wchar(object_id);
+    if (object == NULL) return NULL;
+
+    if (callback == NULL || !PyCallable_Check(callback)) callback = NULL;
+
+    ret = wpd::get_file_partial(self->device, object, stream, offset, count, callback);
+    free(object);
+    return ret;
+} // }}}
+
 // create_folder() {{{
 static PyObject*
 py_create_folder(Device *self, PyObject *args) {
@@ -171,6 +189,10 @@ static PyMethodDef Device_methods[] = {
      "get_file(object_id, stream, callback=None) -> Get the file identified by object_id from the device. The file is written to the stream object, which must be a file like object. If callback is not None, it must be a callable that accepts two arguments: (bytes_read, total_size). It will be called after each chunk is read from the device. Note that it can be called multiple times with the same values."
     },
 
+    {"get_file_partial", (PyCFunction)py_get_file_partial, METH_VARARGS,
+     "get_file_partial(object_id, stream, offset, count, callback=None) -> Get count bytes starting at offset from the file identified by object_id. The range is clamped to the actual file size. Much cheaper than get_file() when only a small part of a large file is needed, for example for metadata extraction. The data is written to the stream object, which must be a file like object. If callback is not None, it must be a callable that accepts two arguments: (bytes_read, count). It will be called after each chunk is read from the device. Note that it can be called multiple times with the same values."
+    },
+
     {"create_folder", (PyCFunction)py_create_folder, METH_VARARGS,
      "create_folder(parent_id, name) -> Create a folder. Returns the folder metadata."
     },
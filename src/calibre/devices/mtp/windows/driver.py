@@ -395,6 +395,22 @@ class MTP_DEVICE(MTPDeviceBase):
             stream.name = f.name
         return stream
 
+    @same_thread
+    def get_mtp_file_partial(self, f, stream, offset=0, size=None, callback=None):
+        if f.is_folder:
+            raise ValueError('%s if a folder'%(f.full_path,))
+        if size is None:
+            size = max(0, f.size - offset)
+        try:
+            try:
+                self.dev.get_file_partial(f.object_id, stream, offset, size, callback)
+            except self.wpd.WPDFileBusy:
+                time.sleep(2)
+                self.dev.get_file_partial(f.object_id, stream, offset, size, callback)
+        except Exception as e:
+            raise DeviceError('Failed to fetch the file %s with error: %s'%
+                    (f.full_path, as_unicode(e)))
+
     @same_thread
     def create_folder(self, parent, name):
         if not parent.is_folder:
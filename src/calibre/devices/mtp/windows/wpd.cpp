@@ -24,6 +24,72 @@ extern IPortableDeviceValues* wpd::get_client_information();
 extern IPortableDevice* wpd::open_device(const wchar_t *pnp_id, IPortableDeviceValues *client_information);
 extern PyObject* wpd::get_device_information(IPortableDevice *device, IPortableDevicePropertiesBulk **bulk_properties);
 
+// Device information cache {{{
+// The information queried by device_info() (capabilities, storage
+// descriptions, friendly names) is static for the lifetime of a connection,
+// but the detection poll opens the device over USB and re-queries it on every
+// call. Cache the snapshot per PnP id and serve repeat queries from memory.
+// Entries are evicted when enumerate_devices() notices the device has gone
+// away, and when the module is uninitialized.
+#define DEVICE_INFO_CACHE_SLOTS 17
+
+static struct device_info_cache_entry {
+    wchar_t *pnp_id;
+    PyObject *data;
+} device_info_cache[DEVICE_INFO_CACHE_SLOTS] = {0};
+
+static void
+device_info_cache_remove(size_t i) {
+    free(device_info_cache[i].pnp_id); device_info_cache[i].pnp_id = NULL;
+    Py_XDECREF(device_info_cache[i].data); device_info_cache[i].data = NULL;
+}
+
+static PyObject*
+device_info_cache_get(const wchar_t *pnp_id) {
+    size_t i;
+    for (i = 0; i < DEVICE_INFO_CACHE_SLOTS; i++) {
+        if (device_info_cache[i].pnp_id != NULL && wcscmp(device_info_cache[i].pnp_id, pnp_id) == 0) {
+            Py_INCREF(device_info_cache[i].data);
+            return device_info_cache[i].data;
+        }
+    }
+    return NULL;
+}
+
+static void
+device_info_cache_put(const wchar_t *pnp_id, PyObject *data) {
+    size_t i, slot;
+    for (i = 0; i < DEVICE_INFO_CACHE_SLOTS; i++) {
+        if (device_info_cache[i].pnp_id == NULL || wcscmp(device_info_cache[i].pnp_id, pnp_id) == 0) break;
+    }
+    slot = (i < DEVICE_INFO_CACHE_SLOTS) ? i : 0;
+    device_info_cache_remove(slot);
+    device_info_cache[slot].pnp_id = _wcsdup(pnp_id);
+    if (device_info_cache[slot].pnp_id == NULL) return;  // Failing to cache is not an error
+    device_info_cache[slot].data = data; Py_INCREF(data);
+}
+
+static void
+device_info_cache_prune(PWSTR *pnp_device_ids, DWORD num_of_devices) {
+    // Evict cached entries for devices that are no longer connected
+    size_t i; DWORD j; int found;
+    for (i = 0; i < DEVICE_INFO_CACHE_SLOTS; i++) {
+        if (device_info_cache[i].pnp_id == NULL) continue;
+        found = 0;
+        for (j = 0; j < num_of_devices; j++) {
+            if (pnp_device_ids[j] != NULL && wcscmp(pnp_device_ids[j], device_info_cache[i].pnp_id) == 0) { found = 1; break; }
+        }
+        if (!found) device_info_cache_remove(i);
+    }
+}
+
+static void
+device_info_cache_clear(void) {
+    size_t i;
+    for (i = 0; i < DEVICE_INFO_CACHE_SLOTS; i++) device_info_cache_remove(i);
+}
+// }}}
+
 // Module startup/shutdown {{{
 static PyObject *
 wpd_init(PyObject *self, PyObject *args) {
@@ -61,6 +127,8 @@ wpd_init(PyObject *self, PyObject *args) {
 
 static PyObject *
 wpd_uninit(PyObject *self, PyObject *args) {
+    device_info_cache_clear();
+
     if (portable_device_manager != NULL) {
         Py_BEGIN_ALLOW_THREADS;
         portable_device_manager->Release();
@@ -108,6 +176,7 @@ wpd_enumerate_devices(PyObject *self, PyObject *args) {
     Py_END_ALLOW_THREADS;
 
     if (SUCCEEDED(hr)) {
+        device_info_cache_prune(pnp_device_ids, num_of_devices);
         ans = PyTuple_New(num_of_devices);
         if (ans != NULL) {
             for(i = 0; i < num_of_devices; i++) {
@@ -147,11 +216,18 @@ wpd_device_info(PyObject *self, PyObject *args) {
     if (wcslen(pnp_id) < 1) { PyErr_SetString(WPDError, "The PNP id must not be empty."); return NULL; }
     if (pnp_id == NULL) return NULL;
 
+    ans = device_info_cache_get(pnp_id);
+    if (ans != NULL) { free(pnp_id); return ans; }
+
     client_information = get_client_information();
     if (client_information != NULL) {
         device = open_device(pnp_id, client_information);
         if (device != NULL) {
             ans = get_device_information(device, NULL);
+            // Do not cache snapshots that failed to read storage, so that the
+            // next poll retries the query
+            if (ans != NULL && PyDict_GetItemString(ans, "storage_error") == NULL)
+                device_info_cache_put(pnp_id, ans);
         }
     }
 
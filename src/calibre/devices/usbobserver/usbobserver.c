@@ -83,6 +83,69 @@ usbobserver_get_iokit_number_property(io_service_t dev, CFStringRef prop) {
 }
 
 
+// Device add/remove observer {{{
+//
+// The device scanner calls get_usb_devices() every couple of seconds,
+// forever. Instead of walking the IO registry on every poll, we register
+// IOKit matching notifications for USB device arrival and termination and
+// poll their iterators, which is a cheap in-memory check. The registry is
+// only walked when an event has actually arrived (or registration failed).
+
+static PyObject *usb_device_cache = NULL;
+static IONotificationPortRef usb_notify_port = NULL;
+static io_iterator_t usb_added_iter = 0, usb_removed_iter = 0;
+static int usb_observer_failed = 0;
+
+// We poll the notification iterators, so the callback never actually runs,
+// but IOServiceAddMatchingNotification requires one.
+static void
+usbobserver_notification_callback(void *refcon, io_iterator_t iter) {
+    (void)refcon; (void)iter;
+}
+
+static int
+usbobserver_drain_iterator(io_iterator_t iter) {
+    int num = 0;
+    io_service_t s;
+
+    while ((s = IOIteratorNext(iter))) { IOObjectRelease(s); num++; }
+    return num;
+}
+
+// Returns 1 if the set of connected devices may have changed since the
+// last call and the registry must be re-walked.
+static int
+usbobserver_usb_devices_changed(void) {
+    kern_return_t kr;
+    CFMutableDictionaryRef matchingDict;
+
+    if (usb_observer_failed) return 1;
+    if (usb_notify_port == NULL) {
+        usb_notify_port = IONotificationPortCreate(kIOMasterPortDefault);
+        if (usb_notify_port == NULL) { usb_observer_failed = 1; return 1; }
+        matchingDict = IOServiceMatching(kIOUSBDeviceClassName);
+        // IOServiceAddMatchingNotification consumes the matching dict
+        kr = matchingDict ? IOServiceAddMatchingNotification(usb_notify_port,
+                kIOFirstMatchNotification, matchingDict,
+                usbobserver_notification_callback, NULL, &usb_added_iter) : KERN_FAILURE;
+        if (kr == KERN_SUCCESS) {
+            matchingDict = IOServiceMatching(kIOUSBDeviceClassName);
+            kr = matchingDict ? IOServiceAddMatchingNotification(usb_notify_port,
+                    kIOTerminatedNotification, matchingDict,
+                    usbobserver_notification_callback, NULL, &usb_removed_iter) : KERN_FAILURE;
+        }
+        if (kr != KERN_SUCCESS) { usb_observer_failed = 1; return 1; }
+        // Drain to arm the notifications
+        usbobserver_drain_iterator(usb_added_iter);
+        usbobserver_drain_iterator(usb_removed_iter);
+        return 1;
+    }
+    return usbobserver_drain_iterator(usb_added_iter) +
+        usbobserver_drain_iterator(usb_removed_iter) > 0 || usb_device_cache == NULL;
+}
+
+// }}}
+
 static PyObject *
 usbobserver_get_usb_devices(PyObject *self, PyObject *args) {
 
@@ -93,7 +156,10 @@ usbobserver_get_usb_devices(PyObject *self, PyObject *args) {
     PyObject *vendor, *product, *bcd;
     PyObject *manufacturer, *productn, *serial;
 
-
+    if (!usbobserver_usb_devices_changed() && usb_device_cache != NULL)
+        // Nothing changed, answer from memory. A shallow copy so callers
+        // cannot mutate the cache.
+        return PyList_GetSlice(usb_device_cache, 0, PyList_GET_SIZE(usb_device_cache));
 
     //Set up matching dictionary for class IOUSBDevice and its subclasses
     matchingDict = IOServiceMatching(kIOUSBDeviceClassName);
@@ -146,6 +212,10 @@ usbobserver_get_usb_devices(PyObject *self, PyObject *args) {
 
     if (iter) IOObjectRelease(iter);
 
+    Py_XDECREF(usb_device_cache);
+    Py_INCREF(devices);
+    usb_device_cache = devices;
+
     return devices;
 }
 
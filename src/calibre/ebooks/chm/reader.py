@@ -123,6 +123,26 @@ class CHMReader(CHMFile):
     def ExtractFiles(self, output_dir=getcwd(), debug_dump=False):
         html_files = set()
         enc = self.chm_encoding
+        try:
+            # read everything in one pass so that shared LZX blocks are
+            # only decompressed once
+            bulk = self.GetAllFiles()
+        except Exception:
+            self.log.exception('Bulk CHM extraction failed, extracting per file')
+            bulk = {}
+
+        def get_data(path):
+            if path[0] != '/':
+                path = '/' + path
+            for e in (enc, 'utf-8'):
+                try:
+                    data = bulk.get(path.encode(e))
+                except UnicodeEncodeError:
+                    continue
+                if data:
+                    return data
+            return self.GetFile(path)
+
         for path in self.Contents():
             fpath = path
             if not isinstance(path, unicode_type):
@@ -130,7 +150,7 @@ class CHMReader(CHMFile):
             lpath = os.path.join(output_dir, fpath)
             self._ensure_dir(lpath)
             try:
-                data = self.GetFile(path)
+                data = get_data(path)
             except:
                 self.log.exception('Failed to extract %s from CHM, ignoring'%path)
                 continue
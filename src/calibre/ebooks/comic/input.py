@@ -84,13 +84,18 @@ class PageProcessor(list):  # {{{
     :method:`process_pages`.
     '''
 
-    def __init__(self, path_to_page, dest, opts, num):
+    def __init__(self, path_to_page, dest, opts, num, palette_hint=None):
         list.__init__(self)
         self.path_to_page = path_to_page
         self.opts         = opts
         self.num          = num
         self.dest         = dest
         self.rotate       = False
+        # Consecutive pages of a comic usually share a palette, so the
+        # palette of the previous page is used to warm start quantization
+        # and the palette used here is exported for the next page
+        self.palette_hint = palette_hint
+        self.palette      = None
         self.render()
 
     def render(self):
@@ -194,7 +199,8 @@ class PageProcessor(list):  # {{{
                 img = despeckle_image(img)
 
             if self.opts.output_format.lower() == 'png' and self.opts.colors:
-                img = quantize_image(img, max_colors=min(256, self.opts.colors))
+                img = quantize_image(img, max_colors=min(256, self.opts.colors), palette_hint=self.palette_hint)
+                self.palette = self.palette_hint = img.colorTable()
             dest = '%d_%d.%s'%(self.num, i, self.opts.output_format)
             dest = os.path.join(self.dest, dest)
             with lopen(dest, 'wb') as f:
@@ -208,9 +214,12 @@ def render_pages(tasks, dest, opts, notification=lambda x, y: x):
     Entry point for the job server.
     '''
     failures, pages = [], []
+    palette_hint = None
     for num, path in tasks:
         try:
-            pages.extend(PageProcessor(path, dest, opts, num))
+            processor = PageProcessor(path, dest, opts, num, palette_hint)
+            pages.extend(processor)
+            palette_hint = processor.palette or palette_hint
             msg = _('Rendered %s')%path
         except:
             failures.append(path)
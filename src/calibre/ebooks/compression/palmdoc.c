@@ -12,6 +12,7 @@
 
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
+#include <pythread.h>
 #include <stdio.h>
 
 #define BUFFER 6000
@@ -90,51 +91,77 @@ cpalmdoc_decompress(PyObject *self, PyObject *args) {
     return ans;
 }
 
-static bool
-cpalmdoc_memcmp( Byte *a, Byte *b, Py_ssize_t len) {
-    Py_ssize_t i;
-    for (i = 0; i < len; i++) if (a[i] != b[i]) return false;
-    return true;
-}
+// Match search. Candidate positions are kept in hash chains keyed on three
+// bytes, walked nearest-first within the 2047 byte window, and each
+// candidate is probed with eight-byte compares plus count-trailing-zeros
+// instead of byte-by-byte. Picks the longest match, nearest on ties, which
+// is the same choice the old linear rfind over every chunk length made.
+
+#define MATCH_HASH_BITS 13
+#define MATCH_HASH(data, pos) \
+    ((((unsigned int)(data)[pos] << 16) ^ ((unsigned int)(data)[(pos)+1] << 8) \
+      ^ (unsigned int)(data)[(pos)+2]) * 2654435761u >> (32 - MATCH_HASH_BITS))
 
 static Py_ssize_t
-cpalmdoc_rfind(Byte *data, Py_ssize_t pos, Py_ssize_t chunk_length) {
-    Py_ssize_t i;
-    for (i = pos - chunk_length; i > -1; i--)
-        if (cpalmdoc_memcmp(data+i, data+pos, chunk_length)) return i;
-    return pos;
+cpalmdoc_match_len(Byte *a, Byte *b, Py_ssize_t maxm) {
+    Py_ssize_t k = 0;
+#if defined(__GNUC__) || defined(__clang__)
+    uint64_t x, y;
+    while (k + 4 <= maxm) {
+        memcpy(&x, a + k, 8); memcpy(&y, b + k, 8);
+        if (x != y) return k + __builtin_ctzll(x ^ y) / 16;
+        k += 4;
+    }
+#endif
+    while (k < maxm && a[k] == b[k]) k++;
+    return k;
 }
 
-
 static Py_ssize_t
 cpalmdoc_do_compress(buffer *b, char *output) {
     Py_ssize_t i = 0, j, chunk_len, dist;
     unsigned int compound;
     Byte c, n;
-    bool found;
     char *head;
+    Byte tempbuf[8];
     buffer temp;
+    Py_ssize_t *head_tab, *prev_tab, hashed_to = 0, best_len, best_j, mlen;
     head = output;
-    temp.data = (Byte *)PyMem_Malloc(sizeof(Byte)*8); temp.len = 0;
-    if (temp.data == NULL) return 0;
+    temp.data = tempbuf; temp.len = 0;
+    head_tab = (Py_ssize_t *)malloc(sizeof(Py_ssize_t) * (1 << MATCH_HASH_BITS));
+    prev_tab = (Py_ssize_t *)malloc(sizeof(Py_ssize_t) * (b->len > 0 ? b->len : 1));
+    if (head_tab == NULL || prev_tab == NULL) {
+        free(head_tab); free(prev_tab);
+        return 0;
+    }
+    for (j = 0; j < (1 << MATCH_HASH_BITS); j++) head_tab[j] = -1;
     while (i < b->len) {
         c = b->data[i];
         //do repeats
         if ( i > 10 && (b->len - i) > 10) {
-            found = false;
-            for (chunk_len = 10; chunk_len > 2; chunk_len--) {
-                j = cpalmdoc_rfind(b->data, i, chunk_len);
-                dist = i - j;
-                if (j < i && dist <= 2047) {
-                    found = true;
-                    compound = (unsigned int)((dist << 3) + chunk_len-3);
-                    *(output++) = CHAR(0x80 + (compound >> 8 ));
-                    *(output++) = CHAR(compound & 0xFF);
-                    i += chunk_len;
-                    break;
+            while (hashed_to <= i - 3) {
+                j = MATCH_HASH(b->data, hashed_to);
+                prev_tab[hashed_to] = head_tab[j];
+                head_tab[j] = hashed_to++;
+            }
+            best_len = 0; best_j = -1;
+            for (j = head_tab[MATCH_HASH(b->data, i)];
+                    j != -1 && i - j <= 2047; j = prev_tab[j]) {
+                mlen = cpalmdoc_match_len(b->data + j, b->data + i,
+                        MIN(10, i - j));
+                if (mlen > best_len) {
+                    best_len = mlen; best_j = j;
+                    if (best_len == 10) break;
                 }
             }
-            if (found) continue;
+            if (best_len > 2) {
+                chunk_len = best_len; dist = i - best_j;
+                compound = (unsigned int)((dist << 3) + chunk_len-3);
+                *(output++) = CHAR(0x80 + (compound >> 8 ));
+                *(output++) = CHAR(compound & 0xFF);
+                i += chunk_len;
+                continue;
+            }
         }
 
         //write single character
@@ -160,10 +187,167 @@ cpalmdoc_do_compress(buffer *b, char *output) {
             for (j=0; j < temp.len; j++) *(output++) = (char)temp.data[j];
         }
     }
-    PyMem_Free(temp.data);
+    free(head_tab); free(prev_tab);
     return output - head;
 }
 
+/* Batch compression.
+ *
+ * MOBI output compresses its text as thousands of independent ~4KB records,
+ * so a whole book can be handed to a thread pool in one call. The workers
+ * use only malloc and a per-worker scratch buffer for the char-to-Byte
+ * mapped input, so they run without the GIL; per-record output buffers are
+ * turned into byte strings once all workers have finished.
+ */
+
+typedef struct palmdoc_task {
+    const char *data;
+    Py_ssize_t len;
+    char *out;
+    Py_ssize_t out_len;
+    int error; /* 1 = out of memory */
+} palmdoc_task;
+
+typedef struct palmdoc_queue {
+    palmdoc_task *tasks;
+    Py_ssize_t count;
+    Py_ssize_t next;
+    int active_workers;
+    PyThread_type_lock mutex;
+    PyThread_type_lock done;
+} palmdoc_queue;
+
+static void
+compress_records_worker(void *arg) {
+    palmdoc_queue *queue = (palmdoc_queue *)arg;
+    palmdoc_task *task;
+    buffer b;
+    Byte *scratch = NULL;
+    Py_ssize_t scratch_len = 0, j;
+    int last;
+
+    for (;;) {
+        PyThread_acquire_lock(queue->mutex, 1);
+        task = (queue->next < queue->count) ?
+            &queue->tasks[queue->next++] : NULL;
+        PyThread_release_lock(queue->mutex);
+        if (task == NULL) break;
+
+        if (scratch_len < task->len) {
+            free(scratch);
+            scratch = (Byte *)malloc(sizeof(Byte)*task->len);
+            scratch_len = (scratch == NULL) ? 0 : task->len;
+        }
+        // Worst case output is two bytes per input byte (isolated binary
+        // bytes each cost a length byte)
+        task->out = (char *)malloc(sizeof(char)*(2*task->len + 8));
+        if ((task->len > 0 && scratch == NULL) || task->out == NULL) {
+            free(task->out); task->out = NULL;
+            task->error = 1;
+            continue;
+        }
+        // Map chars to bytes
+        for (j = 0; j < task->len; j++)
+            scratch[j] = (task->data[j] < 0) ? task->data[j]+256 : task->data[j];
+        b.data = scratch; b.len = task->len;
+        task->out_len = cpalmdoc_do_compress(&b, task->out);
+        // a nonempty record always compresses to at least one byte
+        if (task->len > 0 && task->out_len == 0) task->error = 1;
+    }
+    free(scratch);
+
+    PyThread_acquire_lock(queue->mutex, 1);
+    last = (--queue->active_workers == 0);
+    PyThread_release_lock(queue->mutex);
+    // The queue must not be touched after signalling done
+    if (last) PyThread_release_lock(queue->done);
+}
+
+static PyObject *
+cpalmdoc_compress_records(PyObject *self, PyObject *args, PyObject *kwargs) {
+    static char *kwlist[] = {"records", "threads", NULL};
+    PyObject *records = NULL, *seq = NULL, *item, *ans = NULL, *rec;
+    palmdoc_queue queue;
+    Py_ssize_t count, i;
+    int threads = 1, nomem = 0, spawned;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", kwlist,
+                &records, &threads))
+        return NULL;
+    seq = PySequence_Fast(records, "records must be a sequence of byte strings");
+    if (seq == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(seq);
+    if (count == 0) { Py_DECREF(seq); return PyList_New(0); }
+
+    queue.tasks = (palmdoc_task *)PyMem_Malloc(sizeof(palmdoc_task)*count);
+    if (queue.tasks == NULL) { Py_DECREF(seq); return PyErr_NoMemory(); }
+    for (i = 0; i < count; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if (PyBytes_AsStringAndSize(item,
+                    (char **)&queue.tasks[i].data, &queue.tasks[i].len) != 0) {
+            PyMem_Free(queue.tasks); Py_DECREF(seq);
+            return NULL;
+        }
+        queue.tasks[i].out = NULL;
+        queue.tasks[i].out_len = 0;
+        queue.tasks[i].error = 0;
+    }
+    queue.count = count;
+    queue.next = 0;
+    queue.active_workers = 1;
+    if (threads < 1) threads = 1;
+    if (threads > count) threads = (int)count;
+    if (threads > 64) threads = 64;
+
+    queue.mutex = PyThread_allocate_lock();
+    queue.done = PyThread_allocate_lock();
+    if (queue.mutex == NULL || queue.done == NULL) {
+        if (queue.mutex) PyThread_free_lock(queue.mutex);
+        if (queue.done) PyThread_free_lock(queue.done);
+        PyMem_Free(queue.tasks); Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    PyThread_acquire_lock(queue.done, 1);
+
+    for (spawned = 1; spawned < threads; spawned++) {
+        PyThread_acquire_lock(queue.mutex, 1);
+        queue.active_workers++;
+        PyThread_release_lock(queue.mutex);
+        if (PyThread_start_new_thread(compress_records_worker, &queue) == -1) {
+            PyThread_acquire_lock(queue.mutex, 1);
+            queue.active_workers--;
+            PyThread_release_lock(queue.mutex);
+            break;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    compress_records_worker(&queue);
+    PyThread_acquire_lock(queue.done, 1);
+    Py_END_ALLOW_THREADS
+    PyThread_release_lock(queue.done);
+    PyThread_free_lock(queue.mutex);
+    PyThread_free_lock(queue.done);
+
+    for (i = 0; i < count; i++) if (queue.tasks[i].error) nomem = 1;
+    if (!nomem) {
+        ans = PyList_New(count);
+        if (ans != NULL) {
+            for (i = 0; i < count; i++) {
+                rec = PyBytes_FromStringAndSize(queue.tasks[i].out,
+                        queue.tasks[i].out_len);
+                if (rec == NULL) { Py_DECREF(ans); ans = NULL; break; }
+                PyList_SET_ITEM(ans, i, rec);
+            }
+        }
+    }
+    for (i = 0; i < count; i++) free(queue.tasks[i].out);
+    PyMem_Free(queue.tasks);
+    Py_DECREF(seq);
+    if (ans == NULL && !PyErr_Occurred()) return PyErr_NoMemory();
+    return ans;
+}
+
 static PyObject *
 cpalmdoc_compress(PyObject *self, PyObject *args) {
     const char *_input = NULL; Py_ssize_t input_len = 0;
@@ -178,9 +362,9 @@ cpalmdoc_compress(PyObject *self, PyObject *args) {
     for (j = 0; j < input_len; j++)
         b.data[j] = (_input[j] < 0) ? _input[j]+256 : _input[j];
     b.len = input_len;
-    // Make the output buffer larger than the input as sometimes
-    // compression results in a larger block
-    output = (char *)PyMem_Malloc(sizeof(char) * (int)(1.25*b.len));
+    // Compression can expand the block, worst case to two bytes per input
+    // byte when isolated binary bytes each cost a length byte
+    output = (char *)PyMem_Malloc(sizeof(char) * (2*b.len + 8));
     if (output == NULL) return PyErr_NoMemory();
     j = cpalmdoc_do_compress(&b, output);
     if ( j == 0) return PyErr_NoMemory();
@@ -202,6 +386,12 @@ static PyMethodDef cPalmdoc_methods[] = {
     "compress(bytestring) -> compressed bytestring\n\n"
     		"Palmdoc compress a byte string. "
     },
+
+    {"compress_records", (PyCFunction)cpalmdoc_compress_records,
+    METH_VARARGS | METH_KEYWORDS,
+    "compress_records(records, threads=1) -> list of compressed bytestrings\n\n"
+    		"Palmdoc compress a sequence of byte strings on a thread pool. "
+    },
     {NULL, NULL, 0, NULL}
 };
 
@@ -24,6 +24,10 @@ def compress_doc(data):
     return cPalmdoc.compress(data) if data else b''
 
 
+def compress_doc_records(records, threads=1):
+    return cPalmdoc.compress_records(list(records), threads)
+
+
 def py_compress_doc(data):
     out = io.BytesIO()
     i = 0
@@ -93,4 +97,14 @@ def find_tests():
                 self.assertEqual(py_compress_doc(test), x)
                 self.assertEqual(decompress_doc(x), test)
 
+        def test_palmdoc_batch_compression(self):
+            records = [
+                b'', b'abc\x03\x04\x05\x06ms', b'a b c \xfed ',
+                b'0123456789axyz2bxyz2cdfgfo9iuyerh' * 200,
+            ]
+            for threads in (1, 4):
+                self.assertEqual(
+                    compress_doc_records(records, threads=threads),
+                    [compress_doc(r) for r in records])
+
     return unittest.defaultTestLoader.loadTestsFromTestCase(Test)
@@ -17,9 +17,13 @@
 #include <inttypes.h>
 #endif
 
-#define STRFY(x) #x
-#define STRFY2(x) STRFY(x)
-#define CORRUPT PyErr_SetString(PyExc_ValueError, "Corrupt bitstream at line: " STRFY2(__LINE__))
+// The decode loops run with the GIL released, so errors are recorded on the
+// State and turned into Python exceptions once the GIL is held again.
+#define BZZ_ERROR_EOF     1
+#define BZZ_ERROR_CORRUPT 2
+#define BZZ_ERROR_NOMEM   3
+
+#define CORRUPT(s) { (s)->error = BZZ_ERROR_CORRUPT; (s)->error_line = __LINE__; }
 
 typedef uint8_t bool;
 
@@ -33,10 +37,6 @@ typedef struct Table {
 typedef struct State {
     char *raw;
     char *end;
-    uint32_t  p[256];
-    uint32_t  m[256];
-    uint8_t    up[256];
-    uint8_t    dn[256];
     // machine independent ffz
     char          ffzt[256];
     uint8_t byte;
@@ -51,10 +51,15 @@ typedef struct State {
     bool      is_eof;
     uint32_t  xsize;
     uint8_t  *buf;
+    int       error;
+    int       error_line;
 
 } State;
 
-static Table default_ztable[256] = // {{{
+// The state transition table is never modified at runtime (only the per
+// context indices into it are), so all decoders share this one flat copy
+// and each entry occupies a single 8 byte slot.
+static const Table default_ztable[256] = // {{{
 {
   /* This table has been designed for the ZPCoder
    * by running the following command in file 'zptable.sn':
@@ -336,7 +341,7 @@ static bool preload(State *state) {
         if (!read_byte(state)) {
             state->byte = 0xff;
             if (--state->delay < 1) {
-                PyErr_SetString(PyExc_ValueError, "Unexpected end of input"); return FALSE;
+                state->error = BZZ_ERROR_EOF; return FALSE;
             }
         }
         state->buffer = ((state->buffer)<<8) | state->byte;
@@ -348,7 +353,6 @@ static bool preload(State *state) {
 static void initialize_tables(State* state) {
     int32_t i, j;
     for (i = 0; i < 256; i++) {
-        state->p[i] = default_ztable[i].p; state->m[i] = default_ztable[i].m; state->up[i] = default_ztable[i].up; state->dn[i] = default_ztable[i].dn;
         j = i;
         while (j & 0x80) {
             state->ffzt[i] += 1;
@@ -374,10 +378,21 @@ static bool init_state(State *state) {
 
     // Alloc buffer
     state->buf = (uint8_t*) calloc(MAXBLOCK * 1024, sizeof(uint8_t));
-    if (state->buf == NULL) { PyErr_NoMemory(); return FALSE; }
+    if (state->buf == NULL) { state->error = BZZ_ERROR_NOMEM; return FALSE; }
     return TRUE;
 }
 
+static void set_decode_error(State *state) {
+    switch (state->error) {
+        case BZZ_ERROR_EOF:
+            PyErr_SetString(PyExc_ValueError, "Unexpected end of input"); break;
+        case BZZ_ERROR_CORRUPT:
+            PyErr_Format(PyExc_ValueError, "Corrupt bitstream at line: %d", state->error_line); break;
+        default:
+            PyErr_NoMemory(); break;
+    }
+}
+
 static inline int32_t decode_sub_simple(State *state, int32_t mps, uint32_t z) {
     int32_t shift = 0;
 
@@ -418,6 +433,9 @@ static inline int32_t zpcodec_decoder(State *state) {
 static inline int32_t decode_raw(State *state, int32_t bits) {
     int32_t n = 1, m = 1 << bits, b = 0;
     while (n < m) {
+        // decode_sub returns -1 once an error is flagged, which would
+        // corrupt n and never terminate this loop
+        if (state->error) return 0;
         b = zpcodec_decoder(state);
         n = (n << 1) | b;
     }
@@ -426,11 +444,12 @@ static inline int32_t decode_raw(State *state, int32_t bits) {
 
 static inline int32_t decode_sub(State *state, uint8_t *ctx, int32_t index, uint32_t z)
 {
+    const Table *t = &default_ztable[ctx[index]];
     /* Save bit */
     int32_t bit = (ctx[index] & 1), shift;
-    /* Avoid interval reversion */
+    /* Avoid interval reversion (compiles to a conditional move) */
     unsigned int d = 0x6000 + ((z+state->a)>>2);
-    if (z > d) z = d;
+    z = MIN(z, d);
     /* Test MPS/LPS */
     if (z > state->code) {
         /* LPS branch */
@@ -438,7 +457,7 @@ static inline int32_t decode_sub(State *state, uint8_t *ctx, int32_t index, uint
         state->a = state->a + z;
         state->code = state->code + z;
         /* LPS adaptation */
-        ctx[index] = state->dn[ctx[index]];
+        ctx[index] = t->dn;
         /* LPS renormalization */
         shift = ffz(state->ffzt, state->a);
         state->scount -= shift;
@@ -448,9 +467,8 @@ static inline int32_t decode_sub(State *state, uint8_t *ctx, int32_t index, uint
         state->fence = MIN(state->code, 0x7fff);
         return bit ^ 1;
     } else {
-        /* MPS adaptation */
-        if (state->a >= state->m[ctx[index]])
-            ctx[index] = state->up[ctx[index]];
+        /* MPS adaptation, branchless: either step up or stay put */
+        ctx[index] = (state->a >= t->m) ? t->up : ctx[index];
         /* MPS renormalization */
         state->scount -= 1;
         state->a = (uint16_t)(z<<1);
@@ -464,7 +482,7 @@ static inline int32_t decode_sub(State *state, uint8_t *ctx, int32_t index, uint
 
 
 static inline int32_t zpcodec_decode(State *state, uint8_t *ctx, int32_t index) {
-    uint32_t z = state->a + state->p[ctx[index]];
+    uint32_t z = state->a + default_ztable[ctx[index]].p;
     if (z <= state->fence) {
         state->a = z;
         return ctx[index] & 1;
@@ -475,6 +493,9 @@ static inline int32_t zpcodec_decode(State *state, uint8_t *ctx, int32_t index)
 static inline int32_t decode_binary(State *state, uint8_t *ctx, int32_t index, int bits) {
   int n = 1, m = (1<<bits), b = 0;
   while (n < m) {
+      // decode_sub returns -1 once an error is flagged, which would
+      // corrupt n and send index + n out of the ctx array
+      if (state->error) return 0;
       b = zpcodec_decode(state, ctx, index + n);
       n = (n<<1) | b;
     }
@@ -521,10 +542,11 @@ static bool decode(State *state, uint8_t *ctx) {
     uint8_t j = 0, c = 0;
 
     state->xsize = decode_raw(state, 24);
+    if (state->error) return FALSE;
     if (!state->xsize) return FALSE;
-    if (state->xsize > MAXBLOCK * 1024)  { CORRUPT; goto end; }
+    if (state->xsize > MAXBLOCK * 1024)  { CORRUPT(state); goto end; }
     posn = (uint32_t*)calloc(state->xsize, sizeof(uint32_t));
-    if (posn == NULL) { PyErr_NoMemory(); goto end; }
+    if (posn == NULL) { state->error = BZZ_ERROR_NOMEM; goto end; }
 
     // Decode Estimation Speed
     if (zpcodec_decoder(state)) {
@@ -533,7 +555,7 @@ static bool decode(State *state, uint8_t *ctx) {
     }
 
     for (i = 0; i < state->xsize; i++) {
-        if (PyErr_Occurred()) goto end;
+        if (state->error) goto end;
 
         ctxid = CTXIDS - 1; if (ctxid > mtfno) ctxid = mtfno;
         if (zpcodec_decode(state, ctx, ctxid)) { mtfno=0; state->buf[i] = mtf[mtfno]; goto rotate; }
@@ -582,7 +604,7 @@ static bool decode(State *state, uint8_t *ctx) {
     } // end loop on i
 
     ////////// Reconstruct the string
-    if (markerpos<1 || (uint32_t)markerpos>=state->xsize) { CORRUPT; goto end; }
+    if (markerpos<1 || (uint32_t)markerpos>=state->xsize) { CORRUPT(state); goto end; }
     // Allocate pointers
     // Fill count buffer
     for (i=0; i<(uint32_t)markerpos; i++)
@@ -615,11 +637,11 @@ static bool decode(State *state, uint8_t *ctx) {
         state->buf[--last] = c;
         i = count[c] + (n & 0xffffff);
     }
-    if (i != markerpos) { CORRUPT; goto end; }
+    if (i != markerpos) { CORRUPT(state); goto end; }
 
 end:
     if (posn != NULL) { free(posn); posn = NULL; }
-    if (PyErr_Occurred()) return FALSE;
+    if (state->error) return FALSE;
     return state->xsize != 0;
 }
 
@@ -644,14 +666,15 @@ bzz_decompress(PyObject *self, PyObject *args) {
     if (!init_state(&state)) goto end;
 
     buf = (char *)calloc(blocksize, sizeof(char));
-    if (buf == NULL) { PyErr_NoMemory(); goto end; }
+    if (buf == NULL) { state.error = BZZ_ERROR_NOMEM; goto end; }
     buflen = blocksize;
     pos = buf;
 
+    Py_BEGIN_ALLOW_THREADS
     while (!state.is_eof) {
         if (!state.xsize) {  // decode is needed
             if (!decode(&state, ctx)) {
-                if (PyErr_Occurred()) goto end;
+                if (state.error) break;
                 state.xsize = 1;
                 state.is_eof = TRUE;
             }
@@ -662,21 +685,24 @@ bzz_decompress(PyObject *self, PyObject *args) {
             while (buflen - (pos - buf) <= state.xsize) {
                 tmp = (char*) realloc(buf, buflen + (buflen * sizeof(char)));
                 if (tmp == NULL) {
-                    PyErr_NoMemory(); goto end;
+                    state.error = BZZ_ERROR_NOMEM; break;
                 }
                 buflen += buflen * sizeof(char);
                 pos = tmp + (pos - buf);
                 buf = tmp; tmp = NULL;
             }
+            if (state.error) break;
             memcpy(pos, state.buf, state.xsize);
             pos += state.xsize;
         }
         state.xsize = 0;
     }
+    Py_END_ALLOW_THREADS
 
 end:
     if (state.buf != NULL) free(state.buf);
-    if (!PyErr_Occurred()) {
+    if (state.error) set_decode_error(&state);
+    else {
         buflen = 0;
         for (i = 0; i < 3; i++) {
             buflen <<= 8; buflen += (uint8_t)buf[i];
@@ -688,6 +714,218 @@ end:
     return ans;
 }
 
+/* Iterator yielding the decompressed stream in fixed size segments, so that
+ * very large DjVu chunks do not have to be materialized in one piece and the
+ * GIL is only held between segments.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    State state;
+    uint8_t ctx[300];
+    Py_buffer view;
+    char *pending;
+    size_t pending_len;
+    size_t pending_cap;
+    size_t chunk_size;
+    size_t remaining;
+    size_t produced;
+    size_t header_len;
+    bool header_parsed;
+    bool finished;
+    bool padded;
+} BZZIterator;
+
+static void
+bzziter_dealloc(BZZIterator *it) {
+    if (it->state.buf != NULL) free(it->state.buf);
+    if (it->pending != NULL) free(it->pending);
+    PyBuffer_Release(&it->view);
+    PyObject_Del(it);
+}
+
+static PyObject *
+bzziter_next(BZZIterator *it) {
+    State *state = &it->state;
+    size_t need, n;
+    char *tmp;
+    PyObject *ans;
+
+    if (it->finished && it->pending_len == 0) return NULL;
+
+    need = it->chunk_size + (it->header_parsed ? 0 : 3);
+    if (!it->finished && it->pending_len < need) {
+        Py_BEGIN_ALLOW_THREADS
+        while (!state->is_eof && !state->error && it->pending_len < need) {
+            if (!state->xsize) {
+                if (!decode(state, it->ctx)) {
+                    if (state->error) break;
+                    state->xsize = 1;
+                    state->is_eof = TRUE;
+                }
+                state->xsize -= 1;
+            }
+            if (state->xsize > 0) {
+                while (it->pending_cap - it->pending_len <= state->xsize) {
+                    tmp = (char *)realloc(it->pending, 2 * it->pending_cap);
+                    if (tmp == NULL) { state->error = BZZ_ERROR_NOMEM; break; }
+                    it->pending = tmp;
+                    it->pending_cap *= 2;
+                }
+                if (state->error) break;
+                memcpy(it->pending + it->pending_len, state->buf, state->xsize);
+                it->pending_len += state->xsize;
+                it->produced += state->xsize;
+            }
+            state->xsize = 0;
+        }
+        Py_END_ALLOW_THREADS
+        if (state->error) { set_decode_error(state); return NULL; }
+        if (state->is_eof) it->finished = TRUE;
+    }
+
+    if (!it->header_parsed) {
+        // The first three decoded bytes are the big-endian length of the
+        // stream, which caps the output just as in bzz_decompress(). A
+        // stream that decoded to fewer than three bytes is read against
+        // the zero filled tail of the buffer there, so pad with zeros.
+        if (it->pending_len < 3) {
+            if (!it->finished) { it->pending_len = 0; return NULL; }
+            memset(it->pending + it->pending_len, 0, 3 - it->pending_len);
+            it->pending_len = 3;
+        }
+        it->header_len = ((size_t)(uint8_t)it->pending[0] << 16) |
+                         ((size_t)(uint8_t)it->pending[1] << 8) |
+                          (size_t)(uint8_t)it->pending[2];
+        it->remaining = it->header_len;
+        it->pending_len -= 3;
+        memmove(it->pending, it->pending + 3, it->pending_len);
+        it->header_parsed = TRUE;
+    }
+
+    if (it->finished && !it->padded) {
+        // bzz_decompress() returns MIN(header_len, produced) bytes counted
+        // from the start of its buffer, so when the header claims more than
+        // was decoded, up to three bytes of the zero filled tail leak into
+        // the result; reproduce that so both entry points agree.
+        size_t avail = it->produced >= 3 ? it->produced - 3 : 0;
+        size_t target = MIN(it->header_len, it->produced);
+        it->padded = TRUE;
+        if (target > avail) {
+            if (it->pending_cap - it->pending_len < target - avail) {
+                tmp = (char *)realloc(it->pending, it->pending_cap + 3);
+                if (tmp == NULL) return PyErr_NoMemory();
+                it->pending = tmp;
+                it->pending_cap += 3;
+            }
+            memset(it->pending + it->pending_len, 0, target - avail);
+            it->pending_len += target - avail;
+        }
+    }
+
+    if (it->remaining == 0 && !it->finished) {
+        // bzz_decompress() decodes the entire stream before truncating to
+        // the header length, so a corrupt trailing block must still raise
+        Py_BEGIN_ALLOW_THREADS
+        while (!state->is_eof && !state->error) {
+            if (!decode(state, it->ctx) && !state->error)
+                state->is_eof = TRUE;
+            state->xsize = 0;
+        }
+        Py_END_ALLOW_THREADS
+        if (state->error) { set_decode_error(state); return NULL; }
+        it->finished = TRUE;
+    }
+
+    n = MIN(it->pending_len, it->chunk_size);
+    n = MIN(n, it->remaining);
+    if (n == 0) { it->pending_len = 0; return NULL; }
+    ans = PyBytes_FromStringAndSize(it->pending, n);
+    if (ans == NULL) return NULL;
+    it->pending_len -= n;
+    memmove(it->pending, it->pending + n, it->pending_len);
+    it->remaining -= n;
+    if (it->remaining == 0) it->pending_len = 0;
+    return ans;
+}
+
+static PyTypeObject BZZIteratorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    /* tp_name           */ "bzzdec.BZZIterator",
+    /* tp_basicsize      */ sizeof(BZZIterator),
+    /* tp_itemsize       */ 0,
+    /* tp_dealloc        */ (destructor)bzziter_dealloc,
+    /* tp_print/vectcall */ 0,
+    /* tp_getattr        */ 0,
+    /* tp_setattr        */ 0,
+    /* tp_compare        */ 0,
+    /* tp_repr           */ 0,
+    /* tp_as_number      */ 0,
+    /* tp_as_sequence    */ 0,
+    /* tp_as_mapping     */ 0,
+    /* tp_hash           */ 0,
+    /* tp_call           */ 0,
+    /* tp_str            */ 0,
+    /* tp_getattro       */ 0,
+    /* tp_setattro       */ 0,
+    /* tp_as_buffer      */ 0,
+    /* tp_flags          */ Py_TPFLAGS_DEFAULT,
+    /* tp_doc            */ "Iterator over fixed size segments of a BZZ stream",
+    /* tp_traverse       */ 0,
+    /* tp_clear          */ 0,
+    /* tp_richcompare    */ 0,
+    /* tp_weaklistoffset */ 0,
+    /* tp_iter           */ PyObject_SelfIter,
+    /* tp_iternext       */ (iternextfunc)bzziter_next,
+};
+
+static PyObject *
+bzz_decompress_iter(PyObject *self, PyObject *args) {
+    BZZIterator *it;
+    Py_buffer view;
+    Py_ssize_t chunk_size = 1024 * 1024;
+
+#if PY_MAJOR_VERSION >= 3
+#define BUFVIEW_FMT "y*|n"
+#else
+#define BUFVIEW_FMT "s*|n"
+#endif
+    if (!PyArg_ParseTuple(args, BUFVIEW_FMT, &view, &chunk_size))
+        return NULL;
+    if (chunk_size < 1) {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "chunk_size must be positive");
+        return NULL;
+    }
+
+    it = PyObject_New(BZZIterator, &BZZIteratorType);
+    if (it == NULL) { PyBuffer_Release(&view); return NULL; }
+    memset(&it->state, 0, sizeof(State));
+    memset(it->ctx, 0, sizeof(it->ctx));
+    it->view = view;
+    it->pending = NULL;
+    it->pending_len = 0;
+    it->chunk_size = (size_t)chunk_size;
+    it->remaining = 0;
+    it->produced = 0;
+    it->header_len = 0;
+    it->header_parsed = FALSE;
+    it->finished = FALSE;
+    it->padded = FALSE;
+
+    it->state.raw = (char *)view.buf;
+    it->state.end = it->state.raw + view.len - 1;
+    it->pending_cap = MIN(it->chunk_size + 3, 2 * MAXBLOCK * 1024);
+    it->pending = (char *)malloc(it->pending_cap);
+    if (it->pending == NULL || !init_state(&it->state)) {
+        if (it->state.error) set_decode_error(&it->state);
+        else PyErr_NoMemory();
+        Py_DECREF(it);
+        return NULL;
+    }
+    return (PyObject *)it;
+}
+
 static char bzzdec_doc[] = "Decompress BZZ encoded strings (used in DJVU)";
 
 static PyMethodDef bzzdec_methods[] = {
@@ -696,6 +934,12 @@ static PyMethodDef bzzdec_methods[] = {
     		"Decompress a BZZ compressed byte string. "
     },
 
+    {"decompress_iter", bzz_decompress_iter, METH_VARARGS,
+    "decompress_iter(bytestring, chunk_size=1MB) -> iterator\n\n"
+    		"Decompress a BZZ compressed byte string incrementally, "
+            "yielding segments of at most chunk_size bytes as they are decoded. "
+    },
+
     {NULL, NULL, 0, NULL}
 };
 
@@ -720,7 +964,11 @@ CALIBRE_MODINIT_FUNC PyInit_bzzdec(void) {
 CALIBRE_MODINIT_FUNC initbzzdec(void) {
 #endif
 
-    PyObject *m = INITMODULE;
+    PyObject *m;
+    if (PyType_Ready(&BZZIteratorType) < 0) {
+        INITERROR;
+    }
+    m = INITMODULE;
     if (m == NULL) {
         INITERROR;
     }
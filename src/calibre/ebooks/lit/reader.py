@@ -448,6 +448,7 @@ def preserve(function):
 
 class LitFile(object):
     PIECE_SIZE = 16
+    book_deskey = None
 
     def __init__(self, filename_or_stream, log):
         self._warn = log.warn
@@ -724,8 +725,8 @@ class LitFile(object):
         else:
             return
         if self.drmlevel < 5:
-            msdes.deskey(self.calculate_deskey(), msdes.DE1)
-            bookkey = msdes.des(self.get_file('/DRMStorage/DRMSealed'))
+            bookkey = msdes.Key(self.calculate_deskey(), msdes.DE1).des(
+                self.get_file('/DRMStorage/DRMSealed'))
             if bookkey[0:1] != b'\0':
                 raise LitError('Unable to decrypt title key!')
             self.bookkey = bookkey[1:9]
@@ -801,8 +802,10 @@ class LitFile(object):
         if extra > 0:
             self.warn("content length not a multiple of block size")
             content += b"\0" * (8 - extra)
-        msdes.deskey(self.bookkey, msdes.DE1)
-        return msdes.des(content)
+        if self.book_deskey is None:
+            # Expand the key once, decrypt() is called for every section
+            self.book_deskey = msdes.Key(self.bookkey, msdes.DE1)
+        return self.book_deskey.des(content)
 
     def decompress(self, content, control, reset_table):
         if len(control) < 32 or control[CONTROL_TAG:CONTROL_TAG+4] != b"LZXC":
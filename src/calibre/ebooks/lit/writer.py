@@ -581,8 +581,8 @@ class LitWriter(object):
         drmsource = u'Free as in freedom\0'.encode('utf-16-le')
         self._add_file('/DRMStorage/DRMSource', drmsource)
         tempkey = self._calculate_deskey([self._meta, drmsource])
-        msdes.deskey(tempkey, msdes.EN0)
-        self._add_file('/DRMStorage/DRMSealed', msdes.des(b"\0" * 16))
+        self._add_file('/DRMStorage/DRMSealed',
+                       msdes.Key(tempkey, msdes.EN0).des(b"\0" * 16))
         self._bookkey = b'\0' * 8
         self._add_file('/DRMStorage/ValidationStream', b'MSReader', 3)
 
@@ -604,6 +604,7 @@ class LitWriter(object):
         mapping = [(1, 'MSCompressed', (LZXCOMPRESS_GUID,)),
                    (2, 'EbEncryptDS', (LZXCOMPRESS_GUID, DESENCRYPT_GUID)),
                    (3, 'EbEncryptOnlyDS', (DESENCRYPT_GUID,)),]
+        bookkey = None
         for secnum, name, transforms in mapping:
             root = '::DataSpace/Storage/' + name
             data = self._sections[secnum].getvalue()
@@ -615,11 +616,12 @@ class LitWriter(object):
                     cdata = MSDES_CONTROL + cdata
                     if not data:
                         continue
-                    msdes.deskey(self._bookkey, msdes.EN0)
+                    if bookkey is None:
+                        bookkey = msdes.Key(self._bookkey, msdes.EN0)
                     pad = 8 - (len(data) & 0x7)
                     if pad != 8:
                         data = data + (b'\0' * pad)
-                    data = msdes.des(data)
+                    data = bookkey.des(data)
                 elif guid == LZXCOMPRESS_GUID:
                     cdata = LZXC_CONTROL + cdata
                     if not data:
@@ -8,6 +8,7 @@
 #include "qt_hack.h"
 
 #include <QtEndian>
+#include <QHash>
 
 #include "private/qtextengine_p.h"
 #include "private/qfontengine_p.h"
@@ -18,8 +19,34 @@
 #define BYTES_FMT "s#"
 #endif
 
-PyObject* get_glyphs(const QPointF &p, const QTextItem &text_item) {
+// get_glyphs() is called for every string drawn, and PDF output re-draws
+// identical headers/footers/page numbers on every page. The 'name' table of
+// a font never changes and can be tens of kilobytes, so extracting it anew
+// on each call dominates the cost of this function. Cache it per font
+// engine, verifying the face id on every hit in case an engine address is
+// reused after its font is destroyed.
+struct NameTableEntry {
+    QFontEngine::FaceId face_id;
+    QByteArray table;
+};
+
+static const QByteArray& cached_name_table(QFontEngine *fe) {
     const quint32 *tag = reinterpret_cast<const quint32 *>("name");
+    static QHash<quintptr, NameTableEntry> cache;
+    quintptr key = reinterpret_cast<quintptr>(fe);
+    QHash<quintptr, NameTableEntry>::iterator it = cache.find(key);
+    if (it == cache.end() || !(it.value().face_id == fe->faceId())) {
+        NameTableEntry entry;
+        entry.face_id = fe->faceId();
+        entry.table = fe->getSfntTable(qToBigEndian(*tag));
+        // A conversion uses only a handful of fonts, keep the cache bounded anyway
+        if (cache.size() > 64) cache.clear();
+        it = cache.insert(key, entry);
+    }
+    return it.value().table;
+}
+
+PyObject* get_glyphs(const QPointF &p, const QTextItem &text_item) {
     QTextItemInt ti = static_cast<const QTextItemInt &>(text_item);
     QFontEngine *fe = ti.fontEngine;
     qreal size = ti.fontEngine->fontDef.pixelSize;
@@ -62,7 +89,7 @@ PyObject* get_glyphs(const QPointF &p, const QTextItem &text_item) {
         if (temp == NULL) { Py_DECREF(indices); Py_DECREF(points); return PyErr_NoMemory(); }
         PyTuple_SET_ITEM(indices, i, temp); temp = NULL;
     }
-    const QByteArray table(fe->getSfntTable(qToBigEndian(*tag)));
+    const QByteArray &table = cached_name_table(fe);
     return Py_BuildValue(BYTES_FMT "ffOO", table.constData(), table.size(), size, stretch, points, indices);
 }
 
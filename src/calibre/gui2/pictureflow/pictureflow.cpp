@@ -59,13 +59,22 @@
 #include "pictureflow.h"
 
 #include <QBasicTimer>
-#include <QCache>
+#include <QHash>
 #include <QImage>
 #include <QKeyEvent>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QPainter>
 #include <QPixmap>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSet>
+#include <QThreadPool>
+#include <QThread>
 #include <QTimer>
 #include <QVector>
+#include <QWaitCondition>
 #include <QWidget>
 #include <QTime>
 
@@ -318,15 +327,126 @@ struct SlideInfo
   PFreal cy;
 };
 
+// The per-column perspective math in renderSlide() depends on the slide
+// geometry only through (angle, cy) plus a term linear in cx, so everything
+// that needs a fixed-point division per column can be hoisted into a table
+// keyed on (angle, cy): hity = A[x] + fmul(cx, B[x]). During a flick the
+// stack slides keep the same (angle, cy) for the whole animation and only
+// their cx moves, so their tables are computed once per flick instead of
+// per column per tick; only the two or three transitional slides whose
+// angle changes rebuild each tick.
+struct ProjectionBase
+{
+  int angle;
+  PFreal cy;
+  int w;
+  PFreal sdx, sdy, inv_sdx;
+  QVector<PFreal> A, B;
+  quint32 lastUsed;
+  ProjectionBase() : angle(0), cy(0), w(0), sdx(0), sdy(0), inv_sdx(0), lastUsed(0) {}
+};
+
 static const QString OFFSET_KEY("offset");
 static const QString WIDTH_KEY("width");
 
+// SurfaceCache {{{
+// Cache of prepared slide surfaces, bounded by the number of bytes the cached
+// images actually occupy rather than by entry count, so memory stays bounded
+// at 4K slide sizes without starving the cache at small ones. When over
+// budget, the surface farthest from the current slide is evicted first, since
+// that is the one a flick is least likely to need again soon.
+#define SURFACE_CACHE_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+class SurfaceCache
+{
+public:
+  SurfaceCache() : budget(SURFACE_CACHE_DEFAULT_BUDGET), used(0), center(0), protectedRadius(0) {}
+  ~SurfaceCache() { clear(); }
+
+  bool contains(int index) const { return entries.contains(index); }
+  QImage* object(int index) const { return entries.value(index, 0); }
+
+  // takes ownership of surface; it can be evicted immediately if it alone
+  // exceeds the budget, as with QCache
+  void insert(int index, QImage *surface)
+  {
+    remove(index);
+    entries.insert(index, surface);
+    used += cost(surface);
+    trim();
+  }
+
+  void clear()
+  {
+    QHash<int, QImage*>::const_iterator it;
+    for(it = entries.constBegin(); it != entries.constEnd(); ++it)
+      delete it.value();
+    entries.clear();
+    used = 0;
+  }
+
+  quint64 maxBytes() const { return budget; }
+  void setMaxBytes(quint64 bytes) { budget = bytes; trim(); }
+  void setCurrentSlide(int index) { center = index; }
+  // Entries within radius of the current slide are never evicted, even over
+  // budget: pointers to them stay valid for the whole of a render pass
+  void setProtectedRadius(int radius) { protectedRadius = radius; }
+
+private:
+  void remove(int index)
+  {
+    QImage *old = entries.take(index);
+    if(old)
+    {
+      used -= cost(old);
+      delete old;
+    }
+  }
+
+  void trim()
+  {
+    while(used > budget && !entries.isEmpty())
+    {
+      QHash<int, QImage*>::iterator it, worst = entries.end();
+      int worstDist = -1;
+      for(it = entries.begin(); it != entries.end(); ++it)
+      {
+        int dist = qAbs(it.key() - center);
+        if(dist > protectedRadius && dist > worstDist)
+        {
+          worstDist = dist;
+          worst = it;
+        }
+      }
+      if(worst == entries.end())
+        break;  // only protected entries left
+      used -= cost(worst.value());
+      delete worst.value();
+      entries.erase(worst);
+    }
+  }
+
+  static quint64 cost(const QImage *img)
+  {
+    return (quint64)img->bytesPerLine() * img->height();
+  }
+
+  QHash<int, QImage*> entries;
+  quint64 budget, used;
+  int center;
+  int protectedRadius;
+};
+// }}}
+
+class SurfacePrerenderer;
+
 // PicturePlowPrivate {{{
 
 class PictureFlowPrivate
 {
 public:
   PictureFlowPrivate(PictureFlow* widget, int queueLength);
+  ~PictureFlowPrivate();
 
   int slideCount() const;
   void setSlideCount(int count);
@@ -339,6 +459,7 @@ public:
 
   QImage slide(int index) const;
   void setSlide(int index, const QImage& image);
+  void imageDecoded(int index);
 
   int currentSlide() const;
   void setCurrentSlide(int index);
@@ -352,12 +473,20 @@ public:
   void showNext();
   void showSlide(int index);
 
+  quint64 surfaceCacheBudget() const;
+  void setSurfaceCacheBudget(quint64 bytes);
+
   void resize(int w, int h);
 
   void render();
+  int renderLeftStack(int c1, const QVector<QImage*> &srcs);
+  int renderRightStack(int c2, const QVector<QImage*> &srcs);
   void startAnimation();
   void updateAnimation();
 
+  // area of buffer touched by the last render() pass, for clipped updates
+  QRect frameDirtyRect;
+
   void clearSurfaceCache();
 
   QImage buffer;
@@ -375,6 +504,7 @@ public:
 
   void setImages(FlowImages *images);
   void dataChanged();
+  void invalidateCaptions();
 
 private:
   PictureFlow* widget;
@@ -398,23 +528,142 @@ private:
   PFreal offsetX;
   PFreal offsetY;
 
+  // Cache of projection tables, warmed by render() on the calling thread
+  // before the stack workers start, so the workers only ever read it
+  enum { MaxProjectionBases = 8 };
+  QVector<ProjectionBase> projectionBases;
+  quint32 projectionUseCounter;
+
   QImage blankSurface;
-  QCache<int, QImage> surfaceCache;
+  SurfaceCache surfaceCache;
   QTimer triggerTimer;
 
+  SurfacePrerenderer *prerenderer;
+  quint64 surfaceGeneration;
+  QSet<int> prerenderInFlight;
+
   long long slideFrame;
   int step;
   int target;
   int fade;
 
+  // what the previous frame drew, cleared (to the black background)
+  // instead of refilling the whole buffer every tick
+  QRect prevSlideBand;
+  QRect prevTextRect;
+
+  // captions rasterized once per slide and blitted every frame, instead
+  // of shaping and rasterizing the text on each repaint
+  QHash<int, QImage> captionCache;
+
   void recalc(int w, int h);
+  void buildProjectionBase(ProjectionBase &b, int angle, PFreal cy) const;
+  const ProjectionBase* ensureProjectionBase(int angle, PFreal cy);
+  const ProjectionBase* findProjectionBase(int angle, PFreal cy) const;
   QRect renderSlide(const SlideInfo &slide, int alpha=256, int col1=-1, int col=-1);
+  QRect renderSlide(const SlideInfo &slide, QImage *src, int alpha, int col1, int col2);
   QRect renderCenterSlide(const SlideInfo &slide);
   QImage* surface(int slideIndex);
   void triggerRender(int after_msecs);
   void resetSlides();
-  void render_text(QPainter*, int);
+  QImage captionImage(int index);
+  QRect render_text(QPainter*, int, int alpha=255);
+  void clearBufferRect(const QRect &rect);
+  void collectPrerendered();
+  void prerenderNeighbours();
+  void queuePrerender(int index, const QImage &img);
+  void invalidatePrerender();
+};
+
+// Background surface prerendering {{{
+static QImage prepareSurface(QImage srcimg, const int w, const int h, bool doReflections, bool preserveAspectRatio);
+
+struct PrerenderJob
+{
+  int slideIndex;
+  quint64 generation;
+  QImage source;
+  int width;
+  int height;
+  bool doReflections;
+  bool preserveAspectRatio;
+};
+
+// Runs prepareSurface() off the GUI thread. The GUI thread fetches the source
+// image from the model (the model is implemented in Python and must not be
+// called from another thread), queues a job, and later collects the prepared
+// surface into surfaceCache, so that a cache miss during an animation does
+// not force prepareSurface() to run in the middle of a frame.
+class SurfacePrerenderer : public QThread
+{
+public:
+  SurfacePrerenderer(QObject *widget_) : widget(widget_), abort(false) {}
+
+  void enqueue(const PrerenderJob &job)
+  {
+    QMutexLocker locker(&mutex);
+    jobs.append(job);
+    jobAvailable.wakeOne();
+  }
+
+  void invalidatePending()
+  {
+    QMutexLocker locker(&mutex);
+    jobs.clear();
+  }
+
+  void takeResults(QList<PrerenderJob> &into)
+  {
+    QMutexLocker locker(&mutex);
+    into += results;
+    results.clear();
+  }
+
+  void stop()
+  {
+    {
+      QMutexLocker locker(&mutex);
+      abort = true;
+      jobAvailable.wakeOne();
+    }
+    wait();
+  }
+
+protected:
+  virtual void run()
+  {
+    for(;;)
+    {
+      PrerenderJob job;
+      {
+        QMutexLocker locker(&mutex);
+        while(jobs.isEmpty() && !abort)
+          jobAvailable.wait(&mutex);
+        if(abort)
+          return;
+        job = jobs.takeFirst();
+      }
+      job.source = prepareSurface(job.source, job.width, job.height, job.doReflections, job.preserveAspectRatio);
+      {
+        QMutexLocker locker(&mutex);
+        results.append(job);
+      }
+      // Wake the GUI thread so the finished surface is collected into the
+      // cache (and painted, if its slide is visible) without waiting for the
+      // next animation tick.
+      QMetaObject::invokeMethod(widget, "render", Qt::QueuedConnection);
+    }
+  }
+
+private:
+  QObject *widget;
+  QMutex mutex;
+  QWaitCondition jobAvailable;
+  QList<PrerenderJob> jobs;
+  QList<PrerenderJob> results;
+  bool abort;
 };
+// }}}
 
 PictureFlowPrivate::PictureFlowPrivate(PictureFlow* w, int queueLength_)
 {
@@ -435,28 +684,50 @@ PictureFlowPrivate::PictureFlowPrivate(PictureFlow* w, int queueLength_)
   target = 0;
   fade = 256;
   subtitleFont = QFont();
+  projectionUseCounter = 0;
 
   triggerTimer.setSingleShot(true);
   triggerTimer.setInterval(0);
   QObject::connect(&triggerTimer, SIGNAL(timeout()), widget, SLOT(render()));
 
+  surfaceGeneration = 0;
+  prerenderer = new SurfacePrerenderer(widget);
+  prerenderer->start(QThread::LowPriority);
+  surfaceCache.setProtectedRadius(queueLength + 1);
+
   recalc(200, 200);
   resetSlides();
 }
 
+PictureFlowPrivate::~PictureFlowPrivate()
+{
+  prerenderer->stop();
+  delete prerenderer;
+}
+
 void PictureFlowPrivate::dataChanged() {
 	surfaceCache.clear();
+	captionCache.clear();
+	invalidatePrerender();
 	resetSlides();
 	triggerRender(100);
 }
 
+void PictureFlowPrivate::invalidateCaptions() {
+	captionCache.clear();
+	triggerRender(100);
+}
+
 void PictureFlowPrivate::setImages(FlowImages *images)
 {
 	QObject::disconnect(slideImages, SIGNAL(dataChanged()), widget, SLOT(dataChanged()));
+	QObject::disconnect(slideImages, SIGNAL(imageReady(int)), widget, SLOT(imageReady(int)));
 	slideImages = images;
 	dataChanged();
 	QObject::connect(slideImages, SIGNAL(dataChanged()), widget, SLOT(dataChanged()),
             Qt::QueuedConnection);
+	QObject::connect(slideImages, SIGNAL(imageReady(int)), widget, SLOT(imageReady(int)),
+            Qt::QueuedConnection);
 }
 
 int PictureFlowPrivate::slideCount() const
@@ -497,6 +768,7 @@ void PictureFlowPrivate::setCurrentSlide(int index)
   animateTimer.stop();
   step = 0;
   centerIndex = qBound(0, index, qMax(0, slideImages->count()-1));
+  surfaceCache.setCurrentSlide(centerIndex);
   target = centerIndex;
   slideFrame = ((long long)centerIndex) << 16;
   resetSlides();
@@ -556,6 +828,16 @@ void PictureFlowPrivate::showSlide(int index)
   startAnimation();
 }
 
+quint64 PictureFlowPrivate::surfaceCacheBudget() const
+{
+  return surfaceCache.maxBytes();
+}
+
+void PictureFlowPrivate::setSurfaceCacheBudget(quint64 bytes)
+{
+  surfaceCache.setMaxBytes(bytes);
+}
+
 void PictureFlowPrivate::resize(int w, int h)
 {
   if (w < 10) w = 10;
@@ -676,7 +958,7 @@ QImage* PictureFlowPrivate::surface(int slideIndex)
     return 0;
 
   if(surfaceCache.contains(slideIndex))
-    return surfaceCache[slideIndex];
+    return surfaceCache.object(slideIndex);
 
   QImage img = widget->slide(slideIndex);
   if(img.isNull())
@@ -704,7 +986,99 @@ QImage* PictureFlowPrivate::surface(int slideIndex)
   }
 
   surfaceCache.insert(slideIndex, new QImage(prepareSurface(img, slideWidth, slideHeight, doReflections, preserveAspectRatio)));
-  return surfaceCache[slideIndex];
+  return surfaceCache.object(slideIndex);
+}
+
+// Move any surfaces finished by the prerender thread into the cache. Runs on
+// the GUI thread, which is the only place surfaceCache is touched.
+void PictureFlowPrivate::collectPrerendered()
+{
+  QList<PrerenderJob> done;
+  prerenderer->takeResults(done);
+  for(int i = 0; i < done.count(); i++)
+  {
+    const PrerenderJob& job = done.at(i);
+    prerenderInFlight.remove(job.slideIndex);
+    if(job.generation != surfaceGeneration)
+      continue;  // the viewport or the data changed after this job was queued
+    if(!surfaceCache.contains(job.slideIndex))
+      surfaceCache.insert(job.slideIndex, new QImage(job.source));
+  }
+}
+
+// Speculatively queue the slides on either side of the center for preparation
+// on the worker thread, so the paint path finds them ready in the cache as
+// the animation brings them into view. One slide beyond the visible queue is
+// included, since that is the one a crossing of the center brings on screen.
+void PictureFlowPrivate::prerenderNeighbours()
+{
+  int count = slideImages->count();
+  collectPrerendered();
+  QList<int> wanted;
+  for(int i = 1; i <= queueLength+1; i++)
+  {
+    for(int sign = -1; sign <= 1; sign += 2)
+    {
+      int index = centerIndex + sign*i;
+      if(index < 0 || index >= count)
+        continue;
+      if(surfaceCache.contains(index) || prerenderInFlight.contains(index))
+        continue;
+      wanted.append(index);
+    }
+  }
+  if(wanted.isEmpty())
+    return;
+  // Let asynchronous models start decoding the whole batch before we ask for
+  // any single image; a decode still in progress answers with a null image
+  // and delivers imageReady() later.
+  slideImages->prefetch(wanted);
+  for(int i = 0; i < wanted.count(); i++)
+  {
+    QImage img = slideImages->image(wanted.at(i));
+    if(img.isNull())
+      continue;  // blank slide, or still decoding in the model
+    queuePrerender(wanted.at(i), img);
+  }
+}
+
+// Hand a decoded source image to the prerender thread for surface preparation.
+void PictureFlowPrivate::queuePrerender(int index, const QImage &img)
+{
+  PrerenderJob job;
+  job.slideIndex = index;
+  job.generation = surfaceGeneration;
+  job.source = img;
+  job.width = slideWidth;
+  job.height = slideHeight;
+  job.doReflections = doReflections;
+  job.preserveAspectRatio = preserveAspectRatio;
+  prerenderInFlight.insert(index);
+  prerenderer->enqueue(job);
+}
+
+// Called (via PictureFlow::imageReady) when an asynchronous model finishes
+// decoding an image we asked for with prefetch().
+void PictureFlowPrivate::imageDecoded(int index)
+{
+  if(index < 0 || index >= slideImages->count())
+    return;
+  collectPrerendered();
+  if(surfaceCache.contains(index) || prerenderInFlight.contains(index))
+    return;
+  QImage img = slideImages->image(index);
+  if(img.isNull())
+    return;
+  queuePrerender(index, img);
+}
+
+// Drop queued prerender jobs and mark results of in-progress ones stale.
+// Call whenever cached surfaces become invalid.
+void PictureFlowPrivate::invalidatePrerender()
+{
+  surfaceGeneration++;
+  prerenderer->invalidatePending();
+  prerenderInFlight.clear();
 }
 
 
@@ -715,93 +1089,94 @@ void PictureFlowPrivate::triggerRender(int after_msecs)
   triggerTimer.start(after_msecs);
 }
 
-void PictureFlowPrivate::render_text(QPainter *painter, int index) {
+// Rasterize the caption and subtitle of a slide into a buffer-width strip
+// that render_text() can blit, white text on a transparent background. The
+// layout matches what the old direct QPainter drawing produced, anchored
+// to the bottom of the strip.
+QImage PictureFlowPrivate::captionImage(int index) {
+    QHash<int, QImage>::const_iterator it = captionCache.constFind(index);
+    if (it != captionCache.constEnd())
+        return it.value();
+
     QRect brect, brect2;
     int buffer_width, buffer_height;
     QString caption, subtitle;
+    QFont captionFont;
 
     caption = slideImages->caption(index);
     subtitle = slideImages->subtitle(index);
     buffer_width = buffer.width(); buffer_height = buffer.height();
+    captionFont.setBold(true);
+    captionFont.setPixelSize(fontSize);
     subtitleFont.setPixelSize(fontSize);
 
-    brect = painter->boundingRect(QRect(0, 0, buffer_width, fontSize), TEXT_FLAGS, caption);
-    painter->save();
-    painter->setFont(subtitleFont);
-    brect2 = painter->boundingRect(QRect(0, 0, buffer_width, fontSize), TEXT_FLAGS, subtitle);
-    painter->restore();
+    brect = QFontMetrics(captionFont).boundingRect(QRect(0, 0, buffer_width, fontSize), TEXT_FLAGS, caption);
+    brect2 = QFontMetrics(subtitleFont).boundingRect(QRect(0, 0, buffer_width, fontSize), TEXT_FLAGS, subtitle);
 
     // So that if there is no subtitle, the caption is not flush with the bottom
     if (brect2.height() < fontSize) brect2.setHeight(fontSize);
     brect2.setHeight(brect2.height()+5); // A bit of buffer
 
     // So that the text does not occupy more than the lower half of the buffer
-    if (brect.height() > ((int)(buffer.height()/3.0)) - fontSize*2)
-        brect.setHeight(((int)buffer.height()/3.0) - fontSize*2);
+    if (brect.height() > ((int)(buffer_height/3.0)) - fontSize*2)
+        brect.setHeight(((int)buffer_height/3.0) - fontSize*2);
 
-    brect.moveTop(buffer_height - (brect.height() + brect2.height()));
-    //printf("top: %d, height: %d\n", brect.top(), brect.height());
-    //
-    painter->drawText(brect, TEXT_FLAGS, caption);
+    QImage img(buffer_width, brect.height() + brect2.height(), QImage::Format_ARGB32_Premultiplied);
+    img.fill(Qt::transparent);
 
-    brect2.moveTop(buffer_height - brect2.height());
+    QPainter painter(&img);
+    painter.setPen(Qt::white);
+    painter.setFont(captionFont);
+    brect.moveTop(0);
+    painter.drawText(brect, TEXT_FLAGS, caption);
+    brect2.moveTop(brect.height());
+    painter.setFont(subtitleFont);
+    painter.drawText(brect2, TEXT_FLAGS, subtitle);
+    painter.end();
 
-    painter->save();
-    painter->setFont(subtitleFont);
-    painter->drawText(brect2, TEXT_FLAGS, slideImages->subtitle(index));
-    painter->restore();
+    // Only the slides near the center ever get captions, but a long flick
+    // visits many; do not let the cache grow without bound
+    if (captionCache.count() > 256)
+        captionCache.clear();
+    captionCache.insert(index, img);
+    return img;
+}
+
+// Blit the cached caption strip for a slide, modulated by alpha for the
+// crossfade during animation. Returns the area actually drawn, so render()
+// can track it as dirty.
+QRect PictureFlowPrivate::render_text(QPainter *painter, int index, int alpha) {
+    QImage img = captionImage(index);
+    const int top = buffer.height() - img.height();
+    if (alpha >= 255) {
+        painter->drawImage(0, top, img);
+    } else if (alpha > 0) {
+        painter->save();
+        painter->setOpacity(alpha / 255.0);
+        painter->drawImage(0, top, img);
+        painter->restore();
+    }
+    return QRect(0, top, img.width(), img.height());
 }
 
-// Render the slides. Updates only the offscreen buffer.
-void PictureFlowPrivate::render()
+// Renders the left stack of slides, nearest first, into columns [0, c1-1].
+// Writes only columns left of c1 and reads only shared state that is
+// constant during a render pass, so it can run concurrently with
+// renderRightStack(). srcs holds the surfaces prefetched by render().
+// Returns the leftmost column drawn.
+int PictureFlowPrivate::renderLeftStack(int c1, const QVector<QImage*> &srcs)
 {
-  buffer.fill(0);
-
   int nleft = leftSlides.count();
-  int nright = rightSlides.count();
-  QRect r;
-
-  if (step == 0)
-      r = renderCenterSlide(centerSlide);
-  else
-      r = renderSlide(centerSlide);
-  int c1 = r.left();
-  int c2 = r.right();
-
   if(step == 0)
   {
     // no animation, boring plain rendering
     for(int index = 0; index < nleft-1; index++)
     {
       int alpha = (index < nleft-2) ? 256 : 128;
-      QRect rs = renderSlide(leftSlides[index], alpha, 0, c1-1);
+      QRect rs = renderSlide(leftSlides[index], srcs[index], alpha, 0, c1-1);
       if(!rs.isEmpty())
         c1 = rs.left();
     }
-    for(int index = 0; index < nright-1; index++)
-    {
-      int alpha = (index < nright-2) ? 256 : 128;
-      QRect rs = renderSlide(rightSlides[index], alpha, c2+1, buffer.width());
-      if(!rs.isEmpty())
-        c2 = rs.right();
-    }
-
-    QPainter painter;
-    painter.begin(&buffer);
-
-    QFont font = QFont();
-    font.setBold(true);
-    font.setPixelSize(fontSize);
-    painter.setFont(font);
-    painter.setPen(Qt::white);
-    //painter.setPen(QColor(255,255,255,127));
-
-    if (centerIndex < slideCount() && centerIndex > -1) {
-        render_text(&painter, centerIndex);
-    }
-
-    painter.end();
-
   }
   else
   {
@@ -815,12 +1190,31 @@ void PictureFlowPrivate::render()
         alpha = (step > 0) ? 128-fade/2 : 256-fade/2;
       if(index == nleft-3)
         alpha = (step > 0) ? 256-fade/2 : 256;
-      QRect rs = renderSlide(leftSlides[index], alpha, 0, c1-1);
+      QRect rs = renderSlide(leftSlides[index], srcs[index], alpha, 0, c1-1);
       if(!rs.isEmpty())
         c1 = rs.left();
+    }
+  }
+  return c1;
+}
 
-      alpha = (step > 0) ? 256-fade/2 : 256;
+// The right hand counterpart of renderLeftStack(), writing only columns
+// right of c2. Returns the rightmost column drawn.
+int PictureFlowPrivate::renderRightStack(int c2, const QVector<QImage*> &srcs)
+{
+  int nright = rightSlides.count();
+  if(step == 0)
+  {
+    for(int index = 0; index < nright-1; index++)
+    {
+      int alpha = (index < nright-2) ? 256 : 128;
+      QRect rs = renderSlide(rightSlides[index], srcs[index], alpha, c2+1, buffer.width());
+      if(!rs.isEmpty())
+        c2 = rs.right();
     }
+  }
+  else
+  {
     for(int index = 0; index < nright; index++)
     {
       int alpha = (index < nright-2) ? 256 : 128;
@@ -830,36 +1224,136 @@ void PictureFlowPrivate::render()
         alpha = (step > 0) ? 128+fade/2 : fade/2;
       if(index == nright-3)
         alpha = (step > 0) ? 256 : 128+fade/2;
-      QRect rs = renderSlide(rightSlides[index], alpha, c2+1, buffer.width());
+      QRect rs = renderSlide(rightSlides[index], srcs[index], alpha, c2+1, buffer.width());
       if(!rs.isEmpty())
         c2 = rs.right();
     }
+  }
+  return c2;
+}
+
+// Renders the left stack on a pool thread while the calling (GUI) thread
+// renders the right stack; the two write disjoint column ranges of buffer.
+class LeftStackTask : public QRunnable
+{
+public:
+  LeftStackTask(PictureFlowPrivate *d_, int c1_, const QVector<QImage*> *srcs_, QSemaphore *done_)
+    : d(d_), result(c1_), c1(c1_), srcs(srcs_), done(done_) { setAutoDelete(false); }
+  virtual void run() { result = d->renderLeftStack(c1, *srcs); done->release(); }
+  int result;
+private:
+  PictureFlowPrivate *d;
+  int c1;
+  const QVector<QImage*> *srcs;
+  QSemaphore *done;
+};
+
+// Resets the given area of buffer to the (black) background. Together with
+// the dirty tracking in render() this replaces clearing the whole buffer
+// every animation tick.
+void PictureFlowPrivate::clearBufferRect(const QRect &rect)
+{
+  QRect r = rect.intersected(buffer.rect());
+  if(r.isEmpty())
+    return;
+  const int bytes = r.width() * (int)sizeof(QRgb565);
+  for(int y = r.top(); y <= r.bottom(); y++)
+    memset(buffer.scanLine(y) + r.left() * (int)sizeof(QRgb565), 0, bytes);
+}
+
+// Render the slides. Updates only the offscreen buffer.
+void PictureFlowPrivate::render()
+{
+  collectPrerendered();
+
+  // Only the slide band and the caption area change between ticks and the
+  // background is plain black, so instead of refilling the whole buffer,
+  // clear what the previous frame drew and track what this frame draws
+  QRect dirty = prevSlideBand.united(prevTextRect);
+  clearBufferRect(prevSlideBand);
+  clearBufferRect(prevTextRect);
+
+  int nleft = leftSlides.count();
+  int nright = rightSlides.count();
+  QRect r;
+
+  if (step == 0)
+      r = renderCenterSlide(centerSlide);
+  else
+      r = renderSlide(centerSlide);
+  int c1 = r.left();
+  int c2 = r.right();
 
+  // Build any missing surfaces up front, on this thread: surface() mutates
+  // the cache and can call into the Python side of the model, neither of
+  // which may happen on the stack workers. The cache never evicts entries
+  // this close to the center, so the collected pointers stay valid for the
+  // whole pass.
+  QVector<QImage*> left_srcs(nleft), right_srcs(nright);
+  for(int index = 0; index < nleft; index++)
+    left_srcs[index] = surface(leftSlides[index].slideIndex);
+  for(int index = 0; index < nright; index++)
+    right_srcs[index] = surface(rightSlides[index].slideIndex);
+
+  // Warm the projection base cache for every slide geometry in this frame,
+  // on this thread: the stack workers only read the cache. The stack slides
+  // all share (angle, cy) so this is a handful of lookups plus at most a
+  // couple of rebuilds for the transitional slides.
+  if(step != 0)
+    ensureProjectionBase(centerSlide.angle, centerSlide.cy);
+  for(int index = 0; index < nleft; index++)
+    ensureProjectionBase(leftSlides[index].angle, leftSlides[index].cy);
+  for(int index = 0; index < nright; index++)
+    ensureProjectionBase(rightSlides[index].angle, rightSlides[index].cy);
+
+  buffer.bits();  // force any pending detach before the workers write
 
+  {
+    QSemaphore done;
+    LeftStackTask task(this, c1, &left_srcs, &done);
+    if(QThreadPool::globalInstance()->tryStart(&task))
+    {
+      c2 = renderRightStack(c2, right_srcs);
+      done.acquire();
+      c1 = task.result;
+    }
+    else
+    {
+      // no pool thread free, render both stacks here
+      c1 = renderLeftStack(c1, left_srcs);
+      c2 = renderRightStack(c2, right_srcs);
+    }
+  }
 
-    QPainter painter;
-    painter.begin(&buffer);
+  prevSlideBand = QRect(c1, 0, c2 - c1 + 1, buffer.height());
+  prevTextRect = QRect();
 
-    QFont font = QFont();
-    font.setBold(true);
-    font.setPixelSize(fontSize);
-    painter.setFont(font);
+  QPainter painter;
+  painter.begin(&buffer);
 
+  if(step == 0)
+  {
+    if (centerIndex < slideCount() && centerIndex > -1) {
+        prevTextRect = render_text(&painter, centerIndex);
+    }
+  }
+  else
+  {
     int leftTextIndex = (step>0) ? centerIndex : centerIndex-1;
     int sc = slideCount();
 
-    painter.setPen(QColor(255,255,255, (255-fade) ));
     if (leftTextIndex < sc && leftTextIndex > -1) {
-        render_text(&painter, leftTextIndex);
+        prevTextRect = render_text(&painter, leftTextIndex, 255-fade);
     }
 
-    painter.setPen(QColor(255,255,255, fade));
     if (leftTextIndex+1 < sc && leftTextIndex > -2) {
-        render_text(&painter, leftTextIndex+1);
+        prevTextRect = prevTextRect.united(render_text(&painter, leftTextIndex+1, fade));
     }
-
-    painter.end();
   }
+
+  painter.end();
+
+  frameDirtyRect = dirty.united(prevSlideBand).united(prevTextRect).intersected(buffer.rect());
 }
 
 
@@ -890,18 +1384,110 @@ QRect PictureFlowPrivate::renderCenterSlide(const SlideInfo &slide) {
   int xcon = MIN(h-1, sh-1);
   int ycon = MIN(sw, buffer.width() - left);
 
-  for(int x = 0; x < xcon; x++)
-      for(int y = 0; y < ycon; y++)
-          buffer.setPixel(left + y, 1+x, src->pixel(x, srcoff+y));
+  // The surface is stored transposed (slide columns as scanlines), so this
+  // is a transposing copy: read each surface scanline sequentially and
+  // scatter it down a buffer column. Done with raw pointers, as
+  // QImage::pixel()/setPixel() dispatch on format and bounds-check per call,
+  // which made this loop by far the slowest part of the static frame.
+  uchar *dst_base = buffer.bits();
+  const int dst_stride = buffer.bytesPerLine();
+  for(int y = 0; y < ycon; y++) {
+      const QRgb565 *srcline = reinterpret_cast<const QRgb565*>(src->constScanLine(srcoff + y));
+      uchar *dst = dst_base + dst_stride + (left + y) * (int)sizeof(QRgb565);
+      for(int x = 0; x < xcon; x++, dst += dst_stride)
+          *reinterpret_cast<QRgb565*>(dst) = srcline[x];
+  }
 
   return rect;
 }
+// Fill b with the per-column projection terms for the given (angle, cy).
+// For every buffer column x, hity = A[x] + fmul(cx, B[x]), which replaces
+// the two per-column fixed-point divisions of the old inline math with a
+// single multiply; the remaining division by sdx is likewise replaced by a
+// multiply with inv_sdx. The factored form can differ from dividing
+// directly by a few fixed-point ULPs, at most a sub-pixel shift in where a
+// source column lands.
+void PictureFlowPrivate::buildProjectionBase(ProjectionBase &b, int angle, PFreal cy) const
+{
+  const int w = buffer.width();
+  const int distance = buffer.height();
+  b.angle = angle; b.cy = cy; b.w = w;
+  b.sdx = fcos(angle);
+  b.sdy = fsin(angle);
+  b.inv_sdx = b.sdx ? fdiv(PFREAL_ONE, b.sdx) : 0;
+  b.A.resize(w); b.B.resize(w);
+  for(int x = 0; x < w; x++)
+  {
+    PFreal A = 0, B = 0;
+    if(b.sdy)
+    {
+      PFreal fk = rays[x] - fdiv(b.sdx, b.sdy);
+      if(fk)
+      {
+        A = -fdiv(rays[x]*distance + cy*b.sdx/b.sdy, fk);
+        B = fdiv(PFREAL_ONE, fk);
+      }
+    }
+    b.A[x] = A; b.B[x] = B;
+  }
+}
+
+// Look up or build the projection base for (angle, cy). Must only be
+// called from the GUI thread: it mutates the cache. render() warms the
+// cache for every slide before the stack workers start, so the workers
+// only hit findProjectionBase().
+const ProjectionBase* PictureFlowPrivate::ensureProjectionBase(int angle, PFreal cy)
+{
+  ProjectionBase *b = NULL;
+  for(int i = 0; i < projectionBases.count(); i++)
+  {
+    ProjectionBase &e = projectionBases[i];
+    if(e.angle == angle && e.cy == cy && e.w == buffer.width())
+    {
+      e.lastUsed = ++projectionUseCounter;
+      return &e;
+    }
+  }
+  if(projectionBases.count() < MaxProjectionBases)
+  {
+    projectionBases.append(ProjectionBase());
+    b = &projectionBases.last();
+  }
+  else
+  {
+    b = &projectionBases[0];
+    for(int i = 1; i < projectionBases.count(); i++)
+      if(projectionBases[i].lastUsed < b->lastUsed)
+        b = &projectionBases[i];
+  }
+  buildProjectionBase(*b, angle, cy);
+  b->lastUsed = ++projectionUseCounter;
+  return b;
+}
+
+const ProjectionBase* PictureFlowPrivate::findProjectionBase(int angle, PFreal cy) const
+{
+  for(int i = 0; i < projectionBases.count(); i++)
+  {
+    const ProjectionBase &e = projectionBases.at(i);
+    if(e.angle == angle && e.cy == cy && e.w == buffer.width())
+      return &e;
+  }
+  return NULL;
+}
+
 // Renders a slide to offscreen buffer. Returns a rect of the rendered area.
 // alpha=256 means normal, alpha=0 is fully black, alpha=128 half transparent
 // col1 and col2 limit the column for rendering.
 QRect PictureFlowPrivate::renderSlide(const SlideInfo &slide, int alpha, int col1, int col2)
 {
-  QImage* src = surface(slide.slideIndex);
+  return renderSlide(slide, surface(slide.slideIndex), alpha, col1, col2);
+}
+
+// The variant taking an already looked up surface, used by the stack
+// renderers: the workers must not call surface() themselves.
+QRect PictureFlowPrivate::renderSlide(const SlideInfo &slide, QImage *src, int alpha, int col1, int col2)
+{
   if(!src)
     return QRect();
 
@@ -925,8 +1511,17 @@ QRect PictureFlowPrivate::renderSlide(const SlideInfo &slide, int alpha, int col
   col2 = qMin(col2, w-1);
 
   int distance = h;
-  PFreal sdx = fcos(slide.angle);
-  PFreal sdy = fsin(slide.angle);
+  // The workers must not touch the cache, so a miss (which render() makes
+  // sure cannot normally happen) falls back to a private local table
+  ProjectionBase localBase;
+  const ProjectionBase *base = findProjectionBase(slide.angle, slide.cy);
+  if(!base)
+  {
+    buildProjectionBase(localBase, slide.angle, slide.cy);
+    base = &localBase;
+  }
+  PFreal sdx = base->sdx;
+  PFreal sdy = base->sdy;
   PFreal xs = slide.cx - slideWidth * sdx/2;
   PFreal ys = slide.cy - slideWidth * sdy/2;
   PFreal dist = distance * PFREAL_ONE;
@@ -946,20 +1541,14 @@ QRect PictureFlowPrivate::renderSlide(const SlideInfo &slide, int alpha, int col
   }
   for(int x = qMax(xi, col1); x <= col2; x++)
   {
-    PFreal hity = 0;
-    PFreal fk = rays[x];
-    if(sdy)
-    {
-      fk = fk - fdiv(sdx,sdy);
-      hity = -fdiv((rays[x]*distance - slide.cx + slide.cy*sdx/sdy), fk);
-    }
+    PFreal hity = base->A[x] + fmul(slide.cx, base->B[x]);
 
     dist = distance*PFREAL_ONE + hity;
     if(dist < 0)
       continue;
 
     PFreal hitx = fmul(dist, rays[x]);
-    PFreal hitdist = fdiv(hitx - slide.cx, sdx);
+    PFreal hitdist = fmul(hitx - slide.cx, base->inv_sdx);
 
     int column = sw/2 + (hitdist >> PFREAL_SHIFT);
     if(column >= sw)
@@ -994,7 +1583,9 @@ QRect PictureFlowPrivate::renderSlide(const SlideInfo &slide, int alpha, int col
     int p1 = center*PFREAL_ONE - dy/2;
     int p2 = center*PFREAL_ONE + dy/2;
 
-    const QRgb565 *ptr = (const QRgb565*)(src->scanLine(column));
+    // constScanLine: the blank surface can be shared by both stack workers,
+    // and the non-const overload's detach check is not thread safe
+    const QRgb565 *ptr = (const QRgb565*)(src->constScanLine(column));
     if(alpha == 256)
       while((y1 >= 0) && (y2 < h) && (p1 >= 0))
       {
@@ -1048,6 +1639,10 @@ void PictureFlowPrivate::recalc(int ww, int wh)
   int h = (wh+1)/2;
   buffer = QImage(ww, wh, QImage::Format_RGB16);
   buffer.fill(0);
+  // fresh buffer: nothing to clear next frame, everything to repaint
+  prevSlideBand = QRect();
+  prevTextRect = QRect();
+  frameDirtyRect = buffer.rect();
 
   rays.resize(w*2);
 
@@ -1058,6 +1653,11 @@ void PictureFlowPrivate::recalc(int ww, int wh)
     rays[w+i] = gg;
   }
 
+  // the projection bases are derived from rays and the buffer size, and
+  // the cached captions from the buffer size and font size
+  projectionBases.clear();
+  captionCache.clear();
+
   // pointer must move more than 1/15 of the window to enter drag mode
   singlePressThreshold = ww / 15;
 //  qDebug() << "singlePressThreshold now set to " << singlePressThreshold;
@@ -1083,6 +1683,7 @@ void PictureFlowPrivate::recalc(int ww, int wh)
   spacing = slideWidth/5;
 
   surfaceCache.clear();
+  invalidatePrerender();
   blankSurface = QImage();
 }
 
@@ -1092,6 +1693,7 @@ void PictureFlowPrivate::startAnimation()
   {
     step = (target < centerSlide.slideIndex) ? -1 : 1;
     animateTimer.start(30, widget);
+    prerenderNeighbours();
   }
 }
 
@@ -1136,6 +1738,7 @@ void PictureFlowPrivate::updateAnimation()
   if(centerIndex != index)
   {
     centerIndex = index;
+    surfaceCache.setCurrentSlide(centerIndex);
     slideFrame = ((long long)index) << 16;
     centerSlide.slideIndex = centerIndex;
     for(int i = 0; i < leftSlides.count(); i++)
@@ -1196,6 +1799,7 @@ void PictureFlowPrivate::updateAnimation()
   if(target > index) if(step < 0)
     step = 1;
 
+  prerenderNeighbours();
   triggerRender(0);
 }
 
@@ -1203,6 +1807,7 @@ void PictureFlowPrivate::updateAnimation()
 void PictureFlowPrivate::clearSurfaceCache()
 {
   surfaceCache.clear();
+  invalidatePrerender();
 }
 
 // }}}
@@ -1253,6 +1858,7 @@ void PictureFlow::setPreserveAspectRatio(bool preserve)
 void PictureFlow::setSubtitleFont(QFont font)
 {
   d->subtitleFont = font;
+  d->invalidateCaptions();  // cached captions were rendered with the old font
 }
 
 QFont PictureFlow::subtitleFont() const
@@ -1294,10 +1900,27 @@ void PictureFlow::clearCaches()
   d->clearSurfaceCache();
 }
 
+quint64 PictureFlow::surfaceCacheBudget() const
+{
+  return d->surfaceCacheBudget();
+}
+
+void PictureFlow::setSurfaceCacheBudget(quint64 bytes)
+{
+  d->setSurfaceCacheBudget(bytes);
+}
+
 void PictureFlow::render()
 {
   d->render();
-  update();
+  if (d->frameDirtyRect.isNull()) {
+    update();
+  } else {
+    // buffer is in device pixels, update() takes logical coordinates
+    qreal dpr = device_pixel_ratio();
+    QRectF r(d->frameDirtyRect);
+    update(QRectF(r.x() / dpr, r.y() / dpr, r.width() / dpr, r.height() / dpr).toAlignedRect().adjusted(-1, -1, 1, 1));
+  }
 }
 
 void PictureFlow::showPrevious()
@@ -1520,11 +2143,13 @@ void PictureFlow::timerEvent(QTimerEvent* event)
 }
 
 void PictureFlow::dataChanged() { d->dataChanged(); }
+void PictureFlow::imageReady(int index) { d->imageDecoded(index); }
 void PictureFlow::emitcurrentChanged(int index) { emit currentChanged(index); }
 
 int FlowImages::count() { return 0; }
 QImage FlowImages::image(int index) { Q_UNUSED(index); return QImage(); }
 QString FlowImages::caption(int index) { Q_UNUSED(index); return QString(); }
 QString FlowImages::subtitle(int index) { Q_UNUSED(index); return QString(); }
+void FlowImages::prefetch(const QList<int> &indices) { Q_UNUSED(indices); }
 
 // }}}
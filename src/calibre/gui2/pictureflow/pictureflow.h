@@ -69,8 +69,20 @@ public:
 	virtual QString caption(int index);
     virtual QString subtitle(int index);
 
+    /*!
+      Hint that the widget will soon want image() for these indices.
+      The default implementation does nothing, leaving image() fully
+      synchronous. Asynchronous models should start decoding in the
+      background into a small buffer of ready images, return a null image
+      from image() while an index is still decoding, and emit imageReady()
+      once a later image() call can be served from that buffer, so cover
+      decode I/O never runs on the GUI thread.
+    */
+    virtual void prefetch(const QList<int> &indices);
+
 signals:
 	void dataChanged();
+	void imageReady(int index);
 
 };
 
@@ -154,6 +166,19 @@ public:
   */
   void clearCaches();
 
+  /*!
+    Returns the maximum amount of memory (in bytes) used to cache rendered
+    slide surfaces.
+  */
+  quint64 surfaceCacheBudget() const;
+
+  /*!
+    Sets the maximum amount of memory (in bytes) used to cache rendered slide
+    surfaces. Surfaces farthest from the current slide are evicted first when
+    the budget is exceeded.
+  */
+  void setSurfaceCacheBudget(quint64 bytes);
+
   /*!
     Returns QImage of specified slide.
     This function will be called only whenever necessary, e.g. the 100th slide
@@ -199,7 +224,13 @@ public slots:
     Clear all caches and redraw
   */
   void dataChanged();
-  
+
+  /*!
+    Notification from an asynchronous FlowImages model that image(index)
+    can now be served without blocking.
+  */
+  void imageReady(int index);
+
   void emitcurrentChanged(int index);
 
 signals:
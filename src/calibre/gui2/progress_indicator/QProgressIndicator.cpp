@@ -3,6 +3,7 @@
 #include <QPainter>
 #include <QtWidgets/QStyle>
 #include <QtWidgets/QApplication>
+#include <QScreen>
 #include <QDebug>
 #include <QStyleFactory>
 #include <QtWidgets/QProxyStyle>
@@ -17,10 +18,24 @@ QProgressIndicator::QProgressIndicator(QWidget* parent, int size)
         m_delay(80),
         m_displaySize(size),
         m_displayedWhenStopped(true),
-        m_color(Qt::black)
+        m_color(Qt::black),
+        m_minPaintInterval(1000/60)
 {
     setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
     setFocusPolicy(Qt::NoFocus);
+    // Painting faster than the display refreshes is wasted work
+    QScreen *screen = QApplication::primaryScreen();
+    if (screen && screen->refreshRate() > 1)
+        m_minPaintInterval = static_cast<int>(1000 / screen->refreshRate());
+    m_sincePaint.start();
+}
+
+void QProgressIndicator::requestRepaint()
+{
+    if (!isVisible() || m_sincePaint.elapsed() < m_minPaintInterval)
+        return;
+
+    update();
 }
 
 bool QProgressIndicator::isAnimated () const
@@ -30,6 +45,9 @@ bool QProgressIndicator::isAnimated () const
 
 void QProgressIndicator::setDisplayedWhenStopped(bool state)
 {
+    if (m_displayedWhenStopped == state)
+        return;
+
     m_displayedWhenStopped = state;
 
     update();
@@ -37,6 +55,9 @@ void QProgressIndicator::setDisplayedWhenStopped(bool state)
 
 void QProgressIndicator::setDisplaySize(int size)
 {
+    if (m_displaySize == size)
+        return;
+
     m_displaySize = size;
     update();
 }
@@ -78,6 +99,9 @@ void QProgressIndicator::setAnimationDelay(int delay)
 
 void QProgressIndicator::setColor(const QColor & color)
 {
+    if (m_color == color)
+        return;
+
     m_color = color;
 
     update();
@@ -97,11 +121,13 @@ void QProgressIndicator::timerEvent(QTimerEvent * /*event*/)
 {
     m_angle = (m_angle+30)%360;
 
-    update();
+    requestRepaint();
 }
 
 void QProgressIndicator::paintEvent(QPaintEvent * /*event*/)
 {
+    m_sincePaint.start();
+
     if (!m_displayedWhenStopped && !isAnimated())
         return;
 
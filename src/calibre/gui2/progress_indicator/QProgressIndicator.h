@@ -2,6 +2,7 @@
 
 #include <QtWidgets/QWidget>
 #include <QColor>
+#include <QElapsedTimer>
 #include <QHash>
 
 /*! 
@@ -81,15 +82,22 @@ public slots:
      */
     void setDisplaySize(int size);
 protected:
-    virtual void timerEvent(QTimerEvent * event); 
+    virtual void timerEvent(QTimerEvent * event);
     virtual void paintEvent(QPaintEvent * event);
 private:
+    /*! Schedule a repaint, unless one was painted more recently than the
+        display can show. The rotation angle keeps accumulating either way,
+        so coalesced ticks do not slow the animation down. */
+    void requestRepaint();
+
     int m_angle;
     int m_timerId;
     int m_delay;
     int m_displaySize;
     bool m_displayedWhenStopped;
     QColor m_color;
+    int m_minPaintInterval;
+    QElapsedTimer m_sincePaint;
 };
 
 int load_style(QHash<int,QString> icon_map);
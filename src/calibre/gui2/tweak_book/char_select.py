@@ -36,6 +36,12 @@ non_printing = {
 
 # Searching {{{
 def search_for_chars(query, and_tokens=False):
+    if and_tokens:
+        tokens = [t.lower() for t in query.split()]
+        if tokens and not any(re.match(r'(?:[u]\+)([a-f0-9]+)', t) for t in tokens):
+            # All plain words, intersect them in C
+            from calibre.utils.unicode_names import points_for_words
+            return sorted(points_for_words(tokens))
     ans = set()
     for i, token in enumerate(query.split()):
         token = token.lower()
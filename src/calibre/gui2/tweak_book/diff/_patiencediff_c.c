@@ -24,6 +24,7 @@
 
 
 #include <Python.h>
+#include <pythread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -132,6 +133,12 @@ typedef struct {
     Py_ssize_t *backpointers;
 } PatienceSequenceMatcher;
 
+static PyTypeObject PatienceSequenceMatcherType;
+
+static PyObject *
+opcodes_from_matches(struct matching_blocks *matches,
+                     Py_ssize_t asize, Py_ssize_t bsize);
+
 
 static inline Py_ssize_t
 bisect_left(Py_ssize_t *list, Py_ssize_t item, Py_ssize_t lo, Py_ssize_t hi)
@@ -151,7 +158,8 @@ static inline int
 compare_lines(struct line *a, struct line *b)
 {
     return ((a->hash != b->hash)
-            || PyObject_RichCompareBool(a->data, b->data, Py_NE));
+            || (a->data != b->data
+                && PyObject_RichCompareBool(a->data, b->data, Py_NE)));
 }
 
 
@@ -175,8 +183,8 @@ equate_lines(struct hashtable *result,
              struct line *lines_a, struct line *lines_b,
              Py_ssize_t asize, Py_ssize_t bsize)
 {
-    Py_ssize_t i, j, hsize;
-    struct bucket *hashtable;
+    Py_ssize_t i, j, hsize, nclasses, *map = NULL;
+    struct bucket *hashtable, *classes = NULL;
 
     /* check for overflow, we need the table to be at least bsize+1 */
     if (bsize == PY_SSIZE_T_MAX) {
@@ -244,10 +252,50 @@ equate_lines(struct hashtable *result,
         hashtable[j].a_count++;
     }
 
+    /* intern the equivalence classes into dense integer ids. The LCS core
+       never touches the line objects again, only the class of each line, and
+       unique_lcs resets the whole class table whenever the recursion moves
+       backwards, so a compact table (one entry per distinct line instead of
+       a mostly empty power of two) is much kinder to the cache */
+    map = (Py_ssize_t *) guarded_malloc(sizeof(Py_ssize_t) * (hsize + 1));
+    if (map == NULL) {
+        free(hashtable);
+        PyErr_NoMemory();
+        return 0;
+    }
+    for (i = 0; i <= hsize; i++)
+        map[i] = SENTINEL;
+    nclasses = 0;
+    for (i = 0; i < bsize; i++)
+        if (map[lines_b[i].equiv] == SENTINEL)
+            map[lines_b[i].equiv] = nclasses++;
+    for (i = 0; i < asize; i++)
+        if (map[lines_a[i].equiv] == SENTINEL)
+            map[lines_a[i].equiv] = nclasses++;
+
+    if (nclasses > 0) {
+        classes = (struct bucket *) guarded_malloc(sizeof(struct bucket) * nclasses);
+        if (classes == NULL) {
+            free(map);
+            free(hashtable);
+            PyErr_NoMemory();
+            return 0;
+        }
+        for (i = 0; i <= hsize; i++)
+            if (map[i] != SENTINEL)
+                classes[map[i]] = hashtable[i];
+        for (i = 0; i < bsize; i++)
+            lines_b[i].equiv = map[lines_b[i].equiv];
+        for (i = 0; i < asize; i++)
+            lines_a[i].equiv = map[lines_a[i].equiv];
+    }
+    free(map);
+    free(hashtable);
+
     result->last_a_pos = -1;
     result->last_b_pos = -1;
-    result->size = hsize + 1;
-    result->table = hashtable;
+    result->size = nclasses;
+    result->table = classes;
 
     return 1;
 }
@@ -605,6 +653,184 @@ load_lines(PyObject *orig, struct line **lines)
 }
 
 
+/* Fallback matcher for inputs the patience algorithm handles badly. {{{
+
+   Patience diff anchors on lines that are unique in both sequences; inputs
+   like minified javascript or base64 blobs have almost none, so
+   recurse_matches degenerates into one big replace after an expensive
+   search. When unique anchors are scarce we instead run a classic Myers
+   greedy diff over the interned equivalence class ids (no python object
+   access), with a cap on the edit distance so the worst case stays bounded;
+   if the cap is hit the patience algorithm is used after all. */
+
+#ifndef SCARCE_ANCHORS_MIN_LINES
+#define SCARCE_ANCHORS_MIN_LINES 2000
+#endif
+#ifndef SCARCE_ANCHORS_DENSITY
+#define SCARCE_ANCHORS_DENSITY 64  /* scarce = fewer than 1/64 unique anchors */
+#endif
+#ifndef MYERS_MAX_COST
+#define MYERS_MAX_COST 1024
+#endif
+
+static int
+patience_anchors_are_scarce(PatienceSequenceMatcher *self)
+{
+    Py_ssize_t i, unique = 0, smaller = MIN(self->asize, self->bsize);
+
+    if (smaller < SCARCE_ANCHORS_MIN_LINES)
+        return 0;
+    for (i = 0; i < self->hashtable.size; i++)
+        if (self->hashtable.table[i].a_count == 1 &&
+            self->hashtable.table[i].b_count == 1)
+            unique++;
+    return unique * SCARCE_ANCHORS_DENSITY < smaller;
+}
+
+
+/* Myers greedy diff of a[0:asize] and b[0:bsize], comparing lines by their
+   equivalence class. Returns 1 on success, 0 on memory error, -1 if the
+   edit distance exceeds MYERS_MAX_COST. */
+static int
+myers_matches(struct matching_blocks *answer, struct line *a, struct line *b,
+              Py_ssize_t asize, Py_ssize_t bsize)
+{
+    Py_ssize_t alo = 0, blo = 0, ahi = asize, bhi = bsize, tail;
+    Py_ssize_t n, m, cap, d, k, x, y, px, py_, pk;
+    Py_ssize_t *v = NULL, *trace = NULL;
+    struct matching_line *middle = NULL;
+    Py_ssize_t nmiddle = 0, i;
+    int found = 0, ret = -1;
+
+    /* matching prefix and suffix are common and cost nothing to peel off */
+    while (alo < ahi && blo < bhi && a[alo].equiv == b[blo].equiv)
+        add_matching_line(answer, alo++, blo++);
+    while (ahi > alo && bhi > blo && a[ahi - 1].equiv == b[bhi - 1].equiv) {
+        ahi--;
+        bhi--;
+    }
+    tail = asize - ahi;  /* == bsize - bhi */
+
+    n = ahi - alo;
+    m = bhi - blo;
+    if (n == 0 || m == 0)
+        goto suffix;
+
+    cap = MIN(n + m, MYERS_MAX_COST);
+
+    v = (Py_ssize_t *)guarded_malloc(sizeof(Py_ssize_t) * (2 * cap + 1));
+    /* layer d of the trace starts at d*d and holds 2*d+1 entries */
+    trace = (Py_ssize_t *)guarded_malloc(sizeof(Py_ssize_t) * (cap + 1) * (cap + 1));
+    if (v == NULL || trace == NULL) {
+        /* like recurse_matches, report memory errors by returning 0; this
+           can run without the GIL so no exception may be set here */
+        ret = 0;
+        goto done;
+    }
+
+    v[cap + 1] = 0;
+    for (d = 0; d <= cap && !found; d++) {
+        for (k = -d; k <= d; k += 2) {
+            if (k == -d || (k != d && v[cap + k - 1] < v[cap + k + 1]))
+                x = v[cap + k + 1];
+            else
+                x = v[cap + k - 1] + 1;
+            y = x - k;
+            while (x < n && y < m && a[alo + x].equiv == b[blo + y].equiv) {
+                x++;
+                y++;
+            }
+            v[cap + k] = x;
+            if (x >= n && y >= m) {
+                found = 1;
+                break;
+            }
+        }
+        for (k = -d; k <= d; k += 2)
+            trace[d * d + d + k] = v[cap + k];
+        if (found) {
+            d++;  /* make d the edit distance + 1 for the backtrace below */
+            break;
+        }
+    }
+    if (!found)
+        goto done;  /* too expensive, let the caller fall back to patience */
+    d--;
+
+    middle = (struct matching_line *)guarded_malloc(sizeof(struct matching_line) * (MIN(n, m) + 1));
+    if (middle == NULL) {
+        ret = 0;
+        goto done;
+    }
+
+    /* walk the trace backwards, recording the diagonal runs (= matches) */
+    x = n;
+    y = m;
+    while (d > 0) {
+        k = x - y;
+        if (k == -d || (k != d && trace[(d - 1) * (d - 1) + (d - 1) + k - 1] <
+                                  trace[(d - 1) * (d - 1) + (d - 1) + k + 1]))
+            pk = k + 1;
+        else
+            pk = k - 1;
+        px = trace[(d - 1) * (d - 1) + (d - 1) + pk];
+        py_ = px - pk;
+        while (x > px && y > py_) {
+            x--;
+            y--;
+            middle[nmiddle].a = alo + x;
+            middle[nmiddle].b = blo + y;
+            nmiddle++;
+        }
+        x = px;
+        y = py_;
+        d--;
+    }
+    while (x > 0 && y > 0) {
+        x--;
+        y--;
+        middle[nmiddle].a = alo + x;
+        middle[nmiddle].b = blo + y;
+        nmiddle++;
+    }
+
+    for (i = nmiddle - 1; i >= 0; i--)
+        add_matching_line(answer, middle[i].a, middle[i].b);
+
+suffix:
+    for (i = 0; i < tail; i++)
+        add_matching_line(answer, ahi + i, bhi + i);
+    ret = 1;
+
+done:
+    free(v);
+    free(trace);
+    free(middle);
+    return ret;
+}
+
+
+/* Compute the matching blocks for a matcher, choosing the algorithm based on
+   the input. The answer array must have room for at least bsize blocks. */
+static int
+compute_matches(struct matching_blocks *answer, PatienceSequenceMatcher *self)
+{
+    int res;
+
+    if (patience_anchors_are_scarce(self)) {
+        res = myers_matches(answer, self->a, self->b, self->asize, self->bsize);
+        if (res >= 0)
+            return res;
+        /* the edit distance cap was hit, use patience after all */
+        answer->count = 0;
+    }
+    return recurse_matches(answer, &self->hashtable, self->backpointers,
+                           self->a, self->b, 0, 0,
+                           self->asize, self->bsize, 10);
+}
+/* }}} */
+
+
 static PyObject *
 py_unique_lcs(PyObject *self, PyObject *args)
 {
@@ -753,6 +979,576 @@ error:
 }
 
 
+/* Parallel diffing of many independent sequence pairs.
+
+   Loading and equating lines calls back into python and so runs with the GIL
+   held, but the actual matching (recurse_matches and friends) is pure C.
+   diff_many() therefore loads all the pairs first, then releases the GIL and
+   runs the matching phase on a small pool of native threads, one task per
+   pair. */
+
+struct diff_many_task {
+    PatienceSequenceMatcher *matcher;
+    struct matching_blocks matches;
+    int ok;
+};
+
+struct diff_many_queue {
+    struct diff_many_task *tasks;
+    Py_ssize_t count;
+    Py_ssize_t next;            /* index of the next unclaimed task */
+    Py_ssize_t active_workers;
+    PyThread_type_lock mutex;   /* protects next and active_workers */
+    PyThread_type_lock done;    /* held until the last worker finishes */
+};
+
+static void
+diff_many_run_task(struct diff_many_task *task)
+{
+    PatienceSequenceMatcher *self = task->matcher;
+
+    task->matches.count = 0;
+    task->matches.matches = (struct matching_block *)
+        guarded_malloc(sizeof(struct matching_block) * (self->bsize + 1));
+    if (task->matches.matches == NULL) {
+        task->ok = 0;
+        return;
+    }
+    task->ok = compute_matches(&task->matches, self);
+}
+
+static void
+diff_many_worker(void *arg)
+{
+    struct diff_many_queue *queue = (struct diff_many_queue *)arg;
+    Py_ssize_t i;
+    int last;
+
+    for (;;) {
+        PyThread_acquire_lock(queue->mutex, 1);
+        i = queue->next++;
+        PyThread_release_lock(queue->mutex);
+        if (i >= queue->count)
+            break;
+        diff_many_run_task(queue->tasks + i);
+    }
+
+    /* The queue must not be touched after signalling done: the main
+     * thread may free the locks as soon as it is woken */
+    PyThread_acquire_lock(queue->mutex, 1);
+    last = (--queue->active_workers == 0);
+    PyThread_release_lock(queue->mutex);
+    if (last)
+        PyThread_release_lock(queue->done);
+}
+
+static char py_diff_many_doc[] =
+    "diff_many(pairs[, n_threads]) -> list of opcode lists\n"
+    "\n"
+    "Diff many (a, b) sequence pairs at once, returning for each pair the\n"
+    "same list of 5-tuples that\n"
+    "PatienceSequenceMatcher_c(None, a, b).get_opcodes() would return. The\n"
+    "pairs are independent, so after the lines have been loaded the GIL is\n"
+    "released and the matching runs on up to n_threads native threads\n"
+    "(default: 8, never more than there are pairs).\n";
+
+static PyObject *
+py_diff_many(PyObject *self, PyObject *args)
+{
+    PyObject *pairs, *seq = NULL, *pair, *a, *b, *result = NULL, *opcodes;
+    Py_ssize_t npairs = 0, i, nthreads = 0;
+    struct diff_many_queue queue;
+
+#if PY_VERSION_HEX < 0x02050000
+    if (!PyArg_ParseTuple(args, "O|i", &pairs, &nthreads))
+#else
+    if (!PyArg_ParseTuple(args, "O|n", &pairs, &nthreads))
+#endif
+        return NULL;
+
+    queue.tasks = NULL;
+    queue.mutex = NULL;
+    queue.done = NULL;
+
+    seq = PySequence_Fast(pairs, "diff_many requires a sequence of (a, b) pairs");
+    if (seq == NULL)
+        return NULL;
+    npairs = PySequence_Fast_GET_SIZE(seq);
+
+    if (npairs > 0) {
+        queue.tasks = (struct diff_many_task *)calloc(npairs, sizeof(struct diff_many_task));
+        if (queue.tasks == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+    }
+
+    /* load and equate the lines of every pair; this calls back into python
+       (hashing and comparing the line objects) and needs the GIL */
+    for (i = 0; i < npairs; i++) {
+        pair = PySequence_Fast_GET_ITEM(seq, i);
+        a = PySequence_GetItem(pair, 0);
+        b = a == NULL ? NULL : PySequence_GetItem(pair, 1);
+        if (a == NULL || b == NULL) {
+            Py_XDECREF(a);
+            goto error;
+        }
+        queue.tasks[i].matcher = (PatienceSequenceMatcher *)PyObject_CallFunctionObjArgs(
+            (PyObject *)&PatienceSequenceMatcherType, Py_None, a, b, NULL);
+        Py_DECREF(a);
+        Py_DECREF(b);
+        if (queue.tasks[i].matcher == NULL)
+            goto error;
+    }
+
+    if (npairs > 0) {
+        if (nthreads <= 0)
+            nthreads = 8;
+        if (nthreads > npairs)
+            nthreads = npairs;
+
+        queue.count = npairs;
+        queue.next = 0;
+        queue.mutex = PyThread_allocate_lock();
+        queue.done = PyThread_allocate_lock();
+        if (queue.mutex == NULL || queue.done == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        PyThread_acquire_lock(queue.done, 1);
+        queue.active_workers = 1;  /* the calling thread joins the pool */
+        for (i = 1; i < nthreads; i++) {
+            PyThread_acquire_lock(queue.mutex, 1);
+            queue.active_workers++;
+            PyThread_release_lock(queue.mutex);
+            if (PyThread_start_new_thread(diff_many_worker, &queue) == -1) {
+                /* could not start the thread, run with one worker less */
+                PyThread_acquire_lock(queue.mutex, 1);
+                queue.active_workers--;
+                PyThread_release_lock(queue.mutex);
+            }
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        diff_many_worker(&queue);
+        /* wait for the other workers; the last one to finish releases this */
+        PyThread_acquire_lock(queue.done, 1);
+        Py_END_ALLOW_THREADS
+        PyThread_release_lock(queue.done);
+    }
+
+    result = PyList_New(npairs);
+    if (result == NULL)
+        goto error;
+    for (i = 0; i < npairs; i++) {
+        if (!queue.tasks[i].ok) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        opcodes = opcodes_from_matches(&queue.tasks[i].matches,
+                                       queue.tasks[i].matcher->asize,
+                                       queue.tasks[i].matcher->bsize);
+        if (opcodes == NULL)
+            goto error;
+        PyList_SET_ITEM(result, i, opcodes);
+    }
+    goto cleanup;
+
+error:
+    Py_XDECREF(result);
+    result = NULL;
+
+cleanup:
+    if (queue.tasks != NULL) {
+        for (i = 0; i < npairs; i++) {
+            free(queue.tasks[i].matches.matches);
+            Py_XDECREF(queue.tasks[i].matcher);
+        }
+        free(queue.tasks);
+    }
+    if (queue.mutex != NULL)
+        PyThread_free_lock(queue.mutex);
+    if (queue.done != NULL)
+        PyThread_free_lock(queue.done);
+    Py_XDECREF(seq);
+    return result;
+}
+
+
+/* Intra-line refinement of replaced line pairs.
+
+   The diff view refines every block of replaced lines into word level
+   highlights by diffing the word tokens of the left block against those of
+   the right block. Doing that one pair at a time from python dominates
+   rendering time for large diffs, so refine_opcodes() takes the token
+   sequences for all pairs at once; after the tokens have been loaded the
+   GIL is released and both the matching and the conversion of the opcodes
+   into per-line highlight spans run in pure C on a pool of native threads,
+   following the same scheme as diff_many() above. */
+
+struct refine_span {
+    Py_ssize_t line;    /* line number within the block of lines */
+    Py_ssize_t start;   /* character offset of the span within the line */
+    Py_ssize_t length;
+    int tag;
+};
+
+struct refine_side {
+    Py_ssize_t *lengths;  /* length of each token, SENTINEL for a newline */
+    struct refine_span *spans;
+    Py_ssize_t nspans;
+};
+
+struct refine_task {
+    PatienceSequenceMatcher *matcher;
+    struct matching_blocks matches;
+    struct refine_side a;
+    struct refine_side b;
+    int ok;
+};
+
+struct refine_queue {
+    struct refine_task *tasks;
+    Py_ssize_t count;
+    Py_ssize_t next;            /* index of the next unclaimed task */
+    Py_ssize_t active_workers;
+    PyThread_type_lock mutex;   /* protects next and active_workers */
+    PyThread_type_lock done;    /* held until the last worker finishes */
+};
+
+/* Record the length of every token of one side, marking newline tokens
+   with SENTINEL. Needs the GIL. Returns 0 with an exception set on error. */
+static int
+refine_load_lengths(struct line *lines, Py_ssize_t size, Py_ssize_t **out)
+{
+    Py_ssize_t i, len, *lengths;
+    PyObject *tok;
+
+    lengths = *out = (Py_ssize_t *)guarded_malloc(sizeof(Py_ssize_t) * (size + 1));
+    if (lengths == NULL) {
+        PyErr_NoMemory();
+        return 0;
+    }
+    for (i = 0; i < size; i++) {
+        tok = lines[i].data;
+        len = PyObject_Length(tok);
+        if (len == -1)
+            return 0;
+        if (len == 1 && PyUnicode_Check(tok) &&
+#if PY_MAJOR_VERSION >= 3
+            PyUnicode_READ_CHAR(tok, 0) == '\n'
+#else
+            PyUnicode_AS_UNICODE(tok)[0] == '\n'
+#endif
+           )
+            len = SENTINEL;
+        lengths[i] = len;
+    }
+    return 1;
+}
+
+/* Walk the tokens lo:hi of one side, advancing the current line and the
+   position within it, and when tag is not -1 record a highlight span for
+   every non-newline token, extending the previous span when they touch. */
+static void
+refine_emit(struct refine_side *side, Py_ssize_t lo, Py_ssize_t hi, int tag,
+            Py_ssize_t *line, Py_ssize_t *pos)
+{
+    Py_ssize_t t, len;
+    struct refine_span *last;
+
+    for (t = lo; t < hi; t++) {
+        len = side->lengths[t];
+        if (len == SENTINEL) {  /* newline token */
+            (*line)++;
+            *pos = 0;
+            continue;
+        }
+        if (tag != -1) {
+            last = side->nspans ? side->spans + side->nspans - 1 : NULL;
+            if (last != NULL && last->tag == tag && last->line == *line &&
+                last->start + last->length == *pos)
+                last->length += len;
+            else {
+                side->spans[side->nspans].line = *line;
+                side->spans[side->nspans].start = *pos;
+                side->spans[side->nspans].length = len;
+                side->spans[side->nspans].tag = tag;
+                side->nspans++;
+            }
+        }
+        *pos += len;
+    }
+}
+
+static void
+refine_run_task(struct refine_task *task)
+{
+    PatienceSequenceMatcher *self = task->matcher;
+    struct matching_blocks *m = &task->matches;
+    Py_ssize_t k, i, j, ai, bj, len;
+    Py_ssize_t aline = 0, apos = 0, bline = 0, bpos = 0;
+    int tag;
+
+    m->count = 0;
+    m->matches = (struct matching_block *)
+        guarded_malloc(sizeof(struct matching_block) * (self->bsize + 1));
+    /* every non-newline token can produce at most one span */
+    task->a.spans = (struct refine_span *)
+        guarded_malloc(sizeof(struct refine_span) * (self->asize + 1));
+    task->b.spans = (struct refine_span *)
+        guarded_malloc(sizeof(struct refine_span) * (self->bsize + 1));
+    if (m->matches == NULL || task->a.spans == NULL || task->b.spans == NULL) {
+        task->ok = 0;
+        return;
+    }
+
+    task->ok = compute_matches(m, self);
+    if (!task->ok)
+        return;
+
+    /* sentinel, so the trailing non-equal range is emitted */
+    m->matches[m->count].a = self->asize;
+    m->matches[m->count].b = self->bsize;
+    m->matches[m->count].len = 0;
+    m->count++;
+
+    i = j = 0;
+    for (k = 0; k < m->count; k++) {
+        ai = m->matches[k].a;
+        bj = m->matches[k].b;
+
+        tag = -1;
+        if (i < ai && j < bj)
+            tag = OP_REPLACE;
+        else if (i < ai)
+            tag = OP_DELETE;
+        else if (j < bj)
+            tag = OP_INSERT;
+
+        refine_emit(&task->a, i, ai, tag, &aline, &apos);
+        refine_emit(&task->b, j, bj, tag, &bline, &bpos);
+
+        len = m->matches[k].len;
+        refine_emit(&task->a, ai, ai + len, -1, &aline, &apos);
+        refine_emit(&task->b, bj, bj + len, -1, &bline, &bpos);
+        i = ai + len;
+        j = bj + len;
+    }
+}
+
+static void
+refine_worker(void *arg)
+{
+    struct refine_queue *queue = (struct refine_queue *)arg;
+    Py_ssize_t i;
+    int last;
+
+    for (;;) {
+        PyThread_acquire_lock(queue->mutex, 1);
+        i = queue->next++;
+        PyThread_release_lock(queue->mutex);
+        if (i >= queue->count)
+            break;
+        refine_run_task(queue->tasks + i);
+    }
+
+    /* The queue must not be touched after signalling done: the main
+     * thread may free the locks as soon as it is woken */
+    PyThread_acquire_lock(queue->mutex, 1);
+    last = (--queue->active_workers == 0);
+    PyThread_release_lock(queue->mutex);
+    if (last)
+        PyThread_release_lock(queue->done);
+}
+
+static PyObject *
+refine_spans_to_list(struct refine_side *side)
+{
+    PyObject *ans, *item;
+    Py_ssize_t i;
+
+    ans = PyList_New(side->nspans);
+    if (ans == NULL)
+        return NULL;
+    for (i = 0; i < side->nspans; i++) {
+#if PY_VERSION_HEX < 0x02050000
+        item = Py_BuildValue("iiis", side->spans[i].line, side->spans[i].start,
+                             side->spans[i].length, opcode_names[side->spans[i].tag]);
+#else
+        item = Py_BuildValue("nnns", side->spans[i].line, side->spans[i].start,
+                             side->spans[i].length, opcode_names[side->spans[i].tag]);
+#endif
+        if (item == NULL) {
+            Py_DECREF(ans);
+            return NULL;
+        }
+        PyList_SET_ITEM(ans, i, item);
+    }
+    return ans;
+}
+
+static char py_refine_opcodes_doc[] =
+    "refine_opcodes(pairs[, n_threads]) -> list of (left_spans, right_spans)\n"
+    "\n"
+    "Word level refinement of replaced line pairs. Each pair is a tuple of\n"
+    "two sequences of word tokens (with '\\n' tokens separating the lines),\n"
+    "as produced by splitting the left and the right block of a replace\n"
+    "opcode into words. For each pair the tokens are diffed with the\n"
+    "patience algorithm and the result returned as two lists of highlight\n"
+    "spans, (line, start, length, tag) with tag one of 'replace', 'insert'\n"
+    "or 'delete'; line counts the newline tokens before the span and start\n"
+    "and length are in characters within that line. The pairs are\n"
+    "independent, so after the tokens have been loaded the GIL is released\n"
+    "and the matching runs on up to n_threads native threads (default: 8,\n"
+    "never more than there are pairs).\n";
+
+static PyObject *
+py_refine_opcodes(PyObject *self, PyObject *args)
+{
+    PyObject *pairs, *seq = NULL, *pair, *a, *b, *result = NULL, *left, *right, *item;
+    Py_ssize_t npairs = 0, i, nthreads = 0;
+    struct refine_queue queue;
+
+#if PY_VERSION_HEX < 0x02050000
+    if (!PyArg_ParseTuple(args, "O|i", &pairs, &nthreads))
+#else
+    if (!PyArg_ParseTuple(args, "O|n", &pairs, &nthreads))
+#endif
+        return NULL;
+
+    queue.tasks = NULL;
+    queue.mutex = NULL;
+    queue.done = NULL;
+
+    seq = PySequence_Fast(pairs, "refine_opcodes requires a sequence of (a, b) pairs");
+    if (seq == NULL)
+        return NULL;
+    npairs = PySequence_Fast_GET_SIZE(seq);
+
+    if (npairs > 0) {
+        queue.tasks = (struct refine_task *)calloc(npairs, sizeof(struct refine_task));
+        if (queue.tasks == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+    }
+
+    /* load, equate and measure the tokens of every pair; this calls back
+       into python and needs the GIL */
+    for (i = 0; i < npairs; i++) {
+        pair = PySequence_Fast_GET_ITEM(seq, i);
+        a = PySequence_GetItem(pair, 0);
+        b = a == NULL ? NULL : PySequence_GetItem(pair, 1);
+        if (a == NULL || b == NULL) {
+            Py_XDECREF(a);
+            goto error;
+        }
+        queue.tasks[i].matcher = (PatienceSequenceMatcher *)PyObject_CallFunctionObjArgs(
+            (PyObject *)&PatienceSequenceMatcherType, Py_None, a, b, NULL);
+        Py_DECREF(a);
+        Py_DECREF(b);
+        if (queue.tasks[i].matcher == NULL)
+            goto error;
+        if (!refine_load_lengths(queue.tasks[i].matcher->a,
+                                 queue.tasks[i].matcher->asize,
+                                 &queue.tasks[i].a.lengths))
+            goto error;
+        if (!refine_load_lengths(queue.tasks[i].matcher->b,
+                                 queue.tasks[i].matcher->bsize,
+                                 &queue.tasks[i].b.lengths))
+            goto error;
+    }
+
+    if (npairs > 0) {
+        if (nthreads <= 0)
+            nthreads = 8;
+        if (nthreads > npairs)
+            nthreads = npairs;
+
+        queue.count = npairs;
+        queue.next = 0;
+        queue.mutex = PyThread_allocate_lock();
+        queue.done = PyThread_allocate_lock();
+        if (queue.mutex == NULL || queue.done == NULL) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        PyThread_acquire_lock(queue.done, 1);
+        queue.active_workers = 1;  /* the calling thread joins the pool */
+        for (i = 1; i < nthreads; i++) {
+            PyThread_acquire_lock(queue.mutex, 1);
+            queue.active_workers++;
+            PyThread_release_lock(queue.mutex);
+            if (PyThread_start_new_thread(refine_worker, &queue) == -1) {
+                /* could not start the thread, run with one worker less */
+                PyThread_acquire_lock(queue.mutex, 1);
+                queue.active_workers--;
+                PyThread_release_lock(queue.mutex);
+            }
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        refine_worker(&queue);
+        /* wait for the other workers; the last one to finish releases this */
+        PyThread_acquire_lock(queue.done, 1);
+        Py_END_ALLOW_THREADS
+        PyThread_release_lock(queue.done);
+    }
+
+    result = PyList_New(npairs);
+    if (result == NULL)
+        goto error;
+    for (i = 0; i < npairs; i++) {
+        if (!queue.tasks[i].ok) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        left = refine_spans_to_list(&queue.tasks[i].a);
+        if (left == NULL)
+            goto error;
+        right = refine_spans_to_list(&queue.tasks[i].b);
+        if (right == NULL) {
+            Py_DECREF(left);
+            goto error;
+        }
+        item = PyTuple_New(2);
+        if (item == NULL) {
+            Py_DECREF(left);
+            Py_DECREF(right);
+            goto error;
+        }
+        PyTuple_SET_ITEM(item, 0, left);
+        PyTuple_SET_ITEM(item, 1, right);
+        PyList_SET_ITEM(result, i, item);
+    }
+    goto cleanup;
+
+error:
+    Py_XDECREF(result);
+    result = NULL;
+
+cleanup:
+    if (queue.tasks != NULL) {
+        for (i = 0; i < npairs; i++) {
+            free(queue.tasks[i].matches.matches);
+            free(queue.tasks[i].a.lengths);
+            free(queue.tasks[i].b.lengths);
+            free(queue.tasks[i].a.spans);
+            free(queue.tasks[i].b.spans);
+            Py_XDECREF(queue.tasks[i].matcher);
+        }
+        free(queue.tasks);
+    }
+    if (queue.mutex != NULL)
+        PyThread_free_lock(queue.mutex);
+    if (queue.done != NULL)
+        PyThread_free_lock(queue.done);
+    Py_XDECREF(seq);
+    return result;
+}
+
+
 static PyObject *
 PatienceSequenceMatcher_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
@@ -839,9 +1635,7 @@ PatienceSequenceMatcher_get_matching_blocks(PatienceSequenceMatcher* self)
     } else
         matches.matches = NULL;
 
-    res = recurse_matches(&matches, &self->hashtable, self->backpointers,
-                          self->a, self->b, 0, 0,
-                          self->asize, self->bsize, 10);
+    res = compute_matches(&matches, self);
     if (!res) {
         free(matches.matches);
         return PyErr_NoMemory();
@@ -914,42 +1708,29 @@ static char PatienceSequenceMatcher_get_opcodes_doc[] =
     "  equal a[4:6] (cd) b[3:5] (cd)\n"
     " insert a[6:6] () b[5:6] (f)\n";
 
+/* Convert matching blocks into a list of opcode 5-tuples. The matches array
+   must have room for one extra block, which is used for the sentinel. */
 static PyObject *
-PatienceSequenceMatcher_get_opcodes(PatienceSequenceMatcher* self)
+opcodes_from_matches(struct matching_blocks *matches,
+                     Py_ssize_t asize, Py_ssize_t bsize)
 {
     PyObject *answer, *item;
     Py_ssize_t i, j, k, ai, bj;
-    int tag, res;
-    struct matching_blocks matches;
-
-    matches.count = 0;
-    matches.matches = (struct matching_block *)guarded_malloc(sizeof(struct matching_block) * (self->bsize + 1));
-    if (matches.matches == NULL)
-        return PyErr_NoMemory();
-
-    res = recurse_matches(&matches, &self->hashtable, self->backpointers,
-                          self->a, self->b, 0, 0,
-                          self->asize, self->bsize, 10);
-    if (!res) {
-        free(matches.matches);
-        return PyErr_NoMemory();
-    }
+    int tag;
 
-    matches.matches[matches.count].a = self->asize;
-    matches.matches[matches.count].b = self->bsize;
-    matches.matches[matches.count].len = 0;
-    matches.count++;
+    matches->matches[matches->count].a = asize;
+    matches->matches[matches->count].b = bsize;
+    matches->matches[matches->count].len = 0;
+    matches->count++;
 
     answer = PyList_New(0);
-    if (answer == NULL) {
-        free(matches.matches);
+    if (answer == NULL)
         return NULL;
-    }
 
     i = j = 0;
-    for (k = 0; k < matches.count; k++) {
-        ai = matches.matches[k].a;
-        bj = matches.matches[k].b;
+    for (k = 0; k < matches->count; k++) {
+        ai = matches->matches[k].a;
+        bj = matches->matches[k].b;
 
         tag = -1;
         if (i < ai && j < bj)
@@ -971,10 +1752,10 @@ PatienceSequenceMatcher_get_opcodes(PatienceSequenceMatcher* self)
                 goto error;
         }
 
-        i = ai + matches.matches[k].len;
-        j = bj + matches.matches[k].len;
+        i = ai + matches->matches[k].len;
+        j = bj + matches->matches[k].len;
 
-        if (matches.matches[k].len > 0) {
+        if (matches->matches[k].len > 0) {
 #if PY_VERSION_HEX < 0x02050000
             item = Py_BuildValue("siiii", opcode_names[OP_EQUAL], ai, i, bj, j);
 #else
@@ -987,16 +1768,192 @@ PatienceSequenceMatcher_get_opcodes(PatienceSequenceMatcher* self)
         }
     }
 
-    free(matches.matches);
     return answer;
 
 error:
-    free(matches.matches);
     Py_DECREF(answer);
     return NULL;
 }
 
 
+static PyObject *
+PatienceSequenceMatcher_get_opcodes(PatienceSequenceMatcher* self)
+{
+    PyObject *answer;
+    int res;
+    struct matching_blocks matches;
+
+    matches.count = 0;
+    matches.matches = (struct matching_block *)guarded_malloc(sizeof(struct matching_block) * (self->bsize + 1));
+    if (matches.matches == NULL)
+        return PyErr_NoMemory();
+
+    res = compute_matches(&matches, self);
+    if (!res) {
+        free(matches.matches);
+        return PyErr_NoMemory();
+    }
+
+    answer = opcodes_from_matches(&matches, self->asize, self->bsize);
+    free(matches.matches);
+    return answer;
+}
+
+
+/* Iterator produced by iter_opcodes(). The matching runs on the first call
+   to next() with the GIL released; after that the opcode tuples are built
+   one at a time, so no list with one entry per opcode is ever
+   materialized. */
+typedef struct {
+    PyObject_HEAD
+    PatienceSequenceMatcher *matcher;  /* NULL once iteration has finished */
+    struct matching_blocks matches;
+    Py_ssize_t k;       /* index of the next matching block */
+    Py_ssize_t i, j;    /* how far into a and b the emitted opcodes reach */
+    int started;
+    int in_equal;       /* the non-equal part of block k was already emitted */
+} OpcodeIterator;
+
+static void
+OpcodeIterator_dealloc(OpcodeIterator *self)
+{
+    free(self->matches.matches);
+    Py_XDECREF(self->matcher);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+OpcodeIterator_next(OpcodeIterator *self)
+{
+    PyObject *item;
+    Py_ssize_t ai, bj, len;
+    int tag, res;
+    PatienceSequenceMatcher *m = self->matcher;
+
+    if (m == NULL)
+        return NULL;  /* exhausted */
+
+    if (!self->started) {
+        self->matches.count = 0;
+        self->matches.matches = (struct matching_block *)
+            guarded_malloc(sizeof(struct matching_block) * (m->bsize + 1));
+        if (self->matches.matches == NULL)
+            return PyErr_NoMemory();
+        Py_BEGIN_ALLOW_THREADS
+        res = compute_matches(&self->matches, m);
+        Py_END_ALLOW_THREADS
+        if (!res)
+            return PyErr_NoMemory();
+        /* sentinel, so the trailing non-equal opcode is flushed */
+        self->matches.matches[self->matches.count].a = m->asize;
+        self->matches.matches[self->matches.count].b = m->bsize;
+        self->matches.matches[self->matches.count].len = 0;
+        self->matches.count++;
+        self->started = 1;
+    }
+
+    while (self->k < self->matches.count) {
+        ai = self->matches.matches[self->k].a;
+        bj = self->matches.matches[self->k].b;
+
+        if (!self->in_equal) {
+            self->in_equal = 1;
+            tag = -1;
+            if (self->i < ai && self->j < bj)
+                tag = OP_REPLACE;
+            else if (self->i < ai)
+                tag = OP_DELETE;
+            else if (self->j < bj)
+                tag = OP_INSERT;
+            if (tag != -1) {
+#if PY_VERSION_HEX < 0x02050000
+                item = Py_BuildValue("siiii", opcode_names[tag], self->i, ai, self->j, bj);
+#else
+                item = Py_BuildValue("snnnn", opcode_names[tag], self->i, ai, self->j, bj);
+#endif
+                return item;
+            }
+        }
+
+        len = self->matches.matches[self->k].len;
+        self->i = ai + len;
+        self->j = bj + len;
+        self->k++;
+        self->in_equal = 0;
+        if (len > 0) {
+#if PY_VERSION_HEX < 0x02050000
+            item = Py_BuildValue("siiii", opcode_names[OP_EQUAL], ai, self->i, bj, self->j);
+#else
+            item = Py_BuildValue("snnnn", opcode_names[OP_EQUAL], ai, self->i, bj, self->j);
+#endif
+            return item;
+        }
+    }
+
+    /* finished; release the matcher and the blocks eagerly */
+    free(self->matches.matches);
+    self->matches.matches = NULL;
+    Py_DECREF(self->matcher);
+    self->matcher = NULL;
+    return NULL;
+}
+
+static PyTypeObject OpcodeIteratorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    /* tp_name           */ "OpcodeIterator",
+    /* tp_basicsize      */ sizeof(OpcodeIterator),
+    /* tp_itemsize       */ 0,
+    /* tp_dealloc        */ (destructor)OpcodeIterator_dealloc,
+    /* tp_print          */ 0,
+    /* tp_getattr        */ 0,
+    /* tp_setattr        */ 0,
+    /* tp_compare        */ 0,
+    /* tp_repr           */ 0,
+    /* tp_as_number      */ 0,
+    /* tp_as_sequence    */ 0,
+    /* tp_as_mapping     */ 0,
+    /* tp_hash           */ 0,
+    /* tp_call           */ 0,
+    /* tp_str            */ 0,
+    /* tp_getattro       */ 0,
+    /* tp_setattro       */ 0,
+    /* tp_as_buffer      */ 0,
+    /* tp_flags          */ Py_TPFLAGS_DEFAULT,
+    /* tp_doc            */ "Iterator over diff opcodes",
+    /* tp_traverse       */ 0,
+    /* tp_clear          */ 0,
+    /* tp_richcompare    */ 0,
+    /* tp_weaklistoffset */ 0,
+    /* tp_iter           */ PyObject_SelfIter,
+    /* tp_iternext       */ (iternextfunc)OpcodeIterator_next,
+};
+
+
+static char PatienceSequenceMatcher_iter_opcodes_doc[] =
+    "iter_opcodes() -> iterator over opcode 5-tuples\n"
+    "\n"
+    "Like get_opcodes(), but the opcodes are produced one at a time instead\n"
+    "of all being materialized into one list, so a consumer can start\n"
+    "rendering a huge diff before it has processed all of it. The matching\n"
+    "itself runs on the first call to next(), with the GIL released.\n";
+
+static PyObject *
+PatienceSequenceMatcher_iter_opcodes(PatienceSequenceMatcher* self)
+{
+    OpcodeIterator *iter = PyObject_New(OpcodeIterator, &OpcodeIteratorType);
+    if (iter == NULL)
+        return NULL;
+    Py_INCREF(self);
+    iter->matcher = self;
+    iter->matches.matches = NULL;
+    iter->matches.count = 0;
+    iter->k = iter->i = iter->j = 0;
+    iter->started = 0;
+    iter->in_equal = 0;
+    return (PyObject *)iter;
+}
+
+
 static char PatienceSequenceMatcher_get_grouped_opcodes_doc[] =
     "Isolate change clusters by eliminating ranges with no changes.\n"
     "\n"
@@ -1040,9 +1997,7 @@ PatienceSequenceMatcher_get_grouped_opcodes(PatienceSequenceMatcher* self,
     if (matches.matches == NULL)
         return PyErr_NoMemory();
 
-    res = recurse_matches(&matches, &self->hashtable, self->backpointers,
-                          self->a, self->b, 0, 0,
-                          self->asize, self->bsize, 10);
+    res = compute_matches(&matches, self);
     if (!res) {
         free(matches.matches);
         return PyErr_NoMemory();
@@ -1196,6 +2151,10 @@ static PyMethodDef PatienceSequenceMatcher_methods[] = {
      (PyCFunction)PatienceSequenceMatcher_get_opcodes,
      METH_NOARGS,
      PatienceSequenceMatcher_get_opcodes_doc},
+    {"iter_opcodes",
+     (PyCFunction)PatienceSequenceMatcher_iter_opcodes,
+     METH_NOARGS,
+     PatienceSequenceMatcher_iter_opcodes_doc},
     {"get_grouped_opcodes",
      (PyCFunction)PatienceSequenceMatcher_get_grouped_opcodes,
      METH_VARARGS,
@@ -1252,6 +2211,8 @@ static PyTypeObject PatienceSequenceMatcherType = {
 static PyMethodDef _patiencediff_c_methods[] = {
     {"unique_lcs_c", py_unique_lcs, METH_VARARGS},
     {"recurse_matches_c", py_recurse_matches, METH_VARARGS},
+    {"diff_many", py_diff_many, METH_VARARGS, py_diff_many_doc},
+    {"refine_opcodes", py_refine_opcodes, METH_VARARGS, py_refine_opcodes_doc},
     {NULL, NULL, 0, NULL}
 };
 
@@ -1272,6 +2233,8 @@ static struct PyModuleDef _patiencediff_c_module = {
 CALIBRE_MODINIT_FUNC PyInit__patiencediff_c(void) {
     if (PyType_Ready(&PatienceSequenceMatcherType) < 0)
         INITERROR;
+    if (PyType_Ready(&OpcodeIteratorType) < 0)
+        INITERROR;
 
     PyObject *mod = PyModule_Create(&_patiencediff_c_module);
 #else
@@ -1279,6 +2242,8 @@ CALIBRE_MODINIT_FUNC PyInit__patiencediff_c(void) {
 CALIBRE_MODINIT_FUNC init_patiencediff_c(void) {
     if (PyType_Ready(&PatienceSequenceMatcherType) < 0)
         INITERROR;
+    if (PyType_Ready(&OpcodeIteratorType) < 0)
+        INITERROR;
 
     PyObject *mod = Py_InitModule3("_patiencediff_c", _patiencediff_c_methods,
         "C implementation of PatienceSequenceMatcher");
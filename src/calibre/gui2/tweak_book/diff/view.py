@@ -26,7 +26,7 @@ from calibre.gui2 import info_dialog
 from calibre.gui2.tweak_book import tprefs
 from calibre.gui2.tweak_book.editor.text import PlainTextEdit, default_font_family, LineNumbers
 from calibre.gui2.tweak_book.editor.themes import theme_color, get_theme
-from calibre.gui2.tweak_book.diff import get_sequence_matcher
+from calibre.gui2.tweak_book.diff import get_sequence_matcher, load_patience_module
 from calibre.gui2.tweak_book.diff.highlight import get_highlighter
 
 Change = namedtuple('Change', 'ltop lbot rtop rbot kind')
@@ -694,6 +694,7 @@ class DiffSplit(QSplitter):  # {{{
         self.right_insert = partial(self.do_insert, cr, right_highlight, self.right.line_number_map)
 
         self.changes = []
+        self.refine_requests = []
 
         if context is None:
             for tag, alo, ahi, blo, bhi in cruncher.get_opcodes():
@@ -719,6 +720,7 @@ class DiffSplit(QSplitter):  # {{{
                 insert_boundary()
 
         cl.endEditBlock(), cr.endEditBlock()
+        self.apply_word_highlights()
         del self.left_lines
         del self.right_lines
         del self.left_insert
@@ -870,32 +872,31 @@ class DiffSplit(QSplitter):  # {{{
 
         l, r = '\n'.join(self.left_lines[alo:ahi]), '\n'.join(self.right_lines[blo:bhi])
         ll, rl = self.split_words.findall(l), self.split_words.findall(r)
-        cruncher = get_sequence_matcher()(None, ll, rl)
-        lsb, rsb = self.left.document().findBlockByNumber(lsb), self.right.document().findBlockByNumber(rsb)
-
-        def do_tag(block, words, lo, hi, pos, fmts):
-            for word in words[lo:hi]:
-                if word == '\n':
-                    if fmts:
-                        block.layout().setAdditionalFormats(fmts)
-                    pos, block, fmts = 0, block.next(), []
-                    continue
-
-                if tag in {'replace', 'insert', 'delete'}:
+        # Word level highlighting of the replaced blocks is expensive, so
+        # just collect the blocks here; apply_word_highlights() refines all
+        # of them with a single call into the C module at the end
+        self.refine_requests.append((lsb, rsb, ll, rl))
+
+    def apply_word_highlights(self):
+        requests, self.refine_requests = self.refine_requests, []
+        if not requests:
+            return
+        all_spans = load_patience_module().refine_opcodes([(ll, rl) for lsb, rsb, ll, rl in requests])
+        for (lsb, rsb, ll, rl), (left_spans, right_spans) in zip(requests, all_spans):
+            for view, start_block, spans in ((self.left, lsb, left_spans), (self.right, rsb, right_spans)):
+                doc, block, fmts = view.document(), None, []
+                for line, start, length, tag in spans:
+                    b = doc.findBlockByNumber(start_block + line)
+                    if b != block:
+                        if fmts:
+                            block.layout().setAdditionalFormats(fmts)
+                        block, fmts = b, []
                     fmt = getattr(self.left, '%s_format' % ('replacereplace' if tag == 'replace' else tag))
                     f = QTextLayout.FormatRange()
-                    f.start, f.length, f.format = pos, len(word), fmt
+                    f.start, f.length, f.format = start, length, fmt
                     fmts.append(f)
-                pos += len(word)
-            return block, pos, fmts
-
-        lfmts, rfmts, lpos, rpos = [], [], 0, 0
-        for tag, llo, lhi, rlo, rhi in cruncher.get_opcodes():
-            lsb, lpos, lfmts = do_tag(lsb, ll, llo, lhi, lpos, lfmts)
-            rsb, rpos, rfmts = do_tag(rsb, rl, rlo, rhi, rpos, rfmts)
-        for block, fmts in ((lsb, lfmts), (rsb, rfmts)):
-            if fmts:
-                block.layout().setAdditionalFormats(fmts)
+                if fmts:
+                    block.layout().setAdditionalFormats(fmts)
     # }}}
 
 # }}}
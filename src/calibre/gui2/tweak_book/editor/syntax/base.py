@@ -215,11 +215,19 @@ class SyntaxHighlighter(object):
             start_state = self.user_data_factory().state
         ud.clear(state=start_state, doc_name=self.doc_name)  # Ensure no stale user data lingers
         formats = []
+        # Adjacent ranges with the same format object are merged, as Qt's
+        # cost of applying them scales with the number of ranges and dense
+        # markup otherwise produces hundreds of tiny ones per line
+        last_r = last_fmt = None
         for i, num, fmt in run_loop(ud, self.state_map, self.formats, unicode_type(block.text())):
             if fmt is not None:
-                r = QTextLayout.FormatRange()
-                r.start, r.length, r.format = i, num, fmt
-                formats.append(r)
+                if fmt is last_fmt and last_r.start + last_r.length == i:
+                    last_r.length += num
+                else:
+                    r = QTextLayout.FormatRange()
+                    r.start, r.length, r.format = i, num, fmt
+                    formats.append(r)
+                    last_r, last_fmt = r, fmt
         force_next_highlight = is_new_ud or ud.state != orig_state
         return formats, force_next_highlight
 
@@ -11,7 +11,24 @@
 #include <structmember.h>
 
 #define COMPARE(attr, op) (PyObject_RichCompareBool(a->attr, b->attr, op) == 1)
-static PyObject *bold_tags = NULL, *italic_tags = NULL, *zero = NULL, *spell_property = NULL, *recognized = NULL, *split = NULL;
+static PyObject *bold_tags = NULL, *italic_tags = NULL, *zero = NULL, *spell_property = NULL, *recognized = NULL, *split = NULL, *recognized_many = NULL;
+
+// Real documents use only a few dozen distinct tag names, but the highlighter
+// creates a Tag object per open tag, so without interning a large book holds
+// hundreds of thousands of duplicate name strings. The pool maps each name to
+// its first instance; the cap only matters for pathological documents.
+static PyObject *tag_name_pool = NULL;
+#define TAG_NAME_POOL_MAX_SIZE 1000
+
+static PyObject*
+intern_tag_name(PyObject *name) {  // borrowed ref in, borrowed ref out
+    PyObject *interned = PyDict_GetItem(tag_name_pool, name);
+    if (interned != NULL) return interned;
+    if (PyUnicode_Check(name) && PyDict_Size(tag_name_pool) < TAG_NAME_POOL_MAX_SIZE) {
+        if (PyDict_SetItem(tag_name_pool, name, name) != 0) PyErr_Clear();
+    }
+    return name;
+}
 
 // Tag type definition {{{
 
@@ -56,6 +73,7 @@ html_Tag_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
         self->italic = (PySet_Contains(italic_tags, self->name)) ? Py_True : Py_False;
     }
     if (self->lang == NULL) self->lang = Py_None;
+    self->name = intern_tag_name(self->name);
     Py_INCREF(self->name); Py_INCREF(self->bold); Py_INCREF(self->italic); Py_INCREF(self->lang);
 
     return (PyObject *)self;
@@ -157,6 +175,293 @@ static PyTypeObject html_TagType = { // {{{
 }; // }}}
 // }}}
 
+// TagStack type definition {{{
+
+// A persistent stack of Tag objects. Nodes are immutable and refcounted, so
+// stacks produced by copy() and by slicing share their nodes with the
+// original: State.copy(), which runs for every line when the editor
+// rehighlights, no longer copies the whole stack, and only a genuine push or
+// pop allocates.
+
+typedef struct html_TagStackNode {
+    PyObject *tag;
+    struct html_TagStackNode *next;
+    Py_ssize_t refcount;
+} html_TagStackNode;
+
+static void
+html_TagStackNode_decref(html_TagStackNode *node) {
+    // Iterative, so that freeing a deeply nested stack does not recurse
+    while (node != NULL && --node->refcount == 0) {
+        html_TagStackNode *next = node->next;
+        Py_DECREF(node->tag);
+        PyMem_Free(node);
+        node = next;
+    }
+}
+
+static PyTypeObject html_TagStackType;
+
+typedef struct {
+    PyObject_HEAD
+    // Type-specific fields go here.
+    html_TagStackNode *head;  // most recently opened tag, NULL when empty
+    Py_ssize_t depth;
+
+} html_TagStack;
+
+static void
+html_TagStack_dealloc(html_TagStack* self)
+{
+    html_TagStackNode_decref(self->head); self->head = NULL;
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject *
+html_TagStack_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    html_TagStack *self = NULL;
+    self = (html_TagStack *)type->tp_alloc(type, 0);
+    if (self == NULL) return PyErr_NoMemory();
+    self->head = NULL; self->depth = 0;
+    return (PyObject *)self;
+}
+
+static PyObject *
+html_TagStack_append(html_TagStack *self, PyObject *tag) {
+    html_TagStackNode *node = (html_TagStackNode *)PyMem_Malloc(sizeof(html_TagStackNode));
+    if (node == NULL) return PyErr_NoMemory();
+    Py_INCREF(tag);
+    node->tag = tag;
+    node->next = self->head;  // the node takes over this stack's reference to the old head
+    node->refcount = 1;
+    self->head = node;
+    self->depth += 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+html_TagStack_copy(html_TagStack *self, PyObject *args, PyObject *kwargs) {
+    html_TagStack *ans = (html_TagStack *)html_TagStack_new(&html_TagStackType, NULL, NULL);
+    if (ans == NULL) return NULL;
+    if (self->head != NULL) self->head->refcount += 1;
+    ans->head = self->head;
+    ans->depth = self->depth;
+    return (PyObject *)ans;
+}
+
+static Py_ssize_t
+html_TagStack_length(html_TagStack *self) {
+    return self->depth;
+}
+
+static html_TagStackNode *
+html_TagStack_node_at(html_TagStack *self, Py_ssize_t i) {
+    // i counts from the bottom of the stack, list style; the caller has
+    // checked that it is in range
+    html_TagStackNode *node = self->head;
+    Py_ssize_t hops = self->depth - 1 - i;
+    while (hops-- > 0) node = node->next;
+    return node;
+}
+
+static PyObject *
+html_TagStack_item(html_TagStack *self, Py_ssize_t i) {
+    PyObject *tag = NULL;
+    if (i < 0 || i >= self->depth) {
+        PyErr_SetString(PyExc_IndexError, "TagStack index out of range"); return NULL;
+    }
+    tag = html_TagStack_node_at(self, i)->tag;
+    Py_INCREF(tag);
+    return tag;
+}
+
+static PyObject *
+html_TagStack_subscript(html_TagStack *self, PyObject *key) {
+    Py_ssize_t i = 0, start = 0, stop = 0, step = 0, slicelength = 0;
+    html_TagStack *ans = NULL;
+    PyObject *temp = NULL;
+
+    if (PySlice_Check(key)) {
+#if PY_MAJOR_VERSION >= 3
+        if (PySlice_GetIndicesEx(key, self->depth, &start, &stop, &step, &slicelength) != 0) return NULL;
+#else
+        if (PySlice_GetIndicesEx((PySliceObject *)key, self->depth, &start, &stop, &step, &slicelength) != 0) return NULL;
+#endif
+        if (step == 1 && start == 0) {
+            // The slice the highlighter actually uses, tags[:-n]: pop n nodes
+            // off the top, sharing the bottom of the stack with the original
+            html_TagStackNode *node = self->head;
+            Py_ssize_t hops = self->depth - stop;
+            ans = (html_TagStack *)html_TagStack_new(&html_TagStackType, NULL, NULL);
+            if (ans == NULL) return NULL;
+            while (hops-- > 0) node = node->next;
+            if (node != NULL) node->refcount += 1;
+            ans->head = node;
+            ans->depth = stop;
+            return (PyObject *)ans;
+        }
+        // Generic slices are not used by the highlighter, do it the slow way
+        ans = (html_TagStack *)html_TagStack_new(&html_TagStackType, NULL, NULL);
+        if (ans == NULL) return NULL;
+        for (i = 0; i < slicelength; i++) {
+            temp = html_TagStack_append(ans, html_TagStack_node_at(self, start + i*step)->tag);
+            if (temp == NULL) { Py_DECREF(ans); return NULL; }
+            Py_DECREF(temp);
+        }
+        return (PyObject *)ans;
+    }
+
+    i = PyNumber_AsSsize_t(key, PyExc_IndexError);
+    if (i == -1 && PyErr_Occurred() != NULL) return NULL;
+    if (i < 0) i += self->depth;
+    return html_TagStack_item(self, i);
+}
+
+static PyObject *
+html_TagStack_as_tuple(html_TagStack *self, int top_first) {
+    PyObject *ans = PyTuple_New(self->depth);
+    html_TagStackNode *node = self->head;
+    Py_ssize_t i = 0;
+    if (ans == NULL) return PyErr_NoMemory();
+    for (i = 0; i < self->depth; i++, node = node->next) {
+        Py_INCREF(node->tag);
+        PyTuple_SET_ITEM(ans, (top_first) ? i : self->depth - 1 - i, node->tag);
+    }
+    return ans;
+}
+
+static PyObject *
+html_TagStack_iter(html_TagStack *self) {
+    PyObject *ans = NULL, *temp = html_TagStack_as_tuple(self, 0);
+    if (temp == NULL) return NULL;
+    ans = PyObject_GetIter(temp);
+    Py_DECREF(temp);
+    return ans;
+}
+
+static PyObject *
+html_TagStack_reversed(html_TagStack *self, PyObject *args) {
+    // Walking from the head already visits tags top to bottom, so this is the
+    // natural iteration order for the stack
+    PyObject *ans = NULL, *temp = html_TagStack_as_tuple(self, 1);
+    if (temp == NULL) return NULL;
+    ans = PyObject_GetIter(temp);
+    Py_DECREF(temp);
+    return ans;
+}
+
+static PyObject *
+html_TagStack_compare(PyObject *a, PyObject *b, int op) {
+    html_TagStackNode *x = NULL, *y = NULL;
+    int eq = 1, c = 0;
+    if (op != Py_EQ && op != Py_NE) {
+        PyErr_SetString(PyExc_TypeError, "Only equals comparison is supported for TagStack objects");
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(a, &html_TagStackType) || !PyObject_TypeCheck(b, &html_TagStackType)) {
+        if (op == Py_EQ) Py_RETURN_FALSE;
+        Py_RETURN_TRUE;
+    }
+    if (((html_TagStack *)a)->depth != ((html_TagStack *)b)->depth) eq = 0;
+    else {
+        x = ((html_TagStack *)a)->head; y = ((html_TagStack *)b)->head;
+        // Once the two stacks share a node the rest is identical by construction
+        while (x != y) {
+            c = PyObject_RichCompareBool(x->tag, y->tag, Py_EQ);
+            if (c == -1) return NULL;
+            if (c == 0) { eq = 0; break; }
+            x = x->next; y = y->next;
+        }
+    }
+    if ((op == Py_EQ) ? eq : !eq) Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static PyObject *
+html_TagStack_repr(html_TagStack *self) {
+    PyObject *ans = NULL, *temp = html_TagStack_as_tuple(self, 0);
+    if (temp == NULL) return NULL;
+    ans = PyUnicode_FromFormat("TagStack%R", temp);
+    Py_DECREF(temp);
+    return ans;
+}
+
+static PySequenceMethods html_TagStack_as_sequence = {
+    /* sq_length         */ (lenfunc)html_TagStack_length,
+    /* sq_concat         */ 0,
+    /* sq_repeat         */ 0,
+    /* sq_item           */ (ssizeargfunc)html_TagStack_item,
+    /* sq_slice          */ 0,
+    /* sq_ass_item       */ 0,
+    /* sq_ass_slice      */ 0,
+    /* sq_contains       */ 0,
+    /* sq_inplace_concat */ 0,
+    /* sq_inplace_repeat */ 0,
+};
+
+static PyMappingMethods html_TagStack_as_mapping = {
+    /* mp_length        */ (lenfunc)html_TagStack_length,
+    /* mp_subscript     */ (binaryfunc)html_TagStack_subscript,
+    /* mp_ass_subscript */ 0,
+};
+
+static PyMethodDef html_TagStack_methods[] = {
+    {"append", (PyCFunction)html_TagStack_append, METH_O,
+     "append(tag) -> Push tag onto the top of this stack"
+    },
+    {"copy", (PyCFunction)html_TagStack_copy, METH_VARARGS,
+     "copy() -> Return a copy of this stack, sharing its nodes"
+    },
+    {"__reversed__", (PyCFunction)html_TagStack_reversed, METH_NOARGS,
+     "__reversed__() -> Iterate over the tags from the top of the stack down"
+    },
+
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject html_TagStackType = { // {{{
+    PyVarObject_HEAD_INIT(NULL, 0)
+    /* tp_name           */ "html.TagStack",
+    /* tp_basicsize      */ sizeof(html_TagStack),
+    /* tp_itemsize       */ 0,
+    /* tp_dealloc        */ (destructor)html_TagStack_dealloc,
+    /* tp_print          */ 0,
+    /* tp_getattr        */ 0,
+    /* tp_setattr        */ 0,
+    /* tp_compare        */ 0,
+    /* tp_repr           */ (reprfunc)html_TagStack_repr,
+    /* tp_as_number      */ 0,
+    /* tp_as_sequence    */ &html_TagStack_as_sequence,
+    /* tp_as_mapping     */ &html_TagStack_as_mapping,
+    /* tp_hash           */ 0,
+    /* tp_call           */ 0,
+    /* tp_str            */ 0,
+    /* tp_getattro       */ 0,
+    /* tp_setattro       */ 0,
+    /* tp_as_buffer      */ 0,
+    /* tp_flags          */ Py_TPFLAGS_DEFAULT|Py_TPFLAGS_BASETYPE,
+    /* tp_doc            */ "Immutable stack of Tag objects with O(1) copy",
+    /* tp_traverse       */ 0,
+    /* tp_clear          */ 0,
+    /* tp_richcompare    */ (richcmpfunc)html_TagStack_compare,
+    /* tp_weaklistoffset */ 0,
+    /* tp_iter           */ (getiterfunc)html_TagStack_iter,
+    /* tp_iternext       */ 0,
+    /* tp_methods        */ html_TagStack_methods,
+    /* tp_members        */ 0,
+    /* tp_getset         */ 0,
+    /* tp_base           */ 0,
+    /* tp_dict           */ 0,
+    /* tp_descr_get      */ 0,
+    /* tp_descr_set      */ 0,
+    /* tp_dictoffset     */ 0,
+    /* tp_init           */ 0,
+    /* tp_alloc          */ 0,
+    /* tp_new            */ html_TagStack_new,
+}; // }}}
+// }}}
+
 // State type definition {{{
 
 static PyTypeObject html_StateType;
@@ -229,7 +534,7 @@ html_State_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     }
 
     if (self->tag_being_defined == NULL) self->tag_being_defined = Py_None;
-    if (self->tags == NULL) { self->tags = PyList_New(0); if (self->tags == NULL) return PyErr_NoMemory(); }
+    if (self->tags == NULL) { self->tags = html_TagStack_new(&html_TagStackType, NULL, NULL); if (self->tags == NULL) return PyErr_NoMemory(); }
     if (self->is_bold == NULL) self->is_bold = Py_False;
     if (self->is_italic == NULL) self->is_italic = Py_False;
     if (self->current_lang == NULL) self->current_lang = Py_None;
@@ -256,7 +561,6 @@ html_State_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static PyObject *
 html_State_copy(html_State *self, PyObject *args, PyObject *kwargs) {
     PyObject *ans = NULL, *tags = NULL, *tag_being_defined = NULL, *sub_parser_state = NULL;
-    Py_ssize_t i = 0;
 
     if (self->sub_parser_state == Py_None) {sub_parser_state = Py_None; Py_INCREF(sub_parser_state); }
     else sub_parser_state = PyObject_CallMethod(self->sub_parser_state, "copy", NULL);
@@ -266,12 +570,12 @@ html_State_copy(html_State *self, PyObject *args, PyObject *kwargs) {
     else tag_being_defined = html_Tag_copy((html_Tag*)self->tag_being_defined, NULL, NULL);
     if (tag_being_defined == NULL) goto end;
 
-    tags = PyList_New(PyList_GET_SIZE(self->tags));
-    if (tags == NULL) { PyErr_NoMemory(); goto end; }
-    for (i = 0; i < PyList_GET_SIZE(self->tags); i++) {
-        PyList_SET_ITEM(tags, i, PyList_GET_ITEM(self->tags, i));
-        Py_INCREF(PyList_GET_ITEM(self->tags, i));
-    }
+    // Stack nodes are immutable and shared, so this is O(1) no matter how
+    // deeply the tags are nested
+    if (PyObject_TypeCheck(self->tags, &html_TagStackType))
+        tags = html_TagStack_copy((html_TagStack *)self->tags, NULL, NULL);
+    else tags = PySequence_List(self->tags);
+    if (tags == NULL) goto end;
 
     ans = PyObject_CallFunctionObjArgs((PyObject *) &html_StateType,
             tag_being_defined, tags, self->is_bold, self->is_italic, self->current_lang, self->parse, self->css_formats, sub_parser_state, self->default_lang, self->attribute_name, NULL);
@@ -380,9 +684,9 @@ static PyTypeObject html_StateType = { // {{{
 
 static PyObject*
 html_init(PyObject *self, PyObject *args) {
-    Py_XDECREF(spell_property); Py_XDECREF(recognized); Py_XDECREF(split);
-    if (!PyArg_ParseTuple(args, "OOO", &spell_property, &recognized, &split)) return NULL;
-    Py_INCREF(spell_property); Py_INCREF(recognized); Py_INCREF(split);
+    Py_XDECREF(spell_property); Py_XDECREF(recognized); Py_XDECREF(split); Py_XDECREF(recognized_many); recognized_many = NULL;
+    if (!PyArg_ParseTuple(args, "OOO|O", &spell_property, &recognized, &split, &recognized_many)) return NULL;
+    Py_INCREF(spell_property); Py_INCREF(recognized); Py_INCREF(split); Py_XINCREF(recognized_many);
     Py_RETURN_NONE;
 }
 
@@ -400,9 +704,10 @@ static inline long number_to_long(PyObject *number) {
 
 static PyObject*
 html_check_spelling(PyObject *self, PyObject *args) {
-    PyObject *ans = NULL, *temp = NULL, *items = NULL, *text = NULL, *fmt = NULL, *locale = NULL, *sfmt = NULL, *_store_locale = NULL, *t = NULL, *utmp = NULL;
-    long text_len = 0, start = 0, length = 0, ppos = 0;
+    PyObject *ans = NULL, *temp = NULL, *items = NULL, *text = NULL, *fmt = NULL, *locale = NULL, *sfmt = NULL, *_store_locale = NULL, *t = NULL, *utmp = NULL, *words = NULL, *bitmap = NULL, *run_fmt = NULL;
+    long text_len = 0, start = 0, length = 0, ppos = 0, run_len = 0;
     int store_locale = 0, ok = 0;
+    const unsigned char *bits = NULL;
     Py_ssize_t i = 0, j = 0;
 
     if (!PyArg_ParseTuple(args, "OlOOOO", &text, &text_len, &fmt, &locale, &sfmt, &_store_locale)) return NULL;
@@ -415,10 +720,50 @@ html_check_spelling(PyObject *self, PyObject *args) {
     ans = PyTuple_New((2 * PyList_GET_SIZE(items)) + 1);
     if (ans == NULL) { PyErr_NoMemory(); goto error; }
 
-#define APPEND(x, y) t = Py_BuildValue("lO", (x), (y)); \
+    if (recognized_many != NULL && PyList_GET_SIZE(items) > 0) {
+        // Check all the words of this text run against the dictionary in a
+        // single call, with the results delivered as a bitmap, instead of
+        // paying for a call into python per word
+        words = PyTuple_New(PyList_GET_SIZE(items));
+        if (words == NULL) { PyErr_NoMemory(); goto error; }
+        for (i = 0; i < PyList_GET_SIZE(items); i++) {
+            temp = PyList_GET_ITEM(items, i);
+            start = number_to_long(PyTuple_GET_ITEM(temp, 0));
+            if(start == -1 && PyErr_Occurred() != NULL) goto error;
+            length = number_to_long(PyTuple_GET_ITEM(temp, 1));
+            if(length == -1 && PyErr_Occurred() != NULL) goto error;
+            temp = NULL;
+#if PY_VERSION_HEX >= 0x03030000
+            utmp = PyUnicode_Substring(text, start, start + length);
+#else
+            utmp = PyUnicode_FromUnicode(PyUnicode_AS_UNICODE(text) + start, length);
+#endif
+            if (utmp == NULL) { PyErr_NoMemory(); goto error; }
+            PyTuple_SET_ITEM(words, i, utmp); utmp = NULL;
+        }
+        bitmap = PyObject_CallFunctionObjArgs(recognized_many, words, locale, NULL);
+        if (bitmap == NULL) goto error;
+        if (!PyBytes_Check(bitmap) || PyBytes_GET_SIZE(bitmap) * 8 < PyList_GET_SIZE(items)) {
+            PyErr_SetString(PyExc_TypeError, "The recognized_many callback must return a bytes bitmap with one bit per word");
+            goto error;
+        }
+        bits = (const unsigned char *)PyBytes_AS_STRING(bitmap);
+    }
+
+// Adjacent spans with the same format (a recognized word and the
+// separator before it, most of the time) are coalesced into a single
+// run before being returned, since the cost of applying the ranges in
+// the editor scales with their count. Formats are compared by identity,
+// which is how the highlighter reuses them.
+#define FLUSH_RUN if (run_fmt != NULL) { \
+                     t = Py_BuildValue("lO", run_len, run_fmt); \
+                     Py_DECREF(run_fmt); run_fmt = NULL; \
                      if (t == NULL) goto error; \
                      PyTuple_SET_ITEM(ans, j, t); \
-                     j += 1;
+                     j += 1; }
+
+#define APPEND(x, y) if (run_fmt == (PyObject*)(y)) { run_len += (x); } \
+                     else { FLUSH_RUN; run_fmt = (PyObject*)(y); Py_INCREF(run_fmt); run_len = (x); }
 
     for (i = 0, j = 0; i < PyList_GET_SIZE(items); i++) {
         temp = PyList_GET_ITEM(items, i);
@@ -431,17 +776,20 @@ html_check_spelling(PyObject *self, PyObject *args) {
         if (start > ppos) { APPEND(start - ppos, fmt) }
         ppos = start + length;
 
+        if (bits != NULL) ok = (bits[i >> 3] & (1 << (i & 7))) != 0;
+        else {
 #if PY_VERSION_HEX >= 0x03030000
-        utmp = PyUnicode_Substring(text, start, start + length);
+            utmp = PyUnicode_Substring(text, start, start + length);
 #else
-        utmp = PyUnicode_FromUnicode(PyUnicode_AS_UNICODE(text) + start, length);
+            utmp = PyUnicode_FromUnicode(PyUnicode_AS_UNICODE(text) + start, length);
 #endif
-        if (utmp == NULL) { PyErr_NoMemory(); goto error; }
-        temp = PyObject_CallFunctionObjArgs(recognized, utmp, locale, NULL);
-        Py_DECREF(utmp); utmp = NULL;
-        if (temp == NULL) goto error;
-        ok = PyObject_IsTrue(temp);
-        Py_DECREF(temp); temp = NULL;
+            if (utmp == NULL) { PyErr_NoMemory(); goto error; }
+            temp = PyObject_CallFunctionObjArgs(recognized, utmp, locale, NULL);
+            Py_DECREF(utmp); utmp = NULL;
+            if (temp == NULL) goto error;
+            ok = PyObject_IsTrue(temp);
+            Py_DECREF(temp); temp = NULL;
+        }
 
         if (ok) {
             APPEND(length, fmt)
@@ -459,6 +807,7 @@ html_check_spelling(PyObject *self, PyObject *args) {
     if (ppos < text_len) {
         APPEND(text_len - ppos, fmt)
     }
+    FLUSH_RUN
 
     if (j < PyTuple_GET_SIZE(ans)) _PyTuple_Resize(&ans, j);
     goto end;
@@ -466,7 +815,7 @@ html_check_spelling(PyObject *self, PyObject *args) {
 error:
     Py_XDECREF(ans); ans = NULL;
 end:
-    Py_XDECREF(items); Py_XDECREF(temp);
+    Py_XDECREF(items); Py_XDECREF(temp); Py_XDECREF(words); Py_XDECREF(bitmap); Py_XDECREF(run_fmt);
     return ans;
 }
 
@@ -511,6 +860,8 @@ CALIBRE_MODINIT_FUNC inithtml(void) {
         INITERROR;
     if (PyType_Ready(&html_StateType) < 0)
         INITERROR;
+    if (PyType_Ready(&html_TagStackType) < 0)
+        INITERROR;
 
     temp = Py_BuildValue("ssssssss", "b", "strong", "h1", "h2", "h3", "h4", "h5", "h6", "h7");
     if (temp == NULL) INITERROR;
@@ -525,18 +876,22 @@ CALIBRE_MODINIT_FUNC inithtml(void) {
     temp = NULL;
 
     zero = PyLong_FromLong(0);
+    tag_name_pool = PyDict_New();
 
-    if (bold_tags == NULL || italic_tags == NULL || zero == NULL) {
+    if (bold_tags == NULL || italic_tags == NULL || zero == NULL || tag_name_pool == NULL) {
         Py_XDECREF(bold_tags);
         Py_XDECREF(italic_tags);
         Py_XDECREF(zero);
+        Py_XDECREF(tag_name_pool);
         INITERROR;
     }
 
     Py_INCREF(&html_TagType);
     Py_INCREF(&html_StateType);
+    Py_INCREF(&html_TagStackType);
     PyModule_AddObject(mod, "Tag", (PyObject *)&html_TagType);
     PyModule_AddObject(mod, "State", (PyObject *)&html_StateType);
+    PyModule_AddObject(mod, "TagStack", (PyObject *)&html_TagStackType);
     PyModule_AddObject(mod, "bold_tags", bold_tags);
     PyModule_AddObject(mod, "italic_tags", italic_tags);
 
@@ -74,7 +74,7 @@ if _speedup is not None:
         s = QTextCharFormat(sfmt)
         s.setProperty(SPELL_LOCALE_PROPERTY, locale)
         return s
-    _speedup.init(spell_property, dictionaries.recognized, split_into_words_and_positions)
+    _speedup.init(spell_property, dictionaries.recognized, split_into_words_and_positions, dictionaries.recognized_many)
     del spell_property
     check_spelling = _speedup.check_spelling
 else:
@@ -1257,6 +1257,16 @@ class SpellCheck(Dialog):
             self.end_work()
         else:
             self.work_finished.emit(words, spell_map, change_request)
+            if isinstance(words, dict):
+                # Warm the suggestion cache for the misspelled words while the
+                # user is looking at the list, so that showing suggestions for
+                # any of them is instant. Small batches keep the join() in
+                # refresh() responsive when a new scan cancels this one.
+                misspelled = [w for w in words if not spell_map.get(w)]
+                for i in range(0, len(misspelled), 10):
+                    if self.cancel:
+                        break
+                    dictionaries.suggestions_many(misspelled[i:i+10])
 
     def end_work(self):
         self.stack.setCurrentIndex(1)
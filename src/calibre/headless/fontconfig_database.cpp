@@ -40,7 +40,16 @@
 #include "fontconfig_database.h"
 
 #include <QtCore/QList>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
 #include <QtCore/QElapsedTimer>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
 
 #include <qpa/qplatformnativeinterface.h>
 #include <qpa/qplatformscreen.h>
@@ -69,6 +78,9 @@
 #include <fontconfig/fcfreetype.h>
 #endif
 
+// Defined with the fallback cache next to fallbacksForFamily() below
+static void clearFallbackCache();
+
 QT_BEGIN_NAMESPACE
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 5, 0))
@@ -428,7 +440,146 @@ static inline bool requiresOpenType(int writingSystem)
             || writingSystem == QFontDatabase::Khmer || writingSystem == QFontDatabase::Nko);
 }
 
-static void populateFromPattern(FcPattern *pattern)
+// Populating the font database requires walking every installed font
+// through fontconfig, which takes seconds on machines with many fonts and
+// happens in every headless worker process at startup. We therefore record
+// the resolved metadata for every font on the first scan in a small
+// versioned binary cache and replay it on subsequent starts, as long as the
+// font directories have not changed.
+
+struct CachedFont {
+    QString family, styleName, foundry, fileName;
+    qint32 weight, style, stretch, index;
+    bool antialias, scalable, fixedPitch;
+    double pixelSize;
+    quint64 writingSystems;
+};
+
+struct CachedAlias {
+    QString family, alias;
+};
+
+static QDataStream &operator<<(QDataStream &s, const CachedFont &f)
+{
+    return s << f.family << f.styleName << f.foundry << f.fileName
+        << f.weight << f.style << f.stretch << f.index
+        << f.antialias << f.scalable << f.fixedPitch
+        << f.pixelSize << f.writingSystems;
+}
+
+static QDataStream &operator>>(QDataStream &s, CachedFont &f)
+{
+    return s >> f.family >> f.styleName >> f.foundry >> f.fileName
+        >> f.weight >> f.style >> f.stretch >> f.index
+        >> f.antialias >> f.scalable >> f.fixedPitch
+        >> f.pixelSize >> f.writingSystems;
+}
+
+static QDataStream &operator<<(QDataStream &s, const CachedAlias &a)
+{
+    return s << a.family << a.alias;
+}
+
+static QDataStream &operator>>(QDataStream &s, CachedAlias &a)
+{
+    return s >> a.family >> a.alias;
+}
+
+static const quint32 FONT_CACHE_MAGIC = 0x63616C66;  // 'calf'
+static const quint32 FONT_CACHE_VERSION = 1;
+
+static QString fontCachePath()
+{
+    const QString base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    if (base.isEmpty())
+        return QString();
+    return base + QLatin1String("/calibre-headless-fonts.cache");
+}
+
+static void addDirToSignature(QDataStream &s, const QString &path)
+{
+    const QFileInfo fi(path);
+    const bool exists = fi.exists();
+    s << path << exists << (exists ? fi.lastModified().toMSecsSinceEpoch() : Q_INT64_C(0));
+}
+
+static QByteArray fontDirsSignature()
+{
+    QByteArray ans;
+    QDataStream s(&ans, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_5_0);
+    s << (quint32)FC_VERSION;
+    FcStrList *dirs = FcConfigGetFontDirs(0);
+    if (dirs) {
+        FcChar8 *dir;
+        while ((dir = FcStrListNext(dirs)) != NULL) {
+            const QString path = QString::fromLocal8Bit(reinterpret_cast<const char *>(dir));
+            addDirToSignature(s, path);
+            // Font packages usually install into a subdirectory, which does
+            // not change the mtime of the configured directory itself, so
+            // stat one level of subdirectories as well.
+            const QStringList subdirs = QDir(path).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+            for (int i = 0; i < subdirs.size(); i++)
+                addDirToSignature(s, path + QLatin1Char('/') + subdirs.at(i));
+        }
+        FcStrListDone(dirs);
+    }
+    return ans;
+}
+
+static bool loadFontCache(const QString &path, const QByteArray &signature, QList<CachedFont> &fonts, QList<CachedAlias> &aliases)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+    uchar *mapped = f.map(0, f.size());
+    const QByteArray raw = mapped ?
+        QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), (int)f.size()) : f.readAll();
+    QDataStream s(raw);
+    s.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0, version = 0;
+    s >> magic >> version;
+    if (magic != FONT_CACHE_MAGIC || version != FONT_CACHE_VERSION)
+        return false;
+    QByteArray cached_signature;
+    s >> cached_signature;
+    if (cached_signature != signature)
+        return false;
+    s >> fonts >> aliases;
+    if (s.status() != QDataStream::Ok || fonts.isEmpty()) {
+        fonts.clear(); aliases.clear();
+        return false;
+    }
+    return true;
+}
+
+static void saveFontCache(const QString &path, const QByteArray &signature, const QList<CachedFont> &fonts, const QList<CachedAlias> &aliases)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly))
+        return;
+    QDataStream s(&f);
+    s.setVersion(QDataStream::Qt_5_0);
+    s << FONT_CACHE_MAGIC << FONT_CACHE_VERSION << signature << fonts << aliases;
+    if (s.status() == QDataStream::Ok)
+        f.commit();
+}
+
+static void registerCachedFont(const CachedFont &f)
+{
+    QSupportedWritingSystems writingSystems;
+    for (int j = 1; j < QFontDatabase::WritingSystemsCount; ++j) {
+        if (f.writingSystems & (Q_UINT64_C(1) << j))
+            writingSystems.setSupported(QFontDatabase::WritingSystem(j));
+    }
+    FontFile *fontFile = new FontFile;
+    fontFile->fileName = f.fileName;
+    fontFile->indexValue = f.index;
+    QPlatformFontDatabase::registerFont(f.family, f.styleName, f.foundry, QFont::Weight(f.weight), QFont::Style(f.style), QFont::Stretch(f.stretch), f.antialias, f.scalable, f.pixelSize, f.fixedPitch, writingSystems, fontFile);
+}
+
+static void populateFromPattern(FcPattern *pattern, QList<CachedFont> &fonts, QList<CachedAlias> &aliases)
 {
     QString familyName;
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 8, 0))
@@ -483,7 +634,7 @@ static void populateFromPattern(FcPattern *pattern)
     if (FcPatternGetBool(pattern,FC_ANTIALIAS,0,&antialias) != FcResultMatch)
         antialias = true;
 
-    QSupportedWritingSystems writingSystems;
+    quint64 ws_bits = 0;
     FcLangSet *langset = 0;
     FcResult res = FcPatternGetLangSet(pattern, FC_LANG, 0, &langset);
     if (res == FcResultMatch) {
@@ -505,55 +656,62 @@ static void populateFromPattern(FcPattern *pattern)
                             continue;
                     }
 #endif
-                    writingSystems.setSupported(QFontDatabase::WritingSystem(j));
+                    ws_bits |= Q_UINT64_C(1) << j;
                     hasLang = true;
                 }
             }
         }
         if (!hasLang)
             // none of our known languages, add it to the other set
-            writingSystems.setSupported(QFontDatabase::Other);
+            ws_bits |= Q_UINT64_C(1) << QFontDatabase::Other;
     } else {
         // we set Other to supported for symbol fonts. It makes no
         // sense to merge these with other ones, as they are
         // special in a way.
-        writingSystems.setSupported(QFontDatabase::Other);
+        ws_bits |= Q_UINT64_C(1) << QFontDatabase::Other;
     }
 
 #if (QT_VERSION < QT_VERSION_CHECK(5, 8, 0)) && FC_VERSION >= 20297
     for (int j = 1; j < QFontDatabase::WritingSystemsCount; ++j) {
-        if (writingSystems.supported(QFontDatabase::WritingSystem(j))
+        if ((ws_bits & (Q_UINT64_C(1) << j))
             && requiresOpenType(j) && capabilityForWritingSystem[j]) {
             FcChar8 *cap;
             res = FcPatternGetString (pattern, FC_CAPABILITY, 0, &cap);
             if (res != FcResultMatch || !strstr((const char *)cap, capabilityForWritingSystem[j]))
-                writingSystems.setSupported(QFontDatabase::WritingSystem(j),false);
+                ws_bits &= ~(Q_UINT64_C(1) << j);
         }
     }
 #endif
 
-    FontFile *fontFile = new FontFile;
-    fontFile->fileName = QString::fromLocal8Bit((const char *)file_value);
-    fontFile->indexValue = indexValue;
+    CachedFont entry;
+    entry.family = familyName;
+    entry.fileName = QString::fromLocal8Bit((const char *)file_value);
+    entry.index = indexValue;
 
-    QFont::Style style = (slant_value == FC_SLANT_ITALIC)
+    entry.style = (slant_value == FC_SLANT_ITALIC)
                      ? QFont::StyleItalic
                      : ((slant_value == FC_SLANT_OBLIQUE)
                         ? QFont::StyleOblique
                         : QFont::StyleNormal);
     // Note: weight should really be an int but registerFont incorrectly uses an enum
-    QFont::Weight weight = QFont::Weight(weightFromFcWeight(weight_value));
+    entry.weight = weightFromFcWeight(weight_value);
 
     double pixel_size = 0;
     if (!scalable)
         FcPatternGetDouble (pattern, FC_PIXEL_SIZE, 0, &pixel_size);
+    entry.pixelSize = pixel_size;
 
-    bool fixedPitch = spacing_value >= FC_MONO;
+    entry.fixedPitch = spacing_value >= FC_MONO;
     // Note: stretch should really be an int but registerFont incorrectly uses an enum
-    QFont::Stretch stretch = QFont::Stretch(stretchFromFcWidth(width_value));
+    entry.stretch = stretchFromFcWidth(width_value);
     QString styleName = style_value ? QString::fromUtf8((const char *) style_value) : QString();
-    QPlatformFontDatabase::registerFont(familyName,styleName,QLatin1String((const char *)foundry_value),weight,style,stretch,antialias,scalable,pixel_size,fixedPitch,writingSystems,fontFile);
-//        qDebug() << familyName << (const char *)foundry_value << weight << style << &writingSystems << scalable << true << pixel_size;
+    entry.styleName = styleName;
+    entry.foundry = foundry_value ? QString::fromLatin1((const char *)foundry_value) : QString();
+    entry.antialias = antialias;
+    entry.scalable = scalable;
+    entry.writingSystems = ws_bits;
+    fonts << entry;
+//        qDebug() << familyName << (const char *)foundry_value << entry.weight << entry.style << ws_bits << scalable << true << pixel_size;
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 8, 0))
     for (int k = 1; FcPatternGetString(pattern, FC_FAMILY, k, &value) == FcResultMatch; ++k) {
@@ -574,15 +732,20 @@ static void populateFromPattern(FcPattern *pattern)
             altFamilyNameLang = familyNameLang;
 
         if (familyNameLang == altFamilyNameLang && altStyleName != styleName) {
-            FontFile *altFontFile = new FontFile(*fontFile);
-            QPlatformFontDatabase::registerFont(altFamilyName, altStyleName, QLatin1String((const char *)foundry_value),weight,style,stretch,antialias,scalable,pixel_size,fixedPitch,writingSystems,altFontFile);
+            CachedFont alt = entry;
+            alt.family = altFamilyName;
+            alt.styleName = altStyleName;
+            fonts << alt;
         } else {
-            QPlatformFontDatabase::registerAliasToFontFamily(familyName, altFamilyName);
+            CachedAlias alias = { familyName, altFamilyName };
+            aliases << alias;
         }
     }
 #else
-    for (int k = 1; FcPatternGetString(pattern, FC_FAMILY, k, &value) == FcResultMatch; ++k)
-        QPlatformFontDatabase::registerAliasToFontFamily(familyName, QString::fromUtf8((const char *)value));
+    for (int k = 1; FcPatternGetString(pattern, FC_FAMILY, k, &value) == FcResultMatch; ++k) {
+        CachedAlias alias = { familyName, QString::fromUtf8((const char *)value) };
+        aliases << alias;
+    }
 #endif
 
 }
@@ -594,9 +757,18 @@ void QFontconfigDatabase::populateFontDatabase()
 #else
     FcInitReinitialize();
 #endif
-    FcFontSet  *fonts;
+    clearFallbackCache();
+    QList<CachedFont> cached_fonts;
+    QList<CachedAlias> cached_aliases;
+    const QString cache_path = fontCachePath();
+    const bool use_cache = !cache_path.isEmpty() && !qEnvironmentVariableIsSet("CALIBRE_HEADLESS_NO_FONT_CACHE");
+    QByteArray signature;
+    if (use_cache)
+        signature = fontDirsSignature();
+
+    if (!use_cache || !loadFontCache(cache_path, signature, cached_fonts, cached_aliases)) {
+        FcFontSet  *fonts;
 
-    {
         FcObjectSet *os = FcObjectSetCreate();
         FcPattern *pattern = FcPatternCreate();
         const char *properties [] = {
@@ -620,12 +792,20 @@ void QFontconfigDatabase::populateFontDatabase()
         fonts = FcFontList(0, pattern, os);
         FcObjectSetDestroy(os);
         FcPatternDestroy(pattern);
-    }
 
-    for (int i = 0; i < fonts->nfont; i++)
-        populateFromPattern(fonts->fonts[i]);
+        for (int i = 0; i < fonts->nfont; i++)
+            populateFromPattern(fonts->fonts[i], cached_fonts, cached_aliases);
+
+        FcFontSetDestroy (fonts);
+
+        if (use_cache)
+            saveFontCache(cache_path, signature, cached_fonts, cached_aliases);
+    }
 
-    FcFontSetDestroy (fonts);
+    for (int i = 0; i < cached_fonts.size(); i++)
+        registerCachedFont(cached_fonts.at(i));
+    for (int i = 0; i < cached_aliases.size(); i++)
+        QPlatformFontDatabase::registerAliasToFontFamily(cached_aliases.at(i).family, cached_aliases.at(i).alias);
 
     struct FcDefaultFont {
         const char *qtname;
@@ -665,6 +845,7 @@ void QFontconfigDatabase::invalidate()
 {
     // Clear app fonts.
     FcConfigAppFontClear(0);
+    clearFallbackCache();
 }
 #endif
 
@@ -790,9 +971,39 @@ QFontEngine *QFontconfigDatabase::fontEngine(const QByteArray &fontData, qreal p
     return engine;
 }
 
+// Process lifetime cache of resolved fallback lists. Server side rendering
+// calls fallbacksForFamily() for every text run with missing glyphs and each
+// call runs a full FcFontSort(), which is expensive. The fontconfig
+// configuration is static for the life of the process (only application
+// fonts change it, and adding one clears the cache), so the resolved lists
+// can be cached keyed by the query tuple.
+typedef QHash<QString, QStringList> FallbackCache;
+Q_GLOBAL_STATIC(FallbackCache, fallbackCache)
+Q_GLOBAL_STATIC(QMutex, fallbackCacheMutex)
+
+static QString fallbackCacheKey(const QString &family, QFont::Style style, QFont::StyleHint styleHint, QChar::Script script)
+{
+    return family.toCaseFolded() + QLatin1Char(0x1f) + QString::number(int(style))
+        + QLatin1Char(0x1f) + QString::number(int(styleHint))
+        + QLatin1Char(0x1f) + QString::number(int(script));
+}
+
+static void clearFallbackCache()
+{
+    QMutexLocker locker(fallbackCacheMutex());
+    fallbackCache()->clear();
+}
+
 QStringList QFontconfigDatabase::fallbacksForFamily(const QString &family, QFont::Style style, QFont::StyleHint styleHint, QChar::Script script) const
 {
     QStringList fallbackFamilies;
+    const QString cacheKey = fallbackCacheKey(family, style, styleHint, script);
+    {
+        QMutexLocker locker(fallbackCacheMutex());
+        FallbackCache::const_iterator it = fallbackCache()->constFind(cacheKey);
+        if (it != fallbackCache()->constEnd())
+            return it.value();
+    }
     FcPattern *pattern = FcPatternCreate();
     if (!pattern)
         return fallbackFamilies;
@@ -864,6 +1075,10 @@ QStringList QFontconfigDatabase::fallbacksForFamily(const QString &family, QFont
     }
 //    qDebug() << "fallbackFamilies for:" << family << style << styleHint << script << fallbackFamilies;
 
+    {
+        QMutexLocker locker(fallbackCacheMutex());
+        fallbackCache()->insert(cacheKey, fallbackFamilies);
+    }
     return fallbackFamilies;
 }
 
@@ -928,6 +1143,10 @@ QStringList QFontconfigDatabase::addApplicationFont(const QByteArray &fontData,
         ++id;
     } while (id < count);
 
+    // The new font changes the fontconfig application set, so cached
+    // fallback lists may be stale
+    clearFallbackCache();
+
     return families;
 }
 
@@ -2,13 +2,17 @@
 #include "headless_integration.h"
 #include "qscreen.h"
 #include <QtCore/qdebug.h>
+#include <QtCore/qcoreapplication.h>
 #include <qpa/qplatformscreen.h>
 #include <private/qguiapplication_p.h>
 
 QT_BEGIN_NAMESPACE
 
+static int backing_store_serial = 0;
+
 HeadlessBackingStore::HeadlessBackingStore(QWindow *window)
     : QPlatformBackingStore(window)
+    , mSerial(backing_store_serial++)
     , mDebug(0)
 {
     if (mDebug)
@@ -17,6 +21,8 @@ HeadlessBackingStore::HeadlessBackingStore(QWindow *window)
 
 HeadlessBackingStore::~HeadlessBackingStore()
 {
+    // Release the image before the shared memory segment it may point into
+    mImage = QImage();
 }
 
 QPaintDevice *HeadlessBackingStore::paintDevice()
@@ -44,8 +50,37 @@ void HeadlessBackingStore::flush(QWindow *window, const QRegion &region, const Q
 void HeadlessBackingStore::resize(const QSize &size, const QRegion &)
 {
     QImage::Format format = QGuiApplication::primaryScreen()->handle()->format();
-    if (mImage.size() != size)
-        mImage = QImage(size, format);
+    if (mImage.size() == size)
+        return;
+    // When CALIBRE_HEADLESS_SHM_PREFIX is set, paint directly into a named
+    // shared memory segment (<prefix><pid>-<serial>) instead of a private
+    // buffer, so that other processes can map rendered frames without
+    // copying them.
+    const QByteArray prefix = qgetenv("CALIBRE_HEADLESS_SHM_PREFIX");
+    mImage = QImage();
+    if (mShm.isAttached())
+        mShm.detach();
+    if (!prefix.isEmpty() && !size.isEmpty()) {
+        const QImage probe(1, 1, format);
+        // Match the 32-bit scanline alignment QImage uses for buffers it
+        // allocates itself
+        const int bpl = ((size.width() * probe.depth() + 31) >> 5) << 2;
+        mShm.setKey(QString::fromLocal8Bit(prefix) + QString::number(QCoreApplication::applicationPid()) + QLatin1Char('-') + QString::number(mSerial));
+        if (mShm.create(bpl * size.height())) {
+            mImage = QImage(static_cast<uchar *>(mShm.data()), size.width(), size.height(), bpl, format);
+            return;
+        }
+        if (mDebug)
+            qDebug() << "HeadlessBackingStore::resize() shared memory unavailable:" << mShm.errorString();
+    }
+    mImage = QImage(size, format);
+}
+
+QImage HeadlessBackingStore::toImage() const
+{
+    // Implicitly shared, so grabbing a rendered frame does not copy the
+    // pixel data unless the caller writes to it
+    return mImage;
 }
 
 QT_END_NAMESPACE
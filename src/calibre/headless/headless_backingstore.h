@@ -2,6 +2,7 @@
 
 #include <qpa/qplatformbackingstore.h>
 #include <qpa/qplatformwindow.h>
+#include <QtCore/QSharedMemory>
 #include <QtGui/QImage>
 
 QT_BEGIN_NAMESPACE
@@ -15,9 +16,13 @@ public:
     QPaintDevice *paintDevice();
     void flush(QWindow *window, const QRegion &region, const QPoint &offset);
     void resize(const QSize &size, const QRegion &staticContents);
+    QImage toImage() const Q_DECL_OVERRIDE;
 
 private:
+    // mShm must outlive mImage, which may point into the segment
+    QSharedMemory mShm;
     QImage mImage;
+    const int mSerial;
     const bool mDebug;
 };
 
@@ -57,18 +57,42 @@ class GenericUnixServices : public QGenericUnixServices {
 
 HeadlessIntegration::HeadlessIntegration(const QStringList &parameters)
 {
-    Q_UNUSED(parameters);
-    HeadlessScreen *mPrimaryScreen = new HeadlessScreen();
+    // Batch renderers paint one window per worker thread, with each window
+    // full screen on its own virtual screen so the raster surfaces are
+    // completely independent. The number of screens comes from the platform
+    // argument (-platform headless:screens=N) or CALIBRE_HEADLESS_NUM_SCREENS
+    // and defaults to one.
+    int num_screens = 1;
+    Q_FOREACH (const QString &param, parameters) {
+        if (param.startsWith(QLatin1String("screens="))) {
+            bool ok = false;
+            const int n = param.mid(8).toInt(&ok);
+            if (ok)
+                num_screens = n;
+        }
+    }
+    if (num_screens < 2) {
+        bool ok = false;
+        const int n = qgetenv("CALIBRE_HEADLESS_NUM_SCREENS").toInt(&ok);
+        if (ok && n > 0)
+            num_screens = n;
+    }
+    num_screens = qBound(1, num_screens, 64);
 
-    mPrimaryScreen->mGeometry = QRect(0, 0, 240, 320);
-    mPrimaryScreen->mDepth = 32;
-    mPrimaryScreen->mFormat = QImage::Format_ARGB32_Premultiplied;
+    for (int i = 0; i < num_screens; i++) {
+        HeadlessScreen *screen = new HeadlessScreen();
+
+        // Tile the screens horizontally so their global coordinates do not overlap
+        screen->mGeometry = QRect(i * 240, 0, 240, 320);
+        screen->mDepth = 32;
+        screen->mFormat = QImage::Format_ARGB32_Premultiplied;
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 13, 0))
-    QWindowSystemInterface::handleScreenAdded(mPrimaryScreen);
+        QWindowSystemInterface::handleScreenAdded(screen);
 #else
-    screenAdded(mPrimaryScreen);
+        screenAdded(screen);
 #endif
+    }
 
 #ifdef __APPLE__
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 12, 0))
@@ -147,6 +147,29 @@ class SortedConcatenate(object):
             raise
 
 
+class PresortedConcatenate(object):
+    '''Concatenation in arrival order, for queries that already ORDER BY the
+    sort index, saving the per group sort'''
+    sep = ','
+
+    def __init__(self):
+        self.ans = []
+
+    def step(self, ndx, value):
+        if value is not None:
+            self.ans.append(value)
+
+    def finalize(self):
+        try:
+            if len(self.ans) == 0:
+                return None
+            return self.sep.join(self.ans)
+        except Exception:
+            import traceback
+            traceback.print_exc()
+            raise
+
+
 class SortedConcatenateBar(SortedConcatenate):
     sep = '|'
 
@@ -257,10 +280,14 @@ def do_connect(path, row_factory=None):
     conn.create_aggregate('sortconcat', 2, SortedConcatenate)
     conn.create_aggregate('sortconcat_bar', 2, SortedConcatenateBar)
     conn.create_aggregate('sortconcat_amper', 2, SortedConcatenateAmper)
+    conn.create_aggregate('sortconcat_presorted', 2, PresortedConcatenate)
     conn.create_aggregate('identifiers_concat', 2, IdentifiersConcat)
+    conn.create_aggregate('concat', 1, Concatenate)
+    # Fallback for the ICU backed collation registered by the C extension,
+    # which replaces this one when it loads
+    conn.create_collation('calibre_unicode', icu_collator)
     load_c_extensions(conn)
     conn.row_factory = sqlite.Row if row_factory else (lambda cursor, row : list(row))
-    conn.create_aggregate('concat', 1, Concatenate)
     conn.create_aggregate('aum_sortconcat', 4, AumSortedConcatenate)
     conn.create_collation('PYNOCASE', partial(pynocase,
         encoding=encoding))
@@ -5,6 +5,8 @@
 #include <stdlib.h>
 
 #include <sqlite3ext.h>
+#include <unicode/ucol.h>
+#include "calibre_alloc.h"
 SQLITE_EXTENSION_INIT1
 
 #ifdef _MSC_VER
@@ -15,20 +17,24 @@ SQLITE_EXTENSION_INIT1
 
 // sortconcat {{{
 
+// Values are copied back to back into a single geometrically grown arena
+// (see calibre_alloc.h), with one small item record (arena offset, sort
+// index, length) per value, instead of two mallocs per row.
 typedef struct {
-    unsigned char *val;
+    size_t offset;
     int index;
     int length;
 } SortConcatItem;
 
 typedef struct {
-    SortConcatItem **vals;
+    Arena vals;  // Array of SortConcatItem
+    Arena buf;   // The value bytes, back to back
     int count;
-    int length;
 } SortConcatList;
 
 static void sort_concat_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
     const unsigned char *val;
+    SortConcatItem item;
     int idx, sz;
     SortConcatList *list;
 
@@ -37,227 +43,509 @@ static void sort_concat_step(sqlite3_context *context, int argc, sqlite3_value *
     list = (SortConcatList*) sqlite3_aggregate_context(context, sizeof(*list));
     if (list == NULL) return;
 
-    if (list->vals == NULL) {
-        list->vals = (SortConcatItem**)calloc(100, sizeof(SortConcatItem*));
-        if (list->vals == NULL) return;
-        list->length = 100;
-        list->count = 0;
-    }
-
-    if (list->count == list->length) {
-        list->vals = (SortConcatItem**)realloc(list->vals, sizeof(SortConcatItem*)*(list->length + 100));
-        if (list->vals == NULL) return;
-        list->length = list->length + 100;
-    }
-
-    list->vals[list->count] = (SortConcatItem*)calloc(1, sizeof(SortConcatItem));
-    if (list->vals[list->count] == NULL) return;
-
     idx = sqlite3_value_int(argv[0]);
     val = sqlite3_value_text(argv[1]);
     sz  = sqlite3_value_bytes(argv[1]);
-    if (idx == 0 || val == NULL || sz == 0) {free(list->vals[list->count]); return;}
-
-
+    if (idx == 0 || val == NULL || sz == 0) return;
 
-    list->vals[list->count]->val = (unsigned char*)calloc(sz, sizeof(unsigned char));
-    if (list->vals[list->count]->val == NULL)
-        {free(list->vals[list->count]); return;}
-    list->vals[list->count]->index = idx;
-    list->vals[list->count]->length = sz;
-    memcpy(list->vals[list->count]->val, val, sz);
+    item.offset = list->buf.used;
+    item.index = idx;
+    item.length = sz;
+    if (!arena_append(&list->buf, val, sz)) return;
+    if (!arena_append(&list->vals, &item, sizeof(item))) { list->buf.used -= sz; return; }
     list->count = list->count + 1;
-
 }
 
 static void sort_concat_free(SortConcatList *list) {
-    int i;
     if (list == NULL) return;
-    for (i = 0; i < list->count; i++) {
-        free(list->vals[i]->val);
-        free(list->vals[i]);
-    }
-    free(list->vals);
+    arena_free(&list->vals);
+    arena_free(&list->buf);
 }
 
 static int sort_concat_cmp(const void *a_, const void *b_) {
-    return (*((SortConcatItem**)a_))->index - (*((SortConcatItem**)b_))->index;
+    return ((const SortConcatItem*)a_)->index - ((const SortConcatItem*)b_)->index;
 }
 
 static unsigned char* sort_concat_do_finalize(SortConcatList *list, const unsigned char join) {
+    const SortConcatItem *vals = (const SortConcatItem*)list->vals.buf;
     unsigned char *ans, *pos;
-    unsigned int sz = 0, i;
+    size_t sz;
+    int i;
 
-    for (i = 0; i < list->count; i++) {
-        sz += list->vals[i]->length;
-    }
-    sz += list->count;
+    sz = list->buf.used + list->count;
 
     ans = (unsigned char *) calloc(sz, sizeof(unsigned char));
     if (ans == NULL) return ans;
 
     pos = ans;
     for (i = 0; i < list->count; i++) {
-        if (list->vals[i]->length > 0) {
-            memcpy(pos, list->vals[i]->val, list->vals[i]->length);
-            pos += list->vals[i]->length;
-            if (i < list->count -1) { *pos = join; pos += 1; }
-        }
+        memcpy(pos, list->buf.buf + vals[i].offset, vals[i].length);
+        pos += vals[i].length;
+        if (i < list->count - 1) { *pos = join; pos += 1; }
     }
 
     return ans;
 
 }
 
-static void sort_concat_finalize(sqlite3_context *context) {
+static void sort_concat_do_result(sqlite3_context *context, const unsigned char join, int presorted) {
     SortConcatList *list;
     unsigned char *ans;
 
     list = (SortConcatList*) sqlite3_aggregate_context(context, sizeof(*list));
 
-    if (list != NULL && list->vals != NULL && list->count > 0) {
-        qsort(list->vals, list->count, sizeof(list->vals[0]), sort_concat_cmp);
-        ans = sort_concat_do_finalize(list, ',');
+    if (list != NULL && list->vals.buf != NULL && list->count > 0) {
+        if (!presorted)
+            qsort(list->vals.buf, list->count, sizeof(SortConcatItem), sort_concat_cmp);
+        ans = sort_concat_do_finalize(list, join);
         if (ans != NULL) sqlite3_result_text(context, (char*)ans, -1, SQLITE_TRANSIENT);
         free(ans);
         sort_concat_free(list);
     }
 }
 
+static void sort_concat_finalize(sqlite3_context *context) {
+    sort_concat_do_result(context, ',', 0);
+}
+
 static void sort_concat_finalize2(sqlite3_context *context) {
-    SortConcatList *list;
-    unsigned char *ans;
+    sort_concat_do_result(context, '|', 0);
+}
 
-    list = (SortConcatList*) sqlite3_aggregate_context(context, sizeof(*list));
+static void sort_concat_finalize3(sqlite3_context *context) {
+    sort_concat_do_result(context, '&', 0);
+}
 
-    if (list != NULL && list->vals != NULL && list->count > 0) {
-        qsort(list->vals, list->count, sizeof(list->vals[0]), sort_concat_cmp);
-        ans = sort_concat_do_finalize(list, '|');
-        if (ans != NULL) sqlite3_result_text(context, (char*)ans, -1, SQLITE_TRANSIENT);
-        free(ans);
-        sort_concat_free(list);
-    }
+// For callers that already ORDER BY the sort index, concatenation in
+// arrival order without the qsort
+static void sort_concat_finalize_presorted(sqlite3_context *context) {
+    sort_concat_do_result(context, ',', 1);
+}
+
+// }}}
+
+// identifiers_concat and concat {{{
+
+// Since both aggregates return their values in arrival order, the result
+// string is built directly in an exponentially grown arena (see
+// calibre_alloc.h), one append per step, with value lengths taken from
+// sqlite instead of strlen walks. The finalizer only has to trim the
+// trailing separator.
+
+static void concat_arena_finalize(sqlite3_context *context) {
+    Arena *arena;
 
+    arena = (Arena*) sqlite3_aggregate_context(context, sizeof(*arena));
+    if (arena == NULL || arena->buf == NULL || arena->used == 0) return;
+    // Drop the trailing separator
+    sqlite3_result_text(context, arena->buf, (int)(arena->used - 1), SQLITE_TRANSIENT);
+    arena_free(arena);
 }
 
-static void sort_concat_finalize3(sqlite3_context *context) {
-    SortConcatList *list;
-    unsigned char *ans;
+static void identifiers_concat_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    const char *key, *val;
+    int key_sz, val_sz;
+    Arena *arena;
 
-    list = (SortConcatList*) sqlite3_aggregate_context(context, sizeof(*list));
+    assert(argc == 2);
 
-    if (list != NULL && list->vals != NULL && list->count > 0) {
-        qsort(list->vals, list->count, sizeof(list->vals[0]), sort_concat_cmp);
-        ans = sort_concat_do_finalize(list, '&');
-        if (ans != NULL) sqlite3_result_text(context, (char*)ans, -1, SQLITE_TRANSIENT);
-        free(ans);
-        sort_concat_free(list);
-    }
+    arena = (Arena*) sqlite3_aggregate_context(context, sizeof(*arena));
+    if (arena == NULL) return;
+
+    key = (const char*) sqlite3_value_text(argv[0]);
+    val = (const char*) sqlite3_value_text(argv[1]);
+    if (key == NULL || val == NULL) return;
+    key_sz = sqlite3_value_bytes(argv[0]);
+    val_sz = sqlite3_value_bytes(argv[1]);
+
+    if (!arena_append(arena, key, key_sz)) return;
+    if (!arena_append(arena, ":", 1)) return;
+    if (!arena_append(arena, val, val_sz)) return;
+    arena_append(arena, ",", 1);
+}
 
+static void concat_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    const char *val;
+    Arena *arena;
+
+    assert(argc == 1);
+
+    arena = (Arena*) sqlite3_aggregate_context(context, sizeof(*arena));
+    if (arena == NULL) return;
+
+    val = (const char*) sqlite3_value_text(argv[0]);
+    if (val == NULL) return;
+
+    if (!arena_append(arena, val, sqlite3_value_bytes(argv[0]))) return;
+    arena_append(arena, ",", 1);
 }
 
 // }}}
 
-// identifiers_concat {{{
+// field_cache virtual table {{{
+
+// Exposes many-to-many field maps (tags/authors/etc. per book) to SQL as an
+// eponymous table-valued function, so complex searches can run as single
+// indexed queries inside SQLite instead of set algebra over Python dicts:
+//
+//   SELECT item FROM field_cache WHERE field = 'tags' AND book = ?
+//
+// The maps are registered from Python with sqlite_custom.set_field_map(),
+// which is possible because the same shared object is both the Python
+// module and the SQLite extension, so they share globals. Pairs are stored
+// sorted by (book, item), giving equality lookups on book a binary search.
+// The registry is only mutated from Python with the GIL held and calibre
+// serializes all access to a library database on one thread, so no locking
+// is done here; maps must not be replaced while a query is running.
 
 typedef struct {
-    char *val;
-    size_t length;
-} IdentifiersConcatItem;
+    sqlite3_int64 book;
+    sqlite3_int64 item;
+} FieldPair;
 
 typedef struct {
-    IdentifiersConcatItem **vals;
-    size_t count;
-    size_t length;
-} IdentifiersConcatList;
-
-static void identifiers_concat_step(sqlite3_context *context, int argc, sqlite3_value **argv) {
-    const char *key, *val;
-    size_t len = 0;
-    IdentifiersConcatList *list;
-
-    assert(argc == 2);
+    char *name;
+    FieldPair *pairs;
+    int count;
+} FieldMap;
 
-    list = (IdentifiersConcatList*) sqlite3_aggregate_context(context, sizeof(*list));
-    if (list == NULL) return;
+static FieldMap *field_maps = NULL;
+static int field_map_count = 0;
 
-    if (list->vals == NULL) {
-        list->vals = (IdentifiersConcatItem**)calloc(100, sizeof(IdentifiersConcatItem*));
-        if (list->vals == NULL) return;
-        list->length = 100;
-        list->count = 0;
+static FieldMap* field_map_find(const char *name) {
+    int i;
+    for (i = 0; i < field_map_count; i++) {
+        if (strcmp(field_maps[i].name, name) == 0) return field_maps + i;
     }
+    return NULL;
+}
 
-    if (list->count == list->length) {
-        list->vals = (IdentifiersConcatItem**)realloc(list->vals, sizeof(IdentifiersConcatItem*)*(list->length + 100));
-        if (list->vals == NULL) return;
-        list->length = list->length + 100;
+// Takes ownership of pairs, which must be sorted by (book, item). A NULL
+// pairs/zero count removes the map. Returns 0 on success.
+static int field_map_set(const char *name, FieldPair *pairs, int count) {
+    FieldMap *map, *nmaps;
+    char *nname;
+
+    map = field_map_find(name);
+    if (map == NULL) {
+        if (pairs == NULL || count == 0) { free(pairs); return 0; }
+        nmaps = (FieldMap*)realloc(field_maps, sizeof(FieldMap)*(field_map_count + 1));
+        if (nmaps == NULL) { free(pairs); return 1; }
+        field_maps = nmaps;
+        nname = (char*)calloc(strlen(name) + 1, sizeof(char));
+        if (nname == NULL) { free(pairs); return 1; }
+        memcpy(nname, name, strlen(name));
+        map = field_maps + field_map_count;
+        map->name = nname;
+        map->pairs = NULL;
+        map->count = 0;
+        field_map_count += 1;
     }
+    free(map->pairs);
+    map->pairs = pairs;
+    map->count = (pairs == NULL) ? 0 : count;
+    return 0;
+}
 
-    list->vals[list->count] = (IdentifiersConcatItem*)calloc(1, sizeof(IdentifiersConcatItem));
-    if (list->vals[list->count] == NULL) return;
+static int field_pair_cmp(const void *a_, const void *b_) {
+    const FieldPair *a = (const FieldPair*)a_, *b = (const FieldPair*)b_;
+    if (a->book != b->book) return (a->book < b->book) ? -1 : 1;
+    if (a->item != b->item) return (a->item < b->item) ? -1 : 1;
+    return 0;
+}
 
-    key = (char*) sqlite3_value_text(argv[0]);
-    val = (char*) sqlite3_value_text(argv[1]);
-    if (key == NULL || val == NULL) {return;}
-    len = strlen(key) + strlen(val) + 1;
+typedef struct {
+    sqlite3_vtab base;
+} FieldCacheTable;
 
-    list->vals[list->count]->val = (char*)calloc(len+1, sizeof(char));
-    if (list->vals[list->count]->val == NULL) return;
-    snprintf(list->vals[list->count]->val, len+1, "%s:%s", key, val);
-    list->vals[list->count]->length = len;
+typedef struct {
+    sqlite3_vtab_cursor base;
+    FieldMap *map;
+    int pos;
+    int end;
+    int have_item;
+    sqlite3_int64 item;
+} FieldCacheCursor;
+
+#define FC_COL_BOOK 0
+#define FC_COL_ITEM 1
+#define FC_COL_FIELD 2
+
+static int fc_connect(sqlite3 *db, void *pAux, int argc, const char* const* argv, sqlite3_vtab **ppVtab, char **pzErr) {
+    FieldCacheTable *tab;
+    int rc;
+
+    rc = sqlite3_declare_vtab(db, "CREATE TABLE x(book INTEGER, item INTEGER, field TEXT HIDDEN)");
+    if (rc != SQLITE_OK) return rc;
+    tab = (FieldCacheTable*)sqlite3_malloc(sizeof(*tab));
+    if (tab == NULL) return SQLITE_NOMEM;
+    memset(tab, 0, sizeof(*tab));
+    *ppVtab = &tab->base;
+    return SQLITE_OK;
+}
 
-    list->count = list->count + 1;
+static int fc_disconnect(sqlite3_vtab *vtab) {
+    sqlite3_free(vtab);
+    return SQLITE_OK;
+}
 
+static int fc_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info) {
+    int i, n = 1, idx_num = 0;
+    int cfield = -1, cbook = -1, citem = -1;
+    const struct sqlite3_index_constraint *c;
+
+    for (i = 0; i < info->nConstraint; i++) {
+        c = info->aConstraint + i;
+        if (!c->usable || c->op != SQLITE_INDEX_CONSTRAINT_EQ) continue;
+        switch (c->iColumn) {
+            case FC_COL_FIELD: if (cfield < 0) cfield = i; break;
+            case FC_COL_BOOK: if (cbook < 0) cbook = i; break;
+            case FC_COL_ITEM: if (citem < 0) citem = i; break;
+        }
+    }
+    // argv order in xFilter is always field, book, item
+    if (cfield >= 0) {
+        info->aConstraintUsage[cfield].argvIndex = n++;
+        info->aConstraintUsage[cfield].omit = 1;
+        idx_num |= 1;
+    }
+    if (cbook >= 0) {
+        info->aConstraintUsage[cbook].argvIndex = n++;
+        info->aConstraintUsage[cbook].omit = 1;
+        idx_num |= 2;
+    }
+    if (citem >= 0) {
+        info->aConstraintUsage[citem].argvIndex = n++;
+        info->aConstraintUsage[citem].omit = 1;
+        idx_num |= 4;
+    }
+    info->idxNum = idx_num;
+    if (!(idx_num & 1)) info->estimatedCost = 1e12; // without a field there are no rows
+    else if (idx_num & 2) info->estimatedCost = 10;  // binary search on book
+    else info->estimatedCost = 1e6;
+    return SQLITE_OK;
 }
 
+static int fc_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **ppCursor) {
+    FieldCacheCursor *cur;
 
-static void identifiers_concat_finalize(sqlite3_context *context) {
-    IdentifiersConcatList *list;
-    IdentifiersConcatItem *item;
-    char *ans, *pos;
-    size_t sz = 0, i;
+    cur = (FieldCacheCursor*)sqlite3_malloc(sizeof(*cur));
+    if (cur == NULL) return SQLITE_NOMEM;
+    memset(cur, 0, sizeof(*cur));
+    *ppCursor = &cur->base;
+    return SQLITE_OK;
+}
 
-    list = (IdentifiersConcatList*) sqlite3_aggregate_context(context, sizeof(*list));
-    if (list == NULL || list->vals == NULL || list->count < 1) return;
+static int fc_close(sqlite3_vtab_cursor *cursor) {
+    sqlite3_free(cursor);
+    return SQLITE_OK;
+}
 
-    for (i = 0; i < list->count; i++) {
-        sz += list->vals[i]->length;
+static void fc_skip_unmatched(FieldCacheCursor *cur) {
+    if (!cur->have_item) return;
+    while (cur->pos < cur->end && cur->map->pairs[cur->pos].item != cur->item)
+        cur->pos += 1;
+}
+
+static int fc_filter(sqlite3_vtab_cursor *cursor, int idx_num, const char *idx_str, int argc, sqlite3_value **argv) {
+    FieldCacheCursor *cur = (FieldCacheCursor*)cursor;
+    const unsigned char *name;
+    sqlite3_int64 book;
+    int n = 0, lo, hi, mid;
+
+    cur->map = NULL;
+    cur->pos = 0; cur->end = 0;
+    cur->have_item = 0;
+
+    if (idx_num & 1) {
+        name = sqlite3_value_text(argv[n]);
+        if (name != NULL) cur->map = field_map_find((const char*)name);
+        n += 1;
     }
-    sz += list->count; // Space for commas
-    ans = (char*)calloc(sz+2, sizeof(char));
-    if (ans == NULL) return;
+    if (cur->map != NULL) cur->end = cur->map->count;
+    if (idx_num & 2) {
+        book = sqlite3_value_int64(argv[n]);
+        n += 1;
+        if (cur->map != NULL) {
+            // Narrow [pos, end) to the book's run of pairs
+            lo = 0; hi = cur->map->count;
+            while (lo < hi) {
+                mid = lo + (hi - lo)/2;
+                if (cur->map->pairs[mid].book < book) lo = mid + 1;
+                else hi = mid;
+            }
+            cur->pos = lo;
+            hi = cur->map->count;
+            while (lo < hi) {
+                mid = lo + (hi - lo)/2;
+                if (cur->map->pairs[mid].book <= book) lo = mid + 1;
+                else hi = mid;
+            }
+            cur->end = lo;
+        }
+    }
+    if (idx_num & 4) {
+        cur->item = sqlite3_value_int64(argv[n]);
+        cur->have_item = 1;
+    }
+    fc_skip_unmatched(cur);
+    return SQLITE_OK;
+}
 
-    pos = ans;
+static int fc_next(sqlite3_vtab_cursor *cursor) {
+    FieldCacheCursor *cur = (FieldCacheCursor*)cursor;
+    cur->pos += 1;
+    fc_skip_unmatched(cur);
+    return SQLITE_OK;
+}
 
-    for (i = 0; i < list->count; i++) {
-        item = list->vals[i];
-        if (item == NULL || item->val == NULL) continue;
-        memcpy(pos, item->val, item->length);
-        pos += item->length;
-        *pos = ',';
-        pos += 1;
-        free(item->val);
-        free(item);
+static int fc_eof(sqlite3_vtab_cursor *cursor) {
+    FieldCacheCursor *cur = (FieldCacheCursor*)cursor;
+    return cur->pos >= cur->end;
+}
+
+static int fc_column(sqlite3_vtab_cursor *cursor, sqlite3_context *context, int col) {
+    FieldCacheCursor *cur = (FieldCacheCursor*)cursor;
+
+    switch (col) {
+        case FC_COL_BOOK:
+            sqlite3_result_int64(context, cur->map->pairs[cur->pos].book);
+            break;
+        case FC_COL_ITEM:
+            sqlite3_result_int64(context, cur->map->pairs[cur->pos].item);
+            break;
+        case FC_COL_FIELD:
+            sqlite3_result_text(context, cur->map->name, -1, SQLITE_TRANSIENT);
+            break;
+    }
+    return SQLITE_OK;
+}
+
+static int fc_rowid(sqlite3_vtab_cursor *cursor, sqlite3_int64 *pRowid) {
+    FieldCacheCursor *cur = (FieldCacheCursor*)cursor;
+    *pRowid = cur->pos;
+    return SQLITE_OK;
+}
+
+static sqlite3_module field_cache_module = {
+    0,              /* iVersion */
+    0,              /* xCreate - NULL makes the table eponymous only */
+    fc_connect,     /* xConnect */
+    fc_best_index,  /* xBestIndex */
+    fc_disconnect,  /* xDisconnect */
+    0,              /* xDestroy */
+    fc_open,        /* xOpen */
+    fc_close,       /* xClose */
+    fc_filter,      /* xFilter */
+    fc_next,        /* xNext */
+    fc_eof,         /* xEof */
+    fc_column,      /* xColumn */
+    fc_rowid,       /* xRowid */
+    0,              /* xUpdate */
+    0,              /* xBegin */
+    0,              /* xSync */
+    0,              /* xCommit */
+    0,              /* xRollback */
+    0,              /* xFindMethod */
+    0,              /* xRename */
+    0,              /* xSavepoint */
+    0,              /* xRelease */
+    0,              /* xRollbackTo */
+};
+
+// }}}
+
+// calibre_unicode collation {{{
+
+// ICU backed collation so that ORDER BY on title/author can sort unicode
+// text correctly inside SQLite's btree, instead of fetching every row out
+// and re-sorting in Python
+static int icu_collation_cmp(void *ucol, int llen, const void *left, int rlen, const void *right) {
+    UErrorCode status = U_ZERO_ERROR;
+    UCollationResult res;
+    int c, minlen;
+
+    res = ucol_strcollUTF8((UCollator*)ucol, (const char*)left, llen, (const char*)right, rlen, &status);
+    if (U_FAILURE(status)) {
+        // A collation must still impose a total order, fall back to a
+        // bytewise comparison
+        minlen = (llen < rlen) ? llen : rlen;
+        c = memcmp(left, right, minlen);
+        return (c != 0) ? c : llen - rlen;
+    }
+    switch (res) {
+        case UCOL_LESS: return -1;
+        case UCOL_GREATER: return 1;
+        default: return 0;
     }
-    *(pos-1) = 0; // Remove trailing comma
-    sqlite3_result_text(context, ans, -1, SQLITE_TRANSIENT);
-    free(ans);
-    free(list->vals);
 }
 
+static void icu_collation_close(void *ucol) { ucol_close((UCollator*)ucol); }
+
 // }}}
 
 MYEXPORT int sqlite3_extension_init(
     sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi){
+  UErrorCode status = U_ZERO_ERROR;
+  UCollator *collator;
   SQLITE_EXTENSION_INIT2(pApi);
   sqlite3_create_function(db, "sortconcat", 2, SQLITE_UTF8, NULL, NULL, sort_concat_step, sort_concat_finalize);
   sqlite3_create_function(db, "sortconcat_bar", 2, SQLITE_UTF8, NULL, NULL, sort_concat_step, sort_concat_finalize2);
   sqlite3_create_function(db, "sortconcat_amper", 2, SQLITE_UTF8, NULL, NULL, sort_concat_step, sort_concat_finalize3);
-  sqlite3_create_function(db, "identifiers_concat", 2, SQLITE_UTF8, NULL, NULL, identifiers_concat_step, identifiers_concat_finalize);
+  sqlite3_create_function(db, "sortconcat_presorted", 2, SQLITE_UTF8, NULL, NULL, sort_concat_step, sort_concat_finalize_presorted);
+  sqlite3_create_function(db, "identifiers_concat", 2, SQLITE_UTF8, NULL, NULL, identifiers_concat_step, concat_arena_finalize);
+  sqlite3_create_function(db, "concat", 1, SQLITE_UTF8, NULL, NULL, concat_step, concat_arena_finalize);
+  // The default locale collator, matching what calibre.utils.icu uses for
+  // its sort keys. If ICU fails the extension still loads, only the
+  // collation is unavailable.
+  collator = ucol_open(NULL, &status);
+  if (collator != NULL && !U_FAILURE(status)) {
+      if (sqlite3_create_collation_v2(db, "calibre_unicode", SQLITE_UTF8, collator,
+                  icu_collation_cmp, icu_collation_close) != SQLITE_OK)
+          // On failure the destructor is not invoked
+          ucol_close(collator);
+  } else if (collator != NULL) ucol_close(collator);
+  sqlite3_create_module(db, "field_cache", &field_cache_module, NULL);
   return 0;
 }
 
+static PyObject *
+sqlite_custom_set_field_map(PyObject *self, PyObject *args) {
+    char *name;
+    PyObject *pairs = Py_None, *fast = NULL, *item;
+    FieldPair *fp = NULL;
+    Py_ssize_t count, i;
+
+    if (!PyArg_ParseTuple(args, "s|O", &name, &pairs)) return NULL;
+
+    if (pairs == Py_None) {
+        field_map_set(name, NULL, 0);
+        Py_RETURN_NONE;
+    }
+
+    fast = PySequence_Fast(pairs, "pairs must be a sequence of (book, item) tuples");
+    if (fast == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(fast);
+    if (count > 0) {
+        fp = (FieldPair*)malloc(sizeof(FieldPair)*count);
+        if (fp == NULL) { Py_DECREF(fast); return PyErr_NoMemory(); }
+        for (i = 0; i < count; i++) {
+            item = PySequence_Fast_GET_ITEM(fast, i);
+            if (!PyTuple_Check(item) ||
+                !PyArg_ParseTuple(item, "LL", &fp[i].book, &fp[i].item)) {
+                if (!PyErr_Occurred()) PyErr_SetString(PyExc_TypeError,
+                        "pairs must be (book, item) tuples of integers");
+                free(fp); Py_DECREF(fast);
+                return NULL;
+            }
+        }
+        qsort(fp, count, sizeof(FieldPair), field_pair_cmp);
+    }
+    Py_DECREF(fast);
+    if (field_map_set(name, fp, (int)count) != 0) return PyErr_NoMemory();
+    Py_RETURN_NONE;
+}
+
 static PyObject *
 sqlite_custom_init_funcs(PyObject *self, PyObject *args) {
     Py_RETURN_NONE;
@@ -270,6 +558,14 @@ static PyMethodDef sqlite_custom_methods[] = {
         "init_funcs()\n\nInitialize module."
     },
 
+    {"set_field_map", sqlite_custom_set_field_map, METH_VARARGS,
+        "set_field_map(field, pairs=None)\n\n"
+        "Register the (book, item) pairs of a many-to-many field for the "
+        "field_cache virtual table, replacing any previous pairs for that "
+        "field. Pass None to remove the field. Must not be called while a "
+        "query using the table is running."
+    },
+
     {NULL, NULL, 0, NULL}
 };
 
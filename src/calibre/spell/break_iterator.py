@@ -5,46 +5,64 @@ from __future__ import absolute_import, division, print_function, unicode_litera
 __license__ = 'GPL v3'
 __copyright__ = '2014, Kovid Goyal <kovid at kovidgoyal.net>'
 
+from contextlib import contextmanager
 from threading import Lock
 
 from calibre.utils.icu import _icu
 from calibre.utils.localization import lang_as_iso639_1
 
-_iterators = {}
+_pool = {}
 _lock = Lock()
 
 
-def split_into_words(text, lang='en'):
+@contextmanager
+def pooled_iterator(lang):
+    ''' Checkout a word break iterator for lang from the pool, creating it if
+    needed. Unlike a single shared iterator, this allows many threads to
+    tokenize in parallel, each with its own iterator. '''
+    lang = lang_as_iso639_1(lang) or lang
     with _lock:
-        it = _iterators.get(lang, None)
-        if it is None:
-            it = _iterators[lang] = _icu.BreakIterator(_icu.UBRK_WORD, lang_as_iso639_1(lang) or lang)
+        try:
+            it = _pool[lang].pop()
+        except (KeyError, IndexError):
+            it = _icu.BreakIterator(_icu.UBRK_WORD, lang)
+    try:
+        yield it
+    finally:
+        with _lock:
+            _pool.setdefault(lang, []).append(it)
+
+
+def split_into_words(text, lang='en'):
+    with pooled_iterator(lang) as it:
         it.set_text(text)
         return [text[p:p+s] for p, s in it.split2()]
 
 
 def split_into_words_and_positions(text, lang='en'):
-    with _lock:
-        it = _iterators.get(lang, None)
-        if it is None:
-            it = _iterators[lang] = _icu.BreakIterator(_icu.UBRK_WORD, lang_as_iso639_1(lang) or lang)
+    with pooled_iterator(lang) as it:
         it.set_text(text)
         return it.split2()
 
 
+def split_into(text, buf, lang='en'):
+    ''' Write the (position, length) pairs for the words in text into the
+    writable int32 buffer buf, returning the number of words found. No
+    allocations are done per word, so this is the cheapest way to tokenize
+    large amounts of text. If the return value exceeds len(buf) // 2 the
+    buffer was too small and only the words that fit were stored. '''
+    with pooled_iterator(lang) as it:
+        it.set_text(text)
+        return it.split_into(buf)
+
+
 def index_of(needle, haystack, lang='en'):
-    with _lock:
-        it = _iterators.get(lang, None)
-        if it is None:
-            it = _iterators[lang] = _icu.BreakIterator(_icu.UBRK_WORD, lang_as_iso639_1(lang) or lang)
+    with pooled_iterator(lang) as it:
         it.set_text(haystack)
         return it.index(needle)
 
 
 def count_words(text, lang='en'):
-    with _lock:
-        it = _iterators.get(lang, None)
-        if it is None:
-            it = _iterators[lang] = _icu.BreakIterator(_icu.UBRK_WORD, lang_as_iso639_1(lang) or lang)
+    with pooled_iterator(lang) as it:
         it.set_text(text)
         return len(it.split2())
@@ -5,18 +5,18 @@ from __future__ import absolute_import, division, print_function, unicode_litera
 __license__ = 'GPL v3'
 __copyright__ = '2014, Kovid Goyal <kovid at kovidgoyal.net>'
 
-import os, glob, shutil, re, sys
+import os, glob, shutil, re, sys, errno, hashlib, mmap, struct, tempfile
 from collections import namedtuple, defaultdict
 from itertools import chain
 from functools import partial
 
 from calibre import prints
-from calibre.constants import plugins, config_dir
+from calibre.constants import plugins, config_dir, cache_dir
 from calibre.spell import parse_lang_code
 from calibre.utils.config import JSONConfig
 from calibre.utils.icu import capitalize
 from calibre.utils.localization import get_lang, get_system_locale
-from polyglot.builtins import iteritems, itervalues, unicode_type, filter
+from polyglot.builtins import iteritems, itervalues, unicode_type, filter, is_py3
 
 Dictionary = namedtuple('Dictionary', 'primary_locale locales dicpath affpath builtin name id')
 LoadedDictionary = namedtuple('Dictionary', 'primary_locale locales obj builtin name id')
@@ -162,12 +162,107 @@ def get_dictionary(locale, exact_match=False):
                 return d
 
 
-def load_dictionary(dictionary):
+# Loading a large dictionary (de_DE frami) costs tens of MB and hundreds of
+# milliseconds per process, most of it re-reading and re-encoding the .dic
+# and .aff files. The UTF-8 converted data is therefore cached in a single
+# file that every worker mmaps read-only and feeds straight to hunspell, so
+# N processes share one copy of the bytes in the OS page cache and skip the
+# conversion pass. The cache is invalidated via source sizes and mtimes
+# stored in its header. hunspell still builds its lookup tables per process,
+# those are pointer based structures that cannot be shared.
+DICTIONARY_CACHE_MAGIC = b'calibre-dictionary-cache\x01'
+DICTIONARY_CACHE_HEADER = b'<ddQQQQ'  # dic/aff mtimes, dic/aff sizes, dic/aff data lengths
+
+
+def dictionary_cache_path(dictionary):
+    key = hashlib.sha1(('%s\0%s' % (dictionary.dicpath, dictionary.affpath)).encode('utf-8')).hexdigest()
+    return os.path.join(cache_dir(), 'hunspell-dictionaries', key)
+
+
+def build_dictionary_cache(dictionary, path, st_dic, st_aff):
     from calibre.spell.import_from import convert_to_utf8
+    from calibre.utils.filenames import atomic_rename
     with open(dictionary.dicpath, 'rb') as dic, open(dictionary.affpath, 'rb') as aff:
-        dic_data, aff_data = dic.read(), aff.read()
-        dic_data, aff_data = convert_to_utf8(dic_data, aff_data)
-        obj = hunspell.Dictionary(dic_data, aff_data)
+        dic_data, aff_data = convert_to_utf8(dic.read(), aff.read())
+    try:
+        base = os.path.dirname(path)
+        try:
+            os.makedirs(base)
+        except EnvironmentError as e:
+            if e.errno != errno.EEXIST:
+                raise
+        fd, tname = tempfile.mkstemp(dir=base)
+        try:
+            with os.fdopen(fd, 'wb') as f:
+                f.write(DICTIONARY_CACHE_MAGIC)
+                f.write(struct.pack(DICTIONARY_CACHE_HEADER,
+                    st_dic.st_mtime, st_aff.st_mtime, st_dic.st_size, st_aff.st_size,
+                    len(dic_data), len(aff_data)))
+                f.write(dic_data), f.write(aff_data)
+            atomic_rename(tname, path)
+        except Exception:
+            try:
+                os.remove(tname)
+            except EnvironmentError:
+                pass
+            raise
+    except Exception:
+        pass  # the cache is only an optimization, loading must still succeed
+    return dic_data, aff_data
+
+
+def mmap_cached_dictionary(path, st_dic, st_aff):
+    ' Returns None if the cache file is missing, stale or corrupted '
+    try:
+        f = open(path, 'rb')
+    except EnvironmentError:
+        return None
+    with f:
+        m = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        dic_data = aff_data = view = None
+        try:
+            offset = len(DICTIONARY_CACHE_MAGIC) + struct.calcsize(DICTIONARY_CACHE_HEADER)
+            if len(m) < offset or m[:len(DICTIONARY_CACHE_MAGIC)] != DICTIONARY_CACHE_MAGIC:
+                return None
+            dic_mtime, aff_mtime, dic_size, aff_size, dic_len, aff_len = struct.unpack_from(
+                    DICTIONARY_CACHE_HEADER, m, len(DICTIONARY_CACHE_MAGIC))
+            if (dic_mtime, aff_mtime, dic_size, aff_size) != (
+                    st_dic.st_mtime, st_aff.st_mtime, st_dic.st_size, st_aff.st_size):
+                return None
+            if len(m) != offset + dic_len + aff_len:
+                return None
+            if is_py3:
+                view = memoryview(m)
+                dic_data = view[offset:offset + dic_len]
+                aff_data = view[offset + dic_len:offset + dic_len + aff_len]
+            else:
+                dic_data = buffer(m, offset, dic_len)  # noqa
+                aff_data = buffer(m, offset + dic_len, aff_len)  # noqa
+            return hunspell.Dictionary(dic_data, aff_data)
+        finally:
+            # hunspell has built its own tables by now, drop all views so the
+            # mapping can be closed
+            dic_data = aff_data = view = None
+            m.close()
+
+
+def load_dictionary(dictionary):
+    obj = None
+    try:
+        st_dic, st_aff = os.stat(dictionary.dicpath), os.stat(dictionary.affpath)
+        path = dictionary_cache_path(dictionary)
+        obj = mmap_cached_dictionary(path, st_dic, st_aff)
+        if obj is None:
+            dic_data, aff_data = build_dictionary_cache(dictionary, path, st_dic, st_aff)
+            obj = hunspell.Dictionary(dic_data, aff_data)
+    except Exception:
+        obj = None
+    if obj is None:
+        # Fall back to loading directly from the source files
+        from calibre.spell.import_from import convert_to_utf8
+        with open(dictionary.dicpath, 'rb') as dic, open(dictionary.affpath, 'rb') as aff:
+            dic_data, aff_data = convert_to_utf8(dic.read(), aff.read())
+            obj = hunspell.Dictionary(dic_data, aff_data)
     return LoadedDictionary(dictionary.primary_locale, dictionary.locales, obj, dictionary.builtin, dictionary.name, dictionary.id)
 
 
@@ -379,6 +474,37 @@ class Dictionaries(object):
             self.word_cache[key] = ans
         return ans
 
+    def recognized_many(self, words, locale=None):
+        ''' Check a batch of words in one call, returning the results as a
+        bitmap (bytes) with one bit per word, set iff the word is recognized.
+        Used by the syntax highlighter speedup module so that checking all the
+        words of a line costs a single call into python. '''
+        locale = locale or self.default_locale
+        ans = bytearray((len(words) + 7) // 8)
+        recognized = self.recognized
+        for i, word in enumerate(words):
+            if recognized(word, locale):
+                ans[i >> 3] |= 1 << (i & 7)
+        return bytes(ans)
+
+    def suggestions_many(self, words):
+        ''' Precompute suggestions for a batch of (word, locale) pairs. The
+        results go into the suggestion cache of the underlying dictionaries,
+        so that later suggestions() calls for these words are answered
+        instantly. The suggestion search runs with the GIL released and the
+        dictionaries lock internally, making this safe to call from a worker
+        thread while the results are consumed on the GUI thread. '''
+        by_dictionary = defaultdict(list)
+        for word, locale in words:
+            d = self.dictionary_for_locale(locale or self.default_locale)
+            if d is not None:
+                by_dictionary[d.obj].append(unicode_type(word).replace('\u2010', '-'))
+        for obj, batch in iteritems(by_dictionary):
+            try:
+                obj.suggest_many(tuple(batch))
+            except Exception:
+                pass
+
     def suggestions(self, word, locale=None):
         locale = locale or self.default_locale
         d = self.dictionary_for_locale(locale)
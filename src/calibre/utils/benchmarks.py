@@ -0,0 +1,222 @@
+#!/usr/bin/env python2
+# vim:fileencoding=utf-8
+# License: GPLv3 Copyright: 2026, Kovid Goyal <kovid at kovidgoyal.net>
+
+from __future__ import absolute_import, division, print_function, unicode_literals
+
+'''
+Microbenchmarks for the native extensions, run via python setup.py
+benchmark. Every benchmark works on a deterministic, seeded corpus
+generated in memory, so timings are comparable between runs and between
+releases without shipping binary corpus files. Results are emitted as
+JSON so they can be archived and diffed across releases.
+'''
+
+import json
+import platform
+import random
+import string
+import sys
+import time
+from collections import OrderedDict
+
+from calibre.utils.monotonic import monotonic
+from polyglot.builtins import iteritems, range, unicode_type
+
+BENCHMARKS = OrderedDict()
+CORPUS_SEED = 20260830
+
+
+class SkipBenchmark(Exception):
+    pass
+
+
+def benchmark(name):
+    def register(func):
+        BENCHMARKS[name] = func
+        return func
+    return register
+
+
+def time_repeats(func, repeats):
+    ' Time repeated runs of func, reporting best and mean wall clock seconds '
+    runs = []
+    for i in range(repeats):
+        st = monotonic()
+        func()
+        runs.append(monotonic() - st)
+    return {'best': min(runs), 'mean': sum(runs) / len(runs), 'runs': runs}
+
+
+def random_words(rnd, count, length=8):
+    letters = string.ascii_lowercase
+    return [''.join(rnd.choice(letters) for i in range(length)) for j in range(count)]
+
+
+def path_corpus(num=2000):
+    rnd = random.Random(CORPUS_SEED)
+    words = random_words(rnd, 200)
+    return tuple(
+        '/'.join(rnd.choice(words) for i in range(rnd.randint(2, 6))) + '.html'
+        for j in range(num)
+    )
+
+
+def text_corpus(size=4 * 1024 * 1024):
+    rnd = random.Random(CORPUS_SEED)
+    words = random_words(rnd, 500, length=6)
+    buf = []
+    sz = 0
+    while sz < size:
+        w = rnd.choice(words)
+        buf.append(w)
+        sz += len(w) + 1
+    return (' '.join(buf))[:size].encode('utf-8')
+
+
+@benchmark('matcher')
+def bench_matcher(repeats):
+    ' calculate_scores() in the C matcher over a corpus of file paths '
+    from calibre.utils.matcher import CScorer
+    items = path_corpus()
+    scorer = CScorer(items)
+
+    def run():
+        for score, positions in scorer('aei'):
+            pass
+    return time_repeats(run, repeats)
+
+
+@benchmark('icu_sort_key')
+def bench_icu_sort_key(repeats):
+    ' icu.sort_key() over generated book titles '
+    from calibre.utils.icu import sort_key
+    rnd = random.Random(CORPUS_SEED)
+    titles = [' '.join(random_words(rnd, 4)) for i in range(20000)]
+
+    def run():
+        for t in titles:
+            sort_key(t)
+    return time_repeats(run, repeats)
+
+
+@benchmark('tokenize_flat')
+def bench_tokenize_flat(repeats):
+    ' tinycss tokenize_flat() over generated CSS '
+    from tinycss.tokenizer import tokenize_flat
+    rnd = random.Random(CORPUS_SEED)
+    rules = []
+    for cls in random_words(rnd, 500):
+        rules.append('.%s { color: #%06x; margin: %dpx 0 %dpx 1em; font-family: "%s", serif }' % (
+            cls, rnd.randint(0, 0xffffff), rnd.randint(0, 20), rnd.randint(0, 20), rnd.choice(cls)))
+    css = '\n'.join(rules)
+
+    def run():
+        tokenize_flat(css)
+    return time_repeats(run, repeats)
+
+
+@benchmark('imageops')
+def bench_imageops(repeats):
+    ' imageops filters (blur, despeckle, resize) on a generated image '
+    try:
+        from calibre.utils.img import (
+            despeckle_image, gaussian_blur_image, image_from_data, image_to_data, resize_image
+        )
+    except Exception as e:
+        raise SkipBenchmark('imageops unavailable: %s' % e)
+    rnd = random.Random(CORPUS_SEED)
+    # A deterministic noisy PPM image, decoded once up front
+    w, h = 600, 800
+    header = ('P6 %d %d 255\n' % (w, h)).encode('ascii')
+    if sys.version_info.major >= 3:
+        pixels = bytes(bytearray(rnd.getrandbits(8) for i in range(w * h * 3)))
+    else:
+        pixels = b''.join(chr(rnd.getrandbits(8)) for i in range(w * h * 3))
+    try:
+        img = image_from_data(header + pixels)
+    except Exception as e:
+        raise SkipBenchmark('cannot decode image (no GUI libraries?): %s' % e)
+
+    def run():
+        gaussian_blur_image(img)
+        despeckle_image(img)
+        resize_image(img, 300, 400)
+    return time_repeats(run, repeats)
+
+
+@benchmark('palmdoc')
+def bench_palmdoc(repeats):
+    ' palmdoc compress_doc() over 64KB text records '
+    from calibre.ebooks.compression.palmdoc import compress_doc
+    raw = text_corpus(512 * 1024)
+    records = [raw[i:i + 0x10000] for i in range(0, len(raw), 0x10000)]
+
+    def run():
+        for rec in records:
+            compress_doc(rec)
+    return time_repeats(run, repeats)
+
+
+@benchmark('lzx')
+def bench_lzx(repeats):
+    ' LZX compression as used by the LIT writer '
+    from calibre.ebooks.lit.lzx import Compressor
+    data = text_corpus(1024 * 1024)
+
+    def run():
+        Compressor(17).compress(data, flush=True)
+    return time_repeats(run, repeats)
+
+
+@benchmark('lzma_xz')
+def bench_lzma_xz(repeats):
+    ' xz compression via the lzma binding '
+    import io
+    from lzma.xz import compress
+    data = text_corpus(1024 * 1024)
+
+    def run():
+        compress(data, outfile=io.BytesIO(), level=5)
+    return time_repeats(run, repeats)
+
+
+def run_benchmarks(names=None, repeats=5, outfile=None):
+    results = OrderedDict()
+    for name, func in iteritems(BENCHMARKS):
+        if names and name not in names:
+            continue
+        print('Running', name, '...', end=' ')
+        sys.stdout.flush()
+        try:
+            res = func(repeats)
+        except SkipBenchmark as e:
+            res = {'skipped': unicode_type(e)}
+            print('skipped (%s)' % e)
+        else:
+            print('best: %.4fs mean: %.4fs' % (res['best'], res['mean']))
+        results[name] = res
+
+    from calibre.constants import __version__
+    report = OrderedDict((
+        ('calibre_version', __version__),
+        ('python_version', platform.python_version()),
+        ('platform', platform.platform()),
+        ('timestamp', time.strftime('%Y-%m-%dT%H:%M:%S')),
+        ('repeats', repeats),
+        ('benchmarks', results),
+    ))
+    data = json.dumps(report, indent=2, sort_keys=False)
+    if isinstance(data, bytes):
+        data = data.decode('utf-8')
+    if outfile:
+        with open(outfile, 'wb') as f:
+            f.write(data.encode('utf-8'))
+        print('Timings written to', outfile)
+    else:
+        print(data)
+    return report
+
+
+if __name__ == '__main__':
+    run_benchmarks(set(sys.argv[1:]) or None)
@@ -0,0 +1,165 @@
+/*
+ * calibre_alloc.h
+ * Copyright (C) 2026 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ *
+ * Header-only arena and object pool allocators shared by the native
+ * modules, so that allocation discipline (and its performance) is not
+ * reinvented per module.
+ *
+ * An Arena hands out memory from a single geometrically grown buffer.
+ * There are two usage patterns:
+ *
+ *  - reserve() the worst case up front, then carve() pieces out of it.
+ *    Carved pointers stay valid until the next reset(), so this is the
+ *    fast path for scratch memory that is reused between operations
+ *    (reset does not free, the arena keeps its steady-state size).
+ *    carve() never grows the arena, as growing would relocate earlier
+ *    carvings.
+ *
+ *  - append() data byte-wise, growing as needed. Only the arena buffer
+ *    itself may be held onto, as growth relocates it.
+ *
+ * A Pool hands out fixed-size objects from arena-style chunks with a
+ * free list, for node-churn workloads where objects are released in
+ * arbitrary order.
+ *
+ * Neither allocator does any locking: an arena or pool must be owned by
+ * a single thread at a time. The intended fast path for threaded code
+ * is one allocator per worker, as in matcher.c.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define CALIBRE_ALLOC_UNUSED
+#else
+#define CALIBRE_ALLOC_UNUSED __attribute__((unused))
+#endif
+
+#define ARENA_ALIGN 16
+
+typedef struct {
+    char *buf;
+    size_t cap, used;
+} Arena;
+
+static CALIBRE_ALLOC_UNUSED void arena_free(Arena *arena) {
+    if (arena->buf != NULL) free(arena->buf);
+    arena->buf = NULL; arena->cap = 0; arena->used = 0;
+}
+
+static CALIBRE_ALLOC_UNUSED void arena_reset(Arena *arena) { arena->used = 0; }
+
+/* Ensure the arena is at least sz bytes large. May only be called on a
+ * freshly reset arena as growing relocates the buffer. Returns 0 on
+ * allocation failure. */
+static CALIBRE_ALLOC_UNUSED int arena_reserve(Arena *arena, size_t sz) {
+    char *buf = NULL;
+    if (sz <= arena->cap) return 1;
+    buf = (char*)realloc(arena->buf, sz);
+    if (buf == NULL) return 0;
+    arena->buf = buf; arena->cap = sz;
+    return 1;
+}
+
+/* Carve sz bytes out of previously reserved space, NULL if the reserve
+ * was too small. Carved memory is aligned and has calloc() semantics. */
+static CALIBRE_ALLOC_UNUSED void* arena_carve(Arena *arena, size_t sz) {
+    void *ans = NULL;
+    sz = (sz + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+    if (arena->used + sz > arena->cap) return NULL;
+    ans = arena->buf + arena->used;
+    arena->used += sz;
+    memset(ans, 0, sz);
+    return ans;
+}
+
+/* Append sz bytes to the arena, growing it geometrically as needed.
+ * Returns 0 on allocation failure, in which case the arena is
+ * unchanged. */
+static CALIBRE_ALLOC_UNUSED int arena_append(Arena *arena, const void *data, size_t sz) {
+    char *nbuf;
+    size_t ncap;
+
+    if (arena->used + sz > arena->cap) {
+        ncap = (arena->cap > 0) ? arena->cap : 4096;
+        while (ncap < arena->used + sz) ncap *= 2;
+        nbuf = (char*)realloc(arena->buf, ncap);
+        if (nbuf == NULL) return 0;
+        arena->buf = nbuf;
+        arena->cap = ncap;
+    }
+    memcpy(arena->buf + arena->used, data, sz);
+    arena->used += sz;
+    return 1;
+}
+
+/* Object pool {{{ */
+
+typedef struct PoolChunk {
+    struct PoolChunk *next;
+    /* objects follow */
+} PoolChunk;
+
+typedef struct {
+    size_t obj_size, objs_per_chunk;
+    void *free_list;
+    PoolChunk *chunks;
+} Pool;
+
+static CALIBRE_ALLOC_UNUSED void pool_init(Pool *pool, size_t obj_size, size_t objs_per_chunk) {
+    /* Freed objects store the free list link in their first bytes */
+    if (obj_size < sizeof(void*)) obj_size = sizeof(void*);
+    obj_size = (obj_size + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+    pool->obj_size = obj_size;
+    pool->objs_per_chunk = (objs_per_chunk > 0) ? objs_per_chunk : 64;
+    pool->free_list = NULL;
+    pool->chunks = NULL;
+}
+
+static CALIBRE_ALLOC_UNUSED void* pool_alloc(Pool *pool) {
+    PoolChunk *chunk;
+    char *objs;
+    size_t i;
+    void *ans;
+
+    if (pool->free_list == NULL) {
+        chunk = (PoolChunk*)malloc(ARENA_ALIGN + pool->obj_size * pool->objs_per_chunk);
+        if (chunk == NULL) return NULL;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+        objs = ((char*)chunk) + ARENA_ALIGN;
+        for (i = 0; i < pool->objs_per_chunk; i++) {
+            *(void**)(objs + i * pool->obj_size) = pool->free_list;
+            pool->free_list = objs + i * pool->obj_size;
+        }
+    }
+    ans = pool->free_list;
+    pool->free_list = *(void**)ans;
+    memset(ans, 0, pool->obj_size);
+    return ans;
+}
+
+static CALIBRE_ALLOC_UNUSED void pool_free_obj(Pool *pool, void *obj) {
+    if (obj == NULL) return;
+    *(void**)obj = pool->free_list;
+    pool->free_list = obj;
+}
+
+static CALIBRE_ALLOC_UNUSED void pool_free_all(Pool *pool) {
+    PoolChunk *chunk = pool->chunks, *next;
+    while (chunk != NULL) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    pool->chunks = NULL;
+    pool->free_list = NULL;
+}
+
+/* }}} */
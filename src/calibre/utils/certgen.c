@@ -6,6 +6,7 @@
  */
 
 #define UNICODE
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
 #include <openssl/rand.h>
@@ -69,6 +70,36 @@ error:
     return ans;
 }
 
+/* Deserialize a PEM private key, as produced by serialize_rsa_key(), so
+ * that a keypair generated ahead of time (for example at install time)
+ * can be loaded from a cache instead of being generated on first use. */
+static PyObject* load_rsa_key(PyObject *self, PyObject *args) {
+    PyObject *ans = NULL;
+    char *pem = NULL, *password = NULL;
+    Py_ssize_t sz = 0;
+    BIO *mem = NULL;
+    EVP_PKEY *key = NULL;
+    RSA *KeyPair = NULL;
+
+#if PY_MAJOR_VERSION >= 3
+    if(!PyArg_ParseTuple(args, "y#|z", &pem, &sz, &password)) return NULL;
+#else
+    if(!PyArg_ParseTuple(args, "s#|z", &pem, &sz, &password)) return NULL;
+#endif
+    mem = BIO_new_mem_buf(pem, (int)sz);
+    if (!mem) return set_error("BIO_new_mem_buf");
+    key = PEM_read_bio_PrivateKey(mem, NULL, NULL, (password && *password) ? password : NULL);
+    if (!key) { set_error("PEM_read_bio_PrivateKey"); goto error; }
+    KeyPair = EVP_PKEY_get1_RSA(key);
+    if (!KeyPair) { set_error("EVP_PKEY_get1_RSA"); goto error; }
+    ans = PyCapsule_New(KeyPair, NULL, free_rsa_keypair);
+    if (!ans) { PyErr_NoMemory(); RSA_free(KeyPair); }
+error:
+    if (key) EVP_PKEY_free(key);
+    BIO_free(mem);
+    return ans;
+}
+
 #ifdef _WIN32
 static int add_entry(X509_NAME *Name, const char *field, const char *bytes) {
 #else
@@ -280,7 +311,7 @@ static PyObject* serialize_cert(PyObject *self, PyObject *args) {
     PyObject *capsule = NULL, *ans = NULL;
     X509 *cert = NULL;
     BIO *mem = NULL;
-    long sz = 0;
+    Py_ssize_t sz = 0;
     char *p = NULL;
 
     if(!PyArg_ParseTuple(args, "O", &capsule)) return NULL;
@@ -301,7 +332,7 @@ static PyObject* cert_info(PyObject *self, PyObject *args) {
     PyObject *capsule = NULL, *ans = NULL;
     X509 *cert = NULL;
     BIO *mem = NULL;
-    long sz = 0;
+    Py_ssize_t sz = 0;
     char *p = NULL;
 
     if(!PyArg_ParseTuple(args, "O", &capsule)) return NULL;
@@ -324,7 +355,7 @@ static PyObject* serialize_rsa_key(PyObject *self, PyObject *args) {
     EVP_PKEY *key = NULL;
     RSA *keypair = NULL;
     BIO *mem = NULL;
-    long sz = 0;
+    Py_ssize_t sz = 0;
     int ok = 0;
     char *p = NULL;
 
@@ -355,6 +386,10 @@ static PyMethodDef certgen_methods[] = {
         "create_rsa_keypair(size)\n\nCreate a RSA keypair of the specified size"
     },
 
+    {"load_rsa_key", load_rsa_key, METH_VARARGS,
+        "load_rsa_key(pem, [password])\n\nLoad a keypair from a PEM bytestring, as produced by serialize_rsa_key()"
+    },
+
     {"create_rsa_cert_req", create_rsa_cert_req, METH_VARARGS,
         "create_rsa_cert_req(keypair, alt_names, common_name, country, state, locality, org, org_unit, email_address)\n\nCreate a certificate signing request."
     },
@@ -5,7 +5,10 @@ from __future__ import absolute_import, division, print_function, unicode_litera
 __license__ = 'GPL v3'
 __copyright__ = '2015, Kovid Goyal <kovid at kovidgoyal.net>'
 
+import os
 import socket
+from threading import Event, Thread
+
 from calibre.constants import plugins
 from polyglot.builtins import unicode_type
 
@@ -18,6 +21,73 @@ def create_key_pair(size=2048):
     return certgen.create_rsa_keypair(size)
 
 
+class KeyPairFuture(object):
+
+    '''
+    Completion future for a keypair being generated on a worker thread.
+    The C level generation releases the GIL, so the rest of startup can
+    proceed while the key is computed.
+    '''
+
+    def __init__(self, size):
+        self._done = Event()
+        self._result = self._error = None
+        t = Thread(name='KeyPairGen', target=self._work, args=(size,))
+        t.daemon = True
+        t.start()
+
+    def _work(self, size):
+        try:
+            self._result = create_key_pair(size)
+        except Exception as e:
+            self._error = e
+        finally:
+            self._done.set()
+
+    def done(self):
+        return self._done.is_set()
+
+    def result(self, timeout=None):
+        if not self._done.wait(timeout):
+            raise EnvironmentError('Timed out waiting for keypair generation')
+        if self._error is not None:
+            raise self._error
+        return self._result
+
+
+def create_key_pair_async(size=2048):
+    return KeyPairFuture(size)
+
+
+def load_key_pair(pem_data, password=None):
+    if isinstance(pem_data, unicode_type):
+        pem_data = pem_data.encode('utf-8')
+    return certgen.load_rsa_key(pem_data, password)
+
+
+def pregenerate_key_pair(cache_path, size=2048):
+    ''' Generate a keypair and serialize it into cache_path, for use at
+    install time so that first server start does not stall on key
+    generation. '''
+    data = serialize_key(create_key_pair(size))
+    if isinstance(data, unicode_type):
+        data = data.encode('utf-8')
+    tpath = cache_path + '.tmp'
+    with open(tpath, 'wb') as f:
+        f.write(data)
+    os.rename(tpath, cache_path)
+
+
+def key_pair_from_cache(cache_path, size=2048):
+    ''' Load a keypair written by pregenerate_key_pair(), generating a
+    fresh one if the cache is missing or unreadable. '''
+    try:
+        with open(cache_path, 'rb') as f:
+            return load_key_pair(f.read())
+    except Exception:
+        return create_key_pair(size)
+
+
 def create_cert_request(
     key_pair, common_name,
     country='IN', state='Maharashtra', locality='Mumbai', organization=None,
@@ -74,13 +144,17 @@ def create_server_cert(
         prefix = 'IP' if is_ip else 'DNS'
         alt_names = ('{}:{}'.format(prefix, domain_or_ip),)
 
+    # Generate the server key in the background while the CA key is
+    # generated on this thread (both release the GIL)
+    pkey_future = create_key_pair_async(key_size)
+
     # Create the Certificate Authority
     cakey = create_key_pair(key_size)
     careq = create_cert_request(cakey, ca_name, basic_constraints='CA:TRUE')
     cacert = create_ca_cert(careq, cakey)
 
     # Create the server certificate issued by the newly created CA
-    pkey = create_key_pair(key_size)
+    pkey = pkey_future.result()
     req = create_cert_request(pkey, domain_or_ip, country, state, locality, organization, organizational_unit, email_address, alt_names)
     cert = create_cert(req, cacert, cakey, expire=expire)
 
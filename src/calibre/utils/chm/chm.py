@@ -213,6 +213,7 @@ class CHMFile:
     encoding = None
     lcid = None
     binaryindex = None
+    _byte_path = None
 
     def __init__(self):
         self.searchable = 0
@@ -233,6 +234,14 @@ class CHMFile:
         if self.file is None:
             return 0
 
+        # chmlib only caches five decompressed LZX blocks by default, which
+        # forces it to re-read and re-decompress blocks constantly when
+        # files are accessed in resolve order. 64 blocks (2MB at the usual
+        # 32KB block size) is enough to hold the working set of a typical
+        # conversion.
+        chmlib.chm_set_param(self.file, chmlib.CHM_PARAM_MAX_BLOCKS_CACHED, 64)
+
+        self._byte_path = path
         self.filename = archiveName
         self.GetArchiveInfo()
 
@@ -247,6 +256,7 @@ class CHMFile:
             chmlib.chm_close(self.file)
             self.file = None
             self.filename = ''
+            self._byte_path = None
             self.title = ""
             self.home = "/"
             self.index = None
@@ -403,10 +413,31 @@ class CHMFile:
                 st = 0
             else:
                 st = long_type(start)
+            if (st == 0 and len == ui.length and len >= (1 << 24) and
+                    self._byte_path is not None):
+                # decode the LZX reset segments of very large objects on
+                # all cores; each worker opens its own handle on the file
+                try:
+                    from calibre import detect_ncpus
+                    return (len, chmlib.retrieve_object_parallel(
+                        self._byte_path, ui, detect_ncpus()))
+                except Exception:
+                    pass  # fall back to the serial read
             return chmlib.chm_retrieve_object(self.file, ui, st, len)
         else:
             return (0, '')
 
+    def GetAllFiles(self):
+        '''Retrieves the contents of every file in the archive.
+        This function enumerates the archive once and reads the files in
+        order of their location in the compressed section, so each LZX
+        block is only decompressed once. It returns a dictionary mapping
+        the path of every file to its contents.
+        '''
+        if self.file:
+            return chmlib.extract_all(self.file)
+        return {}
+
     def IsSearchable(self):
         '''Indicates if the full-text search is available for this
         archive - this flag is updated when GetArchiveInfo is called'''
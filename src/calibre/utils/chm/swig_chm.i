@@ -23,6 +23,7 @@
 */
 #include "chm_lib.h"
 #include <stdio.h>
+#include <pythread.h>
 
 static PyObject *my_callback = NULL;
 
@@ -75,8 +76,292 @@ int dummy_enumerator (struct chmFile *h,
     }
     return 0;
  }
+
+/* Context used to collect unit infos without entering Python, so the
+ * enumeration can run with the GIL released */
+typedef struct {
+    struct chmUnitInfo *units;
+    size_t count;
+    size_t capacity;
+} extract_all_ctx;
+
+static int
+collect_enumerator(struct chmFile *h, struct chmUnitInfo *ui, void *context) {
+    extract_all_ctx *ctx = (extract_all_ctx *) context;
+    size_t pl = strlen(ui->path);
+    if (pl == 0 || ui->path[pl - 1] == '/')  /* skip directories */
+        return CHM_ENUMERATOR_CONTINUE;
+    if (ctx->count == ctx->capacity) {
+        size_t ncap = ctx->capacity ? 2 * ctx->capacity : 256;
+        struct chmUnitInfo *tmp = (struct chmUnitInfo *)
+            realloc(ctx->units, ncap * sizeof(struct chmUnitInfo));
+        if (tmp == NULL) return CHM_ENUMERATOR_FAILURE;
+        ctx->units = tmp;
+        ctx->capacity = ncap;
+    }
+    ctx->units[ctx->count++] = *ui;
+    return CHM_ENUMERATOR_CONTINUE;
+}
+
+/* Retrieving objects in ascending order of their start offset within each
+ * space means every LZX reset segment is decompressed exactly once:
+ * chmlib's internal block cache only thrashes on out of order access. */
+static int
+compare_units(const void *a, const void *b) {
+    const struct chmUnitInfo *ua = (const struct chmUnitInfo *) a;
+    const struct chmUnitInfo *ub = (const struct chmUnitInfo *) b;
+    if (ua->space != ub->space) return ua->space < ub->space ? -1 : 1;
+    if (ua->start != ub->start) return ua->start < ub->start ? -1 : 1;
+    return 0;
+}
+
+static PyObject *
+py_extract_all(PyObject *self, PyObject *args) {
+    PyObject *py_h, *ans = NULL, *key, *val;
+    void *argp = NULL;
+    struct chmFile *h;
+    extract_all_ctx ctx = {NULL, 0, 0};
+    unsigned char **bufs = NULL;
+    size_t i;
+    int enum_ret, nomem = 0;
+
+    if (!PyArg_ParseTuple(args, "O:extract_all", &py_h)) return NULL;
+    if (!SWIG_IsOK(SWIG_ConvertPtr(py_h, &argp, SWIGTYPE_p_chmFile, 0))) {
+        PyErr_SetString(PyExc_TypeError,
+                "extract_all() argument must be a chmFile");
+        return NULL;
+    }
+    h = (struct chmFile *) argp;
+
+    Py_BEGIN_ALLOW_THREADS
+    enum_ret = chm_enumerate(h, CHM_ENUMERATE_NORMAL, collect_enumerator, &ctx);
+    Py_END_ALLOW_THREADS
+    if (enum_ret == CHM_ENUMERATOR_FAILURE) {
+        free(ctx.units);
+        PyErr_SetString(PyExc_RuntimeError,
+                "Failed to enumerate the contents of the CHM file");
+        return NULL;
+    }
+
+    bufs = (unsigned char **) calloc(ctx.count ? ctx.count : 1,
+                                     sizeof(unsigned char *));
+    if (bufs == NULL) { free(ctx.units); return PyErr_NoMemory(); }
+
+    Py_BEGIN_ALLOW_THREADS
+    qsort(ctx.units, ctx.count, sizeof(struct chmUnitInfo), compare_units);
+    for (i = 0; i < ctx.count; i++) {
+        struct chmUnitInfo *ui = &ctx.units[i];
+        LONGUINT64 off = 0;
+        if (ui->length > (LONGUINT64) PY_SSIZE_T_MAX) continue;
+        bufs[i] = (unsigned char *) malloc(ui->length ? ui->length : 1);
+        if (bufs[i] == NULL) { nomem = 1; break; }
+        while (off < ui->length) {
+            LONGINT64 got = chm_retrieve_object(h, ui, bufs[i] + off, off,
+                                                ui->length - off);
+            if (got <= 0) break;
+            off += (LONGUINT64) got;
+        }
+        if (off != ui->length) {
+            /* unreadable entry: leave it out, as per file extraction
+             * skips such files too */
+            free(bufs[i]); bufs[i] = NULL;
+        }
+    }
+    Py_END_ALLOW_THREADS
+
+    if (nomem) { PyErr_NoMemory(); goto done; }
+    ans = PyDict_New();
+    if (ans == NULL) goto done;
+    for (i = 0; i < ctx.count; i++) {
+        if (bufs[i] == NULL) continue;
+        /* paths are byte strings, like everywhere else in this module */
+        key = PyBytes_FromString(ctx.units[i].path);
+        val = PyBytes_FromStringAndSize((const char *) bufs[i],
+                (Py_ssize_t) ctx.units[i].length);
+        if (key == NULL || val == NULL || PyDict_SetItem(ans, key, val) != 0) {
+            Py_XDECREF(key); Py_XDECREF(val); Py_DECREF(ans); ans = NULL;
+            goto done;
+        }
+        Py_DECREF(key); Py_DECREF(val);
+    }
+
+done:
+    for (i = 0; i < ctx.count; i++) free(bufs[i]);
+    free(bufs);
+    free(ctx.units);
+    return ans;
+}
+
+/* Parallel retrieval of one large object. LZX reset intervals are
+ * independently decodable, so disjoint spans of the same object can be
+ * decompressed concurrently - but a chmFile handle is not thread safe
+ * (shared descriptor, decoder state and block cache), so every worker
+ * opens its own handle on the same file. Spans are aligned to the 0x8000
+ * byte LZX frame size and kept large, so the redundant decode from the
+ * reset point preceding each span stays a small fraction of the work. */
+
+#define CHM_SPAN_ALIGN 0x8000
+#define CHM_SPAN_MIN (4 * 1024 * 1024)
+
+typedef struct chm_span_task {
+    LONGUINT64 start;
+    LONGUINT64 length;
+    int error; /* 1 = could not open the file, 2 = short read */
+} chm_span_task;
+
+typedef struct chm_span_queue {
+    chm_span_task *tasks;
+    Py_ssize_t count;
+    Py_ssize_t next;
+    int active_workers;
+    const char *filename;
+    const struct chmUnitInfo *ui;
+    unsigned char *out;
+    PyThread_type_lock mutex;
+    PyThread_type_lock done;
+} chm_span_queue;
+
+static void
+retrieve_spans_worker(void *arg) {
+    chm_span_queue *queue = (chm_span_queue *)arg;
+    chm_span_task *task;
+    struct chmFile *h;
+    struct chmUnitInfo ui;
+    int last;
+
+    h = chm_open(queue->filename);
+    ui = *queue->ui;
+
+    for (;;) {
+        PyThread_acquire_lock(queue->mutex, 1);
+        task = (queue->next < queue->count) ?
+            &queue->tasks[queue->next++] : NULL;
+        PyThread_release_lock(queue->mutex);
+        if (task == NULL) break;
+        if (h == NULL) { task->error = 1; continue; }
+        {
+            LONGUINT64 off = 0;
+            while (off < task->length) {
+                LONGINT64 got = chm_retrieve_object(h, &ui,
+                        queue->out + task->start + off,
+                        task->start + off, task->length - off);
+                if (got <= 0) break;
+                off += (LONGUINT64) got;
+            }
+            if (off != task->length) task->error = 2;
+        }
+    }
+    if (h != NULL) chm_close(h);
+
+    PyThread_acquire_lock(queue->mutex, 1);
+    last = (--queue->active_workers == 0);
+    PyThread_release_lock(queue->mutex);
+    /* The queue must not be touched after signalling done */
+    if (last) PyThread_release_lock(queue->done);
+}
+
+static PyObject *
+py_retrieve_object_parallel(PyObject *self, PyObject *args) {
+    PyObject *py_ui, *ans = NULL;
+    const char *filename = NULL;
+    void *argp = NULL;
+    struct chmUnitInfo *ui;
+    chm_span_queue queue;
+    LONGUINT64 length, chunk, start;
+    Py_ssize_t i, nspans;
+    int threads = 0, spawned, error = 0;
+
+#if PY_MAJOR_VERSION >= 3
+#define CHM_PATH_FMT "yO|i:retrieve_object_parallel"
+#else
+#define CHM_PATH_FMT "sO|i:retrieve_object_parallel"
+#endif
+    if (!PyArg_ParseTuple(args, CHM_PATH_FMT, &filename, &py_ui, &threads))
+        return NULL;
+    if (!SWIG_IsOK(SWIG_ConvertPtr(py_ui, &argp, SWIGTYPE_p_chmUnitInfo, 0))) {
+        PyErr_SetString(PyExc_TypeError,
+                "retrieve_object_parallel() second argument must be a chmUnitInfo");
+        return NULL;
+    }
+    ui = (struct chmUnitInfo *) argp;
+    length = ui->length;
+    if (length > (LONGUINT64) PY_SSIZE_T_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "CHM object too large");
+        return NULL;
+    }
+    ans = PyBytes_FromStringAndSize(NULL, (Py_ssize_t) length);
+    if (ans == NULL || length == 0) return ans;
+
+    /* Spans no smaller than CHM_SPAN_MIN, aligned to the LZX frame size */
+    chunk = length / (threads < 1 ? 1 : (LONGUINT64) threads);
+    chunk += CHM_SPAN_ALIGN - 1; chunk -= chunk % CHM_SPAN_ALIGN;
+    if (chunk < CHM_SPAN_MIN) chunk = CHM_SPAN_MIN;
+    nspans = (Py_ssize_t) ((length + chunk - 1) / chunk);
+
+    queue.tasks = (chm_span_task *) PyMem_Malloc(sizeof(chm_span_task) * nspans);
+    if (queue.tasks == NULL) { Py_DECREF(ans); return PyErr_NoMemory(); }
+    for (i = 0, start = 0; i < nspans; i++, start += chunk) {
+        queue.tasks[i].start = start;
+        queue.tasks[i].length = (length - start < chunk) ? length - start : chunk;
+        queue.tasks[i].error = 0;
+    }
+    queue.count = nspans;
+    queue.next = 0;
+    queue.active_workers = 1;
+    queue.filename = filename;
+    queue.ui = ui;
+    queue.out = (unsigned char *) PyBytes_AS_STRING(ans);
+    if (threads < 1) threads = 1;
+    if (threads > nspans) threads = (int) nspans;
+    if (threads > 64) threads = 64;
+
+    queue.mutex = PyThread_allocate_lock();
+    queue.done = PyThread_allocate_lock();
+    if (queue.mutex == NULL || queue.done == NULL) {
+        if (queue.mutex) PyThread_free_lock(queue.mutex);
+        if (queue.done) PyThread_free_lock(queue.done);
+        PyMem_Free(queue.tasks); Py_DECREF(ans);
+        return PyErr_NoMemory();
+    }
+    PyThread_acquire_lock(queue.done, 1);
+
+    for (spawned = 1; spawned < threads; spawned++) {
+        PyThread_acquire_lock(queue.mutex, 1);
+        queue.active_workers++;
+        PyThread_release_lock(queue.mutex);
+        if (PyThread_start_new_thread(retrieve_spans_worker, &queue) == -1) {
+            PyThread_acquire_lock(queue.mutex, 1);
+            queue.active_workers--;
+            PyThread_release_lock(queue.mutex);
+            break;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    retrieve_spans_worker(&queue);
+    PyThread_acquire_lock(queue.done, 1);
+    Py_END_ALLOW_THREADS
+    PyThread_release_lock(queue.done);
+    PyThread_free_lock(queue.mutex);
+    PyThread_free_lock(queue.done);
+
+    for (i = 0; i < nspans; i++) if (queue.tasks[i].error > error)
+        error = queue.tasks[i].error;
+    PyMem_Free(queue.tasks);
+    if (error) {
+        Py_DECREF(ans);
+        PyErr_SetString(error == 1 ? PyExc_IOError : PyExc_RuntimeError,
+                error == 1 ? "Failed to open CHM file for parallel retrieval"
+                           : "Failed to read CHM object");
+        return NULL;
+    }
+    return ans;
+}
 %}
 
+%native(extract_all) PyObject *py_extract_all(PyObject *self, PyObject *args);
+%native(retrieve_object_parallel) PyObject *py_retrieve_object_parallel(PyObject *self, PyObject *args);
+
 %typemap(in) CHM_ENUMERATOR {
   if (!my_set_callback(self, $input)) goto fail;
   $1 = dummy_enumerator;
@@ -0,0 +1,89 @@
+/*
+ * cpu_features.h
+ * Copyright (C) 2026 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ *
+ * Runtime CPU feature detection and kernel dispatch, shared by all the
+ * native modules so that each does not grow its own cpuid logic.
+ * Detection runs once per module (the result is cached), so the
+ * intended pattern is one function pointer per accelerated kernel,
+ * resolved at module import:
+ *
+ *   static void (*blur_kernel)(unsigned char*, size_t);
+ *   // in the module init function:
+ *   blur_kernel = CALIBRE_SELECT_KERNEL(blur_avx2, blur_sse2, blur_neon, blur_scalar);
+ *
+ * Variants that do not exist (or are not compiled on this architecture)
+ * are passed as NULL and skipped, the scalar variant must always be
+ * given. Note that SSE2 is part of the x86-64 baseline and NEON of the
+ * aarch64 baseline, so such kernels may also simply be selected at
+ * compile time; the dispatch table matters for levels above baseline,
+ * like AVX2. calibre.constants.plugins['speedup'].cpu_features()
+ * reports the live feature set for production diagnostics.
+ */
+
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CALIBRE_CPU_X86_MSVC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CALIBRE_CPU_X86_GNU
+#elif defined(__arm__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define CALIBRE_CPU_ARM_LINUX
+#endif
+
+#ifdef _MSC_VER
+#define CALIBRE_CPU_UNUSED
+#else
+#define CALIBRE_CPU_UNUSED __attribute__((unused))
+#endif
+
+typedef struct {
+    int sse2, sse4_2, avx2, neon;
+} CalibreCPUFeatures;
+
+static CALIBRE_CPU_UNUSED CalibreCPUFeatures
+calibre_cpu_features(void) {
+    static int resolved = 0;
+    static CalibreCPUFeatures feats;
+
+    if (!resolved) {
+#if defined(CALIBRE_CPU_X86_GNU)
+        feats.sse2 = __builtin_cpu_supports("sse2") != 0;
+        feats.sse4_2 = __builtin_cpu_supports("sse4.2") != 0;
+        // __builtin_cpu_supports also checks OS support for the AVX state
+        feats.avx2 = __builtin_cpu_supports("avx2") != 0;
+#elif defined(CALIBRE_CPU_X86_MSVC)
+        int info[4] = {0}, nids;
+        __cpuid(info, 0);
+        nids = info[0];
+        if (nids >= 1) {
+            __cpuid(info, 1);
+            feats.sse2 = (info[3] & (1 << 26)) != 0;
+            feats.sse4_2 = (info[2] & (1 << 20)) != 0;
+            // AVX2 additionally needs the OS to save the AVX registers
+            if (nids >= 7 && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6) {
+                __cpuidex(info, 7, 0);
+                feats.avx2 = (info[1] & (1 << 5)) != 0;
+            }
+        }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+        feats.neon = 1;  // NEON is part of the aarch64 baseline
+#elif defined(CALIBRE_CPU_ARM_LINUX) && defined(HWCAP_NEON)
+        feats.neon = (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+        resolved = 1;
+    }
+    return feats;
+}
+
+// Pick the best available variant of a kernel; unimplemented variants
+// are passed as NULL
+#define CALIBRE_SELECT_KERNEL(avx2_fn, sse2_fn, neon_fn, scalar_fn) ( \
+    (calibre_cpu_features().avx2 && (avx2_fn) != NULL) ? (avx2_fn) : \
+    (calibre_cpu_features().sse2 && (sse2_fn) != NULL) ? (sse2_fn) : \
+    (calibre_cpu_features().neon && (neon_fn) != NULL) ? (neon_fn) : (scalar_fn))
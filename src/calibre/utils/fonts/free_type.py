@@ -6,9 +6,12 @@ __license__   = 'GPL v3'
 __copyright__ = '2012, Kovid Goyal <kovid at kovidgoyal.net>'
 __docformat__ = 'restructuredtext en'
 
+import hashlib
 import threading
+from array import array
+from collections import OrderedDict
 from functools import wraps
-from polyglot.builtins import map, unicode_type
+from polyglot.builtins import codepoint_to_chr, map, unicode_type
 
 from calibre.constants import plugins
 
@@ -60,23 +63,57 @@ class Face(object):
         return self.face.supports_text(chars)
 
     @same_thread
-    def glyph_ids(self, text):
+    def unsupported_chars(self, text, has_non_printable_chars=True):
+        '''
+        Returns the characters in text for which this font has no glyphs.
+        '''
         if not isinstance(text, unicode_type):
             raise TypeError('%r is not a unicode object'%text)
-        for char in text:
-            yield self.face.glyph_id(ord(char))
+        if has_non_printable_chars:
+            from calibre.utils.fonts.utils import get_printable_characters
+            text = get_printable_characters(text)
+        chars = tuple(frozenset(map(ord, text)))
+        return ''.join(map(codepoint_to_chr, self.face.unsupported_chars(chars)))
+
+    @same_thread
+    def glyph_ids(self, text, with_undefined=False):
+        '''
+        Resolve the glyph ids for all characters of text in a single call
+        into the plugin. Returns an array of ids, one per character. When
+        with_undefined is True, also returns the set of codepoints that
+        have no glyph in this font.
+        '''
+        if not isinstance(text, unicode_type):
+            raise TypeError('%r is not a unicode object'%text)
+        ids, undefined = self.face.glyph_ids(text)
+        ids = array('I', bytes(ids))
+        return (ids, undefined) if with_undefined else ids
 
 
 class FreeType(object):
 
-    def __init__(self):
+    def __init__(self, face_cache_capacity=32):
         self.start_thread = threading.current_thread()
         ft, ft_err = plugins['freetype']
         if ft_err:
             raise RuntimeError('Failed to load FreeType module with error: %s'
                     % ft_err)
         self.ft = ft.FreeType()
+        # Conversion pipelines load the same embedded fonts dozens of times
+        # per book for subsetting checks, so keep recently loaded faces
+        # alive, keyed by content hash. The cache lives on this object
+        # rather than in the C module, since faces must only be used from
+        # the thread that created them.
+        self.face_cache = OrderedDict()
+        self.face_cache_capacity = face_cache_capacity
 
     @same_thread
     def load_font(self, data):
-        return Face(self.ft.load_font(data))
+        key = hashlib.sha1(data).digest()
+        face = self.face_cache.pop(key, None)
+        if face is None:
+            face = Face(self.ft.load_font(data))
+        self.face_cache[key] = face  # most recently used last
+        while len(self.face_cache) > self.face_cache_capacity:
+            self.face_cache.popitem(last=False)
+        return face
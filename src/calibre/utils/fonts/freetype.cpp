@@ -23,6 +23,9 @@ typedef struct {
     // segfaults.
     PyObject *library;
     PyObject *data;
+    // Lazily built bitmap of the cmap's codepoint coverage, so that
+    // supports_text() is bit tests instead of FT_Get_Char_Index probes
+    unsigned char *coverage;
 } Face;
 
 typedef struct {
@@ -47,6 +50,9 @@ Face_dealloc(Face* self)
     Py_XDECREF(self->data);
     self->data = NULL;
 
+    free(self->coverage);
+    self->coverage = NULL;
+
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -95,6 +101,35 @@ style_name(Face *self, void *closure) {
     return Py_BuildValue("s", self->face->style_name);
 }
 
+#define COVERAGE_SZ (0x110000 / 8)
+
+static int
+ensure_coverage(Face *self) {
+    unsigned char *cov;
+    FT_ULong code;
+    FT_UInt gid;
+
+    if (self->coverage != NULL) return 0;
+    cov = (unsigned char*)calloc(COVERAGE_SZ, sizeof(unsigned char));
+    if (cov == NULL) { PyErr_NoMemory(); return -1; }
+    // One walk of the cmap, instead of a FT_Get_Char_Index probe per
+    // character per call
+    Py_BEGIN_ALLOW_THREADS;
+    code = FT_Get_First_Char(self->face, &gid);
+    while (gid != 0) {
+        if (code < 0x110000) cov[code >> 3] |= (unsigned char)(1 << (code & 7));
+        code = FT_Get_Next_Char(self->face, code, &gid);
+    }
+    Py_END_ALLOW_THREADS;
+    self->coverage = cov;
+    return 0;
+}
+
+static inline int
+covers_code(const unsigned char *cov, FT_ULong code) {
+    return code < 0x110000 && (cov[code >> 3] & (1 << (code & 7)));
+}
+
 static PyObject*
 supports_text(Face *self, PyObject *args) {
     PyObject *chars, *fast, *ret = Py_True;
@@ -102,13 +137,14 @@ supports_text(Face *self, PyObject *args) {
     FT_ULong code;
 
     if (!PyArg_ParseTuple(args, "O", &chars)) return NULL;
+    if (ensure_coverage(self) != 0) return NULL;
     fast = PySequence_Fast(chars, "List of chars is not a sequence");
     if (fast == NULL) return NULL;
     sz = PySequence_Fast_GET_SIZE(fast);
 
     for (i = 0; i < sz; i++) {
         code = (FT_ULong)PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(fast, i), NULL);
-        if (FT_Get_Char_Index(self->face, code) == 0) {
+        if (!covers_code(self->coverage, code)) {
             ret = Py_False;
             break;
         }
@@ -119,6 +155,33 @@ supports_text(Face *self, PyObject *args) {
     return ret;
 }
 
+static PyObject*
+unsupported_chars(Face *self, PyObject *args) {
+    PyObject *chars, *fast, *ans, *temp;
+    Py_ssize_t sz, i;
+    FT_ULong code;
+
+    if (!PyArg_ParseTuple(args, "O", &chars)) return NULL;
+    if (ensure_coverage(self) != 0) return NULL;
+    fast = PySequence_Fast(chars, "List of chars is not a sequence");
+    if (fast == NULL) return NULL;
+    sz = PySequence_Fast_GET_SIZE(fast);
+
+    ans = PyList_New(0);
+    if (ans == NULL) { Py_DECREF(fast); return PyErr_NoMemory(); }
+    for (i = 0; i < sz; i++) {
+        temp = PySequence_Fast_GET_ITEM(fast, i);
+        code = (FT_ULong)PyNumber_AsSsize_t(temp, NULL);
+        if (!covers_code(self->coverage, code)) {
+            if (PyList_Append(ans, temp) != 0) { Py_DECREF(ans); Py_DECREF(fast); return NULL; }
+        }
+    }
+    Py_DECREF(fast);
+    temp = PyList_AsTuple(ans);
+    Py_DECREF(ans);
+    return temp;
+}
+
 static PyObject*
 glyph_id(Face *self, PyObject *args) {
     unsigned long code;
@@ -127,6 +190,62 @@ glyph_id(Face *self, PyObject *args) {
     return Py_BuildValue("k", (unsigned long)FT_Get_Char_Index(self->face, (FT_ULong)code));
 }
 
+static PyObject*
+glyph_ids(Face *self, PyObject *args) {
+    PyObject *text, *ids = NULL, *undefined = NULL, *temp, *ans;
+    FT_ULong *codes = NULL;
+    FT_UInt *gids;
+    Py_ssize_t sz, i;
+
+    if (!PyArg_ParseTuple(args, "U", &text)) return NULL;
+#if PY_MAJOR_VERSION >= 3
+    if (PyUnicode_READY(text) != 0) return NULL;
+    sz = PyUnicode_GET_LENGTH(text);
+#else
+    sz = PyUnicode_GET_SIZE(text);
+#endif
+
+    codes = (FT_ULong*)malloc(sz * sizeof(FT_ULong) + sz * sizeof(FT_UInt) + 1);
+    if (codes == NULL) return PyErr_NoMemory();
+    gids = (FT_UInt*)(codes + sz);
+#if PY_MAJOR_VERSION >= 3
+    {
+        int kind = PyUnicode_KIND(text);
+        void *data = PyUnicode_DATA(text);
+        for (i = 0; i < sz; i++) codes[i] = PyUnicode_READ(kind, data, i);
+    }
+#else
+    {
+        Py_UNICODE *u = PyUnicode_AS_UNICODE(text);
+        for (i = 0; i < sz; i++) codes[i] = u[i];
+    }
+#endif
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < sz; i++) gids[i] = FT_Get_Char_Index(self->face, codes[i]);
+    Py_END_ALLOW_THREADS;
+
+    // One native-endian 32-bit glyph id per character, ready for array('I')
+    ids = PyBytes_FromStringAndSize((const char*)gids, sz * sizeof(FT_UInt));
+    undefined = PyFrozenSet_New(NULL);
+    if (ids == NULL || undefined == NULL) goto error;
+    for (i = 0; i < sz; i++) {
+        if (gids[i] != 0) continue;
+        temp = PyLong_FromUnsignedLong((unsigned long)codes[i]);
+        if (temp == NULL || PySet_Add(undefined, temp) != 0) { Py_XDECREF(temp); goto error; }
+        Py_DECREF(temp);
+    }
+    ans = PyTuple_New(2);
+    if (ans == NULL) goto error;
+    free(codes);
+    PyTuple_SET_ITEM(ans, 0, ids);
+    PyTuple_SET_ITEM(ans, 1, undefined);
+    return ans;
+error:
+    free(codes); Py_XDECREF(ids); Py_XDECREF(undefined);
+    return NULL;
+}
+
 static PyGetSetDef Face_getsetters[] = {
     {(char *)"family_name",
      (getter)family_name, NULL,
@@ -146,10 +265,18 @@ static PyMethodDef Face_methods[] = {
      "supports_text(sequence of unicode character codes) -> Return True iff this font has glyphs for all the specified characters."
     },
 
+    {"unsupported_chars", (PyCFunction)unsupported_chars, METH_VARARGS,
+     "unsupported_chars(sequence of unicode character codes) -> Return a tuple of the characters from the sequence that have no glyph in this font. Pass a whole book's unique codepoints in one call."
+    },
+
     {"glyph_id", (PyCFunction)glyph_id, METH_VARARGS,
      "glyph_id(character code) -> Returns the glyph id for the specified character code."
     },
 
+    {"glyph_ids", (PyCFunction)glyph_ids, METH_VARARGS,
+     "glyph_ids(text) -> Resolve the glyph ids for every character of the unicode string text in one call, with the GIL released. Returns a tuple of (ids, undefined) where ids is a bytestring of native-endian 32-bit glyph ids, one per character, and undefined is the frozenset of codepoints that have no glyph in this font."
+    },
+
     {NULL}  /* Sentinel */
 };
 
@@ -6,11 +6,11 @@ __license__   = 'GPL v3'
 __copyright__ = '2012, Kovid Goyal <kovid at kovidgoyal.net>'
 __docformat__ = 'restructuredtext en'
 
-import os, sys, atexit
+import os, sys, atexit, hashlib, json, threading
 from itertools import product
 
 from calibre import prints, isbytestring
-from calibre.constants import plugins, filesystem_encoding
+from calibre.constants import plugins, filesystem_encoding, cache_dir
 from calibre.utils.fonts.utils import (is_truetype_font, get_font_names,
         get_font_characteristics)
 from polyglot.builtins import iteritems, unicode_type
@@ -38,9 +38,70 @@ class WinFonts(object):
         # import pprint
         # pprint.pprint(self.app_font_families)
 
+        # Enumerating thousands of fonts through GDI takes seconds on
+        # terminal servers, so do it once on a background thread into a
+        # serialized snapshot, invalidated by the state of the system fonts
+        # directory, and serve queries from the snapshot.
+        self._snapshot = None
+        self._snapshot_ready = threading.Event()
+        t = threading.Thread(target=self._load_snapshot)
+        t.daemon = True
+        t.start()
+
+    def _fonts_dir_signature(self):
+        base = os.path.join(os.environ.get('SystemRoot', 'C:\\Windows'), 'Fonts')
+        try:
+            names = sorted(os.listdir(base))
+        except EnvironmentError:
+            return None
+        h = hashlib.sha1()
+        for name in names:
+            try:
+                st = os.stat(os.path.join(base, name))
+            except EnvironmentError:
+                continue
+            h.update(('%s\0%d\0%s\n' % (name, st.st_size, st.st_mtime)).encode('utf-8'))
+        return h.hexdigest()
+
+    def _snapshot_path(self):
+        return os.path.join(cache_dir(), 'winfonts-snapshot.json')
+
+    def _load_snapshot(self):
+        try:
+            sig = self._fonts_dir_signature()
+            path = self._snapshot_path()
+            if sig is not None:
+                try:
+                    with open(path, 'rb') as f:
+                        cached = json.loads(f.read().decode('utf-8'))
+                    if cached.get('signature') == sig:
+                        self._snapshot = cached['families']
+                        return
+                except Exception:
+                    pass  # missing or corrupt snapshot, re-enumerate
+            self._snapshot = self.w.enum_font_families()
+            if sig is not None:
+                try:
+                    from calibre.utils.filenames import atomic_rename
+                    raw = json.dumps({'signature': sig, 'families': self._snapshot}).encode('utf-8')
+                    with open(path + '.tmp', 'wb') as f:
+                        f.write(raw)
+                    atomic_rename(path + '.tmp', path)
+                except Exception:
+                    pass  # the snapshot is only an optimization
+        finally:
+            self._snapshot_ready.set()
+
+    def enum_font_families(self):
+        self._snapshot_ready.wait()
+        if self._snapshot is None:
+            # Snapshot thread failed, fall back to direct enumeration
+            return self.w.enum_font_families()
+        return self._snapshot
+
     def font_families(self):
         names = set()
-        for font in self.w.enum_font_families():
+        for font in self.enum_font_families():
             if (
                     font['is_truetype'] and
                     # Fonts with names starting with @ are designed for
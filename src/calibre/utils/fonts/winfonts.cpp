@@ -43,63 +43,98 @@ static PyObject* wchar_to_unicode(const wchar_t *o) {
 // }}}
 
 // Enumerate font families {{{
-struct EnumData {
-    HDC hdc;
-    PyObject *families;
-};
-
 
-static PyObject* logfont_to_dict(const ENUMLOGFONTEX *lf, const TEXTMETRIC *tm, DWORD font_type, HDC hdc) {
-    PyObject *name, *full_name, *style, *script;
-    LOGFONT f = lf->elfLogFont;
-
-    name = wchar_to_unicode(f.lfFaceName);
-    full_name = wchar_to_unicode(lf->elfFullName);
-    style = wchar_to_unicode(lf->elfStyle);
-    script = wchar_to_unicode(lf->elfScript);
+// The GDI walk collects plain C structs with the GIL released, so that a
+// background thread can absorb the enumeration cost (seconds on terminal
+// servers with thousands of fonts) without stalling the rest of the
+// application; the Python dicts are built afterwards in one pass.
+struct FontEntry {
+    wchar_t name[LF_FACESIZE];
+    wchar_t full_name[LF_FULLFACESIZE];
+    wchar_t style[LF_FACESIZE];
+    wchar_t script[LF_FACESIZE];
+    LONG weight;
+    DWORD font_type;
+    BYTE is_italic, is_underlined, is_struckout;
+};
 
-    return Py_BuildValue("{s:N, s:N, s:N, s:N, s:O, s:O, s:O, s:O, s:l}",
-        "name", name,
-        "full_name", full_name,
-        "style", style,
-        "script", script,
-        "is_truetype", (font_type & TRUETYPE_FONTTYPE) ? Py_True : Py_False,
-        "is_italic", (tm->tmItalic != 0) ? Py_True : Py_False,
-        "is_underlined", (tm->tmUnderlined != 0) ? Py_True : Py_False,
-        "is_strikeout", (tm->tmStruckOut != 0) ? Py_True : Py_False,
-        "weight", tm->tmWeight
-    );
-}
+struct EnumData {
+    struct FontEntry *entries;
+    size_t count, capacity;
+    int oom;
+};
 
 static int CALLBACK find_families_callback(const ENUMLOGFONTEX *lpelfe, const TEXTMETRIC *lpntme, DWORD font_type, LPARAM lParam) {
     struct EnumData *enum_data = reinterpret_cast<struct EnumData*>(lParam);
-    PyObject *font = logfont_to_dict(lpelfe, lpntme, font_type, enum_data->hdc);
-    if (font == NULL) return 0;
-    PyList_Append(enum_data->families, font);
+    struct FontEntry *e;
+
+    if (enum_data->count == enum_data->capacity) {
+        size_t ncap = (enum_data->capacity > 0) ? 2 * enum_data->capacity : 256;
+        struct FontEntry *nentries = (struct FontEntry*)realloc(enum_data->entries, ncap * sizeof(struct FontEntry));
+        if (nentries == NULL) { enum_data->oom = 1; return 0; }
+        enum_data->entries = nentries;
+        enum_data->capacity = ncap;
+    }
+    e = enum_data->entries + enum_data->count;
+    StringCchCopyW(e->name, LF_FACESIZE, lpelfe->elfLogFont.lfFaceName);
+    StringCchCopyW(e->full_name, LF_FULLFACESIZE, (LPCWSTR)lpelfe->elfFullName);
+    StringCchCopyW(e->style, LF_FACESIZE, (LPCWSTR)lpelfe->elfStyle);
+    StringCchCopyW(e->script, LF_FACESIZE, (LPCWSTR)lpelfe->elfScript);
+    e->weight = lpntme->tmWeight;
+    e->font_type = font_type;
+    e->is_italic = lpntme->tmItalic;
+    e->is_underlined = lpntme->tmUnderlined;
+    e->is_struckout = lpntme->tmStruckOut;
+    enum_data->count++;
 
 	return 1;
 }
 
+static PyObject* font_entry_to_dict(const struct FontEntry *e) {
+    return Py_BuildValue("{s:N, s:N, s:N, s:N, s:O, s:O, s:O, s:O, s:l}",
+        "name", wchar_to_unicode(e->name),
+        "full_name", wchar_to_unicode(e->full_name),
+        "style", wchar_to_unicode(e->style),
+        "script", wchar_to_unicode(e->script),
+        "is_truetype", (e->font_type & TRUETYPE_FONTTYPE) ? Py_True : Py_False,
+        "is_italic", (e->is_italic != 0) ? Py_True : Py_False,
+        "is_underlined", (e->is_underlined != 0) ? Py_True : Py_False,
+        "is_strikeout", (e->is_struckout != 0) ? Py_True : Py_False,
+        "weight", e->weight
+    );
+}
+
 static PyObject* enum_font_families(PyObject *self, PyObject *args) {
     LOGFONTW logfont;
 	HDC hdc;
-    PyObject *families;
-    struct EnumData enum_data;
+    PyObject *families, *font;
+    struct EnumData enum_data = {NULL, 0, 0, 0};
+    size_t i;
 
-	families = PyList_New(0);
-    if (families == NULL) return PyErr_NoMemory();
+    Py_BEGIN_ALLOW_THREADS;
     SecureZeroMemory(&logfont, sizeof(logfont));
-
     logfont.lfCharSet = DEFAULT_CHARSET;
     logfont.lfFaceName[0] = L'\0';
 
     hdc = GetDC(NULL);
-    enum_data.hdc = hdc;
-    enum_data.families = families;
-
     EnumFontFamiliesExW(hdc, &logfont, (FONTENUMPROC)find_families_callback,
 					(LPARAM)(&enum_data), 0);
     ReleaseDC(NULL, hdc);
+    Py_END_ALLOW_THREADS;
+
+    if (enum_data.oom) { free(enum_data.entries); return PyErr_NoMemory(); }
+
+	families = PyList_New(0);
+    if (families == NULL) { free(enum_data.entries); return PyErr_NoMemory(); }
+    for (i = 0; i < enum_data.count; i++) {
+        font = font_entry_to_dict(enum_data.entries + i);
+        if (font == NULL || PyList_Append(families, font) != 0) {
+            Py_XDECREF(font); Py_DECREF(families); free(enum_data.entries);
+            return NULL;
+        }
+        Py_DECREF(font);
+    }
+    free(enum_data.entries);
 
 	return families;
 }
@@ -1,9 +1,18 @@
 #include "icu_calibre_utils.h"
+#include "op_stats.h"
 
 #define UPPER_CASE 0
 #define LOWER_CASE 1
 #define TITLE_CASE 2
 
+// Native-layer work counters, exported via get_stats()
+enum { STAT_SORT_KEY, STAT_SORT_KEYS, STAT_STRCMP, STAT_COUNT };
+static CalibreOpStat icu_op_stats[STAT_COUNT] = {
+    {"sort_key", 0, 0},
+    {"sort_keys", 0, 0},
+    {"strcmp", 0, 0},
+};
+
 static PyObject* uchar_to_unicode(const UChar *src, int32_t len) {
     wchar_t *buf = NULL;
     PyObject *ans = NULL;
@@ -22,12 +31,207 @@ static PyObject* uchar_to_unicode(const UChar *src, int32_t len) {
     return ans;
 }
 
+// Sort key cache {{{
+
+// A persistent cache of sort keys. ucol_getSortKey() output only changes
+// when the ICU collation data or the collator configuration changes, so
+// keys for previously seen strings can be reused across sessions. The
+// cache file starts with a magic string and a fingerprint of the collator
+// (ucol_getVersion() plus the strength and numeric attributes, which both
+// change the keys); a fingerprint mismatch discards the file. Records of
+// (string, key) pairs are appended as new strings are seen and indexed in
+// memory by a 64-bit hash of the string.
+
+#define SKC_MAGIC "calibre-skc2"
+#define SKC_MAGIC_LEN 12
+#define SKC_MIN_SLOTS 1024
+
+typedef struct {
+    UVersionInfo icu_version;
+    uint8_t strength;
+    uint8_t numeric;
+    uint8_t pad[2];
+} skc_fingerprint;
+
+static void
+skc_fingerprint_for_collator(const UCollator *collator, skc_fingerprint *f) {
+    UErrorCode status = U_ZERO_ERROR;
+    memset(f, 0, sizeof(*f));
+    ucol_getVersion(collator, f->icu_version);
+    f->strength = (uint8_t)ucol_getStrength(collator);
+    f->numeric = (ucol_getAttribute(collator, UCOL_NUMERIC_COLLATION, &status) == UCOL_ON) ? 1 : 0;
+}
+
+typedef struct {
+    uint64_t hash;
+    size_t offset;  // offset of the record in blob, 0 means empty slot
+} skc_slot;
+
+typedef struct {
+    FILE *fp;          // append handle for new records
+    uint8_t *blob;     // loaded file contents, grows as records are added
+    size_t blob_sz, blob_cap;
+    skc_slot *slots;
+    size_t num_slots, count;
+} sort_key_cache;
+
+static uint64_t
+skc_hash(const UChar *str, int32_t sz) {
+    // FNV-1a over the raw UTF-16 bytes
+    const uint8_t *p = (const uint8_t*)str;
+    size_t len = (size_t)sz * sizeof(UChar), i;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (i = 0; i < len; i++) { hash ^= p[i]; hash *= 0x100000001b3ULL; }
+    if (hash == 0) hash = 1;  // 0 marks an empty slot
+    return hash;
+}
+
+// Record layout: u32 slen (UChars), u32 klen (bytes), UChar str[slen], uint8_t key[klen]
+static const UChar* skc_record_str(sort_key_cache *cache, size_t offset) { return (const UChar*)(cache->blob + offset + 2 * sizeof(uint32_t)); }
+static uint32_t skc_record_slen(sort_key_cache *cache, size_t offset) { uint32_t x; memcpy(&x, cache->blob + offset, sizeof(x)); return x; }
+static uint32_t skc_record_klen(sort_key_cache *cache, size_t offset) { uint32_t x; memcpy(&x, cache->blob + offset + sizeof(uint32_t), sizeof(x)); return x; }
+static const uint8_t* skc_record_key(sort_key_cache *cache, size_t offset) { return cache->blob + offset + 2 * sizeof(uint32_t) + skc_record_slen(cache, offset) * sizeof(UChar); }
+
+static int
+skc_index_insert(sort_key_cache *cache, uint64_t hash, size_t offset) {
+    size_t i, pos;
+    if (cache->count * 2 >= cache->num_slots) {  // Grow at 50% load
+        size_t new_num = cache->num_slots ? 2 * cache->num_slots : SKC_MIN_SLOTS;
+        skc_slot *new_slots = (skc_slot*)calloc(new_num, sizeof(skc_slot));
+        if (new_slots == NULL) return 0;
+        for (i = 0; i < cache->num_slots; i++) {
+            if (cache->slots[i].offset == 0) continue;
+            pos = cache->slots[i].hash & (new_num - 1);
+            while (new_slots[pos].offset != 0) pos = (pos + 1) & (new_num - 1);
+            new_slots[pos] = cache->slots[i];
+        }
+        free(cache->slots); cache->slots = new_slots; cache->num_slots = new_num;
+    }
+    pos = hash & (cache->num_slots - 1);
+    while (cache->slots[pos].offset != 0) pos = (pos + 1) & (cache->num_slots - 1);
+    cache->slots[pos].hash = hash; cache->slots[pos].offset = offset;
+    cache->count++;
+    return 1;
+}
+
+static size_t
+skc_lookup(sort_key_cache *cache, uint64_t hash, const UChar *str, int32_t sz) {
+    size_t pos;
+    if (cache->num_slots == 0) return 0;
+    pos = hash & (cache->num_slots - 1);
+    while (cache->slots[pos].offset != 0) {
+        if (cache->slots[pos].hash == hash) {
+            size_t offset = cache->slots[pos].offset;
+            if (skc_record_slen(cache, offset) == (uint32_t)sz && memcmp(skc_record_str(cache, offset), str, sz * sizeof(UChar)) == 0) return offset;
+        }
+        pos = (pos + 1) & (cache->num_slots - 1);
+    }
+    return 0;
+}
+
+static void
+skc_close(sort_key_cache *cache) {
+    if (cache == NULL) return;
+    if (cache->fp != NULL) fclose(cache->fp);
+    if (cache->blob != NULL) free(cache->blob);
+    if (cache->slots != NULL) free(cache->slots);
+    free(cache);
+}
+
+static sort_key_cache*
+skc_open(const char *path, const skc_fingerprint *fingerprint) {
+    sort_key_cache *cache = NULL;
+    FILE *fp = NULL;
+    long file_sz = 0;
+    size_t pos, record_sz;
+    int valid = 0;
+
+    cache = (sort_key_cache*)calloc(1, sizeof(sort_key_cache));
+    if (cache == NULL) return NULL;
+
+    fp = fopen(path, "rb");
+    if (fp != NULL) {
+        if (fseek(fp, 0, SEEK_END) == 0 && (file_sz = ftell(fp)) >= (long)(SKC_MAGIC_LEN + sizeof(skc_fingerprint)) && fseek(fp, 0, SEEK_SET) == 0) {
+            cache->blob_cap = (size_t)file_sz + 4096;
+            cache->blob = (uint8_t*)malloc(cache->blob_cap);
+            if (cache->blob == NULL) { fclose(fp); skc_close(cache); return NULL; }
+            if (fread(cache->blob, 1, (size_t)file_sz, fp) == (size_t)file_sz &&
+                    memcmp(cache->blob, SKC_MAGIC, SKC_MAGIC_LEN) == 0 &&
+                    memcmp(cache->blob + SKC_MAGIC_LEN, fingerprint, sizeof(skc_fingerprint)) == 0) {
+                cache->blob_sz = (size_t)file_sz;
+                valid = 1;
+            }
+        }
+        fclose(fp); fp = NULL;
+    }
+
+    if (!valid) {
+        // Missing, corrupt or built by a differently configured collator: start over
+        if (cache->blob == NULL) {
+            cache->blob_cap = 4096;
+            cache->blob = (uint8_t*)malloc(cache->blob_cap);
+            if (cache->blob == NULL) { skc_close(cache); return NULL; }
+        }
+        memcpy(cache->blob, SKC_MAGIC, SKC_MAGIC_LEN);
+        memcpy(cache->blob + SKC_MAGIC_LEN, fingerprint, sizeof(skc_fingerprint));
+        cache->blob_sz = SKC_MAGIC_LEN + sizeof(skc_fingerprint);
+        fp = fopen(path, "wb");
+        if (fp == NULL) { skc_close(cache); return NULL; }
+        if (fwrite(cache->blob, 1, cache->blob_sz, fp) != cache->blob_sz) { fclose(fp); skc_close(cache); return NULL; }
+        cache->fp = fp;
+        return cache;
+    }
+
+    // Index the existing records
+    pos = SKC_MAGIC_LEN + sizeof(skc_fingerprint);
+    while (pos + 2 * sizeof(uint32_t) <= cache->blob_sz) {
+        record_sz = 2 * sizeof(uint32_t) + skc_record_slen(cache, pos) * sizeof(UChar) + skc_record_klen(cache, pos);
+        if (pos + record_sz > cache->blob_sz) { cache->blob_sz = pos; break; }  // Truncated trailing record, drop it
+        if (!skc_index_insert(cache, skc_hash(skc_record_str(cache, pos), (int32_t)skc_record_slen(cache, pos)), pos)) { skc_close(cache); return NULL; }
+        pos += record_sz;
+    }
+
+    fp = fopen(path, "ab");
+    if (fp == NULL) { skc_close(cache); return NULL; }
+    cache->fp = fp;
+    return cache;
+}
+
+static size_t
+skc_add(sort_key_cache *cache, uint64_t hash, const UChar *str, int32_t sz, const uint8_t *key, int32_t key_sz) {
+    size_t record_sz = 2 * sizeof(uint32_t) + (size_t)sz * sizeof(UChar) + (size_t)key_sz, offset;
+    uint32_t slen = (uint32_t)sz, klen = (uint32_t)key_sz;
+    uint8_t *record;
+
+    if (cache->blob_sz + record_sz > cache->blob_cap) {
+        size_t new_cap = 2 * cache->blob_cap;
+        uint8_t *new_blob;
+        while (new_cap < cache->blob_sz + record_sz) new_cap *= 2;
+        new_blob = (uint8_t*)realloc(cache->blob, new_cap);
+        if (new_blob == NULL) return 0;
+        cache->blob = new_blob; cache->blob_cap = new_cap;
+    }
+    offset = cache->blob_sz;
+    record = cache->blob + offset;
+    memcpy(record, &slen, sizeof(slen));
+    memcpy(record + sizeof(slen), &klen, sizeof(klen));
+    memcpy(record + 2 * sizeof(uint32_t), str, (size_t)sz * sizeof(UChar));
+    memcpy(record + 2 * sizeof(uint32_t) + (size_t)sz * sizeof(UChar), key, (size_t)key_sz);
+    if (!skc_index_insert(cache, hash, offset)) return 0;
+    cache->blob_sz += record_sz;
+    fwrite(record, 1, record_sz, cache->fp);  // Persisted on a best effort basis
+    return offset;
+}
+
+// }}}
+
 // Collator object definition {{{
 typedef struct {
     PyObject_HEAD
     // Type-specific fields go here.
     UCollator *collator;
     USet *contractions;
+    sort_key_cache *cache;
 
 } icu_Collator;
 
@@ -36,7 +240,8 @@ icu_Collator_dealloc(icu_Collator* self)
 {
     if (self->collator != NULL) ucol_close(self->collator);
     if (self->contractions != NULL) uset_close(self->contractions);
-    self->collator = NULL;
+    if (self->cache != NULL) skc_close(self->cache);
+    self->collator = NULL; self->cache = NULL;
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -59,6 +264,7 @@ icu_Collator_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     if (self != NULL) {
         self->collator = collator;
         self->contractions = NULL;
+        self->cache = NULL;
     }
 
     return (PyObject *)self;
@@ -100,6 +306,8 @@ icu_Collator_set_strength(icu_Collator *self, PyObject *val, void *closure) {
         PyErr_SetString(PyExc_TypeError, "Strength must be an integer.");
         return -1;
     }
+    // Sort keys depend on the strength, cached keys are no longer valid
+    if (self->cache != NULL) { skc_close(self->cache); self->cache = NULL; }
     return 0;
 }
 // }}}
@@ -115,6 +323,8 @@ static int
 icu_Collator_set_numeric(icu_Collator *self, PyObject *val, void *closure) {
     UErrorCode status = U_ZERO_ERROR;
     ucol_setAttribute(self->collator, UCOL_NUMERIC_COLLATION, (PyObject_IsTrue(val)) ? UCOL_ON : UCOL_OFF, &status);
+    // Sort keys depend on the numeric attribute, cached keys are no longer valid
+    if (self->cache != NULL) { skc_close(self->cache); self->cache = NULL; }
     return 0;
 }
 // }}}
@@ -147,10 +357,22 @@ icu_Collator_sort_key(icu_Collator *self, PyObject *input) {
     UChar *buf = NULL;
     uint8_t *buf2 = NULL;
     PyObject *ans = NULL;
+    uint64_t hash = 0;
+    size_t offset = 0;
+    unsigned long long op_start = calibre_op_now_ns();
 
     buf = python_to_icu(input, &sz);
     if (buf == NULL) return NULL;
 
+    if (self->cache != NULL) {
+        hash = skc_hash(buf, sz);
+        offset = skc_lookup(self->cache, hash, buf, sz);
+        if (offset != 0) {
+            ans = PyBytes_FromStringAndSize((char*)skc_record_key(self->cache, offset), skc_record_klen(self->cache, offset));
+            goto end;
+        }
+    }
+
     bsz = 7 * sz + 1;
     buf2 = (uint8_t*)calloc(bsz, sizeof(uint8_t));
     if (buf2 == NULL) { PyErr_NoMemory(); goto end; }
@@ -161,14 +383,103 @@ icu_Collator_sort_key(icu_Collator *self, PyObject *input) {
         key_size = ucol_getSortKey(self->collator, buf, sz, buf2, key_size + 1);
     }
     ans = PyBytes_FromStringAndSize((char*)buf2, key_size);
+    if (ans != NULL && self->cache != NULL) skc_add(self->cache, hash, buf, sz, buf2, key_size);  // A failed add only loses caching
 
 end:
     if (buf != NULL) free(buf);
     if (buf2 != NULL) free(buf2);
+    calibre_op_record(&icu_op_stats[STAT_SORT_KEY], op_start);
 
     return ans;
 } // }}}
 
+// Collator.sort_keys {{{
+static PyObject *
+icu_Collator_sort_keys(icu_Collator *self, PyObject *input) {
+    PyObject *items = NULL, *ans = NULL, *key = NULL;
+    Py_ssize_t i = 0, count = 0;
+    UChar **strings = NULL;
+    int32_t *sizes = NULL, *key_sizes = NULL;
+    size_t *offsets = NULL;
+    uint8_t *arena = NULL, *newarena = NULL;
+    size_t arena_sz = 0, arena_pos = 0;
+    int32_t key_size = 0;
+    int failed = 0;
+    unsigned long long op_start = calibre_op_now_ns();
+
+    items = PySequence_Fast(input, "sort_keys() expects an iterable of unicode strings");
+    if (items == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
+
+    strings = (UChar**)calloc(count + 1, sizeof(UChar*));
+    sizes = (int32_t*)calloc(count + 1, sizeof(int32_t));
+    key_sizes = (int32_t*)calloc(count + 1, sizeof(int32_t));
+    offsets = (size_t*)calloc(count + 1, sizeof(size_t));
+    if (strings == NULL || sizes == NULL || key_sizes == NULL || offsets == NULL) { PyErr_NoMemory(); goto end; }
+
+    // Convert all the inputs up front, while we still hold the GIL, so that
+    // key generation can run without it.
+    for (i = 0; i < count; i++) {
+        strings[i] = python_to_icu(PySequence_Fast_GET_ITEM(items, i), &sizes[i]);
+        if (strings[i] == NULL) goto end;
+        arena_sz += 7 * sizes[i] + 1;  // Same estimate as sort_key()
+    }
+    arena = (uint8_t*)malloc(arena_sz > 0 ? arena_sz : 1);
+    if (arena == NULL) { PyErr_NoMemory(); goto end; }
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < count; i++) {
+        key_size = ucol_getSortKey(self->collator, strings[i], sizes[i], arena + arena_pos, (int32_t)(arena_sz - arena_pos));
+        if ((size_t)key_size > arena_sz - arena_pos) {
+            // The estimate was too small for this key, grow the arena
+            newarena = (uint8_t*)realloc(arena, arena_pos + key_size + 1);
+            if (newarena == NULL) { failed = 1; break; }
+            arena = newarena; arena_sz = arena_pos + key_size + 1;
+            key_size = ucol_getSortKey(self->collator, strings[i], sizes[i], arena + arena_pos, (int32_t)(arena_sz - arena_pos));
+        }
+        offsets[i] = arena_pos; key_sizes[i] = key_size;
+        arena_pos += key_size;
+    }
+    Py_END_ALLOW_THREADS;
+    if (failed) { PyErr_NoMemory(); goto end; }
+
+    ans = PyList_New(count);
+    if (ans == NULL) goto end;
+    for (i = 0; i < count; i++) {
+        key = PyBytes_FromStringAndSize((char*)(arena + offsets[i]), key_sizes[i]);
+        if (key == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+        PyList_SET_ITEM(ans, i, key);
+    }
+
+end:
+    if (strings != NULL) { for (i = 0; i < count; i++) { if (strings[i] != NULL) free(strings[i]); } free(strings); }
+    if (sizes != NULL) free(sizes);
+    if (key_sizes != NULL) free(key_sizes);
+    if (offsets != NULL) free(offsets);
+    if (arena != NULL) free(arena);
+    Py_XDECREF(items);
+    calibre_op_record(&icu_op_stats[STAT_SORT_KEYS], op_start);
+
+    return ans;
+} // }}}
+
+// Collator.enable_sort_key_cache {{{
+static PyObject *
+icu_Collator_enable_sort_key_cache(icu_Collator *self, PyObject *args) {
+    const char *path = NULL;
+    skc_fingerprint fingerprint;
+
+    if (!PyArg_ParseTuple(args, "s", &path)) return NULL;
+    if (self->cache != NULL) { skc_close(self->cache); self->cache = NULL; }
+    skc_fingerprint_for_collator(self->collator, &fingerprint);
+    self->cache = skc_open(path, &fingerprint);
+    if (self->cache == NULL) {
+        PyErr_Format(PyExc_EnvironmentError, "Failed to open sort key cache file: %s", path);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+} // }}}
+
 // Collator.strcmp {{{
 static PyObject *
 icu_Collator_strcmp(icu_Collator *self, PyObject *args) {
@@ -176,9 +487,30 @@ icu_Collator_strcmp(icu_Collator *self, PyObject *args) {
     int32_t asz = 0, bsz = 0;
     UChar *a = NULL, *b = NULL;
     UCollationResult res = UCOL_EQUAL;
+    unsigned long long op_start = calibre_op_now_ns();
 
     if (!PyArg_ParseTuple(args, "OO", &a_, &b_)) return NULL;
 
+#if PY_VERSION_HEX >= 0x03030000
+    // Fast path: ASCII strings store their UTF-8 form directly, so they can
+    // be fed to ucol_strcollUTF8() without a UChar round-trip or any mallocs
+    if (PyUnicode_CheckExact(a_) && PyUnicode_CheckExact(b_) &&
+            PyUnicode_READY(a_) == 0 && PyUnicode_READY(b_) == 0 &&
+            PyUnicode_IS_ASCII(a_) && PyUnicode_IS_ASCII(b_)) {
+        UErrorCode status = U_ZERO_ERROR;
+        Py_ssize_t alen = 0, blen = 0;
+        const char *adata = PyUnicode_AsUTF8AndSize(a_, &alen), *bdata = PyUnicode_AsUTF8AndSize(b_, &blen);
+        if (adata == NULL || bdata == NULL) return NULL;
+        res = ucol_strcollUTF8(self->collator, adata, (int32_t)alen, bdata, (int32_t)blen, &status);
+        if (U_SUCCESS(status)) {
+            calibre_op_record(&icu_op_stats[STAT_STRCMP], op_start);
+            return Py_BuildValue("i", res);
+        }
+        // Fall through to the UChar based path on failure
+        res = UCOL_EQUAL;
+    }
+#endif
+
     a = python_to_icu(a_, &asz);
     if (a == NULL) goto end;
     b = python_to_icu(b_, &bsz);
@@ -187,6 +519,7 @@ icu_Collator_strcmp(icu_Collator *self, PyObject *args) {
 end:
     if (a != NULL) free(a);
     if (b != NULL) free(b);
+    calibre_op_record(&icu_op_stats[STAT_STRCMP], op_start);
 
     return (PyErr_Occurred()) ? NULL : Py_BuildValue("i", res);
 } // }}}
@@ -262,6 +595,158 @@ end:
     Py_RETURN_FALSE;
 } // }}}
 
+// Collator.find_all {{{
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#include <unistd.h>
+#define ICU_HAS_THREADS 1
+#define MAX_FIND_WORKERS 16
+#endif
+
+// Collators are not thread safe, so every worker gets its own clone of the
+// collator and a strided shard of the haystack list.
+typedef struct {
+    UCollator *collator;
+    const UChar *needle;
+    int32_t needle_sz;
+    UChar **haystacks;
+    int32_t *sizes;
+    int32_t *positions, *lengths;
+    Py_ssize_t count, start, step;
+    int failed;
+} icu_find_worker;
+
+static void
+icu_Collator_find_in_shard(icu_find_worker *w) {
+    Py_ssize_t i;
+    for (i = w->start; i < w->count; i += w->step) {
+        UErrorCode status = U_ZERO_ERROR;
+        UStringSearch *search = NULL;
+        int32_t pos = -1, length = -1;
+        // An empty needle or haystack can never match (usearch cannot even
+        // be opened on empty text), report no match like find() does
+        if (w->needle_sz > 0 && w->sizes[i] > 0) {
+            search = usearch_openFromCollator(w->needle, w->needle_sz, w->haystacks[i], w->sizes[i], w->collator, NULL, &status);
+            if (U_SUCCESS(status)) {
+                pos = usearch_first(search, &status);
+                if (pos != USEARCH_DONE) {
+                    length = usearch_getMatchedLength(search);
+#ifdef Py_UNICODE_WIDE
+                    length = u_countChar32(w->haystacks[i] + pos, length);
+                    pos = u_countChar32(w->haystacks[i], pos);
+#endif
+                } else pos = -1;
+            } else w->failed = 1;
+            if (search != NULL) usearch_close(search);
+        }
+        w->positions[i] = pos; w->lengths[i] = length;
+    }
+}
+
+#ifdef ICU_HAS_THREADS
+static void*
+icu_Collator_find_worker(void *x) {
+    icu_Collator_find_in_shard((icu_find_worker*)x);
+    return NULL;
+}
+#endif
+
+static PyObject *
+icu_Collator_find_all(icu_Collator *self, PyObject *args) {
+    PyObject *needle_ = NULL, *haystacks_ = NULL, *items = NULL, *ans = NULL, *temp = NULL;
+    UChar *needle = NULL, **haystacks = NULL;
+    int32_t needle_sz = 0, *sizes = NULL, *positions = NULL, *lengths = NULL;
+    Py_ssize_t i = 0, count = 0, num_workers = 1;
+    icu_find_worker workers[1
+#ifdef ICU_HAS_THREADS
+        + MAX_FIND_WORKERS
+#endif
+    ];
+    int failed = 0;
+
+    if (!PyArg_ParseTuple(args, "OO", &needle_, &haystacks_)) return NULL;
+    items = PySequence_Fast(haystacks_, "find_all() expects an iterable of unicode strings");
+    if (items == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
+
+    needle = python_to_icu(needle_, &needle_sz);
+    if (needle == NULL) goto end;
+    haystacks = (UChar**)calloc(count + 1, sizeof(UChar*));
+    sizes = (int32_t*)calloc(count + 1, sizeof(int32_t));
+    positions = (int32_t*)calloc(count + 1, sizeof(int32_t));
+    lengths = (int32_t*)calloc(count + 1, sizeof(int32_t));
+    if (haystacks == NULL || sizes == NULL || positions == NULL || lengths == NULL) { PyErr_NoMemory(); goto end; }
+    for (i = 0; i < count; i++) {
+        haystacks[i] = python_to_icu(PySequence_Fast_GET_ITEM(items, i), &sizes[i]);
+        if (haystacks[i] == NULL) goto end;
+    }
+
+#ifdef ICU_HAS_THREADS
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers < 1) num_workers = 1;
+    if (num_workers > MAX_FIND_WORKERS) num_workers = MAX_FIND_WORKERS;
+    if (num_workers > count) num_workers = (count > 0) ? count : 1;
+#endif
+
+    for (i = 0; i < num_workers; i++) {
+        UErrorCode status = U_ZERO_ERROR;
+        int32_t bufsize = -1;
+        workers[i].collator = (i == 0) ? self->collator : ucol_safeClone(self->collator, NULL, &bufsize, &status);
+        if (workers[i].collator == NULL || U_FAILURE(status)) {
+            while (--i > 0) ucol_close(workers[i].collator);
+            PyErr_SetString(PyExc_Exception, "Failed to clone collator.");
+            goto end;
+        }
+        workers[i].needle = needle; workers[i].needle_sz = needle_sz;
+        workers[i].haystacks = haystacks; workers[i].sizes = sizes;
+        workers[i].positions = positions; workers[i].lengths = lengths;
+        workers[i].count = count; workers[i].start = i; workers[i].step = num_workers;
+        workers[i].failed = 0;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+#ifdef ICU_HAS_THREADS
+    if (num_workers > 1) {
+        pthread_t threads[MAX_FIND_WORKERS];
+        int started[MAX_FIND_WORKERS] = {0};
+        for (i = 1; i < num_workers; i++) started[i] = (pthread_create(&threads[i], NULL, icu_Collator_find_worker, &workers[i]) == 0);
+        icu_Collator_find_in_shard(&workers[0]);
+        for (i = 1; i < num_workers; i++) {
+            if (started[i]) pthread_join(threads[i], NULL);
+            else icu_Collator_find_in_shard(&workers[i]);  // Thread creation failed, do the work inline
+        }
+    } else icu_Collator_find_in_shard(&workers[0]);
+#else
+    icu_Collator_find_in_shard(&workers[0]);
+#endif
+    Py_END_ALLOW_THREADS;
+
+    for (i = 0; i < num_workers; i++) {
+        if (workers[i].failed) failed = 1;
+        if (i > 0) ucol_close(workers[i].collator);
+    }
+    if (failed) { PyErr_SetString(PyExc_ValueError, "Failed to search in one or more strings"); goto end; }
+
+    ans = PyList_New(count);
+    if (ans == NULL) goto end;
+    for (i = 0; i < count; i++) {
+        temp = Py_BuildValue("ll", (long)positions[i], (long)lengths[i]);
+        if (temp == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+        PyList_SET_ITEM(ans, i, temp);
+    }
+
+end:
+    if (haystacks != NULL) { for (i = 0; i < count; i++) { if (haystacks[i] != NULL) free(haystacks[i]); } free(haystacks); }
+    if (sizes != NULL) free(sizes);
+    if (positions != NULL) free(positions);
+    if (lengths != NULL) free(lengths);
+    if (needle != NULL) free(needle);
+    Py_XDECREF(items);
+
+    return ans;
+} // }}}
+
 // Collator.contractions {{{
 static PyObject *
 icu_Collator_contractions(icu_Collator *self, PyObject *args) {
@@ -355,6 +840,119 @@ end:
     return Py_BuildValue("ii", order, len);
 } // }}}
 
+// Collator.partition_by_first_letter {{{
+
+#define PARTITION_LABEL_CAP 63
+
+static PyObject *
+icu_Collator_partition_by_first_letter(icu_Collator *self, PyObject *args) {
+    PyObject *strings = NULL, *items = NULL, *ans = NULL, *labels = NULL, *indices = NULL, *temp = NULL;
+    UChar **uchars = NULL;
+    int32_t *sizes = NULL, *bucket_of = NULL, *orders = NULL, *label_lens = NULL;
+    UChar (*label_chars)[PARTITION_LABEL_CAP + 1] = NULL;
+    Py_ssize_t count = 0, i = 0;
+    int32_t num_buckets = 0, b = 0, glen = 0, ulen = 0, order = 0;
+    UBreakIterator *bi = NULL;
+    UCollationElements *iter = NULL;
+    UChar upper[PARTITION_LABEL_CAP + 1];
+    UErrorCode status = U_ZERO_ERROR;
+    int failed = 0;
+    static const UChar space = 0x20;
+
+    if (!PyArg_ParseTuple(args, "O", &strings)) return NULL;
+    items = PySequence_Fast(strings, "strings must be a sequence");
+    if (items == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
+
+    uchars = (UChar**)calloc(count > 0 ? count : 1, sizeof(UChar*));
+    sizes = (int32_t*)calloc(count > 0 ? count : 1, sizeof(int32_t));
+    bucket_of = (int32_t*)calloc(count > 0 ? count : 1, sizeof(int32_t));
+    orders = (int32_t*)calloc(count > 0 ? count : 1, sizeof(int32_t));
+    label_lens = (int32_t*)calloc(count > 0 ? count : 1, sizeof(int32_t));
+    label_chars = calloc(count > 0 ? count : 1, sizeof(*label_chars));
+    if (uchars == NULL || sizes == NULL || bucket_of == NULL || orders == NULL || label_lens == NULL || label_chars == NULL) { PyErr_NoMemory(); goto end; }
+
+    for (i = 0; i < count; i++) {
+        uchars[i] = python_to_icu(PySequence_Fast_GET_ITEM(items, i), sizes + i);
+        if (uchars[i] == NULL) goto end;
+    }
+
+    bi = ubrk_open(UBRK_CHARACTER, NULL, NULL, 0, &status);
+    if (U_FAILURE(status)) { PyErr_SetString(PyExc_ValueError, u_errorName(status)); goto end; }
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < count && !failed; i++) {
+        const UChar *src = uchars[i];
+        int32_t sz = sizes[i];
+        // Like the python partition_by_first_letter(), empty strings go
+        // into the space bucket
+        if (sz == 0) { src = &space; sz = 1; }
+        status = U_ZERO_ERROR;
+        ubrk_setText(bi, src, sz, &status);
+        if (U_FAILURE(status)) { failed = 1; break; }
+        ubrk_first(bi);
+        glen = ubrk_next(bi);
+        if (glen == UBRK_DONE || glen <= 0) glen = 1;
+        if (glen > PARTITION_LABEL_CAP) glen = PARTITION_LABEL_CAP;
+        ulen = u_strToUpper(upper, PARTITION_LABEL_CAP, src, glen, NULL, &status);
+        if (U_FAILURE(status) || ulen < 1) { status = U_ZERO_ERROR; u_memcpy(upper, src, glen); ulen = glen; }
+        if (ulen > PARTITION_LABEL_CAP) ulen = PARTITION_LABEL_CAP;
+
+        iter = ucol_openElements(self->collator, upper, ulen, &status);
+        if (U_FAILURE(status)) { failed = 1; break; }
+        order = ucol_next(iter, &status);
+        ucol_closeElements(iter); iter = NULL;
+        if (U_FAILURE(status)) { failed = 1; break; }
+
+        // The number of distinct first letters is small, so a linear scan
+        // over the buckets seen so far beats any hashing overhead
+        for (b = 0; b < num_buckets; b++) {
+            if (orders[b] == order) break;
+        }
+        if (b == num_buckets) {
+            orders[b] = order;
+            u_memcpy(label_chars[b], upper, ulen);
+            label_lens[b] = ulen;
+            num_buckets++;
+        }
+        bucket_of[i] = b;
+    }
+    Py_END_ALLOW_THREADS;
+    if (failed) { PyErr_SetString(PyExc_ValueError, u_errorName(status)); goto end; }
+
+    labels = PyTuple_New(num_buckets);
+    if (labels == NULL) goto end;
+    for (b = 0; b < num_buckets; b++) {
+        temp = icu_to_python(label_chars[b], label_lens[b]);
+        if (temp == NULL) { Py_DECREF(labels); labels = NULL; goto end; }
+        PyTuple_SET_ITEM(labels, b, temp);
+    }
+    indices = PyTuple_New(count);
+    if (indices == NULL) goto end;
+    for (i = 0; i < count; i++) {
+#if PY_MAJOR_VERSION >= 3
+        temp = PyLong_FromLong((long)bucket_of[i]);
+#else
+        temp = PyInt_FromLong((long)bucket_of[i]);
+#endif
+        if (temp == NULL) { Py_DECREF(indices); indices = NULL; goto end; }
+        PyTuple_SET_ITEM(indices, i, temp);
+    }
+    ans = Py_BuildValue("OO", labels, indices);
+
+end:
+    if (bi != NULL) ubrk_close(bi);
+    if (uchars != NULL) { for (i = 0; i < count; i++) { if (uchars[i] != NULL) free(uchars[i]); } free(uchars); }
+    if (sizes != NULL) free(sizes);
+    if (bucket_of != NULL) free(bucket_of);
+    if (orders != NULL) free(orders);
+    if (label_lens != NULL) free(label_lens);
+    if (label_chars != NULL) free(label_chars);
+    Py_XDECREF(labels); Py_XDECREF(indices);
+    Py_XDECREF(items);
+    return ans;
+} // }}}
+
 // Collator.upper_first {{{
 static PyObject *
 icu_Collator_get_upper_first(icu_Collator *self, void *closure) {
@@ -388,6 +986,14 @@ static PyMethodDef icu_Collator_methods[] = {
      "sort_key(unicode object) -> Return a sort key for the given object as a bytestring. The idea is that these bytestring will sort using the builtin cmp function, just like the original unicode strings would sort in the current locale with ICU."
     },
 
+    {"sort_keys", (PyCFunction)icu_Collator_sort_keys, METH_O,
+     "sort_keys(iterable of unicode objects) -> Return a list of sort keys, one for every item in the iterable, as bytestrings. Equivalent to, but much faster than, calling sort_key() once per item, as all keys are generated in a single call with the GIL released."
+    },
+
+    {"enable_sort_key_cache", (PyCFunction)icu_Collator_enable_sort_key_cache, METH_VARARGS,
+     "enable_sort_key_cache(path) -> Use path as a persistent cache of sort keys for this collator. Keys for previously seen strings are read from the cache instead of being regenerated, and newly generated keys are appended to it. The cache is automatically discarded if the ICU collation data or the collator's strength/numeric configuration changes, and is disabled by changing either attribute, so configure the collator before enabling the cache."
+    },
+
     {"strcmp", (PyCFunction)icu_Collator_strcmp, METH_VARARGS,
      "strcmp(unicode object, unicode object) -> strcmp(a, b) <=> cmp(sorty_key(a), sort_key(b)), but faster."
     },
@@ -396,10 +1002,18 @@ static PyMethodDef icu_Collator_methods[] = {
         "find(pattern, source) -> returns the position and length of the first occurrence of pattern in source. Returns (-1, -1) if not found."
     },
 
+    {"find_all", (PyCFunction)icu_Collator_find_all, METH_VARARGS,
+        "find_all(pattern, sources) -> returns a list of (position, length) results, one for every string in sources, equivalent to calling find(pattern, source) on each. The searches are sharded over a pool of threads with a clone of this collator per thread, with the GIL released."
+    },
+
     {"contains", (PyCFunction)icu_Collator_contains, METH_VARARGS,
         "contains(pattern, source) -> return True iff the pattern was found in the source."
     },
 
+    {"partition_by_first_letter", (PyCFunction)icu_Collator_partition_by_first_letter, METH_VARARGS,
+        "partition_by_first_letter(strings) -> returns (labels, indices) where indices has one bucket index per string, grouping strings whose upper-cased first grapheme has the same collation order, and labels maps bucket index to that grapheme. The whole pass runs in C with the GIL released."
+    },
+
     {"contractions", (PyCFunction)icu_Collator_contractions, METH_NOARGS,
         "contractions() -> returns the contractions defined for this collator."
     },
@@ -517,6 +1131,7 @@ icu_Collator_clone(icu_Collator *self, PyObject *args)
 
     clone->collator = collator;
     clone->contractions = NULL;
+    clone->cache = NULL;  // The cache is not shared as it is not thread safe
 
     return (PyObject*) clone;
 
@@ -716,6 +1331,87 @@ icu_BreakIterator_split2(icu_BreakIterator *self, PyObject *args) {
 
 } // }}}
 
+// BreakIterator.split_into {{{
+static PyObject *
+icu_BreakIterator_split_into(icu_BreakIterator *self, PyObject *args) {
+
+    PyObject *buf_ = NULL;
+    Py_buffer view;
+    void *bufp = NULL;
+    int32_t *out = NULL;
+    Py_ssize_t buflen = 0, cap = 0, count = 0;
+    int32_t word_start = 0, p = 0, sz = 0, last_pos = 0, last_sz = 0;
+    int is_hyphen_sep = 0, leading_hyphen = 0, trailing_hyphen = 0, have_view = 0;
+    UChar sep = 0;
+
+    if (!PyArg_ParseTuple(args, "O", &buf_)) return NULL;
+    if (PyObject_GetBuffer(buf_, &view, PyBUF_WRITABLE | PyBUF_SIMPLE) == 0) {
+        have_view = 1; bufp = view.buf; buflen = view.len;
+    } else {
+#if PY_MAJOR_VERSION < 3
+        // array.array does not support the new buffer protocol on py2, fall
+        // back to the old-style writable buffer interface
+        PyErr_Clear();
+        if (PyObject_AsWriteBuffer(buf_, &bufp, &buflen) != 0) return NULL;
+#else
+        return NULL;
+#endif
+    }
+    out = (int32_t*)bufp;
+    cap = buflen / (2 * sizeof(int32_t));
+
+    // Same tokenization as split2(), but token offsets are written directly
+    // into the caller provided buffer, so no Python objects are created and
+    // the GIL can be released for the whole loop. Tokens that do not fit in
+    // the buffer are counted but not stored.
+    Py_BEGIN_ALLOW_THREADS;
+    p = ubrk_first(self->break_iterator);
+    while (p != UBRK_DONE) {
+        word_start = p; p = ubrk_next(self->break_iterator);
+        if (self->type == UBRK_WORD && ubrk_getRuleStatus(self->break_iterator) == UBRK_WORD_NONE)
+            continue;  // We are not at the start of a word
+        sz = (p == UBRK_DONE) ? self->text_len - word_start : p - word_start;
+        if (sz > 0) {
+            // ICU breaks on words containing hyphens, we do not want that, so we recombine manually
+            is_hyphen_sep = 0; leading_hyphen = 0; trailing_hyphen = 0;
+            if (word_start > 0) { // Look for a leading hyphen
+                sep = *(self->text + word_start - 1);
+                if (IS_HYPHEN_CHAR(sep)) {
+                    leading_hyphen = 1;
+                    if (last_pos > 0 && word_start - last_pos == 1) is_hyphen_sep = 1;
+                }
+            }
+            if (word_start + sz < self->text_len) { // Look for a trailing hyphen
+                sep = *(self->text + word_start + sz);
+                if (IS_HYPHEN_CHAR(sep)) trailing_hyphen = 1;
+            }
+            last_pos = p;
+#ifdef Py_UNICODE_WIDE
+            sz = u_countChar32(self->text + word_start, sz);
+            word_start = u_countChar32(self->text, word_start);
+#endif
+            if (is_hyphen_sep && count > 0) {
+                sz = last_sz + sz + trailing_hyphen;
+                last_sz = sz;
+                if (count <= cap) out[2 * (count - 1) + 1] = sz;
+            } else {
+                sz += leading_hyphen + trailing_hyphen;
+                last_sz = sz;
+                if (count < cap) {
+                    out[2 * count] = word_start - leading_hyphen;
+                    out[2 * count + 1] = sz;
+                }
+                count++;
+            }
+        }
+    }
+    Py_END_ALLOW_THREADS;
+
+    if (have_view) PyBuffer_Release(&view);
+    return Py_BuildValue("n", count);
+
+} // }}}
+
 static PyMethodDef icu_BreakIterator_methods[] = {
     {"set_text", (PyCFunction)icu_BreakIterator_set_text, METH_O,
      "set_text(unicode object) -> Set the text this iterator will operate on"
@@ -725,6 +1421,10 @@ static PyMethodDef icu_BreakIterator_methods[] = {
      "split2() -> Split the current text into tokens, returning a list of 2-tuples of the form (position of token, length of token). The numbers are suitable for indexing python strings regardless of narrow/wide builds."
     },
 
+    {"split_into", (PyCFunction)icu_BreakIterator_split_into, METH_VARARGS,
+     "split_into(buffer) -> Like split2(), but writes the (position, length) pairs as int32 values into the provided writable buffer and returns the number of tokens found, releasing the GIL while iterating. Tokens beyond the capacity of the buffer are counted but not stored, so the return value can be used to detect a too-small buffer."
+    },
+
     {"index", (PyCFunction)icu_BreakIterator_index, METH_O,
      "index(token) -> Find the index of the first match for token. Useful to find, for example, words that could also be a part of a larger word. For example, index('i') in 'string i' will be 7 not 3. Returns -1 if not found."
     },
@@ -817,6 +1517,80 @@ end:
 
 } // }}}
 
+// change_case_many {{{
+
+static PyObject* icu_change_case_many(PyObject *self, PyObject *args) {
+    char *locale = NULL;
+    PyObject *strings = NULL, *items = NULL, *ans = NULL, *temp = NULL;
+    int which = UPPER_CASE;
+    UErrorCode status = U_ZERO_ERROR;
+    UChar **inputs = NULL, *arena = NULL;
+    int32_t *sizes = NULL, *out_sizes = NULL;
+    size_t *offsets = NULL, arena_sz = 0, arena_pos = 0;
+    Py_ssize_t i = 0, count = 0;
+
+    if (!PyArg_ParseTuple(args, "Oiz", &strings, &which, &locale)) return NULL;
+    if (locale == NULL) {
+        PyErr_SetString(PyExc_NotImplementedError, "You must specify a locale");  // We deliberately use NotImplementedError so that this error can be unambiguously identified
+        return NULL;
+    }
+    items = PySequence_Fast(strings, "change_case_many() expects an iterable of unicode strings");
+    if (items == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
+
+    inputs = (UChar**)calloc(count + 1, sizeof(UChar*));
+    sizes = (int32_t*)calloc(count + 1, sizeof(int32_t));
+    out_sizes = (int32_t*)calloc(count + 1, sizeof(int32_t));
+    offsets = (size_t*)calloc(count + 1, sizeof(size_t));
+    if (inputs == NULL || sizes == NULL || out_sizes == NULL || offsets == NULL) { PyErr_NoMemory(); goto end; }
+
+    // Convert all inputs while holding the GIL, the case changes then run in
+    // one loop without it, writing into a single arena
+    for (i = 0; i < count; i++) {
+        inputs[i] = python_to_icu(PySequence_Fast_GET_ITEM(items, i), &sizes[i]);
+        if (inputs[i] == NULL) goto end;
+        offsets[i] = arena_sz;
+        arena_sz += 3 * sizes[i] + 1;  // Same estimate as change_case()
+    }
+    arena = (UChar*)calloc(arena_sz > 0 ? arena_sz : 1, sizeof(UChar));
+    if (arena == NULL) { PyErr_NoMemory(); goto end; }
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < count && U_SUCCESS(status); i++) {
+        arena_pos = offsets[i];
+        switch (which) {
+            case TITLE_CASE:
+                out_sizes[i] = u_strToTitle(arena + arena_pos, 3 * sizes[i] + 1, inputs[i], sizes[i], NULL, locale, &status);
+                break;
+            case UPPER_CASE:
+                out_sizes[i] = u_strToUpper(arena + arena_pos, 3 * sizes[i] + 1, inputs[i], sizes[i], locale, &status);
+                break;
+            default:
+                out_sizes[i] = u_strToLower(arena + arena_pos, 3 * sizes[i] + 1, inputs[i], sizes[i], locale, &status);
+        }
+    }
+    Py_END_ALLOW_THREADS;
+    if (U_FAILURE(status)) { PyErr_SetString(PyExc_ValueError, u_errorName(status)); goto end; }
+
+    ans = PyList_New(count);
+    if (ans == NULL) goto end;
+    for (i = 0; i < count; i++) {
+        temp = icu_to_python(arena + offsets[i], out_sizes[i]);
+        if (temp == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+        PyList_SET_ITEM(ans, i, temp);
+    }
+
+end:
+    if (inputs != NULL) { for (i = 0; i < count; i++) { if (inputs[i] != NULL) free(inputs[i]); } free(inputs); }
+    if (sizes != NULL) free(sizes);
+    if (out_sizes != NULL) free(out_sizes);
+    if (offsets != NULL) free(offsets);
+    if (arena != NULL) free(arena);
+    Py_XDECREF(items);
+    return ans;
+
+} // }}}
+
 // swap_case {{{
 
 static PyObject* icu_swap_case(PyObject *self, PyObject *input) {
@@ -1001,33 +1775,146 @@ end:
 
 } // }}}
 
-// normalize {{{
-typedef enum { NFC, NFKC, NFD, NFKD } NORM_MODES;
+// ord_strings {{{
+typedef struct {
+    const void *data;
+    Py_ssize_t len;
+    int kind;
+} OrdStringsItem;
 
 static PyObject *
-icu_normalize(PyObject *self, PyObject *args) {
+icu_ord_strings(PyObject *self, PyObject *args) {
+    PyObject *strings = NULL, *bufobj = NULL, *seq = NULL, *ans = NULL, *temp = NULL, *s = NULL;
+    Py_buffer view = {0};
+    OrdStringsItem *items = NULL;
+    void *bufp = NULL;
+    Py_ssize_t buflen = 0, n = 0, i = 0, j = 0, total = 0, pos = 0;
+    UChar32 *out = NULL;
+    int have_view = 0;
+#if PY_MAJOR_VERSION < 3 && !defined(Py_UNICODE_WIDE)
     UErrorCode status = U_ZERO_ERROR;
-    int32_t sz = 0, cap = 0, rsz = 0;
-    NORM_MODES mode;
-    UChar *dest = NULL, *source = NULL;
-    PyObject *ret = NULL, *src = NULL;
+    int32_t wrote = 0;
+#endif
 
-    if (!PyArg_ParseTuple(args, "iO", &mode, &src)) return NULL;
+    if (!PyArg_ParseTuple(args, "OO", &strings, &bufobj)) return NULL;
+    if (PyObject_GetBuffer(bufobj, &view, PyBUF_WRITABLE) == 0) {
+        have_view = 1; bufp = view.buf; buflen = view.len;
+    } else {
+#if PY_MAJOR_VERSION < 3
+        // array.array does not support the new buffer protocol on py2, fall
+        // back to the old-style writable buffer interface
+        PyErr_Clear();
+        if (PyObject_AsWriteBuffer(bufobj, &bufp, &buflen) != 0) return NULL;
+#else
+        return NULL;
+#endif
+    }
+    seq = PySequence_Fast(strings, "strings must be a sequence");
+    if (seq == NULL) goto end;
+    n = PySequence_Fast_GET_SIZE(seq);
+    items = (OrdStringsItem*)malloc((n > 0 ? n : 1) * sizeof(OrdStringsItem));
+    if (items == NULL) { PyErr_NoMemory(); goto end; }
+    // Collect the raw string data with the GIL held; the sequence keeps the
+    // strings alive, so the pointers stay valid for the conversion below
+    for (i = 0; i < n; i++) {
+        s = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyUnicode_CheckExact(s)) { PyErr_SetString(PyExc_TypeError, "Not a unicode string"); goto end; }
+#if PY_MAJOR_VERSION >= 3
+        if (PyUnicode_READY(s) == -1) goto end;
+        items[i].kind = PyUnicode_KIND(s);
+        items[i].data = PyUnicode_DATA(s);
+        items[i].len = PyUnicode_GET_LENGTH(s);
+#else
+        items[i].kind = 0;
+        items[i].data = (const void*)PyUnicode_AS_UNICODE(s);
+        items[i].len = PyUnicode_GET_SIZE(s);
+#endif
+        total += items[i].len;
+    }
+    if ((size_t)buflen < (size_t)total * sizeof(UChar32)) {
+        PyErr_SetString(PyExc_ValueError, "buffer too small to hold the codepoints of all the strings");
+        goto end;
+    }
+    out = (UChar32*)bufp;
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < n; i++) {
+#if PY_MAJOR_VERSION >= 3
+        if (items[i].kind == PyUnicode_4BYTE_KIND) {
+            memcpy(out + pos, items[i].data, items[i].len * sizeof(UChar32));
+            pos += items[i].len;
+        } else {
+            for (j = 0; j < items[i].len; j++)
+                out[pos++] = PyUnicode_READ(items[i].kind, items[i].data, j);
+        }
+#else
+#ifdef Py_UNICODE_WIDE
+        memcpy(out + pos, items[i].data, items[i].len * sizeof(UChar32));
+        pos += items[i].len;
+#else
+        u_strToUTF32(out + pos, (int32_t)items[i].len, &wrote, (const UChar*)items[i].data, (int32_t)items[i].len, &status);
+        if (U_FAILURE(status)) break;
+        pos += wrote;
+#endif
+#endif
+        items[i].len = pos;  // reused to report the end offset of this string
+    }
+    Py_END_ALLOW_THREADS;
+#if PY_MAJOR_VERSION < 3 && !defined(Py_UNICODE_WIDE)
+    if (U_FAILURE(status)) { PyErr_SetString(PyExc_ValueError, u_errorName(status)); goto end; }
+#endif
+
+    ans = PyTuple_New(n);
+    if (ans == NULL) goto end;
+    for (i = 0; i < n; i++) {
+#if PY_MAJOR_VERSION < 3
+        temp = PyInt_FromSsize_t(items[i].len);
+#else
+        temp = PyLong_FromSsize_t(items[i].len);
+#endif
+        if (temp == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+        PyTuple_SET_ITEM(ans, i, temp);
+    }
+end:
+    if (items != NULL) free(items);
+    Py_XDECREF(seq);
+    if (have_view) PyBuffer_Release(&view);
+    return ans;
+} // }}}
+
+// normalize {{{
+typedef enum { NFC, NFKC, NFD, NFKD } NORM_MODES;
+
+static const UNormalizer2*
+get_normalizer(NORM_MODES mode, UErrorCode *status) {
     const UNormalizer2 *n = NULL;
     switch (mode) {
         case NFC:
-            n = unorm2_getNFCInstance(&status);
+            n = unorm2_getNFCInstance(status);
             break;
         case NFKC:
-            n = unorm2_getNFKCInstance(&status);
+            n = unorm2_getNFKCInstance(status);
             break;
         case NFD:
-            n = unorm2_getNFDInstance(&status);
+            n = unorm2_getNFDInstance(status);
             break;
         case NFKD:
-            n = unorm2_getNFKDInstance(&status);
+            n = unorm2_getNFKDInstance(status);
             break;
     }
+    return n;
+}
+
+static PyObject *
+icu_normalize(PyObject *self, PyObject *args) {
+    UErrorCode status = U_ZERO_ERROR;
+    int32_t sz = 0, cap = 0, rsz = 0;
+    NORM_MODES mode;
+    UChar *dest = NULL, *source = NULL;
+    PyObject *ret = NULL, *src = NULL;
+
+    if (!PyArg_ParseTuple(args, "iO", &mode, &src)) return NULL;
+    const UNormalizer2 *n = get_normalizer(mode, &status);
     if (U_FAILURE(status)) {
         PyErr_SetString(PyExc_ValueError, u_errorName(status));
         goto end;
@@ -1064,6 +1951,75 @@ end:
     return ret;
 } // }}}
 
+// normalize_many {{{
+static PyObject *
+icu_normalize_many(PyObject *self, PyObject *args) {
+    UErrorCode status = U_ZERO_ERROR;
+    int32_t sz = 0, cap = 0, rsz = 0;
+    NORM_MODES mode;
+    UChar *dest = NULL, *source = NULL;
+    PyObject *strings = NULL, *seq = NULL, *ans = NULL, *item = NULL, *temp = NULL;
+    Py_ssize_t num, i;
+
+    if (!PyArg_ParseTuple(args, "iO", &mode, &strings)) return NULL;
+    const UNormalizer2 *n = get_normalizer(mode, &status);
+    if (U_FAILURE(status)) {
+        PyErr_SetString(PyExc_ValueError, u_errorName(status));
+        return NULL;
+    }
+    seq = PySequence_Fast(strings, "strings must be a sequence");
+    if (seq == NULL) return NULL;
+    num = PySequence_Fast_GET_SIZE(seq);
+    ans = PyTuple_New(num);
+    if (ans == NULL) goto end;
+
+    for (i = 0; i < num; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        source = python_to_icu(item, &sz);
+        if (source == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+        // Almost all real-world metadata is already normalized, so the
+        // quick-check lets us return the input object itself, unchanged
+        // and uncopied, running the full normalizer only on the misses.
+        if (unorm2_quickCheck(n, source, sz, &status) == UNORM_YES && U_SUCCESS(status)) {
+            Py_INCREF(item);
+            PyTuple_SET_ITEM(ans, i, item);
+        } else {
+            status = U_ZERO_ERROR;
+            if (cap < 2 * sz) {
+                cap = 2 * sz;
+                free(dest);
+                dest = (UChar*) calloc(cap, sizeof(UChar));
+                if (dest == NULL) { PyErr_NoMemory(); Py_DECREF(ans); ans = NULL; goto end; }
+            }
+            while (1) {
+                rsz = unorm2_normalize(n, source, sz, dest, cap, &status);
+                if (status == U_BUFFER_OVERFLOW_ERROR) {
+                    status = U_ZERO_ERROR;
+                    cap *= 2;
+                    dest = (UChar*) realloc(dest, cap*sizeof(UChar));
+                    if (dest == NULL) { PyErr_NoMemory(); Py_DECREF(ans); ans = NULL; goto end; }
+                    continue;
+                }
+                break;
+            }
+            if (U_FAILURE(status)) {
+                PyErr_SetString(PyExc_ValueError, u_errorName(status));
+                Py_DECREF(ans); ans = NULL; goto end;
+            }
+            temp = icu_to_python(dest, rsz);
+            if (temp == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+            PyTuple_SET_ITEM(ans, i, temp);
+        }
+        free(source); source = NULL;
+    }
+
+end:
+    if (source != NULL) free(source);
+    if (dest != NULL) free(dest);
+    Py_XDECREF(seq);
+    return ans;
+} // }}}
+
 // roundtrip {{{
 static PyObject *
 icu_roundtrip(PyObject *self, PyObject *src) {
@@ -1155,11 +2111,26 @@ icu_utf16_length(PyObject *self, PyObject *src) {
 } // }}}
 
 // Module initialization {{{
+static PyObject *
+icu_get_stats(PyObject *module, PyObject *args) {
+    return calibre_op_stats_to_dict(icu_op_stats, STAT_COUNT);
+}
+
+static PyObject *
+icu_reset_stats(PyObject *module, PyObject *args) {
+    calibre_op_stats_reset(icu_op_stats, STAT_COUNT);
+    Py_RETURN_NONE;
+}
+
 static PyMethodDef icu_methods[] = {
     {"change_case", icu_change_case, METH_VARARGS,
         "change_case(unicode object, which, locale) -> change case to one of UPPER_CASE, LOWER_CASE, TITLE_CASE"
     },
 
+    {"change_case_many", icu_change_case_many, METH_VARARGS,
+        "change_case_many(iterable of unicode objects, which, locale) -> Change the case of all the strings in one call, returning a list. Much faster than calling change_case() once per string as all conversions are done in a single loop with the GIL released."
+    },
+
     {"swap_case", icu_swap_case, METH_O,
         "swap_case(unicode object) -> swaps the case using the simple, locale independent unicode algorithm"
     },
@@ -1192,10 +2163,18 @@ static PyMethodDef icu_methods[] = {
      "ord_string(code) -> Convert a python unicode string to a tuple of unicode codepoints."
     },
 
+    {"ord_strings", icu_ord_strings, METH_VARARGS,
+     "ord_strings(strings, buffer) -> Write the UTF-32 codepoints of every string in strings consecutively into the writable buffer, releasing the GIL for the copy, and return a tuple of end offsets (in codepoints) one per string. Raises ValueError if the buffer is too small."
+    },
+
     {"normalize", icu_normalize, METH_VARARGS,
      "normalize(mode, unicode_text) -> Return a python unicode string which is normalized in the specified mode."
     },
 
+    {"normalize_many", icu_normalize_many, METH_VARARGS,
+     "normalize_many(mode, strings) -> Return a tuple with every string in strings normalized in the specified mode. Strings that are already normalized are returned as-is (the same object, no copy), detected via ICU's quick-check."
+    },
+
     {"roundtrip", icu_roundtrip, METH_O,
      "roundtrip(string) -> Roundtrip a unicode object from python to ICU back to python (useful for testing)"
     },
@@ -1212,6 +2191,14 @@ static PyMethodDef icu_methods[] = {
      "utf16_length(string) -> Return the length of a string (number of UTF-16 code points in the string). Useful on wide python builds where len() returns an incorrect answer if the string contains surrogate pairs."
     },
 
+    {"get_stats", icu_get_stats, METH_NOARGS,
+     "get_stats() -> The per-operation native work counters (collations, sort keys) as a dict of name to (calls, total_ns)."
+    },
+
+    {"reset_stats", icu_reset_stats, METH_NOARGS,
+     "reset_stats() -> Zero the per-operation native work counters."
+    },
+
     {NULL}  /* Sentinel */
 };
 
@@ -45,6 +45,11 @@ class TestICU(unittest.TestCase):
         self.ae(0, icu.strcmp(None, b''))
         self.ae(0, icu.strcmp(s, s.encode(sys.getdefaultencoding())))
 
+        # Test batch sort key generation
+        c = icu._icu.Collator('en')
+        self.ae(c.sort_keys(german), [c.sort_key(x) for x in german])
+        self.ae(c.sort_keys([]), [])
+
         # Test locales
         with make_collation_func('dsk', 'de', func='sort_key') as dsk:
             self.ae(german_good, sorted(german, key=dsk))
@@ -93,6 +98,11 @@ class TestICU(unittest.TestCase):
             self.ae(icu.capitalize(x), x[0].upper() + x[1:].lower())
             self.ae(icu.swapcase(x), x.swapcase())
 
+        words = ['a', 'Alice\'s code', 'macdonald\'s machIne', '02 the wars', '']
+        for which in (icu._icu.UPPER_CASE, icu._icu.LOWER_CASE, icu._icu.TITLE_CASE):
+            self.ae(icu._icu.change_case_many(words, which, 'en'),
+                    [icu._icu.change_case(w, which, 'en') for w in words])
+
     def test_find(self):
         ' Test searching for substrings '
         self.ae((1, 1), icu.find(b'a', b'1ab'))
@@ -112,6 +122,9 @@ class TestICU(unittest.TestCase):
         self.assertTrue(icu.contains('', ''))
         self.assertFalse(icu.contains('xxx', 'xx'))
         self.assertTrue(icu.primary_contains('pena', 'peña'))
+        c = icu._icu.Collator('en')
+        haystacks = ['1ab', 'abc', 'xyz', ''] * 10
+        self.ae(c.find_all('a', haystacks), [c.find('a', h) for h in haystacks])
 
     def test_collation_order(self):
         'Testing collation ordering'
@@ -142,6 +155,16 @@ class TestICU(unittest.TestCase):
         self.ae(icu._icu.chr(0x1f431), '\U0001f431')
         self.ae(icu._icu.ord_string('abc'*100), tuple(map(ord, 'abc'*100)))
         self.ae(icu._icu.ord_string('\U0001f431'), (0x1f431,))
+        import array
+        strings = ['abc'*100, '', '\U0001f431', 'x∙y']
+        flat, ends = [], []
+        for s in strings:
+            flat.extend(icu._icu.ord_string(s) if s else ())
+            ends.append(len(flat))
+        buf = array.array(str('i'), [0] * (len(flat) + 10))
+        self.ae(icu._icu.ord_strings(strings, buf), tuple(ends))
+        self.ae(list(buf[:len(flat)]), flat)
+        self.assertRaises(ValueError, icu._icu.ord_strings, strings, array.array(str('i'), [0]))
 
     def test_character_name(self):
         ' Test character naming '
@@ -162,7 +185,8 @@ class TestICU(unittest.TestCase):
 
     def test_break_iterator(self):
         ' Test the break iterator '
-        from calibre.spell.break_iterator import split_into_words as split, index_of, split_into_words_and_positions
+        import array
+        from calibre.spell.break_iterator import split_into_words as split, index_of, split_into_words_and_positions, split_into
         for q in ('one two three', ' one two three', 'one\ntwo  three ', ):
             self.ae(split(unicode_type(q)), ['one', 'two', 'three'], 'Failed to split: %r' % q)
         self.ae(split(u'I I\'m'), ['I', "I'm"])
@@ -171,6 +195,11 @@ class TestICU(unittest.TestCase):
         self.ae(split(u'-one a-b-c-d e'), ['-one', 'a-b-c-d', 'e'])
         self.ae(split(u'-one -a-b-c-d- e'), ['-one', '-a-b-c-d-', 'e'])
         self.ae(split_into_words_and_positions('one \U0001f431 three'), [(0, 3), (7 if icu.is_narrow_build else 6, 5)])
+        buf = array.array(b'i' if sys.version_info.major < 3 else 'i', [0] * 16)
+        for q in ('one two three', 'out-of-the-box', '-one two-', ''):
+            n = split_into(q, buf)
+            self.ae(split_into_words_and_positions(q), [(buf[2*i], buf[2*i + 1]) for i in range(n)])
+        self.ae(3, split_into('one two three', array.array(b'i' if sys.version_info.major < 3 else 'i', [0, 0])))
         for needle, haystack, pos in (
                 ('word', 'a word b', 2),
                 ('word', 'a word', 2),
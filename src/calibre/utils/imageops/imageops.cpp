@@ -8,6 +8,9 @@
 #include "imageops.h"
 #include <stdexcept>
 #include <QVector>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 #include <cmath>
 
 // Macros {{{
@@ -55,93 +58,267 @@ typedef struct
 } HistogramListItem;
 // }}}
 
+// Make buffer a detached image of the same size and format as img, reusing
+// its existing allocation when possible. Used by the filters that render
+// into a destination buffer, so that ImagePipeline can ping-pong between
+// two long lived buffers instead of allocating one per stage.
+static void prep_buffer(QImage &buffer, const QImage &img) {
+    if (buffer.width() != img.width() || buffer.height() != img.height() || buffer.format() != img.format() || !buffer.isDetached())
+        buffer = QImage(img.width(), img.height(), img.format());
+    if (buffer.isNull()) throw std::bad_alloc();
+}
+
+// Parallel bands {{{
+class BandRunnable : public QRunnable {
+public:
+    BandRunnable(band_func f, void *ctx, int start, int limit) : f(f), ctx(ctx), start(start), limit(limit) {}
+    virtual void run() { f(ctx, start, limit); }
+private:
+    band_func f;
+    void *ctx;
+    int start, limit;
+};
+
+void run_in_bands(band_func f, void *ctx, const int count) {
+    int i, band_size, start = 0;
+    int num_bands = QThread::idealThreadCount();
+    // Keep at least 64 rows/columns per band so we do not spawn threads for
+    // tiny images where the overhead would dominate.
+    num_bands = MIN(num_bands, count / 64);
+    if (num_bands < 2) { f(ctx, 0, count); return; }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(num_bands - 1);
+    band_size = count / num_bands;
+    for (i = 0; i < num_bands - 1; i++, start += band_size)
+        pool.start(new BandRunnable(f, ctx, start, start + band_size));
+    f(ctx, start, count);  // last band runs on the calling thread
+    pool.waitForDone();
+}
+// }}}
+
 // Remove borders (auto-trim) {{{
+#define DISTANCE(r, g, b) (SQUARE(r - red_average) + SQUARE(g - green_average) + SQUARE(b - blue_average))
+
+// The original homogeneity test: normalized per-pixel squared distance from
+// the row's average color, compared against fuzz. Also used as the fallback
+// when the vectorized bounds below cannot classify a row.
+static bool row_is_uniform_exact(const QRgb *row, const unsigned int width, const double fuzz,
+        double *reds, double *greens, double *blues,
+        double &red_average, double &green_average, double &blue_average) {
+    unsigned int c = 0;
+    const QRgb *pixel = NULL;
+    double distance = 0;
+
+    red_average = 0; green_average = 0; blue_average = 0;
+    for (c = 0, pixel = row; c < width; c++, pixel++) {
+        reds[c] = qRed(*pixel) / 255.0; greens[c] = qGreen(*pixel) / 255.0; blues[c] = qBlue(*pixel) / 255.0;
+        red_average += reds[c]; green_average += greens[c]; blue_average += blues[c];
+    }
+    red_average /= MAX(1, width); green_average /= MAX(1, width); blue_average /= MAX(1, width);
+    for (c = 0; c < width && distance <= fuzz; c++)
+        distance = MAX(distance, DISTANCE(reds[c], greens[c], blues[c]));
+    return distance <= fuzz;
+}
+
+#ifdef IMAGEOPS_HAS_SSE2
+// Exact per-channel sums and min/max of a row, four pixels per iteration.
+// The channel bytes are masked out and summed with psadbw, which is exact
+// integer arithmetic, so averages derived from these sums carry none of the
+// rounding drift of sequential double summation.
+static void border_row_stats(const QRgb *row, const unsigned int width,
+        quint64 sums[3], int mins[3], int maxs[3]) {
+    unsigned int c = 0;
+    int i;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bmask = _mm_set1_epi32(0x000000ff);
+    const __m128i gmask = _mm_set1_epi32(0x0000ff00);
+    const __m128i rmask = _mm_set1_epi32(0x00ff0000);
+    __m128i sr = zero, sg = zero, sb = zero;
+    __m128i mn = _mm_set1_epi32(-1), mx = zero;
+    union { __m128i v; unsigned char b[16]; quint64 q[2]; } u;
+
+    sums[0] = sums[1] = sums[2] = 0;
+    mins[0] = mins[1] = mins[2] = 255;
+    maxs[0] = maxs[1] = maxs[2] = 0;
+    for (; c + 4 <= width; c += 4) {
+        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + c));
+        // psadbw sums all sixteen bytes, and only the wanted channel's bytes
+        // survive the mask, so no shifting is needed
+        sb = _mm_add_epi64(sb, _mm_sad_epu8(_mm_and_si128(px, bmask), zero));
+        sg = _mm_add_epi64(sg, _mm_sad_epu8(_mm_and_si128(px, gmask), zero));
+        sr = _mm_add_epi64(sr, _mm_sad_epu8(_mm_and_si128(px, rmask), zero));
+        mn = _mm_min_epu8(mn, px);
+        mx = _mm_max_epu8(mx, px);
+    }
+    u.v = sr; sums[0] = u.q[0] + u.q[1];
+    u.v = sg; sums[1] = u.q[0] + u.q[1];
+    u.v = sb; sums[2] = u.q[0] + u.q[1];
+    if (c) {  // pixels are laid out B,G,R,A in memory
+        u.v = mn;
+        for (i = 0; i < 4; i++) {
+            mins[0] = MIN(mins[0], u.b[4*i + 2]); mins[1] = MIN(mins[1], u.b[4*i + 1]); mins[2] = MIN(mins[2], u.b[4*i]);
+        }
+        u.v = mx;
+        for (i = 0; i < 4; i++) {
+            maxs[0] = MAX(maxs[0], u.b[4*i + 2]); maxs[1] = MAX(maxs[1], u.b[4*i + 1]); maxs[2] = MAX(maxs[2], u.b[4*i]);
+        }
+    }
+    for (; c < width; c++) {
+        const int pr = qRed(row[c]), pg = qGreen(row[c]), pb = qBlue(row[c]);
+        sums[0] += pr; sums[1] += pg; sums[2] += pb;
+        mins[0] = MIN(mins[0], pr); mins[1] = MIN(mins[1], pg); mins[2] = MIN(mins[2], pb);
+        maxs[0] = MAX(maxs[0], pr); maxs[1] = MAX(maxs[1], pg); maxs[2] = MAX(maxs[2], pb);
+    }
+}
+#endif
+
 static unsigned int read_border_row(const QImage &img, const unsigned int width, const unsigned int height, double *reds, const double fuzz, const bool top) {
-	unsigned int r = 0, c = 0, start = 0, delta = top ? 1 : -1, ans = 0;
-	const QRgb *row = NULL, *pixel = NULL;
+	unsigned int r = 0, start = 0, delta = top ? 1 : -1, ans = 0;
+	const QRgb *row = NULL, *prev = NULL;
     double *greens = NULL, *blues = NULL;
-	double red_average = 0, green_average = 0, blue_average = 0, distance = 0, first_red = 0, first_green = 0, first_blue = 0;
-#define DISTANCE(r, g, b) (SQUARE(r - red_average) + SQUARE(g - green_average) + SQUARE(b - blue_average))
+	double red_average = 0, green_average = 0, blue_average = 0, first_red = 0, first_green = 0, first_blue = 0;
+    bool uniform = false;
 
     greens = reds + width + 1; blues = greens + width + 1;
 	start = top ? 0 : height - 1;
 
 	for (r = start; top ? height - r : r > 0; r += delta) {
 		row = reinterpret_cast<const QRgb*>(img.constScanLine(r));
-        red_average = 0; green_average = 0; blue_average = 0;
-		for (c = 0, pixel = row; c < width; c++, pixel++) {
-            reds[c] = qRed(*pixel) / 255.0; greens[c] = qGreen(*pixel) / 255.0; blues[c] = qBlue(*pixel) / 255.0;
-            red_average += reds[c]; green_average += greens[c]; blue_average += blues[c];
-		}
-        red_average /= MAX(1, width); green_average /= MAX(1, width); blue_average /= MAX(1, width);
-        distance = 0;
-        for (c = 0; c < width && distance <= fuzz; c++)
-            distance = MAX(distance, DISTANCE(reds[c], greens[c], blues[c]));
-        if (distance > fuzz) break;  // row is not homogeneous
+        // Borders are very often runs of byte-identical rows; such a row has
+        // the same average as the row before it and needs no re-analysis
+        if (prev != NULL && memcmp(row, prev, width * sizeof(QRgb)) == 0) {
+            prev = row;
+            ans += 1;
+            continue;
+        }
+#ifdef IMAGEOPS_HAS_SSE2
+        {
+            // Classify the row from its per-channel ranges: every pixel is
+            // within (range/255)^2 per channel of the average, and some pixel
+            // is at least (range/2/255)^2 away in the widest channel, which
+            // decides all but rows sitting essentially at the fuzz threshold
+            // without the per-pixel distance pass
+            quint64 sums[3];
+            int mins[3], maxs[3];
+            border_row_stats(row, width, sums, mins, maxs);
+            const double dr = (maxs[0] - mins[0]) / 255.0, dg = (maxs[1] - mins[1]) / 255.0, db = (maxs[2] - mins[2]) / 255.0;
+            const double widest = MAX(dr, (MAX(dg, db)));
+            if (SQUARE(widest / 2) > fuzz) break;  // some pixel is certainly too far from the average
+            if (SQUARE(dr) + SQUARE(dg) + SQUARE(db) <= fuzz) {
+                red_average = sums[0] / (255.0 * (MAX(1u, width)));
+                green_average = sums[1] / (255.0 * (MAX(1u, width)));
+                blue_average = sums[2] / (255.0 * (MAX(1u, width)));
+                uniform = true;
+            } else {
+                uniform = row_is_uniform_exact(row, width, fuzz, reds, greens, blues, red_average, green_average, blue_average);
+            }
+        }
+#else
+        uniform = row_is_uniform_exact(row, width, fuzz, reds, greens, blues, red_average, green_average, blue_average);
+#endif
+        if (!uniform) break;  // row is not homogeneous
         if (r == start) { first_red = red_average; first_green = green_average; first_blue = blue_average; }
         else if (DISTANCE(first_red, first_green, first_blue) > fuzz) break;  // this row's average color is far from the previous row's average color
+        prev = row;
         ans += 1;
 	}
 	return ans;
 }
 
-QImage remove_borders(const QImage &image, double fuzz) {
-    ScopedGILRelease PyGILRelease;
+// Find the rectangle of img that is left after trimming homogeneous
+// borders, without modifying img. Returns img.rect() when nothing can be
+// trimmed. vbuf is scratch space, reused across calls by ImagePipeline.
+static QRect content_rect(const QImage &img, double fuzz, QVector<double> &vbuf) {
 	double *buf = NULL;
-	QImage img = image, timg;
+	QImage timg;
 	QTransform transpose;
 	unsigned int width = img.width(), height = img.height();
 	unsigned int top_border = 0, bottom_border = 0, left_border = 0, right_border = 0;
-    bool bad_alloc = false;
-    QVector<double> vbuf = QVector<double>();
 
-    ENSURE32(img)
     vbuf.resize(3*(MAX(width, height)+1));
 	buf = vbuf.data();
 	fuzz /= 255.0;
 
 	top_border = read_border_row(img, width, height, buf, fuzz, true);
-    if (top_border < height - 1) {
-        bottom_border = read_border_row(img, width, height, buf, fuzz, false);
-        if (bottom_border < height - 1) {
-            transpose.rotate(90);
-            timg = img.transformed(transpose);
-            if (timg.isNull()) bad_alloc = true;
-            else {
-                left_border = read_border_row(timg, height, width, buf, fuzz, true);
-                if (left_border < width - 1) {
-                    right_border = read_border_row(timg, height, width, buf, fuzz, false);
-                    if (right_border < width - 1) {
-                        if (left_border || right_border || top_border || bottom_border) {
-                            // printf("111111 l=%d t=%d r=%d b=%d\n", left_border, top_border, right_border, bottom_border);
-                            img = img.copy(left_border, top_border, width - left_border - right_border, height - top_border - bottom_border);
-                            if (img.isNull()) bad_alloc = true;
-                        }
-                    }
-                }
-            }
-        }
-    }
+    if (top_border >= height - 1) return img.rect();
+    bottom_border = read_border_row(img, width, height, buf, fuzz, false);
+    if (bottom_border >= height - 1) return img.rect();
+    transpose.rotate(90);
+    timg = img.transformed(transpose);
+    if (timg.isNull()) throw std::bad_alloc();
+    left_border = read_border_row(timg, height, width, buf, fuzz, true);
+    if (left_border >= width - 1) return img.rect();
+    right_border = read_border_row(timg, height, width, buf, fuzz, false);
+    if (right_border >= width - 1) return img.rect();
+    // printf("111111 l=%d t=%d r=%d b=%d\n", left_border, top_border, right_border, bottom_border);
+    return QRect(left_border, top_border, width - left_border - right_border, height - top_border - bottom_border);
+}
 
-    if (bad_alloc) throw std::bad_alloc();
+QImage remove_borders(const QImage &image, double fuzz) {
+    ScopedGILRelease PyGILRelease;
+	QImage img = image;
+    QVector<double> vbuf = QVector<double>();
+    QRect rect;
+
+    ENSURE32(img)
+    rect = content_rect(img, fuzz, vbuf);
+    if (rect != img.rect()) {
+        img = img.copy(rect);
+        if (img.isNull()) throw std::bad_alloc();
+    }
     return img;
 }
 // }}}
 
-QImage grayscale(const QImage &image) { // {{{
-    ScopedGILRelease PyGILRelease;
-    QImage img = image;
+// grayscale() {{{
+static void grayscale_in_place(QImage &img) {  // img must be Format_(A)RGB32
     QRgb *row = NULL, *pixel = NULL;
     int r = 0, gray = 0, width = img.width(), height = img.height();
 
-    ENSURE32(img);
     for (r = 0; r < height; r++) {
 		row = reinterpret_cast<QRgb*>(img.scanLine(r));
-        for (pixel = row; pixel < row + width; pixel++) {
+        pixel = row;
+#ifdef IMAGEOPS_HAS_SSE2
+        {
+            // Four pixels per iteration. qGray() is (11*r + 16*g + 5*b)/32,
+            // which maps onto a single multiply-add over the [B G R A] byte
+            // layout of Format_(A)RGB32 pixels, so the results are bit
+            // identical to the scalar loop below.
+            const __m128i coeff = _mm_set_epi16(0, 11, 16, 5, 0, 11, 16, 5);
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i opaque = _mm_set1_epi32(0xff000000);
+            __m128i px, lo, hi, g;
+            for (; pixel + 4 <= row + width; pixel += 4) {
+                px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixel));
+                lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coeff);
+                hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coeff);
+                // add the two 32bit partial sums of each pixel
+                lo = _mm_add_epi32(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+                hi = _mm_add_epi32(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+                g = _mm_unpacklo_epi64(_mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 0, 2, 0)),
+                                       _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 0, 2, 0)));
+                g = _mm_srli_epi32(g, 5);
+                // replicate the gray value into all three channels, alpha opaque
+                g = _mm_or_si128(_mm_or_si128(g, _mm_slli_epi32(g, 8)),
+                        _mm_or_si128(_mm_slli_epi32(g, 16), opaque));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(pixel), g);
+            }
+        }
+#endif
+        for (; pixel < row + width; pixel++) {
             gray = qGray(*pixel);
             *pixel = qRgb(gray, gray, gray);
         }
     }
+}
+
+QImage grayscale(const QImage &image) {
+    ScopedGILRelease PyGILRelease;
+    QImage img = image;
+
+    ENSURE32(img);
+    grayscale_in_place(img);
 	return img;
 } // }}}
 
@@ -150,58 +327,40 @@ QImage grayscale(const QImage &image) { // {{{
     r+=((weight))*(qRed((pixel))); g+=((weight))*(qGreen((pixel))); \
     b+=((weight))*(qBlue((pixel)));
 
-static QImage convolve(const QImage &image, int matrix_size, float *matrix) {
-    int i, x, y, w, h, matrix_x, matrix_y;
-    int edge = matrix_size/2;
-    QRgb *dest, *s, **scanblock;
-    const QRgb *src = NULL;
-    float *m, *normalize_matrix, normalize, r, g, b;
-    QImage img(image);
-    QVector<QRgb*> buf1 = QVector<QRgb*>(matrix_size);
-    QVector<float> buf2 = QVector<float>(matrix_size * matrix_size);
-
-    if(!(matrix_size % 2))
-        throw std::out_of_range("Convolution kernel width must be an odd number");
-
-    w = img.width();
-    h = img.height();
-    if(w < 3 || h < 3) return img;
-
-    ENSURE32(img);
-
-    QImage buffer(w, h, img.format());
-    if (buffer.isNull()) throw std::bad_alloc();
-    buf1.resize(matrix_size);
+typedef struct {
+    const uchar *src_data;
+    uchar *dest_data;
+    int src_stride, dest_stride;  // in bytes
+    const float *normalize_matrix;
+    int matrix_size, w, h;
+} ConvolveCtx;
+
+static void convolve_band(void *vctx, const int y_start, const int y_limit) {
+    ConvolveCtx *ctx = reinterpret_cast<ConvolveCtx*>(vctx);
+    int i, x, y, matrix_x, matrix_y;
+    const int matrix_size = ctx->matrix_size, w = ctx->w, h = ctx->h;
+    const int edge = matrix_size/2;
+    QRgb *dest;
+    const QRgb *src = NULL, *s, **scanblock;
+    const float *m;
+    float r, g, b;
+    QVector<const QRgb*> buf1 = QVector<const QRgb*>(matrix_size);
     scanblock = buf1.data();
-    buf2.resize(matrix_size * matrix_size);
-    normalize_matrix = buf2.data();
 
-    // create normalized matrix
-    normalize = 0.0;
-    for(i=0; i < matrix_size*matrix_size; ++i)
-        normalize += matrix[i];
-    if(std::abs(normalize) <=  M_EPSILON)
-        normalize = 1.0;
-    normalize = 1.0/normalize;
-    for(i=0; i < matrix_size*matrix_size; ++i)
-        normalize_matrix[i] = normalize*matrix[i];
-
-    // apply
-
-    for(y=0; y < h; ++y){
-        src = reinterpret_cast<const QRgb*>(img.constScanLine(y));
-        dest = (QRgb *)buffer.scanLine(y);
+    for(y=y_start; y < y_limit; ++y){
+        src = reinterpret_cast<const QRgb*>(ctx->src_data + y*ctx->src_stride);
+        dest = reinterpret_cast<QRgb*>(ctx->dest_data + y*ctx->dest_stride);
         // Read in scanlines to pixel neighborhood. If the scanline is outside
         // the image use the top or bottom edge.
         for(x=y-edge, i=0; x <= y+edge; ++i, ++x){
-            scanblock[i] = (QRgb *)
-                img.scanLine((x < 0) ? 0 : (x > h-1) ? h-1 : x);
+            scanblock[i] = reinterpret_cast<const QRgb*>(
+                ctx->src_data + ((x < 0) ? 0 : (x > h-1) ? h-1 : x)*ctx->src_stride);
         }
         // Now we are about to start processing scanlines. First handle the
         // part where the pixel neighborhood extends off the left edge.
         for(x=0; x-edge < 0 ; ++x){
             r = g = b = 0.0;
-            m = normalize_matrix;
+            m = ctx->normalize_matrix;
             for(matrix_y = 0; matrix_y < matrix_size; ++matrix_y){
                 s = scanblock[matrix_y];
                 matrix_x = -edge;
@@ -223,7 +382,7 @@ static QImage convolve(const QImage &image, int matrix_size, float *matrix) {
         // Okay, now process the middle part where the entire neighborhood
         // is on the image.
         for(; x+edge < w; ++x){
-            m = normalize_matrix;
+            m = ctx->normalize_matrix;
             r = g = b = 0.0;
             for(matrix_y = 0; matrix_y < matrix_size; ++matrix_y){
                 s = scanblock[matrix_y] + (x-edge);
@@ -241,7 +400,7 @@ static QImage convolve(const QImage &image, int matrix_size, float *matrix) {
         // the right edge of the image
         for(; x < w; ++x){
             r = g = b = 0.0;
-            m = normalize_matrix;
+            m = ctx->normalize_matrix;
             for(matrix_y = 0; matrix_y < matrix_size; ++matrix_y){
                 s = scanblock[matrix_y];
                 s += x-edge;
@@ -263,8 +422,49 @@ static QImage convolve(const QImage &image, int matrix_size, float *matrix) {
                             (unsigned char)b, qAlpha(*src++));
         }
     }
+}
+
+static void convolve_into(const QImage &image, int matrix_size, float *matrix, QImage &buffer) {
+    int i, w, h;
+    float *normalize_matrix, normalize;
+    QImage img(image);
+    QVector<float> buf2 = QVector<float>(matrix_size * matrix_size);
+    ConvolveCtx ctx;
+
+    if(!(matrix_size % 2))
+        throw std::out_of_range("Convolution kernel width must be an odd number");
+
+    w = img.width();
+    h = img.height();
+    if(w < 3 || h < 3) {
+        buffer = img.copy();
+        if (buffer.isNull()) throw std::bad_alloc();
+        return;
+    }
+
+    ENSURE32(img);
+
+    prep_buffer(buffer, img);
+    buf2.resize(matrix_size * matrix_size);
+    normalize_matrix = buf2.data();
+
+    // create normalized matrix
+    normalize = 0.0;
+    for(i=0; i < matrix_size*matrix_size; ++i)
+        normalize += matrix[i];
+    if(std::abs(normalize) <=  M_EPSILON)
+        normalize = 1.0;
+    normalize = 1.0/normalize;
+    for(i=0; i < matrix_size*matrix_size; ++i)
+        normalize_matrix[i] = normalize*matrix[i];
 
-    return buffer;
+    // apply, one horizontal band of rows per core. Rows only read from the
+    // source image so the bands are independent.
+    ctx.src_data = img.constBits(); ctx.dest_data = buffer.bits();
+    ctx.src_stride = img.bytesPerLine(); ctx.dest_stride = buffer.bytesPerLine();
+    ctx.normalize_matrix = normalize_matrix; ctx.matrix_size = matrix_size;
+    ctx.w = w; ctx.h = h;
+    run_in_bands(convolve_band, &ctx, h);
 }
 
 static int default_convolve_matrix_size(const float radius, const float sigma, const bool quality) {
@@ -295,8 +495,8 @@ static int default_convolve_matrix_size(const float radius, const float sigma, c
 
 // }}}
 
-QImage gaussian_sharpen(const QImage &img, const float radius, const float sigma, const bool high_quality) {  // {{{
-    ScopedGILRelease PyGILRelease;
+// gaussian_sharpen() {{{
+static void gaussian_sharpen_into(const QImage &img, const float radius, const float sigma, const bool high_quality, QImage &buffer) {
     int matrix_size = default_convolve_matrix_size(radius, sigma, high_quality);
     int len = matrix_size*matrix_size;
     QVector<float> buf = QVector<float>(len);
@@ -316,7 +516,13 @@ QImage gaussian_sharpen(const QImage &img, const float radius, const float sigma
     }
 
     matrix[i/2]=(-2.0)*normalize;
-    QImage result(convolve(img, matrix_size, matrix));
+    convolve_into(img, matrix_size, matrix, buffer);
+}
+
+QImage gaussian_sharpen(const QImage &img, const float radius, const float sigma, const bool high_quality) {
+    ScopedGILRelease PyGILRelease;
+    QImage result;
+    gaussian_sharpen_into(img, radius, sigma, high_quality, result);
     return(result);
 } // }}}
 
@@ -435,12 +641,45 @@ static void blur_scan_line(const float* kernel, const int kern_width, const QRgb
     }
 }
 
-QImage gaussian_blur(const QImage &image, const float radius, const float sigma) {
-    ScopedGILRelease PyGILRelease;
-    int kern_width, x, y, w, h;
-    QRgb *src;
+typedef struct {
+    const float *kernel;
+    int kern_width;
+    const uchar *src_data;
+    uchar *dest_data;
+    int src_stride, dest_stride;  // in bytes
+    int columns;
+} BlurRowsCtx;
+
+static void blur_rows_band(void *vctx, const int y_start, const int y_limit) {
+    BlurRowsCtx *ctx = reinterpret_cast<BlurRowsCtx*>(vctx);
+    int y;
+    for(y=y_start; y < y_limit; ++y)
+        blur_scan_line(ctx->kernel, ctx->kern_width,
+                reinterpret_cast<const QRgb*>(ctx->src_data + y*ctx->src_stride),
+                reinterpret_cast<QRgb*>(ctx->dest_data + y*ctx->dest_stride), ctx->columns, 1);
+}
+
+typedef struct {
+    const float *kernel;
+    int kern_width;
+    QRgb *data;
+    int rows, row_stride;  // row_stride in pixels
+} BlurColsCtx;
+
+static void blur_cols_band(void *vctx, const int x_start, const int x_limit) {
+    BlurColsCtx *ctx = reinterpret_cast<BlurColsCtx*>(vctx);
+    int x;
+    for(x=x_start; x < x_limit; ++x)
+        blur_scan_line(ctx->kernel, ctx->kern_width, ctx->data+x, ctx->data+x,
+                ctx->rows, ctx->row_stride);
+}
+
+static void gaussian_blur_into(const QImage &image, const float radius, const float sigma, QImage &buffer) {
+    int kern_width, w, h;
     QImage img(image);
     QVector<float> kernel;
+    BlurRowsCtx rctx;
+    BlurColsCtx cctx;
 
     if(sigma == 0.0) throw std::out_of_range("Zero sigma is invalid for convolution");
 
@@ -468,69 +707,108 @@ QImage gaussian_blur(const QImage &image, const float radius, const float sigma)
     // allocate destination image
     w = img.width();
     h = img.height();
-    QImage buffer(w, h, img.format());
-    if (buffer.isNull()) throw std::bad_alloc();
+    prep_buffer(buffer, img);
+
+    // The separable kernel passes parallelize trivially: rows are
+    // independent in the first pass, columns in the second.
+
+    // blur image rows
+    rctx.kernel = kernel.data(); rctx.kern_width = kern_width;
+    rctx.src_data = img.constBits(); rctx.dest_data = buffer.bits();
+    rctx.src_stride = img.bytesPerLine(); rctx.dest_stride = buffer.bytesPerLine();
+    rctx.columns = w;
+    run_in_bands(blur_rows_band, &rctx, h);
+
+    // blur image columns, in place in the buffer
+    cctx.kernel = kernel.data(); cctx.kern_width = kern_width;
+    cctx.data = reinterpret_cast<QRgb *>(buffer.bits());
+    cctx.rows = h; cctx.row_stride = w;
+    run_in_bands(blur_cols_band, &cctx, w);
+}
 
-    //blur image rows
-    for(y=0; y < h; ++y)
-        blur_scan_line(kernel.data(), kern_width, reinterpret_cast<const QRgb *>(img.constScanLine(y)),
-                                   reinterpret_cast<QRgb *>(buffer.scanLine(y)), img.width(), 1);
-
-    // blur image columns
-    src = reinterpret_cast<QRgb *>(buffer.scanLine(0));
-    for(x=0; x < w; ++x)
-        blur_scan_line(kernel.data(), kern_width, src+x, src+x, img.height(),
-                                   img.width());
-    // finish up
+QImage gaussian_blur(const QImage &image, const float radius, const float sigma) {
+    ScopedGILRelease PyGILRelease;
+    QImage buffer;
+    gaussian_blur_into(image, radius, sigma, buffer);
     return(buffer);
 }
 // }}}
 
 // despeckle() {{{
 
-static inline void hull(const int x_offset, const int y_offset, const int w, const int h, unsigned char *f, unsigned char *g, const int polarity) {
+// Each hull stage reads only from one byte plane and writes only to the
+// other (stage one reads f and writes g, stage two reads g and writes f),
+// so within a stage every row is independent and the stage runs across
+// row bands, with the stage boundary acting as the barrier. The band
+// functions need no scratch of their own: they share the two planes owned
+// by the caller, which ImagePipeline and the tiled variant already reuse
+// across calls.
+typedef struct {
+    const unsigned char *src;
+    unsigned char *dest;
+    int x_offset, y_offset, w, polarity;
+} HullCtx;
+
+static void hull_stage1_band(void *vctx, const int y_start, const int y_limit) {
+    HullCtx *ctx = reinterpret_cast<HullCtx*>(vctx);
+    const int w = ctx->w, stride = w + 2;
     int x, y, v;
-    unsigned char *p, *q, *r, *s;
-    p = f+(w+2); q = g+(w+2);
-    r = p+(y_offset*(w+2)+x_offset);
-    for(y=0; y < h; ++y, ++p, ++q, ++r){
-        ++p; ++q; ++r;
-        if(polarity > 0){
-            for(x=w; x > 0; --x, ++p, ++q, ++r){
-                v = (*p);
-                if((int)*r >= (v+2)) v += 1;
-                *q = (unsigned char)v;
+    for (y = y_start; y < y_limit; y++) {
+        const unsigned char *p = ctx->src + (y + 1)*stride + 1;
+        const unsigned char *r = p + ctx->y_offset*stride + ctx->x_offset;
+        unsigned char *q = ctx->dest + (y + 1)*stride + 1;
+        if (ctx->polarity > 0) {
+            for (x = 0; x < w; x++) {
+                v = p[x];
+                if ((int)r[x] >= (v + 2)) v += 1;
+                q[x] = (unsigned char)v;
             }
         }
-        else{
-            for(x=w; x > 0; --x, ++p, ++q, ++r){
-                v = (*p);
-                if((int)*r <= (v-2)) v -= 1;
-                *q = (unsigned char)v;
+        else {
+            for (x = 0; x < w; x++) {
+                v = p[x];
+                if ((int)r[x] <= (v - 2)) v -= 1;
+                q[x] = (unsigned char)v;
             }
         }
     }
-    p = f+(w+2); q = g+(w+2);
-    r = q+(y_offset*(w+2)+x_offset); s = q-(y_offset*(w+2)+x_offset);
-    for(y=0; y < h; ++y, ++p, ++q, ++r, ++s){
-        ++p; ++q; ++r; ++s;
-        if(polarity > 0){
-            for(x=w; x > 0; --x, ++p, ++q, ++r, ++s){
-                v = (*q);
-                if(((int)*s >= (v+2)) && ((int)*r > v)) v+=1;
-                *p = (unsigned char)v;
+}
+
+static void hull_stage2_band(void *vctx, const int y_start, const int y_limit) {
+    HullCtx *ctx = reinterpret_cast<HullCtx*>(vctx);
+    const int w = ctx->w, stride = w + 2;
+    const int off = ctx->y_offset*stride + ctx->x_offset;
+    int x, y, v;
+    for (y = y_start; y < y_limit; y++) {
+        const unsigned char *q = ctx->src + (y + 1)*stride + 1;
+        const unsigned char *r = q + off, *s = q - off;
+        unsigned char *p = ctx->dest + (y + 1)*stride + 1;
+        if (ctx->polarity > 0) {
+            for (x = 0; x < w; x++) {
+                v = q[x];
+                if (((int)s[x] >= (v + 2)) && ((int)r[x] > v)) v += 1;
+                p[x] = (unsigned char)v;
             }
         }
-        else{
-            for(x=w; x > 0; --x, ++p, ++q, ++r, ++s){
-                v = (int)(*q);
-                if (((int)*s <= (v-2)) && ((int)*r < v)) v -= 1;
-                *p = (unsigned char)v;
+        else {
+            for (x = 0; x < w; x++) {
+                v = q[x];
+                if (((int)s[x] <= (v - 2)) && ((int)r[x] < v)) v -= 1;
+                p[x] = (unsigned char)v;
             }
         }
     }
 }
 
+static inline void hull(const int x_offset, const int y_offset, const int w, const int h, unsigned char *f, unsigned char *g, const int polarity) {
+    HullCtx ctx;
+    ctx.x_offset = x_offset; ctx.y_offset = y_offset; ctx.w = w; ctx.polarity = polarity;
+    ctx.src = f; ctx.dest = g;
+    run_in_bands(hull_stage1_band, &ctx, h);
+    ctx.src = g; ctx.dest = f;
+    run_in_bands(hull_stage2_band, &ctx, h);
+}
+
 #define DESPECKLE_CHANNEL(c, e) \
     pixels.fill(0); \
     j = w+2; \
@@ -555,12 +833,12 @@ static inline void hull(const int x_offset, const int y_offset, const int w, con
             *dest = e; \
     }
 
-QImage despeckle(const QImage &image) {
-    ScopedGILRelease PyGILRelease;
+// img must be Format_(A)RGB32. pixels and buffer are scratch space, reused
+// across calls by ImagePipeline.
+static void despeckle_in_place(QImage &img, QVector<unsigned char> &pixels, QVector<unsigned char> &buffer) {
     int length, x, y, j, i;
     QRgb *dest;
     const QRgb *src;
-    QImage img(image);
     int w = img.width();
     int h = img.height();
 
@@ -568,13 +846,21 @@ QImage despeckle(const QImage &image) {
         X[4]= {0, 1, 1,-1},
         Y[4]= {1, 0, 1, 1};
 
-    ENSURE32(img);
     length = (img.width()+2)*(img.height()+2);
-    QVector<unsigned char> pixels(length), buffer(length);
+    pixels.resize(length); buffer.resize(length);
 
     DESPECKLE_CHANNEL(qRed, qRgba(pixels[j], qGreen(*dest), qBlue(*dest), qAlpha(*dest)))
     DESPECKLE_CHANNEL(qGreen, qRgba(qRed(*dest), pixels[j], qBlue(*dest), qAlpha(*dest)))
     DESPECKLE_CHANNEL(qBlue, qRgba(qRed(*dest), qGreen(*dest), pixels[j], qAlpha(*dest)))
+}
+
+QImage despeckle(const QImage &image) {
+    ScopedGILRelease PyGILRelease;
+    QImage img(image);
+    QVector<unsigned char> pixels, buffer;
+
+    ENSURE32(img);
+    despeckle_in_place(img, pixels, buffer);
 
     return(img);
 }
@@ -588,10 +874,80 @@ static inline unsigned int BYTE_MUL(unsigned int x, unsigned int a) {
     return ((unsigned int)(t)) | ((unsigned int)(t >> 24));
 }
 
+#ifdef IMAGEOPS_HAS_SSE2
+// Composite four premultiplied source pixels onto an opaque destination:
+// dest = src + BYTE_MUL(dest, 255 - alpha(src)), computed in 16bit lanes
+// with the same rounding as BYTE_MUL above, so the result is bit identical
+// to the scalar loop. The formula is already correct for the degenerate
+// alphas: a fully transparent source pixel leaves dest unchanged and a
+// fully opaque one replaces it.
+static inline __m128i blend_four_pixels(const __m128i s, const __m128i d, const __m128i zero, const __m128i half, const __m128i ones16) {
+    const __m128i slo = _mm_unpacklo_epi8(s, zero), shi = _mm_unpackhi_epi8(s, zero);
+    // broadcast 255 - alpha to every channel lane of its pixel
+    const __m128i invlo = _mm_sub_epi16(ones16, _mm_shufflehi_epi16(_mm_shufflelo_epi16(slo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+    const __m128i invhi = _mm_sub_epi16(ones16, _mm_shufflehi_epi16(_mm_shufflelo_epi16(shi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+    __m128i tlo = _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), invlo);
+    __m128i thi = _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), invhi);
+    tlo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(tlo, _mm_srli_epi16(tlo, 8)), half), 8);
+    thi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(thi, _mm_srli_epi16(thi, 8)), half), 8);
+    return _mm_add_epi8(s, _mm_packus_epi16(tlo, thi));
+}
+#endif
+
+// Blend one row of Format_ARGB32_Premultiplied source pixels onto an
+// opaque canvas row.
+static void blend_premul_row(QRgb *dest, const QRgb *src, const unsigned int width) {
+    unsigned int c = 0;
+#ifdef IMAGEOPS_HAS_SSE2
+    // Eight pixels per iteration. Covers are dominated by fully opaque
+    // runs (text blocks, frames) and fully transparent runs around them,
+    // so each group of eight is classified first from its alpha bytes:
+    // all-opaque groups are stored directly, which makes such runs
+    // degenerate to a straight memcpy, and all-transparent groups are
+    // skipped without touching the canvas. Only mixed groups, i.e. the
+    // anti-aliased edges, pay for the blend itself.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi16(0x80);
+    const __m128i ones16 = _mm_set1_epi16(0xff);
+    const __m128i ones = _mm_set1_epi32(-1);
+    const __m128i rgbmask = _mm_set1_epi32(0x00ffffff);
+    for (; c + 8 <= width; c += 8) {
+        const __m128i s1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
+        const __m128i s2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c + 4));
+        // forcing the color bytes to 0xff/0x00 makes the group tests
+        // depend on the alpha bytes alone
+        const int opaque1 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(s1, rgbmask), ones));
+        const int opaque2 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(s2, rgbmask), ones));
+        if ((opaque1 & opaque2) == 0xffff) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + c), s1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + c + 4), s2);
+            continue;
+        }
+        const int zero1 = _mm_movemask_epi8(_mm_cmpeq_epi8(s1, zero));
+        const int zero2 = _mm_movemask_epi8(_mm_cmpeq_epi8(s2, zero));
+        if ((zero1 & zero2) == 0xffff) continue;
+        const __m128i d1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + c));
+        const __m128i d2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest + c + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + c), blend_four_pixels(s1, d1, zero, half, ones16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + c + 4), blend_four_pixels(s2, d2, zero, half, ones16));
+    }
+#endif
+    for (; c < width; c++) {
+        // Optimized Alpha blending, taken from qt_blend_argb32_on_argb32
+        // Since the canvas has no transparency
+        // the composite pixel is: canvas*(1-alpha) + src * alpha
+        // but src is pre-multiplied, so it is:
+        // canvas*(1-alpha) + src
+        const QRgb s = src[c];
+        if (s >= 0xff000000) dest[c] = s;
+        else if (s != 0) dest[c] = s + BYTE_MUL(dest[c], qAlpha(~s));
+    }
+}
+
 void overlay(const QImage &image, QImage &canvas, unsigned int left, unsigned int top) {
     ScopedGILRelease PyGILRelease;
     QImage img(image);
-    unsigned int cw = canvas.width(), ch = canvas.height(), iw = img.width(), ih = img.height(), r, c, right = 0, bottom = 0, height, width, s;
+    unsigned int cw = canvas.width(), ch = canvas.height(), iw = img.width(), ih = img.height(), r, right = 0, bottom = 0, height, width;
     const QRgb* src;
     QRgb* dest;
 
@@ -613,16 +969,7 @@ void overlay(const QImage &image, QImage &canvas, unsigned int left, unsigned in
         for (r = 0; r < height; r++) {
             src = reinterpret_cast<const QRgb*>(img.constScanLine(r));
             dest = reinterpret_cast<QRgb*>(canvas.scanLine(r + top));
-            for (c = 0; c < width; c++) {
-                // Optimized Alpha blending, taken from qt_blend_argb32_on_argb32
-                // Since the canvas has no transparency
-                // the composite pixel is: canvas*(1-alpha) + src * alpha
-                // but src is pre-multiplied, so it is:
-                // canvas*(1-alpha) + src
-                s = src[c];
-                if (s >= 0xff000000) dest[left+c] = s;
-                else if (s != 0) dest[left+c] = s + BYTE_MUL(dest[left+c], qAlpha(~s));
-            }
+            blend_premul_row(dest + left, src, width);
         }
     } else {
         ENSURE32(img);
@@ -635,8 +982,26 @@ void overlay(const QImage &image, QImage &canvas, unsigned int left, unsigned in
 
 } // }}}
 
-QImage normalize(const QImage &image) { // {{{
-    ScopedGILRelease PyGILRelease;
+#ifdef IMAGEOPS_HAS_SSE2
+// Apply the histogram stretch to two pixels held as eight 16bit channels.
+// Each channel is mapped as ((in - low) * m) >> 16 with m a per channel
+// 16.16 fixed point multiplier, split into high/low bytes since SSE2 only
+// multiplies 16bit lanes. The full 32bit product is reconstructed before
+// shifting, so the result is exactly equal to the normalize_map table.
+static inline __m128i normalize_two_pixels(const __m128i chan, const __m128i lows, const __m128i mhi, const __m128i mlo, const __m128i zero) {
+    __m128i x, p1lo, p1hi, p2, a, b;
+    x = _mm_subs_epu16(chan, lows);
+    p1lo = _mm_mullo_epi16(x, mhi);
+    p1hi = _mm_mulhi_epu16(x, mhi);
+    p2 = _mm_mullo_epi16(x, mlo);  // fits in 16 bits as x <= 255 and mlo <= 255
+    a = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(_mm_unpacklo_epi16(p1lo, p1hi), 8), _mm_unpacklo_epi16(p2, zero)), 16);
+    b = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(_mm_unpackhi_epi16(p1lo, p1hi), 8), _mm_unpackhi_epi16(p2, zero)), 16);
+    return _mm_packs_epi32(a, b);  // over-range values saturate and are clamped to 255 by the final packus
+}
+#endif
+
+// normalize() {{{
+static void normalize_in_place(QImage &img) {  // img must be Format_(A)RGB32
     IntegerPixel intensity;
     HistogramListItem histogram[256] = {{0, 0, 0, 0}};
     CharPixel normalize_map[256] = {{0, 0, 0, 0}};
@@ -645,9 +1010,6 @@ QImage normalize(const QImage &image) { // {{{
     int i, count;
     QRgb pixel, *dest;
     unsigned char r, g, b;
-    QImage img(image);
-
-    ENSURE32(img);
 
     count = img.width()*img.height();
 
@@ -737,7 +1099,36 @@ QImage normalize(const QImage &image) { // {{{
 
     // write
     dest = reinterpret_cast<QRgb *>(img.bits());
-    for(i=0; i < count; ++i){
+    i = 0;
+#ifdef IMAGEOPS_HAS_SSE2
+    {
+        // Channel order within a pixel is B, G, R; alpha and any channel
+        // with low == high use an identity multiplier (1.0 in 16.16).
+        quint32 m[3];
+        quint16 l[3];
+        int c, d;
+        const int lows_[3] = { low.blue, low.green, low.red }, highs_[3] = { high.blue, high.green, high.red };
+        __m128i px, lo16, hi16;
+        for (c = 0; c < 3; c++) {
+            d = highs_[c] - lows_[c];
+            if (d > 0) { m[c] = (255u << 16) / d + 1; l[c] = lows_[c]; }
+            else { m[c] = 65536u; l[c] = 0; }
+        }
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lows = _mm_set_epi16(0, (short)l[2], (short)l[1], (short)l[0], 0, (short)l[2], (short)l[1], (short)l[0]);
+        const __m128i mhi = _mm_set_epi16(256, (short)(m[2] >> 8), (short)(m[1] >> 8), (short)(m[0] >> 8),
+                                          256, (short)(m[2] >> 8), (short)(m[1] >> 8), (short)(m[0] >> 8));
+        const __m128i mlo = _mm_set_epi16(0, (short)(m[2] & 0xff), (short)(m[1] & 0xff), (short)(m[0] & 0xff),
+                                          0, (short)(m[2] & 0xff), (short)(m[1] & 0xff), (short)(m[0] & 0xff));
+        for (; i + 4 <= count; i += 4, dest += 4) {
+            px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest));
+            lo16 = normalize_two_pixels(_mm_unpacklo_epi8(px, zero), lows, mhi, mlo, zero);
+            hi16 = normalize_two_pixels(_mm_unpackhi_epi8(px, zero), lows, mhi, mlo, zero);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_packus_epi16(lo16, hi16));
+        }
+    }
+#endif
+    for(; i < count; ++i){
         pixel = *dest;
         r = (low.red != high.red) ? normalize_map[qRed(pixel)].red :
             qRed(pixel);
@@ -747,12 +1138,86 @@ QImage normalize(const QImage &image) { // {{{
             qBlue(pixel);
         *dest++ = qRgba(r, g, b, qAlpha(pixel));
     }
+}
+
+QImage normalize(const QImage &image) {
+    ScopedGILRelease PyGILRelease;
+    QImage img(image);
+
+    ENSURE32(img);
+    normalize_in_place(img);
 
     return img;
 } // }}}
 
-QImage oil_paint(const QImage &image, const float radius, const bool high_quality) {  // {{{
-    ScopedGILRelease PyGILRelease;
+// oil_paint() {{{
+
+// Fast oil paint using the classic sliding window histogram update: as the
+// window moves one pixel right, the leftmost column of the neighborhood is
+// subtracted from the intensity histogram and the new rightmost column
+// added, so the cost per pixel is O(matrix_size) instead of
+// O(matrix_size^2). The output pixel is the average color of the most
+// common intensity bin, while the exhaustive loop below outputs the last
+// neighborhood pixel that pushed its bin into the lead, so results differ
+// very slightly in tie cases; the high_quality flag selects between them.
+static void oil_paint_sliding(const QImage &img, QImage &buffer, const int matrix_size) {
+    int x, y, i, c, max_bin, stale, w = img.width(), h = img.height();
+    const int edge = matrix_size/2;
+    unsigned int histogram[256], rsum[256], gsum[256], bsum[256], asum[256];
+    unsigned int max_count, n;
+    QRgb *dest;
+    const QRgb **scanblock;
+    QVector<const QRgb*> buf = QVector<const QRgb*>(matrix_size);
+    scanblock = buf.data();
+
+#define OP_CLAMP(c) ((c) < 0 ? 0 : ((c) > w-1 ? w-1 : (c)))
+#define OP_ADD(col) for (i = 0; i < matrix_size; i++) { \
+        const QRgb px = scanblock[i][OP_CLAMP(col)]; \
+        const unsigned int v = qGray(px); \
+        histogram[v]++; rsum[v] += qRed(px); gsum[v] += qGreen(px); bsum[v] += qBlue(px); asum[v] += qAlpha(px); \
+        if (histogram[v] > max_count) { max_count = histogram[v]; max_bin = v; } \
+    }
+#define OP_REMOVE(col) for (i = 0; i < matrix_size; i++) { \
+        const QRgb px = scanblock[i][OP_CLAMP(col)]; \
+        const unsigned int v = qGray(px); \
+        histogram[v]--; rsum[v] -= qRed(px); gsum[v] -= qGreen(px); bsum[v] -= qBlue(px); asum[v] -= qAlpha(px); \
+        if ((int)v == max_bin) stale = 1; \
+    }
+
+    for (y = 0; y < h; y++) {
+        dest = reinterpret_cast<QRgb*>(buffer.scanLine(y));
+        // Read in scanlines to pixel neighborhood. If the scanline is outside
+        // the image use the top or bottom edge.
+        for (x = y-edge, i = 0; x <= y+edge; ++i, ++x)
+            scanblock[i] = reinterpret_cast<const QRgb*>(img.constScanLine((x < 0) ? 0 : (x > h-1) ? h-1 : x));
+
+        memset(histogram, 0, sizeof(histogram));
+        memset(rsum, 0, sizeof(rsum)); memset(gsum, 0, sizeof(gsum));
+        memset(bsum, 0, sizeof(bsum)); memset(asum, 0, sizeof(asum));
+        max_count = 0; max_bin = 0; stale = 0;
+        for (c = -edge; c <= edge; c++) OP_ADD(c);
+
+        for (x = 0; x < w; x++) {
+            if (stale) {
+                // the leading bin lost pixels, recount to find the new mode
+                for (max_count = 0, max_bin = 0, i = 0; i < 256; i++)
+                    if (histogram[i] > max_count) { max_count = histogram[i]; max_bin = i; }
+                stale = 0;
+            }
+            n = histogram[max_bin];
+            dest[x] = qRgba(rsum[max_bin]/n, gsum[max_bin]/n, bsum[max_bin]/n, asum[max_bin]/n);
+            if (x + 1 < w) {
+                OP_REMOVE(x - edge);
+                OP_ADD(x + 1 + edge);
+            }
+        }
+    }
+#undef OP_ADD
+#undef OP_REMOVE
+#undef OP_CLAMP
+}
+
+static void oil_paint_into(const QImage &image, const float radius, const bool high_quality, QImage &buffer) {
     int matrix_size = default_convolve_matrix_size(radius, 0.5, high_quality);
     int i, x, y, w, h, matrix_x, matrix_y;
     int edge = matrix_size/2;
@@ -767,7 +1232,9 @@ QImage oil_paint(const QImage &image, const float radius, const bool high_qualit
     if(w < 3 || h < 3) throw std::out_of_range("Image is too small");
 
     ENSURE32(img);
-    QImage buffer(w, h, img.format());
+    prep_buffer(buffer, img);
+
+    if (!high_quality) { oil_paint_sliding(img, buffer, matrix_size); return; }
 
     buf.resize(matrix_size);
     scanblock = buf.data();
@@ -860,10 +1327,254 @@ QImage oil_paint(const QImage &image, const float radius, const bool high_qualit
             ++dest;
         }
     }
+}
 
+QImage oil_paint(const QImage &image, const float radius, const bool high_quality) {
+    ScopedGILRelease PyGILRelease;
+    QImage buffer;
+    oil_paint_into(image, radius, high_quality, buffer);
     return(buffer);
 } // }}}
 
+// Tiled execution {{{
+// Filters whose scratch memory grows with the image size can be run on
+// horizontal strips instead, capping peak scratch memory at a configurable
+// budget regardless of input size. Each strip is copied out of the source
+// with `overlap` extra rows on either side, filtered, and its interior rows
+// copied into the result, so pixels never see the artificial tile edges.
+typedef void (*tile_filter)(QImage &tile, void *ctx);
+
+static QImage run_tiled(const QImage &image, tile_filter filter, void *ctx, const int overlap, const size_t scratch_bytes_per_row, unsigned int max_scratch_bytes) {
+    QImage img(image), tile;
+    int w, h, y, limit, ty0, ty1, r, rows;
+
+    ENSURE32(img);
+    w = img.width(); h = img.height();
+    rows = (int)(max_scratch_bytes / MAX((size_t)1, scratch_bytes_per_row));
+    // Never shrink tiles to the point where the overlap dominates the work
+    rows = MAX(rows, 3*overlap + 1);
+    if (rows >= h) {  // the whole image fits in the budget, no tiling needed
+        filter(img, ctx);
+        return img;
+    }
+
+    QImage result(w, h, img.format());
+    if (result.isNull()) throw std::bad_alloc();
+    for (y = 0; y < h; y += rows) {
+        limit = MIN(h, y + rows);
+        ty0 = MAX(0, y - overlap); ty1 = MIN(h, limit + overlap);
+        tile = img.copy(0, ty0, w, ty1 - ty0);
+        if (tile.isNull()) throw std::bad_alloc();
+        filter(tile, ctx);
+        for (r = y; r < limit; r++)
+            memcpy(result.scanLine(r), tile.constScanLine(r - ty0), w * sizeof(QRgb));
+    }
+    return result;
+}
+
+typedef struct {
+    QVector<unsigned char> *p1, *p2;
+} DespeckleTileCtx;
+
+static void despeckle_tile(QImage &tile, void *vctx) {
+    DespeckleTileCtx *ctx = reinterpret_cast<DespeckleTileCtx*>(vctx);
+    despeckle_in_place(tile, *ctx->p1, *ctx->p2);
+}
+
+QImage despeckle_tiled(const QImage &image, unsigned int max_scratch_bytes) {
+    ScopedGILRelease PyGILRelease;
+    QVector<unsigned char> p1, p2;
+    DespeckleTileCtx ctx = { &p1, &p2 };
+    size_t w = (size_t)image.width();
+    // Scratch per tile row: the tile pixels plus the two hull byte planes.
+    // The hull passes move data by at most one pixel each, and there are 4
+    // iterations of 4 offset pairs running two stages per channel, so 32
+    // rows of overlap guarantee interior pixels match the untiled filter.
+    return run_tiled(image, despeckle_tile, &ctx, 32, 4*w + 2*(w + 2), max_scratch_bytes);
+}
+
+typedef struct {
+    float radius;
+    bool high_quality;
+    QImage *scratch;
+} OilPaintTileCtx;
+
+static void oil_paint_tile(QImage &tile, void *vctx) {
+    OilPaintTileCtx *ctx = reinterpret_cast<OilPaintTileCtx*>(vctx);
+    oil_paint_into(tile, ctx->radius, ctx->high_quality, *ctx->scratch);
+    tile.swap(*ctx->scratch);
+}
+
+QImage oil_paint_tiled(const QImage &image, const float radius, const bool high_quality, unsigned int max_scratch_bytes) {
+    ScopedGILRelease PyGILRelease;
+    int matrix_size = default_convolve_matrix_size(radius, 0.5, high_quality);
+    QImage scratch;
+    OilPaintTileCtx ctx = { radius, high_quality, &scratch };
+    // Scratch per tile row: the tile pixels plus the destination buffer; the
+    // filter only looks matrix_size/2 pixels away from each output pixel.
+    return run_tiled(image, oil_paint_tile, &ctx, matrix_size/2, 8*(size_t)image.width(), max_scratch_bytes);
+}
+// }}}
+
+// ImagePipeline {{{
+enum {
+    OpRemoveBorders, OpGrayscale, OpNormalize, OpDespeckle,
+    OpGaussianBlur, OpGaussianSharpen, OpOilPaint, OpQuantize
+};
+
+ImagePipeline::ImagePipeline() {}
+
+ImagePipeline::Op ImagePipeline::make_op(const int type) {
+    Op op;
+    op.type = type; op.fuzz = 0; op.radius = 0; op.sigma = 0;
+    op.high_quality = true; op.dither = false; op.maximum_colors = 256;
+    return op;
+}
+
+void ImagePipeline::add_remove_borders(double fuzz) {
+    Op op = make_op(OpRemoveBorders); op.fuzz = fuzz; ops.append(op);
+}
+
+void ImagePipeline::add_grayscale() {
+    ops.append(make_op(OpGrayscale));
+}
+
+void ImagePipeline::add_normalize() {
+    ops.append(make_op(OpNormalize));
+}
+
+void ImagePipeline::add_despeckle() {
+    ops.append(make_op(OpDespeckle));
+}
+
+void ImagePipeline::add_gaussian_blur(const float radius, const float sigma) {
+    Op op = make_op(OpGaussianBlur); op.radius = radius; op.sigma = sigma; ops.append(op);
+}
+
+void ImagePipeline::add_gaussian_sharpen(const float radius, const float sigma, const bool high_quality) {
+    Op op = make_op(OpGaussianSharpen); op.radius = radius; op.sigma = sigma; op.high_quality = high_quality; ops.append(op);
+}
+
+void ImagePipeline::add_oil_paint(const float radius, const bool high_quality) {
+    Op op = make_op(OpOilPaint); op.radius = radius; op.high_quality = high_quality; ops.append(op);
+}
+
+void ImagePipeline::add_quantize(unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette) {
+    Op op = make_op(OpQuantize); op.maximum_colors = maximum_colors; op.dither = dither; op.palette = palette; ops.append(op);
+}
+
+QImage ImagePipeline::process(const QImage &image) {
+    ScopedGILRelease PyGILRelease;
+    int i;
+
+    buf = image;
+    ENSURE32(buf)
+    // Own the bits so the in place stages below do not trigger copy-on-write
+    // detaches. image itself is never modified.
+    buf.detach();
+    if (buf.isNull() && !image.isNull()) throw std::bad_alloc();
+
+    for (i = 0; i < ops.size(); i++) {
+        const Op &op = ops.at(i);
+        switch (op.type) {
+            case OpRemoveBorders: {
+                QRect rect = content_rect(buf, op.fuzz, border_buf);
+                if (rect != buf.rect()) {
+                    buf = buf.copy(rect);
+                    if (buf.isNull()) throw std::bad_alloc();
+                }
+                break; }
+            case OpGrayscale:
+                grayscale_in_place(buf); break;
+            case OpNormalize:
+                normalize_in_place(buf); break;
+            case OpDespeckle:
+                despeckle_in_place(buf, despeckle_buf1, despeckle_buf2); break;
+            case OpGaussianBlur:
+                gaussian_blur_into(buf, op.radius, op.sigma, spare); buf.swap(spare); break;
+            case OpGaussianSharpen:
+                gaussian_sharpen_into(buf, op.radius, op.sigma, op.high_quality, spare); buf.swap(spare); break;
+            case OpOilPaint:
+                oil_paint_into(buf, op.radius, op.high_quality, spare); buf.swap(spare); break;
+            case OpQuantize:
+                // quantize changes the image format, it can only be the last stage
+                return quantize_impl(buf, op.maximum_colors, op.dither, op.palette);
+        }
+    }
+    return buf;
+}
+// }}}
+
+// Transparency scans {{{
+static bool row_has_transparent(const QRgb *line, const int w) {
+    int c = 0;
+#ifdef IMAGEOPS_HAS_SSE2
+    // ANDing the alpha bytes of two pixel groups gives 0xff only when both
+    // pixels are fully opaque, so a single compare+movemask tests 8 pixels
+    // and the loop exits as soon as any group contains transparency
+    const __m128i amask = _mm_set1_epi32((int)0xff000000);
+    for (; c + 8 <= w; c += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + c));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + c + 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_and_si128(a, b), amask), amask)) != 0xffff) return true;
+    }
+#endif
+    for (; c < w; c++) {
+        if (qAlpha(*(line + c)) != 0xff) return true;
+    }
+    return false;
+}
+
+#ifdef IMAGEOPS_HAS_SSE2
+// Bitmask over a group of four pixels, with bit (4i + 3) set iff pixel i is
+// not fully opaque (the alpha byte is byte 3 of each pixel, and the other
+// bytes of the compare mask always match since they are zeroed on both sides)
+static inline int transparent_mask4(const QRgb *p, const __m128i amask) {
+    const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(px, amask), amask)) & 0x8888;
+}
+#endif
+
+static int first_transparent_in_row(const QRgb *line, const int w) {
+    int c = 0;
+#ifdef IMAGEOPS_HAS_SSE2
+    const __m128i amask = _mm_set1_epi32((int)0xff000000);
+    for (; c + 4 <= w; c += 4) {
+        const int t = transparent_mask4(line + c, amask);
+        if (t) {
+            int i = 0;
+            while (!(t & (0x8 << (4 * i)))) i++;
+            return c + i;
+        }
+    }
+#endif
+    for (; c < w; c++) {
+        if (qAlpha(*(line + c)) != 0xff) return c;
+    }
+    return -1;
+}
+
+static int last_transparent_in_row(const QRgb *line, const int w) {
+    int c = w;
+#ifdef IMAGEOPS_HAS_SSE2
+    const __m128i amask = _mm_set1_epi32((int)0xff000000);
+    while (c >= 4) {
+        c -= 4;
+        const int t = transparent_mask4(line + c, amask);
+        if (t) {
+            int i = 3;
+            while (!(t & (0x8 << (4 * i)))) i--;
+            return c + i;
+        }
+    }
+    // the vector loop consumed the row from the end, any leftover is at the front
+#endif
+    while (--c >= 0) {
+        if (qAlpha(*(line + c)) != 0xff) return c;
+    }
+    return -1;
+}
+
 bool has_transparent_pixels(const QImage &image) {  // {{{
     QImage img(image);
     QImage::Format fmt = img.format();
@@ -875,70 +1586,148 @@ bool has_transparent_pixels(const QImage &image) {  // {{{
     int w = image.width(), h = image.height();
     for (int r = 0; r < h; r++) {
         const QRgb *line = reinterpret_cast<const QRgb*>(img.constScanLine(r));
-        for (int c = 0; c < w; c++) {
-            if (qAlpha(*(line + c)) != 0xff) return true;
-        }
+        if (row_has_transparent(line, w)) return true;
     }
     return false;
 } // }}}
 
-QImage set_opacity(const QImage &image, double alpha) {  // {{{
+// Bounding box of all pixels that are not fully opaque, an empty rect when
+// the image is fully opaque. Lets callers that need both the transparency
+// check and the affected area make a single pass over the image.
+QRect transparent_region(const QImage &image) {  // {{{
     QImage img(image);
     QImage::Format fmt = img.format();
-    if (fmt != QImage::Format_ARGB32) {
+    if (!img.hasAlphaChannel()) return QRect();
+    if (fmt != QImage::Format_ARGB32 && fmt != QImage::Format_ARGB32_Premultiplied) {
         img = img.convertToFormat(QImage::Format_ARGB32);
         if (img.isNull()) throw std::bad_alloc();
     }
-    int w = image.width(), h = image.height();
+    int w = img.width(), h = img.height();
+    int top = -1, bottom = -1, left = w, right = -1;
     for (int r = 0; r < h; r++) {
-        QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(r));
-        for (int c = 0; c < w; c++) {
-            QRgb pixel = *(line + c);
-            *(line + c) = qRgba(qRed(pixel), qGreen(pixel), qBlue(pixel), qAlpha(pixel) * alpha);
+        const QRgb *line = reinterpret_cast<const QRgb*>(img.constScanLine(r));
+        const int first = first_transparent_in_row(line, w);
+        if (first < 0) continue;
+        const int last = last_transparent_in_row(line, w);
+        if (top < 0) top = r;
+        bottom = r;
+        if (first < left) left = first;
+        if (last > right) right = last;
+    }
+    if (top < 0) return QRect();
+    return QRect(left, top, right - left + 1, bottom - top + 1);
+} // }}}
+// }}}
+
+// set_opacity() {{{
+
+// Scale the alpha byte of every pixel by the 16.16 fixed point factor m
+// (m < 65536), leaving the color bytes untouched.
+static void scale_alpha_row(QRgb *line, const int w, const quint32 m) {
+    int c = 0;
+#ifdef IMAGEOPS_HAS_SSE2
+    {
+        // Four pixels per iteration: the alpha bytes are isolated into the
+        // low halves of the 32bit lanes, multiplied by m with a 16bit
+        // lo/hi multiply pair, and the rounded result shifted back into
+        // the alpha position.
+        const __m128i rgbmask = _mm_set1_epi32(0x00ffffff);
+        const __m128i mvec = _mm_set1_epi32((int)m);
+        const __m128i half = _mm_set1_epi32(0x8000);
+        for (; c + 4 <= w; c += 4) {
+            const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + c));
+            const __m128i a = _mm_srli_epi32(px, 24);
+            __m128i t = _mm_or_si128(_mm_mullo_epi16(a, mvec), _mm_slli_epi32(_mm_mulhi_epu16(a, mvec), 16));
+            t = _mm_slli_epi32(_mm_srli_epi32(_mm_add_epi32(t, half), 16), 24);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(line + c), _mm_or_si128(_mm_and_si128(px, rgbmask), t));
         }
     }
+#endif
+    for (; c < w; c++) {
+        const QRgb pixel = line[c];
+        line[c] = (pixel & 0x00ffffff) | (((qAlpha(pixel) * m + 0x8000) >> 16) << 24);
+    }
+}
+
+// Modify the caller-owned image directly instead of returning a copy, so
+// animations that fade the same cover every frame do not pay a full-size
+// allocation per frame. The image must already be ARGB32 since an in-place
+// operation cannot convert it.
+void set_opacity_in_place(QImage &img, double alpha) {
+    if (img.isNull()) throw std::out_of_range("Cannot set opacity on a null image");
+    if (img.format() != QImage::Format_ARGB32) throw std::out_of_range("set_opacity_in_place() needs a QImage in the ARGB32 format");
+    if (alpha >= 1) return;
+    if (alpha < 0) alpha = 0;
+    const quint32 m = MIN(65535u, (quint32)(alpha * 65536 + 0.5));  // must fit in 16 bits for the vector multiply
+    const int w = img.width(), h = img.height();
+    for (int r = 0; r < h; r++)
+        scale_alpha_row(reinterpret_cast<QRgb*>(img.scanLine(r)), w, m);
+}
+
+QImage set_opacity(const QImage &image, double alpha) {
+    QImage img(image);
+    if (img.format() != QImage::Format_ARGB32) {
+        img = img.convertToFormat(QImage::Format_ARGB32);
+        if (img.isNull()) throw std::bad_alloc();
+    }
+    set_opacity_in_place(img, alpha);
     return img;
 } // }}}
 
-QImage texture_image(const QImage &image, const QImage &texturei) {  // {{{
-    QImage canvas(image);
+// texture_image() {{{
+
+// Textures are applied per theme: thousands of covers in a row get the
+// same small tile, so the tile is cached pre-expanded to full canvas
+// width. That pays the format conversion and the modular tile addressing
+// once per (texture, width) instead of once per cover, and lets each
+// canvas row be covered by a single memcpy or one blend_premul_row()
+// pass. One entry suffices for the batch use case; a different texture
+// or canvas width simply rebuilds it. texture_image() runs with the GIL
+// held, which serializes access to the cache.
+struct TextureCache {
+    qint64 key;
+    int width, tile_height;
+    bool overwrite;
+    QVector<QRgb> rows;  // tile_height rows of width pixels each
+    TextureCache() : key(0), width(0), tile_height(0), overwrite(false) {}
+};
+
+static void expand_texture_rows(const QImage &texturei, const int cw, TextureCache &cache) {
     QImage texture(texturei);
-    if (texture.isNull()) throw std::out_of_range("Cannot use null texture image");
+    ENSURE32(texture);
+    cache.overwrite = !texturei.hasAlphaChannel();
+    if (!cache.overwrite && texture.format() != QImage::Format_ARGB32_Premultiplied) {
+        texture = texture.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        if (texture.isNull()) throw std::bad_alloc();
+    }
+    const int tw = texture.width(), th = texture.height();
+    cache.rows.resize(th * cw);
+    for (int r = 0; r < th; r++) {
+        const QRgb *src = reinterpret_cast<const QRgb*>(texture.constScanLine(r));
+        QRgb *dest = cache.rows.data() + r * cw;
+        for (int x = 0; x < cw; x += tw)
+            memcpy(dest + x, src, (MIN(tw, cw - x)) * sizeof(QRgb));
+    }
+    cache.key = texturei.cacheKey(); cache.width = cw; cache.tile_height = th;
+}
+
+QImage texture_image(const QImage &image, const QImage &texturei) {
+    QImage canvas(image);
+    static TextureCache cache;
+    if (texturei.isNull()) throw std::out_of_range("Cannot use null texture image");
     if (canvas.isNull()) throw std::out_of_range("Cannot use null canvas image");
 
-    ENSURE32(canvas); ENSURE32(texture);
-    int x = 0, y = 0, cw = canvas.width(), ch = canvas.height(), tw = texture.width(), th = texture.height();
-    const bool overwrite = !texturei.hasAlphaChannel();
-
-    if (!overwrite) {
-        if (texture.format() != QImage::Format_ARGB32_Premultiplied) {
-            texture = texture.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-            if (texture.isNull()) throw std::bad_alloc();
-        }
-    }
-
-    while (y < ch) {
-        int ylimit = MIN(th, ch - y);
-        x = 0;
-        while (x < cw) {
-            for (int r = 0; r < ylimit; r++) {
-                const QRgb *src = reinterpret_cast<const QRgb*>(texture.constScanLine(r));
-                QRgb *dest = reinterpret_cast<QRgb*>(canvas.scanLine(r + y)) + x;
-                int xlimit = MIN(tw, cw - x);
-                if (overwrite) {
-                    memcpy(dest, src, xlimit * sizeof(QRgb));
-                } else {
-                    for (int c = 0; c < xlimit; c++) {
-                        // See the overlay function() for an explanation of the alpha blending code below
-                        QRgb s = src[c];
-                        if (s >= 0xff000000) dest[c] = s;
-                        else if (s != 0) dest[c] = s + BYTE_MUL(dest[c], qAlpha(~s));
-                    }
-                }
-            }
-            x += tw;
-        }
-        y += th;
+    ENSURE32(canvas);
+    const int cw = canvas.width(), ch = canvas.height();
+
+    if (cache.key != texturei.cacheKey() || cache.width != cw || cache.rows.isEmpty())
+        expand_texture_rows(texturei, cw, cache);
+
+    for (int r = 0; r < ch; r++) {
+        QRgb *dest = reinterpret_cast<QRgb*>(canvas.scanLine(r));
+        const QRgb *src = cache.rows.constData() + (r % cache.tile_height) * cw;
+        if (cache.overwrite) memcpy(dest, src, cw * sizeof(QRgb));
+        else blend_premul_row(dest, src, cw);
     }
     return canvas;
 } // }}}
@@ -9,18 +9,43 @@
 
 #include <Python.h>
 #include <QImage>
+#include <QVector>
+
+// SSE2 is part of the x86-64 baseline and of every 32-bit CPU calibre
+// supports, so vector paths are selected at compile time; every function
+// keeps a scalar loop both as fallback for other architectures and to
+// handle the pixels left over after the vector loop.
+#if defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define IMAGEOPS_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Run a filter over horizontal bands of an image, one band per core. The
+// band function must only touch rows/columns in [start, limit) and must not
+// call any QImage methods, since those can trigger copy-on-write detaches
+// which are not thread safe. Callers capture raw bits()/constBits() pointers
+// into a context struct before spawning the bands.
+typedef void (*band_func)(void *ctx, int start, int limit);
+void run_in_bands(band_func f, void *ctx, const int count);
 
 QImage remove_borders(const QImage &image, double fuzz);
 QImage grayscale(const QImage &image);
 QImage gaussian_sharpen(const QImage &img, const float radius, const float sigma, const bool high_quality=true);
 QImage gaussian_blur(const QImage &img, const float radius, const float sigma);
 QImage despeckle(const QImage &image);
+QImage despeckle_tiled(const QImage &image, unsigned int max_scratch_bytes);
 void overlay(const QImage &image, QImage &canvas, unsigned int left, unsigned int top);
 QImage normalize(const QImage &image);
 QImage oil_paint(const QImage &image, const float radius=-1, const bool high_quality=true);
+QImage oil_paint_tiled(const QImage &image, const float radius, const bool high_quality, unsigned int max_scratch_bytes);
 QImage quantize(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette);
+QImage quantize_impl(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette);
+QImage quantize_hinted(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette_hint);
+QImage quantize_hinted_impl(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette_hint);
 bool has_transparent_pixels(const QImage &image);
+QRect transparent_region(const QImage &image);
 QImage set_opacity(const QImage &image, double alpha);
+void set_opacity_in_place(QImage &image, double alpha);
 QImage texture_image(const QImage &image, const QImage &texturei);
 QImage ordered_dither(const QImage &image);
 
@@ -31,3 +56,34 @@ public:
 private:
     PyThreadState * thread_state;
 };
+
+// A sequence of image operations that is applied to many images, reusing a
+// single pair of working buffers between stages and across images, instead
+// of allocating a fresh intermediate image per stage per image.
+class ImagePipeline {
+public:
+    ImagePipeline();
+    void add_remove_borders(double fuzz);
+    void add_grayscale();
+    void add_normalize();
+    void add_despeckle();
+    void add_gaussian_blur(const float radius, const float sigma);
+    void add_gaussian_sharpen(const float radius, const float sigma, const bool high_quality=true);
+    void add_oil_paint(const float radius=-1, const bool high_quality=true);
+    void add_quantize(unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette);
+    QImage process(const QImage &image);
+private:
+    struct Op {
+        int type;
+        double fuzz;
+        float radius, sigma;
+        bool high_quality, dither;
+        unsigned int maximum_colors;
+        QVector<QRgb> palette;
+    };
+    Op make_op(const int type);
+    QVector<Op> ops;
+    QImage buf, spare;  // the reusable buffer pair, ping-ponged between stages
+    QVector<double> border_buf;
+    QVector<unsigned char> despeckle_buf1, despeckle_buf2;
+};
@@ -18,6 +18,9 @@
 #include <stdio.h>
 #include <QVector>
 #include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 
 // Increasing this number improves quality but also increases running time and memory consumption
 static const size_t MAX_LEAVES = 2000;
@@ -234,6 +237,68 @@ public:
         }
     } // }}}
 
+    // Merging trees built in parallel {{{
+
+    // Accumulate the totals of all leaves in this subtree
+    void fold_into(SumPixel &dsum, SumPixel &derr, uint64_t &dcount) const {
+        if (this->is_leaf) {
+            dsum.red += this->sum.red; dsum.green += this->sum.green; dsum.blue += this->sum.blue;
+            derr.red += this->error_sum.red; derr.green += this->error_sum.green; derr.blue += this->error_sum.blue;
+            dcount += this->pixel_count;
+            return;
+        }
+        for (int i = 0; i < MAX_DEPTH; i++)
+            if (this->children[i] != NULL) this->children[i]->fold_into(dsum, derr, dcount);
+    }
+
+    // Like add_color(), but adding a pre-aggregated set of pixels in one step
+    void add_color_weighted(const unsigned char r, const unsigned char g, const unsigned char b, const uint64_t count, const SumPixel &csum, const SumPixel &cerr, const size_t depth, const size_t level, unsigned int *leaf_count, Node **reducible_nodes, Pool<Node> &node_pool) {
+        if (this->is_leaf) {
+            this->pixel_count += count;
+            this->sum.red += csum.red; this->sum.green += csum.green; this->sum.blue += csum.blue;
+            this->error_sum.red += cerr.red; this->error_sum.green += cerr.green; this->error_sum.blue += cerr.blue;
+            this->update_average();
+        } else {
+            unsigned char index = get_index(r, g, b, level);
+            if (this->children[index] == NULL) this->children[index] = this->create_child(level, depth, leaf_count, reducible_nodes, node_pool);
+            this->children[index]->add_color_weighted(r, g, b, count, csum, cerr, depth, level + 1, leaf_count, reducible_nodes, node_pool);
+        }
+    }
+
+    // Merge the tree rooted at other (built over a different stripe of the
+    // image) into this tree. Both trees must have been built with the same
+    // depth. Where the trees have the same structure leaves are summed
+    // directly; where one tree was reduced to a shallower leaf, the other
+    // side's totals are folded in at that leaf or re-inserted along the
+    // path of their average color.
+    void absorb(const Node *other, const size_t depth, const size_t level, unsigned int *leaf_count, Node **reducible_nodes, Pool<Node> &node_pool) {
+        int i;
+        if (this->is_leaf) {
+            SumPixel s = {0, 0, 0}, e = {0, 0, 0};
+            uint64_t n = 0;
+            other->fold_into(s, e, n);
+            if (n > 0) {
+                this->pixel_count += n;
+                this->sum.red += s.red; this->sum.green += s.green; this->sum.blue += s.blue;
+                this->error_sum.red += e.red; this->error_sum.green += e.green; this->error_sum.blue += e.blue;
+                this->update_average();
+            }
+            return;
+        }
+        if (other->is_leaf) {
+            if (other->pixel_count > 0) this->add_color_weighted(
+                (unsigned char)(other->avg.red + 0.5), (unsigned char)(other->avg.green + 0.5), (unsigned char)(other->avg.blue + 0.5),
+                other->pixel_count, other->sum, other->error_sum, depth, level, leaf_count, reducible_nodes, node_pool);
+            return;
+        }
+        for (i = 0; i < MAX_DEPTH; i++) {
+            if (other->children[i] == NULL) continue;
+            if (this->children[i] == NULL) this->children[i] = this->create_child(level, depth, leaf_count, reducible_nodes, node_pool);
+            this->children[i]->absorb(other->children[i], depth, level + 1, leaf_count, reducible_nodes, node_pool);
+        }
+    }
+    // }}}
+
     unsigned char index_for_nearest_color(const unsigned char r, const unsigned char g, const unsigned char b, const size_t level) { // {{{
         /* Returns the color palette index for the nearest color to (r, g, b) */
         Node *child;
@@ -253,6 +318,33 @@ public:
 
 };
 
+// Nearest color cache {{{
+// Direct mapped cache over the 24 bit RGB value, avoiding the tree walk in
+// index_for_nearest_color() for colors that were looked up recently. Images
+// have far fewer distinct colors than pixels, so the hit rate is very high.
+#define COLOR_CACHE_BITS 16
+#define COLOR_CACHE_EMPTY 0xff000000u
+
+class NearestColorCache {
+private:
+    QVector<quint32> keys;
+    QVector<unsigned char> values;
+
+public:
+    NearestColorCache() : keys((1 << COLOR_CACHE_BITS), COLOR_CACHE_EMPTY), values(1 << COLOR_CACHE_BITS) {}
+
+    unsigned char index_for(Node &root, const QRgb pixel) {
+        const quint32 key = pixel & 0xffffffu;
+        const quint32 slot = (key * 2654435761u) >> (32 - COLOR_CACHE_BITS);
+        if (keys[slot] != key) {
+            keys[slot] = key;
+            values[slot] = root.index_for_nearest_color(qRed(pixel), qGreen(pixel), qBlue(pixel), 0);
+        }
+        return values[slot];
+    }
+};
+// }}}
+
 // Image Dithering  {{{
 static inline void propagate_error(QVector<DoublePixel> &error_line, int c, unsigned char mult, DoublePixel &error) {
     error_line[c].red   += error.red * mult;
@@ -283,6 +375,7 @@ static void dither_image(const QImage &img, QImage &ans, QVector<QRgb> &color_ta
     const DoublePixel zero = {0, 0, 0};
     QVector<DoublePixel> err1(iwidth), err2(iwidth), *line1 = NULL, *line2 = NULL;
     const QVector<QRgb> src_color_table = img.colorTable();
+    NearestColorCache cache;
 
     for (r = 0; r < iheight; r++) {
         line = reinterpret_cast<const QRgb*>(img.constScanLine(r));
@@ -295,7 +388,7 @@ static void dither_image(const QImage &img, QImage &ans, QVector<QRgb> &color_ta
         for (c = start; 0 < (is_odd ? c + 1 : iwidth - c); c += delta) {
             pixel = src_is_indexed ? src_color_table.at(*(src_line + c)) : *(line + c);
             err_pixel = apply_error(pixel, (*line1)[c]);
-            index = root.index_for_nearest_color(qRed(err_pixel), qGreen(err_pixel), qBlue(err_pixel), 0);
+            index = cache.index_for(root, err_pixel);
             *(bits + c) = index;
             calculate_error(color_table[index], pixel, error);
             if (0 < (is_odd ? c : iwidth - c - 1)) {
@@ -309,11 +402,10 @@ static void dither_image(const QImage &img, QImage &ans, QVector<QRgb> &color_ta
 }
 // }}}
 
-inline unsigned int read_colors(const QImage &img, Node &root, size_t depth, Node **reducible_nodes, Pool<Node> &node_pool) {
-    int iwidth = img.width(), iheight = img.height(), r, c;
-    unsigned int leaf_count = 0;
+inline unsigned int read_colors(const QImage &img, const int row_start, const int row_limit, Node &root, size_t depth, Node **reducible_nodes, Pool<Node> &node_pool, unsigned int leaf_count = 0) {
+    int iwidth = img.width(), r, c;
     const QRgb* line = NULL;
-    for (r = 0; r < iheight; r++) {
+    for (r = row_start; r < row_limit; r++) {
         line = reinterpret_cast<const QRgb*>(img.constScanLine(r));
         for (c = 0; c < iwidth; c++) {
             const QRgb pixel = *(line + c);
@@ -325,6 +417,61 @@ inline unsigned int read_colors(const QImage &img, Node &root, size_t depth, Nod
     return leaf_count;
 }
 
+inline unsigned int read_colors(const QImage &img, Node &root, size_t depth, Node **reducible_nodes, Pool<Node> &node_pool) {
+    return read_colors(img, 0, img.height(), root, depth, reducible_nodes, node_pool);
+}
+
+// Parallel tree building {{{
+// Each stripe of rows gets its own tree, node pool and reducible lists, so
+// the workers share nothing but the (read only) source image. The stripe
+// trees are then merged into the main tree, reducing after each merge so
+// the main pool never holds more than two stripes worth of leaves.
+class StripeWorker : public QRunnable {
+public:
+    StripeWorker(const QImage &img, int row_start, int row_limit, size_t depth) :
+        root(), leaf_count(0), img(img), row_start(row_start), row_limit(row_limit), depth(depth), node_pool((MAX_LEAVES + 1) * 8) {
+        for (size_t i = 0; i < MAX_DEPTH + 1; i++) reducible_nodes[i] = NULL;
+        setAutoDelete(false);  // the tree is read after the pool finishes
+    }
+
+    virtual void run() {
+        leaf_count = read_colors(img, row_start, row_limit, root, depth, reducible_nodes, node_pool);
+    }
+
+    Node root;
+    unsigned int leaf_count;
+
+private:
+    const QImage &img;
+    int row_start, row_limit;
+    size_t depth;
+    Node* reducible_nodes[MAX_DEPTH + 1];
+    Pool<Node> node_pool;
+};
+
+static unsigned int read_colors_parallel(const QImage &img, Node &root, size_t depth, Node **reducible_nodes, Pool<Node> &node_pool, const int num_stripes, unsigned int leaf_count = 0) {
+    int i, row_start = 0, rows = img.height() / num_stripes;
+    QVector<StripeWorker*> workers;
+    QThreadPool pool;
+
+    pool.setMaxThreadCount(num_stripes);
+    for (i = 0; i < num_stripes; i++, row_start += rows) {
+        StripeWorker *w = new StripeWorker(img, row_start, (i == num_stripes - 1) ? img.height() : row_start + rows, depth);
+        workers.append(w);
+        pool.start(w);
+    }
+    pool.waitForDone();
+
+    for (i = 0; i < workers.size(); i++) {
+        root.absorb(&workers.at(i)->root, depth, 0, &leaf_count, reducible_nodes, node_pool);
+        while (leaf_count > MAX_LEAVES)
+            root.reduce(depth, &leaf_count, reducible_nodes, node_pool);
+        delete workers.at(i);
+    }
+    return leaf_count;
+}
+// }}}
+
 inline unsigned int read_colors(const QVector<QRgb> &color_table, Node &root, size_t depth, Node **reducible_nodes, Pool<Node> &node_pool) {
     unsigned int leaf_count = 0;
     for (int i = 0; i < color_table.size(); i++) {
@@ -344,6 +491,7 @@ inline void reduce_tree(Node &root, size_t depth, unsigned int *leaf_count, unsi
 static void write_image(const QImage &img, QImage &ans, Node &root, bool src_is_indexed) {
     int iheight = img.height(), iwidth = img.width(), r = 0, c = 0;
     QVector<QRgb> src_color_table = img.colorTable();
+    NearestColorCache cache;
 
     for (r = 0; r < iheight; r++) {
         const QRgb *line = reinterpret_cast<const QRgb*>(img.constScanLine(r));
@@ -351,13 +499,45 @@ static void write_image(const QImage &img, QImage &ans, Node &root, bool src_is_
         unsigned char *bits = ans.scanLine(r);
         for (c = 0; c < iwidth; c++) {
             const QRgb pixel = src_is_indexed ? src_color_table.at(*(src_line + c)) : *(line + c);
-            *(bits + c) = root.index_for_nearest_color(qRed(pixel), qGreen(pixel), qBlue(pixel), 0);
+            *(bits + c) = cache.index_for(root, pixel);
         }
     }
 }
 
-QImage quantize(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette) {
-    ScopedGILRelease PyGILRelease;
+// Palette hint acceptance {{{
+// When quantizing a sequence of related images (the pages of a comic) the
+// palette of one page is usually a good palette for the next. Before doing a
+// full histogram build over the image, the tree seeded from the hint palette
+// is scored on a sparse grid of sample pixels; if the mean squared distance
+// to the nearest palette color is small enough, the hint palette is used
+// directly and the full build (by far the most expensive phase) is skipped.
+static const uint64_t HINT_MAX_MEAN_SQ_ERROR = 600;  // ~14 per channel
+
+static bool hint_palette_is_close_enough(const QImage &img, Node &root, unsigned int leaf_count) {
+    QVector<QRgb> color_table(leaf_count);
+    unsigned char index = 0;
+    NearestColorCache cache;
+    int iheight = img.height(), iwidth = img.width(), r, c;
+    int rstep = MAX(1, iheight / 64), cstep = MAX(1, iwidth / 128);
+    uint64_t total_error = 0, num_samples = 0;
+
+    root.set_palette_colors(color_table.data(), &index, false);
+    for (r = 0; r < iheight; r += rstep) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(img.constScanLine(r));
+        for (c = 0; c < iwidth; c += cstep) {
+            const QRgb pixel = line[c], nearest = color_table[cache.index_for(root, pixel)];
+            total_error += euclidean_distance<int64_t>(
+                qRed(pixel), qGreen(pixel), qBlue(pixel), qRed(nearest), qGreen(nearest), qBlue(nearest));
+            num_samples++;
+        }
+    }
+    return num_samples > 0 && total_error / num_samples <= HINT_MAX_MEAN_SQ_ERROR;
+}
+// }}}
+
+// Implementation of quantize() that does not release the GIL, for use as
+// the final stage of an ImagePipeline, which has already released it.
+static QImage quantize_internal(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette, const QVector<QRgb> &palette_hint) {
     size_t depth = MAX_DEPTH;
     int iwidth = image.width(), iheight = image.height();
     QImage img(image), ans(iwidth, iheight, QImage::Format_Indexed8);
@@ -376,16 +556,36 @@ QImage quantize(const QImage &image, unsigned int maximum_colors, bool dither, c
         img = img.convertToFormat(QImage::Format_RGB32);
         if (img.isNull()) throw std::bad_alloc();
     }
+    // Build stripe trees in parallel only for images tall enough that a
+    // stripe amortizes the cost of its private node pool.
+    int num_stripes = MIN(QThread::idealThreadCount(), iheight / 512);
+
     // There can be no more than MAX_LEAVES * 8 nodes. Add 1 in case there is an off by 1 error somewhere.
-    Pool<Node> node_pool((MAX_LEAVES + 1) * 8);
+    // When merging stripe trees the main tree briefly holds up to two stripes worth of leaves.
+    Pool<Node> node_pool(((num_stripes > 1 ? 2 * MAX_LEAVES : MAX_LEAVES) + 2) * 8);
     if (palette.size() > 0) {
         // Quantizing to fixed palette
         leaf_count = read_colors(palette, root, depth, reducible_nodes, node_pool);
         maximum_colors = MAX(2, MIN(MAX_COLORS, leaf_count));
     } else if (img.format() == QImage::Format_RGB32) {
+        bool build_needed = true;
         depth = (size_t)log2(maximum_colors);
         depth = MAX(2, MIN(depth, MAX_DEPTH));
-        leaf_count = read_colors(img, root, depth, reducible_nodes, node_pool);
+        if (palette_hint.size() > 0) {
+            leaf_count = read_colors(palette_hint, root, depth, reducible_nodes, node_pool);
+            reduce_tree(root, depth, &leaf_count, maximum_colors, reducible_nodes, node_pool);
+            if (hint_palette_is_close_enough(img, root, leaf_count)) {
+                maximum_colors = MAX(2, MIN(MAX_COLORS, leaf_count));
+                build_needed = false;
+            }
+            // otherwise the hint tree is kept as a seed: the image's colors
+            // refine it below, and the early reductions benefit from the
+            // structure of the previous palette
+        }
+        if (build_needed) {
+            if (num_stripes > 1) leaf_count = read_colors_parallel(img, root, depth, reducible_nodes, node_pool, num_stripes, leaf_count);
+            else leaf_count = read_colors(img, 0, img.height(), root, depth, reducible_nodes, node_pool, leaf_count);
+        }
     } else {
         leaf_count = read_colors(img.colorTable(), root, depth, reducible_nodes, node_pool);
     }
@@ -400,3 +600,21 @@ QImage quantize(const QImage &image, unsigned int maximum_colors, bool dither, c
 
     return ans;
 }
+
+QImage quantize_impl(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette) {
+    return quantize_internal(image, maximum_colors, dither, palette, QVector<QRgb>());
+}
+
+QImage quantize_hinted_impl(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette_hint) {
+    return quantize_internal(image, maximum_colors, dither, QVector<QRgb>(), palette_hint);
+}
+
+QImage quantize(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette) {
+    ScopedGILRelease PyGILRelease;
+    return quantize_impl(image, maximum_colors, dither, palette);
+}
+
+QImage quantize_hinted(const QImage &image, unsigned int maximum_colors, bool dither, const QVector<QRgb> &palette_hint) {
+    ScopedGILRelease PyGILRelease;
+    return quantize_hinted_impl(image, maximum_colors, dither, palette_hint);
+}
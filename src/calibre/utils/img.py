@@ -440,11 +440,21 @@ def gaussian_blur_image(img, radius=-1, sigma=3):
     return imageops.gaussian_blur(image_from_data(img), max(0, radius), sigma)
 
 
-def despeckle_image(img):
+def despeckle_image(img, max_scratch_bytes=0):
+    ''' If max_scratch_bytes is > 0 the image is processed in overlapping
+    tiles, capping the scratch memory used by the filter at roughly that many
+    bytes regardless of image size. '''
+    if max_scratch_bytes > 0:
+        return imageops.despeckle_tiled(image_from_data(img), max_scratch_bytes)
     return imageops.despeckle(image_from_data(img))
 
 
-def oil_paint_image(img, radius=-1, high_quality=True):
+def oil_paint_image(img, radius=-1, high_quality=True, max_scratch_bytes=0):
+    ''' If max_scratch_bytes is > 0 the image is processed in overlapping
+    tiles, capping the scratch memory used by the filter at roughly that many
+    bytes regardless of image size. '''
+    if max_scratch_bytes > 0:
+        return imageops.oil_paint_tiled(image_from_data(img), radius, high_quality, max_scratch_bytes)
     return imageops.oil_paint(image_from_data(img), radius, high_quality)
 
 
@@ -452,7 +462,21 @@ def normalize_image(img):
     return imageops.normalize(image_from_data(img))
 
 
-def quantize_image(img, max_colors=256, dither=True, palette=''):
+def image_pipeline(ops):
+    ''' Create a reusable pipeline of image operations. `ops` is a list of
+    (name, *args) tuples, e.g. [('remove_borders', 10), ('normalize',),
+    ('quantize', 256, True, [])]. The names and arguments match the
+    correspondingly named functions in this module. Call process(img) on the
+    returned object for each image; intermediate buffers are shared between
+    stages and reused across images, so processing many images with one
+    pipeline allocates only a single pair of working buffers. '''
+    pipeline = imageops.ImagePipeline()
+    for op in ops:
+        getattr(pipeline, 'add_' + op[0])(*op[1:])
+    return pipeline
+
+
+def quantize_image(img, max_colors=256, dither=True, palette='', palette_hint=None):
     ''' Quantize the image to contain a maximum of `max_colors` colors. By
     default a palette is chosen automatically, if you want to use a fixed
     palette, then pass in a list of color names in the `palette` variable. If
@@ -462,12 +486,19 @@ def quantize_image(img, max_colors=256, dither=True, palette=''):
     :param max_colors: Max. number of colors in the auto-generated palette. Must be between 2 and 256.
     :param dither: Whether to use dithering or not. dithering is almost always a good thing.
     :param palette: Use a manually specified palette instead. For example: palette='red green blue #eee'
+    :param palette_hint: A list of RGB values (the color table of the
+        previously quantized image) used to warm start the quantization.
+        When the hint is a close enough fit for this image it is used
+        directly, skipping the expensive palette computation, which is
+        usually the case for consecutive pages of the same comic.
     '''
     img = image_from_data(img)
     if img.hasAlphaChannel():
         img = blend_image(img)
     if palette and isinstance(palette, string_or_bytes):
         palette = palette.split()
+    if palette_hint and not palette:
+        return imageops.quantize_hinted(img, max_colors, dither, list(palette_hint))
     return imageops.quantize(img, max_colors, dither, [QColor(x).rgb() for x in palette])
 
 
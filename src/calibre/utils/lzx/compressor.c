@@ -6,6 +6,7 @@
 
 #include <Python.h>
 #include <structmember.h>
+#include <pythread.h>
 #include <lzxc.h>
 #include <lzxmodule.h>
 
@@ -32,6 +33,7 @@ typedef struct Compressor {
     int wbits;
     int blocksize;
     int flushing;
+    unsigned int greedy_below;
     struct lzxc_data *stream;
     buffer_t residue;
     buffer_t input;
@@ -39,6 +41,54 @@ typedef struct Compressor {
     PyObject *rtable;
 } Compressor;
 
+/* Setting up an lzxc stream allocates multi-megabyte match-finding
+ * structures. Retired streams are parked here (the GIL serializes access)
+ * and handed to the next Compressor created with the same window size, so
+ * compressing many files in a row reuses the warmed allocations.
+ */
+#define STREAM_POOL_SIZE 4
+
+/* Match length cap used when an input falls below greedy_below; short
+ * matches need far fewer analysis passes and lose little on small inputs.
+ */
+#define GREEDY_ANALYSIS_LIMIT 32
+
+static struct {
+    int wbits;
+    struct lzxc_data *stream;
+} stream_pool[STREAM_POOL_SIZE];
+
+static struct lzxc_data *
+stream_pool_get(int wbits)
+{
+    int i;
+    struct lzxc_data *stream = NULL;
+
+    for (i = 0; i < STREAM_POOL_SIZE; i++) {
+        if (stream_pool[i].stream != NULL && stream_pool[i].wbits == wbits) {
+            stream = stream_pool[i].stream;
+            stream_pool[i].stream = NULL;
+            break;
+        }
+    }
+    return stream;
+}
+
+static void
+stream_pool_put(struct lzxc_data *stream, int wbits)
+{
+    int i;
+
+    for (i = 0; i < STREAM_POOL_SIZE; i++) {
+        if (stream_pool[i].stream == NULL) {
+            stream_pool[i].stream = stream;
+            stream_pool[i].wbits = wbits;
+            return;
+        }
+    }
+    lzxc_finish(stream, NULL);
+}
+
 static PyMemberDef Compressor_members[] = {
     { "reset", T_INT, offsetof(Compressor, reset), READONLY,
       "whether or not the Compressor resets each block" },
@@ -46,6 +96,8 @@ static PyMemberDef Compressor_members[] = {
       "window size in bits" },
     { "blocksize", T_INT, offsetof(Compressor, blocksize), READONLY,
       "block size in bytes" },
+    { "greedy_below", T_UINT, offsetof(Compressor, greedy_below), READONLY,
+      "input size below which greedy match analysis is used" },
     { NULL }
 };
 
@@ -69,7 +121,7 @@ Compressor_dealloc(Compressor *self)
     Compressor_clear(self);
 
     if (self->stream) {
-        lzxc_finish(self->stream, NULL);
+        stream_pool_put(self->stream, self->wbits);
         self->stream = NULL;
     }
     if (self->residue.data) {
@@ -182,21 +234,312 @@ mark_frame(void *context, uint32_t uncomp, uint32_t comp)
     }
 }
 
+/* Parallel compression.
+ *
+ * In reset mode every blocksize-sized chunk of input is compressed from a
+ * pristine stream state, so the chunks are independent and can be handed to
+ * a thread pool, with the outputs and frame tables concatenated in order.
+ * Each frame ends 16-bit aligned, which makes plain byte concatenation
+ * produce the same stream the serial loop would have. The workers use only
+ * malloc and their own lzxc streams (created up front, on the main thread),
+ * so they run without the GIL.
+ */
+
+typedef struct lzx_task {
+    const char *data;
+    unsigned int size;
+    char *out;
+    unsigned int out_used;
+    unsigned int out_size;
+    uint32_t *frames;            /* task-relative (uncomp, comp) pairs */
+    unsigned int num_frames;
+    unsigned int frames_size;
+    int error;                   /* 0 ok, 1 compression error, 2 no memory */
+} lzx_task;
+
+struct lzx_queue {
+    lzx_task *tasks;
+    Py_ssize_t count, next;
+    int active_workers;
+    int blocksize;
+    PyThread_type_lock mutex, done;
+};
+
+typedef struct lzx_worker {
+    struct lzx_queue *queue;
+    struct lzxc_data *stream;
+    lzx_task *task;
+    unsigned int in_offset;
+    /* the stream counters accumulate across tasks, frame entries are
+     * rebased to the task using the totals seen at task start */
+    uint32_t total_uncomp, total_comp;
+    uint32_t base_uncomp, base_comp;
+} lzx_worker;
+
+static int
+worker_get_bytes(void *context, int nbytes, void *buf)
+{
+    lzx_worker *w = (lzx_worker *)context;
+    int remaining = w->task->size - w->in_offset;
+
+    if (nbytes > remaining) {
+        nbytes = remaining;
+    }
+    memcpy(buf, w->task->data + w->in_offset, nbytes);
+    w->in_offset += nbytes;
+    return nbytes;
+}
+
+static int
+worker_at_eof(void *context)
+{
+    lzx_worker *w = (lzx_worker *)context;
+    return w->in_offset >= w->task->size;
+}
+
+static int
+worker_put_bytes(void *context, int nbytes, void *data)
+{
+    lzx_worker *w = (lzx_worker *)context;
+    lzx_task *task = w->task;
+
+    if (task->out_used + nbytes > task->out_size) {
+        unsigned int nsize = task->out_size ? task->out_size : 16384;
+        char *nout = NULL;
+        while (task->out_used + nbytes > nsize) {
+            nsize *= 2;
+        }
+        nout = realloc(task->out, nsize);
+        if (nout == NULL) {
+            /* the return value of put_bytes is not checked by the stream,
+             * record the failure and keep going */
+            task->error = 2;
+            return nbytes;
+        }
+        task->out = nout;
+        task->out_size = nsize;
+    }
+    memcpy(task->out + task->out_used, data, nbytes);
+    task->out_used += nbytes;
+    return nbytes;
+}
+
+static void
+worker_mark_frame(void *context, uint32_t uncomp, uint32_t comp)
+{
+    lzx_worker *w = (lzx_worker *)context;
+    lzx_task *task = w->task;
+
+    w->total_uncomp = uncomp;
+    w->total_comp = comp;
+    if (task->num_frames * 2 + 2 > task->frames_size) {
+        unsigned int nsize = task->frames_size ? task->frames_size * 2 : 16;
+        uint32_t *nframes = realloc(task->frames, nsize * sizeof(uint32_t));
+        if (nframes == NULL) {
+            task->error = 2;
+            return;
+        }
+        task->frames = nframes;
+        task->frames_size = nsize;
+    }
+    task->frames[task->num_frames * 2] = uncomp - w->base_uncomp;
+    task->frames[task->num_frames * 2 + 1] = comp - w->base_comp;
+    task->num_frames++;
+}
+
+static void
+compress_mt_worker(void *arg)
+{
+    lzx_worker *w = (lzx_worker *)arg;
+    struct lzx_queue *q = w->queue;
+    int last = 0;
+
+    while (1) {
+        Py_ssize_t idx;
+        PyThread_acquire_lock(q->mutex, 1);
+        idx = (q->next < q->count) ? q->next++ : -1;
+        PyThread_release_lock(q->mutex);
+        if (idx < 0) {
+            break;
+        }
+        w->task = q->tasks + idx;
+        w->in_offset = 0;
+        w->base_uncomp = w->total_uncomp;
+        w->base_comp = w->total_comp;
+        if (lzxc_compress_block(w->stream, q->blocksize, 1) != 0) {
+            w->task->error = 1;
+        }
+        lzxc_reset(w->stream);
+    }
+    /* The queue must not be touched after signalling done: the main thread
+     * may free the locks as soon as it is woken */
+    PyThread_acquire_lock(q->mutex, 1);
+    last = (--q->active_workers == 0);
+    PyThread_release_lock(q->mutex);
+    if (last) {
+        PyThread_release_lock(q->done);
+    }
+}
+
+static PyObject *
+Compressor_compress_mt(
+    Compressor *self, char *data, unsigned int inlen, int threads)
+{
+    struct lzx_queue q;
+    lzx_worker *workers = NULL;
+    Py_ssize_t ntasks, i;
+    unsigned int blocksize = self->blocksize;
+    uint32_t running_uncomp = 0, running_comp = 0;
+    size_t total_out = 0;
+    char *outp = NULL;
+    PyObject *cdata = NULL;
+    PyObject *rtable = NULL;
+    PyObject *result = NULL;
+
+    memset(&q, 0, sizeof(q));
+    ntasks = (inlen + blocksize - 1) / blocksize;
+    if (threads > 64) {
+        threads = 64;
+    }
+    if (threads > ntasks) {
+        threads = (int)ntasks;
+    }
+    q.count = ntasks;
+    q.blocksize = blocksize;
+    q.tasks = calloc(ntasks, sizeof(lzx_task));
+    workers = calloc(threads, sizeof(lzx_worker));
+    q.mutex = PyThread_allocate_lock();
+    q.done = PyThread_allocate_lock();
+    if (q.tasks == NULL || workers == NULL || q.mutex == NULL || q.done == NULL) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i < ntasks; i++) {
+        q.tasks[i].data = data + i * (size_t)blocksize;
+        q.tasks[i].size =
+            (i == ntasks - 1) ? inlen - (unsigned int)(i * blocksize) : blocksize;
+    }
+    for (i = 0; i < threads; i++) {
+        workers[i].queue = &q;
+        if (lzxc_init(&workers[i].stream, self->wbits,
+                      worker_get_bytes, workers + i, worker_at_eof,
+                      worker_put_bytes, workers + i,
+                      worker_mark_frame, workers + i) != 0) {
+            workers[i].stream = NULL;
+            PyErr_SetString(LZXError, "Failed to create compression stream");
+            goto exit;
+        }
+    }
+
+    q.active_workers = 1;  /* the calling thread */
+    PyThread_acquire_lock(q.done, 1);
+    for (i = 1; i < threads; i++) {
+        PyThread_acquire_lock(q.mutex, 1);
+        q.active_workers++;
+        PyThread_release_lock(q.mutex);
+        if (PyThread_start_new_thread(compress_mt_worker, workers + i) == -1) {
+            /* could not start a thread, make do with fewer */
+            PyThread_acquire_lock(q.mutex, 1);
+            q.active_workers--;
+            PyThread_release_lock(q.mutex);
+            break;
+        }
+    }
+    Py_BEGIN_ALLOW_THREADS;
+    compress_mt_worker(workers);
+    PyThread_acquire_lock(q.done, 1);  /* wait for the pool to drain */
+    PyThread_release_lock(q.done);
+    Py_END_ALLOW_THREADS;
+
+    for (i = 0; i < ntasks; i++) {
+        if (q.tasks[i].error == 2) {
+            PyErr_NoMemory();
+            goto exit;
+        }
+        if (q.tasks[i].error != 0) {
+            PyErr_SetString(LZXError, "Error during compression");
+            goto exit;
+        }
+        total_out += q.tasks[i].out_used;
+    }
+
+    /* Concatenate the outputs and rebase the frame tables */
+    cdata = PyBytes_FromStringAndSize(NULL, total_out);
+    rtable = PyList_New(0);
+    if (cdata == NULL || rtable == NULL) {
+        goto exit;
+    }
+    outp = PyBytes_AS_STRING(cdata);
+    for (i = 0; i < ntasks; i++) {
+        lzx_task *task = q.tasks + i;
+        unsigned int j;
+        memcpy(outp, task->out, task->out_used);
+        outp += task->out_used;
+        for (j = 0; j < task->num_frames; j++) {
+            PyObject *entry = Py_BuildValue("(II)",
+                task->frames[j * 2] + running_uncomp,
+                task->frames[j * 2 + 1] + running_comp);
+            if (entry == NULL || PyList_Append(rtable, entry) != 0) {
+                Py_XDECREF(entry);
+                goto exit;
+            }
+            Py_DECREF(entry);
+        }
+        running_uncomp += task->frames[(task->num_frames - 1) * 2];
+        running_comp += task->frames[(task->num_frames - 1) * 2 + 1];
+    }
+    result = Py_BuildValue("(OO)", cdata, rtable);
+
+exit:
+    if (workers) {
+        for (i = 0; i < threads; i++) {
+            if (workers[i].stream) {
+                lzxc_finish(workers[i].stream, NULL);
+            }
+        }
+        free(workers);
+    }
+    if (q.tasks) {
+        for (i = 0; i < ntasks; i++) {
+            free(q.tasks[i].out);
+            free(q.tasks[i].frames);
+        }
+        free(q.tasks);
+    }
+    if (q.mutex) {
+        PyThread_free_lock(q.mutex);
+    }
+    if (q.done) {
+        PyThread_free_lock(q.done);
+    }
+    Py_XDECREF(cdata);
+    Py_XDECREF(rtable);
+    return result;
+}
+
 static int
 Compressor_init(Compressor *self, PyObject *args, PyObject *kwds)
 {
-    static char *kwlist[] = {"wbits", "reset", NULL};
+    static char *kwlist[] = {"wbits", "reset", "greedy_below", NULL};
     int wbits = 0;
     int retval = 0;
 
     self->reset = 1;
+    self->greedy_below = 0;
 
     if (!PyArg_ParseTupleAndKeywords(
-            args, kwds, "I|b", kwlist, &wbits, &self->reset)) {
+            args, kwds, "I|bI", kwlist, &wbits, &self->reset,
+            &self->greedy_below)) {
         return -1;
     }
     /* TODO: check window size. */
 
+    if (self->stream != NULL) {
+        /* the pooled stream keeps the window size it was created with */
+        stream_pool_put(self->stream, self->wbits);
+        self->stream = NULL;
+    }
+
     self->wbits = wbits;
     self->blocksize = 1 << wbits;
 
@@ -206,8 +549,11 @@ Compressor_init(Compressor *self, PyObject *args, PyObject *kwds)
         return -1;
     }
 
+    self->stream = stream_pool_get(wbits);
     if (self->stream != NULL) {
-        lzxc_finish(self->stream, NULL);
+        lzxc_rebind(self->stream, get_bytes, self, at_eof,
+                    put_bytes, self, mark_frame, self);
+        return 0;
     }
     retval = lzxc_init(&self->stream, wbits, get_bytes, self, at_eof,
                        put_bytes, self, mark_frame, self);
@@ -240,6 +586,13 @@ Compressor_compress__(
     input->size = inlen;
     input->offset = 0;
 
+    if (self->greedy_below != 0 &&
+        inlen + (residue->size - residue->offset) < self->greedy_below) {
+        lzxc_set_analysis_limit(self->stream, GREEDY_ANALYSIS_LIMIT);
+    } else {
+        lzxc_set_analysis_limit(self->stream, 0);
+    }
+
     outlen = inlen;
     remainder = outlen % blocksize;
     if (remainder != 0) {
@@ -304,20 +657,30 @@ Compressor_compress__(
 static PyObject *
 Compressor_compress(Compressor *self, PyObject *args, PyObject *kwds)
 {
-    static char *kwlist[] = {"data", "flush", NULL};
+    static char *kwlist[] = {"data", "flush", "threads", NULL};
     char *data = NULL;
     unsigned int inlen = 0;
     int flush = 0;
+    int threads = 1;
 
     if (!PyArg_ParseTupleAndKeywords(
 #if PYTHON_MAJOR_VERSION >= 3
-            args, kwds, "y#|b", kwlist, &data, &inlen, &flush)) {
+            args, kwds, "y#|bi", kwlist, &data, &inlen, &flush, &threads)) {
 #else
-            args, kwds, "s#|b", kwlist, &data, &inlen, &flush)) {
+            args, kwds, "s#|bi", kwlist, &data, &inlen, &flush, &threads)) {
 #endif
         return NULL;
     }
 
+    /* The parallel path needs independent blocks: reset mode, a flushing
+     * one-shot call with no residue from earlier calls, and more than one
+     * block of input */
+    if (threads > 1 && self->reset && flush
+        && COMPRESSOR_REMAINING(self) == 0 && PyList_GET_SIZE(self->rtable) == 0
+        && inlen > (unsigned int)self->blocksize) {
+        return Compressor_compress_mt(self, data, inlen, threads);
+    }
+
     return Compressor_compress__(self, data, inlen, flush);
 }
 
@@ -330,7 +693,9 @@ Compressor_flush(Compressor *self)
 static PyMethodDef Compressor_methods[] = {
     { "compress", (PyCFunction)Compressor_compress,
       METH_VARARGS | METH_KEYWORDS,
-      "Return a string containing data LZX compressed." },
+      "Return a string containing data LZX compressed. With threads > 1,"
+      " a flushing call on a reset-mode compressor spreads the blocks over"
+      " a thread pool." },
     { "flush", (PyCFunction)Compressor_flush, METH_NOARGS,
       "Return a string containing any remaining LZX compressed data." },
     { NULL }
@@ -73,6 +73,26 @@ void lz_init(lz_info *lzi, int wsize, int max_dist,
   lzi->lentab = calloc(lzi->block_buf_size + 1, sizeof(int));
   lzi->prevtab = calloc(lzi->block_buf_size + 1, sizeof(unsigned char *));
   lzi->analysis_valid = 0;
+  lzi->analysis_maxlen = lzi->max_match;
+}
+
+void lz_reinit(lz_info *lzi)
+{
+  lzi->cur_loc = 0;
+  lzi->block_loc = 0;
+  lzi->chars_in_buf = 0;
+  lzi->eofcount = 0;
+  lzi->stop = 0;
+  lzi->analysis_valid = 0;
+}
+
+void lz_set_analysis_limit(lz_info *lzi, int maxlen)
+{
+  if (maxlen <= 0 || maxlen > lzi->max_match)
+    maxlen = lzi->max_match;
+  if (maxlen < lzi->min_match)
+    maxlen = lzi->min_match;
+  lzi->analysis_maxlen = maxlen;
 }
 
 void lz_release(lz_info *lzi)
@@ -215,7 +235,7 @@ static void lz_analyze_block(lz_info *lzi)
   timersub(&initialloop.ru_utime, &initialtime, &initialtime);
 #endif
   wasinc = 1;
-  for (maxlen = 1; wasinc && (maxlen < lzi->max_match); maxlen++) {
+  for (maxlen = 1; wasinc && (maxlen < lzi->analysis_maxlen); maxlen++) {
 #ifdef DEBUG_PERF
     getrusage(RUSAGE_SELF, &outerloop);
 #endif
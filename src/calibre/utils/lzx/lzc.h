@@ -35,6 +35,7 @@ struct lz_info
   int max_dist;
   unsigned char **prevtab;
   int *lentab;
+  int analysis_maxlen; /* cap on match lengths found by block analysis */
   short eofcount;
   short stop;
   short analysis_valid;
@@ -55,6 +56,11 @@ void lz_init(lz_info *lzi, int wsize, int max_dist,
 void lz_release(lz_info *lzi);
 
 void lz_reset(lz_info *lzi);
+/* discard all buffered input and analysis, as if freshly lz_init()ed */
+void lz_reinit(lz_info *lzi);
+/* cap the match lengths found by block analysis, trading compression
+   ratio for analysis time; maxlen <= 0 restores the full max_match */
+void lz_set_analysis_limit(lz_info *lzi, int maxlen);
 void lz_stop_compressing(lz_info *lzi);
 int lz_left_to_process(lz_info *lzi); /* returns # chars read in but unprocessed */
 int lz_compress(lz_info *lzi, int nchars);
@@ -1088,6 +1088,32 @@ lzxc_reset(lzxc_data *lzxd)
   lz_reset(lzxd->lzi);
 }
 
+void lzxc_rebind(lzxc_data *lzxd,
+	     lzxc_get_bytes_t get_bytes, void *get_bytes_arg,
+	     lzxc_at_eof_t at_eof,
+	     lzxc_put_bytes_t put_bytes, void *put_bytes_arg,
+	     lzxc_mark_frame_t mark_frame, void *mark_frame_arg)
+{
+  lzxd->get_bytes = get_bytes;
+  lzxd->in_arg = get_bytes_arg;
+  lzxd->at_eof = at_eof;
+  lzxd->put_bytes = put_bytes;
+  lzxd->out_arg = put_bytes_arg;
+  lzxd->mark_frame = mark_frame;
+  lzxd->mark_frame_arg = mark_frame_arg;
+  lzxd->len_uncompressed_input = 0;
+  lzxd->len_compressed_output = 0;
+  lzxd->bit_buf = 0;
+  lzxd->bits_in_buf = 0;
+  lz_reinit(lzxd->lzi);
+  lzxc_reset(lzxd);
+}
+
+void lzxc_set_analysis_limit(lzxc_data *lzxd, int max_match_len)
+{
+  lz_set_analysis_limit(lzxd->lzi, max_match_len);
+}
+
 int lzxc_compress_block(lzxc_data *lzxd, int block_size, int subdivide)
 {
   int i;
@@ -40,6 +40,18 @@ int lzxc_init(struct lzxc_data **lzxdp, int wsize_code,
 
 void lzxc_reset(lzxc_data *lzxd);
 
+/* rebind a stream to new callbacks and reset it for a fresh compression
+   run, keeping all allocations; for recycling streams between users */
+void lzxc_rebind(lzxc_data *lzxd,
+	     lzxc_get_bytes_t get_bytes, void *get_bytes_arg,
+	     lzxc_at_eof_t at_eof,
+	     lzxc_put_bytes_t put_bytes, void *put_bytes_arg,
+	     lzxc_mark_frame_t mark_frame, void *mark_frame_arg);
+
+/* cap the match lengths found by input analysis, trading compression
+   ratio for speed; max_match_len <= 0 restores the full match length */
+void lzxc_set_analysis_limit(lzxc_data *lzxd, int max_match_len);
+
 int lzxc_compress_block(lzxc_data *lzxd, int block_size, int subdivide);
 
 int lzxc_finish(struct lzxc_data *lzxd, struct lzxc_results *lzxr);
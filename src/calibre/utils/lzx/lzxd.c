@@ -80,9 +80,11 @@
  * mask any bits. So we have to know the bit width of the bit buffer
  * variable.
  *
- * The bit buffer datatype should be at least 32 bits wide: it must be
- * possible to ENSURE_BITS(16), so it must be possible to add 16 new bits
- * to the bit buffer when the bit buffer already has 1 to 15 bits left.
+ * The bit buffer is 64 bits wide. The stream is read 16-bit little-endian
+ * word at a time, but the wide buffer lets the common refill inject two
+ * whole words in one go with a single bounds check, instead of looping
+ * with a branch per 16 bits; LZX never reads more than 17 bits at once so
+ * one such refill always satisfies a request.
  */
 
 #if HAVE_LIMITS_H
@@ -107,18 +109,29 @@
   bits_left  = lzx->bits_left;                                          \
 } while (0)
 
-#define ENSURE_BITS(nbits)                                              \
-  while (bits_left < (nbits)) {                                         \
-    if (i_ptr >= i_end) {                                               \
-      if (lzxd_read_input(lzx)) return lzx->error;                      \
-      i_ptr = lzx->i_ptr;                                               \
-      i_end = lzx->i_end;                                               \
+#define ENSURE_BITS(nbits) do {                                         \
+  if (bits_left < (nbits)) {                                            \
+    if ((i_ptr + 3 < i_end) && (bits_left <= (int)(BITBUF_WIDTH - 32))) {\
+      /* common case: inject two whole words at once, one bounds check */\
+      bit_buffer |= (((uint64_t)((i_ptr[1] << 8) | i_ptr[0]) << 16)     \
+                     | (uint64_t)((i_ptr[3] << 8) | i_ptr[2]))          \
+                    << (BITBUF_WIDTH - 32 - bits_left);                 \
+      bits_left  += 32;                                                 \
+      i_ptr      += 4;                                                  \
     }                                                                   \
-    bit_buffer |= ((i_ptr[1] << 8) | i_ptr[0])                          \
-                  << (BITBUF_WIDTH - 16 - bits_left);                   \
-    bits_left  += 16;                                                   \
-    i_ptr      += 2;                                                    \
-  }
+    else while (bits_left < (nbits)) {                                  \
+      if (i_ptr >= i_end) {                                             \
+        if (lzxd_read_input(lzx)) return lzx->error;                    \
+        i_ptr = lzx->i_ptr;                                             \
+        i_end = lzx->i_end;                                             \
+      }                                                                 \
+      bit_buffer |= (uint64_t)((i_ptr[1] << 8) | i_ptr[0])              \
+                    << (BITBUF_WIDTH - 16 - bits_left);                 \
+      bits_left  += 16;                                                 \
+      i_ptr      += 2;                                                  \
+    }                                                                   \
+  }                                                                     \
+} while (0)
 
 #define PEEK_BITS(nbits) (bit_buffer >> (BITBUF_WIDTH - (nbits)))
 
@@ -164,19 +177,19 @@ static int lzxd_read_input(struct lzxd_stream *lzx) {
   ENSURE_BITS(16);                                                      \
   /* immediate table lookup of [tablebits] bits of the code */          \
   sym = lzx->tbl##_table[PEEK_BITS(LZX_##tbl##_TABLEBITS)];             \
-  /* is the symbol is longer than [tablebits] bits? (i=node index) */   \
+  /* is the symbol is longer than [tablebits] bits? */                  \
   if (sym >= LZX_##tbl##_MAXSYMBOLS) {                                  \
     /* decode remaining bits by tree traversal */                       \
-    i = 1 << (BITBUF_WIDTH - LZX_##tbl##_TABLEBITS);                    \
+    uint64_t mask = (uint64_t)1 << (BITBUF_WIDTH - LZX_##tbl##_TABLEBITS); \
     do {                                                                \
       /* one less bit. error if we run out of bits before decode */     \
-      i >>= 1;                                                          \
-      if (i == 0) {                                                     \
+      mask >>= 1;                                                       \
+      if (mask == 0) {                                                  \
         D(("out of bits in huffman decode"))                            \
         return lzx->error = MSPACK_ERR_DECRUNCH;                        \
       }                                                                 \
       /* double node index and add 0 (left branch) or 1 (right) */      \
-      sym <<= 1; sym |= (bit_buffer & i) ? 1 : 0;                       \
+      sym <<= 1; sym |= (bit_buffer & mask) ? 1 : 0;                    \
       /* hop to next node index / decoded symbol */                     \
       sym = lzx->tbl##_table[sym];                                      \
       /* while we are still in node indicies, not decoded symbols */    \
@@ -293,7 +306,7 @@ static int lzxd_read_lens(struct lzxd_stream *lzx, unsigned char *lens,
 			  unsigned int first, unsigned int last)
 {
   /* bit buffer and huffman symbol decode variables */
-  register unsigned int bit_buffer;
+  register uint64_t bit_buffer;
   register int bits_left, i;
   register unsigned short sym;
   unsigned char *i_ptr, *i_end;
@@ -466,9 +479,27 @@ void lzxd_set_output_length(struct lzxd_stream *lzx, off_t out_bytes) {
   if (lzx && out_bytes > 0) lzx->length = out_bytes;
 }
 
+void lzxd_reuse(struct lzxd_stream *lzx, off_t output_length) {
+  if (!lzx) return;
+  lzx->offset          = 0;
+  lzx->length          = output_length;
+  lzx->window_posn     = 0;
+  lzx->frame_posn      = 0;
+  lzx->frame           = 0;
+  lzx->intel_filesize  = 0;
+  lzx->intel_curpos    = 0;
+  lzx->intel_started   = 0;
+  lzx->input_end       = 0;
+  lzx->error           = MSPACK_ERR_OK;
+  lzx->i_ptr = lzx->i_end = &lzx->inbuf[0];
+  lzx->o_ptr = lzx->o_end = &lzx->e8_buf[0];
+  lzx->bit_buffer = lzx->bits_left = 0;
+  lzxd_reset_state(lzx);
+}
+
 int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
   /* bitstream reading and huffman variables */
-  register unsigned int bit_buffer;
+  register uint64_t bit_buffer;
   register int bits_left, i=0;
   register unsigned short sym;
   unsigned char *i_ptr, *i_end;
@@ -583,7 +614,9 @@ int lzxd_decompress(struct lzxd_stream *lzx, off_t out_bytes) {
 
 	  /* read 1-16 (not 0-15) bits to align to bytes */
 	  ENSURE_BITS(16);
-	  if (bits_left > 16) i_ptr -= 2;
+	  /* return whole unused words to the input; the wide bit buffer can
+	   * hold several of them after a 32-bit refill */
+	  while (bits_left > 16) { i_ptr -= 2; bits_left -= 16; }
 	  bits_left = 0; bit_buffer = 0;
 
 	  /* read 12 bytes of stored R0 / R1 / R2 values */
@@ -13,6 +13,11 @@
 #pragma once
 
 #include <sys/types.h>
+#ifdef _MSC_VER
+#include "msstdint.h"
+#else
+#include <stdint.h>
+#endif
 
 
 /* LZX compression / decompression definitions */
@@ -75,7 +80,8 @@ struct lzxd_stream {
 
   /* I/O buffering */
   unsigned char *inbuf, *i_ptr, *i_end, *o_ptr, *o_end;
-  unsigned int  bit_buffer, bits_left, inbuf_size;
+  uint64_t      bit_buffer;
+  unsigned int  bits_left, inbuf_size;
 
   /* huffman code lengths */
   unsigned char PRETREE_len  [LZX_PRETREE_MAXSYMBOLS  + LZX_LENTABLE_SAFETY];
@@ -134,6 +140,13 @@ extern struct lzxd_stream *lzxd_init(struct mspack_system *system,
 extern void lzxd_set_output_length(struct lzxd_stream *lzx,
 				   off_t output_length);
 
+/* reinitialises a stream for decoding a fresh LZX data stream, keeping the
+ * window and input buffer allocations from lzxd_init(). Equivalent to
+ * lzxd_free() followed by lzxd_init() with the same parameters, but without
+ * the allocations. output_length is as described in lzxd_init().
+ */
+extern void lzxd_reuse(struct lzxd_stream *lzx, off_t output_length);
+
 /* decompresses, or decompresses more of, an LZX stream.
  *
  * - out_bytes of data will be decompressed and the function will return
@@ -115,8 +115,11 @@ struct mspack_system lzxglue_system = {
 
 int LZXwindow = 0;
 struct lzxd_stream * lzx_stream = NULL;
+/* The stream reads from and writes to these; the buffers are repointed at
+ * the caller's data for each decompression run */
+static memory_file lzx_source = { 0xB5, NULL, 0, 0 };
+static memory_file lzx_dest = { 0xB5, NULL, 0, 0 };
 
-/* Can't really init here, don't know enough */
 static PyObject *
 init(PyObject *self, PyObject *args)
 {
@@ -126,8 +129,13 @@ init(PyObject *self, PyObject *args)
         return NULL;
     }
 
+    /* the stream (and its window) is kept across calls, it only has to be
+     * recreated when the window size changes */
+    if (lzx_stream != NULL && window != LZXwindow) {
+        lzxd_free(lzx_stream);
+        lzx_stream = NULL;
+    }
     LZXwindow = window;
-    lzx_stream = NULL;
 
     Py_RETURN_NONE;
 }
@@ -145,16 +153,54 @@ reset(PyObject *self, PyObject *args)
 
 //int LZXdecompress(unsigned char *inbuf, unsigned char *outbuf,
 //    unsigned int inlen, unsigned int outlen)
+static int
+decompress_buffer(unsigned char *inbuf, unsigned int inlen,
+                  unsigned char *outbuf, unsigned int outlen)
+{
+    int err;
+
+    if (lzx_stream == NULL) {
+        lzx_stream = lzxd_init(&lzxglue_system,
+            (struct mspack_file *)&lzx_source, (struct mspack_file *)&lzx_dest,
+            LZXwindow, 0x7fff /* Never reset, I do it */, 4096, outlen);
+        if (lzx_stream == NULL) {
+            return -1;
+        }
+    } else {
+        lzxd_reuse(lzx_stream, outlen);
+    }
+
+    lzx_source.buffer = inbuf;
+    lzx_source.current_bytes = 0;
+    lzx_source.total_bytes = inlen;
+
+    lzx_dest.buffer = outbuf;
+    lzx_dest.current_bytes = 0;
+    lzx_dest.total_bytes = outlen;
+
+    /* The stream callbacks only copy memory and output overruns cannot
+     * happen since the writes are bounded by outlen, so the GIL can be
+     * released; for small outputs the save/restore costs more than the
+     * decompression, hence the threshold */
+    if (outlen >= 256u * 1024u) {
+        Py_BEGIN_ALLOW_THREADS;
+        err = lzxd_decompress(lzx_stream, outlen);
+        Py_END_ALLOW_THREADS;
+    } else {
+        err = lzxd_decompress(lzx_stream, outlen);
+    }
+    lzx_source.buffer = NULL;
+    lzx_dest.buffer = NULL;
+
+    return (err == MSPACK_ERR_OK) ? 0 : -1;
+}
+
 static PyObject *
 decompress(PyObject *self, PyObject *args)
 {
     unsigned char *inbuf;
-    unsigned char *outbuf;
     unsigned int inlen;
     unsigned int outlen;
-    int err;
-    memory_file source;
-    memory_file dest;
     PyObject *retval = NULL;
 
 #if PY_MAJOR_VERSION >= 3
@@ -169,40 +215,54 @@ decompress(PyObject *self, PyObject *args)
     if (retval == NULL) {
         return NULL;
     }
-    outbuf = (unsigned char *)PyBytes_AS_STRING(retval);
 
-    source.magic = 0xB5;
-    source.buffer = inbuf;
-    source.current_bytes = 0;
-    source.total_bytes = inlen;
+    if (decompress_buffer(inbuf, inlen,
+            (unsigned char *)PyBytes_AS_STRING(retval), outlen) != 0) {
+        Py_DECREF(retval);
+        retval = NULL;
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(LZXError, "LZX decompression failed");
+        }
+    }
 
-    dest.magic = 0xB5;
-    dest.buffer = outbuf;
-    dest.current_bytes = 0;
-    dest.total_bytes = outlen;
+    return retval;
+}
 
-    lzx_stream = lzxd_init(&lzxglue_system, (struct mspack_file *)&source,
-        (struct mspack_file *)&dest, LZXwindow,
-        0x7fff /* Never reset, I do it */, 4096, outlen);
-    err = -1;
-    if (lzx_stream) err = lzxd_decompress(lzx_stream, outlen);
+static PyObject *
+decompress_into(PyObject *self, PyObject *args)
+{
+    unsigned char *inbuf;
+    unsigned int inlen;
+    Py_buffer outview;
+    int err;
 
-    lzxd_free(lzx_stream);
-    lzx_stream = NULL;
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTuple(args, "y#w*", &inbuf, &inlen, &outview)) {
+#else
+    if (!PyArg_ParseTuple(args, "s#w*", &inbuf, &inlen, &outview)) {
+#endif
+        return NULL;
+    }
 
-    if (err != MSPACK_ERR_OK) {
-        Py_DECREF(retval);
-        retval = NULL;
-        PyErr_SetString(LZXError, "LZX decompression failed");
+    err = decompress_buffer(inbuf, inlen,
+        (unsigned char *)outview.buf, (unsigned int)outview.len);
+    PyBuffer_Release(&outview);
+    if (err != 0) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(LZXError, "LZX decompression failed");
+        }
+        return NULL;
     }
 
-    return retval;
+    Py_RETURN_NONE;
 }
 
 static PyMethodDef lzx_methods[] = {
     { "init", &init, METH_VARARGS, "Initialize the LZX decompressor" },
     { "reset", &reset, METH_VARARGS, "Reset the LZX decompressor" },
     { "decompress", &decompress, METH_VARARGS, "Run the LZX decompressor" },
+    { "decompress_into", &decompress_into, METH_VARARGS,
+      "Run the LZX decompressor, writing into a preallocated writable buffer" },
     { NULL }
 };
 
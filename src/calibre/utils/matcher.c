@@ -8,6 +8,8 @@
 #define NO_ICU_TO_PYTHON
 #define NO_PYTHON_TO_ICU32
 #include "icu_calibre_utils.h"
+#include "calibre_alloc.h"
+#include "op_stats.h"
 #include <float.h>
 
 #ifdef _MSC_VER
@@ -18,8 +20,28 @@
 typedef unsigned char bool;
 #define TRUE 1
 #define FALSE 0
+
+// SSE2 is part of the x86-64 baseline and of every 32-bit CPU calibre
+// supports (see imageops.h); the prefilter keeps a scalar loop as fallback
+// for other architectures and for the trailing characters.
+#if defined(__SSE2__) || (defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define MATCHER_HAS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Native-layer work counters, exported via get_stats()
+enum { STAT_CALCULATE_SCORES, STAT_COUNT };
+static CalibreOpStat matcher_op_stats[STAT_COUNT] = {
+    {"calculate_scores", 0, 0},
+};
 #define MAX(x, y) ((x > y) ? x : y)
 #define nullfree(x) if(x != NULL) free(x); x = NULL;
+#define MAX_MATCH_WORKERS 16
+
+// Scratch memory for scoring comes from grow-only arenas (see
+// calibre_alloc.h) owned by the Matcher. They are reset (not freed)
+// between queries, so the hot interactive path does no allocator traffic
+// once the arenas have grown to their steady-state size.
 
 // Algorithm to sort items by subsequence score {{{
 typedef struct {
@@ -27,15 +49,20 @@ typedef struct {
     int32_t *positions;
 } MemoryItem;
 
-static MemoryItem*** alloc_memory(int32_t needle_len, int32_t max_haystack_len) {
-    MemoryItem ***ans = NULL, **d1 = NULL, *d2 = NULL;
+static size_t memory_size(int32_t needle_len, int32_t max_haystack_len) {
     size_t num = max_haystack_len * max_haystack_len * needle_len;
     size_t position_sz = needle_len * sizeof(int32_t);
-    size_t sz = (num * (sizeof(MemoryItem) + position_sz)) + (max_haystack_len * sizeof(MemoryItem**)) + (needle_len * sizeof(MemoryItem*));
+    return (num * (sizeof(MemoryItem) + position_sz)) + (max_haystack_len * sizeof(MemoryItem**)) + (needle_len * sizeof(MemoryItem*));
+}
+
+static MemoryItem*** alloc_memory(Arena *arena, int32_t needle_len, int32_t max_haystack_len) {
+    MemoryItem ***ans = NULL, **d1 = NULL, *d2 = NULL;
+    size_t position_sz = needle_len * sizeof(int32_t);
+    size_t sz = memory_size(needle_len, max_haystack_len);
     int32_t hidx, nidx, last_idx, i, j;
     char *base = NULL;
 
-    ans = (MemoryItem***) calloc(sz, 1);
+    ans = (MemoryItem***) arena_carve(arena, sz);
     if (ans != NULL) {
         d1 = (MemoryItem**)(ans + max_haystack_len);
         d2 = (MemoryItem*) (d1 + max_haystack_len * needle_len );
@@ -84,18 +111,22 @@ typedef struct {
     StackItem *items;
 } Stack;
 
-static void alloc_stack(Stack *stack, int32_t needle_len, int32_t max_haystack_len) {
+static size_t stack_size(int32_t needle_len, int32_t max_haystack_len) {
+    size_t num = max_haystack_len * needle_len;
+    return num * (sizeof(StackItem) + needle_len * sizeof(int32_t));
+}
+
+static void alloc_stack(Arena *arena, Stack *stack, int32_t needle_len, int32_t max_haystack_len) {
     StackItem *ans = NULL;
     char *base = NULL;
     size_t num = max_haystack_len * needle_len;
     size_t position_sz = needle_len * sizeof(int32_t);
-    size_t sz = sizeof(StackItem) + position_sz;
     size_t i = 0;
 
     stack->needle_len = needle_len;
     stack->pos = -1;
     stack->size = num;
-    ans = (StackItem*) calloc(num, sz);
+    ans = (StackItem*) arena_carve(arena, stack_size(needle_len, max_haystack_len));
     if (ans != NULL) {
         base = (char*)(ans + num);
         for (i = 0; i < num; i++, base += position_sz) ans[i].positions = (int32_t*) base;
@@ -240,7 +271,8 @@ static bool create_searches(UStringSearch **searches, UChar *haystack, int32_t h
         U16_FWD_1(needle, i, needle_len);
         if (pos == i) break;
         searches[pos] = usearch_openFromCollator(needle + pos, i - pos, haystack, haystack_len, collator, NULL, &status);
-        if (U_FAILURE(status)) { PyErr_SetString(PyExc_ValueError, u_errorName(status)); searches[pos] = NULL; return FALSE; }
+        // No PyErr here, this can run in a worker thread without the GIL
+        if (U_FAILURE(status)) { searches[pos] = NULL; return FALSE; }
     }
 
     return TRUE;
@@ -254,67 +286,268 @@ static void free_searches(UStringSearch **searches, int32_t count) {
     }
 }
 
-static bool match(UChar **items, int32_t *item_lengths, uint32_t item_count, UChar *needle, Match *match_results, int32_t *final_positions, int32_t needle_char_len, UCollator *collator, UChar *level1, UChar *level2, UChar *level3) {
+// First-character prefilter {{{
+
+// Most items cannot match a query at all because they do not contain the
+// first character of the needle, yet the scorer still walks them fully.
+// Before scoring, each item is scanned for the needle's first character so
+// non-containing items can be skipped outright. The scorer matches through
+// the collator, which may fold case and accents and carry locale
+// tailorings, so the scan cannot simply compare codepoints: instead the
+// set of ASCII characters that collate equal to the needle's first
+// character is computed with the actual collator, and an item is skipped
+// only when it is pure ASCII and contains none of them. Non-ASCII items
+// and needles always go to the scorer, so the filter is exact for any
+// collator.
+
+#define MAX_PREFILTER_CHARS 4
+
+static int32_t build_prefilter(UCollator *collator, const UChar *needle, int32_t needle_len, UChar *chars) {
+    UChar32 first = 0;
+    UChar c;
+    int32_t count = 0, flen = 0;
+
+    if (needle_len <= 0) return 0;
+    U16_GET(needle, 0, 0, needle_len, first);
+    if (first >= 0x80 || !u_isalnum(first)) return 0;
+    flen = U16_LENGTH(first);
+    for (c = 0x20; c < 0x7f; c++) {
+        if (ucol_strcoll(collator, &c, 1, needle, flen) == UCOL_EQUAL) {
+            // An unusual tailoring with many equivalents, not worth filtering
+            if (count >= MAX_PREFILTER_CHARS) return 0;
+            chars[count++] = c;
+        }
+    }
+    return count;
+}
+
+// Returns TRUE iff the item is pure ASCII and contains none of the
+// prefilter characters, i.e. it provably cannot match the needle
+static bool prefilter_rejects(const UChar *s, int32_t len, const UChar *chars, int32_t count) {
+    int32_t i = 0, k;
+#ifdef MATCHER_HAS_SSE2
+    const __m128i limit = _mm_set1_epi16(0x7f);
+    __m128i targets[MAX_PREFILTER_CHARS];
+    for (k = 0; k < count; k++) targets[k] = _mm_set1_epi16((short)chars[k]);
+    for (; i + 8 <= len; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        // Non-ASCII characters and prefilter characters both mean the item
+        // cannot be skipped, so they share one test
+        __m128i bad = _mm_cmpgt_epi16(v, limit);
+        for (k = 0; k < count; k++) bad = _mm_or_si128(bad, _mm_cmpeq_epi16(v, targets[k]));
+        if (_mm_movemask_epi8(bad) != 0) return FALSE;
+    }
+#endif
+    for (; i < len; i++) {
+        if (s[i] > 0x7f) return FALSE;
+        for (k = 0; k < count; k++) { if (s[i] == chars[k]) return FALSE; }
+    }
+    return TRUE;
+}
+
+// }}}
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#include <unistd.h>
+#define MATCHER_HAS_THREADS 1
+#endif
+
+// Scores are independent per item, so items can be sharded over a pool of
+// worker threads. Each worker has its own collator clone (collators are not
+// thread safe) and its own stack/memo scratch space; items are handed out
+// one at a time from a shared counter so fast workers steal work that would
+// otherwise queue behind slow items.
+#define BITMAP_BYTES(count) (((count) + 7) / 8)
+#define BITMAP_GET(b, i) ((b)[(i) >> 3] & (1 << ((i) & 7)))
+#define BITMAP_SET(b, i) ((b)[(i) >> 3] |= (1 << ((i) & 7)))
+
+typedef struct {
+    UChar **items;
+    int32_t *item_lengths;
+    uint32_t item_count;
+    UChar *needle;
+    int32_t needle_len, needle_char_len, maxhl;
+    Match *match_results;
+    int32_t *final_positions;
+    UCollator *collator;
+    UChar *level1, *level2, *level3;
+    const uint8_t *skip;  // Bitmap of items known to score zero, may be NULL
+    const UChar *pf_chars;  // Collator-equivalents of the needle's first char
+    int32_t pf_count;       // 0 disables the prefilter
+    Arena *arena;
+    uint32_t *next_item;
+#ifdef MATCHER_HAS_THREADS
+    pthread_mutex_t *next_item_mutex;
+#endif
+    bool ok;
+} MatchWorker;
+
+static uint32_t grab_next_item(MatchWorker *w) {
+    uint32_t ans;
+#ifdef MATCHER_HAS_THREADS
+    pthread_mutex_lock(w->next_item_mutex);
+    ans = (*w->next_item)++;
+    pthread_mutex_unlock(w->next_item_mutex);
+#else
+    ans = (*w->next_item)++;
+#endif
+    return ans;
+}
+
+static void process_items(MatchWorker *w) {
     Stack stack = {0};
-    int32_t i = 0, maxhl = 0;
+    uint32_t i = 0;
     int32_t r = 0, *positions = NULL;
-    MatchInfo *matches = NULL;
-    bool ok = FALSE;
+    MatchInfo minfo = {0};
     MemoryItem ***memo = NULL;
-    int32_t needle_len = u_strlen(needle);
     UStringSearch **searches = NULL;
 
-    if (needle_len <= 0 || item_count <= 0) {
-        for (i = 0; i < (int32_t)item_count; i++) match_results[i].score = 0.0;
-        ok = TRUE;
-        goto end;
+    w->ok = FALSE;
+    arena_reset(w->arena);
+    if (!arena_reserve(w->arena,
+                memory_size(w->needle_len, w->maxhl) + stack_size(w->needle_len, w->maxhl) +
+                2 * w->needle_len * sizeof(int32_t) + w->needle_len * sizeof(UStringSearch*) + 4 * ARENA_ALIGN)) goto end;
+    positions = (int32_t*)arena_carve(w->arena, 2*w->needle_len*sizeof(int32_t)); // One set of positions is the final answer and one set is working space
+    searches = (UStringSearch**) arena_carve(w->arena, w->needle_len*sizeof(UStringSearch*));
+    alloc_stack(w->arena, &stack, w->needle_len, w->maxhl);
+    memo = alloc_memory(w->arena, w->needle_len, w->maxhl);
+    if (positions == NULL || searches == NULL || stack.items == NULL || memo == NULL) goto end;
+
+    minfo.needle = w->needle;
+    minfo.needle_len = w->needle_len;
+    minfo.level1 = w->level1;
+    minfo.level2 = w->level2;
+    minfo.level3 = w->level3;
+    minfo.memo = memo;
+
+    while ((i = grab_next_item(w)) < w->item_count) {
+        if (w->skip != NULL && BITMAP_GET(w->skip, i)) {
+            // Known to score zero from a previous, shorter query
+            w->match_results[i].score = 0.0;
+            convert_positions(positions, w->final_positions + i * w->needle_char_len, w->items[i], w->needle_char_len, w->needle_len, 0.0);
+            continue;
+        }
+        // Empty items can never match (and usearch cannot even be opened on
+        // them), nor can items rejected by the first character prefilter
+        if (w->item_lengths[i] <= 0 || (w->pf_count > 0 && prefilter_rejects(w->items[i], w->item_lengths[i], w->pf_chars, w->pf_count))) {
+            w->match_results[i].score = 0.0;
+            convert_positions(positions, w->final_positions + i * w->needle_char_len, w->items[i], w->needle_char_len, w->needle_len, 0.0);
+            continue;
+        }
+        minfo.haystack = w->items[i];
+        minfo.haystack_len = w->item_lengths[i];
+        minfo.max_score_per_char = (1.0 / minfo.haystack_len + 1.0 / w->needle_len) / 2.0;
+        for (r = 0; r < w->needle_len; r++)  positions[r] = -1;
+        stack_clear(&stack);
+        clear_memory(memo, w->needle_len, minfo.haystack_len);
+        free_searches(searches, w->needle_len);
+        if (!create_searches(searches, minfo.haystack, minfo.haystack_len, w->needle, w->needle_len, w->collator)) goto end;
+        w->match_results[i].score = process_item(&minfo, &stack, positions, searches);
+        convert_positions(positions, w->final_positions + i * w->needle_char_len, minfo.haystack, w->needle_char_len, w->needle_len, w->match_results[i].score);
     }
 
-    matches = (MatchInfo*)calloc(item_count, sizeof(MatchInfo));
-    positions = (int32_t*)calloc(2*needle_len, sizeof(int32_t)); // One set of positions is the final answer and one set is working space
-    searches = (UStringSearch**) calloc(needle_len, sizeof(UStringSearch*));
-    if (matches == NULL || positions == NULL || searches == NULL) {PyErr_NoMemory(); goto end;}
-
-    for (i = 0; i < (int32_t)item_count; i++) {
-        matches[i].haystack = items[i];
-        matches[i].haystack_len = item_lengths[i];
-        matches[i].needle = needle;
-        matches[i].needle_len = needle_len;
-        matches[i].max_score_per_char = (1.0 / matches[i].haystack_len + 1.0 / needle_len) / 2.0;
-        matches[i].level1 = level1;
-        matches[i].level2 = level2;
-        matches[i].level3 = level3;
-        maxhl = MAX(maxhl, matches[i].haystack_len);
+    w->ok = TRUE;
+end:
+    // All scratch memory came from the arena, only the ICU search handles
+    // need to be closed
+    if (searches != NULL) free_searches(searches, w->needle_len);
+}
+
+#ifdef MATCHER_HAS_THREADS
+static void* process_items_worker(void *x) {
+    process_items((MatchWorker*)x);
+    return NULL;
+}
+#endif
+
+static bool match(UChar **items, int32_t *item_lengths, uint32_t item_count, UChar *needle, Match *match_results, int32_t *final_positions, int32_t needle_char_len, UCollator *collator, UChar *level1, UChar *level2, UChar *level3, int32_t num_threads, const uint8_t *skip, Arena *arenas) {
+    UChar pf_chars[MAX_PREFILTER_CHARS];
+    int32_t pf_count = 0;
+    int32_t i = 0, maxhl = 0, num_workers = 1;
+    bool ok = TRUE;
+    int32_t needle_len = u_strlen(needle);
+    uint32_t next_item = 0;
+    MatchWorker workers[1
+#ifdef MATCHER_HAS_THREADS
+        + MAX_MATCH_WORKERS
+#endif
+    ];
+#ifdef MATCHER_HAS_THREADS
+    pthread_mutex_t next_item_mutex;
+#endif
+
+    if (needle_len <= 0 || item_count <= 0) {
+        for (i = 0; i < (int32_t)item_count; i++) match_results[i].score = 0.0;
+        return TRUE;
     }
 
+    for (i = 0; i < (int32_t)item_count; i++) maxhl = MAX(maxhl, item_lengths[i]);
     if (maxhl <= 0) {
         for (i = 0; i < (int32_t)item_count; i++) match_results[i].score = 0.0;
-        ok = TRUE;
-        goto end;
+        return TRUE;
     }
 
-    alloc_stack(&stack, needle_len, maxhl);
-    memo = alloc_memory(needle_len, maxhl);
-    if (stack.items == NULL || memo == NULL) {PyErr_NoMemory(); goto end;}
+#ifdef MATCHER_HAS_THREADS
+    num_workers = num_threads;
+    if (num_workers < 1) {  // Auto-detect
+        num_workers = (int32_t)sysconf(_SC_NPROCESSORS_ONLN);
+        if (num_workers < 1) num_workers = 1;
+    }
+    if (num_workers > MAX_MATCH_WORKERS) num_workers = MAX_MATCH_WORKERS;
+    if ((uint32_t)num_workers > item_count) num_workers = (int32_t)item_count;
+    if (item_count < 512) num_workers = 1;  // Not worth the thread startup cost
+#else
+    (void)num_threads;
+#endif
 
-    for (i = 0; i < (int32_t)item_count; i++) {
-        for (r = 0; r < needle_len; r++)  positions[r] = -1;
-        stack_clear(&stack);
-        clear_memory(memo, needle_len, matches[i].haystack_len);
-        free_searches(searches, needle_len);
-        if (!create_searches(searches, matches[i].haystack, matches[i].haystack_len, needle, needle_len, collator)) goto end;
-        matches[i].memo = memo;
-        match_results[i].score = process_item(&matches[i], &stack, positions, searches);
-        convert_positions(positions, final_positions + i * needle_char_len, matches[i].haystack, needle_char_len, needle_len, match_results[i].score);
+    pf_count = build_prefilter(collator, needle, needle_len, pf_chars);
+
+    for (i = 0; i < num_workers; i++) {
+        UErrorCode status = U_ZERO_ERROR;
+        workers[i].collator = (i == 0) ? collator : ucol_safeClone(collator, NULL, NULL, &status);
+        if (workers[i].collator == NULL || U_FAILURE(status)) {
+            while (--i > 0) ucol_close(workers[i].collator);
+            return FALSE;
+        }
+        workers[i].items = items; workers[i].item_lengths = item_lengths; workers[i].item_count = item_count;
+        workers[i].needle = needle; workers[i].needle_len = needle_len; workers[i].needle_char_len = needle_char_len;
+        workers[i].maxhl = maxhl;
+        workers[i].match_results = match_results; workers[i].final_positions = final_positions;
+        workers[i].level1 = level1; workers[i].level2 = level2; workers[i].level3 = level3;
+        workers[i].skip = skip;
+        workers[i].pf_chars = pf_chars; workers[i].pf_count = pf_count;
+        workers[i].arena = &arenas[i];
+        workers[i].next_item = &next_item;
+#ifdef MATCHER_HAS_THREADS
+        workers[i].next_item_mutex = &next_item_mutex;
+#endif
+        workers[i].ok = FALSE;
     }
 
-    ok = TRUE;
-end:
-    nullfree(positions);
-    nullfree(stack.items);
-    nullfree(matches);
-    nullfree(memo);
-    if (searches != NULL) { free_searches(searches, needle_len); nullfree(searches); }
+#ifdef MATCHER_HAS_THREADS
+    // grab_next_item() locks the mutex even in single worker runs, so it
+    // must be initialized whenever the workers can reference it
+    pthread_mutex_init(&next_item_mutex, NULL);
+    if (num_workers > 1) {
+        pthread_t threads[MAX_MATCH_WORKERS];
+        int started[MAX_MATCH_WORKERS] = {0};
+        for (i = 1; i < num_workers; i++) started[i] = (pthread_create(&threads[i], NULL, process_items_worker, &workers[i]) == 0);
+        process_items(&workers[0]);
+        for (i = 1; i < num_workers; i++) {
+            if (started[i]) pthread_join(threads[i], NULL);
+            else process_items(&workers[i]);  // Thread creation failed, do the work inline
+        }
+    } else process_items(&workers[0]);
+    pthread_mutex_destroy(&next_item_mutex);
+#else
+    process_items(&workers[0]);
+#endif
+
+    for (i = 0; i < num_workers; i++) {
+        if (!workers[i].ok) ok = FALSE;
+        if (i > 0) ucol_close(workers[i].collator);
+    }
     return ok;
 }
 
@@ -331,17 +564,34 @@ typedef struct {
     UChar *level2;
     UChar *level3;
     UCollator *collator;
+    int32_t num_threads;
+    // Cache of the previous query: items that scored zero for it can be
+    // skipped when the new query merely extends it
+    UChar *prev_query;
+    int32_t prev_query_len;
+    uint8_t *zero_bitmap;
+    // When the items were loaded from a dump, they live in this single
+    // block instead of one allocation per item
+    UChar *items_block;
+    // Grow-only scratch memory, reset between queries: one arena per
+    // possible worker thread and one for the per-query result buffers
+    Arena arenas[1 + MAX_MATCH_WORKERS];
+    Arena qarena;
 } Matcher;
 
 // Matcher.__init__() {{{
 
 static void free_matcher(Matcher *self) {
     uint32_t i = 0;
-    if (self->items != NULL) {
+    if (self->items != NULL && self->items_block == NULL) {
         for (i = 0; i < self->item_count; i++) { nullfree(self->items[i]); }
     }
+    nullfree(self->items_block);
     nullfree(self->items); nullfree(self->item_lengths);
     nullfree(self->level1); nullfree(self->level2); nullfree(self->level3);
+    nullfree(self->prev_query); nullfree(self->zero_bitmap); self->prev_query_len = 0;
+    for (i = 0; i < sizeof(self->arenas)/sizeof(self->arenas[0]); i++) arena_free(&self->arenas[i]);
+    arena_free(&self->qarena);
     if (self->collator != NULL) ucol_close(self->collator); self->collator = NULL;
 }
 static void
@@ -357,10 +607,14 @@ Matcher_init(Matcher *self, PyObject *args, PyObject *kwds)
 {
     PyObject *items = NULL, *p = NULL, *py_items = NULL, *level1 = NULL, *level2 = NULL, *level3 = NULL, *collator = NULL;
     int32_t i = 0;
+    // Default to a single thread as the Python wrapper in matcher.py already
+    // shards items over a pool of scorers. 0 means auto-detect CPU cores.
+    int num_threads = 1;
     UErrorCode status = U_ZERO_ERROR;
     UCollator *col = NULL;
 
-    if (!PyArg_ParseTuple(args, "OOOOO", &items, &collator, &level1, &level2, &level3)) return -1;
+    if (!PyArg_ParseTuple(args, "OOOOO|i", &items, &collator, &level1, &level2, &level3, &num_threads)) return -1;
+    self->num_threads = num_threads;
 
     // Clone the passed in collator (cloning is needed as collators are not thread safe)
     if (!PyCapsule_CheckExact(collator)) { PyErr_SetString(PyExc_TypeError, "Collator must be a capsule"); return -1; }
@@ -405,16 +659,30 @@ Matcher_calculate_scores(Matcher *self, PyObject *args) {
     uint32_t i = 0, needle_char_len = 0, j = 0;
     PyObject *items = NULL, *score = NULL, *positions = NULL, *pneedle = NULL;
     UChar *needle = NULL;
+    const uint8_t *skip = NULL;
+    int32_t needle_len = 0;
+    unsigned long long op_start = 0;
 
     if (!PyArg_ParseTuple(args, "O", &pneedle)) return NULL;
 
     needle = python_to_icu(pneedle, NULL);
     if (needle == NULL) return NULL;
     needle_char_len = u_countChar32(needle, -1);
+    needle_len = u_strlen(needle);
+
+    // If the new query extends the previous one, any item that scored zero
+    // before cannot match now either, so it need not be rescored
+    if (self->prev_query != NULL && self->zero_bitmap != NULL && self->prev_query_len > 0 &&
+            self->prev_query_len <= needle_len &&
+            memcmp(self->prev_query, needle, self->prev_query_len * sizeof(UChar)) == 0)
+        skip = self->zero_bitmap;
     items = PyTuple_New(self->item_count);
     positions = PyTuple_New(self->item_count);
-    matches = (Match*)calloc(self->item_count, sizeof(Match));
-    final_positions = (int32_t*) calloc(needle_char_len * self->item_count, sizeof(int32_t));
+    arena_reset(&self->qarena);
+    if (arena_reserve(&self->qarena, self->item_count * sizeof(Match) + (size_t)needle_char_len * self->item_count * sizeof(int32_t) + 2 * ARENA_ALIGN)) {
+        matches = (Match*)arena_carve(&self->qarena, self->item_count * sizeof(Match));
+        final_positions = (int32_t*) arena_carve(&self->qarena, (size_t)needle_char_len * self->item_count * sizeof(int32_t));
+    }
     if (items == NULL || matches == NULL || final_positions == NULL || positions == NULL) {PyErr_NoMemory(); goto end;}
 
     for (i = 0; i < self->item_count; i++) {
@@ -423,9 +691,27 @@ Matcher_calculate_scores(Matcher *self, PyObject *args) {
         PyTuple_SET_ITEM(positions, (Py_ssize_t)i, score);
     }
 
+    op_start = calibre_op_now_ns();
     Py_BEGIN_ALLOW_THREADS;
-    ok = match(self->items, self->item_lengths, self->item_count, needle, matches, final_positions, needle_char_len, self->collator, self->level1, self->level2, self->level3);
+    ok = match(self->items, self->item_lengths, self->item_count, needle, matches, final_positions, needle_char_len, self->collator, self->level1, self->level2, self->level3, self->num_threads, skip, self->arenas);
     Py_END_ALLOW_THREADS;
+    calibre_op_record(&matcher_op_stats[STAT_CALCULATE_SCORES], op_start);
+
+    if (ok && needle_len > 0) {
+        // Remember which items scored zero for this query. A failed
+        // allocation here only loses the cache, not correctness.
+        if (self->zero_bitmap == NULL) self->zero_bitmap = (uint8_t*)calloc(BITMAP_BYTES(self->item_count), 1);
+        if (self->zero_bitmap != NULL) {
+            memset(self->zero_bitmap, 0, BITMAP_BYTES(self->item_count));
+            for (i = 0; i < self->item_count; i++) { if (matches[i].score == 0.0) BITMAP_SET(self->zero_bitmap, i); }
+            nullfree(self->prev_query);
+            self->prev_query = (UChar*)malloc((needle_len + 1) * sizeof(UChar));
+            if (self->prev_query != NULL) {
+                memcpy(self->prev_query, needle, (needle_len + 1) * sizeof(UChar));
+                self->prev_query_len = needle_len;
+            } else self->prev_query_len = 0;
+        }
+    }
 
     if (ok) {
         for (i = 0; i < self->item_count; i++) {
@@ -439,21 +725,148 @@ Matcher_calculate_scores(Matcher *self, PyObject *args) {
                 PyTuple_SET_ITEM(PyTuple_GET_ITEM(positions, (Py_ssize_t)i), (Py_ssize_t)j, score);
             }
         }
-    } else { PyErr_NoMemory(); goto end; }
+    } else { PyErr_SetString(PyExc_RuntimeError, "Failed to score items, most likely out of memory"); goto end; }
 
 end:
     nullfree(needle);
-    nullfree(matches);
-    nullfree(final_positions);
+    // matches and final_positions live in the arena until the next query
     if (PyErr_Occurred()) { Py_XDECREF(items); items = NULL; Py_XDECREF(positions); positions = NULL; return NULL; }
     return Py_BuildValue("NN", items, positions);
 } // }}}
 
+// Matcher.dump/load {{{
+
+// The dump file holds the already normalized UChar item table as one
+// relocatable blob: a magic string, the item count, the item lengths and
+// then all items back to back, each with its null terminator. Loading it is
+// a couple of reads instead of one string conversion per item.
+#define MATCHER_MAGIC "calibre-matcher1"
+#define MATCHER_MAGIC_LEN 16
+
+static PyObject *
+Matcher_dump(Matcher *self, PyObject *args) {
+    const char *path = NULL;
+    FILE *fp = NULL;
+    uint32_t i = 0;
+
+    if (!PyArg_ParseTuple(args, "s", &path)) return NULL;
+    fp = fopen(path, "wb");
+    if (fp == NULL) { PyErr_SetFromErrnoWithFilename(PyExc_OSError, path); return NULL; }
+    if (fwrite(MATCHER_MAGIC, 1, MATCHER_MAGIC_LEN, fp) != MATCHER_MAGIC_LEN) goto werr;
+    if (fwrite(&self->item_count, sizeof(uint32_t), 1, fp) != 1) goto werr;
+    if (self->item_count > 0 && fwrite(self->item_lengths, sizeof(int32_t), self->item_count, fp) != self->item_count) goto werr;
+    for (i = 0; i < self->item_count; i++) {
+        if (fwrite(self->items[i], sizeof(UChar), self->item_lengths[i] + 1, fp) != (size_t)self->item_lengths[i] + 1) goto werr;
+    }
+    if (fclose(fp) != 0) { fp = NULL; goto werr; }
+    Py_RETURN_NONE;
+werr:
+    if (fp != NULL) fclose(fp);
+    PyErr_Format(PyExc_OSError, "Failed to write matcher dump to: %s", path);
+    return NULL;
+}
+
+static PyTypeObject MatcherType;
+
+static PyObject *
+matcher_load(PyObject *module, PyObject *args) {
+    const char *path = NULL;
+    PyObject *level1 = NULL, *level2 = NULL, *level3 = NULL, *collator = NULL;
+    int num_threads = 1;
+    Matcher *self = NULL;
+    FILE *fp = NULL;
+    char magic[MATCHER_MAGIC_LEN] = {0};
+    UErrorCode status = U_ZERO_ERROR;
+    UCollator *col = NULL;
+    size_t total_uchars = 0, pos = 0;
+    uint32_t i = 0;
+
+    if (!PyArg_ParseTuple(args, "sOOOO|i", &path, &collator, &level1, &level2, &level3, &num_threads)) return NULL;
+    if (!PyCapsule_CheckExact(collator)) { PyErr_SetString(PyExc_TypeError, "Collator must be a capsule"); return NULL; }
+    col = (UCollator*)PyCapsule_GetPointer(collator, NULL);
+    if (col == NULL) return NULL;
+
+    self = (Matcher*)MatcherType.tp_alloc(&MatcherType, 0);
+    if (self == NULL) return NULL;
+    self->num_threads = num_threads;
+
+    self->collator = ucol_safeClone(col, NULL, NULL, &status);
+    if (U_FAILURE(status)) { self->collator = NULL; PyErr_SetString(PyExc_ValueError, u_errorName(status)); goto err; }
+    self->level1 = python_to_icu(level1, NULL);
+    self->level2 = python_to_icu(level2, NULL);
+    self->level3 = python_to_icu(level3, NULL);
+    if (self->level1 == NULL || self->level2 == NULL || self->level3 == NULL) goto err;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) { PyErr_SetFromErrnoWithFilename(PyExc_OSError, path); goto err; }
+    if (fread(magic, 1, MATCHER_MAGIC_LEN, fp) != MATCHER_MAGIC_LEN || memcmp(magic, MATCHER_MAGIC, MATCHER_MAGIC_LEN) != 0) goto rerr;
+    if (fread(&self->item_count, sizeof(uint32_t), 1, fp) != 1) goto rerr;
+
+    self->items = (UChar**)calloc(self->item_count + 1, sizeof(UChar*));
+    self->item_lengths = (int32_t*)calloc(self->item_count + 1, sizeof(int32_t));
+    if (self->items == NULL || self->item_lengths == NULL) { PyErr_NoMemory(); goto err; }
+    if (self->item_count > 0 && fread(self->item_lengths, sizeof(int32_t), self->item_count, fp) != self->item_count) goto rerr;
+
+    for (i = 0; i < self->item_count; i++) {
+        if (self->item_lengths[i] < 0) goto rerr;
+        total_uchars += self->item_lengths[i] + 1;
+    }
+    self->items_block = (UChar*)malloc((total_uchars > 0 ? total_uchars : 1) * sizeof(UChar));
+    if (self->items_block == NULL) { PyErr_NoMemory(); goto err; }
+    if (total_uchars > 0 && fread(self->items_block, sizeof(UChar), total_uchars, fp) != total_uchars) goto rerr;
+    for (i = 0; i < self->item_count; i++) {
+        self->items[i] = self->items_block + pos;
+        pos += self->item_lengths[i] + 1;
+        if (self->items_block[pos - 1] != 0) goto rerr;  // Missing null terminator
+    }
+    fclose(fp); fp = NULL;
+
+    return (PyObject*)self;
+rerr:
+    PyErr_Format(PyExc_ValueError, "Not a valid matcher dump: %s", path);
+err:
+    if (fp != NULL) fclose(fp);
+    Py_XDECREF(self);
+    return NULL;
+}
+// }}}
+
 static PyMethodDef Matcher_methods[] = {
     {"calculate_scores", (PyCFunction)Matcher_calculate_scores, METH_VARARGS,
      "calculate_scores(query) -> Return the scores for all items given query as a tuple."
     },
 
+    {"dump", (PyCFunction)Matcher_dump, METH_VARARGS,
+     "dump(path) -> Write the normalized item table to path as a single blob, from which a new Matcher can be created with load() without re-converting every item."
+    },
+
+    {NULL, NULL}  /* Sentinel */
+};
+
+static PyObject *
+matcher_get_stats(PyObject *module, PyObject *args) {
+    return calibre_op_stats_to_dict(matcher_op_stats, STAT_COUNT);
+}
+
+static PyObject *
+matcher_reset_stats(PyObject *module, PyObject *args) {
+    calibre_op_stats_reset(matcher_op_stats, STAT_COUNT);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef matcher_module_methods[] = {
+    {"load", matcher_load, METH_VARARGS,
+     "load(path, collator_capsule, level1, level2, level3, threads=1) -> Create a Matcher from a dump() file. The item table is read as one blob, so startup cost is independent of the number of items."
+    },
+
+    {"get_stats", matcher_get_stats, METH_NOARGS,
+     "get_stats() -> The per-operation native work counters as a dict of name to (calls, total_ns)."
+    },
+
+    {"reset_stats", matcher_reset_stats, METH_NOARGS,
+     "reset_stats() -> Zero the per-operation native work counters."
+    },
+
     {NULL, NULL}  /* Sentinel */
 };
 
@@ -508,7 +921,7 @@ static struct PyModuleDef matcher_module = {
     /* m_name     */ "matcher",
     /* m_doc      */ "Find subsequence matches.",
     /* m_size     */ -1,
-    /* m_methods  */ 0,
+    /* m_methods  */ matcher_module_methods,
     /* m_slots    */ 0,
     /* m_traverse */ 0,
     /* m_clear    */ 0,
@@ -520,7 +933,7 @@ CALIBRE_MODINIT_FUNC PyInit_matcher(void) {
 #else
 #define INITERROR return
 CALIBRE_MODINIT_FUNC initmatcher(void) {
-    PyObject *mod = Py_InitModule3("matcher", NULL, "Find subsequence matches");
+    PyObject *mod = Py_InitModule3("matcher", matcher_module_methods, "Find subsequence matches");
 #endif
 
     if (mod == NULL) INITERROR;
@@ -31,6 +31,16 @@ static PyObject* monotonic(PyObject *self, PyObject *args) {
 	return PyFloat_FromDouble(((double)GetTickCount64())/SEC_TO_MS);
 }
 
+/* For tracing we need sub-millisecond deltas, so QueryPerformanceCounter
+ * is used despite its absolute inaccuracy; only differences between
+ * events matter here. */
+static LARGE_INTEGER trace_frequency = {0};
+static unsigned long long trace_now_ns(void) {
+	LARGE_INTEGER pc;
+	QueryPerformanceCounter(&pc);
+	return (unsigned long long)(((double)pc.QuadPart) * SEC_TO_NS / trace_frequency.QuadPart);
+}
+
 /* QueryPerformanceCounter() is wildly inaccurate, so we use the more stable
  * the lower resolution GetTickCount64() (this is what python 3.x uses)
  * static LARGE_INTEGER frequency = {0}, ts = {0};
@@ -47,6 +57,10 @@ static PyObject* monotonic(PyObject *self, PyObject *args) {
 	return PyFloat_FromDouble(((double)(mach_absolute_time() * timebase.numer) / timebase.denom)/SEC_TO_NS);
 }
 
+static unsigned long long trace_now_ns(void) {
+	return (unsigned long long)(mach_absolute_time() * timebase.numer / timebase.denom);
+}
+
 #else
 #include <time.h>
 static struct timespec ts = {0};
@@ -61,28 +75,151 @@ static PyObject* monotonic(PyObject *self, PyObject *args) {
 	if (clock_gettime(clk_id, &ts) != 0) { PyErr_SetFromErrno(PyExc_OSError); return NULL; }
 	return PyFloat_FromDouble((((double)ts.tv_nsec) / SEC_TO_NS) + (double)ts.tv_sec);
 }
+
+static unsigned long long trace_now_ns(void) {
+	struct timespec tts;
+	if (clock_gettime(clk_id, &tts) != 0) return 0;
+	return ((unsigned long long)tts.tv_sec) * SEC_TO_NS + tts.tv_nsec;
+}
+#endif
+
+/* Lock-free trace ring {{{
+ *
+ * A fixed, process-wide ring of (tag, timestamp) events that native
+ * modules write to without taking any lock (or the GIL), so hot paths
+ * can be instrumented with nanosecond-scale overhead. Other extensions
+ * get at calibre_trace_event() through the "monotonic._C_API" capsule;
+ * see monotonic_trace.h. Python drains the ring on demand.
+ */
+
+#include "monotonic_trace.h"
+
+#define TRACE_RING_SIZE 16384  /* must be a power of two */
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+typedef struct {
+	unsigned int tag;
+	unsigned long long ns;
+} TraceEvent;
+
+static TraceEvent trace_ring[TRACE_RING_SIZE];
+static volatile int trace_enabled = 0;
+#ifdef _MSC_VER
+static volatile LONG64 trace_head = 0;
+#else
+static volatile unsigned long long trace_head = 0;
 #endif
 
+static void calibre_trace_event(unsigned int tag) {
+	unsigned long long slot;
+	if (!trace_enabled) return;
+#ifdef _MSC_VER
+	slot = (unsigned long long)(InterlockedIncrement64(&trace_head) - 1);
+#else
+	slot = __sync_fetch_and_add(&trace_head, 1);
+#endif
+	trace_ring[slot & TRACE_RING_MASK].tag = tag;
+	trace_ring[slot & TRACE_RING_MASK].ns = trace_now_ns();
+}
+
+static CalibreTraceAPI trace_api = { calibre_trace_event };
+
+static PyObject* trace_start(PyObject *self, PyObject *args) {
+	trace_head = 0;
+	trace_enabled = 1;
+	Py_RETURN_NONE;
+}
+
+static PyObject* trace_stop(PyObject *self, PyObject *args) {
+	trace_enabled = 0;
+	Py_RETURN_NONE;
+}
+
+static PyObject* trace_event(PyObject *self, PyObject *args) {
+	unsigned int tag = 0;
+	if (!PyArg_ParseTuple(args, "I", &tag)) return NULL;
+	calibre_trace_event(tag);
+	Py_RETURN_NONE;
+}
+
+static PyObject* trace_drain(PyObject *self, PyObject *args) {
+	unsigned long long head, start, i;
+	PyObject *ans = NULL, *ev = NULL;
+	head = (unsigned long long)trace_head;
+	/* On overflow the ring keeps only the most recent TRACE_RING_SIZE
+	 * events; older ones have been overwritten. Entries may still be
+	 * racing with writers unless tracing is stopped first. */
+	start = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+	ans = PyList_New(0);
+	if (ans == NULL) return NULL;
+	for (i = start; i < head; i++) {
+		ev = Py_BuildValue("IK", trace_ring[i & TRACE_RING_MASK].tag, trace_ring[i & TRACE_RING_MASK].ns);
+		if (ev == NULL || PyList_Append(ans, ev) != 0) { Py_XDECREF(ev); Py_DECREF(ans); return NULL; }
+		Py_DECREF(ev);
+	}
+	return Py_BuildValue("KN", head, ans);
+}
+/* }}} */
+
 static PyMethodDef monotonic_methods[] = {
 	{"monotonic", monotonic, METH_NOARGS,
 		"monotonic()\n\nReturn a monotonically increasing time value."
 	},
 
+	{"trace_start", trace_start, METH_NOARGS,
+		"trace_start()\n\nReset the trace ring and start recording events."
+	},
+
+	{"trace_stop", trace_stop, METH_NOARGS,
+		"trace_stop()\n\nStop recording trace events."
+	},
+
+	{"trace_event", trace_event, METH_VARARGS,
+		"trace_event(tag)\n\nRecord a trace event with the specified integer tag."
+	},
+
+	{"trace_drain", trace_drain, METH_NOARGS,
+		"trace_drain()\n\nReturn (total_events, [(tag, time_ns), ...]) for the most recent events in the ring. Call trace_stop() first for consistent results."
+	},
+
     {NULL, NULL, 0, NULL}
 };
 
-CALIBRE_MODINIT_FUNC
-initmonotonic(void) {
-    PyObject *m;
+#if PY_MAJOR_VERSION >= 3
+#define INITERROR return NULL
+#define INITMODULE PyModule_Create(&monotonic_module)
+static struct PyModuleDef monotonic_module = {
+    /* m_base     */ PyModuleDef_HEAD_INIT,
+    /* m_name     */ "monotonic",
+    /* m_doc      */ "Implementation of time.monotonic() in C for speed",
+    /* m_size     */ -1,
+    /* m_methods  */ monotonic_methods,
+    /* m_slots    */ 0,
+    /* m_traverse */ 0,
+    /* m_clear    */ 0,
+    /* m_free     */ 0,
+};
+CALIBRE_MODINIT_FUNC PyInit_monotonic(void) {
+#else
+#define INITERROR return
+#define INITMODULE Py_InitModule3("monotonic", monotonic_methods, "Implementation of time.monotonic() in C for speed")
+CALIBRE_MODINIT_FUNC initmonotonic(void) {
+#endif
+    PyObject *m, *capsule;
 #ifdef _MSC_VER
 	/* if(!QueryPerformanceFrequency(&frequency)) { PyErr_SetFromWindowsErr(0); return; } */
+	QueryPerformanceFrequency(&trace_frequency);
 #endif
 #ifdef __APPLE__
 	mach_timebase_info(&timebase);
 #endif
-    m = Py_InitModule3("monotonic", monotonic_methods,
-    "Implementation of time.monotonic() in C for speed"
-    );
-    if (m == NULL) return;
+    m = INITMODULE;
+    if (m == NULL) INITERROR;
+
+    capsule = PyCapsule_New(&trace_api, "monotonic._C_API", NULL);
+    if (capsule != NULL) PyModule_AddObject(m, "_C_API", capsule);
+#if PY_MAJOR_VERSION >= 3
+    return m;
+#endif
 }
 
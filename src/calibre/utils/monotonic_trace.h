@@ -0,0 +1,40 @@
+/*
+ * monotonic_trace.h
+ * Copyright (C) 2026 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ *
+ * Lock-free trace events for native hot paths. The monotonic module
+ * owns the process-wide ring buffer and exports its writer through the
+ * "monotonic._C_API" capsule; any other extension can record events by
+ * importing the capsule once at module init and then calling
+ * CALIBRE_TRACE(tag) wherever needed. When the capsule is unavailable
+ * (or tracing is disabled from Python) the macro is a cheap no-op, so
+ * instrumentation can be left in place permanently.
+ */
+
+#pragma once
+
+typedef struct {
+	void (*trace_event)(unsigned int tag);
+} CalibreTraceAPI;
+
+#ifdef CALIBRE_TRACE_CLIENT
+/* Define CALIBRE_TRACE_CLIENT before including this header in modules
+ * that consume the API (the monotonic module itself must not). */
+
+static CalibreTraceAPI *calibre_trace_api = NULL;
+
+/* Call with the GIL held, from the module init function. Failure to
+ * find the capsule is not an error: tracing just stays off. */
+static void
+calibre_trace_init(void) {
+	calibre_trace_api = (CalibreTraceAPI *)PyCapsule_Import("monotonic._C_API", 0);
+	if (calibre_trace_api == NULL) PyErr_Clear();
+}
+
+#define CALIBRE_TRACE(tag) do { \
+	if (calibre_trace_api != NULL) calibre_trace_api->trace_event(tag); \
+} while(0)
+
+#endif /* CALIBRE_TRACE_CLIENT */
@@ -62,6 +62,13 @@ extern void des(unsigned char *, unsigned char *);
  * internal key register) one block of eight bytes at address 'from'
  * into the block at address 'to'.  They can be the same.
  */
+
+extern void desmany(unsigned char *, unsigned char *, unsigned long, unsigned long *);
+/*		    from[8*n]	   to[8*n]	   n	      cookedkey[32]
+ * Encrypts/Decrypts n consecutive blocks of eight bytes with the given
+ * cooked key (as produced by cpkey), without touching the internal key
+ * register. Safe to call without holding any interpreter lock.
+ */
  
 #ifdef D2_DES
  
@@ -151,6 +151,22 @@ unsigned char *inblock, *outblock;
 	return;
 	}
 
+void desmany(inblocks, outblocks, nblocks, cookedkey)
+unsigned char *inblocks, *outblocks;
+unsigned long nblocks;
+unsigned long *cookedkey;
+{
+	unsigned long work[2];
+
+	while( nblocks-- ) {
+		scrunch(inblocks, work);
+		desfunc(work, cookedkey);
+		unscrun(work, outblocks);
+		inblocks += 8, outblocks += 8;
+		}
+	return;
+	}
+
 
 static void scrunch(outof, into)
 unsigned char *outof;
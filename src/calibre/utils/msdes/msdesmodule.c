@@ -5,6 +5,7 @@
  */
 
 
+#define PY_SSIZE_T_CLEAN
 #include <Python.h>
 
 #include <d3des.h>
@@ -17,7 +18,7 @@ static PyObject *
 msdes_deskey(PyObject *self, PyObject *args)
 {
     unsigned char *key = NULL;
-    unsigned int len = 0;
+    Py_ssize_t len = 0;
     short int edf = 0;
 
 #if PY_MAJOR_VERSION >= 3
@@ -48,8 +49,8 @@ msdes_des(PyObject *self, PyObject *args)
 {
     unsigned char *inbuf = NULL;
     unsigned char *outbuf = NULL;
-    unsigned int len = 0;
-    unsigned int off = 0;
+    Py_ssize_t len = 0;
+    Py_ssize_t off = 0;
     PyObject *retval = NULL;
 
 #if PY_MAJOR_VERSION >= 3
@@ -79,6 +80,137 @@ msdes_des(PyObject *self, PyObject *args)
     return retval;
 }
 
+/* Key object: expands the key once at construction, so that repeated
+ * en/decryption calls skip the key schedule and do not depend on the
+ * module-global key register. */
+
+typedef struct {
+    PyObject_HEAD
+    unsigned long cooked[32];
+} Key;
+
+static PyObject *
+Key_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    Key *self;
+    unsigned char *key = NULL;
+    Py_ssize_t len = 0;
+    short int edf = 0;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTuple(args, "y#h", &key, &len, &edf)) {
+#else
+    if (!PyArg_ParseTuple(args, "s#h", &key, &len, &edf)) {
+#endif
+        return NULL;
+    }
+
+    if (len != 8) {
+        PyErr_SetString(MsDesError, "Key length incorrect");
+        return NULL;
+    }
+
+    if ((edf != EN0) && (edf != DE1)) {
+        PyErr_SetString(MsDesError, "En/decryption direction invalid");
+        return NULL;
+    }
+
+    self = (Key *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        return NULL;
+    }
+
+    /* deskey() cooks into the module-global key register, so like a
+     * deskey() call this clobbers it; copy the schedule out for our own
+     * use. */
+    deskey(key, edf);
+    cpkey(self->cooked);
+
+    return (PyObject *)self;
+}
+
+static PyObject *
+Key_des(Key *self, PyObject *args)
+{
+    unsigned char *inbuf = NULL;
+    unsigned char *outbuf = NULL;
+    Py_ssize_t len = 0;
+    PyObject *retval = NULL;
+
+#if PY_MAJOR_VERSION >= 3
+    if (!PyArg_ParseTuple(args, "y#", &inbuf, &len)) {
+#else
+    if (!PyArg_ParseTuple(args, "s#", &inbuf, &len)) {
+#endif
+        return NULL;
+    }
+
+    if ((len == 0) || ((len % 8) != 0)) {
+        PyErr_SetString(MsDesError,
+            "Input length not a multiple of the block size");
+        return NULL;
+    }
+
+    retval = PyBytes_FromStringAndSize(NULL, len);
+    if (retval == NULL) {
+        return NULL;
+    }
+    outbuf = (unsigned char *)PyBytes_AS_STRING(retval);
+
+    Py_BEGIN_ALLOW_THREADS;
+    desmany(inbuf, outbuf, (unsigned long)(len / 8), self->cooked);
+    Py_END_ALLOW_THREADS;
+
+    return retval;
+}
+
+static PyMethodDef Key_methods[] = {
+    { "des", (PyCFunction)&Key_des, METH_VARARGS,
+      "Perform DES en/decryption of a whole buffer with this key, releasing the GIL while the blocks are processed." },
+    { NULL, NULL }
+};
+
+static PyTypeObject KeyType = { /* {{{ */
+    PyVarObject_HEAD_INIT(NULL, 0)
+    /* tp_name           */ "msdes.Key",
+    /* tp_basicsize      */ sizeof(Key),
+    /* tp_itemsize       */ 0,
+    /* tp_dealloc        */ 0,
+    /* tp_print          */ 0,
+    /* tp_getattr        */ 0,
+    /* tp_setattr        */ 0,
+    /* tp_compare        */ 0,
+    /* tp_repr           */ 0,
+    /* tp_as_number      */ 0,
+    /* tp_as_sequence    */ 0,
+    /* tp_as_mapping     */ 0,
+    /* tp_hash           */ 0,
+    /* tp_call           */ 0,
+    /* tp_str            */ 0,
+    /* tp_getattro       */ 0,
+    /* tp_setattro       */ 0,
+    /* tp_as_buffer      */ 0,
+    /* tp_flags          */ Py_TPFLAGS_DEFAULT,
+    /* tp_doc            */ "Key(key, mode) -> A DES key expanded once for repeated use. Note that construction clobbers the module-global key register, just like deskey().",
+    /* tp_traverse       */ 0,
+    /* tp_clear          */ 0,
+    /* tp_richcompare    */ 0,
+    /* tp_weaklistoffset */ 0,
+    /* tp_iter           */ 0,
+    /* tp_iternext       */ 0,
+    /* tp_methods        */ Key_methods,
+    /* tp_members        */ 0,
+    /* tp_getset         */ 0,
+    /* tp_base           */ 0,
+    /* tp_dict           */ 0,
+    /* tp_descr_get      */ 0,
+    /* tp_descr_set      */ 0,
+    /* tp_dictoffset     */ 0,
+    /* tp_init           */ 0,
+    /* tp_alloc          */ 0,
+    /* tp_new            */ Key_new,
+}; /* }}} */
+
 static PyMethodDef msdes_methods[] = {
     { "deskey", &msdes_deskey, METH_VARARGS, "Provide a new key for DES en/decryption." },
     { "des", &msdes_des, METH_VARARGS, "Perform DES en/decryption." },
@@ -108,11 +240,18 @@ CALIBRE_MODINIT_FUNC initmsdes(void) {
 
     PyObject *m;
 
+    if (PyType_Ready(&KeyType) < 0) {
+        INITERROR;
+    }
+
     m = INITMODULE;
     if (m == NULL) {
         INITERROR;
     }
 
+    Py_INCREF(&KeyType);
+    PyModule_AddObject(m, "Key", (PyObject *)&KeyType);
+
     MsDesError = PyErr_NewException("msdes.MsDesError", NULL, NULL);
     Py_INCREF(MsDesError);
     PyModule_AddObject(m, "MsDesError", MsDesError);
@@ -0,0 +1,113 @@
+/*
+ * op_stats.h
+ * Copyright (C) 2026 Kovid Goyal <kovid at kovidgoyal.net>
+ *
+ * Distributed under terms of the GPL3 license.
+ *
+ * Lock-free per-operation counters for native modules: number of calls
+ * and cumulative wall clock nanoseconds, updated with atomic adds so
+ * they can be bumped without the GIL and from worker threads. Each
+ * module keeps its own static CalibreOpStat array and exposes it to
+ * Python through get_stats()/reset_stats() built on the helpers below,
+ * so that native-layer work can be correlated with request latency in
+ * the content server.
+ *
+ * Typical use around a hot section:
+ *
+ *   unsigned long long op_start = calibre_op_now_ns();
+ *   ... the work ...
+ *   calibre_op_record(&stats[OP_FOO], op_start);
+ *
+ * C++ callers can instead put CalibreOpTimer timer(&stats[OP_FOO]); on
+ * the stack, which records on scope exit, exceptions included.
+ */
+
+#pragma once
+
+#include <Python.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef _MSC_VER
+#define CALIBRE_OP_UNUSED
+#else
+#define CALIBRE_OP_UNUSED __attribute__((unused))
+#endif
+
+typedef struct {
+    const char *name;
+    volatile unsigned long long calls, total_ns;
+} CalibreOpStat;
+
+static CALIBRE_OP_UNUSED unsigned long long
+calibre_op_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = {{0, 0}};
+    LARGE_INTEGER counts;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counts);
+    return (unsigned long long)((counts.QuadPart * 1000000000ULL) / frequency.QuadPart);
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase = {0, 0};
+    if (timebase.denom == 0) mach_timebase_info(&timebase);
+    return (mach_absolute_time() * timebase.numer) / timebase.denom;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static CALIBRE_OP_UNUSED void
+calibre_op_record(CalibreOpStat *stat, unsigned long long start_ns) {
+    unsigned long long dur = calibre_op_now_ns() - start_ns;
+#ifdef _MSC_VER
+    InterlockedIncrement64((volatile LONG64*)&stat->calls);
+    InterlockedExchangeAdd64((volatile LONG64*)&stat->total_ns, (LONG64)dur);
+#else
+    __sync_fetch_and_add(&stat->calls, 1);
+    __sync_fetch_and_add(&stat->total_ns, dur);
+#endif
+}
+
+/* A dict of operation name -> (calls, total_ns). Call with the GIL
+ * held. Reads are not atomic with respect to concurrent updates, which
+ * is fine for monitoring. */
+static CALIBRE_OP_UNUSED PyObject*
+calibre_op_stats_to_dict(CalibreOpStat *stats, size_t count) {
+    PyObject *ans, *val;
+    size_t i;
+
+    ans = PyDict_New();
+    if (ans == NULL) return NULL;
+    for (i = 0; i < count; i++) {
+        val = Py_BuildValue("KK", stats[i].calls, stats[i].total_ns);
+        if (val == NULL || PyDict_SetItemString(ans, stats[i].name, val) != 0) {
+            Py_XDECREF(val); Py_DECREF(ans);
+            return NULL;
+        }
+        Py_DECREF(val);
+    }
+    return ans;
+}
+
+static CALIBRE_OP_UNUSED void
+calibre_op_stats_reset(CalibreOpStat *stats, size_t count) {
+    size_t i;
+    for (i = 0; i < count; i++) { stats[i].calls = 0; stats[i].total_ns = 0; }
+}
+
+#ifdef __cplusplus
+struct CalibreOpTimer {
+    CalibreOpStat *stat;
+    unsigned long long start_ns;
+    CalibreOpTimer(CalibreOpStat *s) : stat(s), start_ns(calibre_op_now_ns()) {}
+    ~CalibreOpTimer() { calibre_op_record(stat, start_ns); }
+};
+#endif
@@ -57,7 +57,7 @@ def set_metadata_(tdir, title, authors, bkp, tags, xmp_packet):
     podofo = get_podofo()
     os.chdir(tdir)
     p = podofo.PDFDoc()
-    p.open('input.pdf')
+    p.open('input.pdf', True)
     title = prep(title)
     touched = False
     if title and title != p.title:
@@ -93,7 +93,14 @@ def set_metadata_(tdir, title, authors, bkp, tags, xmp_packet):
         pass
 
     if touched:
-        p.save('output.pdf')
+        try:
+            # Append only the changed objects to a copy of the original,
+            # instead of rewriting the entire PDF
+            shutil.copyfile('input.pdf', 'output.pdf')
+            p.save('output.pdf', True)
+        except Exception:
+            # PoDoFo without incremental update support
+            p.save('output.pdf')
 
     return touched
 
@@ -103,6 +110,9 @@ def delete_all_but(path, pages):
     numbers are counted from the end of the PDF. '''
     podofo = get_podofo()
     p = podofo.PDFDoc()
+    # Cannot use open() here as the document is written back to the same
+    # path, which would truncate the file lazily loaded objects are still
+    # read from
     with open(path, 'rb') as f:
         raw = f.read()
     p.load(raw)
@@ -119,18 +129,16 @@ def delete_all_but(path, pages):
 def get_xmp_metadata(path):
     podofo = get_podofo()
     p = podofo.PDFDoc()
-    with open(path, 'rb') as f:
-        raw = f.read()
-    p.load(raw)
+    # open() parses only the xref and trailer, loading objects lazily, so
+    # this does not pay for the full object tree of large documents
+    p.open(path)
     return p.get_xmp_metadata()
 
 
 def get_image_count(path):
     podofo = get_podofo()
     p = podofo.PDFDoc()
-    with open(path, 'rb') as f:
-        raw = f.read()
-    p.load(raw)
+    p.open(path)
     return p.image_count()
 
 
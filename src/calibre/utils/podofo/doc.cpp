@@ -7,6 +7,8 @@
 
 #include "global.h"
 
+#include <vector>
+
 using namespace pdf;
 
 // Constructor/desctructor {{{
@@ -62,15 +64,22 @@ PDFDoc_load(PDFDoc *self, PyObject *args) {
 static PyObject *
 PDFDoc_open(PDFDoc *self, PyObject *args) {
     char *fname;
+    int for_update = 0;
 #ifdef _WIN32
 #define ENCODING "mbcs"
 #else
 #define ENCODING "utf-8"
 #endif
-    if (!PyArg_ParseTuple(args, "es", ENCODING, &fname)) return NULL;
+    if (!PyArg_ParseTuple(args, "es|i", ENCODING, &fname, &for_update)) return NULL;
 #undef ENCODING
 	try {
+#if PODOFO_VERSION >= 0x000905
+		// Loading for update records the information needed to later
+		// append an incremental update instead of rewriting the file
+		self->doc->Load(fname, for_update != 0);
+#else
 		self->doc->Load(fname);
+#endif
 	} catch(const PdfError & err) {
 		podofo_set_exception(err);
 		PyMem_Free(fname);
@@ -86,10 +95,26 @@ PDFDoc_open(PDFDoc *self, PyObject *args) {
 static PyObject *
 PDFDoc_save(PDFDoc *self, PyObject *args) {
     char *buffer;
+    int incremental = 0, use_xref_stream = 0;
 
-    if (PyArg_ParseTuple(args, "s", &buffer)) {
+    if (PyArg_ParseTuple(args, "s|ii", &buffer, &incremental, &use_xref_stream)) {
         try {
-            self->doc->Write(buffer);
+            if (incremental) {
+#if PODOFO_VERSION >= 0x000905
+                // Appends an xref section with just the changed objects to
+                // the file at path, which must already contain the document
+                // as it was loaded (the document must have been opened with
+                // for_update set)
+                self->doc->WriteUpdate(buffer);
+#else
+                PyErr_SetString(PyExc_NotImplementedError,
+                        "This version of PoDoFo does not support incremental updates");
+                return NULL;
+#endif
+            } else {
+                PdfOutputDevice device(buffer);
+                write_doc_to_device(self->doc, &device, use_xref_stream != 0);
+            }
         } catch(const PdfError & err) {
             podofo_set_exception(err);
             return NULL;
@@ -101,30 +126,19 @@ PDFDoc_save(PDFDoc *self, PyObject *args) {
 
 static PyObject *
 PDFDoc_write(PDFDoc *self, PyObject *args) {
-    PyObject *ans;
-
-    try {
-        PdfRefCountedBuffer buffer(1*1024*1024);
-        PdfOutputDevice out(&buffer);
-        self->doc->Write(&out);
-        ans = PyBytes_FromStringAndSize(buffer.GetBuffer(), out.Tell());
-        if (ans == NULL) PyErr_NoMemory();
-    } catch(const PdfError &err) {
-        podofo_set_exception(err);
-        return NULL;
-    } catch (...) {
-        return PyErr_NoMemory();
-    }
+    int use_xref_stream = 0;
 
-    return ans;
+    if (!PyArg_ParseTuple(args, "|i", &use_xref_stream)) return NULL;
+    return write_doc_mem(self->doc, use_xref_stream != 0);
 }
 
 static PyObject *
 PDFDoc_save_to_fileobj(PDFDoc *self, PyObject *args) {
     PyObject *f;
+    int use_xref_stream = 0;
 
-    if (!PyArg_ParseTuple(args, "O", &f)) return NULL;
-    return write_doc(self->doc, f);
+    if (!PyArg_ParseTuple(args, "O|i", &f, &use_xref_stream)) return NULL;
+    return write_doc(self->doc, f, use_xref_stream != 0);
 }
 
 // }}}
@@ -242,6 +256,158 @@ PDFDoc_set_box(PDFDoc *self, PyObject *args) {
     Py_RETURN_NONE;
 } // }}}
 
+// get_page_info_many() {{{
+
+// One parsed range from the /PageLabels number tree (PDF 32000, 12.4.2)
+struct page_label_range {
+    int start_index;
+    char style;  // 'D', 'R', 'r', 'A', 'a' or 0 for prefix only labels
+    long long start;
+    std::string prefix;
+};
+
+struct page_info_record {
+    double media[4], crop[4];
+    long rotation;
+    bool has_label;
+    std::string label;
+};
+
+static const PdfObject*
+resolve_object(PdfMemDocument *doc, const PdfObject *o) {
+    if (o != NULL && o->IsReference()) o = doc->GetObjects().GetObject(o->GetReference());
+    return o;
+}
+
+static std::string
+format_roman(long long num, bool lowercase) {
+    static const long long values[] = {1000, 900, 500, 400, 100, 90, 50, 40, 10, 9, 5, 4, 1};
+    static const char *symbols[] = {"M", "CM", "D", "CD", "C", "XC", "L", "XL", "X", "IX", "V", "IV", "I"};
+    std::string ans;
+    if (num <= 0) return ans;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        while (num >= values[i]) { ans += symbols[i]; num -= values[i]; }
+    }
+    if (lowercase) for (size_t i = 0; i < ans.size(); i++) ans[i] += 'a' - 'A';
+    return ans;
+}
+
+static std::string
+format_letters(long long num, bool lowercase) {
+    // A..Z, AA..ZZ, AAA and so on
+    std::string ans;
+    if (num <= 0) return ans;
+    ans.assign(static_cast<size_t>((num - 1) / 26 + 1), static_cast<char>((lowercase ? 'a' : 'A') + (num - 1) % 26));
+    return ans;
+}
+
+static std::string
+format_page_label(const page_label_range &r, int page_index) {
+    std::string ans = r.prefix;
+    long long num = r.start + (page_index - r.start_index);
+    switch (r.style) {
+        case 'D': { std::stringstream s; s << num; ans += s.str(); break; }
+        case 'R': ans += format_roman(num, false); break;
+        case 'r': ans += format_roman(num, true); break;
+        case 'A': ans += format_letters(num, false); break;
+        case 'a': ans += format_letters(num, true); break;
+        default: break;
+    }
+    return ans;
+}
+
+static void
+collect_page_label_ranges(PdfMemDocument *doc, const PdfObject *node, std::vector<page_label_range> &ranges, int depth) {
+    if (node == NULL || !node->IsDictionary() || depth > 32) return;  // depth guard against cyclic trees
+    const PdfObject *kids = resolve_object(doc, node->GetDictionary().GetKey("Kids"));
+    if (kids != NULL && kids->IsArray()) {
+        const PdfArray &a = kids->GetArray();
+        for (size_t i = 0; i < a.size(); i++) collect_page_label_ranges(doc, resolve_object(doc, &a[i]), ranges, depth + 1);
+        return;
+    }
+    const PdfObject *nums = resolve_object(doc, node->GetDictionary().GetKey("Nums"));
+    if (nums == NULL || !nums->IsArray()) return;
+    const PdfArray &a = nums->GetArray();
+    for (size_t i = 0; i + 1 < a.size(); i += 2) {
+        const PdfObject *key = resolve_object(doc, &a[i]), *val = resolve_object(doc, &a[i + 1]);
+        if (key == NULL || !key->IsNumber() || val == NULL || !val->IsDictionary()) continue;
+        page_label_range r;
+        r.start_index = static_cast<int>(key->GetNumber()); r.style = 0; r.start = 1;
+        const PdfObject *o = resolve_object(doc, val->GetDictionary().GetKey("S"));
+        if (o != NULL && o->IsName() && !o->GetName().GetName().empty()) r.style = o->GetName().GetName()[0];
+        o = resolve_object(doc, val->GetDictionary().GetKey("St"));
+        if (o != NULL && o->IsNumber()) r.start = o->GetNumber();
+        o = resolve_object(doc, val->GetDictionary().GetKey("P"));
+        if (o != NULL && o->IsString()) r.prefix = o->GetString().GetStringUtf8();
+        ranges.push_back(r);
+    }
+}
+
+static PyObject *
+PDFDoc_get_page_info_many(PDFDoc *self, PyObject *args) {
+    int first = 0, count = -1, total, i;
+    bool ok = true;
+    PdfError saved_err;
+
+    if (!PyArg_ParseTuple(args, "|ii", &first, &count)) return NULL;
+    try {
+        total = self->doc->GetPageCount();
+    } catch(const PdfError & err) {
+        podofo_set_exception(err);
+        return NULL;
+    }
+    if (first < 0 || first > total) { PyErr_Format(PyExc_ValueError, "Invalid first page number: %d", first); return NULL; }
+    if (count < 0 || first + count > total) count = total - first;
+
+    std::vector<page_info_record> records(count);
+    std::vector<page_label_range> ranges;
+
+    // The page tree and the /PageLabels number tree are walked once with the
+    // GIL released, instead of crossing the binding for every page. The walk
+    // stays on one thread, as PoDoFo materializes objects lazily into shared
+    // document state on first access.
+    Py_BEGIN_ALLOW_THREADS;
+    try {
+        const PdfObject *catalog = self->doc->GetCatalog();
+        if (catalog != NULL) collect_page_label_ranges(self->doc, resolve_object(self->doc, catalog->GetDictionary().GetKey("PageLabels")), ranges, 0);
+        for (i = 0; i < count; i++) {
+            PdfPage *page = self->doc->GetPage(first + i);
+            if (page == NULL) continue;
+            page_info_record &rec = records[i];
+            const PdfRect mb = page->GetMediaBox(), cb = page->GetCropBox();
+            rec.media[0] = mb.GetLeft(); rec.media[1] = mb.GetBottom(); rec.media[2] = mb.GetWidth(); rec.media[3] = mb.GetHeight();
+            rec.crop[0] = cb.GetLeft(); rec.crop[1] = cb.GetBottom(); rec.crop[2] = cb.GetWidth(); rec.crop[3] = cb.GetHeight();
+            rec.rotation = page->GetRotation();
+            // The last range starting at or before the page applies to it
+            const page_label_range *best = NULL;
+            for (size_t j = 0; j < ranges.size(); j++) {
+                if (ranges[j].start_index <= first + i && (best == NULL || ranges[j].start_index >= best->start_index)) best = &ranges[j];
+            }
+            if (best != NULL) { rec.has_label = true; rec.label = format_page_label(*best, first + i); }
+        }
+    } catch (const PdfError &err) { saved_err = err; ok = false; }
+    Py_END_ALLOW_THREADS;
+    if (!ok) { podofo_set_exception(saved_err); return NULL; }
+
+    PyObject *ans = PyList_New(count);
+    if (ans == NULL) return NULL;
+    for (i = 0; i < count; i++) {
+        const page_info_record &rec = records[i];
+        PyObject *label;
+        if (rec.has_label) {
+            label = PyUnicode_FromStringAndSize(rec.label.data(), static_cast<Py_ssize_t>(rec.label.size()));
+        } else { label = Py_None; Py_INCREF(label); }
+        if (label == NULL) { Py_DECREF(ans); return NULL; }
+        PyObject *entry = Py_BuildValue("(dddd)(dddd)lN",
+                rec.media[0], rec.media[1], rec.media[2], rec.media[3],
+                rec.crop[0], rec.crop[1], rec.crop[2], rec.crop[3],
+                rec.rotation, label);
+        if (entry == NULL) { Py_DECREF(ans); return NULL; }
+        PyList_SET_ITEM(ans, i, entry);
+    }
+    return ans;
+} // }}}
+
 // create_outline() {{{
 static PyObject *
 PDFDoc_create_outline(PDFDoc *self, PyObject *args) {
@@ -280,6 +446,105 @@ error:
 
 } // }}}
 
+// create_outline_tree() {{{
+static bool
+add_outline_children(PdfOutlineItem *parent, PyObject *items, const std::vector<PdfPage*> &pages) {
+    PdfOutlineItem *item, *prev = NULL;
+    PyObject *entry, *ptitle, *children;
+    Py_ssize_t i, len;
+    int pagenum;
+
+    len = PySequence_Size(items);
+    if (len < 0) return false;
+    for (i = 0; i < len; i++) {
+        entry = PySequence_GetItem(items, i);
+        if (entry == NULL) return false;
+        children = NULL;
+        if (!PyArg_ParseTuple(entry, "Ui|O", &ptitle, &pagenum, &children)) { Py_DECREF(entry); return false; }
+        if (pagenum < 0 || static_cast<size_t>(pagenum) >= pages.size()) {
+            PyErr_Format(PyExc_ValueError, "Invalid page number: %d", pagenum);
+            Py_DECREF(entry); return false;
+        }
+        const PdfString title = podofo_convert_pystring(ptitle);
+        PdfDestination dest(pages[pagenum]);
+        item = (prev == NULL) ? parent->CreateChild(title, dest) : prev->CreateNext(title, dest);
+        if (item == NULL) { PyErr_NoMemory(); Py_DECREF(entry); return false; }
+        if (children != NULL && children != Py_None) {
+            if (!add_outline_children(item, children, pages)) { Py_DECREF(entry); return false; }
+        }
+        prev = item;
+        Py_DECREF(entry);
+    }
+    return true;
+}
+
+static PyObject *
+PDFDoc_create_outline_tree(PDFDoc *self, PyObject *args) {
+    PyObject *items, *entry = NULL, *ptitle, *children;
+    PDFOutlineItem *ans;
+    PdfOutlineItem *item, *prev = NULL;
+    Py_ssize_t i, len;
+    int pagenum;
+
+    if (!PyArg_ParseTuple(args, "O", &items)) return NULL;
+
+    ans = PyObject_New(PDFOutlineItem, &PDFOutlineItemType);
+    if (ans == NULL) goto error;
+    ans->item = NULL; ans->doc = self->doc;
+
+    try {
+        len = PySequence_Size(items);
+        if (len < 0) goto error;
+        if (len == 0) { PyErr_SetString(PyExc_ValueError, "Cannot create an outline from an empty list"); goto error; }
+        // Resolve every page object once, instead of once per outline entry
+        std::vector<PdfPage*> pages(self->doc->GetPageCount());
+        for (i = 0; i < static_cast<Py_ssize_t>(pages.size()); i++) pages[i] = self->doc->GetPage(static_cast<int>(i));
+        PdfOutlines *outlines = self->doc->GetOutlines();
+        if (outlines == NULL) {PyErr_NoMemory(); goto error;}
+        for (i = 0; i < len; i++) {
+            entry = PySequence_GetItem(items, i);
+            if (entry == NULL) goto error;
+            children = NULL;
+            if (!PyArg_ParseTuple(entry, "Ui|O", &ptitle, &pagenum, &children)) goto error;
+            if (pagenum < 0 || static_cast<size_t>(pagenum) >= pages.size()) {
+                PyErr_Format(PyExc_ValueError, "Invalid page number: %d", pagenum);
+                goto error;
+            }
+            const PdfString title = podofo_convert_pystring(ptitle);
+            PdfDestination dest(pages[pagenum]);
+            if (prev == NULL) {
+                item = outlines->CreateRoot(title);
+                if (item == NULL) { PyErr_NoMemory(); goto error; }
+                item->SetDestination(dest);
+                ans->item = item;
+            } else {
+                item = prev->CreateNext(title, dest);
+                if (item == NULL) { PyErr_NoMemory(); goto error; }
+            }
+            if (children != NULL && children != Py_None) {
+                if (!add_outline_children(item, children, pages)) goto error;
+            }
+            prev = item;
+            Py_CLEAR(entry);
+        }
+    } catch(const PdfError & err) {
+        podofo_set_exception(err); goto error;
+    } catch(const std::exception & err) {
+        PyErr_Format(PyExc_ValueError, "An error occurred while trying to create the outline: %s", err.what());
+        goto error;
+    } catch (...) {
+        PyErr_SetString(PyExc_ValueError, "An unknown error occurred while trying to create the outline");
+        goto error;
+    }
+
+    return (PyObject*)ans;
+error:
+    Py_XDECREF(entry);
+    Py_XDECREF(ans);
+    return NULL;
+
+} // }}}
+
 // get_xmp_metadata() {{{
 static PyObject *
 PDFDoc_get_xmp_metadata(PDFDoc *self, PyObject *args) {
@@ -550,16 +815,24 @@ static PyMethodDef PDFDoc_methods[] = {
      "Load a PDF document from a byte buffer (string)"
     },
     {"open", (PyCFunction)PDFDoc_open, METH_VARARGS,
-     "Load a PDF document from a file path (string)"
+     "open(path, for_update=False) -> Load a PDF document from a file path (string). "
+     "Set for_update to be able to save incrementally later. "
+     "Only the xref and trailer are parsed up front, objects are materialized on "
+     "first access, so prefer this over load() when inspecting large documents."
     },
     {"save", (PyCFunction)PDFDoc_save, METH_VARARGS,
-     "Save the PDF document to a path on disk"
+     "save(path, incremental=False, use_xref_stream=False) -> Save the PDF document to a path on disk. "
+     "An incremental save appends only the changed objects to the file at path, "
+     "which must already contain the document as it was loaded. "
+     "With use_xref_stream the cross reference is written as a compressed stream and objects are "
+     "serialized without cosmetic whitespace, producing a smaller PDF 1.5 file that is faster to "
+     "parse; ignored for incremental saves, which reuse the format of the existing file."
     },
     {"write", (PyCFunction)PDFDoc_write, METH_VARARGS,
-     "Return the PDF document as a bytestring."
+     "write(use_xref_stream=False) -> Return the PDF document as a releasable memoryview over its serialized bytes."
     },
     {"save_to_fileobj", (PyCFunction)PDFDoc_save_to_fileobj, METH_VARARGS,
-     "Write the PDF document to the soecified file-like object."
+     "save_to_fileobj(f, use_xref_stream=False) -> Write the PDF document to the specified file-like object."
     },
     {"extract_first_page", (PyCFunction)PDFDoc_extract_first_page, METH_VARARGS,
      "extract_first_page() -> Remove all but the first page."
@@ -579,9 +852,22 @@ static PyMethodDef PDFDoc_methods[] = {
     {"set_box", (PyCFunction)PDFDoc_set_box, METH_VARARGS,
      "set_box(page_num, box, left, bottom, width, height) -> Set the PDF bounding box for the page numbered nu, box must be one of: MediaBox, CropBox, TrimBox, BleedBox, ArtBox. The numbers are interpreted as pts."
     },
+    {"get_page_info_many", (PyCFunction)PDFDoc_get_page_info_many, METH_VARARGS,
+     "get_page_info_many(first=0, count=-1) -> Return a list with an entry for each of count pages "
+     "starting at first (all remaining pages if count is negative): a tuple of "
+     "((media box), (crop box), rotation, label), the boxes as (left, bottom, width, height) in pts "
+     "and label the page label from the /PageLabels tree, or None if the document defines none. "
+     "The whole page tree is walked once in C++ with the GIL released, instead of crossing the "
+     "binding per page."
+    },
     {"create_outline", (PyCFunction)PDFDoc_create_outline, METH_VARARGS,
      "create_outline(title, pagenum) -> Create an outline, return the first outline item."
     },
+    {"create_outline_tree", (PyCFunction)PDFDoc_create_outline_tree, METH_VARARGS,
+     "create_outline_tree(items) -> Create the entire outline in one call. items is a list of "
+     "(title, pagenum) or (title, pagenum, children) tuples, where children is a list of the same "
+     "shape. The first top level item becomes the root of the outline, which is returned."
+    },
     {"get_xmp_metadata", (PyCFunction)PDFDoc_get_xmp_metadata, METH_VARARGS,
      "get_xmp_metadata(raw) -> Get the XMP metadata as raw bytes"
     },
@@ -40,5 +40,7 @@ extern PyObject *Error;
 void podofo_set_exception(const PdfError &err);
 PyObject * podofo_convert_pdfstring(const PdfString &s);
 const PdfString podofo_convert_pystring(PyObject *py);
-PyObject* write_doc(PdfMemDocument *doc, PyObject *f);
+void write_doc_to_device(PdfMemDocument *doc, PdfOutputDevice *device, bool use_xref_stream);
+PyObject* write_doc(PdfMemDocument *doc, PyObject *f, bool use_xref_stream);
+PyObject* write_doc_mem(PdfMemDocument *doc, bool use_xref_stream);
 }
@@ -11,40 +11,18 @@ using namespace PoDoFo;
 
 #define NUKE(x) { Py_XDECREF(x); x = NULL; }
 
+// Serialized output is accumulated here before being handed to Python, so
+// the many small writes PoDoFo makes do not each become a Python call
+#define WRITE_BUFFER_SIZE (1024*1024)
+
 class pyerr : public std::exception {
 };
 
-class OutputDevice : public PdfOutputDevice {
-
-    private:
-        PyObject *tell_func;
-        PyObject *seek_func;
-        PyObject *read_func;
-        PyObject *write_func;
-        PyObject *flush_func;
-        size_t written;
-
-        void update_written() {
-            size_t pos;
-            pos = Tell();
-            if (pos > written) written = pos;
-        }
+// Common formatted printing on top of the virtual Write() of the devices
+// below, the base class implementation only works with its own internals
+class DeviceBase : public PdfOutputDevice {
 
     public:
-        OutputDevice(PyObject *file) : tell_func(0), seek_func(0), read_func(0), write_func(0), flush_func(0), written(0) {
-#define GA(f, a) { if((f = PyObject_GetAttrString(file, a)) == NULL) throw pyerr(); }
-            GA(tell_func, "tell");
-            GA(seek_func, "seek");
-            GA(read_func, "read");
-            GA(write_func, "write");
-            GA(flush_func, "flush");
-        }
-        ~OutputDevice() {
-            NUKE(tell_func); NUKE(seek_func); NUKE(read_func); NUKE(write_func); NUKE(flush_func);
-        }
-
-        size_t GetLength() const { return written; }
-
         long PrintVLen(const char* pszFormat, va_list args) {
 
             if( !pszFormat ) { PODOFO_RAISE_ERROR( ePdfError_InvalidHandle ); }
@@ -91,12 +69,91 @@ class OutputDevice : public PdfOutputDevice {
             PrintV(pszFormat, lBytes, args);
             va_end( args );
         }
+};
+
+class OutputDevice : public DeviceBase {
+
+    private:
+        PyObject *tell_func;
+        PyObject *seek_func;
+        PyObject *read_func;
+        PyObject *write_func;
+        PyObject *flush_func;
+        size_t written;
+        char *wbuf;
+        size_t wbuf_used;
+
+        void update_written() {
+            size_t pos;
+            pos = Tell();
+            if (pos > written) written = pos;
+        }
+
+        // Hand the memory to the file object wrapped in a memoryview, so
+        // no intermediate copy of the data is made. The view is released
+        // afterwards so a write() that stashes it cannot watch the buffer
+        // being reused.
+        void write_to_python(const char *pBuffer, size_t lLen) {
+            PyObject *ret, *temp = NULL;
+
+#if PY_MAJOR_VERSION >= 3
+            temp = PyMemoryView_FromMemory((char *)pBuffer, static_cast<Py_ssize_t>(lLen), PyBUF_READ);
+#else
+            Py_buffer view;
+            if (PyBuffer_FillInfo(&view, NULL, (void *)pBuffer, static_cast<Py_ssize_t>(lLen), 1, PyBUF_SIMPLE) != 0) throw pyerr();
+            temp = PyMemoryView_FromBuffer(&view);
+#endif
+            if (temp == NULL) throw pyerr();
+
+            ret = PyObject_CallFunctionObjArgs(write_func, temp, NULL);
+            if (ret == NULL) {
+                Py_DECREF(temp);
+                if (PyErr_Occurred() == NULL)
+                    PyErr_SetString(PyExc_Exception, "Failed to call write() on python file object");
+                throw pyerr();
+            }
+            Py_DECREF(ret);
+#if PY_MAJOR_VERSION >= 3
+            ret = PyObject_CallMethod(temp, "release", NULL);
+            if (ret == NULL) PyErr_Clear(); else Py_DECREF(ret);
+#endif
+            Py_DECREF(temp);
+            update_written();
+        }
+
+        void flush_wbuf() {
+            if (wbuf_used > 0) {
+                size_t n = wbuf_used;
+                // reset before writing so a throwing write cannot flush twice
+                wbuf_used = 0;
+                write_to_python(wbuf, n);
+            }
+        }
+
+    public:
+        OutputDevice(PyObject *file) : tell_func(0), seek_func(0), read_func(0), write_func(0), flush_func(0), written(0), wbuf(0), wbuf_used(0) {
+#define GA(f, a) { if((f = PyObject_GetAttrString(file, a)) == NULL) throw pyerr(); }
+            GA(tell_func, "tell");
+            GA(seek_func, "seek");
+            GA(read_func, "read");
+            GA(write_func, "write");
+            GA(flush_func, "flush");
+            wbuf = new (std::nothrow) char[WRITE_BUFFER_SIZE];
+            if (wbuf == NULL) { PyErr_NoMemory(); throw pyerr(); }
+        }
+        ~OutputDevice() {
+            delete[] wbuf;
+            NUKE(tell_func); NUKE(seek_func); NUKE(read_func); NUKE(write_func); NUKE(flush_func);
+        }
+
+        size_t GetLength() const { return written + wbuf_used; }
 
         size_t Read( char* pBuffer, size_t lLen ) {
             PyObject *ret, *temp;
             char *buf = NULL;
             Py_ssize_t len = 0;
 
+            flush_wbuf();
 #if PY_MAJOR_VERSION >= 3
             if ((temp = PyLong_FromSize_t(lLen)) == NULL) throw pyerr();
 #else
@@ -122,6 +179,8 @@ class OutputDevice : public PdfOutputDevice {
 
         void Seek(size_t offset) {
             PyObject *ret, *temp;
+
+            flush_wbuf();
 #if PY_MAJOR_VERSION >= 3
             if ((temp = PyLong_FromSize_t(offset)) == NULL) throw pyerr();
 #else
@@ -160,39 +219,110 @@ class OutputDevice : public PdfOutputDevice {
             Py_DECREF(ret);
             if (PyErr_Occurred() != NULL) throw pyerr();
 
-            return static_cast<size_t>(ans);
+            // the buffered bytes have not reached the file object yet
+            return static_cast<size_t>(ans) + wbuf_used;
         }
 
         void Write(const char* pBuffer, size_t lLen) {
-            PyObject *ret, *temp = NULL;
+            if (lLen >= WRITE_BUFFER_SIZE) {
+                // too large to ever fit, pass it through directly
+                flush_wbuf();
+                write_to_python(pBuffer, lLen);
+                return;
+            }
+            if (wbuf_used + lLen > WRITE_BUFFER_SIZE) flush_wbuf();
+            memcpy(wbuf + wbuf_used, pBuffer, lLen);
+            wbuf_used += lLen;
+        }
 
-            temp = PyBytes_FromStringAndSize(pBuffer, static_cast<Py_ssize_t>(lLen));
-            if (temp == NULL) throw pyerr();
+        void Flush() {
+            flush_wbuf();
+            Py_XDECREF(PyObject_CallFunctionObjArgs(flush_func, NULL));
+        }
 
-            ret = PyObject_CallFunctionObjArgs(write_func, temp, NULL);
-            NUKE(temp);
+};
 
-            if (ret == NULL) {
-                if (PyErr_Occurred() == NULL)
-                    PyErr_SetString(PyExc_Exception, "Failed to call write() on python file object");
-                throw pyerr();
+
+// Serializes the document into a Python bytearray, which can be exposed to
+// Python as a memoryview without copying it
+class ByteArrayDevice : public DeviceBase {
+
+    private:
+        PyObject *ba;
+        size_t used;
+        size_t pos;
+
+        void ensure(size_t n) {
+            size_t cap = static_cast<size_t>(PyByteArray_GET_SIZE(ba));
+            if (n > cap) {
+                size_t ncap = cap ? cap : WRITE_BUFFER_SIZE;
+                while (ncap < n) ncap *= 2;
+                if (PyByteArray_Resize(ba, static_cast<Py_ssize_t>(ncap)) != 0) throw pyerr();
             }
-            Py_DECREF(ret);
-            update_written();
         }
 
-        void Flush() {
-            Py_XDECREF(PyObject_CallFunctionObjArgs(flush_func, NULL));
+    public:
+        ByteArrayDevice() : ba(0), used(0), pos(0) {
+            ba = PyByteArray_FromStringAndSize("", 0);
+            if (ba == NULL) throw pyerr();
+        }
+        ~ByteArrayDevice() { Py_XDECREF(ba); }
+
+        // Shrink to the written length and hand the bytearray over
+        PyObject* finish() {
+            PyObject *ans = ba;
+            if (PyByteArray_Resize(ans, static_cast<Py_ssize_t>(used)) != 0) throw pyerr();
+            ba = NULL;
+            return ans;
+        }
+
+        size_t GetLength() const { return used; }
+
+        size_t Tell() const { return pos; }
+
+        void Seek(size_t offset) { pos = offset; }
+
+        size_t Read(char* pBuffer, size_t lLen) {
+            size_t n = (pos < used) ? used - pos : 0;
+            if (lLen < n) n = lLen;
+            memcpy(pBuffer, PyByteArray_AS_STRING(ba) + pos, n);
+            pos += n;
+            return n;
+        }
+
+        void Write(const char* pBuffer, size_t lLen) {
+            ensure(pos + lLen);
+            memcpy(PyByteArray_AS_STRING(ba) + pos, pBuffer, lLen);
+            pos += lLen;
+            if (pos > used) used = pos;
         }
 
+        void Flush() { }
+
 };
 
 
-PyObject* pdf::write_doc(PdfMemDocument *doc, PyObject *f) {
-    OutputDevice d(f);
+// Write the document through an explicitly configured PdfWriter. With
+// use_xref_stream the cross reference is written as a compressed stream
+// (PDF 1.5) and objects are serialized in compact mode without cosmetic
+// whitespace, which shrinks the file and speeds up subsequent parses.
+// PoDoFo's writer cannot pack objects into object streams, so this is as
+// far as the format can be compacted at write time.
+void pdf::write_doc_to_device(PdfMemDocument *doc, PdfOutputDevice *device, bool use_xref_stream) {
+    if (!use_xref_stream) { doc->Write(device); return; }
+    PdfWriter writer(&doc->GetObjects(), doc->GetTrailer());
+    writer.SetWriteMode(ePdfWriteMode_Compact);
+    writer.SetUseXRefStream(true);
+    writer.SetPdfVersion(doc->GetPdfVersion() < ePdfVersion_1_5 ? ePdfVersion_1_5 : doc->GetPdfVersion());
+    if (doc->GetEncrypt() != NULL) writer.SetEncrypted(*doc->GetEncrypt());
+    writer.Write(device);
+}
 
+PyObject* pdf::write_doc(PdfMemDocument *doc, PyObject *f, bool use_xref_stream) {
     try {
-        doc->Write(&d);
+        OutputDevice d(f);
+        write_doc_to_device(doc, &d, use_xref_stream);
+        d.Flush();
     } catch(const PdfError & err) {
         podofo_set_exception(err); return NULL;
     } catch (...) {
@@ -203,3 +333,25 @@ PyObject* pdf::write_doc(PdfMemDocument *doc, PyObject *f) {
 
     Py_RETURN_NONE;
 }
+
+PyObject* pdf::write_doc_mem(PdfMemDocument *doc, bool use_xref_stream) {
+    PyObject *ba = NULL, *ans = NULL;
+
+    try {
+        ByteArrayDevice d;
+        write_doc_to_device(doc, &d, use_xref_stream);
+        ba = d.finish();
+    } catch(const PdfError & err) {
+        podofo_set_exception(err); return NULL;
+    } catch (...) {
+        if (PyErr_Occurred() == NULL)
+            PyErr_SetString(PyExc_Exception, "An unknown error occurred while trying to write the pdf to memory");
+        return NULL;
+    }
+
+    // A memoryview over the bytearray exposes the serialized document
+    // without copying it; the caller can release it when done
+    ans = PyMemoryView_FromObject(ba);
+    Py_DECREF(ba);
+    return ans;
+}
@@ -9,6 +9,12 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <string.h>
+#include "cpu_features.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPEEDUP_HAS_SSE2
+#include <emmintrin.h>
+#endif
 
 #define MIN(x, y) ((x < y) ? x : y)
 #define MAX(x, y) ((x > y) ? x : y)
@@ -27,42 +33,45 @@ typedef unsigned __int8 uint8_t;
 #include <stdint.h>
 #endif
 
-static PyObject *
-speedup_parse_date(PyObject *self, PyObject *args) {
-    const char *raw, *orig, *tz;
+// Parse a date in the fixed-width YYYY-MM-DD HH:MM:SS[+HH:MM] layout used by
+// the calibre db into out (year, month, day, hour, minute, second, tzsecs).
+// Returns 0 if raw is not in that layout. Does not touch the Python API, so
+// whole columns can be parsed with the GIL released.
+static int
+parse_date_components(const char *raw, long *out) {
+    const char *orig, *tz;
     char *end;
-    long year, month, day, hour, minute, second, tzh = 0, tzm = 0, sign = 0;
+    long tzh = 0, tzm = 0, sign = 0;
     size_t len;
-    if(!PyArg_ParseTuple(args, "s", &raw)) return NULL;
     while ((*raw == ' ' || *raw == '\t' || *raw == '\n' || *raw == '\r' || *raw == '\f' || *raw == '\v') && *raw != 0) raw++;
     len = strlen(raw);
-    if (len < 19) Py_RETURN_NONE;
+    if (len < 19) return 0;
 
     orig = raw;
 
-    year = strtol(raw, &end, 10);
-    if ((end - raw) != 4) Py_RETURN_NONE;
+    out[0] = strtol(raw, &end, 10);
+    if ((end - raw) != 4) return 0;
     raw += 5;
 
 
-    month = strtol(raw, &end, 10);
-    if ((end - raw) != 2) Py_RETURN_NONE;
+    out[1] = strtol(raw, &end, 10);
+    if ((end - raw) != 2) return 0;
     raw += 3;
 
-    day = strtol(raw, &end, 10);
-    if ((end - raw) != 2) Py_RETURN_NONE;
+    out[2] = strtol(raw, &end, 10);
+    if ((end - raw) != 2) return 0;
     raw += 3;
 
-    hour = strtol(raw, &end, 10);
-    if ((end - raw) != 2) Py_RETURN_NONE;
+    out[3] = strtol(raw, &end, 10);
+    if ((end - raw) != 2) return 0;
     raw += 3;
 
-    minute = strtol(raw, &end, 10);
-    if ((end - raw) != 2) Py_RETURN_NONE;
+    out[4] = strtol(raw, &end, 10);
+    if ((end - raw) != 2) return 0;
     raw += 3;
 
-    second = strtol(raw, &end, 10);
-    if ((end - raw) != 2) Py_RETURN_NONE;
+    out[5] = strtol(raw, &end, 10);
+    if ((end - raw) != 2) return 0;
 
     tz = orig + len - 6;
 
@@ -73,15 +82,78 @@ speedup_parse_date(PyObject *self, PyObject *args) {
         tz += 1;
 
         tzh = strtol(tz, &end, 10);
-        if ((end - tz) != 2) Py_RETURN_NONE;
+        if ((end - tz) != 2) return 0;
         tz += 3;
 
         tzm = strtol(tz, &end, 10);
-        if ((end - tz) != 2) Py_RETURN_NONE;
+        if ((end - tz) != 2) return 0;
+    }
+
+    out[6] = (tzh*60 + tzm)*sign*60;
+    return 1;
+}
+
+static PyObject *
+speedup_parse_date(PyObject *self, PyObject *args) {
+    const char *raw;
+    long out[7] = {0};
+    if(!PyArg_ParseTuple(args, "s", &raw)) return NULL;
+    if (!parse_date_components(raw, out)) Py_RETURN_NONE;
+    return Py_BuildValue("lllllll", out[0], out[1], out[2], out[3], out[4], out[5], out[6]);
+}
+
+static PyObject *
+speedup_parse_date_many(PyObject *self, PyObject *input) {
+    PyObject *items = NULL, *ans = NULL, *temp = NULL;
+    const char **raws = NULL;
+    long *components = NULL;
+    unsigned char *valid = NULL;
+    Py_ssize_t i = 0, count = 0;
+
+    items = PySequence_Fast(input, "parse_date_many() expects an iterable of strings");
+    if (items == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
+
+    raws = (const char**)calloc(count + 1, sizeof(char*));
+    components = (long*)calloc((count + 1) * 7, sizeof(long));
+    valid = (unsigned char*)calloc(count + 1, sizeof(unsigned char));
+    if (raws == NULL || components == NULL || valid == NULL) { PyErr_NoMemory(); goto end; }
+
+    // Get at the UTF-8 data for all items up front, the parsing then runs in
+    // one loop with the GIL released. None entries parse as None.
+    for (i = 0; i < count; i++) {
+        temp = PySequence_Fast_GET_ITEM(items, i);
+        if (temp == Py_None) continue;
+#if PY_MAJOR_VERSION >= 3
+        raws[i] = PyUnicode_AsUTF8(temp);
+#else
+        raws[i] = PyString_AsString(temp);
+#endif
+        if (raws[i] == NULL) goto end;
+    }
+    temp = NULL;
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < count; i++) {
+        if (raws[i] != NULL) valid[i] = parse_date_components(raws[i], components + 7 * i);
+    }
+    Py_END_ALLOW_THREADS;
+
+    ans = PyList_New(count);
+    if (ans == NULL) goto end;
+    for (i = 0; i < count; i++) {
+        if (valid[i]) {
+            long *c = components + 7 * i;
+            temp = Py_BuildValue("lllllll", c[0], c[1], c[2], c[3], c[4], c[5], c[6]);
+            if (temp == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+        } else { temp = Py_None; Py_INCREF(temp); }
+        PyList_SET_ITEM(ans, i, temp);
     }
 
-    return Py_BuildValue("lllllll", year, month, day, hour, minute, second,
-            (tzh*60 + tzm)*sign*60);
+end:
+    free(raws); free(components); free(valid);
+    Py_XDECREF(items);
+    return ans;
 }
 
 
@@ -117,6 +189,77 @@ speedup_pdf_float(PyObject *self, PyObject *args) {
     return ret;
 }
 
+// Format f like pdf_float() does, writing at p and returning the new write
+// position. Uses snprintf instead of PyOS_double_to_string so it can run
+// with the GIL released; the locale dependent separator is fixed up the same
+// way pdf_float() fixes it.
+static char*
+format_pdf_float(double f, char *p) {
+    double a = fabs(f);
+    int precision = 6, l = 0;
+    char *dot;
+
+    if (a <= 1.0e-7) { *p++ = '0'; return p; }
+    if (a > 1) precision = MIN(MAX(0, 6-(int)log10(a)), 6);
+    l = snprintf(p, 32, "%.*f", precision, f);
+    if (l <= 0) { *p++ = '0'; return p; }
+    if (precision > 0) {
+        l -= 1;
+        while (l > 0 && p[l] == '0') l--;
+        if (p[l] != ',' && p[l] != '.') l += 1;  // Keep the last non-zero digit, drop a trailing separator
+        if ( (dot = (char*)memchr(p, ',', l)) ) *dot = '.';
+    }
+    return p + l;
+}
+
+static PyObject*
+speedup_pdf_floats(PyObject *self, PyObject *args) {
+    PyObject *obj = NULL, *ans = NULL;
+    Py_buffer view;
+    const void *bufp = NULL;
+    const double *nums = NULL;
+    char *out = NULL, *p = NULL;
+    Py_ssize_t buflen = 0, count = 0, i = 0;
+    int have_view = 0;
+
+    if (!PyArg_ParseTuple(args, "O", &obj)) return NULL;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) == 0) {
+        have_view = 1; bufp = view.buf; buflen = view.len;
+    } else {
+#if PY_MAJOR_VERSION < 3
+        // array.array does not support the new buffer protocol on py2, fall
+        // back to the old-style buffer interface
+        PyErr_Clear();
+        if (PyObject_AsReadBuffer(obj, &bufp, &buflen) != 0) return NULL;
+#else
+        return NULL;
+#endif
+    }
+    if (buflen % sizeof(double) != 0) {
+        if (have_view) PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_ValueError, "Buffer length is not a multiple of the size of a double");
+        return NULL;
+    }
+    count = buflen / sizeof(double);
+    nums = (const double*)bufp;
+
+    out = (char*)malloc(34 * count + 1);  // 32 bytes per number + separator
+    if (out == NULL) { if (have_view) PyBuffer_Release(&view); return PyErr_NoMemory(); }
+
+    Py_BEGIN_ALLOW_THREADS;
+    p = out;
+    for (i = 0; i < count; i++) {
+        if (i > 0) *p++ = ' ';
+        p = format_pdf_float(nums[i], p);
+    }
+    Py_END_ALLOW_THREADS;
+
+    ans = PyBytes_FromStringAndSize(out, p - out);
+    free(out);
+    if (have_view) PyBuffer_Release(&view);
+    return ans;
+}
+
 static PyObject*
 speedup_detach(PyObject *self, PyObject *args) {
     char *devnull = NULL;
@@ -171,65 +314,201 @@ static void calculate_gaussian_kernel(Py_ssize_t size, double *kernel, double ra
     for (r = 0; r < size * size; r++) kernel[r] *= sum;
 }
 
+#ifndef _MSC_VER
+#include <pthread.h>
+#include <unistd.h>
+#define SPEEDUP_HAS_THREADS 1
+#define MAX_BLUR_WORKERS 8
+#endif
+
+// One horizontal band of the Gaussian blur. Bands read from a shared source
+// buffer and write disjoint rows of the destination, so they are independent
+// and can run on separate threads.
+typedef struct {
+    const double *src, *kernel;
+    double *dst;
+    Py_ssize_t width, height, weight, row_start, row_end;
+} blur_band;
+
+static void blur_rows(blur_band *b) {
+    Py_ssize_t r, c, i, j, half_weight = b->weight / 2;
+    double pixel;
+    for (r = b->row_start; r < b->row_end; r++) {
+        for (c = 0; c < b->width; c++) {
+            pixel = 0;
+            for (i = -half_weight; i <= half_weight; i++) {
+                for (j = -half_weight; j <= half_weight; j++) {
+                    pixel += (*(b->src + STRIDE(b->width, CLAMP(r + i, 0, b->height - 1), CLAMP(c + j, 0, b->width - 1)))) * (*(b->kernel + STRIDE(b->weight, half_weight + i, half_weight + j)));
+                }
+            }
+            *(b->dst + STRIDE(b->width, r, c)) = CLAMP(pixel, 0, 1);
+        }
+    }
+}
+
+#ifdef SPEEDUP_HAS_THREADS
+static void* blur_rows_worker(void *x) {
+    blur_rows((blur_band*)x);
+    return NULL;
+}
+#endif
+
+// Batch cover generation renders the same themed texture for every cover in
+// a job, so textures rendered from an explicit seed are memoized in a small
+// move-to-front cache keyed by the full parameter set. Unseeded calls keep
+// the historical rand() noise and are not cached, as their output is not
+// reproducible. The cached object is immutable, so handing the same one to
+// every caller is safe.
+
+#define TEXTURE_CACHE_SLOTS 8
+
+struct texture_key {
+    Py_ssize_t width, height, weight;
+    double radius, blend_alpha;
+    float density;
+    long seed;
+    unsigned char base_r, base_g, base_b, blend_r, blend_g, blend_b;
+};
+
+static struct texture_cache_entry { struct texture_key key; PyObject *value; } texture_cache[TEXTURE_CACHE_SLOTS];
+
+static PyObject*
+texture_cache_get(const struct texture_key *key) {
+    int i;
+    struct texture_cache_entry hit;
+    for (i = 0; i < TEXTURE_CACHE_SLOTS; i++) {
+        if (texture_cache[i].value != NULL && memcmp(&texture_cache[i].key, key, sizeof(*key)) == 0) {
+            hit = texture_cache[i];
+            memmove(texture_cache + 1, texture_cache, i * sizeof(struct texture_cache_entry));
+            texture_cache[0] = hit;
+            Py_INCREF(hit.value);
+            return hit.value;
+        }
+    }
+    return NULL;
+}
+
+static void
+texture_cache_put(const struct texture_key *key, PyObject *value) {
+    Py_XDECREF(texture_cache[TEXTURE_CACHE_SLOTS - 1].value);
+    memmove(texture_cache + 1, texture_cache, (TEXTURE_CACHE_SLOTS - 1) * sizeof(struct texture_cache_entry));
+    texture_cache[0].key = *key;
+    texture_cache[0].value = value;
+    Py_INCREF(value);
+}
+
 static PyObject*
 speedup_create_texture(PyObject *self, PyObject *args, PyObject *kw) {
     PyObject *ret = NULL;
-    Py_ssize_t width, height, weight = 3, i, j, r, c, half_weight;
-    double pixel, *mask = NULL, radius = 1, *kernel = NULL, blend_alpha = 0.1;
+    Py_ssize_t width, height, weight = 3, i, j, num_bands = 1, rows_per_band;
+    long seed = -1;
+    unsigned long rstate;
+    struct texture_key tkey;
+    double *mask = NULL, *blurred = NULL, radius = 1, *kernel = NULL, blend_alpha = 0.1;
+    blur_band bands[1
+#ifdef SPEEDUP_HAS_THREADS
+        + MAX_BLUR_WORKERS
+#endif
+    ];
     float density = 0.7f;
     unsigned char base_r, base_g, base_b, blend_r = 0, blend_g = 0, blend_b = 0, *ppm = NULL, *t = NULL;
     char header[100] = {0};
-    static char* kwlist[] = {"blend_red", "blend_green", "blend_blue", "blend_alpha", "density", "weight", "radius", NULL};
+    static char* kwlist[] = {"width", "height", "red", "green", "blue", "blend_red", "blend_green", "blend_blue", "blend_alpha", "density", "weight", "radius", "seed", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kw, "nnbbb|bbbdfnd", kwlist, &width, &height, &base_r, &base_g, &base_b, &blend_r, &blend_g, &blend_b, &blend_alpha, &density, &weight, &radius)) return NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "nnbbb|bbbdfndl", kwlist, &width, &height, &base_r, &base_g, &base_b, &blend_r, &blend_g, &blend_b, &blend_alpha, &density, &weight, &radius, &seed)) return NULL;
     if (weight % 2 != 1 || weight < 1) { PyErr_SetString(PyExc_ValueError, "The weight must be an odd positive number"); return NULL; }
     if (radius <= 0) { PyErr_SetString(PyExc_ValueError, "The radius must be positive"); return NULL; }
     if (width > 100000 || height > 10000) { PyErr_SetString(PyExc_ValueError, "The width or height is too large"); return NULL; }
     if (width < 1 || height < 1) { PyErr_SetString(PyExc_ValueError, "The width or height is too small"); return NULL; }
+
+    if (seed >= 0) {
+        // memcmp() is used to compare keys, so any padding must be zeroed
+        memset(&tkey, 0, sizeof(tkey));
+        tkey.width = width; tkey.height = height; tkey.weight = weight;
+        tkey.radius = radius; tkey.blend_alpha = blend_alpha; tkey.density = density;
+        tkey.seed = seed;
+        tkey.base_r = base_r; tkey.base_g = base_g; tkey.base_b = base_b;
+        tkey.blend_r = blend_r; tkey.blend_g = blend_g; tkey.blend_b = blend_b;
+        ret = texture_cache_get(&tkey);
+        if (ret != NULL) return ret;
+    }
     snprintf(header, 99, "P6\n%d %d\n255\n", (int)width, (int)height);
 
     kernel = (double*)calloc(weight * weight, sizeof(double));
     if (kernel == NULL) { PyErr_NoMemory(); return NULL; }
     mask = (double*)calloc(width * height, sizeof(double));
     if (mask == NULL) { free(kernel); PyErr_NoMemory(); return NULL;}
+    blurred = (double*)calloc(width * height, sizeof(double));
+    if (blurred == NULL) { free(kernel); free(mask); PyErr_NoMemory(); return NULL; }
     ppm = (unsigned char*)calloc(strlen(header) + (3 * width * height), sizeof(unsigned char));
-    if (ppm == NULL) { free(kernel); free(mask); PyErr_NoMemory(); return NULL; }
+    if (ppm == NULL) { free(kernel); free(mask); free(blurred); PyErr_NoMemory(); return NULL; }
 
     calculate_gaussian_kernel(weight, kernel, radius);
 
-    // Random noise, noisy pixels are blend_alpha, other pixels are 0
-    for (i = 0; i < width * height; i++) {
-        if (((float)(rand()) / RAND_MAX) <= density) mask[i] = blend_alpha;
+    // Random noise, noisy pixels are blend_alpha, other pixels are 0. This
+    // stays single threaded as rand() is not thread safe. With an explicit
+    // seed a local LCG is used instead, so the texture is reproducible and
+    // can be cached.
+    if (seed >= 0) {
+        rstate = (unsigned long)seed;
+        for (i = 0; i < width * height; i++) {
+            rstate = rstate * 1103515245UL + 12345UL;
+            if ((float)((rstate >> 16) & 0x7fff) / 32767.0f <= density) mask[i] = blend_alpha;
+        }
+    } else {
+        for (i = 0; i < width * height; i++) {
+            if (((float)(rand()) / RAND_MAX) <= density) mask[i] = blend_alpha;
+        }
     }
 
-    // Blur the noise using the gaussian kernel
-    half_weight = weight / 2;
-    for (r = 0; r < height; r++) {
-        for (c = 0; c < width; c++) {
-            pixel = 0;
-            for (i = -half_weight; i <= half_weight; i++) {
-                for (j = -half_weight; j <= half_weight; j++) {
-                    pixel += (*(mask + STRIDE(width, CLAMP(r + i, 0, height - 1), CLAMP(c + j, 0, width - 1)))) * (*(kernel + STRIDE(weight, half_weight + i, half_weight + j)));
-                }
-            }
-            *(mask + STRIDE(width, r, c)) = CLAMP(pixel, 0, 1);
-        }
+#ifdef SPEEDUP_HAS_THREADS
+    num_bands = (Py_ssize_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_bands < 1) num_bands = 1;
+    if (num_bands > MAX_BLUR_WORKERS) num_bands = MAX_BLUR_WORKERS;
+    if (num_bands > height / 64) num_bands = height / 64 + 1;  // Too little work per band otherwise
+#endif
+    rows_per_band = height / num_bands + 1;
+    for (i = 0; i < num_bands; i++) {
+        bands[i].src = mask; bands[i].dst = blurred; bands[i].kernel = kernel;
+        bands[i].width = width; bands[i].height = height; bands[i].weight = weight;
+        bands[i].row_start = i * rows_per_band;
+        bands[i].row_end = MIN((i + 1) * rows_per_band, height);
     }
 
+    Py_BEGIN_ALLOW_THREADS;
+    // Blur the noise using the gaussian kernel, one band of rows per thread
+#ifdef SPEEDUP_HAS_THREADS
+    if (num_bands > 1) {
+        pthread_t threads[MAX_BLUR_WORKERS];
+        int started[MAX_BLUR_WORKERS] = {0};
+        for (i = 1; i < num_bands; i++) started[i] = (pthread_create(&threads[i], NULL, blur_rows_worker, &bands[i]) == 0);
+        blur_rows(&bands[0]);
+        for (i = 1; i < num_bands; i++) {
+            if (started[i]) pthread_join(threads[i], NULL);
+            else blur_rows(&bands[i]);  // Thread creation failed, do the work inline
+        }
+    } else blur_rows(&bands[0]);
+#else
+    blur_rows(&bands[0]);
+#endif
+
     // Create the texture in PPM (P6) format
     memcpy(ppm, header, strlen(header));
     t = ppm + strlen(header);
     for (i = 0, j = 0; j < width * height; i += 3, j += 1) {
-#define BLEND(src, dest) ( ((unsigned char)(src * mask[j])) + ((unsigned char)(dest * (1 - mask[j]))) )
+#define BLEND(src, dest) ( ((unsigned char)(src * blurred[j])) + ((unsigned char)(dest * (1 - blurred[j]))) )
         t[i] = BLEND(blend_r, base_r);
         t[i+1] = BLEND(blend_g, base_g);
         t[i+2] = BLEND(blend_b, base_b);
     }
+    Py_END_ALLOW_THREADS;
 
     ret = Py_BuildValue("s", ppm);
     free(mask); mask = NULL;
+    free(blurred); blurred = NULL;
     free(kernel); kernel = NULL;
     free(ppm); ppm = NULL;
+    if (ret != NULL && seed >= 0) texture_cache_put(&tkey, ret);
     return ret;
 }
 
@@ -410,15 +689,6 @@ clean_xml_chars(PyObject *self, PyObject *text) {
 }
 #endif
 
-static PyObject *
-speedup_iso_8601(PyObject *self, PyObject *args) {
-    char *str = NULL, *c = NULL;
-    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0, usecond = 0, i = 0, tzhour = 1000, tzminute = 0, tzsign = 0;
-
-    if (!PyArg_ParseTuple(args, "s", &str)) return NULL;
-    c = str;
-
-#define RAISE(msg) return PyErr_Format(PyExc_ValueError, "%s is not a valid ISO 8601 datestring: %s", str, msg);
 #define CHAR_IS_DIGIT(c) (*c >= '0' && *c <= '9')
 #define READ_DECIMAL_NUMBER(max_digits, x, abort) \
     for (i = 0; i < max_digits; i++) { \
@@ -427,47 +697,117 @@ speedup_iso_8601(PyObject *self, PyObject *args) {
     }
 #define OPTIONAL_SEPARATOR(x) if(*c == x) c++;
 
+#ifdef SPEEDUP_HAS_SSE2
+// Convert the twelve digit fields of a fixed width "YYYY-MM-DDTHH:MM"
+// prefix in one shot: the sixteen bytes are widened to words, de-ASCIIfied
+// and combined into field values with a single multiply-add, with the
+// separator lanes given a weight of zero. The digits and separators are
+// validated byte-wise first (that also guarantees sixteen readable bytes),
+// so only clean prefixes in the dominant layout take this path. Returns 0
+// to fall back to the flexible scalar parser.
+static int
+parse_iso8601_fixed_prefix(const char *c, long *year, long *month, long *day, long *hour, long *minute, long *second) {
+    __m128i vlo, vhi, v;
+    int32_t lo[4], hi[4];
+#define D(i) (c[i] >= '0' && c[i] <= '9')
+    if (!(D(0) && D(1) && D(2) && D(3) && c[4] == '-' && D(5) && D(6) && c[7] == '-' &&
+          D(8) && D(9) && (c[10] == 'T' || c[10] == ' ') && D(11) && D(12) && c[13] == ':' &&
+          D(14) && D(15) && c[16] == ':' && D(17) && D(18))) return 0;
+#undef D
+    v = _mm_loadu_si128((const __m128i*)c);
+    vlo = _mm_sub_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_set1_epi16('0'));
+    vhi = _mm_sub_epi16(_mm_unpackhi_epi8(v, _mm_setzero_si128()), _mm_set1_epi16('0'));
+    _mm_storeu_si128((__m128i*)lo, _mm_madd_epi16(vlo, _mm_setr_epi16(10, 1, 10, 1, 0, 10, 1, 0)));
+    _mm_storeu_si128((__m128i*)hi, _mm_madd_epi16(vhi, _mm_setr_epi16(10, 1, 0, 10, 1, 0, 10, 1)));
+    *year = lo[0] * 100 + lo[1]; *month = lo[2] + lo[3];
+    *day = hi[0]; *hour = hi[1] + hi[2]; *minute = hi[3];
+    *second = (c[17] - '0') * 10 + c[18] - '0';
+    return 1;
+}
+#endif
+
+// OPDS feeds share a handful of timezone offsets across millions of
+// timestamps, so the batch parser remembers the last suffix seen and its
+// parsed value, keyed on the exact remaining text (anything longer than the
+// longest sensible suffix bypasses the memo).
+struct iso8601_tz_memo {
+    char suffix[8];
+    long aware, tzsecs;
+    int valid;
+};
+
+// Parse an ISO 8601 datestring into out (year, month, day, hour, minute,
+// second, microsecond, tz aware flag, tz offset in seconds). Returns an
+// error message if the string is not valid, NULL on success. Does not touch
+// the Python API, so whole feeds can be parsed with the GIL released.
+static const char *
+parse_iso8601_components(const char *c, long *out, struct iso8601_tz_memo *memo) {
+    long year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0, usecond = 0, tzhour = 1000, tzminute = 0, tzsign = 0;
+    int i = 0, have_time = 0;
+    const char *tz_start;
+
     // Ignore leading whitespace
     while(*c == ' ' || *c == '\n' || *c == '\r' || *c == '\t' || *c == '\v' || *c == '\f') c++;
 
-    // Year
-    READ_DECIMAL_NUMBER(4, year, RAISE("No year specified"));
-    OPTIONAL_SEPARATOR('-');
-    // Month (optional)
-    READ_DECIMAL_NUMBER(2, month, break);
-    if (month == 0) month = 1; // YYYY format
-    else {
+#ifdef SPEEDUP_HAS_SSE2
+    if (parse_iso8601_fixed_prefix(c, &year, &month, &day, &hour, &minute, &second) &&
+            1 <= month && month <= 12 && day != 0) {
+        c += 19;
+        have_time = 1;
+    } else {
+        year = month = day = hour = minute = second = 0;
+#else
+    {
+#endif
+        // Year
+        READ_DECIMAL_NUMBER(4, year, return "No year specified");
         OPTIONAL_SEPARATOR('-');
+        // Month (optional)
+        READ_DECIMAL_NUMBER(2, month, break);
+        if (month == 0) month = 1; // YYYY format
+        else {
+            OPTIONAL_SEPARATOR('-');
+
+            // Day (optional)
+            READ_DECIMAL_NUMBER(2, day, break);
+        }
+        if (day == 0) day = 1; // YYYY-MM format
+        if (month > 12) return "month greater than 12";
 
-        // Day (optional)
-        READ_DECIMAL_NUMBER(2, day, break);
+        if (*c == 'T' || *c == ' ') // Time separator
+        {
+            c++;
+
+            // Hour
+            READ_DECIMAL_NUMBER(2, hour, return "No hour specified");
+            OPTIONAL_SEPARATOR(':');
+            // Minute (optional)
+            READ_DECIMAL_NUMBER(2, minute, break);
+            OPTIONAL_SEPARATOR(':');
+            // Second (optional)
+            READ_DECIMAL_NUMBER(2, second, break);
+            have_time = 1;
+        }
     }
-    if (day == 0) day = 1; // YYYY-MM format
-    if (month > 12) RAISE("month greater than 12");
 
-    if (*c == 'T' || *c == ' ') // Time separator
+    if (have_time && (*c == '.' || *c == ',')) // separator for microseconds
     {
         c++;
+        // Parse fraction of second up to 6 places
+        READ_DECIMAL_NUMBER(6, usecond, break);
+        // Omit excessive digits
+        while (CHAR_IS_DIGIT(c)) c++;
+        // If we break early, fully expand the usecond
+        while (i++ < 6) usecond *= 10;
+    }
 
-        // Hour
-        READ_DECIMAL_NUMBER(2, hour, RAISE("No hour specified"));
-        OPTIONAL_SEPARATOR(':');
-        // Minute (optional)
-        READ_DECIMAL_NUMBER(2, minute, break);
-        OPTIONAL_SEPARATOR(':');
-        // Second (optional)
-        READ_DECIMAL_NUMBER(2, second, break);
+    out[0] = year; out[1] = month; out[2] = day;
+    out[3] = hour; out[4] = minute; out[5] = second; out[6] = usecond;
 
-        if (*c == '.' || *c == ',') // separator for microseconds
-        {
-            c++;
-            // Parse fraction of second up to 6 places
-            READ_DECIMAL_NUMBER(6, usecond, break);
-            // Omit excessive digits
-            while (CHAR_IS_DIGIT(c)) c++;
-            // If we break early, fully expand the usecond
-            while (i++ < 6) usecond *= 10;
-        }
+    tz_start = c;
+    if (memo != NULL && memo->valid && strncmp(c, memo->suffix, sizeof(memo->suffix)) == 0) {
+        out[7] = memo->aware; out[8] = memo->tzsecs;
+        return NULL;
     }
 
     switch(*c) {
@@ -488,7 +828,92 @@ speedup_iso_8601(PyObject *self, PyObject *args) {
         READ_DECIMAL_NUMBER(2, tzminute, break);
     }
 
-    return Py_BuildValue("NOi", PyDateTime_FromDateAndTime(year, month, day, hour, minute, second, usecond), (tzhour == 1000) ? Py_False : Py_True, tzsign*60*(tzhour*60 + tzminute));
+    out[7] = tzhour != 1000;
+    out[8] = tzsign*60*(tzhour*60 + tzminute);
+    if (memo != NULL && strlen(tz_start) < sizeof(memo->suffix)) {
+        strcpy(memo->suffix, tz_start);
+        memo->aware = out[7]; memo->tzsecs = out[8]; memo->valid = 1;
+    }
+    return NULL;
+}
+
+static PyObject *
+speedup_iso_8601(PyObject *self, PyObject *args) {
+    const char *str = NULL, *err = NULL;
+    long out[9] = {0};
+
+    if (!PyArg_ParseTuple(args, "s", &str)) return NULL;
+    err = parse_iso8601_components(str, out, NULL);
+    if (err != NULL) return PyErr_Format(PyExc_ValueError, "%s is not a valid ISO 8601 datestring: %s", str, err);
+    return Py_BuildValue("NOi", PyDateTime_FromDateAndTime((int)out[0], (int)out[1], (int)out[2], (int)out[3], (int)out[4], (int)out[5], (int)out[6]), out[7] ? Py_True : Py_False, (int)out[8]);
+}
+
+static PyObject *
+speedup_iso_8601_many(PyObject *self, PyObject *input) {
+    PyObject *items = NULL, *ans = NULL, *temp = NULL;
+    const char **raws = NULL;
+    long *components = NULL;
+    unsigned char *valid = NULL;
+    struct iso8601_tz_memo memo;
+    Py_ssize_t i = 0, count = 0;
+
+    memset(&memo, 0, sizeof(memo));
+    items = PySequence_Fast(input, "parse_iso8601_many() expects an iterable of strings");
+    if (items == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
+
+    raws = (const char**)calloc(count + 1, sizeof(char*));
+    components = (long*)calloc((count + 1) * 9, sizeof(long));
+    valid = (unsigned char*)calloc(count + 1, sizeof(unsigned char));
+    if (raws == NULL || components == NULL || valid == NULL) { PyErr_NoMemory(); goto end; }
+
+    // Get at the UTF-8 data for all items up front, the parsing then runs in
+    // one loop with the GIL released. None entries parse as None.
+    for (i = 0; i < count; i++) {
+        temp = PySequence_Fast_GET_ITEM(items, i);
+        if (temp == Py_None) continue;
+#if PY_MAJOR_VERSION >= 3
+        raws[i] = PyUnicode_AsUTF8(temp);
+#else
+        raws[i] = PyString_AsString(temp);
+#endif
+        if (raws[i] == NULL) goto end;
+    }
+    temp = NULL;
+
+    Py_BEGIN_ALLOW_THREADS;
+    for (i = 0; i < count; i++) {
+        if (raws[i] != NULL) valid[i] = parse_iso8601_components(raws[i], components + 9 * i, &memo) == NULL;
+    }
+    Py_END_ALLOW_THREADS;
+
+    ans = PyList_New(count);
+    if (ans == NULL) goto end;
+    for (i = 0; i < count; i++) {
+        if (valid[i]) {
+            long *c = components + 9 * i;
+            int j;
+            // Built by hand rather than with Py_BuildValue() as parsing its
+            // format string per entry is measurable on feed sized batches
+            temp = PyTuple_New(9);
+            if (temp == NULL) { Py_DECREF(ans); ans = NULL; goto end; }
+            for (j = 0; j < 9; j++) {
+#if PY_MAJOR_VERSION >= 3
+                PyObject *num = PyLong_FromLong(c[j]);
+#else
+                PyObject *num = PyInt_FromLong(c[j]);
+#endif
+                if (num == NULL) { Py_DECREF(temp); Py_DECREF(ans); ans = NULL; goto end; }
+                PyTuple_SET_ITEM(temp, j, num);
+            }
+        } else { temp = Py_None; Py_INCREF(temp); }
+        PyList_SET_ITEM(ans, i, temp);
+    }
+
+end:
+    free(raws); free(components); free(valid);
+    Py_XDECREF(items);
+    return ans;
 }
 
 #ifndef _MSC_VER
@@ -543,30 +968,60 @@ set_thread_name(PyObject *self, PyObject *args) {
 #endif
 }
 
+static PyObject*
+speedup_cpu_features(PyObject *self, PyObject *args) {
+    CalibreCPUFeatures feats = calibre_cpu_features();
+    PyObject *ans;
+	(void)(self); (void)(args);
+    ans = PyDict_New();
+    if (ans == NULL) return NULL;
+    if (PyDict_SetItemString(ans, "sse2", feats.sse2 ? Py_True : Py_False) != 0 ||
+        PyDict_SetItemString(ans, "sse4_2", feats.sse4_2 ? Py_True : Py_False) != 0 ||
+        PyDict_SetItemString(ans, "avx2", feats.avx2 ? Py_True : Py_False) != 0 ||
+        PyDict_SetItemString(ans, "neon", feats.neon ? Py_True : Py_False) != 0) {
+        Py_DECREF(ans);
+        return NULL;
+    }
+    return ans;
+}
+
 static PyMethodDef speedup_methods[] = {
     {"parse_date", speedup_parse_date, METH_VARARGS,
         "parse_date()\n\nParse ISO dates faster (specialized for dates stored in the calibre db)."
     },
 
+    {"parse_date_many", speedup_parse_date_many, METH_O,
+        "parse_date_many(iterable of strings)\n\nParse a whole column of dates in one call, returning a list with an entry per input: a tuple of (year, month, day, hour, minute, second, tzsecs) or None if the input was None or not a valid date. All parsing is done with the GIL released."
+    },
+
     {"parse_iso8601", speedup_iso_8601, METH_VARARGS,
         "parse_iso8601(datestring)\n\nParse ISO 8601 dates faster. More spec compliant than parse_date()"
     },
 
+    {"parse_iso8601_many", speedup_iso_8601_many, METH_O,
+        "parse_iso8601_many(iterable of strings)\n\nParse a whole feed of ISO 8601 timestamps in one call, returning a list with an entry per input: a tuple of (year, month, day, hour, minute, second, microsecond, aware, tzsecs) or None if the input was None or not a valid datestring. All parsing is done with the GIL released and a repeated timezone suffix is parsed only once."
+    },
+
     {"pdf_float", speedup_pdf_float, METH_VARARGS,
         "pdf_float()\n\nConvert float to a string representation suitable for PDF"
     },
 
+    {"pdf_floats", speedup_pdf_floats, METH_VARARGS,
+        "pdf_floats(buffer_of_doubles)\n\nFormat an entire array of doubles (any buffer of binary doubles, e.g. array.array('d')) into a single space separated bytestring suitable for PDF content streams, with the GIL released. Equivalent to joining pdf_float() results but without per-number Python calls."
+    },
+
     {"detach", speedup_detach, METH_VARARGS,
         "detach()\n\nRedirect the standard I/O stream to the specified file (usually os.devnull)"
     },
 
     {"create_texture", (PyCFunction)speedup_create_texture, METH_VARARGS | METH_KEYWORDS,
-        "create_texture(width, height, red, green, blue, blend_red=0, blend_green=0, blend_blue=0, blend_alpha=0.1, density=0.7, weight=3, radius=1)\n\n"
+        "create_texture(width, height, red, green, blue, blend_red=0, blend_green=0, blend_blue=0, blend_alpha=0.1, density=0.7, weight=3, radius=1, seed=-1)\n\n"
             "Create a texture of the specified width and height from the specified color."
             " The texture is created by blending in random noise of the specified blend color into a flat image."
             " All colors are numbers between 0 and 255. 0 <= blend_alpha <= 1 with 0 being fully transparent."
             " 0 <= density <= 1 is used to control the amount of noise in the texture."
             " weight and radius control the Gaussian convolution used for blurring of the noise. weight must be an odd positive integer. Increasing the weight will tend to blur out the noise. Decreasing it will make it sharper."
+            " Passing a seed >= 0 makes the noise reproducible, and such textures are served from a small internal cache keyed by the full parameter set, so batch jobs compute each distinct texture only once."
             " This function returns an image (bytestring) in the PPM format as the texture."
     },
 
@@ -590,6 +1045,10 @@ static PyMethodDef speedup_methods[] = {
 		"set_thread_name(name)\n\nWrapper for pthread_setname_np"
 	},
 
+    {"cpu_features", speedup_cpu_features, METH_NOARGS,
+        "cpu_features()\n\nThe SIMD instruction sets available on this CPU, as a dict of feature name to bool. This is the same detection the native modules use to pick their accelerated kernels at import time, so it reports which paths are live."
+    },
+
     {NULL, NULL, 0, NULL}
 };
 
@@ -10,84 +10,312 @@
 #include <Python.h>
 #include <new>
 #include <string>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
 #include <hunspell.hxx>
 
+// LRU cache of spell check results. A book wide spell check of a novel
+// probes the dictionary ~80k times for only ~8k distinct words, and add()
+// and remove() are rare, so caching recognized() results pays off. The
+// cache must be invalidated whenever the runtime dictionary is mutated.
+template <typename Value>
+class LRUCache {
+    size_t capacity;
+    typedef std::list< std::pair<std::string, Value> > Order;
+    Order order;  // front is most recently used
+    std::unordered_map<std::string, typename Order::iterator> map;
+public:
+    explicit LRUCache(size_t capacity) : capacity(capacity), order(), map() {}
+
+    bool get(const std::string &word, Value *value) {
+        typename std::unordered_map<std::string, typename Order::iterator>::iterator it = map.find(word);
+        if (it == map.end()) return false;
+        order.splice(order.begin(), order, it->second);
+        *value = it->second->second;
+        return true;
+    }
+
+    void put(const std::string &word, const Value &value) {
+        Value dummy;
+        if (get(word, &dummy)) { order.front().second = value; return; }
+        order.push_front(std::make_pair(word, value));
+        map[word] = order.begin();
+        if (map.size() > capacity) {
+            map.erase(order.back().first);
+            order.pop_back();
+        }
+    }
+
+    void clear() { map.clear(); order.clear(); }
+};
+
+typedef LRUCache<bool> WordCache;
+// Suggestion lists are stored in the dictionary encoding and decoded on
+// the way out; suggest() is 10-100ms per word, so even a modest cache is
+// a large win for the spell check dialog
+typedef LRUCache< std::vector<std::string> > SuggestionCache;
+
 typedef struct {
 	PyObject_HEAD
     Hunspell *handle;
     char *encoding;
+    WordCache *cache;
+    SuggestionCache *suggestion_cache;
+    // Serializes use of the hunspell handle, which is not thread safe.
+    // Must only be acquired with the GIL released, so that a thread
+    // holding it while it waits to reacquire the GIL cannot deadlock with
+    // a thread that holds the GIL and wants the lock.
+    std::mutex *handle_lock;
 } Dictionary;
 
 static PyObject *HunspellError = NULL;
 
 static int
 init_type(Dictionary *self, PyObject *args, PyObject *kwds) {
-	char *dic = NULL, *aff = NULL;
-    Py_ssize_t diclen, afflen;
+    // The data is accepted via the buffer protocol so that callers can pass
+    // a read-only mmap of a dictionary cache file without an intermediate
+    // copy; hunspell builds its own tables, the buffers are released here.
+    Py_buffer dic = {0}, aff = {0};
 
     self->handle = NULL;
     self->encoding = NULL;
+    self->cache = NULL;
+    self->suggestion_cache = NULL;
+    self->handle_lock = NULL;
 
-	if (!PyArg_ParseTuple(args, "s#s#", &dic, &diclen, &aff, &afflen)) return 1;
+	if (!PyArg_ParseTuple(args, "s*s*", &dic, &aff)) return 1;
 
     try {
-        self->handle = new (std::nothrow) Hunspell(aff, afflen, dic, diclen);
+        self->handle = new (std::nothrow) Hunspell((const char*)aff.buf, (size_t)aff.len, (const char*)dic.buf, (size_t)dic.len);
     } catch (const std::exception &ex) {
         PyErr_SetString(HunspellError, ex.what());
-        return 1;
     } catch (const std::string &ex) {
         PyErr_SetString(HunspellError, ex.c_str());
-        return 1;
     } catch (...) {
         PyErr_SetString(HunspellError, "Failed to create dictionary, unknown error");
-        return 1;
     }
+    PyBuffer_Release(&dic); PyBuffer_Release(&aff);
+    if (PyErr_Occurred()) return 1;
     if (self->handle == NULL) { PyErr_NoMemory(); return 1; }
     self->encoding = self->handle->get_dic_encoding();
     if (self->encoding == NULL) { delete self->handle; self->handle = NULL; PyErr_SetString(HunspellError, "Failed to get dictionary encoding"); return 1; }
+    self->cache = new (std::nothrow) WordCache(10000);
+    self->suggestion_cache = new (std::nothrow) SuggestionCache(4096);
+    self->handle_lock = new (std::nothrow) std::mutex();
+    if (self->cache == NULL || self->suggestion_cache == NULL || self->handle_lock == NULL) {
+        delete self->handle; self->handle = NULL;
+        delete self->cache; self->cache = NULL;
+        delete self->suggestion_cache; self->suggestion_cache = NULL;
+        delete self->handle_lock; self->handle_lock = NULL;
+        PyErr_NoMemory(); return 1;
+    }
 	return 0;
 }
 
 static void
 dealloc(Dictionary *self) {
     if (self->handle != NULL) delete self->handle;
+    if (self->cache != NULL) delete self->cache;
+    if (self->suggestion_cache != NULL) delete self->suggestion_cache;
+    if (self->handle_lock != NULL) delete self->handle_lock;
     /* We do not free encoding, since it is managed by hunspell */
-    self->encoding = NULL; self->handle = NULL;
+    self->encoding = NULL; self->handle = NULL; self->cache = NULL;
+    self->suggestion_cache = NULL; self->handle_lock = NULL;
 	Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
 static PyObject *
 recognized(Dictionary *self, PyObject *args) {
 	char *word = NULL;
+    bool ans;
 	if (!PyArg_ParseTuple(args, "es", self->encoding, &word)) return NULL;
 
-    if (self->handle->spell(word) == 0) { PyMem_Free(word); Py_RETURN_FALSE;}
-    PyMem_Free(word);
-    Py_RETURN_TRUE;
+    try {
+        std::string key(word);
+        PyMem_Free(word);
+        if (!self->cache->get(key, &ans)) {
+            Py_BEGIN_ALLOW_THREADS;
+            {
+                std::lock_guard<std::mutex> guard(*self->handle_lock);
+                ans = self->handle->spell(key.c_str()) != 0;
+            }
+            Py_END_ALLOW_THREADS;
+            self->cache->put(key, ans);
+        }
+    } catch (const std::bad_alloc&) { return PyErr_NoMemory(); }
+    if (ans) Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static PyObject *
+recognized_many(Dictionary *self, PyObject *args) {
+    PyObject *words = NULL, *fast = NULL, *word = NULL, *encoded = NULL, *ans = NULL;
+    Py_ssize_t count, i;
+
+	if (!PyArg_ParseTuple(args, "O", &words)) return NULL;
+    fast = PySequence_Fast(words, "words must be a sequence of unicode objects");
+    if (fast == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(fast);
+
+    try {
+        std::vector<std::string> to_check;      // deduped cache misses
+        std::vector<char> results(count, 0);
+        std::unordered_map<std::string, std::vector<Py_ssize_t> > pending;  // miss -> input positions
+        bool recognized;
+
+        for (i = 0; i < count; i++) {
+            word = PySequence_Fast_GET_ITEM(fast, i);
+            if (!PyUnicode_Check(word)) {
+                PyErr_SetString(PyExc_TypeError, "words must be a sequence of unicode objects");
+                Py_DECREF(fast); return NULL;
+            }
+            encoded = PyUnicode_AsEncodedString(word, self->encoding, "strict");
+            if (encoded == NULL) {
+                // A word that cannot be represented in the dictionary's
+                // encoding cannot be in the dictionary
+                PyErr_Clear();
+                continue;
+            }
+            std::string key(PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+            Py_DECREF(encoded); encoded = NULL;
+            if (self->cache->get(key, &recognized)) {
+                results[i] = recognized ? 1 : 0;
+                continue;
+            }
+            std::vector<Py_ssize_t> &positions = pending[key];
+            if (positions.empty()) to_check.push_back(key);
+            positions.push_back(i);
+        }
+
+        std::vector<char> checked(to_check.size(), 0);
+        if (!to_check.empty()) {
+            Hunspell *handle = self->handle;
+            Py_BEGIN_ALLOW_THREADS;
+            {
+                std::lock_guard<std::mutex> guard(*self->handle_lock);
+                for (size_t w = 0; w < to_check.size(); w++)
+                    checked[w] = handle->spell(to_check[w].c_str()) ? 1 : 0;
+            }
+            Py_END_ALLOW_THREADS;
+        }
+        for (size_t w = 0; w < to_check.size(); w++) {
+            const std::vector<Py_ssize_t> &positions = pending[to_check[w]];
+            for (size_t p = 0; p < positions.size(); p++) results[positions[p]] = checked[w];
+            self->cache->put(to_check[w], checked[w] != 0);
+        }
+
+        ans = PyTuple_New(count);
+        if (ans == NULL) { Py_DECREF(fast); return PyErr_NoMemory(); }
+        for (i = 0; i < count; i++) {
+            PyObject *val = results[i] ? Py_True : Py_False;
+            Py_INCREF(val);
+            PyTuple_SET_ITEM(ans, i, val);
+        }
+    } catch (const std::bad_alloc&) {
+        Py_DECREF(fast);
+        return PyErr_NoMemory();
+    }
+
+    Py_DECREF(fast);
+    return ans;
+}
+
+// Run the (expensive) suggestion search for a single word, with neither
+// the GIL nor the handle lock held by the caller. The results are
+// returned in the dictionary encoding.
+static void
+suggest_word(Dictionary *self, const std::string &word, std::vector<std::string> *suggestions) {
+    char **slist = NULL;
+    int i, num_slist;
+    {
+        std::lock_guard<std::mutex> guard(*self->handle_lock);
+        num_slist = self->handle->suggest(&slist, word.c_str());
+    }
+    for (i = 0; i < num_slist; i++) suggestions->push_back(std::string(slist[i]));
+    if (slist != NULL) self->handle->free_list(&slist, num_slist);
 }
 
 static PyObject *
 suggest(Dictionary *self, PyObject *args) {
-	char *word = NULL, **slist = NULL;
-	int i, num_slist;
+	char *word = NULL;
 	PyObject *ans, *temp;
 
 	if (!PyArg_ParseTuple(args, "es", self->encoding, &word)) return NULL;
 
-	num_slist = self->handle->suggest(&slist, word);
-	ans = PyTuple_New(num_slist);
-    if (ans == NULL) PyErr_NoMemory();
-    else {
-        for (i = 0; i < num_slist; i++) {
-            temp = PyUnicode_Decode(slist[i], strlen(slist[i]), self->encoding, "strict");
-            if (temp == NULL) { Py_DECREF(ans); ans = NULL; break; }
+    try {
+        std::string key(word);
+        PyMem_Free(word); word = NULL;
+        std::vector<std::string> suggestions;
+        if (!self->suggestion_cache->get(key, &suggestions)) {
+            Py_BEGIN_ALLOW_THREADS;
+            suggest_word(self, key, &suggestions);
+            Py_END_ALLOW_THREADS;
+            self->suggestion_cache->put(key, suggestions);
+        }
+        ans = PyTuple_New(suggestions.size());
+        if (ans == NULL) return PyErr_NoMemory();
+        for (size_t i = 0; i < suggestions.size(); i++) {
+            temp = PyUnicode_Decode(suggestions[i].c_str(), suggestions[i].size(), self->encoding, "strict");
+            if (temp == NULL) { Py_DECREF(ans); return NULL; }
             PyTuple_SET_ITEM(ans, i, temp);
         }
+    } catch (const std::bad_alloc&) { if (word != NULL) PyMem_Free(word); return PyErr_NoMemory(); }
+	return ans;
+}
+
+static PyObject *
+suggest_many(Dictionary *self, PyObject *args) {
+    PyObject *words = NULL, *fast = NULL, *word = NULL, *encoded = NULL;
+    Py_ssize_t count, i;
+
+	if (!PyArg_ParseTuple(args, "O", &words)) return NULL;
+    fast = PySequence_Fast(words, "words must be a sequence of unicode objects");
+    if (fast == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(fast);
+
+    try {
+        std::vector<std::string> to_check;  // deduped cache misses
+        std::vector<std::string> dummy;
+
+        for (i = 0; i < count; i++) {
+            word = PySequence_Fast_GET_ITEM(fast, i);
+            if (!PyUnicode_Check(word)) {
+                PyErr_SetString(PyExc_TypeError, "words must be a sequence of unicode objects");
+                Py_DECREF(fast); return NULL;
+            }
+            encoded = PyUnicode_AsEncodedString(word, self->encoding, "strict");
+            if (encoded == NULL) {
+                // No suggestions are possible for a word that cannot be
+                // represented in the dictionary's encoding
+                PyErr_Clear();
+                continue;
+            }
+            std::string key(PyBytes_AS_STRING(encoded), PyBytes_GET_SIZE(encoded));
+            Py_DECREF(encoded); encoded = NULL;
+            if (self->suggestion_cache->get(key, &dummy)) continue;
+            if (std::find(to_check.begin(), to_check.end(), key) == to_check.end())
+                to_check.push_back(key);
+        }
+
+        std::vector< std::vector<std::string> > checked(to_check.size());
+        if (!to_check.empty()) {
+            Py_BEGIN_ALLOW_THREADS;
+            for (size_t w = 0; w < to_check.size(); w++)
+                suggest_word(self, to_check[w], &checked[w]);
+            Py_END_ALLOW_THREADS;
+        }
+        for (size_t w = 0; w < to_check.size(); w++)
+            self->suggestion_cache->put(to_check[w], checked[w]);
+    } catch (const std::bad_alloc&) {
+        Py_DECREF(fast);
+        return PyErr_NoMemory();
     }
 
-    if (slist != NULL) self->handle->free_list(&slist, num_slist);
-    PyMem_Free(word);
-	return ans;
+    Py_DECREF(fast);
+    Py_RETURN_NONE;
 }
 
 static PyObject *
@@ -95,8 +323,17 @@ add(Dictionary *self, PyObject *args) {
 	char *word = NULL;
 
 	if (!PyArg_ParseTuple(args, "es", self->encoding, &word)) return NULL;
-	if (self->handle->add(word) == 0) { PyMem_Free(word); Py_RETURN_TRUE; }
+    // cached results are stale once the dictionary changes
+    self->cache->clear(); self->suggestion_cache->clear();
+    int rc;
+    Py_BEGIN_ALLOW_THREADS;
+    {
+        std::lock_guard<std::mutex> guard(*self->handle_lock);
+        rc = self->handle->add(word);
+    }
+    Py_END_ALLOW_THREADS;
     PyMem_Free(word);
+	if (rc == 0) Py_RETURN_TRUE;
     Py_RETURN_FALSE;
 }
 
@@ -105,8 +342,17 @@ remove_word(Dictionary *self, PyObject *args) {
 	char *word = NULL;
 
 	if (!PyArg_ParseTuple(args, "es", self->encoding, &word)) return NULL;
-	if (self->handle->remove(word) == 0) { PyMem_Free(word); Py_RETURN_TRUE; }
+    // cached results are stale once the dictionary changes
+    self->cache->clear(); self->suggestion_cache->clear();
+    int rc;
+    Py_BEGIN_ALLOW_THREADS;
+    {
+        std::lock_guard<std::mutex> guard(*self->handle_lock);
+        rc = self->handle->remove(word);
+    }
+    Py_END_ALLOW_THREADS;
     PyMem_Free(word);
+	if (rc == 0) Py_RETURN_TRUE;
     Py_RETURN_FALSE;
 }
 
@@ -116,11 +362,27 @@ static PyMethodDef HunSpell_methods[] = {
 	 "object. If encoding of the word to the encoding of the dictionary fails, "
 	 "a UnicodeEncodeError is raised. Returns False if the input word is not "
 	 "recognized."},
+	{"recognized_many", (PyCFunction)recognized_many, METH_VARARGS,
+	 "Check the spelling of a sequence of unicode words in one call. Words "
+	 "are deduplicated, previously checked words are answered from an "
+	 "internal cache and only the remainder queries the dictionary, with the "
+	 "GIL released. Words that cannot be encoded to the dictionary encoding "
+	 "are reported as not recognized rather than raising. Returns a tuple of "
+	 "booleans, one per input word. The dictionary search is serialized by an "
+	 "internal lock, so it is safe to call from a worker thread."},
 	{"suggest", (PyCFunction)suggest, METH_VARARGS,
 	 "Provide suggestions for the given word. The input word must be a unicode "
 	 "object. If encoding of the word to the encoding of the dictionary fails, "
-	 "a UnicodeEncodeError is raised. Returns the list of suggested words as "
-	 "unicode objects."},
+	 "a UnicodeEncodeError is raised. Results are served from an internal "
+	 "cache when possible, see suggest_many(). Returns the list of suggested "
+	 "words as unicode objects."},
+	{"suggest_many", (PyCFunction)suggest_many, METH_VARARGS,
+	 "Run the suggestion search for a sequence of unicode words, filling the "
+	 "internal suggestion cache so that later suggest() calls for the same "
+	 "words are instant. The search runs with the GIL released and the "
+	 "dictionary internally locked, so this is meant to be called from a "
+	 "worker thread while the results are consumed on another. Words that "
+	 "cannot be encoded to the dictionary encoding are skipped. Returns None."},
 	{"add", (PyCFunction)add, METH_VARARGS,
 	 "Adds the given word into the runtime dictionary"},
 	{"remove", (PyCFunction)remove_word, METH_VARARGS,
@@ -42,3 +42,38 @@ def points_for_word(w):
 
 
 points_for_word.cache = {}  # noqa
+
+
+def points_for_words(words):
+    """Returns the set of codepoints whose names contain all the given words
+    (an AND search), intersected in C without intermediate per-word sets"""
+    words = tuple(w.lower() for w in words)
+    ans = points_for_words.cache.get(words)
+    if ans is None:
+        if any(w in html_entities() for w in words):
+            # html entity matches are not in the C name data, take the slow path
+            ans = frozenset(points_for_word(words[0]))
+            for w in words[1:]:
+                ans &= points_for_word(w)
+        else:
+            ans = plugins['unicode_names'][0].codepoints_for_words([w.encode('utf-8') for w in words])
+        points_for_words.cache[words] = ans
+    return ans
+
+
+points_for_words.cache = {}  # noqa
+
+
+def points_for_prefix(prefix, limit=128):
+    """Returns a tuple of the first ``limit`` codepoints whose names contain a
+    word starting with ``prefix``, for search-as-you-type"""
+    prefix = prefix.lower()
+    key = prefix, limit
+    ans = points_for_prefix.cache.get(key)
+    if ans is None:
+        ans = plugins['unicode_names'][0].codepoints_for_prefix(prefix.encode('utf-8'), limit)
+        points_for_prefix.cache[key] = ans
+    return ans
+
+
+points_for_prefix.cache = {}  # noqa
@@ -735,6 +735,7 @@ class ZipFile:
 
         self._allowZip64 = allowZip64
         self._didModify = False
+        self._reusable_compressor = None
         self.debug = 0  # Level of printing: 0 through 3
         self.NameToInfo = {}    # Find file info given name
         self.filelist = []      # List of ZipInfo instances for archive
@@ -1193,6 +1194,24 @@ class ZipFile:
             if not self._allowZip64:
                 raise LargeZipFile("Zipfile size would require ZIP64 extensions")
 
+    def _start_deflater(self):
+        # Reuse a single raw deflate compressor for all members of this
+        # archive, resetting it in between, instead of re-initializing the
+        # deflate state once per member. EPUBs can have thousands of members.
+        if self._reusable_compressor is not None:
+            self._reusable_compressor.reset()
+            return self._reusable_compressor
+        try:
+            from calibre.constants import plugins
+            zlib2 = plugins['zlib2'][0]
+        except Exception:
+            zlib2 = None
+        if zlib2 is not None:
+            self._reusable_compressor = zlib2.compressobj(
+                    zlib2.Z_DEFAULT_COMPRESSION, zlib2.DEFLATED, -15)
+            return self._reusable_compressor
+        return zlib.compressobj(zlib.Z_DEFAULT_COMPRESSION, zlib.DEFLATED, -15)
+
     def write(self, filename, arcname=None, compress_type=None):
         """Put the bytes from filename into the archive under the name
         arcname."""
@@ -1246,8 +1265,7 @@ class ZipFile:
             zinfo.file_size = file_size = 0
             self.fp.write(zinfo.FileHeader())
             if zinfo.compress_type == ZIP_DEFLATED:
-                cmpr = zlib.compressobj(zlib.Z_DEFAULT_COMPRESSION,
-                    zlib.DEFLATED, -15)
+                cmpr = self._start_deflater()
             else:
                 cmpr = None
             while 1:
@@ -1309,8 +1327,7 @@ class ZipFile:
         if not raw_bytes:
             zinfo.CRC = crc32(byts) & 0xffffffff       # CRC-32 checksum
             if zinfo.compress_type == ZIP_DEFLATED:
-                co = zlib.compressobj(zlib.Z_DEFAULT_COMPRESSION,
-                    zlib.DEFLATED, -15)
+                co = self._start_deflater()
                 byts = co.compress(byts) + co.flush()
                 zinfo.compress_size = len(byts)    # Compressed size
             else:
@@ -7,7 +7,28 @@
 
 #define UNICODE
 #include <Python.h>
+#include <pythread.h>
 #include <zlib.h>
+#include "op_stats.h"
+
+/* Native-layer work counters, exported via get_stats() */
+enum { STAT_COMPRESS, STAT_COMPRESS_MANY, STAT_CRC32, STAT_ZIP_ADD, STAT_COUNT };
+static CalibreOpStat zlib2_op_stats[STAT_COUNT] = {
+    {"compress", 0, 0},
+    {"compress_many", 0, 0},
+    {"crc32", 0, 0},
+    {"zip_add", 0, 0},
+};
+
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
 
 #define DEF_BUF_SIZE (16*1024)
 /* The following parameters are copied from zutil.h, version 0.95 */
@@ -32,6 +53,13 @@ typedef struct
     char eof;
     int is_initialised;
     PyObject *zdict;
+    /* Initialization parameters, preserved so that reset() can re-create
+       the stream if it was ever torn down */
+    int level;
+    int method;
+    int wbits;
+    int memLevel;
+    int strategy;
 } compobject;
 
 static void
@@ -101,6 +129,8 @@ PyZlib_compressobj(PyObject *selfptr, PyObject *args)
     self = newcompobject(&Comptype);
     if (self==NULL) return NULL;
 
+    self->level = level; self->method = method; self->wbits = wbits;
+    self->memLevel = memLevel; self->strategy = strategy;
     self->zst.zalloc = (alloc_func)Z_NULL;
     self->zst.zfree = (free_func)Z_NULL;
     self->zst.next_in = Z_NULL;
@@ -155,6 +185,7 @@ Compress_compress(compobject *self, PyObject *data_obj)
     Py_buffer indata = {0};
     Byte *input = NULL;
     unsigned long start_total_out = 0;
+    unsigned long long op_start = calibre_op_now_ns();
 
 	if (PyObject_GetBuffer(data_obj, &indata, PyBUF_SIMPLE) != 0) return NULL;
     input = indata.buf; len = indata.len;
@@ -213,6 +244,7 @@ Compress_compress(compobject *self, PyObject *data_obj)
 
  done:
     if (indata.obj) PyBuffer_Release(&indata);
+    calibre_op_record(&zlib2_op_stats[STAT_COMPRESS], op_start);
     return RetVal;
 }
 
@@ -265,24 +297,18 @@ Compress_flush(compobject *self, PyObject *args)
         Py_END_ALLOW_THREADS
     }
 
-    /* If mode is Z_FINISH, we also have to call deflateEnd() to free
-       various data structures. Note we should only get Z_STREAM_END when
-       mode is Z_FINISH, but checking both for safety*/
-    if (err == Z_STREAM_END && mode == Z_FINISH) {
-        err = deflateEnd(&(self->zst));
-        if (err != Z_OK) {
-            zlib_error(self->zst, err, "while finishing compression");
-            Py_DECREF(RetVal);
-            RetVal = NULL;
-            goto error;
-        }
-        else
-            self->is_initialised = 0;
+    /* Note we should only get Z_STREAM_END when mode is Z_FINISH. The
+       deflate state is deliberately kept alive so that reset() can reuse
+       this object for another stream without paying for deflateInit2()
+       again; it is torn down in the destructor. zlib reports an error if
+       compress() is called again without an intervening reset().
 
-        /* We will only get Z_BUF_ERROR if the output buffer was full
-           but there wasn't more output when we tried again, so it is
-           not an error condition.
-        */
+       We will only get Z_BUF_ERROR if the output buffer was full
+       but there wasn't more output when we tried again, so it is
+       not an error condition.
+    */
+    if (err == Z_STREAM_END && mode == Z_FINISH) {
+        self->eof = 1;
     } else if (err!=Z_OK && err!=Z_BUF_ERROR) {
         zlib_error(self->zst, err, "while flushing");
         Py_DECREF(RetVal);
@@ -299,12 +325,136 @@ Compress_flush(compobject *self, PyObject *args)
     return RetVal;
 }
 
+static PyObject *
+Compress_reset(compobject *self)
+{
+    int err = 0;
+
+    if (self->is_initialised) {
+        /* Cheap: just rewinds the existing deflate state for a new stream */
+        err = deflateReset(&self->zst);
+    } else {
+        self->zst.zalloc = (alloc_func)Z_NULL;
+        self->zst.zfree = (free_func)Z_NULL;
+        self->zst.next_in = Z_NULL;
+        self->zst.avail_in = 0;
+        err = deflateInit2(&self->zst, self->level, self->method, self->wbits,
+                           self->memLevel, self->strategy);
+        if (err == Z_OK) self->is_initialised = 1;
+    }
+    if (err != Z_OK) {
+        zlib_error(self->zst, err, "while resetting compression object");
+        return NULL;
+    }
+    self->eof = 0;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+Compress_compress_into(compobject *self, PyObject *args)
+{
+    int err = 0;
+    Py_buffer indata = {0}, outdata = {0};
+    unsigned long start_total_out = 0;
+    PyObject *ret = NULL;
+
+    if (!PyArg_ParseTuple(args, "s*w*:compress_into", &indata, &outdata))
+        return NULL;
+
+    if ((size_t)indata.len > UINT_MAX || (size_t)outdata.len > UINT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "Size does not fit in an unsigned int");
+        goto done;
+    }
+
+    start_total_out = self->zst.total_out;
+    self->zst.avail_in = (unsigned int)indata.len;
+    self->zst.next_in = indata.buf;
+    self->zst.avail_out = (unsigned int)outdata.len;
+    self->zst.next_out = outdata.buf;
+
+    Py_BEGIN_ALLOW_THREADS
+    err = deflate(&(self->zst), Z_NO_FLUSH);
+    Py_END_ALLOW_THREADS
+
+    if (err != Z_OK && err != Z_BUF_ERROR) {
+        zlib_error(self->zst, err, "while compressing data");
+        goto done;
+    }
+    /* With Z_NO_FLUSH deflate consumes all input unless it runs out of
+       output space, there is no need to loop */
+    if (self->zst.avail_in != 0) {
+        PyErr_SetString(ZlibError, "Output buffer too small to hold the compressed data");
+        goto done;
+    }
+    ret = PyLong_FromUnsignedLong(self->zst.total_out - start_total_out);
+
+ done:
+    if (indata.obj) PyBuffer_Release(&indata);
+    if (outdata.obj) PyBuffer_Release(&outdata);
+    return ret;
+}
+
+static PyObject *
+Compress_flush_into(compobject *self, PyObject *args)
+{
+    int err = 0, mode = Z_FINISH;
+    Py_buffer outdata = {0};
+    unsigned long start_total_out = 0;
+    PyObject *ret = NULL;
+
+    if (!PyArg_ParseTuple(args, "w*|i:flush_into", &outdata, &mode))
+        return NULL;
+
+    if ((size_t)outdata.len > UINT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "Size does not fit in an unsigned int");
+        goto done;
+    }
+    if (mode == Z_NO_FLUSH) {
+        ret = PyLong_FromUnsignedLong(0);
+        goto done;
+    }
+
+    start_total_out = self->zst.total_out;
+    self->zst.avail_in = 0;
+    self->zst.avail_out = (unsigned int)outdata.len;
+    self->zst.next_out = outdata.buf;
+
+    Py_BEGIN_ALLOW_THREADS
+    err = deflate(&(self->zst), mode);
+    Py_END_ALLOW_THREADS
+
+    if (err != Z_OK && err != Z_BUF_ERROR && err != Z_STREAM_END) {
+        zlib_error(self->zst, err, "while flushing");
+        goto done;
+    }
+    /* Z_STREAM_END proves a Z_FINISH flush completed even if it exactly
+       filled the buffer; for other modes a full buffer may mean truncation */
+    if ((mode == Z_FINISH) ? (err != Z_STREAM_END) : (self->zst.avail_out == 0)) {
+        PyErr_SetString(ZlibError, "Output buffer too small to hold the flushed data");
+        goto done;
+    }
+    /* As in flush(), the deflate state is kept alive after Z_FINISH so
+       that reset() can reuse it for the next stream */
+    if (mode == Z_FINISH) self->eof = 1;
+    ret = PyLong_FromUnsignedLong(self->zst.total_out - start_total_out);
+
+ done:
+    if (outdata.obj) PyBuffer_Release(&outdata);
+    return ret;
+}
+
 static PyMethodDef comp_methods[] =
 {
     {"compress", (PyCFunction)Compress_compress, METH_O, "compress(data) -- returns compressed data, dont forget to call flush when done."},
 
     {"flush", (PyCFunction)Compress_flush, METH_VARARGS, "flush([mode]) -- returns any remaining data"},
 
+    {"reset", (PyCFunction)Compress_reset, METH_NOARGS, "reset() -- reuse this object for a new stream, much cheaper than creating a new compression object"},
+
+    {"compress_into", (PyCFunction)Compress_compress_into, METH_VARARGS, "compress_into(data, buf) -- compress data into the writable buffer buf, returning the number of bytes written. Raises zlib2.error if buf is too small to hold all the compressed data."},
+
+    {"flush_into", (PyCFunction)Compress_flush_into, METH_VARARGS, "flush_into(buf, [mode]) -- like flush(), but writing into the writable buffer buf, returning the number of bytes written. Raises zlib2.error if buf is too small."},
+
     {NULL}
 };
 
@@ -340,14 +490,171 @@ static PyTypeObject Comptype = {
 };
 
 
+/* Hardware accelerated crc32 {{{
+ *
+ * Folds the buffer with PCLMULQDQ carry-less multiplies over the zlib
+ * polynomial, finishing with a Barrett reduction, as described in the Intel
+ * paper "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction". Selected at runtime, everything else falls back to the
+ * generic table implementation in zlib.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAS_CRC32_PCLMUL 1
+#include <stdint.h>
+#include <immintrin.h>
+
+__attribute__((target("sse4.1,pclmul")))
+static uint32_t
+crc32_pclmul(const unsigned char *buf, size_t len, uint32_t crc)
+{
+    /* The bit-reflected domain constants k1-k5 and the Barrett polynomials
+       for the zlib (gzip, 0x04C11DB7) polynomial. len must be >= 64 and a
+       multiple of 16. */
+    static const uint64_t __attribute__((aligned(16))) k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t __attribute__((aligned(16))) k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t __attribute__((aligned(16))) k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t __attribute__((aligned(16))) poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+
+    buf += 64;
+    len -= 64;
+
+    /* Fold in parallel, four 16 byte lanes at a time */
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+
+        x1 = _mm_xor_si128(x1, x5);
+        x2 = _mm_xor_si128(x2, x6);
+        x3 = _mm_xor_si128(x3, x7);
+        x4 = _mm_xor_si128(x4, x8);
+
+        x1 = _mm_xor_si128(x1, y5);
+        x2 = _mm_xor_si128(x2, y6);
+        x3 = _mm_xor_si128(x3, y7);
+        x4 = _mm_xor_si128(x4, y8);
+
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold the four lanes into one */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(x1, x2);
+    x1 = _mm_xor_si128(x1, x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(x1, x3);
+    x1 = _mm_xor_si128(x1, x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(x1, x4);
+    x1 = _mm_xor_si128(x1, x5);
+
+    /* Remaining 16 byte blocks */
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(x1, x2);
+        x1 = _mm_xor_si128(x1, x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    /* Fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduce to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return _mm_extract_epi32(x1, 1);
+}
+#endif
+
+static uLong
+crc32_fast(uLong value, const Byte *buf, size_t len)
+{
+#ifdef HAS_CRC32_PCLMUL
+    static int has_pclmul = -1;
+    if (has_pclmul == -1)
+        has_pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    if (has_pclmul && len >= 64) {
+        /* The folding loop needs a multiple of 16 bytes, at least 64; the
+           tail goes through zlib below */
+        size_t chunk = len & ~((size_t)15);
+        value = ~(uLong)crc32_pclmul(buf, chunk, ~(uint32_t)value) & 0xffffffffUL;
+        buf += chunk;
+        len -= chunk;
+        if (len == 0) return value;
+    }
+#endif
+    /* Avoid truncation of length for very large buffers. crc32() takes
+       length as an unsigned int, which may be narrower than size_t. */
+    while (len > UINT_MAX) {
+        value = crc32(value, buf, UINT_MAX);
+        buf += (size_t) UINT_MAX;
+        len -= (size_t) UINT_MAX;
+    }
+    return crc32(value, buf, (unsigned int)len);
+}
+/* }}} */
+
 static PyObject *
 zlib_crc32(PyObject *self, PyObject *args)
 {
-    int signed_val = 0, len = 0;
 	unsigned int value = 0;
+	unsigned long result = 0;
 	unsigned char *buf = NULL;
+    Py_ssize_t len = 0;
     Py_buffer indata = {0};
     PyObject* obj = NULL;
+    unsigned long long op_start = calibre_op_now_ns();
 
 	if(!PyArg_ParseTuple(args, "O|I:crc32", &obj, &value)) return NULL;
 	if (PyObject_GetBuffer(obj, &indata, PyBUF_SIMPLE) != 0) return NULL;
@@ -357,20 +664,527 @@ zlib_crc32(PyObject *self, PyObject *args)
        and may lower performance */
     if (len > 1024*5) {
         Py_BEGIN_ALLOW_THREADS
-        /* Avoid truncation of length for very large buffers. crc32() takes
-           length as an unsigned int, which may be narrower than Py_ssize_t. */
-        while ((size_t)len > UINT_MAX) {
-            value = crc32(value, buf, UINT_MAX);
-            buf += (size_t) UINT_MAX;
-            len -= (size_t) UINT_MAX;
-        }
-        signed_val = crc32(value, buf, (unsigned int)len);
+        result = crc32_fast(value, buf, (size_t)len);
         Py_END_ALLOW_THREADS
     } else {
-        signed_val = crc32(value, buf, len);
+        result = crc32_fast(value, buf, (size_t)len);
     }
     if (indata.obj) PyBuffer_Release(&indata);
-    return PyLong_FromUnsignedLong(signed_val & 0xffffffffU);
+    calibre_op_record(&zlib2_op_stats[STAT_CRC32], op_start);
+    return PyLong_FromUnsignedLong(result & 0xffffffffU);
+}
+
+/* Parallel compression of independent blobs {{{
+ *
+ * Zip members are compressed independently, so they can be deflated on a
+ * pool of threads with the GIL released, one raw deflate stream per blob.
+ * Workers use only malloc/free and zlib, never the Python C-API.
+ */
+
+typedef struct {
+    const Byte *in;
+    unsigned int inlen;
+    int level;
+    Byte *out;
+    unsigned long outlen;
+    unsigned long crc;
+    int error;  /* 0: ok, 1: out of memory, 2: zlib error */
+} compress_task;
+
+typedef struct {
+    compress_task *tasks;
+    Py_ssize_t count;
+    Py_ssize_t next;
+    int active_workers;
+    PyThread_type_lock mutex;
+    PyThread_type_lock done;
+} compress_queue;
+
+static void
+compress_one(compress_task *t) {
+    z_stream zst;
+    int err;
+
+    memset(&zst, 0, sizeof(zst));
+    zst.zalloc = (alloc_func)Z_NULL;
+    zst.zfree = (free_func)Z_NULL;
+    err = deflateInit2(&zst, t->level, DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+                       Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) { t->error = (err == Z_MEM_ERROR) ? 1 : 2; return; }
+    t->out = (Byte*)malloc(deflateBound(&zst, t->inlen));
+    if (t->out == NULL) { deflateEnd(&zst); t->error = 1; return; }
+
+    zst.next_in = (Byte*)t->in;
+    zst.avail_in = t->inlen;
+    zst.next_out = t->out;
+    /* deflateBound() guarantees the output fits, so a single Z_FINISH
+       call must return Z_STREAM_END */
+    zst.avail_out = (unsigned int)deflateBound(&zst, t->inlen);
+    err = deflate(&zst, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        deflateEnd(&zst);
+        free(t->out); t->out = NULL;
+        t->error = 2;
+        return;
+    }
+    t->outlen = zst.total_out;
+    deflateEnd(&zst);
+    t->crc = crc32_fast(0, t->in, t->inlen);
+}
+
+static void
+compress_many_worker(void *arg) {
+    compress_queue *queue = (compress_queue*)arg;
+    Py_ssize_t i;
+    int last;
+
+    while (1) {
+        PyThread_acquire_lock(queue->mutex, 1);
+        i = queue->next;
+        if (i < queue->count) queue->next++;
+        PyThread_release_lock(queue->mutex);
+        if (i >= queue->count) break;
+        compress_one(queue->tasks + i);
+    }
+
+    PyThread_acquire_lock(queue->mutex, 1);
+    last = (--queue->active_workers == 0);
+    PyThread_release_lock(queue->mutex);
+    /* The queue must not be touched after signalling done */
+    if (last) PyThread_release_lock(queue->done);
+}
+
+static PyObject *
+zlib_compress_many(PyObject *self, PyObject *args)
+{
+    PyObject *items = NULL, *item = NULL, *ans = NULL, *temp = NULL;
+    Py_buffer *views = NULL;
+    compress_queue queue = {0};
+    Py_ssize_t i, count, nviews = 0;
+    int threads = 1, level, spawned;
+    unsigned long long op_start = calibre_op_now_ns();
+
+    if (!PyArg_ParseTuple(args, "O|i:compress_many", &items, &threads)) return NULL;
+    items = PySequence_Fast(items, "compress_many() expects a sequence of (data, level) tuples");
+    if (items == NULL) return NULL;
+    count = PySequence_Fast_GET_SIZE(items);
+    if (count == 0) { Py_DECREF(items); return PyList_New(0); }
+
+    views = (Py_buffer*)calloc(count, sizeof(Py_buffer));
+    queue.tasks = (compress_task*)calloc(count, sizeof(compress_task));
+    if (views == NULL || queue.tasks == NULL) { PyErr_NoMemory(); goto done; }
+    queue.count = count;
+
+    for (i = 0; i < count; i++) {
+        item = PySequence_Fast_GET_ITEM(items, i);
+        if (!PyTuple_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "compress_many() expects a sequence of (data, level) tuples");
+            goto done;
+        }
+        if (!PyArg_ParseTuple(item, "s*i", views + i, &level)) goto done;
+        nviews++;
+        if ((size_t)views[i].len > UINT_MAX) {
+            PyErr_SetString(PyExc_OverflowError, "Size does not fit in an unsigned int");
+            goto done;
+        }
+        queue.tasks[i].in = views[i].buf;
+        queue.tasks[i].inlen = (unsigned int)views[i].len;
+        queue.tasks[i].level = level;
+    }
+
+    if (threads < 1) threads = 1;
+    if ((Py_ssize_t)threads > count) threads = (int)count;
+
+    queue.mutex = PyThread_allocate_lock();
+    queue.done = PyThread_allocate_lock();
+    if (queue.mutex == NULL || queue.done == NULL) { PyErr_NoMemory(); goto done; }
+    /* The calling thread is a worker too */
+    queue.active_workers = 1;
+    PyThread_acquire_lock(queue.done, 1);
+    for (spawned = 1; spawned < threads; spawned++) {
+        PyThread_acquire_lock(queue.mutex, 1);
+        queue.active_workers++;
+        PyThread_release_lock(queue.mutex);
+        if (PyThread_start_new_thread(compress_many_worker, &queue) == -1) {
+            PyThread_acquire_lock(queue.mutex, 1);
+            queue.active_workers--;
+            PyThread_release_lock(queue.mutex);
+            break;
+        }
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    compress_many_worker(&queue);
+    /* Wait for the other workers to drain the queue */
+    PyThread_acquire_lock(queue.done, 1);
+    PyThread_release_lock(queue.done);
+    Py_END_ALLOW_THREADS
+
+    for (i = 0; i < count; i++) {
+        if (queue.tasks[i].error == 1) { PyErr_NoMemory(); goto done; }
+        if (queue.tasks[i].error == 2) {
+            PyErr_Format(ZlibError, "Error while compressing item %zd", i);
+            goto done;
+        }
+    }
+
+    ans = PyList_New(count);
+    if (ans == NULL) goto done;
+    for (i = 0; i < count; i++) {
+        temp = Py_BuildValue("(NN)",
+            PyBytes_FromStringAndSize((const char*)queue.tasks[i].out, queue.tasks[i].outlen),
+            PyLong_FromUnsignedLong(queue.tasks[i].crc & 0xffffffffU));
+        if (temp == NULL) { Py_CLEAR(ans); goto done; }
+        PyList_SET_ITEM(ans, i, temp); temp = NULL;
+    }
+
+ done:
+    if (queue.mutex != NULL) PyThread_free_lock(queue.mutex);
+    if (queue.done != NULL) PyThread_free_lock(queue.done);
+    if (queue.tasks != NULL) {
+        for (i = 0; i < count; i++) free(queue.tasks[i].out);
+        free(queue.tasks);
+    }
+    if (views != NULL) {
+        for (i = 0; i < nviews; i++) PyBuffer_Release(views + i);
+        free(views);
+    }
+    Py_DECREF(items);
+    calibre_op_record(&zlib2_op_stats[STAT_COMPRESS_MANY], op_start);
+    return ans;
+}
+/* }}} */
+
+/* Streaming zip writer {{{
+ *
+ * Writes a zip archive member by member straight to a file descriptor:
+ * one deflate state reused across members via deflateReset(), crc32
+ * computed in C while the data is hot in cache, and the local header,
+ * file name and compressed data handed to the kernel in a single
+ * writev() call. The central directory is accumulated in memory and
+ * written by close(). Large enough for any EPUB; zip64 archives (more
+ * than 4GB or 65535 members) are not supported.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    int fd;
+    int level;
+    int closed;
+    z_stream zst;
+    int is_initialised;
+    unsigned long long offset;  /* current position in the output file */
+    unsigned long count;        /* number of members written */
+    Byte *cd;                   /* central directory under construction */
+    size_t cd_used, cd_capacity;
+    Byte *outbuf;               /* reusable deflate output buffer */
+    size_t outbuf_capacity;
+} zipwriter;
+
+static PyTypeObject ZipWritertype;
+
+static void put16(Byte *p, unsigned int v) { p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; }
+static void put32(Byte *p, unsigned long v) { p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; p[2] = (v >> 16) & 0xff; p[3] = (v >> 24) & 0xff; }
+
+static void
+dos_time(unsigned long unix_time, unsigned int *dtime, unsigned int *ddate) {
+    time_t t = (time_t)unix_time;
+    struct tm tmbuf;
+#ifdef _WIN32
+    struct tm *tm = localtime(&t);
+    if (tm != NULL) tmbuf = *tm; else tm = NULL;
+#else
+    struct tm *tm = localtime_r(&t, &tmbuf);
+#endif
+    if (tm == NULL || tmbuf.tm_year < 80) { *dtime = 0; *ddate = 0x21; return; }  /* 1980-01-01 */
+    *dtime = (tmbuf.tm_hour << 11) | (tmbuf.tm_min << 5) | (tmbuf.tm_sec >> 1);
+    *ddate = ((tmbuf.tm_year - 80) << 9) | ((tmbuf.tm_mon + 1) << 5) | tmbuf.tm_mday;
+}
+
+typedef struct { const Byte *base; size_t len; } zipvec;
+
+/* Returns 0 on success, -1 with errno set. Must be called without the GIL. */
+static int
+write_vectors(int fd, zipvec *vecs, int count) {
+#ifdef _WIN32
+    int i;
+    for (i = 0; i < count; i++) {
+        const Byte *p = vecs[i].base;
+        size_t left = vecs[i].len;
+        while (left > 0) {
+            int n = _write(fd, p, (unsigned int)((left > INT_MAX) ? INT_MAX : left));
+            if (n < 0) return -1;
+            p += n; left -= (size_t)n;
+        }
+    }
+#else
+    struct iovec iov[4];
+    int i, first = 0;
+    for (i = 0; i < count; i++) { iov[i].iov_base = (void*)vecs[i].base; iov[i].iov_len = vecs[i].len; }
+    while (first < count) {
+        ssize_t n = writev(fd, iov + first, count - first);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        while (first < count && (size_t)n >= iov[first].iov_len) { n -= (ssize_t)iov[first].iov_len; first++; }
+        if (first < count) {
+            iov[first].iov_base = (Byte*)iov[first].iov_base + n;
+            iov[first].iov_len -= (size_t)n;
+        }
+    }
+#endif
+    return 0;
+}
+
+static void
+ZipWriter_dealloc(zipwriter *self)
+{
+    if (self->is_initialised) deflateEnd(&self->zst);
+    free(self->cd); self->cd = NULL;
+    free(self->outbuf); self->outbuf = NULL;
+    PyObject_Del(self);
+}
+
+static PyObject *
+ZipWriter_add(zipwriter *self, PyObject *args)
+{
+    PyObject *nameobj = NULL, *namebytes = NULL;
+    Py_buffer data = {0};
+    unsigned long mtime = 0, crc = 0, bound = 0, csize = 0;
+    unsigned int inplen, flags = 0, method = 8, dtime, ddate;
+    int err = Z_OK, write_failed = 0;
+    Py_ssize_t namelen, i;
+    const Byte *name, *payload;
+    Byte header[30], *cdent;
+    zipvec vecs[3];
+    unsigned long long op_start = calibre_op_now_ns();
+
+    if (!PyArg_ParseTuple(args, "Os*|k:add", &nameobj, &data, &mtime)) return NULL;
+    if (self->closed) { PyErr_SetString(ZlibError, "This zip writer has already been closed"); goto done; }
+    if ((size_t)data.len > UINT_MAX) { PyErr_SetString(PyExc_OverflowError, "Size does not fit in an unsigned int"); goto done; }
+    inplen = (unsigned int)data.len;
+
+    if (PyUnicode_Check(nameobj)) namebytes = PyUnicode_AsUTF8String(nameobj);
+    else if (PyBytes_Check(nameobj)) { namebytes = nameobj; Py_INCREF(namebytes); }
+    else PyErr_SetString(PyExc_TypeError, "The name must be a unicode or bytes object");
+    if (namebytes == NULL) goto done;
+    name = (const Byte*)PyBytes_AS_STRING(namebytes);
+    namelen = PyBytes_GET_SIZE(namebytes);
+    if (namelen > 0xffff) { PyErr_SetString(ZlibError, "File name too long for the zip format"); goto done; }
+    for (i = 0; i < namelen; i++) {
+        if (name[i] > 0x7f) { flags |= 0x800; break; }  /* UTF-8 name */
+    }
+
+    bound = deflateBound(&self->zst, inplen);
+    if (bound > self->outbuf_capacity) {
+        Byte *nout = (Byte*)realloc(self->outbuf, bound);
+        if (nout == NULL) { PyErr_NoMemory(); goto done; }
+        self->outbuf = nout; self->outbuf_capacity = bound;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    crc = crc32_fast(0, (const Byte*)data.buf, (size_t)inplen);
+    err = deflateReset(&self->zst);
+    if (err == Z_OK) {
+        self->zst.next_in = (Byte*)data.buf;
+        self->zst.avail_in = inplen;
+        self->zst.next_out = self->outbuf;
+        /* deflateBound() guarantees the output fits, so a single Z_FINISH
+           call must return Z_STREAM_END */
+        self->zst.avail_out = (unsigned int)bound;
+        err = deflate(&self->zst, Z_FINISH);
+    }
+    Py_END_ALLOW_THREADS
+    if (err != Z_STREAM_END) { zlib_error(self->zst, err, "while compressing zip member"); goto done; }
+
+    csize = self->zst.total_out;
+    payload = self->outbuf;
+    if (csize >= inplen) {
+        /* Deflate grew the data (already compressed member), store it */
+        method = 0; csize = inplen; payload = (const Byte*)data.buf;
+    }
+    if (self->offset + 30 + (unsigned long long)namelen + csize > 0xffffffffULL || self->count >= 0xffff) {
+        PyErr_SetString(ZlibError, "Archive too large, zip64 is not supported"); goto done;
+    }
+
+    if (self->cd_used + 46 + (size_t)namelen > self->cd_capacity) {
+        size_t ncap = self->cd_capacity ? self->cd_capacity : 8192;
+        Byte *ncd = NULL;
+        while (self->cd_used + 46 + (size_t)namelen > ncap) ncap *= 2;
+        ncd = (Byte*)realloc(self->cd, ncap);
+        if (ncd == NULL) { PyErr_NoMemory(); goto done; }
+        self->cd = ncd; self->cd_capacity = ncap;
+    }
+
+    dos_time(mtime ? mtime : (unsigned long)time(NULL), &dtime, &ddate);
+
+    put32(header, 0x04034b50UL);      /* local file header signature */
+    put16(header + 4, 20);            /* version needed to extract */
+    put16(header + 6, flags);
+    put16(header + 8, method);
+    put16(header + 10, dtime);
+    put16(header + 12, ddate);
+    put32(header + 14, crc);
+    put32(header + 18, csize);
+    put32(header + 22, inplen);
+    put16(header + 26, (unsigned int)namelen);
+    put16(header + 28, 0);            /* extra field length */
+    vecs[0].base = header; vecs[0].len = 30;
+    vecs[1].base = name; vecs[1].len = (size_t)namelen;
+    vecs[2].base = payload; vecs[2].len = (size_t)csize;
+    Py_BEGIN_ALLOW_THREADS
+    write_failed = write_vectors(self->fd, vecs, 3);
+    Py_END_ALLOW_THREADS
+    if (write_failed) { PyErr_SetFromErrno(PyExc_OSError); goto done; }
+
+    cdent = self->cd + self->cd_used;
+    put32(cdent, 0x02014b50UL);       /* central directory header signature */
+    put16(cdent + 4, 20);             /* version made by */
+    put16(cdent + 6, 20);             /* version needed to extract */
+    put16(cdent + 8, flags);
+    put16(cdent + 10, method);
+    put16(cdent + 12, dtime);
+    put16(cdent + 14, ddate);
+    put32(cdent + 16, crc);
+    put32(cdent + 20, csize);
+    put32(cdent + 24, inplen);
+    put16(cdent + 28, (unsigned int)namelen);
+    put16(cdent + 30, 0);             /* extra field length */
+    put16(cdent + 32, 0);             /* file comment length */
+    put16(cdent + 34, 0);             /* disk number start */
+    put16(cdent + 36, 0);             /* internal file attributes */
+    put32(cdent + 38, 0);             /* external file attributes */
+    put32(cdent + 42, (unsigned long)self->offset);  /* local header offset */
+    memcpy(cdent + 46, name, (size_t)namelen);
+    self->cd_used += 46 + (size_t)namelen;
+
+    self->offset += 30 + (unsigned long long)namelen + csize;
+    self->count++;
+
+done:
+    Py_XDECREF(namebytes);
+    if (data.obj) PyBuffer_Release(&data);
+    calibre_op_record(&zlib2_op_stats[STAT_ZIP_ADD], op_start);
+    if (PyErr_Occurred()) return NULL;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+ZipWriter_close(zipwriter *self, PyObject *args)
+{
+    Byte eocd[22];
+    zipvec vecs[2];
+    int write_failed = 0;
+
+    if (self->closed) Py_RETURN_NONE;
+    if (self->offset + self->cd_used + 22 > 0xffffffffULL) {
+        PyErr_SetString(ZlibError, "Archive too large, zip64 is not supported");
+        return NULL;
+    }
+    put32(eocd, 0x06054b50UL);        /* end of central directory signature */
+    put16(eocd + 4, 0);               /* this disk */
+    put16(eocd + 6, 0);               /* disk with the central directory */
+    put16(eocd + 8, (unsigned int)self->count);
+    put16(eocd + 10, (unsigned int)self->count);
+    put32(eocd + 12, (unsigned long)self->cd_used);
+    put32(eocd + 16, (unsigned long)self->offset);
+    put16(eocd + 20, 0);              /* comment length */
+
+    if (self->cd_used) {
+        vecs[0].base = self->cd; vecs[0].len = self->cd_used;
+        vecs[1].base = eocd; vecs[1].len = 22;
+    } else {
+        /* No members: only the end of central directory record is needed */
+        vecs[0].base = eocd; vecs[0].len = 22;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    write_failed = write_vectors(self->fd, vecs, self->cd_used ? 2 : 1);
+    Py_END_ALLOW_THREADS
+    if (write_failed) { PyErr_SetFromErrno(PyExc_OSError); return NULL; }
+    /* The caller owns the file descriptor and closes it itself */
+    self->closed = 1;
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef zipwriter_methods[] =
+{
+    {"add", (PyCFunction)ZipWriter_add, METH_VARARGS, "add(name, data, mtime=now) -- deflate data (any buffer object) and write it as the zip member name (unicode, stored UTF-8 encoded) with a single vectored write. Members that deflate would grow are stored uncompressed. mtime is a unix timestamp used for the member's modification time."},
+
+    {"close", (PyCFunction)ZipWriter_close, METH_NOARGS, "close() -- write the central directory, finishing the archive. The file descriptor is not closed, it belongs to the caller."},
+
+    {NULL}
+};
+
+static PyTypeObject ZipWritertype = {
+    PyVarObject_HEAD_INIT(0, 0)
+    "zlib2.ZipWriter",
+    sizeof(zipwriter),
+    0,
+    (destructor)ZipWriter_dealloc,  /*tp_dealloc*/
+    0,                              /*tp_print*/
+    0,                              /*tp_getattr*/
+    0,                              /*tp_setattr*/
+    0,                              /*tp_reserved*/
+    0,                              /*tp_repr*/
+    0,                              /*tp_as_number*/
+    0,                              /*tp_as_sequence*/
+    0,                              /*tp_as_mapping*/
+    0,                              /*tp_hash*/
+    0,                              /*tp_call*/
+    0,                              /*tp_str*/
+    0,                              /*tp_getattro*/
+    0,                              /*tp_setattro*/
+    0,                              /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,             /*tp_flags*/
+    0,                              /*tp_doc*/
+    0,                              /*tp_traverse*/
+    0,                              /*tp_clear*/
+    0,                              /*tp_richcompare*/
+    0,                              /*tp_weaklistoffset*/
+    0,                              /*tp_iter*/
+    0,                              /*tp_iternext*/
+    zipwriter_methods,              /*tp_methods*/
+};
+
+static PyObject *
+PyZlib_zip_writer(PyObject *selfptr, PyObject *args)
+{
+    zipwriter *self = NULL;
+    int fd, level = Z_DEFAULT_COMPRESSION, err;
+
+    if (!PyArg_ParseTuple(args, "i|i:zip_writer", &fd, &level)) return NULL;
+    self = PyObject_New(zipwriter, &ZipWritertype);
+    if (self == NULL) return NULL;
+    self->fd = fd; self->level = level; self->closed = 0;
+    self->is_initialised = 0;
+    self->offset = 0; self->count = 0;
+    self->cd = NULL; self->cd_used = 0; self->cd_capacity = 0;
+    self->outbuf = NULL; self->outbuf_capacity = 0;
+    memset(&self->zst, 0, sizeof(self->zst));
+    self->zst.zalloc = (alloc_func)Z_NULL;
+    self->zst.zfree = (free_func)Z_NULL;
+    /* Raw deflate streams, the zip headers are written here */
+    err = deflateInit2(&self->zst, level, DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (err != Z_OK) {
+        zlib_error(self->zst, err, "while creating zip writer");
+        Py_DECREF(self);
+        return NULL;
+    }
+    self->is_initialised = 1;
+    return (PyObject*)self;
+}
+/* }}} */
+
+static PyObject *
+zlib2_get_stats(PyObject *self, PyObject *args) {
+    return calibre_op_stats_to_dict(zlib2_op_stats, STAT_COUNT);
+}
+
+static PyObject *
+zlib2_reset_stats(PyObject *self, PyObject *args) {
+    calibre_op_stats_reset(zlib2_op_stats, STAT_COUNT);
+    Py_RETURN_NONE;
 }
 
 static PyMethodDef methods[] = {
@@ -379,6 +1193,21 @@ static PyMethodDef methods[] = {
 	},
     {"compressobj", (PyCFunction)PyZlib_compressobj, METH_VARARGS, "Create compression object"},
 
+    {"compress_many", zlib_compress_many, METH_VARARGS,
+        "compress_many([(data, level), ...], threads=1)\n\nDeflate independent blobs on a pool of threads with the GIL released, one raw deflate stream (wbits=-MAX_WBITS) per blob, as used for zip archive members. Returns a list of (compressed, crc32) in input order."
+    },
+
+    {"zip_writer", PyZlib_zip_writer, METH_VARARGS,
+        "zip_writer(fd, level=6)\n\nCreate a streaming zip writer that writes directly to the file descriptor fd. Members are deflated with a single reused zlib state, their crc32 computed inline, and each member written with one vectored write. zip64 archives are not supported. The fd belongs to the caller and is not closed by close()."
+    },
+
+    {"get_stats", zlib2_get_stats, METH_NOARGS,
+        "get_stats()\n\nThe per-operation native work counters as a dict of name to (calls, total_ns)."
+    },
+
+    {"reset_stats", zlib2_reset_stats, METH_NOARGS,
+        "reset_stats()\n\nZero the per-operation native work counters."
+    },
 
     {NULL, NULL, 0, NULL}
 };
@@ -389,6 +1218,8 @@ initzlib2(void) {
     Comptype.tp_new = PyType_GenericNew;
     if (PyType_Ready(&Comptype) < 0)
         return;
+    if (PyType_Ready(&ZipWritertype) < 0)
+        return;
 
     m = Py_InitModule3("zlib2", methods,
     "Implementation of zlib compression with support for the buffer protocol, which is missing in Python2. Code taken from the Python3 zlib module"
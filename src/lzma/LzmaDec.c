@@ -476,9 +476,33 @@ static int MY_FAST_CALL LzmaDec_DecodeReal(CLzmaDec *p, SizeT limit, const Byte
           ptrdiff_t src = (ptrdiff_t)pos - (ptrdiff_t)dicPos;
           const Byte *lim = dest + curLen;
           dicPos += curLen;
-          do
-            *(dest) = (Byte)*(dest + src);
-          while (++dest != lim);
+          if (src <= -16 || src >= 16)
+          {
+            /* source and destination are at least 16 bytes apart, so
+               16-byte chunks can be copied without the chunks overlapping;
+               the remaining (curLen & 15) bytes use the byte loop below */
+            while (lim - dest >= 16)
+            {
+              memcpy(dest, dest + src, 16);
+              dest += 16;
+            }
+            while (dest != lim)
+            {
+              *(dest) = (Byte)*(dest + src);
+              dest++;
+            }
+          }
+          else if (src == -1)
+          {
+            /* rep-match with distance 1 is a run of a single byte */
+            memset(dest, dest[-1], curLen);
+          }
+          else
+          {
+            do
+              *(dest) = (Byte)*(dest + src);
+            while (++dest != lim);
+          }
         }
         else
         {
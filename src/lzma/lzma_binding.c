@@ -8,6 +8,7 @@
 #define PY_SSIZE_T_CLEAN
 #define UNICODE
 #include "Python.h"
+#include <pythread.h>
 #include "Lzma2Dec.h"
 #include "Lzma2Enc.h"
 #define UNUSED_VAR(x) (void)x;
@@ -15,6 +16,11 @@
 static void *Alloc(void *p, size_t size) { UNUSED_VAR(p); return PyMem_Malloc(size); }
 static void Free(void *p, void *address) { UNUSED_VAR(p); PyMem_Free(address); }
 static ISzAlloc allocator = { Alloc, Free };
+// Used by the worker threads of the parallel compressor, which run without
+// the GIL and so cannot use the PyMem allocator
+static void *AllocRaw(void *p, size_t size) { UNUSED_VAR(p); return malloc(size); }
+static void FreeRaw(void *p, void *address) { UNUSED_VAR(p); free(address); }
+static ISzAlloc raw_allocator = { AllocRaw, FreeRaw };
 static const char* error_codes[18] = {
     "OK",
     "SZ_ERROR_DATA",
@@ -56,7 +62,7 @@ typedef struct {
 static PyObject *LZMAError = NULL;
 
 // Utils {{{
-static UInt64 crc64_table[256];
+static UInt64 crc64_table[8][256];
 
 #if PY_MAJOR_VERSION >= 3
     #define BYTES_FMT "y#"
@@ -64,6 +70,14 @@ static UInt64 crc64_table[256];
     #define BYTES_FMT "s#"
 #endif
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || \
+        (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))))
+#define CRC64_HAS_CLMUL 1
+#include <emmintrin.h>
+#include <wmmintrin.h>
+static int crc64_have_clmul = 0;
+#endif
+
 static void init_crc_table() {
     static const UInt64 poly64 = (UInt64)(0xC96C5795D7870F42);
     size_t i, j;
@@ -75,43 +89,434 @@ static void init_crc_table() {
             else
                 crc64 >>= 1;
         }
-        crc64_table[i] = crc64;
+        crc64_table[0][i] = crc64;
+    }
+    // The extra tables for the slice-by-8 kernel: table[j][i] is the CRC of
+    // byte i followed by j zero bytes
+    for (j = 1; j < 8; ++j) {
+        for (i = 0; i < 256; ++i)
+            crc64_table[j][i] = crc64_table[0][crc64_table[j-1][i] & 0xFF] ^ (crc64_table[j-1][i] >> 8);
+    }
+#ifdef CRC64_HAS_CLMUL
+    crc64_have_clmul = __builtin_cpu_supports("pclmul");
+#endif
+}
+
+// Process eight bytes per table lookup round instead of one. crc is the
+// running (already inverted) CRC state.
+static UInt64
+crc64_slice8(const unsigned char *data, size_t size, UInt64 crc) {
+    UInt64 block;
+    while (size && ((uintptr_t)data & 7)) {
+        crc = crc64_table[0][*data++ ^ (crc & 0xFF)] ^ (crc >> 8);
+        size--;
     }
+#define CRC64_ROUND \
+        block = crc ^ ((UInt64)data[0] | ((UInt64)data[1] << 8) | ((UInt64)data[2] << 16) | ((UInt64)data[3] << 24) | \
+            ((UInt64)data[4] << 32) | ((UInt64)data[5] << 40) | ((UInt64)data[6] << 48) | ((UInt64)data[7] << 56)); \
+        crc = crc64_table[7][block & 0xFF]         ^ crc64_table[6][(block >> 8) & 0xFF]  ^ \
+              crc64_table[5][(block >> 16) & 0xFF] ^ crc64_table[4][(block >> 24) & 0xFF] ^ \
+              crc64_table[3][(block >> 32) & 0xFF] ^ crc64_table[2][(block >> 40) & 0xFF] ^ \
+              crc64_table[1][(block >> 48) & 0xFF] ^ crc64_table[0][(block >> 56) & 0xFF]; \
+        data += 8;
+    while (size >= 64) {
+        CRC64_ROUND; CRC64_ROUND; CRC64_ROUND; CRC64_ROUND;
+        CRC64_ROUND; CRC64_ROUND; CRC64_ROUND; CRC64_ROUND;
+        size -= 64;
+    }
+    while (size >= 8) { CRC64_ROUND; size -= 8; }
+#undef CRC64_ROUND
+    while (size--) crc = crc64_table[0][*data++ ^ (crc & 0xFF)] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC64_HAS_CLMUL
+// Carry-less multiplication kernel: fold 64 bytes per iteration across four
+// 128 bit lanes. The fold constants are x^575 and x^511 reduced modulo the
+// CRC-64 polynomial, bit-reflected to match the table driven kernels. The
+// final four lanes are handed off to the table kernel, which keeps the
+// reduction step out of the hot path and shares the tail handling.
+__attribute__((target("pclmul,sse2")))
+static UInt64
+crc64_clmul(const unsigned char *data, size_t size, UInt64 crc) {
+    const __m128i fold = _mm_set_epi64x((long long)0x081F6054A7842DF4ULL, (long long)0x6AE3EFBB9DD441F3ULL);
+    __m128i x0, x1, x2, x3;
+    unsigned char lanes[64];
+    x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(data)), _mm_set_epi64x(0, (long long)crc));
+    x1 = _mm_loadu_si128((const __m128i*)(data + 16));
+    x2 = _mm_loadu_si128((const __m128i*)(data + 32));
+    x3 = _mm_loadu_si128((const __m128i*)(data + 48));
+    data += 64; size -= 64;
+    while (size >= 64) {
+#define CRC64_FOLD(x, off) x = _mm_xor_si128(_mm_xor_si128( \
+            _mm_clmulepi64_si128(x, fold, 0x00), _mm_clmulepi64_si128(x, fold, 0x11)), \
+            _mm_loadu_si128((const __m128i*)(data + off)))
+        CRC64_FOLD(x0, 0); CRC64_FOLD(x1, 16); CRC64_FOLD(x2, 32); CRC64_FOLD(x3, 48);
+#undef CRC64_FOLD
+        data += 64; size -= 64;
+    }
+    _mm_storeu_si128((__m128i*)(lanes), x0);
+    _mm_storeu_si128((__m128i*)(lanes + 16), x1);
+    _mm_storeu_si128((__m128i*)(lanes + 32), x2);
+    _mm_storeu_si128((__m128i*)(lanes + 48), x3);
+    return crc64_slice8(data, size, crc64_slice8(lanes, sizeof(lanes), 0));
+}
+#endif
+
+static UInt64
+crc64_kernel(const unsigned char *data, size_t size, UInt64 crc) {
+#ifdef CRC64_HAS_CLMUL
+    if (crc64_have_clmul && size >= 128) return crc64_clmul(data, size, crc);
+#endif
+    return crc64_slice8(data, size, crc);
 }
 
+// Inputs at least this large release the GIL while checksumming
+#define CRC64_GIL_THRESHOLD (64u * 1024u)
+
 static PyObject *
 crc64(PyObject *self, PyObject *args) {
     unsigned char *data = NULL;
     Py_ssize_t size = 0;
     UInt64 crc = 0;
-    size_t i;
     if (!PyArg_ParseTuple(args, BYTES_FMT "|K", &data, &size, &crc)) return NULL;
     crc = ~crc;
-    for (i = 0; i < (size_t)size; ++i)
-        crc = crc64_table[data[i] ^ (crc & 0xFF)] ^ (crc >> 8);
+    if ((size_t)size >= CRC64_GIL_THRESHOLD) {
+        Py_BEGIN_ALLOW_THREADS;
+        crc = crc64_kernel(data, (size_t)size, crc);
+        Py_END_ALLOW_THREADS;
+    } else crc = crc64_kernel(data, (size_t)size, crc);
 
     return Py_BuildValue("K", ~crc);
 }
 
+#if defined(__SSE2__)
+#define DELTA_USE_SSE2 1
+#include <emmintrin.h>
+
+// Prefix sum of bytes within each 16 byte block for distances that divide
+// the vector width, with the carry (the last `dist` decoded bytes)
+// broadcast into every lane of the next block.
+static void
+delta_sum_sse2(unsigned char *data, Py_ssize_t n, unsigned int dist) {
+    Py_ssize_t i = dist;
+    __m128i v, carry;
+    while (n - i >= 16) {
+        v = _mm_loadu_si128((const __m128i*)(data + i));
+        switch (dist) {
+            case 1:
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+                carry = _mm_set1_epi8((char)data[i-1]);
+                break;
+            case 2:
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+                carry = _mm_set1_epi16((short)(data[i-2] | (data[i-1] << 8)));
+                break;
+            case 4:
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+                carry = _mm_set1_epi32((int)(data[i-4] | (data[i-3] << 8) | (data[i-2] << 16) | ((unsigned int)data[i-1] << 24)));
+                break;
+            default:  // 8
+                v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+                carry = _mm_loadl_epi64((const __m128i*)(data + i - 8));
+                carry = _mm_unpacklo_epi64(carry, carry);
+                break;
+        }
+        v = _mm_add_epi8(v, carry);
+        _mm_storeu_si128((__m128i*)(data + i), v);
+        i += 16;
+    }
+    for (; i < n; i++) data[i] += data[i - dist];
+}
+#endif
+
+static void
+delta_sum(unsigned char *data, Py_ssize_t n, unsigned int dist) {
+    Py_ssize_t i = dist;
+#ifdef DELTA_USE_SSE2
+    if (dist == 1 || dist == 2 || dist == 4 || dist == 8) { delta_sum_sse2(data, n, dist); return; }
+    if (dist >= 16) {
+        // the source block is fully decoded before the destination block,
+        // so plain vector adds suffice
+        for (; n - i >= 16; i += 16)
+            _mm_storeu_si128((__m128i*)(data + i),
+                _mm_add_epi8(_mm_loadu_si128((const __m128i*)(data + i)), _mm_loadu_si128((const __m128i*)(data + i - dist))));
+    }
+#endif
+    for (; i < n; i++) data[i] += data[i - dist];
+}
+
+// Inputs at least this large release the GIL while decoding
+#define DELTA_GIL_THRESHOLD (64u * 1024u)
+
 static PyObject*
 delta_decode(PyObject *self, PyObject *args) {
     PyObject *array = NULL, *histarray = NULL;
-    unsigned char *data = NULL, pos = 0, *history = NULL;
-    unsigned int distance = 0;
-    Py_ssize_t datalen = 0, i;
+    unsigned char *data = NULL, pos = 0, distance = 0, *history = NULL;
+    unsigned int dist;
+    Py_ssize_t datalen = 0, i, first;
     if (!PyArg_ParseTuple(args, "O!O!BB", &PyByteArray_Type, &array, &PyByteArray_Type, &histarray, &pos, &distance)) return NULL;
     if (PyByteArray_GET_SIZE(histarray) != 256) {
         PyErr_SetString(PyExc_TypeError, "histarray must be 256 bytes long");
         return NULL;
     }
     data = (unsigned char*)PyByteArray_AS_STRING(array); history = (unsigned char*)PyByteArray_AS_STRING(histarray);
-    datalen = PyBytes_GET_SIZE(array);
+    datalen = PyByteArray_GET_SIZE(array);
+    // the filter distance is 1..256 and arrives modulo 256, with the
+    // circular history making a distance of 0 behave as 256
+    dist = distance ? distance : 256;
+
+    // The first dist bytes need history from previous calls; the entries
+    // read are distinct from the ones written, so the stores can be
+    // deferred to the rebuild below
+    first = (datalen < (Py_ssize_t)dist) ? datalen : (Py_ssize_t)dist;
+    for (i = 0; i < first; i++)
+        data[i] += history[(unsigned char)(pos - i + distance)];
+    // After that every byte depends only on the buffer itself
+    if (datalen >= (Py_ssize_t)DELTA_GIL_THRESHOLD) {
+        Py_buffer view;
+        // exporting a buffer pins the bytearray, so it cannot be resized
+        // while the GIL is released
+        if (PyObject_GetBuffer(array, &view, PyBUF_WRITABLE) != 0) return NULL;
+        Py_BEGIN_ALLOW_THREADS;
+        delta_sum((unsigned char*)view.buf, datalen, dist);
+        Py_END_ALLOW_THREADS;
+        PyBuffer_Release(&view);
+    } else delta_sum(data, datalen, dist);
+    // Rebuild the history the byte-serial loop would have left behind: the
+    // last (up to) 256 decoded bytes, in circular order
+    for (i = (datalen > 256) ? datalen - 256 : 0; i < datalen; i++)
+        history[(unsigned char)(pos - i)] = data[i];
+    return Py_BuildValue("B", (unsigned char)(pos - datalen));
+}
+// }}}
+
+// Parallel decompression {{{
+// The chunk headers of an LZMA2 stream are plain bytes, so the chunk
+// boundaries can be found without running the decoder. A chunk that
+// resets the dictionary depends on nothing before it, therefore the runs
+// of chunks between dictionary resets can be decoded concurrently, each
+// into its own known offset of the output. The parallel compressor above
+// produces such a reset at every slice boundary; streams from the single
+// threaded encoder typically contain one run and end up decoded by the
+// calling thread alone. As with compression, the workers use only raw
+// malloc so they can run without the GIL.
+
+typedef struct {
+    const Byte *in;
+    size_t in_size;
+    Byte *out;
+    size_t out_size;
+    SRes res;
+} DecompressTask;
+
+struct decompress_queue {
+    DecompressTask *tasks;
+    Py_ssize_t count, next;
+    int active_workers;
+    unsigned char props;
+    PyThread_type_lock mutex, done;
+};
+
+// Walk the chunk headers (see the format comment at the top of
+// Lzma2Dec.c), recording one task per run of chunks between dictionary
+// resets. With tasks == NULL only the counts are computed. Returns 0 for
+// a truncated or malformed stream, otherwise 1 with *consumed set to the
+// offset just past the end-of-stream marker and *total_unpacked to the
+// decompressed size of the whole stream.
+static int
+scan_chunks(const Byte *in, size_t in_size, DecompressTask *tasks, Py_ssize_t *count, size_t *consumed, UInt64 *total_unpacked) {
+    size_t pos = 0, run_start = 0;
+    UInt64 run_unpacked = 0;
+    *count = 0; *total_unpacked = 0;
+    while (1) {
+        unsigned control;
+        int reset_dic;
+        size_t unpack_size, data_size, header_size;
+        if (pos >= in_size) return 0;
+        control = in[pos];
+        if (control == 0) { pos++; break; }  // end-of-stream marker
+        if (control & 0x80) {  // LZMA chunk
+            if (pos + 5 > in_size) return 0;
+            unpack_size = (((size_t)control & 0x1F) << 16) + ((size_t)in[pos + 1] << 8) + in[pos + 2] + 1;
+            data_size = ((size_t)in[pos + 3] << 8) + in[pos + 4] + 1;
+            header_size = (((control >> 5) & 3) >= 2) ? 6 : 5;  // modes 2 and 3 carry a props byte
+            reset_dic = ((control >> 5) & 3) == 3;
+        } else {  // uncompressed chunk, control 1 resets the dictionary
+            if (control > 2 || pos + 3 > in_size) return 0;
+            unpack_size = ((size_t)in[pos + 1] << 8) + in[pos + 2] + 1;
+            data_size = unpack_size;
+            header_size = 3;
+            reset_dic = control == 1;
+        }
+        if (data_size > in_size - pos - header_size) return 0;
+        if (reset_dic && run_unpacked > 0) {
+            if (tasks != NULL) {
+                tasks[*count].in = in + run_start;
+                tasks[*count].in_size = pos - run_start;
+                tasks[*count].out_size = (size_t)run_unpacked;
+            }
+            (*count)++;
+            run_start = pos; run_unpacked = 0;
+        }
+        if (!reset_dic && run_unpacked == 0 && pos == run_start)
+            return 0;  // the first chunk of the stream must reset the dictionary
+        run_unpacked += unpack_size;
+        *total_unpacked += unpack_size;
+        pos += header_size + data_size;
+    }
+    if (run_unpacked > 0) {
+        if (tasks != NULL) {
+            tasks[*count].in = in + run_start;
+            tasks[*count].in_size = (pos - 1) - run_start;
+            tasks[*count].out_size = (size_t)run_unpacked;
+        }
+        (*count)++;
+    }
+    *consumed = pos;
+    return 1;
+}
 
-    for (i = 0; i < datalen; i++) {
-        data[i] += history[(unsigned char)(pos + distance)];
-        history[pos--] = data[i];
+static void
+decompress_run(CLzma2Dec *state, DecompressTask *t) {
+    SizeT in_pos = 0, out_pos = 0;
+    ELzmaStatus status = LZMA_STATUS_NOT_FINISHED;
+    Lzma2Dec_Init(state);
+    while (out_pos < t->out_size) {
+        SizeT bytes_written = t->out_size - out_pos, bytes_read = t->in_size - in_pos;
+        t->res = Lzma2Dec_DecodeToBuf(state, t->out + out_pos, &bytes_written, (Byte*)(t->in + in_pos), &bytes_read, LZMA_FINISH_ANY, &status);
+        if (t->res != SZ_OK) return;
+        out_pos += bytes_written; in_pos += bytes_read;
+        // the run produced less output than its headers promised
+        if (bytes_written == 0 && bytes_read == 0) { t->res = SZ_ERROR_DATA; return; }
+    }
+}
+
+static void
+decompress_worker(void *arg) {
+    struct decompress_queue *q = (struct decompress_queue*)arg;
+    CLzma2Dec state;
+    int last = 0;
+    SRes setup;
+    Lzma2Dec_Construct(&state);
+    setup = Lzma2Dec_Allocate(&state, (Byte)q->props, &raw_allocator);
+    while (1) {
+        Py_ssize_t idx;
+        PyThread_acquire_lock(q->mutex, 1);
+        idx = (q->next < q->count) ? q->next++ : -1;
+        PyThread_release_lock(q->mutex);
+        if (idx < 0) break;
+        if (setup != SZ_OK) q->tasks[idx].res = setup;
+        else decompress_run(&state, q->tasks + idx);
     }
-    return Py_BuildValue("B", pos);
+    Lzma2Dec_Free(&state, &raw_allocator);
+    // The queue must not be touched after signalling done: the main thread
+    // may free the locks as soon as it is woken
+    PyThread_acquire_lock(q->mutex, 1);
+    last = (--q->active_workers == 0);
+    PyThread_release_lock(q->mutex);
+    if (last) PyThread_release_lock(q->done);
+}
+
+static PyObject*
+decompress2_mt(PyObject *read, PyObject *seek, PyObject *write, unsigned char props, SizeT bufsize, int threads) {
+    PyObject *rres = NULL, *wres = NULL;
+    struct decompress_queue q;
+    Byte *in = NULL, *out = NULL;
+    size_t in_used = 0, in_capacity = 0, consumed = 0, out_pos = 0;
+    UInt64 total_unpacked = 0;
+    Py_ssize_t i = 0, count = 0, nbytes = 0;
+    int eof = 0;
+
+    memset(&q, 0, sizeof(q));
+    q.props = props;
+    if (threads > 64) threads = 64;
+    q.mutex = PyThread_allocate_lock();
+    q.done = PyThread_allocate_lock();
+    if (q.mutex == NULL || q.done == NULL) { PyErr_NoMemory(); goto exit; }
+
+    // The whole stream has to be in memory so that the chunk headers can
+    // be scanned up front; that is the price of parallel decoding
+    while (!eof) {
+        if (in_used + bufsize > in_capacity) {
+            size_t ncap = in_capacity ? in_capacity : (bufsize > 65536 ? bufsize : 65536);
+            Byte *nin = NULL;
+            while (in_used + bufsize > ncap) ncap *= 2;
+            nin = (Byte*)realloc(in, ncap);
+            if (nin == NULL) { PyErr_NoMemory(); goto exit; }
+            in = nin; in_capacity = ncap;
+        }
+        rres = PyObject_CallFunction(read, "n", (Py_ssize_t)bufsize);
+        if (rres == NULL) goto exit;
+        if (!PyBytes_Check(rres)) { PyErr_SetString(PyExc_TypeError, "read() must return bytes"); goto exit; }
+        nbytes = PyBytes_GET_SIZE(rres);
+        if (nbytes == 0) eof = 1;
+        else { memcpy(in + in_used, PyBytes_AS_STRING(rres), nbytes); in_used += nbytes; }
+        Py_DECREF(rres); rres = NULL;
+    }
+
+    if (!scan_chunks(in, in_used, NULL, &count, &consumed, &total_unpacked)) {
+        PyErr_SetString(LZMAError, "LZMA2 block was truncated or malformed"); goto exit;
+    }
+    if (count > 0) {
+        if (total_unpacked != (UInt64)(size_t)total_unpacked) { PyErr_NoMemory(); goto exit; }
+        q.tasks = (DecompressTask*)calloc(count, sizeof(DecompressTask));
+        out = (Byte*)malloc((size_t)total_unpacked);
+        if (q.tasks == NULL || out == NULL) { PyErr_NoMemory(); goto exit; }
+        scan_chunks(in, in_used, q.tasks, &count, &consumed, &total_unpacked);
+        for (i = 0; i < count; i++) {
+            q.tasks[i].out = out + out_pos;
+            out_pos += q.tasks[i].out_size;
+        }
+
+        q.count = count; q.next = 0;
+        q.active_workers = 1;  // the calling thread
+        PyThread_acquire_lock(q.done, 1);
+        for (i = 0; i < ((Py_ssize_t)threads < count ? threads : count) - 1; i++) {
+            PyThread_acquire_lock(q.mutex, 1);
+            q.active_workers++;
+            PyThread_release_lock(q.mutex);
+            if (PyThread_start_new_thread(decompress_worker, &q) == -1) {
+                // could not start a thread, make do with fewer
+                PyThread_acquire_lock(q.mutex, 1);
+                q.active_workers--;
+                PyThread_release_lock(q.mutex);
+                break;
+            }
+        }
+        Py_BEGIN_ALLOW_THREADS;
+        decompress_worker(&q);
+        PyThread_acquire_lock(q.done, 1);  // wait for the pool to drain
+        PyThread_release_lock(q.done);
+        Py_END_ALLOW_THREADS;
+
+        for (i = 0; i < count; i++) {
+            if (q.tasks[i].res != SZ_OK) { SET_ERROR(q.tasks[i].res); goto exit; }
+        }
+        // Write out the decoded runs, in order
+        for (out_pos = 0; out_pos < (size_t)total_unpacked; out_pos += nbytes) {
+            nbytes = ((size_t)total_unpacked - out_pos < bufsize) ? (Py_ssize_t)((size_t)total_unpacked - out_pos) : (Py_ssize_t)bufsize;
+            wres = PyObject_CallFunction(write, BYTES_FMT, (char*)out + out_pos, nbytes);
+            if (wres == NULL) goto exit;
+            Py_DECREF(wres); wres = NULL;
+        }
+    }
+    if (in_used > consumed) {
+        if (!PyObject_CallFunction(seek, "ni", -(Py_ssize_t)(in_used - consumed), SEEK_CUR)) goto exit;
+    }
+
+exit:
+    free(in); free(out); free(q.tasks);
+    if (q.mutex != NULL) PyThread_free_lock(q.mutex);
+    if (q.done != NULL) PyThread_free_lock(q.done);
+    if (PyErr_Occurred()) return NULL;
+    Py_RETURN_NONE;
 }
 // }}}
 
@@ -125,9 +530,11 @@ decompress2(PyObject *self, PyObject *args) {
     char *inbuf = NULL, *outbuf = NULL;
     CLzma2Dec state;
     SRes res = SZ_OK;
+    int threads = 1;
     ELzmaStatus status = LZMA_STATUS_NOT_FINISHED;
 
-    if (!PyArg_ParseTuple(args, "OOOBk", &read, &seek, &write, &props, &bufsize)) return NULL;
+    if (!PyArg_ParseTuple(args, "OOOBk|i", &read, &seek, &write, &props, &bufsize, &threads)) return NULL;
+    if (threads > 1) return decompress2_mt(read, seek, write, props, bufsize, threads);
 
     Lzma2Dec_Construct(&state);
     res = Lzma2Dec_Allocate(&state, (Byte)props, &allocator);
@@ -180,6 +587,177 @@ exit:
 }
 // }}}
 
+// Streaming LZMA2 decompressor {{{
+// Unlike decompress2(), which drives python read/seek callbacks, this
+// object is fed compressed bytes as they become available and yields
+// decompressed data through a reusable output buffer of caller-chosen
+// size, so arbitrarily large archives can be unpacked with constant
+// memory and no intermediate bytes objects.
+
+typedef struct {
+    PyObject_HEAD
+    CLzma2Dec state;
+    int state_allocated, finished;
+    Byte *outbuf;
+    size_t outbuf_size;
+    // compressed input that could not be consumed because outbuf filled up
+    Byte *pending;
+    size_t pending_capacity, pending_used;
+} Decompressor;
+
+static void
+Decompressor_dealloc(Decompressor *self) {
+    if (self->state_allocated) Lzma2Dec_Free(&self->state, &allocator);
+    PyMem_Free(self->outbuf); self->outbuf = NULL;
+    free(self->pending); self->pending = NULL;
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int
+Decompressor_init(Decompressor *self, PyObject *args, PyObject *kwds) {
+    unsigned char props = 0;
+    unsigned long bufsize = 1024 * 1024;
+    SRes res = SZ_OK;
+    static char *kwlist[] = {"props", "bufsize", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "B|k", kwlist, &props, &bufsize)) return -1;
+    if (bufsize < 4096) bufsize = 4096;
+    if (self->state_allocated) { Lzma2Dec_Free(&self->state, &allocator); self->state_allocated = 0; }
+    PyMem_Free(self->outbuf); self->outbuf = NULL;
+    free(self->pending); self->pending = NULL;
+    self->pending_capacity = 0; self->pending_used = 0; self->finished = 0;
+
+    Lzma2Dec_Construct(&self->state);
+    res = Lzma2Dec_Allocate(&self->state, (Byte)props, &allocator);
+    if (res == SZ_ERROR_MEM) { PyErr_NoMemory(); return -1; }
+    if (res != SZ_OK) { PyErr_SetString(PyExc_TypeError, "Incorrect stream properties"); return -1; }
+    self->state_allocated = 1;
+    Lzma2Dec_Init(&self->state);
+    self->outbuf = (Byte*)PyMem_Malloc(bufsize);
+    if (self->outbuf == NULL) { PyErr_NoMemory(); return -1; }
+    self->outbuf_size = bufsize;
+    return 0;
+}
+
+static PyObject*
+Decompressor_feed(Decompressor *self, PyObject *args) {
+    unsigned char *data = NULL;
+    Py_ssize_t size = 0;
+    size_t out_pos = 0, in_pos = 0;
+    SRes res = SZ_OK;
+    ELzmaStatus status = LZMA_STATUS_NOT_FINISHED;
+
+    if (!PyArg_ParseTuple(args, BYTES_FMT, &data, &size)) return NULL;
+    if (self->outbuf == NULL) { PyErr_SetString(LZMAError, "Decompressor not initialized"); return NULL; }
+    if (size > 0 && !self->finished) {
+        if (self->pending_used + size > self->pending_capacity) {
+            size_t ncap = self->pending_capacity ? self->pending_capacity : 8192;
+            Byte *npending = NULL;
+            while (self->pending_used + size > ncap) ncap *= 2;
+            npending = (Byte*)realloc(self->pending, ncap);
+            if (npending == NULL) return PyErr_NoMemory();
+            self->pending = npending; self->pending_capacity = ncap;
+        }
+        memcpy(self->pending + self->pending_used, data, size);
+        self->pending_used += size;
+    }
+
+    Py_BEGIN_ALLOW_THREADS;
+    while (out_pos < self->outbuf_size && in_pos < self->pending_used && !self->finished) {
+        SizeT bytes_written = self->outbuf_size - out_pos, bytes_read = self->pending_used - in_pos;
+        res = Lzma2Dec_DecodeToBuf(&self->state, self->outbuf + out_pos, &bytes_written, self->pending + in_pos, &bytes_read, LZMA_FINISH_ANY, &status);
+        if (res != SZ_OK) break;
+        out_pos += bytes_written; in_pos += bytes_read;
+        if (status == LZMA_STATUS_FINISHED_WITH_MARK) { self->finished = 1; break; }
+        // no progress possible: either outbuf is full or the remaining
+        // input is a partial chunk needing more data
+        if (bytes_written == 0 && bytes_read == 0) break;
+    }
+    Py_END_ALLOW_THREADS;
+    if (res != SZ_OK) { SET_ERROR(res); return NULL; }
+    if (in_pos > 0) {
+        self->pending_used -= in_pos;
+        if (self->pending_used) memmove(self->pending, self->pending + in_pos, self->pending_used);
+    }
+#if PY_MAJOR_VERSION >= 3
+    return PyMemoryView_FromMemory((char*)self->outbuf, (Py_ssize_t)out_pos, PyBUF_READ);
+#else
+    {
+        Py_buffer view;
+        if (PyBuffer_FillInfo(&view, NULL, self->outbuf, (Py_ssize_t)out_pos, 1, PyBUF_FULL_RO) != 0) return NULL;
+        return PyMemoryView_FromBuffer(&view);
+    }
+#endif
+}
+
+static PyObject*
+Decompressor_get_finished(Decompressor *self, void *closure) {
+    return PyBool_FromLong(self->finished);
+}
+
+static PyObject*
+Decompressor_get_needs_input(Decompressor *self, void *closure) {
+    return PyBool_FromLong(self->pending_used == 0 && !self->finished);
+}
+
+static PyMethodDef Decompressor_methods[] = {
+    {"feed", (PyCFunction)Decompressor_feed, METH_VARARGS,
+        "feed(data) -> memoryview\n\nDecompress data, returning a view of the decompressed bytes. The view is valid only until the next call to feed(). When the output buffer fills up, leftover input is buffered internally; call feed(b'') until the returned view is empty to drain it."
+    },
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef Decompressor_getsetters[] = {
+    {"finished", (getter)Decompressor_get_finished, NULL, "True once the LZMA2 end-of-stream marker has been seen", NULL},
+    {"needs_input", (getter)Decompressor_get_needs_input, NULL, "True when all fed input has been consumed and the stream is not finished", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject DecompressorType = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0,
+#endif
+    /* tp_name           */ "lzma_binding.LZMA2Decompressor",
+    /* tp_basicsize      */ sizeof(Decompressor),
+    /* tp_itemsize       */ 0,
+    /* tp_dealloc        */ (destructor)Decompressor_dealloc,
+    /* tp_print          */ 0,
+    /* tp_getattr        */ 0,
+    /* tp_setattr        */ 0,
+    /* tp_compare        */ 0,
+    /* tp_repr           */ 0,
+    /* tp_as_number      */ 0,
+    /* tp_as_sequence    */ 0,
+    /* tp_as_mapping     */ 0,
+    /* tp_hash           */ 0,
+    /* tp_call           */ 0,
+    /* tp_str            */ 0,
+    /* tp_getattro       */ 0,
+    /* tp_setattro       */ 0,
+    /* tp_as_buffer      */ 0,
+    /* tp_flags          */ Py_TPFLAGS_DEFAULT,
+    /* tp_doc            */ "LZMA2Decompressor(props, bufsize=1024*1024)\n\nStreaming LZMA2 decompressor. Feed it compressed bytes as they arrive, it yields views of decompressed data from a reusable buffer of size bufsize.",
+    /* tp_traverse       */ 0,
+    /* tp_clear          */ 0,
+    /* tp_richcompare    */ 0,
+    /* tp_weaklistoffset */ 0,
+    /* tp_iter           */ 0,
+    /* tp_iternext       */ 0,
+    /* tp_methods        */ Decompressor_methods,
+    /* tp_members        */ 0,
+    /* tp_getset         */ Decompressor_getsetters,
+    /* tp_base           */ 0,
+    /* tp_dict           */ 0,
+    /* tp_descr_get      */ 0,
+    /* tp_descr_set      */ 0,
+    /* tp_dictoffset     */ 0,
+    /* tp_init           */ (initproc)Decompressor_init,
+    /* tp_alloc          */ 0,
+    /* tp_new            */ 0,
+};
+// }}}
+
 // LZMA1 decompress {{{
 static PyObject*
 decompress(PyObject *self, PyObject *args) {
@@ -284,13 +862,16 @@ static SRes iread(void *p, void *buf, size_t *size) {
     InStream *self = (InStream*)p;
     PyObject *res = NULL;
     char *str = NULL;
-    if (*size == 0) return SZ_OK;
+    size_t req = *size;
+    if (req == 0) return SZ_OK;
     ACQUIRE_GIL
-    res = PyObject_CallFunction(self->read, "n", size);
+    res = PyObject_CallFunction(self->read, "n", (Py_ssize_t)req);
     if (res == NULL) return SZ_ERROR_READ;
     str = PyBytes_AsString(res);
     if (str == NULL) { Py_DECREF(res); return SZ_ERROR_READ; }
     *size = PyBytes_Size(res);
+    // a read() that returns more than was asked for would overflow buf
+    if (*size > req) { Py_DECREF(res); return SZ_ERROR_READ; }
     if(*size) memcpy(buf, str, *size);
     Py_DECREF(res);
     RELEASE_GIL
@@ -342,12 +923,220 @@ exit:
 }
 
 
+// Parallel compression {{{
+// LZMA2 is a sequence of chunks, each of which can opt to reset the
+// dictionary, so compressing independent slices of the input on separate
+// threads and concatenating the results in order yields a valid LZMA2
+// stream. The SDK is built single threaded (_7ZIP_ST), therefore the
+// thread pool lives here: every worker has its own CLzma2EncHandle and
+// compresses slices from an in-memory queue into an in-memory buffer,
+// using only raw malloc, so no GIL is needed. Each per-slice stream ends
+// with the LZMA2 end-of-stream marker (a single null byte), which is
+// stripped from every slice, a single marker being written after the last
+// one.
+
+#define SLICE_SIZE (8u * 1024u * 1024u)
+
+typedef struct {
+    ISeqInStream stream;
+    const Byte *data;
+    size_t pos, size;
+} MemInStream;
+
+static SRes mem_read(void *p, void *buf, size_t *size) {
+    MemInStream *self = (MemInStream*)p;
+    size_t n = self->size - self->pos;
+    if (n > *size) n = *size;
+    if (n) memcpy(buf, self->data + self->pos, n);
+    self->pos += n; *size = n;
+    return SZ_OK;
+}
+
+typedef struct {
+    ISeqOutStream stream;
+    Byte *data;
+    size_t used, capacity;
+    int nomem;
+} MemOutStream;
+
+static size_t mem_write(void *p, const void *buf, size_t size) {
+    MemOutStream *self = (MemOutStream*)p;
+    if (self->used + size > self->capacity) {
+        size_t ncap = self->capacity ? self->capacity : 65536;
+        Byte *ndata = NULL;
+        while (self->used + size > ncap) ncap *= 2;
+        ndata = (Byte*)realloc(self->data, ncap);
+        if (ndata == NULL) { self->nomem = 1; return 0; }
+        self->data = ndata; self->capacity = ncap;
+    }
+    memcpy(self->data + self->used, buf, size);
+    self->used += size;
+    return size;
+}
+
+typedef struct {
+    Byte *data;
+    size_t size;
+    MemOutStream out;
+    SRes res;
+} CompressTask;
+
+struct compress_queue {
+    CompressTask *tasks;
+    Py_ssize_t count, next;
+    int active_workers, preset;
+    PyThread_type_lock mutex, done;
+};
+
+static void
+compress_slice(CLzma2EncHandle lzma2, CompressTask *t) {
+    MemInStream in;
+    in.stream.Read = mem_read;
+    in.data = t->data; in.pos = 0; in.size = t->size;
+    t->out.stream.Write = mem_write;
+    t->res = Lzma2Enc_Encode(lzma2, (ISeqOutStream*)&t->out, (ISeqInStream*)&in, NULL);
+    if (t->res == SZ_OK && t->out.nomem) t->res = SZ_ERROR_MEM;
+    // strip the end-of-stream marker
+    if (t->res == SZ_OK && t->out.used && t->out.data[t->out.used - 1] == 0) t->out.used--;
+}
+
+static void
+compress_worker(void *arg) {
+    struct compress_queue *q = (struct compress_queue*)arg;
+    CLzma2EncProps props;
+    int last = 0;
+    CLzma2EncHandle lzma2 = Lzma2Enc_Create(&raw_allocator, &raw_allocator);
+    SRes setup = (lzma2 == NULL) ? SZ_ERROR_MEM : SZ_OK;
+    if (setup == SZ_OK) {
+        init_props(&props, q->preset);
+        setup = Lzma2Enc_SetProps(lzma2, &props);
+    }
+    while (1) {
+        Py_ssize_t idx;
+        PyThread_acquire_lock(q->mutex, 1);
+        idx = (q->next < q->count) ? q->next++ : -1;
+        PyThread_release_lock(q->mutex);
+        if (idx < 0) break;
+        if (setup != SZ_OK) q->tasks[idx].res = setup;
+        else compress_slice(lzma2, q->tasks + idx);
+    }
+    if (lzma2) Lzma2Enc_Destroy(lzma2);
+    // The queue must not be touched after signalling done: the main thread
+    // may free the locks as soon as it is woken
+    PyThread_acquire_lock(q->mutex, 1);
+    last = (--q->active_workers == 0);
+    PyThread_release_lock(q->mutex);
+    if (last) PyThread_release_lock(q->done);
+}
+
+static PyObject*
+compress_mt(PyObject *read, PyObject *write, PyObject *progress_callback, int preset, int threads) {
+    PyObject *rres = NULL, *wres = NULL;
+    struct compress_queue q;
+    Py_ssize_t i = 0, nslices = 0;
+    int eof = 0;
+    UInt64 in_total = 0, out_total = 0;
+    static const char null_byte = 0;
+
+    memset(&q, 0, sizeof(q));
+    q.preset = preset;
+    if (threads > 64) threads = 64;
+    q.tasks = (CompressTask*)calloc(threads, sizeof(CompressTask));
+    q.mutex = PyThread_allocate_lock();
+    q.done = PyThread_allocate_lock();
+    if (q.tasks == NULL || q.mutex == NULL || q.done == NULL) { PyErr_NoMemory(); goto exit; }
+    for (i = 0; i < threads; i++) {
+        q.tasks[i].data = (Byte*)malloc(SLICE_SIZE);
+        if (q.tasks[i].data == NULL) { PyErr_NoMemory(); goto exit; }
+    }
+
+    while (!eof) {
+        // Read one slice of input per thread
+        for (nslices = 0; nslices < threads && !eof; nslices++) {
+            CompressTask *t = q.tasks + nslices;
+            t->size = 0; t->res = SZ_OK;
+            t->out.used = 0; t->out.nomem = 0;
+            while (t->size < SLICE_SIZE) {
+                Py_ssize_t nbytes = 0;
+                rres = PyObject_CallFunction(read, "n", (Py_ssize_t)(SLICE_SIZE - t->size));
+                if (rres == NULL) goto exit;
+                if (!PyBytes_Check(rres)) { PyErr_SetString(PyExc_TypeError, "read() must return bytes"); goto exit; }
+                nbytes = PyBytes_GET_SIZE(rres);
+                if (nbytes == 0) { eof = 1; Py_DECREF(rres); rres = NULL; break; }
+                memcpy(t->data + t->size, PyBytes_AS_STRING(rres), nbytes);
+                t->size += nbytes;
+                Py_DECREF(rres); rres = NULL;
+            }
+            in_total += t->size;
+            if (t->size == 0) break;  // only possible when eof
+        }
+        if (nslices && q.tasks[nslices - 1].size == 0) nslices--;
+        if (nslices == 0) break;
+
+        // Compress the slices in parallel
+        q.count = nslices; q.next = 0;
+        q.active_workers = 1;  // the calling thread
+        PyThread_acquire_lock(q.done, 1);
+        for (i = 0; i < nslices - 1; i++) {
+            PyThread_acquire_lock(q.mutex, 1);
+            q.active_workers++;
+            PyThread_release_lock(q.mutex);
+            if (PyThread_start_new_thread(compress_worker, &q) == -1) {
+                // could not start a thread, make do with fewer
+                PyThread_acquire_lock(q.mutex, 1);
+                q.active_workers--;
+                PyThread_release_lock(q.mutex);
+                break;
+            }
+        }
+        Py_BEGIN_ALLOW_THREADS;
+        compress_worker(&q);
+        PyThread_acquire_lock(q.done, 1);  // wait for the pool to drain
+        PyThread_release_lock(q.done);
+        Py_END_ALLOW_THREADS;
+
+        // Write out the compressed slices, in order
+        for (i = 0; i < nslices; i++) {
+            CompressTask *t = q.tasks + i;
+            if (t->res != SZ_OK) { SET_ERROR(t->res); goto exit; }
+            wres = PyObject_CallFunction(write, BYTES_FMT, (char*)t->out.data, (Py_ssize_t)t->out.used);
+            if (wres == NULL) goto exit;
+            Py_DECREF(wres); wres = NULL;
+            out_total += t->out.used;
+        }
+        if (progress_callback) {
+            wres = PyObject_CallFunction(progress_callback, "KK", in_total, out_total);
+            if (!wres || !PyObject_IsTrue(wres)) {
+                Py_XDECREF(wres); wres = NULL;
+                if (!PyErr_Occurred()) SET_ERROR(SZ_ERROR_PROGRESS);
+                goto exit;
+            }
+            Py_DECREF(wres); wres = NULL;
+        }
+    }
+    // Terminate the stream with an end-of-stream marker
+    wres = PyObject_CallFunction(write, BYTES_FMT, &null_byte, (Py_ssize_t)1);
+    if (wres == NULL) goto exit;
+    Py_DECREF(wres); wres = NULL;
+
+exit:
+    if (q.tasks != NULL) {
+        for (i = 0; i < threads; i++) { free(q.tasks[i].data); free(q.tasks[i].out.data); }
+        free(q.tasks);
+    }
+    if (q.mutex != NULL) PyThread_free_lock(q.mutex);
+    if (q.done != NULL) PyThread_free_lock(q.done);
+    if (PyErr_Occurred()) return NULL;
+    return get_lzma2_properties(preset);
+}
+// }}}
+
 static PyObject*
 compress(PyObject *self, PyObject *args) {
     PyObject *read = NULL, *write = NULL, *progress_callback = NULL;
     CLzma2EncHandle lzma2 = NULL;
     CLzma2EncProps props;
-    int preset = 5;
+    int preset = 5, threads = 1;
     InStream in_stream;
     OutStream out_stream;
     Progress progress;
@@ -355,8 +1144,9 @@ compress(PyObject *self, PyObject *args) {
     Byte props_out = 0;
     PyThreadState *ts = NULL;
 
-    if (!PyArg_ParseTuple(args, "OO|Oi", &read, &write, &progress_callback, &preset)) return NULL;
+    if (!PyArg_ParseTuple(args, "OO|Oii", &read, &write, &progress_callback, &preset, &threads)) return NULL;
     if (progress_callback && !PyCallable_Check(progress_callback)) progress_callback = NULL;
+    if (threads > 1) return compress_mt(read, write, progress_callback, preset, threads);
 
     lzma2 = Lzma2Enc_Create(&allocator, &allocator);
     if (lzma2 == NULL) { PyErr_NoMemory(); goto exit; }
@@ -393,15 +1183,143 @@ exit:
 
 // }}}
 
+// Reusable LZMA2 compressor {{{
+// compress() creates and destroys the encoder, including the multi-megabyte
+// match-finder hash and window arenas, on every call. When compressing many
+// small files that setup dominates, so this object keeps one CLzma2EncHandle
+// (and the output buffer) alive between calls: the SDK reuses the existing
+// arenas as long as the coder parameters are unchanged and only
+// re-initializes positions. Every call produces a complete LZMA2 stream,
+// terminated by the end-of-stream marker, that decompress2() and
+// LZMA2Decompressor can decode. The SDK provides no way to preload the
+// match-finder window, so priming the dictionary with a shared sample is
+// not possible without changing the stream format.
+
+typedef struct {
+    PyObject_HEAD
+    CLzma2EncHandle lzma2;
+    Byte props;
+    MemOutStream out;
+} Compressor;
+
+static void
+Compressor_dealloc(Compressor *self) {
+    if (self->lzma2) { Lzma2Enc_Destroy(self->lzma2); self->lzma2 = NULL; }
+    free(self->out.data); self->out.data = NULL;
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int
+Compressor_init(Compressor *self, PyObject *args, PyObject *kwds) {
+    int preset = 5;
+    CLzma2EncProps props;
+    SRes res = SZ_OK;
+    static char *kwlist[] = {"preset", NULL};
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &preset)) return -1;
+    if (self->lzma2) { Lzma2Enc_Destroy(self->lzma2); self->lzma2 = NULL; }
+    // raw malloc, as the encoder allocates lazily inside Encode, which runs
+    // without the GIL
+    self->lzma2 = Lzma2Enc_Create(&raw_allocator, &raw_allocator);
+    if (self->lzma2 == NULL) { PyErr_NoMemory(); return -1; }
+    init_props(&props, preset);
+    res = Lzma2Enc_SetProps(self->lzma2, &props);
+    if (res != SZ_OK) { SET_ERROR(res); return -1; }
+    self->props = Lzma2Enc_WriteProperties(self->lzma2);
+    return 0;
+}
+
+static PyObject*
+Compressor_compress(Compressor *self, PyObject *args) {
+    unsigned char *data = NULL;
+    Py_ssize_t size = 0;
+    MemInStream in;
+    SRes res = SZ_OK;
+    if (!PyArg_ParseTuple(args, BYTES_FMT, &data, &size)) return NULL;
+    if (self->lzma2 == NULL) { PyErr_SetString(LZMAError, "Compressor not initialized"); return NULL; }
+    in.stream.Read = mem_read;
+    in.data = (const Byte*)data; in.pos = 0; in.size = (size_t)size;
+    self->out.stream.Write = mem_write;
+    self->out.used = 0; self->out.nomem = 0;
+    Py_BEGIN_ALLOW_THREADS;
+    res = Lzma2Enc_Encode(self->lzma2, (ISeqOutStream*)&self->out, (ISeqInStream*)&in, NULL);
+    Py_END_ALLOW_THREADS;
+    if (res == SZ_OK && self->out.nomem) res = SZ_ERROR_MEM;
+    if (res != SZ_OK) { SET_ERROR(res); return NULL; }
+    return Py_BuildValue(BYTES_FMT, self->out.data, (Py_ssize_t)self->out.used);
+}
+
+static PyObject*
+Compressor_get_props(Compressor *self, void *closure) {
+    return Py_BuildValue(BYTES_FMT, &self->props, (Py_ssize_t)1);
+}
+
+static PyMethodDef Compressor_methods[] = {
+    {"compress", (PyCFunction)Compressor_compress, METH_VARARGS,
+        "compress(data) -> bytes\n\nCompress data into a self contained LZMA2 stream, reusing the encoder state from previous calls."
+    },
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef Compressor_getsetters[] = {
+    {"props", (getter)Compressor_get_props, NULL, "The LZMA2 properties for the streams produced by this compressor, as a bytestring", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject CompressorType = {
+#if PY_MAJOR_VERSION >= 3
+    PyVarObject_HEAD_INIT(NULL, 0)
+#else
+    PyObject_HEAD_INIT(NULL) 0,
+#endif
+    /* tp_name           */ "lzma_binding.LZMA2Compressor",
+    /* tp_basicsize      */ sizeof(Compressor),
+    /* tp_itemsize       */ 0,
+    /* tp_dealloc        */ (destructor)Compressor_dealloc,
+    /* tp_print          */ 0,
+    /* tp_getattr        */ 0,
+    /* tp_setattr        */ 0,
+    /* tp_compare        */ 0,
+    /* tp_repr           */ 0,
+    /* tp_as_number      */ 0,
+    /* tp_as_sequence    */ 0,
+    /* tp_as_mapping     */ 0,
+    /* tp_hash           */ 0,
+    /* tp_call           */ 0,
+    /* tp_str            */ 0,
+    /* tp_getattro       */ 0,
+    /* tp_setattro       */ 0,
+    /* tp_as_buffer      */ 0,
+    /* tp_flags          */ Py_TPFLAGS_DEFAULT,
+    /* tp_doc            */ "LZMA2Compressor(preset=5)\n\nReusable LZMA2 compressor. Keeps the encoder dictionary/match-finder arenas alive between compress() calls, which is much faster when compressing many small blobs.",
+    /* tp_traverse       */ 0,
+    /* tp_clear          */ 0,
+    /* tp_richcompare    */ 0,
+    /* tp_weaklistoffset */ 0,
+    /* tp_iter           */ 0,
+    /* tp_iternext       */ 0,
+    /* tp_methods        */ Compressor_methods,
+    /* tp_members        */ 0,
+    /* tp_getset         */ Compressor_getsetters,
+    /* tp_base           */ 0,
+    /* tp_dict           */ 0,
+    /* tp_descr_get      */ 0,
+    /* tp_descr_set      */ 0,
+    /* tp_dictoffset     */ 0,
+    /* tp_init           */ (initproc)Compressor_init,
+    /* tp_alloc          */ 0,
+    /* tp_new            */ 0,
+};
+// }}}
+
 static char lzma_binding_doc[] = "Bindings to the LZMA (de)compression C code";
 
 static PyMethodDef lzma_binding_methods[] = {
     {"decompress2", decompress2, METH_VARARGS,
-        "Decompress an LZMA2 encoded block, of unknown compressed size (reads till LZMA2 EOS marker)"
+        "decompress2(read, seek, write, props, bufsize, threads=1)\n\nDecompress an LZMA2 encoded block, of unknown compressed size (reads till LZMA2 EOS marker). When threads > 1, the stream is buffered in memory and the runs of chunks between dictionary resets are decoded concurrently."
     },
 
     {"compress", compress, METH_VARARGS,
-        "Compress data into an LZMA2 block, writing it to outfile. Returns the LZMA2 properties as a bytestring."
+        "compress(read, write, progress_callback=None, preset=5, threads=1)\n\nCompress data into an LZMA2 block, writing it to outfile. When threads > 1, independent slices of the input are compressed concurrently. Returns the LZMA2 properties as a bytestring."
     },
 
     {"decompress", decompress, METH_VARARGS,
@@ -443,6 +1361,14 @@ CALIBRE_MODINIT_FUNC initlzma_binding(void) {
     PyObject *m = NULL, *preset_map = NULL, *temp = NULL;
     int i = 0;
     init_crc_table();
+    DecompressorType.tp_new = PyType_GenericNew;
+    if (PyType_Ready(&DecompressorType) < 0) {
+        INITERROR;
+    }
+    CompressorType.tp_new = PyType_GenericNew;
+    if (PyType_Ready(&CompressorType) < 0) {
+        INITERROR;
+    }
     LZMAError = PyErr_NewException("lzma_binding.error", NULL, NULL);
     if (!LZMAError) {
         INITERROR;
@@ -451,6 +1377,10 @@ CALIBRE_MODINIT_FUNC initlzma_binding(void) {
     if (m == NULL) {
         INITERROR;
     }
+    Py_INCREF(&DecompressorType);
+    PyModule_AddObject(m, "LZMA2Decompressor", (PyObject *)&DecompressorType);
+    Py_INCREF(&CompressorType);
+    PyModule_AddObject(m, "LZMA2Compressor", (PyObject *)&CompressorType);
     preset_map = PyTuple_New(10);
     if (preset_map == NULL) {
         INITERROR;
@@ -392,7 +392,7 @@ def decompress(raw, outfile=None):
     return outfile
 
 
-def compress(raw, outfile=None, level=5, check_type='crc64'):
+def compress(raw, outfile=None, level=5, check_type='crc64', threads=1):
     '''
     Compress the specified data into a .xz stream (which can be written directly as
     an .xz file.
@@ -405,6 +405,9 @@ def compress(raw, outfile=None, level=5, check_type='crc64'):
             slowest/best compression
     :check_type: The type of data integrity check to write into the output .xz stream.
                  Should be one of: 'crc32', 'crc64', 'sha256', or None
+    :threads: Number of threads to use for compression. Values greater than one
+              compress independent slices of the input concurrently, at a small
+              cost in compression ratio.
     '''
     if isinstance(raw, bytes):
         raw = BytesIO(raw)
@@ -451,7 +454,7 @@ def compress(raw, outfile=None, level=5, check_type='crc64'):
             checker(ans)
         return ans
 
-    lzma.compress(read, outfile.write, None, level)
+    lzma.compress(read, outfile.write, None, level, threads)
     unpadded_size = outfile.tell() - start
     pos = outfile.tell()
     if pos % 4:
@@ -9,6 +9,26 @@
 #define PY_SSIZE_T_CLEAN
 #include <Python.h>
 #include <structmember.h>
+#include <pythread.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOKENIZER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if PY_VERSION_HEX < 0x03030000
+#define PyUnicode_GET_LENGTH PyUnicode_GET_SIZE
+#endif
+
+static PyObject *COMPILED_TOKEN_REGEXPS = NULL, *UNICODE_UNESCAPE = NULL, *NEWLINE_UNESCAPE = NULL, *SIMPLE_UNESCAPE = NULL, *FIND_NEWLINES = NULL, *TOKEN_DISPATCH = NULL;
+static PyObject *COLON = NULL, *SCOLON = NULL, *LPAR = NULL, *RPAR = NULL, *LBRACE = NULL, *RBRACE = NULL, *LBOX = NULL, *RBOX = NULL, *DELIM_TOK = NULL, *INTEGER = NULL, *STRING_TOK = NULL;
+
+static Py_ssize_t BAD_COMMENT, BAD_STRING, PERCENTAGE, DIMENSION, ATKEYWORD, FUNCTION, COMMENT, NUMBER, STRING, IDENT, HASH, URI, S, CDO, CDC, DELIM = -1;
+
+static PyObject* clone_unicode(const PyObject* src, Py_ssize_t start_offset, Py_ssize_t end_offset);
+static PyObject* unicode_to_number(PyObject *src);
+static PyObject* lowercase(PyObject *x);
 
 // Token type definition {{{
 typedef struct {
@@ -21,6 +41,14 @@ typedef struct {
     PyObject *unit;
     PyObject *line;
     PyObject *column;
+    // Tokens created by tokenize_flat() store only their position inside
+    // the retained source string. The python objects above start out NULL
+    // and are built on first access, since most tokens are never inspected
+    // when flattening stylesheets.
+    PyObject *source;
+    PyObject *type_name;
+    Py_ssize_t start, length, split, type_id, line_no, column_no;
+    int eof_bad_string;
 
 } tokenizer_Token;
 
@@ -34,6 +62,8 @@ tokenizer_Token_dealloc(tokenizer_Token* self)
     Py_XDECREF(self->unit); self->unit = NULL;
     Py_XDECREF(self->line); self->line = NULL;
     Py_XDECREF(self->column); self->column = NULL;
+    Py_XDECREF(self->source); self->source = NULL;
+    Py_XDECREF(self->type_name); self->type_name = NULL;
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -55,6 +85,189 @@ tokenizer_Token_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     return (PyObject *)self;
 }
 
+// Lazy attribute building {{{
+
+static PyObject *
+Token_get_as_css(tokenizer_Token *self, void *closure) {
+    if (self->_as_css == NULL) {
+        if (self->source == NULL) { PyErr_SetString(PyExc_AttributeError, "_as_css"); return NULL; }
+        self->_as_css = clone_unicode(self->source, self->start, PyUnicode_GET_LENGTH(self->source) - self->start - self->length);
+        if (self->_as_css == NULL) return NULL;
+    }
+    Py_INCREF(self->_as_css);
+    return self->_as_css;
+}
+
+// Build the value (and unit) for a lazy token, mirroring exactly what the
+// old eager code in tokenize_flat() used to do. The unescape callables live
+// in module globals set by init(), which are retained for as long as any
+// tokens may be alive in practice, since cleanup() is never called by
+// calibre.
+static int
+Token_build_value(tokenizer_Token *self) {
+    PyObject *css_value = NULL, *value = NULL, *unit = NULL, *item = NULL;
+    if (self->value != NULL || self->source == NULL) return 0;
+    if (SIMPLE_UNESCAPE == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tokenizer module not initialized. You must call init() first."); return -1;
+    }
+    css_value = Token_get_as_css(self, NULL);
+    if (css_value == NULL) return -1;
+
+#define LUNESCAPE(x, func) item = PyObject_CallFunctionObjArgs(func, x, NULL); if (item == NULL) { goto error; } Py_DECREF(x); x = item; item = NULL;
+#define LTONUMBER(x) item = unicode_to_number(x); if (item == NULL) goto error; Py_DECREF(x); x = item; item = NULL;
+
+    if (self->type_id == DIMENSION) {
+        value = clone_unicode(css_value, 0, self->length - self->split);
+        if (value == NULL) goto error;
+        LTONUMBER(value);
+        unit = clone_unicode(css_value, self->split, 0);
+        if (unit == NULL) goto error;
+        LUNESCAPE(unit, SIMPLE_UNESCAPE);
+        LUNESCAPE(unit, UNICODE_UNESCAPE);
+        item = lowercase(unit);
+        if (item == NULL) goto error;
+        Py_DECREF(unit); unit = item; item = NULL;
+    } else
+
+    if (self->type_id == PERCENTAGE) {
+        if (self->length > 0) {
+            value = clone_unicode(css_value, 0, 1);
+        } else { value = css_value; Py_INCREF(value); }
+        if (value == NULL) goto error;
+        LTONUMBER(value);
+        unit = PyUnicode_FromString("%");
+        if (unit == NULL) goto error;
+    } else
+
+    if (self->type_id == NUMBER) {
+        value = css_value; Py_INCREF(value);
+        LTONUMBER(value);
+    } else
+
+    if (self->type_id == IDENT || self->type_id == ATKEYWORD || self->type_id == HASH || self->type_id == FUNCTION) {
+        value = PyObject_CallFunctionObjArgs(SIMPLE_UNESCAPE, css_value, NULL);
+        if (value == NULL) goto error;
+        LUNESCAPE(value, UNICODE_UNESCAPE);
+    } else
+
+    if (self->type_id == STRING) {
+        if (self->length > 1) {  // remove quotes
+            value = clone_unicode(css_value, 1, 1);
+        } else { value = css_value; Py_INCREF(value); }
+        if (value == NULL) goto error;
+        LUNESCAPE(value, NEWLINE_UNESCAPE);
+        LUNESCAPE(value, SIMPLE_UNESCAPE);
+        LUNESCAPE(value, UNICODE_UNESCAPE);
+    } else
+
+    if (self->type_id == BAD_STRING && self->eof_bad_string) {
+        if (self->length > 0) {  // remove quote
+            value = clone_unicode(css_value, 1, 0);
+        } else { value = css_value; Py_INCREF(value); }
+        if (value == NULL) goto error;
+        LUNESCAPE(value, NEWLINE_UNESCAPE);
+        LUNESCAPE(value, SIMPLE_UNESCAPE);
+        LUNESCAPE(value, UNICODE_UNESCAPE);
+    } else {
+        value = css_value; Py_INCREF(value);
+    }
+
+    if (unit == NULL) { unit = Py_None; Py_INCREF(unit); }
+    self->value = value; self->unit = unit;
+    Py_DECREF(css_value);
+    return 0;
+error:
+    Py_XDECREF(css_value); Py_XDECREF(value); Py_XDECREF(unit); Py_XDECREF(item);
+    return -1;
+#undef LUNESCAPE
+#undef LTONUMBER
+}
+
+static PyObject *
+Token_get_type(tokenizer_Token *self, void *closure) {
+    if (self->type == NULL) {
+        if (self->source == NULL || self->type_name == NULL) { PyErr_SetString(PyExc_AttributeError, "type"); return NULL; }
+        if (self->type_id == NUMBER) {
+            // NUMBER tokens with an integral value are reported as INTEGER
+            if (Token_build_value(self) != 0) return NULL;
+            self->type = PyFloat_Check(self->value) ? self->type_name : INTEGER;
+        } else self->type = self->type_name;
+        Py_INCREF(self->type);
+    }
+    Py_INCREF(self->type);
+    return self->type;
+}
+
+static PyObject *
+Token_get_value(tokenizer_Token *self, void *closure) {
+    if (self->value == NULL) {
+        if (Token_build_value(self) != 0) return NULL;
+        if (self->value == NULL) { PyErr_SetString(PyExc_AttributeError, "value"); return NULL; }
+    }
+    Py_INCREF(self->value);
+    return self->value;
+}
+
+static PyObject *
+Token_get_unit(tokenizer_Token *self, void *closure) {
+    if (self->unit == NULL) {
+        if (Token_build_value(self) != 0) return NULL;
+        if (self->unit == NULL) { PyErr_SetString(PyExc_AttributeError, "unit"); return NULL; }
+    }
+    Py_INCREF(self->unit);
+    return self->unit;
+}
+
+#if PY_MAJOR_VERSION >= 3
+#define ssize_to_pyint(x) PyLong_FromSsize_t(x)
+#else
+#define ssize_to_pyint(x) PyInt_FromSsize_t(x)
+#endif
+
+static PyObject *
+Token_get_line(tokenizer_Token *self, void *closure) {
+    if (self->line == NULL) {
+        if (self->source == NULL) { PyErr_SetString(PyExc_AttributeError, "line"); return NULL; }
+        self->line = ssize_to_pyint(self->line_no);
+        if (self->line == NULL) return NULL;
+    }
+    Py_INCREF(self->line);
+    return self->line;
+}
+
+static PyObject *
+Token_get_column(tokenizer_Token *self, void *closure) {
+    if (self->column == NULL) {
+        if (self->source == NULL) { PyErr_SetString(PyExc_AttributeError, "column"); return NULL; }
+        self->column = ssize_to_pyint(self->column_no);
+        if (self->column == NULL) return NULL;
+    }
+    Py_INCREF(self->column);
+    return self->column;
+}
+
+// Attributes remain settable (and deletable), as they were when they were
+// plain T_OBJECT_EX members, the closure carries the offset of the slot.
+static int
+Token_set_field(tokenizer_Token *self, PyObject *val, void *closure) {
+    PyObject **slot = (PyObject **)((char *)self + (Py_ssize_t)closure);
+    Py_XINCREF(val);
+    Py_XDECREF(*slot);
+    *slot = val;
+    return 0;
+}
+
+// Force all lazy attributes to be built, used by repr
+static int
+Token_materialize(tokenizer_Token *self) {
+    PyObject *t;
+#define GET(func) t = func(self, NULL); if (t == NULL) return -1; Py_DECREF(t);
+    GET(Token_get_type); GET(Token_get_as_css); GET(Token_get_value); GET(Token_get_line); GET(Token_get_column);
+#undef GET
+    return 0;
+}
+// }}}
+
 #if PY_MAJOR_VERSION >= 3
 #define PyObject_Unicode_Compat(arg) PyObject_Str(arg)
 #else
@@ -64,6 +277,7 @@ tokenizer_Token_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 static PyObject *
 tokenizer_Token_repr(tokenizer_Token *self) {
     PyObject *type = NULL, *line = NULL, *column = NULL, *value = NULL, *ans = NULL, *unit = NULL;
+    if (self->source != NULL && Token_materialize(self) != 0) PyErr_Clear();
     if (!self->type || !self->line || !self->column || !self->value)
         return PyBytes_FromString("<Token NULL fields>");
     type = PyObject_Unicode_Compat(self->type);
@@ -86,6 +300,7 @@ tokenizer_Token_repr(tokenizer_Token *self) {
 
 static PyObject *
 tokenizer_Token_as_css(tokenizer_Token *self, PyObject *args, PyObject *kwargs) {
+    if (!self->_as_css && self->source != NULL) return Token_get_as_css(self, NULL);
     if (!self->_as_css) {
         Py_RETURN_NONE;
     }
@@ -95,12 +310,16 @@ tokenizer_Token_as_css(tokenizer_Token *self, PyObject *args, PyObject *kwargs)
 
 static PyMemberDef tokenizer_Token_members[] = {
     {"is_container", T_OBJECT_EX, offsetof(tokenizer_Token, is_container), 0, "False unless this token is a  container for other tokens"},
-    {"type", T_OBJECT_EX, offsetof(tokenizer_Token, type), 0, "The token type"},
-    {"_as_css", T_OBJECT_EX, offsetof(tokenizer_Token, _as_css), 0, "Internal variable, use as_css() method instead."},
-    {"value", T_OBJECT_EX, offsetof(tokenizer_Token, value), 0, "The token value"},
-    {"unit", T_OBJECT_EX, offsetof(tokenizer_Token, unit), 0, "The token unit"},
-    {"line", T_OBJECT_EX, offsetof(tokenizer_Token, line), 0, "The token line number"},
-    {"column", T_OBJECT_EX, offsetof(tokenizer_Token, column), 0, "The token column number"},
+    {NULL}  /* Sentinel */
+};
+
+static PyGetSetDef tokenizer_Token_getsetters[] = {
+    {"type", (getter)Token_get_type, (setter)Token_set_field, "The token type", (void *)offsetof(tokenizer_Token, type)},
+    {"_as_css", (getter)Token_get_as_css, (setter)Token_set_field, "Internal variable, use as_css() method instead.", (void *)offsetof(tokenizer_Token, _as_css)},
+    {"value", (getter)Token_get_value, (setter)Token_set_field, "The token value", (void *)offsetof(tokenizer_Token, value)},
+    {"unit", (getter)Token_get_unit, (setter)Token_set_field, "The token unit", (void *)offsetof(tokenizer_Token, unit)},
+    {"line", (getter)Token_get_line, (setter)Token_set_field, "The token line number", (void *)offsetof(tokenizer_Token, line)},
+    {"column", (getter)Token_get_column, (setter)Token_set_field, "The token column number", (void *)offsetof(tokenizer_Token, column)},
     {NULL}  /* Sentinel */
 };
 
@@ -142,7 +361,7 @@ static PyTypeObject tokenizer_TokenType = { // {{{
         /* tp_iternext       */ 0,
         /* tp_methods        */ tokenizer_Token_methods,
         /* tp_members        */ tokenizer_Token_members,
-        /* tp_getset         */ 0,
+        /* tp_getset         */ tokenizer_Token_getsetters,
         /* tp_base           */ 0,
         /* tp_dict           */ 0,
         /* tp_descr_get      */ 0,
@@ -152,12 +371,21 @@ static PyTypeObject tokenizer_TokenType = { // {{{
         /* tp_alloc          */ 0,
         /* tp_new            */ tokenizer_Token_new,
 }; // }}}
-// }}}
 
-static PyObject *COMPILED_TOKEN_REGEXPS = NULL, *UNICODE_UNESCAPE = NULL, *NEWLINE_UNESCAPE = NULL, *SIMPLE_UNESCAPE = NULL, *FIND_NEWLINES = NULL, *TOKEN_DISPATCH = NULL;
-static PyObject *COLON = NULL, *SCOLON = NULL, *LPAR = NULL, *RPAR = NULL, *LBRACE = NULL, *RBRACE = NULL, *LBOX = NULL, *RBOX = NULL, *DELIM_TOK = NULL, *INTEGER = NULL, *STRING_TOK = NULL;
-
-static Py_ssize_t BAD_COMMENT, BAD_STRING, PERCENTAGE, DIMENSION, ATKEYWORD, FUNCTION, COMMENT, NUMBER, STRING, IDENT, HASH, URI, DELIM = -1;
+// Create a lazy token holding only a reference to the source string and the
+// information needed to build its python level attributes on first access.
+static tokenizer_Token*
+Token_create_lazy(PyObject *source, Py_ssize_t type_id, PyObject *type_name, Py_ssize_t start, Py_ssize_t length, Py_ssize_t split, int eof_bad_string, Py_ssize_t line, Py_ssize_t column) {
+    tokenizer_Token *self = (tokenizer_Token *)tokenizer_TokenType.tp_alloc(&tokenizer_TokenType, 0);
+    if (self == NULL) { PyErr_NoMemory(); return NULL; }
+    self->source = source; Py_INCREF(source);
+    self->type_name = type_name; Py_INCREF(type_name);
+    self->type_id = type_id; self->start = start; self->length = length; self->split = split;
+    self->eof_bad_string = eof_bad_string; self->line_no = line; self->column_no = column;
+    self->is_container = Py_False; Py_INCREF(self->is_container);
+    return self;
+}
+// }}}
 
 #define CLEANUP(x) Py_XDECREF((x)); x = NULL;
 
@@ -182,7 +410,7 @@ tokenize_init(PyObject *self, PyObject *args) {
 #define SETCONST(x) do { (x) = PyNumber_AsSsize_t(PyDict_GetItemString(cti, #x), PyExc_OverflowError); \
                          if((x) == -1 && PyErr_Occurred() != NULL) { return NULL; } \
                        } while(0)
-    SETCONST(BAD_COMMENT); SETCONST(BAD_STRING); SETCONST(PERCENTAGE); SETCONST(DIMENSION); SETCONST(ATKEYWORD); SETCONST(FUNCTION); SETCONST(COMMENT); SETCONST(NUMBER); SETCONST(STRING); SETCONST(IDENT); SETCONST(HASH); SETCONST(URI);
+    SETCONST(BAD_COMMENT); SETCONST(BAD_STRING); SETCONST(PERCENTAGE); SETCONST(DIMENSION); SETCONST(ATKEYWORD); SETCONST(FUNCTION); SETCONST(COMMENT); SETCONST(NUMBER); SETCONST(STRING); SETCONST(IDENT); SETCONST(HASH); SETCONST(URI); SETCONST(S); SETCONST(CDO); SETCONST(CDC);
 
     Py_RETURN_NONE;
 }
@@ -194,7 +422,6 @@ tokenize_init(PyObject *self, PyObject *args) {
     for (Py_ssize_t iteridx = 0; iteridx < PyUnicode_GET_LENGTH(unicode_object); iteridx++) { \
         Py_UCS4 ch = PyUnicode_READ(_kind, _data, iteridx);
 #else
-#define PyUnicode_GET_LENGTH PyUnicode_GET_SIZE
 #define ITER_CODE_PTS(unicode_object) { \
     Py_UNICODE *_data = PyUnicode_AS_UNICODE(unicode_object); \
     Py_ssize_t iteridx; \
@@ -222,16 +449,41 @@ static PyObject *unicode_to_number(PyObject *src) {
 }
 
 
-static void lowercase(PyObject *x) {
-    ITER_CODE_PTS(x)
-        if ('A' <= ch && ch <= 'Z') {
+// Return a new reference to x with A-Z lowercased. x must not be modified
+// in place: one character strings (a one letter dimension unit, for
+// example) can be cached singletons shared with the rest of the
+// interpreter.
+static PyObject* lowercase(PyObject *x) {
 #if PY_VERSION_HEX >= 0x03030000
-            PyUnicode_WRITE(_kind, _data, iteridx, ch + 32);
+    Py_ssize_t i, len = PyUnicode_GET_LENGTH(x);
+    int kind = PyUnicode_KIND(x);
+    void *data = PyUnicode_DATA(x), *buf;
+    PyObject *ans;
+    Py_UCS4 ch, maxchar = 0;
+    for (i = 0; i < len; i++) {
+        ch = PyUnicode_READ(kind, data, i);
+        if (ch > maxchar) maxchar = ch;
+    }
+    ans = PyUnicode_New(len, maxchar);
+    if (ans == NULL) return NULL;
+    buf = PyUnicode_DATA(ans);
+    for (i = 0; i < len; i++) {
+        ch = PyUnicode_READ(kind, data, i);
+        if ('A' <= ch && ch <= 'Z') ch += 32;
+        PyUnicode_WRITE(PyUnicode_KIND(ans), buf, i, ch);
+    }
+    return ans;
 #else
-            _data[iteridx] += 32;
+    Py_ssize_t i, len = PyUnicode_GET_LENGTH(x);
+    const Py_UNICODE *data = PyUnicode_AS_UNICODE(x);
+    Py_UNICODE *buf;
+    PyObject *ans = PyUnicode_FromUnicode(NULL, len);
+    if (ans == NULL) return NULL;
+    buf = PyUnicode_AS_UNICODE(ans);
+    for (i = 0; i < len; i++)
+        buf[i] = ('A' <= data[i] && data[i] <= 'Z') ? data[i] + 32 : data[i];
+    return ans;
 #endif
-        }
-    END_ITER_CODE_PTS
 }
 
 static PyObject*
@@ -256,45 +508,158 @@ clone_unicode(const PyObject* src, Py_ssize_t start_offset, Py_ssize_t end_offse
 #endif
 }
 
-static PyObject*
-tokenize_flat(PyObject *self, PyObject *args) {
+// Fast scanning of character runs {{{
+// The common CSS tokens (whitespace runs, plain ASCII identifiers and
+// numbers) can be recognized without calling into the regex engine. These
+// helpers find the end of such runs, using 16 byte SSE2 compares when the
+// source uses the 1 byte unicode representation, which CSS sources almost
+// always do.
+
+#define is_css_space(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n' || (c) == '\f')
+#define is_ascii_nmchar(c) (('a' <= ((c) | 32) && ((c) | 32) <= 'z') || ('0' <= (c) && (c) <= '9') || (c) == '_' || (c) == '-')
+
+#ifdef TOKENIZER_USE_SSE2
+static __m128i
+bytes_in_range(__m128i v, unsigned char lo, unsigned char hi) {
+    const __m128i zero = _mm_setzero_si128();
+    return _mm_and_si128(
+        _mm_cmpeq_epi8(_mm_subs_epu8(v, _mm_set1_epi8((char)hi)), zero),
+        _mm_cmpeq_epi8(_mm_subs_epu8(_mm_set1_epi8((char)lo), v), zero));
+}
+#endif
+
+#if PY_VERSION_HEX >= 0x03030000
+static Py_ssize_t
+scan_whitespace(int kind, const void *data, Py_ssize_t pos, Py_ssize_t limit) {
+#ifdef TOKENIZER_USE_SSE2
+    if (kind == PyUnicode_1BYTE_KIND) {
+        const unsigned char *p = (const unsigned char *)data;
+        while (pos + 16 <= limit) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(p + pos));
+            __m128i ws = _mm_or_si128(_mm_or_si128(
+                    _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+                _mm_or_si128(_mm_or_si128(
+                    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')),
+                    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))),
+                    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\f'))));
+            if (_mm_movemask_epi8(ws) != 0xFFFF) break;
+            pos += 16;
+        }
+    }
+#endif
+    while (pos < limit && is_css_space(PyUnicode_READ(kind, data, pos))) pos++;
+    return pos;
+}
+
+static Py_ssize_t
+scan_nmchars(int kind, const void *data, Py_ssize_t pos, Py_ssize_t limit) {
+#ifdef TOKENIZER_USE_SSE2
+    if (kind == PyUnicode_1BYTE_KIND) {
+        const unsigned char *p = (const unsigned char *)data;
+        while (pos + 16 <= limit) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(p + pos));
+            __m128i nm = _mm_or_si128(_mm_or_si128(
+                    bytes_in_range(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 'z'),
+                    bytes_in_range(chunk, '0', '9')),
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')),
+                    _mm_cmpeq_epi8(chunk, _mm_set1_epi8('-'))));
+            if (_mm_movemask_epi8(nm) != 0xFFFF) break;
+            pos += 16;
+        }
+    }
+#endif
+    while (pos < limit && is_ascii_nmchar(PyUnicode_READ(kind, data, pos))) pos++;
+    return pos;
+}
+#else
+static Py_ssize_t
+scan_whitespace(const Py_UNICODE *data, Py_ssize_t pos, Py_ssize_t limit) {
+    while (pos < limit && is_css_space(data[pos])) pos++;
+    return pos;
+}
+
+static Py_ssize_t
+scan_nmchars(const Py_UNICODE *data, Py_ssize_t pos, Py_ssize_t limit) {
+    while (pos < limit && is_ascii_nmchar(data[pos])) pos++;
+    return pos;
+}
+#endif
+
+// Count the newlines in the token spanning [pos, limit), with the same
+// semantics as the nl macro from token_data.py (\n|\r\n|\r|\f), reporting
+// the number of newlines and the position just past the last one, relative
+// to pos, so that callers do not have to run the FIND_NEWLINES regex on
+// every token.
+static void
+#if PY_VERSION_HEX >= 0x03030000
+count_newlines(int kind, const void *data, Py_ssize_t pos, Py_ssize_t limit, Py_ssize_t *num, Py_ssize_t *last_end) {
+#else
+count_newlines(const Py_UNICODE *data, Py_ssize_t pos, Py_ssize_t limit, Py_ssize_t *num, Py_ssize_t *last_end) {
+#endif
+    int cr = 0;
+    Py_ssize_t i;
+    *num = 0; *last_end = 0;
+    for (i = pos; i < limit; i++) {
+#if PY_VERSION_HEX >= 0x03030000
+        Py_UCS4 ch = PyUnicode_READ(kind, data, i);
+#else
+        Py_UNICODE ch = data[i];
+#endif
+        if (ch == '\n') {
+            if (cr) cr = 0; else (*num)++;  // a \n preceded by \r is part of the same newline
+            *last_end = i - pos + 1;
+        } else if (ch == '\r') {
+            (*num)++; *last_end = i - pos + 1; cr = 1;
+        } else if (ch == '\f') {
+            (*num)++; *last_end = i - pos + 1; cr = 0;
+        } else cr = 0;
+    }
+}
+// }}}
+
+// Tokenize py_source starting at pos (with the given starting line/column)
+// appending the tokens to the (already created) tokens list. Returns 0 on
+// success and -1 with an exception set on failure.
+static int
+tokenize_span(PyObject *tokens, PyObject *py_source, int ignore_comments, Py_ssize_t pos, Py_ssize_t line, Py_ssize_t column) {
 #if PY_VERSION_HEX >= 0x03030000
-    void *css_source = NULL; int css_kind; Py_UCS4 c = 0, codepoint = 0;
+    void *css_source = NULL; int css_kind; Py_UCS4 c = 0, codepoint = 0, nc = 0;
 #define first_char(string) PyUnicode_READ_CHAR(string, 0)
 #define unicode_from_data(data, sz) PyUnicode_FromKindAndData(css_kind, data, sz)
+#define char_at(idx) PyUnicode_READ(css_kind, css_source, (idx))
+#define scan_ws_run(start) scan_whitespace(css_kind, css_source, (start), source_len)
+#define scan_nm_run(start) scan_nmchars(css_kind, css_source, (start), source_len)
 #else
-    Py_UNICODE *css_source = NULL, c = 0, codepoint = 0;
+    Py_UNICODE *css_source = NULL, c = 0, codepoint = 0, nc = 0;
 #define first_char(string) PyUnicode_AS_UNICODE(string)[0]
 #define unicode_from_data(data, sz) PyUnicode_FromUnicode(data, sz)
+#define char_at(idx) css_source[(idx)]
+#define scan_ws_run(start) scan_whitespace(css_source, (start), source_len)
+#define scan_nm_run(start) scan_nmchars(css_source, (start), source_len)
 #endif
-    PyObject *ic = NULL, *token = NULL, *tokens = NULL, *type_name = NULL, *css_value = NULL, *value = NULL, *unit = NULL, *tries = NULL, *match = NULL, *match_func = NULL, *py_source = NULL, *item = NULL, *newlines = NULL;
-    int ignore_comments = 0;
-    Py_ssize_t pos = 0, line = 1, column = 1, i = 0;
-    Py_ssize_t length = 0, next_pos = 0, type_ = -1, source_len = 0;
-
-
-    if (COMPILED_TOKEN_REGEXPS == NULL) {
-        PyErr_SetString(PyExc_RuntimeError, "tokenizer module not initialized. You must call init() first."); return NULL;
-    }
+#if PY_VERSION_HEX >= 0x03030000
+#define count_nl_run(start, limit) count_newlines(css_kind, css_source, (start), (limit), &nl_count, &nl_last_end)
+#else
+#define count_nl_run(start, limit) count_newlines(css_source, (start), (limit), &nl_count, &nl_last_end)
+#endif
+    PyObject *token = NULL, *type_name = NULL, *value = NULL, *tries = NULL, *match = NULL, *match_func = NULL, *item = NULL;
+    int eof_bad_string = 0;
+    Py_ssize_t i = 0;
+    Py_ssize_t length = 0, next_pos = 0, type_ = -1, source_len = 0, run_end = 0, fast_type = -1, nl_count = 0, nl_last_end = 0, split = 0;
 
-    if (!PyArg_ParseTuple(args, "UO", &py_source, &ic)) return NULL;
-    if (PyObject_IsTrue(ic)) ignore_comments = 1;
 #if PY_VERSION_HEX >= 0x03030000
-    if (PyUnicode_READY(py_source) != 0) return NULL;
+    if (PyUnicode_READY(py_source) != 0) return -1;
     css_source = PyUnicode_DATA(py_source); css_kind = PyUnicode_KIND(py_source);
 #else
     css_source = PyUnicode_AS_UNICODE(py_source);
 #endif
     source_len = PyUnicode_GET_LENGTH(py_source);
 
-    tokens = PyList_New(0);
-    if (tokens == NULL) return PyErr_NoMemory();
-
 #define UNESCAPE(x, func) item = PyObject_CallFunctionObjArgs(func, x, NULL); if (item == NULL) { goto error; } Py_DECREF(x); x = item; item = NULL;
 
-#define TONUMBER(x) item = unicode_to_number(x); if (item == NULL) goto error; Py_DECREF(x); x = item; item = NULL;
-
-#define SINGLE(x) { type_ = -1; type_name = x; Py_INCREF(type_name); css_value = x; Py_INCREF(css_value); }
+#define SINGLE(x) { type_ = -1; type_name = x; }
 
     while (pos < source_len) {
 #if PY_VERSION_HEX >= 0x03030000
@@ -303,77 +668,103 @@ tokenize_flat(PyObject *self, PyObject *args) {
         c = css_source[pos];
 #endif
 
-        css_value = NULL; type_name = NULL; value = NULL; unit = NULL; match = NULL;
+        // type_name is a borrowed reference (to a singleton or a dispatch
+        // tuple member), ownership is taken by Token_create_lazy()
+        type_name = NULL; value = NULL; match = NULL;
+        type_ = -1; split = 0; eof_bad_string = 0; next_pos = pos + 1;
 
         if (c == ':') SINGLE(COLON) else if (c == ';') SINGLE(SCOLON) else if (c == '(') SINGLE(LPAR) else if (c == ')') SINGLE(RPAR) else if (c == '{') SINGLE(LBRACE) else if (c == '}') SINGLE(RBRACE) else if (c == '[') SINGLE(LBOX) else if (c == ']') SINGLE(RBOX) else
         {
             codepoint = (c > 160) ? 160: c;
             tries = PyList_GET_ITEM(TOKEN_DISPATCH, codepoint);
-            for (i = 0; i < PyList_Size(tries); i++) {
+            // Fast paths for the common run tokens. These produce exactly
+            // the same tokens as the corresponding regexps would, without
+            // the cost of calling into the regex engine.
+            fast_type = -1;
+            if (is_css_space(c)) {
+                run_end = scan_ws_run(pos + 1); fast_type = S;
+            } else if (c == '_' || ('a' <= (c | 32) && (c | 32) <= 'z' && (c | 32) != 'u')) {
+                // A maximal ASCII nmchar run is a complete IDENT unless the
+                // next character could extend it (escape/nonascii) or turn
+                // it into a FUNCTION. Runs starting with u are left to the
+                // regexps as they may be URI or UNICODE-RANGE tokens.
+                run_end = scan_nm_run(pos + 1);
+                nc = (run_end < source_len) ? char_at(run_end) : 0;
+                if (nc != '\\' && nc != '(' && nc < 160) fast_type = IDENT;
+            } else if ('0' <= c && c <= '9') {
+                // num from token_data.py: [0-9]*\.[0-9]+|[0-9]+ (signs and
+                // leading dots are left to the regexps)
+                run_end = pos + 1;
+                while (run_end < source_len && (nc = char_at(run_end)) >= '0' && nc <= '9') run_end++;
+                if (run_end + 1 < source_len && char_at(run_end) == '.' && (nc = char_at(run_end + 1)) >= '0' && nc <= '9') {
+                    run_end += 2;
+                    while (run_end < source_len && (nc = char_at(run_end)) >= '0' && nc <= '9') run_end++;
+                }
+                // Only a NUMBER if the next character cannot make this a
+                // PERCENTAGE or DIMENSION instead
+                nc = (run_end < source_len) ? char_at(run_end) : 0;
+                if (nc != '%' && nc != '\\' && nc != '_' && nc != '-' && nc < 160 && !('a' <= (nc | 32) && (nc | 32) <= 'z')) fast_type = NUMBER;
+            }
+            if (fast_type != -1) {
+                for (i = 0; i < PyList_Size(tries); i++) {
+                    item = PyList_GET_ITEM(tries, i);
+                    type_ = PyNumber_AsSsize_t(PyTuple_GET_ITEM(item, 0), PyExc_OverflowError);
+                    if(type_ == -1 && PyErr_Occurred() != NULL) { goto error; }
+                    if (type_ != fast_type) continue;
+                    type_name = PyTuple_GET_ITEM(item, 1);
+                    next_pos = run_end;
+                    break;
+                }
+            }
+            if (type_name == NULL) for (i = 0; i < PyList_Size(tries); i++) {
                 item = PyList_GET_ITEM(tries, i);
                 match_func = PyTuple_GET_ITEM(item, 2);
                 match = PyObject_CallFunction(match_func, "On", py_source, pos);
                 if (match == NULL) { goto error; }
                 if (match != Py_None) {
-                    css_value = PyObject_CallMethod(match, "group", NULL);
-                    if (css_value == NULL) { goto error; }
+                    item = PyObject_CallMethod(match, "end", NULL);
+                    if (item == NULL) { goto error; }
+                    next_pos = PyNumber_AsSsize_t(item, PyExc_OverflowError);
+                    Py_DECREF(item); item = NULL;
+                    if(next_pos == -1 && PyErr_Occurred() != NULL) { goto error; }
+                    item = PyList_GET_ITEM(tries, i);
                     type_ = PyNumber_AsSsize_t(PyTuple_GET_ITEM(item, 0), PyExc_OverflowError);
                     if(type_ == -1 && PyErr_Occurred() != NULL) { goto error; }
                     type_name = PyTuple_GET_ITEM(item, 1);
-                    Py_INCREF(type_name);
                     break;
                 }
             }
-            if (css_value == NULL) {  // No match
-                type_ = DELIM; type_name = DELIM_TOK; Py_INCREF(type_name); css_value = unicode_from_data(&c, 1);
-                if (css_value == NULL) { goto error; }
+            if (type_name == NULL) {  // No match
+                type_ = DELIM; type_name = DELIM_TOK;
             }
         }
 
-        length = PyUnicode_GET_LENGTH(css_value);
-        next_pos = pos + length;
+        length = next_pos - pos;
+
+        if (type_ == BAD_STRING && next_pos == source_len) {
+            type_name = STRING_TOK; eof_bad_string = 1;
+        } else if (type_ == DIMENSION) {
+            // Record where the num part of the token ends (the regexps
+            // guarantee a maximal num match here), so that the value and
+            // unit can be built lazily without keeping the match around
+            i = pos;
+            if (char_at(i) == '+' || char_at(i) == '-') i++;
+            while (i < next_pos && (nc = char_at(i)) >= '0' && nc <= '9') i++;
+            if (i + 1 < next_pos && char_at(i) == '.' && (nc = char_at(i + 1)) >= '0' && nc <= '9') {
+                i += 2;
+                while (i < next_pos && (nc = char_at(i)) >= '0' && nc <= '9') i++;
+            }
+            split = i - pos;
+        }
 
-        // Now calculate the value and unit for this token (if any)
         if (! (ignore_comments && (type_ == COMMENT || type_ == BAD_COMMENT))) {
-            if (type_ == DIMENSION) {
-                value = PyObject_CallMethod(match, "group", "I", 1);
-                if (value == NULL) { goto error; }
-                TONUMBER(value);
-                unit = PyObject_CallMethod(match, "group", "I", 2);
-                if (unit == NULL) { goto error; }
-                UNESCAPE(unit, SIMPLE_UNESCAPE);
-                UNESCAPE(unit, UNICODE_UNESCAPE);
-                lowercase(unit);
-            } else
-
-            if (type_ == PERCENTAGE) {
-                if (PyUnicode_GET_LENGTH(css_value) > 0) {
-                    value = clone_unicode(css_value, 0, 1);
-                    if (value == NULL) goto error;
-                } else { value = css_value; Py_INCREF(value); }
-                if (value == NULL) goto error;
-                TONUMBER(value);
-                unit = PyUnicode_FromString("%");
-                if (unit == NULL) goto error;
-            } else
-
-            if (type_ == NUMBER) {
-                value = css_value; Py_INCREF(value);
-                TONUMBER(value);
-                if (!PyFloat_Check(value)) {
-                    Py_XDECREF(type_name);
-                    type_name = INTEGER;
-                    Py_INCREF(type_name);
-                }
-            } else
-
-            if (type_ == IDENT || type_ == ATKEYWORD || type_ == HASH || type_ == FUNCTION) {
-                value = PyObject_CallFunctionObjArgs(SIMPLE_UNESCAPE, css_value, NULL);
-                if (value == NULL) goto error;
-                UNESCAPE(value, UNICODE_UNESCAPE);
-            } else
+            token = (PyObject *)Token_create_lazy(py_source, type_, type_name, pos, length, split, eof_bad_string, line, column);
+            if (token == NULL) goto error;
 
             if (type_ == URI) {
+                // The URI value needs the match object to extract, so it
+                // cannot be built lazily. URI tokens are rare enough that
+                // building it eagerly does not matter.
                 value = PyObject_CallMethod(match, "group", "I", 1);
                 if (value == NULL) { goto error; }
                 if (PyObject_IsTrue(value) && PyUnicode_GET_LENGTH(value) > 1 && (first_char(value) == '"' || first_char(value) == '\'')) {
@@ -384,76 +775,708 @@ tokenize_flat(PyObject *self, PyObject *args) {
                 }
                 UNESCAPE(value, SIMPLE_UNESCAPE);
                 UNESCAPE(value, UNICODE_UNESCAPE);
-            } else
+                ((tokenizer_Token *)token)->value = value; value = NULL;
+                ((tokenizer_Token *)token)->unit = Py_None; Py_INCREF(Py_None);
+            }
 
-            if (type_ == STRING) {
-                if (PyObject_IsTrue(css_value) && PyUnicode_GET_LENGTH(css_value) > 1) {  // remove quotes
-                    value = clone_unicode(css_value, 1, 1);
-                } else {
-                    value = css_value; Py_INCREF(value);
-                }
-                UNESCAPE(value, NEWLINE_UNESCAPE);
-                UNESCAPE(value, SIMPLE_UNESCAPE);
-                UNESCAPE(value, UNICODE_UNESCAPE);
-            } else
-
-            if (type_ == BAD_STRING && next_pos == source_len) {
-                Py_XDECREF(type_name); type_name = STRING_TOK; Py_INCREF(type_name);
-                if (PyObject_IsTrue(css_value) && PyUnicode_GET_LENGTH(css_value) > 0) {  // remove quote
-                    value = clone_unicode(css_value, 1, 0);
-                } else {
-                    value = css_value; Py_INCREF(value);
-                }
-                UNESCAPE(value, NEWLINE_UNESCAPE);
-                UNESCAPE(value, SIMPLE_UNESCAPE);
-                UNESCAPE(value, UNICODE_UNESCAPE);
-            } else {
-                value = css_value; Py_INCREF(value);
-            }  // if(type_ == ...)
-
-            if (unit == NULL) { unit = Py_None; Py_INCREF(unit); }
-            item = Py_BuildValue("OOOOnn", type_name, css_value, value, unit, line, column);
-            if (item == NULL) goto error;
-            token = PyObject_CallObject((PyObject *) &tokenizer_TokenType, item);
-            Py_DECREF(item); item = NULL;
-            if (token == NULL) goto error;
-            if (PyList_Append(tokens, token) != 0) { Py_DECREF(token); token = NULL; goto error; }
-            Py_DECREF(token);
+            if (PyList_Append(tokens, token) != 0) goto error;
+            Py_DECREF(token); token = NULL;
 
         }  // if(!(ignore_comments...
 
         Py_XDECREF(match); match = NULL;
 
+        count_nl_run(pos, next_pos);
         pos = next_pos;
-        newlines = PyObject_CallFunctionObjArgs(FIND_NEWLINES, css_value, NULL);
-        if (newlines == NULL) goto error;
-        Py_XDECREF(css_value); css_value = NULL; Py_XDECREF(type_name); type_name = NULL; Py_XDECREF(value); value = NULL; Py_XDECREF(unit); unit = NULL;
-        if (PyObject_IsTrue(newlines)) {
-            line += PyList_Size(newlines);
-            item = PyObject_CallMethod(PyList_GET_ITEM(newlines, PyList_Size(newlines) - 1), "end", NULL);
-            if (item == NULL) { Py_DECREF(newlines); newlines = NULL; goto error; }
-            column = PyNumber_AsSsize_t(item, PyExc_OverflowError);
-            if(column == -1 && PyErr_Occurred()) { Py_DECREF(newlines); newlines = NULL; goto error; }
-            column = length - column + 1;
-            Py_DECREF(item); item = NULL;
+        if (nl_count > 0) {
+            line += nl_count;
+            column = length - nl_last_end + 1;
         } else column += length;
-        Py_DECREF(newlines); newlines = NULL;
 
     }  // while (pos < ...)
 
-    return tokens;
+    return 0;
 error:
-    Py_XDECREF(tokens); Py_XDECREF(css_value); Py_XDECREF(type_name); Py_XDECREF(value); Py_XDECREF(unit); Py_XDECREF(match);
-    return NULL;
+    Py_XDECREF(token); Py_XDECREF(value); Py_XDECREF(match);
+    return -1;
 #undef unicode_from_data
 #undef first_char
+#undef char_at
+#undef scan_ws_run
+#undef scan_nm_run
+#undef count_nl_run
+}
+
+static PyObject*
+tokenize_flat(PyObject *self, PyObject *args) {
+    PyObject *ic = NULL, *py_source = NULL, *tokens = NULL;
+    int ignore_comments = 0;
+
+    if (COMPILED_TOKEN_REGEXPS == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tokenizer module not initialized. You must call init() first."); return NULL;
+    }
+
+    if (!PyArg_ParseTuple(args, "UO", &py_source, &ic)) return NULL;
+    if (PyObject_IsTrue(ic)) ignore_comments = 1;
+
+    tokens = PyList_New(0);
+    if (tokens == NULL) return PyErr_NoMemory();
+    if (tokenize_span(tokens, py_source, ignore_comments, 0, 1, 1) != 0) { Py_DECREF(tokens); return NULL; }
+    return tokens;
 }
 
+// Parallel batch tokenization {{{
+// The CSS files in a book are independent, so the scanning phase of
+// tokenization can proceed across a pool of native threads with the GIL
+// released. Workers segment each sheet into token spans using only the
+// pure C scanners (no python objects are touched), recording the line and
+// column of every token as they go. The tokens themselves are then created
+// from the recorded segments under the GIL, which is cheap since tokens
+// are lazy. When a worker encounters a construct it cannot delimit with
+// certainty in pure C (an escape, a non-ASCII token start, anything that
+// might be a URI or UNICODE-RANGE), it stops, and the rest of that sheet
+// is tokenized by the ordinary serial code path.
+
+#define SEG_SINGLE 1
+#define SEG_EOF_BAD_STRING 2
+
+#if PY_VERSION_HEX >= 0x03030000
+typedef Py_UCS4 css_char;
+#else
+typedef Py_UNICODE css_char;
+#endif
+
+struct css_segment {
+    Py_ssize_t start, length, split, type_id, line, column;
+    int flags;
+};
+
+struct sheet_task {
+#if PY_VERSION_HEX >= 0x03030000
+    int kind;
+    const void *data;
+#else
+    const Py_UNICODE *data;
+#endif
+    Py_ssize_t len;
+    struct css_segment *segments;
+    Py_ssize_t seg_count, seg_cap;
+    Py_ssize_t tail_pos, tail_line, tail_column;
+    int ok;
+};
+
+#if PY_VERSION_HEX >= 0x03030000
+#define sheet_char(t, i) PyUnicode_READ((t)->kind, (t)->data, (i))
+#define sheet_scan_ws(t, p) scan_whitespace((t)->kind, (t)->data, (p), (t)->len)
+#define sheet_scan_nm(t, p) scan_nmchars((t)->kind, (t)->data, (p), (t)->len)
+#define sheet_count_nl(t, p, e) count_newlines((t)->kind, (t)->data, (p), (e), &nl_count, &nl_last_end)
+#else
+#define sheet_char(t, i) ((t)->data[(i)])
+#define sheet_scan_ws(t, p) scan_whitespace((t)->data, (p), (t)->len)
+#define sheet_scan_nm(t, p) scan_nmchars((t)->data, (p), (t)->len)
+#define sheet_count_nl(t, p, e) count_newlines((t)->data, (p), (e), &nl_count, &nl_last_end)
+#endif
+
+#define is_ascii_alpha(c) ('a' <= ((c) | 32) && ((c) | 32) <= 'z')
+#define is_ascii_digit(c) ('0' <= (c) && (c) <= '9')
+// The unquoted URI target character class from token_data.py:
+// [!#$%&*-\[\]-~]|{nonascii}
+#define is_uri_char(c) ((33 <= (c) && (c) <= 126 && (c) != '"' && (c) != '\'' && (c) != '(' && (c) != ')' && (c) != '\\') || (c) >= 160)
+
+// Which low codepoints have no token regexps dispatched to them at all and
+// therefore always produce DELIM tokens. Filled in under the GIL before the
+// workers start.
+static unsigned char certain_delim[161];
+
+static int
+add_segment(struct sheet_task *t, Py_ssize_t start, Py_ssize_t length, Py_ssize_t split, Py_ssize_t type_id, int flags, Py_ssize_t line, Py_ssize_t column) {
+    struct css_segment *s;
+    if (t->seg_count >= t->seg_cap) {
+        Py_ssize_t ncap = t->seg_cap ? 2 * t->seg_cap : 256;
+        s = (struct css_segment *)realloc(t->segments, ncap * sizeof(struct css_segment));
+        if (s == NULL) return 0;
+        t->segments = s; t->seg_cap = ncap;
+    }
+    s = t->segments + t->seg_count++;
+    s->start = start; s->length = length; s->split = split; s->type_id = type_id; s->flags = flags; s->line = line; s->column = column;
+    return 1;
+}
+
+// Does a num token (from token_data.py: [-+]?(?:[0-9]*\.[0-9]+|[0-9]+))
+// start at pos? Only called when the character at pos is one of +-.
+static int
+num_starts_at(const struct sheet_task *t, Py_ssize_t pos) {
+    css_char c = sheet_char(t, pos), nc;
+    Py_ssize_t i = pos;
+    if (c == '+' || c == '-') {
+        i++;
+        if (i >= t->len) return 0;
+        nc = sheet_char(t, i);
+        if (is_ascii_digit(nc)) return 1;
+        if (nc != '.') return 0;
+    }
+    i++;
+    return i < t->len && is_ascii_digit(sheet_char(t, i));
+}
+
+// The end of the maximal num match starting at pos
+static Py_ssize_t
+scan_num_run(const struct sheet_task *t, Py_ssize_t pos) {
+    Py_ssize_t i = pos;
+    css_char c = sheet_char(t, i);
+    if (c == '+' || c == '-') i++;
+    while (i < t->len && is_ascii_digit(sheet_char(t, i))) i++;
+    if (i + 1 < t->len && sheet_char(t, i) == '.' && is_ascii_digit(sheet_char(t, i + 1))) {
+        i += 2;
+        while (i < t->len && is_ascii_digit(sheet_char(t, i))) i++;
+    }
+    return i;
+}
+
+// Split a sheet into token spans, using only pure C (this runs without the
+// GIL). Every segment produced here is guaranteed to be exactly the token
+// the regexps would produce. Stops at the first position that needs the
+// regex engine, recording it (with its line/column) as the tail.
+static void
+segment_sheet(struct sheet_task *t) {
+    Py_ssize_t pos = 0, line = 1, column = 1, end = 0, split = 0, type_id = -1, u0 = 0, i = 0, nl_count = 0, nl_last_end = 0, length = 0;
+    int flags = 0;
+    css_char c = 0, nc = 0, c2 = 0;
+
+    while (pos < t->len) {
+        c = sheet_char(t, pos);
+        end = pos + 1; split = 0; type_id = -1; flags = 0;
+
+        if (c == ':' || c == ';' || c == '(' || c == ')' || c == '{' || c == '}' || c == '[' || c == ']') {
+            flags = SEG_SINGLE;
+        } else
+
+        if (is_css_space(c)) {
+            end = sheet_scan_ws(t, pos + 1); type_id = S;
+        } else
+
+        // IDENT or FUNCTION (idents starting with u may be URI or
+        // UNICODE-RANGE tokens, those are left for the regexps)
+        if (c == '_' || (is_ascii_alpha(c) && (c | 32) != 'u') ||
+            (c == '-' && pos + 1 < t->len && ((c2 = sheet_char(t, pos + 1)) == '_' || is_ascii_alpha(c2)))) {
+            end = sheet_scan_nm(t, pos + 1);
+            nc = (end < t->len) ? sheet_char(t, end) : 0;
+            if (nc == '\\' || nc >= 160) goto bail;
+            if (nc == '(') { end++; type_id = FUNCTION; }
+            else type_id = IDENT;
+        } else
+
+        // NUMBER, PERCENTAGE or DIMENSION
+        if (is_ascii_digit(c) || ((c == '+' || c == '-' || c == '.') && num_starts_at(t, pos))) {
+            end = scan_num_run(t, pos);
+            nc = (end < t->len) ? sheet_char(t, end) : 0;
+            if (nc == '\\' || nc >= 160) goto bail;
+            if (nc == '%') { end++; type_id = PERCENTAGE; }
+            else if (nc == '_' || is_ascii_alpha(nc) || nc == '-') {
+                u0 = end;
+                if (nc == '-') {
+                    c2 = (u0 + 1 < t->len) ? sheet_char(t, u0 + 1) : 0;
+                    if (c2 == '\\' || c2 >= 160) goto bail;
+                    // a - not followed by an ident start cannot be a unit
+                    if (!(c2 == '_' || is_ascii_alpha(c2))) { type_id = NUMBER; goto have; }
+                }
+                end = sheet_scan_nm(t, u0 + 1);
+                nc = (end < t->len) ? sheet_char(t, end) : 0;
+                if (nc == '\\' || nc >= 160) goto bail;
+                split = u0 - pos; type_id = DIMENSION;
+            }
+            else type_id = NUMBER;
+        } else
+
+        if (c == '-') {  // not a number or ident start, may be CDC
+            if (pos + 3 <= t->len && sheet_char(t, pos + 1) == '-' && sheet_char(t, pos + 2) == '>') { end = pos + 3; type_id = CDC; }
+            else {
+                nc = (pos + 1 < t->len) ? sheet_char(t, pos + 1) : 0;
+                if (nc == '\\' || nc >= 160) goto bail;  // might be an escaped/nonascii ident start
+                type_id = DELIM;
+            }
+        } else
+
+        if (c == '+' || c == '.') {  // not a number start (checked above)
+            type_id = DELIM;
+        } else
+
+        if (c == '#') {
+            nc = (pos + 1 < t->len) ? sheet_char(t, pos + 1) : 0;
+            if (is_ascii_nmchar(nc)) {
+                end = sheet_scan_nm(t, pos + 1);
+                nc = (end < t->len) ? sheet_char(t, end) : 0;
+                if (nc == '\\' || nc >= 160) goto bail;
+                type_id = HASH;
+            } else if (nc == '\\' || nc >= 160) goto bail;
+            else type_id = DELIM;
+        } else
+
+        if (c == '@') {
+            nc = (pos + 1 < t->len) ? sheet_char(t, pos + 1) : 0;
+            if (nc == '_' || is_ascii_alpha(nc) ||
+                (nc == '-' && pos + 2 < t->len && ((c2 = sheet_char(t, pos + 2)) == '_' || is_ascii_alpha(c2)))) {
+                end = sheet_scan_nm(t, pos + 1);
+                nc = (end < t->len) ? sheet_char(t, end) : 0;
+                if (nc == '\\' || nc >= 160) goto bail;
+                type_id = ATKEYWORD;
+            } else if (nc == '\\' || nc >= 160 || nc == '-') goto bail;
+            else type_id = DELIM;
+        } else
+
+        if (c == '/') {
+            if (pos + 1 < t->len && sheet_char(t, pos + 1) == '*') {
+                for (i = pos + 2; i + 1 < t->len; i++) {
+                    if (sheet_char(t, i) == '*' && sheet_char(t, i + 1) == '/') break;
+                }
+                if (i + 1 < t->len) { end = i + 2; type_id = COMMENT; }
+                // the extent of an unterminated comment is subtle (the
+                // BAD_COMMENT regexp must end on a *), leave it alone
+                else goto bail;
+            } else type_id = DELIM;
+        } else
+
+        if (c == '"' || c == '\'') {
+            type_id = -2;
+            for (i = pos + 1; i < t->len; i++) {
+                nc = sheet_char(t, i);
+                if (nc == c) { end = i + 1; type_id = STRING; break; }
+                if (nc == '\\') goto bail;  // escapes are for the regexps
+                if (nc == '\n' || nc == '\r' || nc == '\f') { end = i; type_id = BAD_STRING; break; }
+            }
+            if (type_id == -2) { end = t->len; type_id = BAD_STRING; flags = SEG_EOF_BAD_STRING; }
+        } else
+
+        if (c == '<') {
+            if (pos + 4 <= t->len && sheet_char(t, pos + 1) == '!' && sheet_char(t, pos + 2) == '-' && sheet_char(t, pos + 3) == '-') { end = pos + 4; type_id = CDO; }
+            else type_id = DELIM;
+        } else
+
+        // url(...) with an unquoted, escape-free target. Anything else
+        // starting with u (UNICODE-RANGE, quoted or escaped URIs, plain
+        // idents) is left for the regexps.
+        if ((c | 32) == 'u') {
+            if (!(pos + 3 < t->len && (sheet_char(t, pos + 1) | 32) == 'r' && (sheet_char(t, pos + 2) | 32) == 'l' && sheet_char(t, pos + 3) == '(')) goto bail;
+            i = pos + 4;
+            while (i < t->len && is_css_space(sheet_char(t, i))) i++;
+            u0 = i;  // start of the URI target
+            while (i < t->len && is_uri_char(sheet_char(t, i))) i++;
+            while (i < t->len && is_css_space(sheet_char(t, i))) i++;
+            if (i >= t->len || sheet_char(t, i) != ')') goto bail;  // looks like a BAD_URI
+            end = i + 1; split = u0 - pos; type_id = URI;
+        } else
+
+        if (c < 160 && certain_delim[c]) {
+            type_id = DELIM;
+        } else goto bail;
+
+have:
+        if (!add_segment(t, pos, end - pos, split, type_id, flags, line, column)) { t->ok = 0; break; }
+        length = end - pos;
+        sheet_count_nl(t, pos, end);
+        if (nl_count > 0) { line += nl_count; column = length - nl_last_end + 1; }
+        else column += length;
+        pos = end;
+    }
+bail:
+    t->tail_pos = pos; t->tail_line = line; t->tail_column = column;
+}
+
+// Fill certain_delim from TOKEN_DISPATCH. Must be called under the GIL
+// before segment_sheet() can run.
+static void
+fill_certain_delim(void) {
+    Py_ssize_t i;
+    for (i = 0; i < 161; i++)
+        certain_delim[i] = PyList_GET_SIZE(PyList_GET_ITEM(TOKEN_DISPATCH, i)) == 0;
+}
+
+// Build the (lazy) token list for a sheet from its recorded segments,
+// tokenizing whatever could not be segmented with the serial code path.
+static PyObject*
+tokens_from_segments(PyObject *src, struct sheet_task *t, int ignore_comments) {
+    PyObject *tokens = NULL, *type_name = NULL, *token = NULL;
+    struct css_segment *s = NULL;
+    Py_ssize_t j = 0, num_tokens = 0, type_ = -1;
+    css_char ch;
+
+    for (j = 0; j < t->seg_count; j++) {
+        s = t->segments + j;
+        if (ignore_comments && (s->type_id == COMMENT || s->type_id == BAD_COMMENT)) continue;
+        num_tokens++;
+    }
+    tokens = PyList_New(num_tokens);
+    if (tokens == NULL) return PyErr_NoMemory();
+    num_tokens = 0;
+    for (j = 0; j < t->seg_count; j++) {
+        s = t->segments + j;
+        type_ = s->type_id;
+        if (s->flags & SEG_SINGLE) {
+            ch = sheet_char(t, s->start);
+            type_ = -1;
+            switch (ch) {
+                case ':': type_name = COLON; break;
+                case ';': type_name = SCOLON; break;
+                case '(': type_name = LPAR; break;
+                case ')': type_name = RPAR; break;
+                case '{': type_name = LBRACE; break;
+                case '}': type_name = RBRACE; break;
+                case '[': type_name = LBOX; break;
+                default: type_name = RBOX; break;
+            }
+        }
+        else if (type_ == DELIM) type_name = DELIM_TOK;
+        else if (s->flags & SEG_EOF_BAD_STRING) type_name = STRING_TOK;
+        else type_name = PyTuple_GET_ITEM(PyList_GET_ITEM(COMPILED_TOKEN_REGEXPS, type_), 0);
+        if (ignore_comments && (type_ == COMMENT || type_ == BAD_COMMENT)) continue;
+        token = (PyObject *)Token_create_lazy(src, type_, type_name, s->start, s->length, s->split, (s->flags & SEG_EOF_BAD_STRING) != 0, s->line, s->column);
+        if (token == NULL) goto error;
+        if (type_ == URI) {
+            // segmented URI targets have no quotes or escapes, so the
+            // unescaped value is simply the raw text, sans surrounding
+            // whitespace
+            Py_ssize_t cs = s->start + s->split, ce = s->start + s->length - 1;
+            while (ce > cs && is_css_space(sheet_char(t, ce - 1))) ce--;
+            ((tokenizer_Token *)token)->value = clone_unicode(src, cs, PyUnicode_GET_LENGTH(src) - ce);
+            if (((tokenizer_Token *)token)->value == NULL) { Py_DECREF(token); token = NULL; goto error; }
+            Py_INCREF(Py_None);
+            ((tokenizer_Token *)token)->unit = Py_None;
+        }
+        PyList_SET_ITEM(tokens, num_tokens++, token);  // tokens owns token
+        token = NULL;
+    }
+    // tokenize whatever could not be segmented serially
+    if (t->tail_pos < t->len) {
+        if (tokenize_span(tokens, src, ignore_comments, t->tail_pos, t->tail_line, t->tail_column) != 0) goto error;
+    }
+    return tokens;
+
+error:
+    Py_DECREF(tokens);
+    return NULL;
+}
+
+struct tokenize_many_queue {
+    struct sheet_task *tasks;
+    Py_ssize_t count, next;
+    int active_workers;
+    PyThread_type_lock mutex, done;
+};
+
+static void
+tokenize_many_worker(void *arg) {
+    struct tokenize_many_queue *q = (struct tokenize_many_queue *)arg;
+    while (1) {
+        Py_ssize_t idx;
+        PyThread_acquire_lock(q->mutex, 1);
+        idx = (q->next < q->count) ? q->next++ : -1;
+        PyThread_release_lock(q->mutex);
+        if (idx < 0) break;
+        segment_sheet(q->tasks + idx);
+    }
+    {
+        // The queue must not be touched after signalling done: the main
+        // thread may free the locks as soon as it is woken
+        int last;
+        PyThread_acquire_lock(q->mutex, 1);
+        last = (--q->active_workers == 0);
+        PyThread_release_lock(q->mutex);
+        if (last) PyThread_release_lock(q->done);
+    }
+}
+
+#ifndef TOKENIZE_MANY_DEFAULT_THREADS
+#define TOKENIZE_MANY_DEFAULT_THREADS 8
+#endif
+
+static PyObject*
+py_tokenize_many(PyObject *self, PyObject *args) {
+    PyObject *sources = NULL, *ic = NULL, *seq = NULL, *ans = NULL, *tokens = NULL, *src = NULL;
+    struct tokenize_many_queue q;
+    struct sheet_task *t = NULL;
+    Py_ssize_t n = 0, i = 0, nthreads = 0;
+    int ignore_comments = 0;
+
+    memset(&q, 0, sizeof(q));
+
+    if (COMPILED_TOKEN_REGEXPS == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tokenizer module not initialized. You must call init() first."); return NULL;
+    }
+    if (!PyArg_ParseTuple(args, "OO|n", &sources, &ic, &nthreads)) return NULL;
+    if (PyObject_IsTrue(ic)) ignore_comments = 1;
+    seq = PySequence_Fast(sources, "sources must be a sequence of unicode strings");
+    if (seq == NULL) return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+    ans = PyList_New(n);
+    if (ans == NULL) { Py_DECREF(seq); return PyErr_NoMemory(); }
+    if (n == 0) { Py_DECREF(seq); return ans; }
+
+    q.tasks = (struct sheet_task *)calloc(n, sizeof(struct sheet_task));
+    if (q.tasks == NULL) { PyErr_NoMemory(); goto error; }
+    q.count = n;
+    for (i = 0; i < n; i++) {
+        src = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyUnicode_Check(src)) { PyErr_SetString(PyExc_TypeError, "sources must be a sequence of unicode strings"); goto error; }
+#if PY_VERSION_HEX >= 0x03030000
+        if (PyUnicode_READY(src) != 0) goto error;
+        q.tasks[i].kind = PyUnicode_KIND(src); q.tasks[i].data = PyUnicode_DATA(src);
+#else
+        q.tasks[i].data = PyUnicode_AS_UNICODE(src);
+#endif
+        q.tasks[i].len = PyUnicode_GET_LENGTH(src);
+        q.tasks[i].ok = 1;
+    }
+    fill_certain_delim();
+
+    if (nthreads <= 0) nthreads = TOKENIZE_MANY_DEFAULT_THREADS;
+    if (nthreads > n) nthreads = n;
+    q.mutex = PyThread_allocate_lock();
+    q.done = PyThread_allocate_lock();
+    if (q.mutex == NULL || q.done == NULL) {
+        // could not set up the pool, segment on the calling thread
+        for (i = 0; i < n; i++) segment_sheet(q.tasks + i);
+    } else {
+        q.active_workers = 1;  // the calling thread
+        PyThread_acquire_lock(q.done, 1);
+        for (i = 0; i < nthreads - 1; i++) {
+            PyThread_acquire_lock(q.mutex, 1);
+            q.active_workers++;
+            PyThread_release_lock(q.mutex);
+            if (PyThread_start_new_thread(tokenize_many_worker, &q) == -1) {
+                // could not start a thread, make do with fewer
+                PyThread_acquire_lock(q.mutex, 1);
+                q.active_workers--;
+                PyThread_release_lock(q.mutex);
+                break;
+            }
+        }
+        Py_BEGIN_ALLOW_THREADS;
+        tokenize_many_worker(&q);
+        PyThread_acquire_lock(q.done, 1);  // wait for the pool to drain
+        PyThread_release_lock(q.done);
+        Py_END_ALLOW_THREADS;
+    }
+
+    // Build the token lists from the recorded segments
+    for (i = 0; i < n; i++) {
+        t = q.tasks + i;
+        if (!t->ok) { PyErr_NoMemory(); goto error; }
+        src = PySequence_Fast_GET_ITEM(seq, i);
+        tokens = tokens_from_segments(src, t, ignore_comments);
+        if (tokens == NULL) goto error;
+        PyList_SET_ITEM(ans, i, tokens);  // ans owns tokens
+    }
+    goto end;
+
+error:
+    Py_CLEAR(ans);
+end:
+    if (q.tasks != NULL) {
+        for (i = 0; i < n; i++) free(q.tasks[i].segments);
+        free(q.tasks);
+    }
+    if (q.mutex != NULL) PyThread_free_lock(q.mutex);
+    if (q.done != NULL) PyThread_free_lock(q.done);
+    Py_XDECREF(seq);
+    return ans;
+}
+// }}}
+
+// Token stream cache {{{
+// Conversions tokenize the same stylesheets over and over, as publisher
+// house styles are shared by thousands of books. The segment array for a
+// sheet is therefore persisted to a small binary file in a cache
+// directory, keyed by a content hash of the source text, and on a hit
+// the (lazy) tokens are rebuilt directly from the stored segments
+// without any scanning. A file whose header, payload checksum or
+// segments do not validate is simply ignored and rewritten, so corrupt
+// or stale caches cost only a re-tokenization.
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#endif
+
+#define CSC_MAGIC "calibre-csstok2"
+
+struct csc_header {
+    char magic[16];          // CSC_MAGIC, NUL padded
+    Py_ssize_t seg_size;     // sizeof(struct css_segment), discards caches written by a different build
+    Py_ssize_t src_len;      // length of the source in code units, guards against hash collisions
+    Py_ssize_t seg_count;
+    Py_ssize_t tail_pos, tail_line, tail_column;
+    uint64_t payload_hash;   // FNV-1a of the stored segment array, catches in-bounds corruption
+};
+
+static uint64_t
+csc_fnv1a(const uint8_t *p, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i = 0; i < len; i++) { hash ^= p[i]; hash *= 0x100000001b3ULL; }
+    return hash;
+}
+
+static uint64_t
+csc_hash(const struct sheet_task *t) {
+    // FNV-1a over the raw code unit bytes. CPython always stores text in
+    // its most compact representation, so equal strings hash equally.
+#if PY_VERSION_HEX >= 0x03030000
+    size_t len = (size_t)t->len * t->kind;
+#else
+    size_t len = (size_t)t->len * sizeof(Py_UNICODE);
+#endif
+    return csc_fnv1a((const uint8_t *)t->data, len);
+}
+
+static int
+csc_segments_valid(const struct sheet_task *t) {
+    // The segments drive raw reads of the source text, so a cache file
+    // must prove its offsets are in bounds before they are trusted
+    const struct css_segment *s;
+    Py_ssize_t j, ntypes = PyList_GET_SIZE(COMPILED_TOKEN_REGEXPS);
+    if (t->tail_pos < 0 || t->tail_pos > t->len || t->tail_line < 1 || t->tail_column < 1) return 0;
+    for (j = 0; j < t->seg_count; j++) {
+        s = t->segments + j;
+        if (s->start < 0 || s->length < 1 || s->start + s->length > t->tail_pos) return 0;
+        if (s->split < 0 || s->split > s->length) return 0;
+        if (s->line < 1 || s->column < 1) return 0;
+        if ((s->flags & ~(SEG_SINGLE | SEG_EOF_BAD_STRING)) != 0) return 0;
+        if (!(s->flags & SEG_SINGLE) && (s->type_id < 0 || s->type_id >= ntypes)) return 0;
+    }
+    return 1;
+}
+
+static int
+csc_load(const char *path, struct sheet_task *t) {
+    FILE *fp = NULL;
+    struct csc_header hdr;
+    int ok = 0;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) return 0;
+    if (fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+            memcmp(hdr.magic, CSC_MAGIC, sizeof(CSC_MAGIC)) == 0 &&
+            hdr.seg_size == (Py_ssize_t)sizeof(struct css_segment) &&
+            hdr.src_len == t->len && hdr.seg_count >= 0) {
+        t->segments = (struct css_segment *)malloc((hdr.seg_count ? hdr.seg_count : 1) * sizeof(struct css_segment));
+        if (t->segments != NULL &&
+                fread(t->segments, sizeof(struct css_segment), (size_t)hdr.seg_count, fp) == (size_t)hdr.seg_count &&
+                csc_fnv1a((const uint8_t *)t->segments, (size_t)hdr.seg_count * sizeof(struct css_segment)) == hdr.payload_hash) {
+            t->seg_count = t->seg_cap = hdr.seg_count;
+            t->tail_pos = hdr.tail_pos; t->tail_line = hdr.tail_line; t->tail_column = hdr.tail_column;
+            ok = csc_segments_valid(t);
+        }
+        if (!ok) { free(t->segments); t->segments = NULL; t->seg_count = t->seg_cap = 0; }
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void
+csc_save(const char *path, const struct sheet_task *t) {
+    // Persisted on a best effort basis: the file is written to a
+    // temporary name in the same directory and renamed into place, so a
+    // reader never sees a partially written cache and a crash mid-write
+    // leaves the old file intact
+    FILE *fp = NULL;
+    struct csc_header hdr;
+    char *tmp = NULL;
+    size_t plen = strlen(path);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CSC_MAGIC, sizeof(CSC_MAGIC));
+    hdr.seg_size = (Py_ssize_t)sizeof(struct css_segment);
+    hdr.src_len = t->len;
+    hdr.seg_count = t->seg_count;
+    hdr.tail_pos = t->tail_pos; hdr.tail_line = t->tail_line; hdr.tail_column = t->tail_column;
+    hdr.payload_hash = csc_fnv1a((const uint8_t *)t->segments, (size_t)t->seg_count * sizeof(struct css_segment));
+
+    tmp = (char *)malloc(plen + 32);
+    if (tmp == NULL) return;
+#ifdef _WIN32
+    sprintf(tmp, "%s.%u.tmp", path, (unsigned)_getpid());
+    fp = fopen(tmp, "wb");
+    if (fp == NULL) { free(tmp); return; }
+#else
+    sprintf(tmp, "%s.XXXXXX", path);
+    {
+        int fd = mkstemp(tmp);
+        if (fd == -1) { free(tmp); return; }
+        fp = fdopen(fd, "wb");
+        if (fp == NULL) { close(fd); remove(tmp); free(tmp); return; }
+    }
+#endif
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+            (t->seg_count > 0 && fwrite(t->segments, sizeof(struct css_segment), (size_t)t->seg_count, fp) != (size_t)t->seg_count)) {
+        fclose(fp); remove(tmp); free(tmp); return;
+    }
+    fclose(fp);
+#ifdef _WIN32
+    if (!MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING)) remove(tmp);
+#else
+    if (rename(tmp, path) != 0) remove(tmp);
+#endif
+    free(tmp);
+}
+
+static PyObject*
+py_tokenize_cached(PyObject *self, PyObject *args) {
+    PyObject *py_source = NULL, *ic = NULL, *ans = NULL;
+    const char *cache_dir = NULL;
+    char *path = NULL;
+    struct sheet_task t;
+    int ignore_comments = 0;
+
+    memset(&t, 0, sizeof(t));
+
+    if (COMPILED_TOKEN_REGEXPS == NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "tokenizer module not initialized. You must call init() first."); return NULL;
+    }
+    if (!PyArg_ParseTuple(args, "UsO", &py_source, &cache_dir, &ic)) return NULL;
+    if (PyObject_IsTrue(ic)) ignore_comments = 1;
+
+#if PY_VERSION_HEX >= 0x03030000
+    if (PyUnicode_READY(py_source) != 0) return NULL;
+    t.kind = PyUnicode_KIND(py_source); t.data = PyUnicode_DATA(py_source);
+#else
+    t.data = PyUnicode_AS_UNICODE(py_source);
+#endif
+    t.len = PyUnicode_GET_LENGTH(py_source);
+    t.ok = 1;
+
+    path = (char *)malloc(strlen(cache_dir) + 32);
+    if (path == NULL) return PyErr_NoMemory();
+    sprintf(path, "%s/%016llx.csstok", cache_dir, (unsigned long long)csc_hash(&t));
+
+    if (!csc_load(path, &t)) {
+        fill_certain_delim();
+        Py_BEGIN_ALLOW_THREADS;
+        segment_sheet(&t);
+        Py_END_ALLOW_THREADS;
+        if (!t.ok) { free(path); free(t.segments); return PyErr_NoMemory(); }
+        csc_save(path, &t);
+    }
+    free(path);
+
+    ans = tokens_from_segments(py_source, &t, ignore_comments);
+    free(t.segments);
+    return ans;
+}
+// }}}
+
 static PyMethodDef tokenizer_methods[] = {
     {"tokenize_flat", tokenize_flat, METH_VARARGS,
         "tokenize_flat(css_source, ignore_comments)\n\n Convert CSS source into a flat list of tokens"
     },
 
+    {"tokenize_many", py_tokenize_many, METH_VARARGS,
+        "tokenize_many(css_sources, ignore_comments, n_threads=8)\n\n Tokenize several CSS sources in parallel, returning a list of flat token lists, one per source"
+    },
+
+    {"tokenize_cached", py_tokenize_cached, METH_VARARGS,
+        "tokenize_cached(css_source, cache_dir, ignore_comments)\n\n Like tokenize_flat(), but persists the scanned token stream in cache_dir, keyed by a hash of the source, so that repeated stylesheets skip tokenization"
+    },
+
     {"init", tokenize_init, METH_VARARGS,
         "init()\n\nInitialize the module."
     },
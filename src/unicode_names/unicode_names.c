@@ -6,6 +6,41 @@
  */
 
 #include "names.h"
+#include <zlib.h>
+
+// The codepoint names are stored zlib compressed in NUL separated blocks of
+// NAMES_PER_BLOCK names (see names.h). The compressed blob lives in .rodata,
+// so the dynamic loader maps it read-only straight from the shared library
+// and untouched blocks are never paged in. A block is decompressed on first
+// use; lookups cluster, so a few cached blocks cover almost all of them.
+#define NAME_CACHE_SLOTS 4
+static struct {
+    uint32_t block;  // block number + 1, 0 means the slot is empty
+    char data[MAX_UNCOMPRESSED_NAME_BLOCK];
+} name_cache[NAME_CACHE_SLOTS];
+static unsigned name_cache_pos = 0;
+
+static const char*
+name_for_codepoint(char_type cp) {
+    char_type m = mark_for_codepoint(cp); if (m == 0) return NULL;
+    uint32_t block = m / NAMES_PER_BLOCK, idx = m % NAMES_PER_BLOCK;
+    const char *data = NULL;
+    for (unsigned i = 0; i < NAME_CACHE_SLOTS; i++) {
+        if (name_cache[i].block == block + 1) { data = name_cache[i].data; break; }
+    }
+    if (data == NULL) {
+        unsigned slot = name_cache_pos++ % NAME_CACHE_SLOTS;
+        uLongf usz = MAX_UNCOMPRESSED_NAME_BLOCK;
+        name_cache[slot].block = 0;
+        if (uncompress((Bytef*)name_cache[slot].data, &usz,
+                    compressed_name_data + name_block_offsets[block],
+                    name_block_offsets[block + 1] - name_block_offsets[block]) != Z_OK) return NULL;
+        name_cache[slot].block = block + 1;
+        data = name_cache[slot].data;
+    }
+    while (idx--) data += strlen(data) + 1;
+    return data;
+}
 
 static inline void
 add_matches(const word_trie *wt, char_type *codepoints, size_t *pos, const size_t sz) {
@@ -27,13 +62,13 @@ process_trie_node(const word_trie *wt, char_type *codepoints, size_t *pos, const
     }
 }
 
-static inline PyObject*
-codepoints_for_word(const char *word, size_t len) {
+static const word_trie*
+find_trie_node(const char *word, size_t len) {
     const word_trie *wt = all_trie_nodes;
     for (size_t i = 0; i < len; i++) {
         unsigned char ch = word[i];
         size_t num_children = children_array[wt->children_offset];
-        if (!num_children) return PyFrozenSet_New(NULL);
+        if (!num_children) return NULL;
         bool found = false;
         for (size_t c = wt->children_offset + 1; c < wt->children_offset + 1 + num_children; c++) {
             uint32_t x = children_array[c];
@@ -43,8 +78,15 @@ codepoints_for_word(const char *word, size_t len) {
                 break;
             }
         }
-        if (!found) return PyFrozenSet_New(NULL);
+        if (!found) return NULL;
     }
+    return wt;
+}
+
+static inline PyObject*
+codepoints_for_word(const char *word, size_t len) {
+    const word_trie *wt = find_trie_node(word, len);
+    if (wt == NULL) return PyFrozenSet_New(NULL);
     static char_type codepoints[1024];
     size_t cpos = 0;
     process_trie_node(wt, codepoints, &cpos, arraysz(codepoints));
@@ -63,6 +105,123 @@ cfw(PyObject *self UNUSED, PyObject *args) {
     return codepoints_for_word(word, strlen(word));
 }
 
+static int
+cmp_char_type(const void *a, const void *b) {
+    char_type x = *(const char_type*)a, y = *(const char_type*)b;
+    return (x > y) - (x < y);
+}
+
+#define MAX_WORD_CODEPOINTS 1024
+
+static size_t
+sorted_codepoints_for_word(const char *word, size_t len, char_type *buf) {
+    const word_trie *wt = find_trie_node(word, len);
+    if (wt == NULL) return 0;
+    size_t n = 0, m = 0;
+    process_trie_node(wt, buf, &n, MAX_WORD_CODEPOINTS);
+    if (!n) return 0;
+    qsort(buf, n, sizeof(char_type), cmp_char_type);
+    for (size_t i = 1; i < n; i++) { if (buf[i] != buf[m]) buf[++m] = buf[i]; }
+    return m + 1;
+}
+
+// First position in arr[start:n] whose value is >= key, found by exponential
+// probing followed by a binary search over the bracketed range
+static size_t
+gallop_lower_bound(const char_type *arr, size_t start, size_t n, char_type key) {
+    size_t lo = start, hi = start, step = 1;
+    while (hi < n && arr[hi] < key) { lo = hi + 1; hi += step; step *= 2; }
+    if (hi > n) hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (arr[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Intersects sorted arrays in place into a, galloping past the gaps
+static size_t
+intersect_sorted(char_type *a, size_t na, const char_type *b, size_t nb) {
+    size_t out = 0, i = 0, j = 0;
+    while (i < na && j < nb) {
+        if (a[i] == b[j]) { a[out++] = a[i]; i++; j++; }
+        else if (a[i] < b[j]) i = gallop_lower_bound(a, i + 1, na, b[j]);
+        else j = gallop_lower_bound(b, j + 1, nb, a[i]);
+    }
+    return out;
+}
+
+static PyObject*
+cfws(PyObject *self UNUSED, PyObject *args) {
+    PyObject *words, *fast = NULL, *ans = NULL;
+    char_type *acc = NULL, *buf = NULL;
+    size_t acc_n = 0;
+    if (!PyArg_ParseTuple(args, "O", &words)) return NULL;
+    fast = PySequence_Fast(words, "words must be a sequence of strings");
+    if (fast == NULL) return NULL;
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(fast);
+    if (count == 0) { Py_DECREF(fast); return PyFrozenSet_New(NULL); }
+    acc = malloc(2 * MAX_WORD_CODEPOINTS * sizeof(char_type));
+    if (acc == NULL) { Py_DECREF(fast); return PyErr_NoMemory(); }
+    buf = acc + MAX_WORD_CODEPOINTS;
+    for (Py_ssize_t w = 0; w < count; w++) {
+        PyObject *item = PySequence_Fast_GET_ITEM(fast, w), *utf8 = NULL;
+        const char *word;
+        if (PyBytes_Check(item)) word = PyBytes_AS_STRING(item);
+        else {
+            utf8 = PyUnicode_AsUTF8String(item);
+            if (utf8 == NULL) goto end;
+            word = PyBytes_AS_STRING(utf8);
+        }
+        if (w == 0) acc_n = sorted_codepoints_for_word(word, strlen(word), acc);
+        else {
+            size_t bn = sorted_codepoints_for_word(word, strlen(word), buf);
+            acc_n = intersect_sorted(acc, acc_n, buf, bn);
+        }
+        Py_XDECREF(utf8);
+        if (!acc_n) break;
+    }
+    ans = PyFrozenSet_New(NULL);
+    if (ans == NULL) goto end;
+    for (size_t i = 0; i < acc_n; i++) {
+        PyObject *t = PyLong_FromUnsignedLong(acc[i]); if (t == NULL) { Py_CLEAR(ans); goto end; }
+        int ret = PySet_Add(ans, t); Py_DECREF(t); if (ret != 0) { Py_CLEAR(ans); goto end; }
+    }
+end:
+    free(acc); Py_DECREF(fast);
+    return ans;
+}
+
+static PyObject*
+cfp(PyObject *self UNUSED, PyObject *args) {
+    const char *prefix;
+    unsigned long limit = 128;
+    if (!PyArg_ParseTuple(args, "s|k", &prefix, &limit)) return NULL;
+    if (limit > 65536) limit = 65536;
+    const word_trie *wt = find_trie_node(prefix, strlen(prefix));
+    if (wt == NULL || limit == 0) return PyTuple_New(0);
+    char_type *codepoints = malloc(limit * sizeof(char_type));
+    if (codepoints == NULL) return PyErr_NoMemory();
+    size_t cpos = 0;
+    process_trie_node(wt, codepoints, &cpos, limit);
+    // The same codepoint can appear under several words in the subtree,
+    // dedupe while preserving trie order
+    PyObject *ans = NULL, *seen = PySet_New(NULL), *list = PyList_New(0);
+    if (seen == NULL || list == NULL) goto end;
+    for (size_t i = 0; i < cpos; i++) {
+        PyObject *t = PyLong_FromUnsignedLong(codepoints[i]); if (t == NULL) goto end;
+        int dup = PySet_Contains(seen, t);
+        if (dup == 0 && (PySet_Add(seen, t) != 0 || PyList_Append(list, t) != 0)) dup = -1;
+        Py_DECREF(t);
+        if (dup < 0) goto end;
+    }
+    ans = PyList_AsTuple(list);
+end:
+    free(codepoints); Py_XDECREF(seen); Py_XDECREF(list);
+    return ans;
+}
+
 static PyObject*
 nfc(PyObject *self UNUSED, PyObject *args) {
     unsigned int cp;
@@ -76,6 +235,17 @@ static PyMethodDef unicode_names_methods[] = {
     {"codepoints_for_word", (PyCFunction)cfw, METH_VARARGS,
      "Return a set of integer codepoints for where each codepoint's name "
      "contains ``word``,"},
+    {"codepoints_for_words", (PyCFunction)cfws, METH_VARARGS,
+     "codepoints_for_words(words)\n\n"
+     "Return a frozenset of codepoints whose names contain every word in "
+     "``words``. The per word matches are intersected as sorted arrays in C "
+     "with a galloping merge, no intermediate sets are built."},
+    {"codepoints_for_prefix", (PyCFunction)cfp, METH_VARARGS,
+     "codepoints_for_prefix(prefix, limit=128)\n\n"
+     "Return a tuple of up to ``limit`` codepoints, in trie order, whose "
+     "names contain a word starting with ``prefix``. Meant for "
+     "search-as-you-type, each lookup costs O(len(prefix)) plus the "
+     "size of the returned window."},
     {"name_for_codepoint", (PyCFunction)nfc, METH_VARARGS,
      "Returns the given codepoint's name"},
     {NULL, NULL, 0, NULL}        /* Sentinel */